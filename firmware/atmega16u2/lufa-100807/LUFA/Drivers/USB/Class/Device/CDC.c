@@ -143,6 +143,38 @@ uint8_t CDC_Device_SendString(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo
 	return Endpoint_Write_Stream_LE(Data, Length, NO_STREAM_CALLBACK);
 }
 
+uint16_t CDC_Device_SendData(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+                             const void* const Buffer,
+                             uint16_t Length)
+{
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
+	  return 0;
+
+	const uint8_t* Data      = (const uint8_t*)Buffer;
+	uint16_t       BytesSent = 0;
+
+	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataINEndpointNumber);
+
+	while (Length && Endpoint_IsINReady())
+	{
+		uint16_t BankSpace = (CDCInterfaceInfo->Config.DataINEndpointSize - Endpoint_BytesInEndpoint());
+
+		if (BankSpace > Length)
+		  BankSpace = Length;
+
+		Endpoint_Write_Block(Data, BankSpace);
+		Data      += BankSpace;
+		BytesSent += BankSpace;
+		Length    -= BankSpace;
+
+		/* Send full banks straight away, so that CDC_Device_Flush() doesn't follow them with a ZLP */
+		if (!(Endpoint_IsReadWriteAllowed()))
+		  Endpoint_ClearIN();
+	}
+
+	return BytesSent;
+}
+
 uint8_t CDC_Device_SendByte(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
                             const uint8_t Data)
 {
@@ -238,6 +270,37 @@ int16_t CDC_Device_ReceiveByte(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInf
 	return ReceivedByte;
 }
 
+uint16_t CDC_Device_ReceiveData(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+                                void* const Buffer,
+                                uint16_t Length)
+{
+	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
+	  return 0;
+
+	uint8_t* Data          = (uint8_t*)Buffer;
+	uint16_t BytesReceived = 0;
+
+	Endpoint_SelectEndpoint(CDCInterfaceInfo->Config.DataOUTEndpointNumber);
+
+	while (Length && Endpoint_IsOUTReceived())
+	{
+		uint16_t BytesInEndpoint = Endpoint_BytesInEndpoint();
+
+		if (BytesInEndpoint > Length)
+		  BytesInEndpoint = Length;
+
+		Endpoint_Read_Block(Data, BytesInEndpoint);
+		Data          += BytesInEndpoint;
+		BytesReceived += BytesInEndpoint;
+		Length        -= BytesInEndpoint;
+
+		if (!(Endpoint_BytesInEndpoint()))
+		  Endpoint_ClearOUT();
+	}
+
+	return BytesReceived;
+}
+
 void CDC_Device_SendControlLineStateChange(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo)
 {
 	if ((USB_DeviceState != DEVICE_STATE_Configured) || !(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS))
@@ -217,6 +217,25 @@
 			                              const char* const Data,
 			                              const uint16_t Length) ATTR_NON_NULL_PTR_ARG(1) ATTR_NON_NULL_PTR_ARG(2);
 			
+			/** Sends up to the given number of bytes to the attached USB host, without waiting for a free endpoint bank. This
+			 *  is the bulk version of \ref CDC_Device_SendByte(): each free bank is filled with as many bytes as fit, eight bytes
+			 *  per loop iteration, rather than checking the bank before every byte. Full banks are sent straight away, a partially
+			 *  filled last bank is left for \ref CDC_Device_Flush(). The function returns as soon as no bank is free, the caller
+			 *  keeps the rest of the data for a later call.
+			 *
+			 *  \pre This function must only be called when the Device state machine is in the DEVICE_STATE_Configured state or
+			 *       the call will fail.
+			 *
+			 *  \param[in,out] CDCInterfaceInfo  Pointer to a structure containing a CDC Class configuration and state.
+			 *  \param[in]     Buffer            Pointer to the data to send to the host.
+			 *  \param[in]     Length            Size in bytes of the data to send to the host.
+			 *
+			 *  \return Number of bytes queued for the host, zero if no bank was free or the host is not connected.
+			 */
+			uint16_t CDC_Device_SendData(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+			                             const void* const Buffer,
+			                             uint16_t Length) ATTR_NON_NULL_PTR_ARG(1) ATTR_NON_NULL_PTR_ARG(2);
+
 			/** Sends a given byte to the attached USB host, if connected. If a host is not connected when the function is called, the
 			 *  byte is discarded. Bytes will be queued for transmission to the host until either the endpoint bank becomes full, or the
 			 *  \ref CDC_Device_Flush() function is called to flush the pending data to the host. This allows for multiple bytes to be 
@@ -260,6 +279,24 @@
 			 *  \return Next received byte from the host, or a negative value if no data received.
 			 */
 			int16_t CDC_Device_ReceiveByte(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo) ATTR_NON_NULL_PTR_ARG(1);
+
+			/** Reads up to the given number of bytes received from the host, without waiting for more. This is the bulk
+			 *  version of \ref CDC_Device_ReceiveByte(): the data is copied out of the OUT endpoint banks which have been
+			 *  received so far, eight bytes per loop iteration, and each bank is released as soon as it is empty. The
+			 *  function returns as soon as no received bank is left.
+			 *
+			 *  \pre This function must only be called when the Device state machine is in the DEVICE_STATE_Configured state or
+			 *       the call will fail.
+			 *
+			 *  \param[in,out] CDCInterfaceInfo  Pointer to a structure containing a CDC Class configuration and state.
+			 *  \param[out]    Buffer            Pointer to the buffer to store the received data in.
+			 *  \param[in]     Length            Size of the buffer, in bytes.
+			 *
+			 *  \return Number of bytes stored into the buffer, zero if no data has been received.
+			 */
+			uint16_t CDC_Device_ReceiveData(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+			                                void* const Buffer,
+			                                uint16_t Length) ATTR_NON_NULL_PTR_ARG(1) ATTR_NON_NULL_PTR_ARG(2);
 			
 			/** Flushes any data waiting to be sent, ensuring that the send buffer is cleared.
 			 *
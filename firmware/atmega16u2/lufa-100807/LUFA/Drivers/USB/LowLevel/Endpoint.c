@@ -137,6 +137,58 @@ uint8_t Endpoint_WaitUntilReady(void)
 	}
 }
 
+void Endpoint_Write_Block(const void* Buffer,
+                          uint16_t Length)
+{
+	const uint8_t* DataStream = (const uint8_t*)Buffer;
+	uint16_t       Rounds     = ((Length + 7) >> 3);
+
+	if (!(Length))
+	  return;
+
+	switch (Length & 0x07)
+	{
+		default:
+			do
+			{
+					Endpoint_Write_Byte(*(DataStream++));
+			case 7: Endpoint_Write_Byte(*(DataStream++));
+			case 6: Endpoint_Write_Byte(*(DataStream++));
+			case 5: Endpoint_Write_Byte(*(DataStream++));
+			case 4: Endpoint_Write_Byte(*(DataStream++));
+			case 3: Endpoint_Write_Byte(*(DataStream++));
+			case 2: Endpoint_Write_Byte(*(DataStream++));
+			case 1:	Endpoint_Write_Byte(*(DataStream++));
+			} while (--Rounds);
+	}
+}
+
+void Endpoint_Read_Block(void* Buffer,
+                         uint16_t Length)
+{
+	uint8_t* DataStream = (uint8_t*)Buffer;
+	uint16_t Rounds     = ((Length + 7) >> 3);
+
+	if (!(Length))
+	  return;
+
+	switch (Length & 0x07)
+	{
+		default:
+			do
+			{
+					*(DataStream++) = Endpoint_Read_Byte();
+			case 7: *(DataStream++) = Endpoint_Read_Byte();
+			case 6: *(DataStream++) = Endpoint_Read_Byte();
+			case 5: *(DataStream++) = Endpoint_Read_Byte();
+			case 4: *(DataStream++) = Endpoint_Read_Byte();
+			case 3: *(DataStream++) = Endpoint_Read_Byte();
+			case 2: *(DataStream++) = Endpoint_Read_Byte();
+			case 1:	*(DataStream++) = Endpoint_Read_Byte();
+			} while (--Rounds);
+	}
+}
+
 uint8_t Endpoint_Discard_Stream(uint16_t Length
 #if !defined(NO_STREAM_CALLBACKS)
                                 , StreamCallbackPtr_t Callback
@@ -392,6 +392,27 @@
 			{
 				return ((UEINT & (1 << EndpointNumber)) ? true : false);
 			}
+
+			/** Enables the OUT packet received interrupt of the currently selected endpoint, so that the next packet
+			 *  from the host raises the USB endpoint interrupt. This is intended to wake the application from sleep;
+			 *  the library only handles it with the INTERRUPT_DATA_ENDPOINTS compile time token, where the ISR masks
+			 *  the interrupt again and leaves the packet to the application.
+			 */
+			static inline void Endpoint_EnableOUTInterrupt(void) ATTR_ALWAYS_INLINE;
+			static inline void Endpoint_EnableOUTInterrupt(void)
+			{
+				UEIENX |= (1 << RXOUTE);
+			}
+
+			/** Enables the IN bank ready interrupt of the currently selected endpoint, so that the interrupt is raised
+			 *  as soon as the host has taken a bank and it can be filled again. The same applies as for
+			 *  \ref Endpoint_EnableOUTInterrupt().
+			 */
+			static inline void Endpoint_EnableINInterrupt(void) ATTR_ALWAYS_INLINE;
+			static inline void Endpoint_EnableINInterrupt(void)
+			{
+				UEIENX |= (1 << TXINE);
+			}
 			
 			/** Determines if the selected IN endpoint is ready for a new packet.
 			 *
@@ -829,6 +850,32 @@
 			 */
 			void Endpoint_ClearStatusStage(void);
 
+			/** Writes the given number of bytes from the given buffer into the currently selected endpoint's bank,
+			 *  eight bytes per loop iteration. Unlike the stream functions, the bank state is not checked and full
+			 *  banks are not sent; the caller must make sure that the data fits into the space left in the bank,
+			 *  for example from \ref Endpoint_BytesInEndpoint() and the endpoint size. This is intended for bulk
+			 *  data paths which already track the bank space themselves.
+			 *
+			 *  \ingroup Group_EndpointPrimitiveRW
+			 *
+			 *  \param[in] Buffer  Pointer to the source data buffer to read from.
+			 *  \param[in] Length  Number of bytes to write, at most the free space in the current bank.
+			 */
+			void Endpoint_Write_Block(const void* Buffer,
+			                          uint16_t Length) ATTR_NON_NULL_PTR_ARG(1);
+
+			/** Reads the given number of bytes from the currently selected endpoint's bank into the given buffer,
+			 *  eight bytes per loop iteration. As with \ref Endpoint_Write_Block(), the bank state is not checked
+			 *  and the bank is not released; the caller must not read more than \ref Endpoint_BytesInEndpoint().
+			 *
+			 *  \ingroup Group_EndpointPrimitiveRW
+			 *
+			 *  \param[out] Buffer  Pointer to the destination data buffer to write to.
+			 *  \param[in]  Length  Number of bytes to read, at most the number of bytes left in the current bank.
+			 */
+			void Endpoint_Read_Block(void* Buffer,
+			                         uint16_t Length) ATTR_NON_NULL_PTR_ARG(1);
+
 			/** Reads and discards the given number of bytes from the endpoint from the given buffer,
 			 *  discarding fully read packets from the host as needed. The last packet is not automatically
 			 *  discarded once the remaining bytes has been read; the user is responsible for manually
@@ -235,6 +235,31 @@ ISR(USB_COM_vect, ISR_BLOCK)
 {
 	uint8_t PrevSelectedEndpoint = Endpoint_GetCurrentEndpoint(); 
 
+	#if defined(INTERRUPT_DATA_ENDPOINTS)
+	/* Data endpoint interrupts only wake the application, which services the endpoint and arms them again */
+	uint8_t EndpointInterrupts = (Endpoint_GetEndpointInterrupts() & ~(1 << ENDPOINT_CONTROLEP));
+
+	for (uint8_t EndpointNumber = 1; EndpointInterrupts; EndpointNumber++)
+	{
+		if (EndpointInterrupts & (1 << EndpointNumber))
+		{
+			Endpoint_SelectEndpoint(EndpointNumber);
+			UEIENX = 0;
+
+			EndpointInterrupts &= ~(1 << EndpointNumber);
+		}
+	}
+
+	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
+
+	/* The control interrupt stays masked while a request is processed, don't start it again from a nested call */
+	if (!(USB_INT_IsEnabled(USB_INT_RXSTPI) && USB_INT_HasOccurred(USB_INT_RXSTPI)))
+	{
+		Endpoint_SelectEndpoint(PrevSelectedEndpoint);
+		return;
+	}
+	#endif
+
 	Endpoint_SelectEndpoint(ENDPOINT_CONTROLEP);
 	USB_INT_Disable(USB_INT_RXSTPI);
 
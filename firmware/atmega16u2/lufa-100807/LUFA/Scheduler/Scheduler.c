@@ -33,6 +33,8 @@
 volatile SchedulerDelayCounter_t Scheduler_TickCounter;
 volatile uint8_t                 Scheduler_TotalTasks;
 
+static uint8_t                   Scheduler_LastTask;
+
 bool Scheduler_HasDelayElapsed(const uint16_t Delay,
                                SchedulerDelayCounter_t* const DelayCounter)
 {
@@ -83,6 +85,118 @@ void Scheduler_SetTaskMode(const TaskPtr_t Task,
 	}
 }
 
+void Scheduler_SignalTask(const TaskPtr_t Task)
+{
+	TaskEntry_t* CurrTask = &Scheduler_TaskList[0];
+
+	while (CurrTask != &Scheduler_TaskList[Scheduler_TotalTasks])
+	{
+		if (CurrTask->Task == Task)
+		{
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				#if defined(SCHEDULER_CYCLE_COUNTER)
+				if (!(CurrTask->Events))
+				  CurrTask->Stats.SignalTime = SCHEDULER_CYCLE_COUNTER();
+				#endif
+
+				if (CurrTask->Events != 0xFF)
+				  CurrTask->Events++;
+			}
+
+			break;
+		}
+
+		CurrTask++;
+	}
+}
+
+static inline bool Scheduler_IsRunnable(const TaskEntry_t* const CurrTask)
+{
+	return ((CurrTask->TaskStatus == TASK_RUN) && (!(CurrTask->EventDriven) || CurrTask->Events));
+}
+
+bool Scheduler_IsIdle(void)
+{
+	TaskEntry_t* CurrTask = &Scheduler_TaskList[0];
+
+	while (CurrTask != &Scheduler_TaskList[Scheduler_TotalTasks])
+	{
+		if (Scheduler_IsRunnable(CurrTask))
+		  return false;
+
+		CurrTask++;
+	}
+
+	return true;
+}
+
+bool Scheduler_RunNextTask(void)
+{
+	TaskEntry_t* NextTask = NULL;
+	uint8_t      NextIndex = Scheduler_LastTask;
+	uint8_t      Index     = Scheduler_LastTask;
+
+	/* Look at every task once, starting after the last one run, so that tasks of equal priority take turns */
+	for (uint8_t i = 0; i < Scheduler_TotalTasks; i++)
+	{
+		if (++Index >= Scheduler_TotalTasks)
+		  Index = 0;
+
+		TaskEntry_t* CurrTask = &Scheduler_TaskList[Index];
+
+		if (Scheduler_IsRunnable(CurrTask) && ((NextTask == NULL) || (CurrTask->Priority > NextTask->Priority)))
+		{
+			NextTask  = CurrTask;
+			NextIndex = Index;
+		}
+	}
+
+	if (NextTask == NULL)
+	  return false;
+
+	Scheduler_LastTask = NextIndex;
+
+	#if defined(SCHEDULER_CYCLE_COUNTER)
+	uint16_t StartTime = SCHEDULER_CYCLE_COUNTER();
+
+	if (NextTask->EventDriven)
+	{
+		uint16_t Latency = (StartTime - NextTask->Stats.SignalTime);
+
+		if (Latency > NextTask->Stats.MaxLatency)
+		  NextTask->Stats.MaxLatency = Latency;
+	}
+	#endif
+
+	if (NextTask->EventDriven)
+	{
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			NextTask->Events--;
+
+			#if defined(SCHEDULER_CYCLE_COUNTER)
+			/* Signals still pending have waited at least since now */
+			NextTask->Stats.SignalTime = StartTime;
+			#endif
+		}
+	}
+
+	NextTask->Task();
+
+	#if defined(SCHEDULER_CYCLE_COUNTER)
+	uint16_t RunTime = (SCHEDULER_CYCLE_COUNTER() - StartTime);
+
+	NextTask->Stats.Runs++;
+	NextTask->Stats.Cycles += RunTime;
+
+	if (RunTime > NextTask->Stats.MaxCycles)
+	  NextTask->Stats.MaxCycles = RunTime;
+	#endif
+
+	return true;
+}
+
 void Scheduler_SetGroupTaskMode(const uint8_t GroupID,
                                 const bool TaskStatus)
 {
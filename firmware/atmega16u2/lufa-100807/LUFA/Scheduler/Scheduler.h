@@ -33,6 +33,7 @@
  *
  *  Simple round-robbin cooperative scheduler for use in basic projects where non real-time tasks need
  *  to be executed. Each task is executed in sequence, and can be enabled or disabled individually or as a group.
+ *  Tasks can optionally be given priorities, be woken by events and have their run time accounted.
  *
  *  \deprecated This module is deprecated and will be removed in a future library release.
  */
@@ -51,6 +52,16 @@
  *
  *  For a task to yield it must return, thus each task should have persistent data marked with the static attribute.
  *
+ *  After each task run the scheduler picks the runnable task with the highest \c Priority next, tasks of the same
+ *  priority take turns in list order. With all priorities left at zero this is the plain round-robbin order. A task
+ *  with \c EventDriven set only runs once it has been signalled through \ref Scheduler_SignalTask(), once for each
+ *  signal; signals may be raised from interrupts. When no task is runnable the SCHEDULER_IDLE() hook is executed,
+ *  which can be defined to put the CPU to sleep until the next interrupt.
+ *
+ *  If SCHEDULER_CYCLE_COUNTER() is defined to read a free running 16-bit timer (such as TCNT1), each task entry also
+ *  holds its \ref TaskStats_t: the number of runs, the timer counts used by them and the longest time an event driven
+ *  task waited from its signal to its start, in the same timer counts.
+ *
  *  Usage Example:
  *  \code
  *      #include <LUFA/Scheduler/Scheduler.h>
@@ -61,7 +72,7 @@
  *      TASK_LIST
  *      {
  *      	{ .Task = MyTask1, .TaskStatus = TASK_RUN, .GroupID = 1  },
- *      	{ .Task = MyTask2, .TaskStatus = TASK_RUN, .GroupID = 1  },
+ *      	{ .Task = MyTask2, .TaskStatus = TASK_RUN, .GroupID = 1, .Priority = 1, .EventDriven = true },
  *      }
  *
  *      int main(void)
@@ -69,6 +80,12 @@
  *      	Scheduler_Start();
  *      }
  *
+ *      ISR(USART1_RX_vect)
+ *      {
+ *      	// Wake MyTask2 ahead of MyTask1
+ *      	Scheduler_SignalTask(MyTask2);
+ *      }
+ *
  *      TASK(MyTask1)
  *      {
  *      	// Implementation Here
@@ -89,6 +106,7 @@
 	/* Includes: */
 		#include <stdint.h>
 		#include <stdbool.h>
+		#include <stddef.h>
 		
 		#include <util/atomic.h>
 
@@ -137,6 +155,15 @@
 
 			/** Task status mode constant, for passing to \ref Scheduler_SetTaskMode() or \ref Scheduler_SetGroupTaskMode(). */
 			#define TASK_STOP               false
+
+			#if !defined(SCHEDULER_IDLE) || defined(__DOXYGEN__)
+				/** Hook executed by the scheduler when no task is runnable, empty unless defined by the application
+				 *  via the -D switch. It is called with interrupts enabled; to sleep without missing a signal raised
+				 *  meanwhile, disable interrupts, check \ref Scheduler_IsIdle() again and use sei() directly before
+				 *  sleep_cpu().
+				 */
+				#define SCHEDULER_IDLE()
+			#endif
 			
 		/* Pseudo-Function Macros: */
 			#if defined(__DOXYGEN__)
@@ -164,15 +191,34 @@
 			 */
 			typedef uint16_t SchedulerDelayCounter_t;
 			
+			/** \brief Scheduler Task Accounting Structure.
+			 *
+			 *  Run time accounting of a single task, only present when SCHEDULER_CYCLE_COUNTER() is defined.
+			 */
+			typedef struct
+			{
+				uint16_t Runs;       /**< Number of times the task has been run. */
+				uint32_t Cycles;     /**< Total SCHEDULER_CYCLE_COUNTER() counts used by the task's runs. */
+				uint16_t MaxCycles;  /**< Longest single run of the task, in SCHEDULER_CYCLE_COUNTER() counts. */
+				uint16_t MaxLatency; /**< Longest wait of an event driven task from its signal to its run. */
+				uint16_t SignalTime; /**< SCHEDULER_CYCLE_COUNTER() value at the oldest pending signal, internal. */
+			} TaskStats_t;
+
 			/** \brief Scheduler Task List Entry Structure.
 			 *
 			 *  Structure for holding a single task's information in the scheduler task list.
 			 */
 			typedef struct
 			{
-				TaskPtr_t Task;       /**< Pointer to the task to execute. */
-				bool      TaskStatus; /**< Status of the task (either TASK_RUN or TASK_STOP). */
-				uint8_t   GroupID;    /**< Group ID of the task so that its status can be changed as a group. */
+				TaskPtr_t        Task;        /**< Pointer to the task to execute. */
+				bool             TaskStatus;  /**< Status of the task (either TASK_RUN or TASK_STOP). */
+				uint8_t          GroupID;     /**< Group ID of the task so that its status can be changed as a group. */
+				uint8_t          Priority;    /**< Priority of the task, runnable tasks with higher values run first. */
+				bool             EventDriven; /**< Indicates that the task only runs when signalled, see \ref Scheduler_SignalTask(). */
+				volatile uint8_t Events;      /**< Number of signals not yet handled by a run of the task. */
+				#if defined(SCHEDULER_CYCLE_COUNTER) || defined(__DOXYGEN__)
+				TaskStats_t      Stats;       /**< Run time accounting of the task. */
+				#endif
 			} TaskEntry_t;
 
 		/* Global Variables: */
@@ -180,7 +226,7 @@
 			 *  TaskEntry_t and can be manipulated as desired, although it is preferential that the proper Scheduler
 			 *  functions should be used instead of direct manipulation.
 			 */
-			exter TaskEntry_t Scheduler_TaskList[];
+			extern TaskEntry_t Scheduler_TaskList[];
 			
 			/** Contains the total number of tasks in the task list, irrespective of if the task's status is set to
 			 *  \ref TASK_RUN or \ref TASK_STOP.
@@ -251,6 +297,25 @@
 			void Scheduler_SetGroupTaskMode(const uint8_t GroupID,
 			                                const bool TaskStatus);
 
+			/** Signals an event driven task, so that it runs once more. Signals are counted up to 255 and each run of
+			 *  the task consumes one of them. This may be called from an interrupt.
+			 *
+			 *  \param[in] Task  Name of the task to signal.
+			 */
+			void Scheduler_SignalTask(const TaskPtr_t Task);
+
+			/** Runs the next runnable task, the one with the highest priority after the task that ran last.
+			 *
+			 *  \return Boolean true if a task was run, false if no task was runnable.
+			 */
+			bool Scheduler_RunNextTask(void);
+
+			/** Determines if the scheduler has no runnable task, for use in the SCHEDULER_IDLE() hook.
+			 *
+			 *  \return Boolean true if no task is waiting to run, false otherwise.
+			 */
+			bool Scheduler_IsIdle(void) ATTR_WARN_UNUSED_RESULT;
+
 	/* Private Interface - For use in library only: */
 	#if !defined(__DOXYGEN__)
 		/* Macros: */
@@ -271,15 +336,8 @@
 
 				for (;;)
 				{
-					TaskEntry_t* CurrTask = &Scheduler_TaskList[0];
-					
-					while (CurrTask != &Scheduler_TaskList[TotalTasks])
-					{
-						if (CurrTask->TaskStatus == TASK_RUN)
-						  CurrTask->Task();
-
-						CurrTask++;
-					}
+					if (!(Scheduler_RunNextTask()))
+					  SCHEDULER_IDLE();
 				}
 			}
 	#endif
@@ -39,10 +39,93 @@
 /** Circular buffer to hold data from the host before it is sent to the device via the serial port. */
 RingBuff_t USBtoUSART_Buffer;
 
+/** Storage for \ref USBtoUSART_Buffer. */
+static RingBuff_Data_t USBtoUSART_Storage[USB_TO_USART_BUFFER_SIZE];
+
+/** State of a bridge assisted bootloader entry, see \ref USBSERIAL_REQ_EnterBootloader. */
+static volatile struct
+{
+	uint8_t Ticks; /**< Flush timer ticks left in the current phase, zero when no entry is in progress */
+	uint8_t Sequence; /**< STK500v2 sequence number of the sign-on messages */
+	bool    InReset; /**< Indicates that the target is still being held in reset */
+	bool    TargetSpoke; /**< Set by the USART receive ISR once the target has answered */
+} BootEntry;
+
+#if defined(USBSERIAL_STATS)
+/** Link statistics, read by the host through the \ref USBSERIAL_REQ_GetStats vendor request. */
+USBSerial_Stats_t Stats;
+#endif
+
+#if defined(USBSERIAL_FLOW_CONTROL)
+/** Indicates that RTS/CTS flow control with the target is switched on, see \ref USBSERIAL_REQ_SetFlowControl. */
+static volatile bool FlowControl;
+#endif
+
+#if defined(USBSERIAL_SELF_UPDATE)
+/** State of a bridge firmware update, see \ref USBSERIAL_REQ_UpdateBegin. */
+static volatile struct
+{
+	uint8_t  State; /**< Current state, a value from the \ref USBSerial_UpdateStates_t enum */
+	uint16_t Length; /**< Length of the image being staged, in bytes */
+	uint16_t CRC; /**< CRC-CCITT the staged image must match */
+	uint16_t Received; /**< Image bytes staged so far */
+	uint8_t  LowByte; /**< Low byte of a flash word split across two raw channel packets */
+} Update;
+
+/** End of the running image in flash, from the linker. */
+extern uint8_t __data_load_end;
+#endif
+
+#if defined(USBSERIAL_ISP)
+/** Set from the USB interrupt when the host selects the ISP programmer's baud rate, see \ref USBSERIAL_ISP_BAUD. */
+static volatile bool ISPRequested;
+
+/** Indicates that the main loop has handed the serial port to the ISP programmer. */
+static bool ISPActive;
+#endif
+
+/** Flush timer ticks left of a break sent to the target, \ref USBSERIAL_BREAK_INDEFINITE while the host ends it. */
+static volatile uint8_t BreakTicks;
+
+/** CDC_CONTROL_LINE_IN_* line events seen by the USART receive ISR since the last serial state notification. */
+static volatile uint8_t SerialStateEvents;
+
+/** Indicates that the host is to be sent the serial state even without new line events. */
+static volatile bool SerialStatePending;
+
+/** Serial state being sent to the host, once the notification header has gone out ahead of it. */
+static uint16_t SerialStateSending;
+
+/** Indicates that the header of a serial state notification has been sent, and the state itself is next. */
+static bool SerialStateHeaderSent;
+
+/** OUT endpoint whose data is currently being forwarded to \ref USBtoUSART_Buffer. */
+static uint8_t USBtoUSART_Source = CDC_RX_EPNUM;
+
+/** Indicates that \ref USBtoUSART_Source still holds part of a bank, which must be forwarded before any other. */
+static bool USBtoUSART_Partial;
+
+/** Set by the flush timer overflow ISR, so that the timer can wake the bridge from sleep. */
+static volatile bool FlushTickPending;
+
+/** Set by the idle line timer ISR once the USART receive line has gone quiet. */
+static volatile bool LineIdlePending;
+
+/** Indicates that data for the host was left in \ref USARTtoUSB_Buffer because no IN bank was free. */
+static bool USARTtoUSB_Stalled;
+
 /** Circular buffer to hold data from the serial port before it is sent to the host. */
 RingBuff_t USARTtoUSB_Buffer;
 
-/** Pulse generation counters to keep track of the number of milliseconds remaining for each pulse type */
+/** Storage for \ref USARTtoUSB_Buffer. */
+static RingBuff_Data_t USARTtoUSB_Storage[USART_TO_USB_BUFFER_SIZE];
+
+/** Set by the main loop when data moves in either direction, and turned into an LED pulse by the flush timer ISR. */
+static volatile bool TxLEDActivity, RxLEDActivity;
+
+/** Pulse generation counters to keep track of the number of flush timer ticks remaining for each pulse type,
+ *  only touched from the flush timer ISR.
+ */
 volatile struct
 {
 	uint8_t TxLEDPulse; /**< Milliseconds remaining for data Tx LED pulse */
@@ -50,6 +133,15 @@ volatile struct
 	uint8_t PingPongLEDPulse; /**< Milliseconds remaining for enumeration Tx/Rx ping-pong LED pulse */
 } PulseMSRemaining;
 
+/** Policy deciding when data buffered from the target is flushed to the host, trading latency for
+ *  full packets. Set by the host through the \ref USBSERIAL_REQ_SetFlushPolicy vendor request.
+ */
+volatile USBSerial_FlushPolicy_t FlushPolicy =
+	{
+		.IdleChars  = USBSERIAL_FLUSH_IDLE_CHARS,
+		.PacketSize = CDC_TXRX_EPSIZE,
+	};
+
 /** LUFA CDC Class driver interface configuration and state information. This structure is
  *  passed to all CDC Class driver functions, so that multiple instances of the same class
  *  within a device can be differentiated from one another.
@@ -62,11 +154,11 @@ USB_ClassInfo_CDC_Device_t VirtualSerial_CDC_Interface =
 
 				.DataINEndpointNumber           = CDC_TX_EPNUM,
 				.DataINEndpointSize             = CDC_TXRX_EPSIZE,
-				.DataINEndpointDoubleBank       = false,
+				.DataINEndpointDoubleBank       = CDC_TXRX_DOUBLEBANK,
 
 				.DataOUTEndpointNumber          = CDC_RX_EPNUM,
 				.DataOUTEndpointSize            = CDC_TXRX_EPSIZE,
-				.DataOUTEndpointDoubleBank      = false,
+				.DataOUTEndpointDoubleBank      = CDC_TXRX_DOUBLEBANK,
 
 				.NotificationEndpointNumber     = CDC_NOTIFICATION_EPNUM,
 				.NotificationEndpointSize       = CDC_NOTIFICATION_EPSIZE,
@@ -81,58 +173,501 @@ int main(void)
 {
 	SetupHardware();
 	
-	RingBuffer_InitBuffer(&USBtoUSART_Buffer);
-	RingBuffer_InitBuffer(&USARTtoUSB_Buffer);
+	RingBuffer_InitBuffer(&USBtoUSART_Buffer, USBtoUSART_Storage, sizeof(USBtoUSART_Storage));
+	RingBuffer_InitBuffer(&USARTtoUSB_Buffer, USARTtoUSB_Storage, sizeof(USARTtoUSB_Storage));
 
 	sei();
 
 	for (;;)
 	{
-		/* Only try to read in bytes from the CDC interface if the transmit buffer is not full */
-		if (!(RingBuffer_IsFull(&USBtoUSART_Buffer)))
+		#if defined(USBSERIAL_SELF_UPDATE)
+		if (Update.State == USBSERIAL_UPDATE_Installing)
 		{
-			int16_t ReceivedByte = CDC_Device_ReceiveByte(&VirtualSerial_CDC_Interface);
+			/* Give the status stage of the install request time to reach the host before leaving the bus */
+			_delay_ms(10);
+
+			USB_ShutDown();
+			cli();
 
-			/* Read bytes from the USB OUT endpoint into the USART transmit buffer */
-			if (!(ReceivedByte < 0))
-			  RingBuffer_Insert(&USBtoUSART_Buffer, ReceivedByte);
+			LEDs_SetAllLEDs(LEDMASK_BUSY);
+			Update_Install(Update.Length);
 		}
+		#endif
+
+		/* Only try to read in bytes from the host if the transmit buffer is not full */
+		if (!(RingBuffer_IsFull(&USBtoUSART_Buffer)))
+		  USBtoUSART_Task();
+
+		#if defined(USBSERIAL_ISP)
+		if (ISPRequested != ISPActive)
+		  USBtoUSART_SetISPMode(ISPRequested);
+
+		/* Replies of the programmer go out straight away, as if the line had gone idle */
+		if (ISPActive && ISP_Task(&USBtoUSART_Buffer, &USARTtoUSB_Buffer))
+		  LineIdlePending = true;
+		#endif
 		
-		/* Check if the UART receive buffer flush timer has expired or the buffer is nearly full */
+		/* Check if the UART line has gone idle or the receive buffer flush timer has expired */
+		bool LineIdle  = LineIdlePending;
+		bool FlushTick = FlushTickPending;
+
+		if (LineIdle)
+		  LineIdlePending = false;
+
+		if (FlushTick)
+		  FlushTickPending = false;
+
+		/* While data is still streaming in and the buffer isn't nearly full, only send whole packets */
 		RingBuff_Count_t BufferCount = RingBuffer_GetCount(&USARTtoUSB_Buffer);
-		if ((TIFR0 & (1 << TOV0)) || (BufferCount > BUFFER_NEARLY_FULL))
+		if (!(LineIdle || FlushTick || (BufferCount > USART_TO_USB_NEARLY_FULL)))
+		  BufferCount &= ~(FlushPolicy.PacketSize - 1);
+
+		USARTtoUSB_Stalled = false;
+
+		if (BufferCount)
 		{
-			TIFR0 |= (1 << TOV0);
+			#if defined(USBSERIAL_STATS)
+			if (LineIdle)
+			  USBSERIAL_STATS_ADD(FlushIdle, 1);
+			else if (FlushTick)
+			  USBSERIAL_STATS_ADD(FlushTimer, 1);
+			else if (BufferCount > USART_TO_USB_NEARLY_FULL)
+			  USBSERIAL_STATS_ADD(FlushNearlyFull, 1);
+			else
+			  USBSERIAL_STATS_ADD(FlushPacket, 1);
+			#endif
 
-			if (USARTtoUSB_Buffer.Count) {
-				LEDs_TurnOnLEDs(LEDMASK_TX);
-				PulseMSRemaining.TxLEDPulse = TX_RX_LED_PULSE_MS;
-			}
+			TxLEDActivity = true;
 
 			/* Read bytes from the USART receive buffer into the USB IN endpoint */
-			while (BufferCount--)
-			  CDC_Device_SendByte(&VirtualSerial_CDC_Interface, RingBuffer_Remove(&USARTtoUSB_Buffer));
-			  
-			/* Turn off TX LED(s) once the TX pulse period has elapsed */
-			if (PulseMSRemaining.TxLEDPulse && !(--PulseMSRemaining.TxLEDPulse))
-			  LEDs_TurnOffLEDs(LEDMASK_TX);
-
-			/* Turn off RX LED(s) once the RX pulse period has elapsed */
-			if (PulseMSRemaining.RxLEDPulse && !(--PulseMSRemaining.RxLEDPulse))
-			  LEDs_TurnOffLEDs(LEDMASK_RX);
+			USARTtoUSB_Stalled = USARTtoUSB_WriteBlock(BufferCount);
+			CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+		}
+
+		#if defined(USBSERIAL_FLOW_CONTROL)
+		/* Release the target once the USART receive buffer has drained well clear of the RTS margin */
+		if ((USBSERIAL_RTS_PORT & USBSERIAL_RTS_MASK) &&
+		    ((USART_TO_USB_BUFFER_SIZE - RingBuffer_GetCount(&USARTtoUSB_Buffer)) >= (USBSERIAL_RTS_MARGIN * 2)))
+		{
+			USBSERIAL_RTS_PORT &= ~USBSERIAL_RTS_MASK;
+		}
+		#endif
+
+		if (FlushTick)
+		{
+			if (BootEntry.Ticks)
+			  BootEntry_Tick();
+
+			/* A timed break from the host ends once it has lasted long enough */
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				if (BreakTicks && (BreakTicks != USBSERIAL_BREAK_INDEFINITE) && !(--BreakTicks))
+				  USBtoUSART_EndBreak();
+			}
 		}
+
+		/* Breaks and line errors from the target go to the host out of band */
+		SerialState_Task();
 		
-		/* Load the next byte from the USART transmit buffer into the USART */
+		/* Let the USART data register empty ISR drain the USART transmit buffer in the background */
 		if (!(RingBuffer_IsEmpty(&USBtoUSART_Buffer))) {
-		  Serial_TxByte(RingBuffer_Remove(&USBtoUSART_Buffer));
-		  	
-		  	LEDs_TurnOnLEDs(LEDMASK_RX);
-			PulseMSRemaining.RxLEDPulse = TX_RX_LED_PULSE_MS;
+			/* Line encoding changes rewrite UCSR1B from the USB interrupt, so don't race them */
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				if ((UCSR1B & (1 << TXEN1)) && !(USBtoUSART_IsBlocked()))
+				  UCSR1B |= (1 << UDRIE1);
+			}
+
+			RxLEDActivity = true;
 		}
 		
-		CDC_Device_USBTask(&VirtualSerial_CDC_Interface);
+		#if !defined(INTERRUPT_CONTROL_ENDPOINT)
 		USB_USBTask();
+		#endif
+
+		WaitForEvent();
+	}
+}
+
+/** Sleeps until the next interrupt once the main loop has nothing left to do, so that the bridge is woken by
+ *  USB, USART and timer events rather than spinning. Control requests are handled from the USB interrupt; the
+ *  data endpoint interrupts are only armed here, with interrupts off, so that an event which arrived since the
+ *  main loop looked ends the sleep straight away. Without INTERRUPT_DATA_ENDPOINTS the bridge only sleeps while
+ *  the host hasn't configured the device.
+ */
+void WaitForEvent(void)
+{
+	set_sleep_mode(SLEEP_MODE_IDLE);
+
+	cli();
+
+	if (USB_DeviceState == DEVICE_STATE_Configured)
+	{
+#if defined(INTERRUPT_DATA_ENDPOINTS)
+		/* While the USB to USART buffer is full the UDRE ISR wakes us as it drains */
+		if (!(RingBuffer_IsFull(&USBtoUSART_Buffer)))
+		{
+			Endpoint_SelectEndpoint(CDC_RX_EPNUM);
+			Endpoint_EnableOUTInterrupt();
+
+			#if defined(USBSERIAL_RAW_CHANNEL)
+			Endpoint_SelectEndpoint(RAW_RX_EPNUM);
+			Endpoint_EnableOUTInterrupt();
+			#endif
+		}
+
+		if (USARTtoUSB_Stalled)
+		{
+			Endpoint_SelectEndpoint(CDC_TX_EPNUM);
+			Endpoint_EnableINInterrupt();
+		}
+
+		if (SerialStatePending || SerialStateEvents || SerialStateHeaderSent)
+		{
+			Endpoint_SelectEndpoint(CDC_NOTIFICATION_EPNUM);
+			Endpoint_EnableINInterrupt();
+		}
+#else
+		sei();
+		return;
+#endif
+	}
+
+	/* The flush timer only has to tick for data waiting in either direction (the CTS input is polled),
+	 * for LED pulses and for a bootloader entry in progress */
+	if (!(RingBuffer_IsEmpty(&USARTtoUSB_Buffer)) || !(RingBuffer_IsEmpty(&USBtoUSART_Buffer)) ||
+	    TxLEDActivity || RxLEDActivity || PulseMSRemaining.TxLEDPulse || PulseMSRemaining.RxLEDPulse ||
+	    BootEntry.Ticks || BreakTicks)
+	{
+		TIMSK0 |= (1 << TOIE0);
+	}
+	else
+	{
+		TIMSK0 &= ~(1 << TOIE0);
+	}
+
+	if (!(LineIdlePending || FlushTickPending))
+	{
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+	}
+
+	sei();
+}
+
+/** Forwards data from the host's OUT endpoints to the USB to USART buffer. With the raw channel enabled, an
+ *  endpoint bank is always forwarded in full before the other endpoint is looked at, so that console and raw
+ *  channel data never interleave inside a packet; between banks the raw channel has priority.
+ */
+void USBtoUSART_Task(void)
+{
+#if defined(USBSERIAL_RAW_CHANNEL)
+	if (USBtoUSART_Partial)
+	{
+		USBtoUSART_Partial = USBtoUSART_ReadBlock(USBtoUSART_Source);
+		return;
+	}
+
+	#if defined(USBSERIAL_SELF_UPDATE)
+	/* While an update is being staged the raw channel carries the image instead of target data */
+	if (Update.State == USBSERIAL_UPDATE_Receiving)
+	{
+		Update_ReadBlock();
+	}
+	else
+	#endif
+	{
+		USBtoUSART_Source  = RAW_RX_EPNUM;
+		USBtoUSART_Partial = USBtoUSART_ReadBlock(RAW_RX_EPNUM);
+
+		if (USBtoUSART_Partial || RingBuffer_IsFull(&USBtoUSART_Buffer))
+		  return;
+	}
+#endif
+
+	USBtoUSART_Source  = CDC_RX_EPNUM;
+	USBtoUSART_Partial = USBtoUSART_ReadBlock(CDC_RX_EPNUM);
+}
+
+/** Drains as much of the given OUT endpoint's current bank as will fit into the USB to USART buffer,
+ *  selecting the endpoint once and copying the data into the ring buffer in contiguous runs with
+ *  \ref Endpoint_Read_Block() rather than going through \ref CDC_Device_ReceiveByte() for every byte.
+ *  The bank is only released back to the host once it has been completely read out.
+ *
+ *  \param[in] EndpointNumber  OUT endpoint to read from, the CDC data endpoint or the raw channel endpoint
+ *
+ *  \return Boolean true if data was left in the endpoint bank for a later call, false otherwise
+ */
+bool USBtoUSART_ReadBlock(const uint8_t EndpointNumber)
+{
+	if (USB_DeviceState != DEVICE_STATE_Configured)
+	  return false;
+
+	/* Console data has nowhere to go until the host has set up the virtual serial port */
+	if ((EndpointNumber == CDC_RX_EPNUM) && !(VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS))
+	  return false;
+
+	Endpoint_SelectEndpoint(EndpointNumber);
+
+	if (!(Endpoint_IsOUTReceived()))
+	  return false;
+
+	uint16_t         BytesInEndpoint = Endpoint_BytesInEndpoint();
+	RingBuff_Count_t BytesFree       = (USB_TO_USART_BUFFER_SIZE - RingBuffer_GetCount(&USBtoUSART_Buffer));
+
+	while (BytesInEndpoint && BytesFree)
+	{
+		RingBuff_Count_t Run = RingBuffer_GetInRun(&USBtoUSART_Buffer);
+
+		if (Run > BytesFree)
+		  Run = BytesFree;
+
+		if (Run > BytesInEndpoint)
+		  Run = BytesInEndpoint;
+
+		Endpoint_Read_Block(RingBuffer_GetInPtr(&USBtoUSART_Buffer), Run);
+		RingBuffer_AdvanceIn(&USBtoUSART_Buffer, Run);
+		USBSERIAL_STATS_ADD(HostToTargetBytes, Run);
+		USBSERIAL_STATS_HIGH(USBtoUSARTHighWater, RingBuffer_GetCount(&USBtoUSART_Buffer));
+
+		BytesInEndpoint -= Run;
+		BytesFree       -= Run;
+	}
+
+	if (BytesInEndpoint)
+	  return true;
+
+	Endpoint_ClearOUT();
+	return false;
+}
+
+#if defined(USBSERIAL_SELF_UPDATE)
+/** Determines if the bridge can stage and install a new firmware image of itself.
+ *
+ *  \return Boolean true if the bootloader exports its flash API and the running image ends below the staging area
+ */
+bool Update_IsAvailable(void)
+{
+	return (BootloaderAPI_IsAvailable() && ((uint16_t)&__data_load_end <= USBSERIAL_UPDATE_STAGING));
+}
+
+/** Starts staging a new firmware image, which then arrives on the raw channel, see \ref Update_ReadBlock().
+ *
+ *  \param[in] Length  Length of the image in bytes, no more than \ref USBSERIAL_UPDATE_MAX_LENGTH
+ *  \param[in] CRC     CRC-CCITT of the image, checked once it has been completely staged
+ */
+void Update_Begin(const uint16_t Length,
+                  const uint16_t CRC)
+{
+	Update.Length   = Length;
+	Update.CRC      = CRC;
+	Update.Received = 0;
+	Update.State    = USBSERIAL_UPDATE_Receiving;
+}
+
+/** Writes the raw channel endpoint's current bank to the staging area. Each flash page is erased when its
+ *  first byte arrives and written once it is full, so the RAM cost is a single byte for a word split across
+ *  packets. The bootloader calls stall the CPU for the erase or write of a page, about 4ms, with interrupts
+ *  off; the host is throttled by NAKs meanwhile. Once the whole image is staged its CRC is checked, which moves
+ *  the update to the \ref USBSERIAL_UPDATE_Staged or \ref USBSERIAL_UPDATE_Failed state.
+ */
+void Update_ReadBlock(void)
+{
+	if (USB_DeviceState != DEVICE_STATE_Configured)
+	  return;
+
+	Endpoint_SelectEndpoint(RAW_RX_EPNUM);
+
+	if (!(Endpoint_IsOUTReceived()))
+	  return;
+
+	uint16_t BytesInEndpoint = Endpoint_BytesInEndpoint();
+
+	while (BytesInEndpoint--)
+	{
+		uint8_t  Data    = Endpoint_Read_Byte();
+		uint16_t Address = (USBSERIAL_UPDATE_STAGING + Update.Received);
+
+		/* More data than announced, the host and the bridge disagree on the image */
+		if (Update.Received == Update.Length)
+		{
+			Update.State = USBSERIAL_UPDATE_Failed;
+			break;
+		}
+
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (!(Address & 0x01))
+			{
+				if (!(Address & (SPM_PAGESIZE - 1)))
+				  BootloaderAPI_ErasePage(Address);
+
+				Update.LowByte = Data;
+			}
+			else
+			{
+				BootloaderAPI_FillWord(Address - 1, ((uint16_t)Data << 8) | Update.LowByte);
+
+				if ((Address & (SPM_PAGESIZE - 1)) == (SPM_PAGESIZE - 1))
+				  BootloaderAPI_WritePage(Address - (SPM_PAGESIZE - 1));
+			}
+		}
+
+		Update.Received++;
+	}
+
+	Endpoint_ClearOUT();
+
+	if ((Update.State != USBSERIAL_UPDATE_Receiving) || (Update.Received != Update.Length))
+	  return;
+
+	/* Pad and write out the last, partially filled page */
+	uint16_t Address = (USBSERIAL_UPDATE_STAGING + Update.Received);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		if (Address & 0x01)
+		{
+			BootloaderAPI_FillWord(Address - 1, 0xFF00 | Update.LowByte);
+			Address++;
+		}
+
+		if (Address & (SPM_PAGESIZE - 1))
+		  BootloaderAPI_WritePage(Address & ~(SPM_PAGESIZE - 1));
+	}
+
+	uint16_t CRC = 0;
+
+	for (uint16_t Offset = 0; Offset < Update.Length; Offset++)
+	  CRC = _crc_ccitt_update(CRC, pgm_read_byte(USBSERIAL_UPDATE_STAGING + Offset));
+
+	Update.State = (CRC == Update.CRC) ? USBSERIAL_UPDATE_Staged : USBSERIAL_UPDATE_Failed;
+}
+
+/** Copies the staged firmware image over the running bridge and restarts it through the watchdog. This runs
+ *  from its own flash page at \ref USBSERIAL_UPDATE_INSTALLER, above anything it installs, and only calls into
+ *  the bootloader, so it keeps running while the rest of the application section is rewritten under it. It is
+ *  never replaced itself, so its address and arguments must stay the same between bridge releases. Interrupts
+ *  must be off and the USB controller shut down. Losing power meanwhile leaves a partial image behind, which
+ *  must then be replaced through the bootloader.
+ *
+ *  \param[in] Length  Length of the staged image in bytes
+ */
+void Update_Install(const uint16_t Length)
+{
+	for (uint16_t PageAddress = 0; PageAddress < Length; PageAddress += SPM_PAGESIZE)
+	{
+		BootloaderAPI_ErasePage(PageAddress);
+
+		for (uint8_t PageByte = 0; PageByte < SPM_PAGESIZE; PageByte += 2)
+		  BootloaderAPI_FillWord(PageAddress + PageByte, pgm_read_word(USBSERIAL_UPDATE_STAGING + PageAddress + PageByte));
+
+		BootloaderAPI_WritePage(PageAddress);
+	}
+
+	wdt_enable(WDTO_15MS);
+	for (;;);
+}
+#endif
+
+/** Sends up to the given number of bytes from the USART to USB buffer to the host, handing the
+ *  contiguous runs of the ring buffer to \ref CDC_Device_SendData() rather than going through
+ *  \ref CDC_Device_SendByte() for every byte. Full banks are sent immediately; a partially filled
+ *  bank is left for \ref CDC_Device_USBTask() to flush. When no IN bank is free the rest stays in
+ *  the ring buffer for the next pass of the main loop, instead of waiting for the host.
+ *
+ *  \param[in] BufferCount  Number of bytes to move, as returned by \ref RingBuffer_GetCount()
+ *
+ *  \return Boolean true if data was left behind because no IN bank was free, false otherwise
+ */
+bool USARTtoUSB_WriteBlock(RingBuff_Count_t BufferCount)
+{
+	while (BufferCount)
+	{
+		RingBuff_Count_t Run = RingBuffer_GetOutRun(&USARTtoUSB_Buffer);
+
+		if (Run > BufferCount)
+		  Run = BufferCount;
+
+		RingBuff_Count_t Sent = CDC_Device_SendData(&VirtualSerial_CDC_Interface,
+		                                            RingBuffer_GetOutPtr(&USARTtoUSB_Buffer), Run);
+
+		RingBuffer_AdvanceOut(&USARTtoUSB_Buffer, Sent);
+		USBSERIAL_STATS_ADD(TargetToHostBytes, Sent);
+
+		if (Sent != Run)
+		{
+			if (USB_DeviceState != DEVICE_STATE_Configured)
+			  return false;
+
+			USBSERIAL_STATS_ADD(EndpointNotReady, 1);
+			return true;
+		}
+
+		BufferCount -= Run;
+	}
+
+	return false;
+}
+
+/** Sets the policy deciding when data from the target is flushed to the host, clamping the values to
+ *  their valid ranges, and reprograms the idle line timer to match.
+ *
+ *  \param[in] IdleChars   Idle line gap in character times after which buffered data is sent, zero to disable
+ *  \param[in] PacketSize  Block size to send in while data is still arriving, rounded down to a power of two
+ */
+void USARTtoUSB_SetFlushPolicy(const uint16_t IdleChars,
+                               const uint16_t PacketSize)
+{
+	uint8_t Size = CDC_TXRX_EPSIZE;
+
+	while ((Size > 1) && (Size > PacketSize))
+	  Size >>= 1;
+
+	FlushPolicy.IdleChars  = (IdleChars > USBSERIAL_FLUSH_MAX_IDLE_CHARS) ? USBSERIAL_FLUSH_MAX_IDLE_CHARS : IdleChars;
+	FlushPolicy.PacketSize = Size;
+
+	USARTtoUSB_ConfigureIdleTimer();
+}
+
+/** Programs Timer 1 so that its compare match A flag is raised once the USART receive line has been idle
+ *  for the number of character times given by the flush policy, at the current line encoding. The USART
+ *  receive ISR restarts the timer for every byte, so the flag only rises once the target goes quiet.
+ */
+void USARTtoUSB_ConfigureIdleTimer(void)
+{
+	uint32_t BaudRateBPS = VirtualSerial_CDC_Interface.State.LineEncoding.BaudRateBPS;
+
+	TCCR1B = 0;
+	TIFR1  = (1 << OCF1A);
+
+	if (!(FlushPolicy.IdleChars) || !(BaudRateBPS))
+	  return;
+
+	/* Start, data, parity and stop bits of each character on the line */
+	uint8_t CharBits = (1 + VirtualSerial_CDC_Interface.State.LineEncoding.DataBits);
+
+	if (VirtualSerial_CDC_Interface.State.LineEncoding.ParityType != CDC_PARITY_None)
+	  CharBits++;
+
+	CharBits += (VirtualSerial_CDC_Interface.State.LineEncoding.CharFormat == CDC_LINEENCODING_TwoStopBits) ? 2 : 1;
+
+	/* Count at F_CPU / 8, falling back to F_CPU / 64 for gaps that don't fit at slow baud rates */
+	uint32_t GapTicks = (((uint32_t)FlushPolicy.IdleChars * CharBits * (F_CPU / 8)) / BaudRateBPS);
+	uint8_t  Prescale = (1 << CS11);
+
+	if (GapTicks > 0xFFFF)
+	{
+		GapTicks /= 8;
+		Prescale  = ((1 << CS11) | (1 << CS10));
 	}
+
+	OCR1A  = (GapTicks > 0xFFFF) ? 0xFFFF : GapTicks;
+	TCNT1  = 0;
+	TCCR1B = Prescale;
+	TIMSK1 = (1 << OCIE1A);
 }
 
 /** Configures the board hardware and chip peripherals for the demo's functionality. */
@@ -153,21 +688,369 @@ void SetupHardware(void)
   
 	/* Start the flush timer so that overflows occur rapidly to push received bytes to the USB interface */
 	TCCR0B = (1 << CS02);
+	TIMSK0 = (1 << TOIE0);
 	
+	#if defined(USBSERIAL_FLOW_CONTROL)
+	/* RTS output asserted, CTS input pulled up so an unconnected line reads as deasserted */
+	USBSERIAL_RTS_PORT &= ~USBSERIAL_RTS_MASK;
+	USBSERIAL_RTS_DDR  |= USBSERIAL_RTS_MASK;
+	USBSERIAL_CTS_PORT |= USBSERIAL_CTS_MASK;
+	#endif
+
+	/* Host RTS output to the target deasserted */
+	USBSERIAL_HOST_RTS_PORT |= USBSERIAL_HOST_RTS_MASK;
+	USBSERIAL_HOST_RTS_DDR  |= USBSERIAL_HOST_RTS_MASK;
+
 	/* Pull target /RESET line high */
 	AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
 	AVR_RESET_LINE_DDR  |= AVR_RESET_LINE_MASK;
 }
 
+/** Determines if the target has asked for data to stop through its RTS line, which drives our CTS input.
+ *
+ *  \return Boolean true if flow control is on and the target can't take more data, false otherwise
+ */
+bool USBtoUSART_IsBlocked(void)
+{
+#if defined(USBSERIAL_FLOW_CONTROL)
+	return (FlowControl && (USBSERIAL_CTS_PIN & USBSERIAL_CTS_MASK));
+#else
+	return false;
+#endif
+}
+
+/** Switches RTS/CTS flow control with the target on or off. While it is off RTS is held asserted, so that
+ *  a target which does use flow control is never stopped by it.
+ *
+ *  \param[in] Enable  Boolean true to honour the target's RTS line, false to ignore it
+ */
+void USBtoUSART_SetFlowControl(const bool Enable)
+{
+#if defined(USBSERIAL_FLOW_CONTROL)
+	FlowControl = Enable;
+
+	USBSERIAL_RTS_PORT &= ~USBSERIAL_RTS_MASK;
+#endif
+}
+
+/** Sends the host a CDC serial state notification when the USART receive ISR has seen a break or a line error,
+ *  or the host has opened the port. The notification is ten bytes, more than the notification endpoint holds,
+ *  so the header and the state go out in separate packets; nothing here waits for the host to poll.
+ */
+void SerialState_Task(void)
+{
+	if (USB_DeviceState != DEVICE_STATE_Configured)
+	{
+		SerialStateHeaderSent = false;
+		return;
+	}
+
+	if (!(SerialStateHeaderSent || SerialStatePending || SerialStateEvents))
+	  return;
+
+	Endpoint_SelectEndpoint(CDC_NOTIFICATION_EPNUM);
+
+	if (!(Endpoint_IsINReady()))
+	  return;
+
+	if (SerialStateHeaderSent)
+	{
+		Endpoint_Write_Word_LE(SerialStateSending);
+		Endpoint_ClearIN();
+
+		SerialStateHeaderSent = false;
+		return;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		/* Breaks and errors are one-off events, DCD and DSR just say that the bridge is up */
+		SerialStateSending = (CDC_CONTROL_LINE_IN_DCD | CDC_CONTROL_LINE_IN_DSR | SerialStateEvents);
+		SerialStateEvents  = 0;
+		SerialStatePending = false;
+	}
+
+	USB_Request_Header_t Notification = (USB_Request_Header_t)
+		{
+			.bmRequestType = (REQDIR_DEVICETOHOST | REQTYPE_CLASS | REQREC_INTERFACE),
+			.bRequest      = NOTIF_SerialState,
+			.wValue        = 0,
+			.wIndex        = VirtualSerial_CDC_Interface.Config.ControlInterfaceNumber,
+			.wLength       = sizeof(SerialStateSending),
+		};
+
+	Endpoint_Write_Block(&Notification, sizeof(Notification));
+	Endpoint_ClearIN();
+
+	SerialStateHeaderSent = true;
+}
+
+/** Sends everything still queued for the target out of the USART, waiting until the last byte has left the
+ *  line. Used before the line is reconfigured or a break is sent, so that neither cuts into earlier data.
+ */
+void USBtoUSART_Drain(void)
+{
+	if (!(UCSR1B & (1 << TXEN1)))
+	  return;
+
+	bool Drained = false;
+
+	UCSR1B &= ~(1 << UDRIE1);
+
+	while (!(RingBuffer_IsEmpty(&USBtoUSART_Buffer)))
+	{
+		while (!(UCSR1A & (1 << UDRE1)));
+		UCSR1A |= (1 << TXC1);
+		UDR1 = RingBuffer_Remove(&USBtoUSART_Buffer);
+		Drained = true;
+	}
+
+	if (Drained)
+	  while (!(UCSR1A & (1 << TXC1)));
+}
+
+/** Ends a break sent to the target, handing the TX line back to the USART. */
+void USBtoUSART_EndBreak(void)
+{
+	BreakTicks = 0;
+
+	/* Idle level for whenever the transmitter is off again */
+	PORTD |= (1 << 3);
+	UCSR1B |= (1 << TXEN1);
+}
+
+/** Hands the virtual serial port to the ISP programmer, or back to the target's USART. Called from the main
+ *  loop, which is the only consumer of the ring buffers while the USART is off.
+ *
+ *  \param[in] Enable  Indicates that the ISP programmer is to take over
+ */
+void USBtoUSART_SetISPMode(const bool Enable)
+{
+#if defined(USBSERIAL_ISP)
+	ISPActive = Enable;
+
+	if (Enable)
+	{
+		/* Anything the target sent before doesn't belong in the programmer's replies */
+		RingBuffer_InitBuffer(&USARTtoUSB_Buffer, USARTtoUSB_Storage, sizeof(USARTtoUSB_Storage));
+		ISP_Start();
+		return;
+	}
+
+	ISP_Stop();
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		/* The rest of an aborted programming session must not reach the target */
+		RingBuffer_InitBuffer(&USBtoUSART_Buffer, USBtoUSART_Storage, sizeof(USBtoUSART_Storage));
+		EVENT_CDC_Device_LineEncodingChanged(&VirtualSerial_CDC_Interface);
+	}
+#endif
+}
+
+/** Starts a bridge assisted bootloader entry, holding the target in reset for \ref USBSERIAL_BOOT_RESET_TICKS.
+ *  Flow control is switched off, as the bootloader doesn't drive RTS.
+ *
+ *  \param[in] Sequence  STK500v2 sequence number to use in the sign-on messages
+ */
+void BootEntry_Start(const uint8_t Sequence)
+{
+	USBtoUSART_SetFlowControl(false);
+
+	AVR_RESET_LINE_PORT &= ~AVR_RESET_LINE_MASK;
+
+	BootEntry.Sequence = Sequence;
+	BootEntry.InReset  = true;
+	BootEntry.Ticks    = USBSERIAL_BOOT_RESET_TICKS;
+}
+
+/** Runs a bridge assisted bootloader entry, once per flush timer tick. After releasing reset, a STK500v2
+ *  sign-on message is queued for the target every tick until the target answers or the sign-on phase times
+ *  out. Messages sent before the bootloader's USART is up are lost or cut short, which the bootloader's
+ *  message parser resynchronises from, so the first one it sees whole gets answered straight away.
+ */
+void BootEntry_Tick(void)
+{
+	if (BootEntry.InReset)
+	{
+		if (--BootEntry.Ticks)
+		  return;
+
+		BootEntry.InReset     = false;
+		BootEntry.TargetSpoke = false;
+		BootEntry.Ticks       = USBSERIAL_BOOT_SIGNON_TICKS;
+
+		AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
+		return;
+	}
+
+	if (BootEntry.TargetSpoke)
+	{
+		BootEntry.Ticks = 0;
+		return;
+	}
+
+	BootEntry.Ticks--;
+
+	/* MESSAGE_START, sequence, length high and low, TOKEN, CMD_SIGN_ON and the XOR checksum */
+	uint8_t SignOn[7] = {0x1B, BootEntry.Sequence, 0x00, 0x01, 0x0E, 0x01, 0x00};
+
+	for (uint8_t i = 0; i < (sizeof(SignOn) - 1); i++)
+	  SignOn[sizeof(SignOn) - 1] ^= SignOn[i];
+
+	if ((USB_TO_USART_BUFFER_SIZE - RingBuffer_GetCount(&USBtoUSART_Buffer)) < sizeof(SignOn))
+	  return;
+
+	for (uint8_t i = 0; i < sizeof(SignOn); i++)
+	  RingBuffer_Insert(&USBtoUSART_Buffer, SignOn[i]);
+}
+
+/** Event handler for the library USB Suspend event. The host has stopped the bus, so the LEDs are switched
+ *  off and the flush and idle line timers are stopped until the host wakes the device again.
+ */
+void EVENT_USB_Device_Suspend(void)
+{
+	LEDs_SetAllLEDs(LEDS_NO_LEDS);
+
+	power_timer0_disable();
+	power_timer1_disable();
+}
+
+/** Event handler for the library USB Wake Up event, restarting the timers stopped on suspend. */
+void EVENT_USB_Device_WakeUp(void)
+{
+	power_timer0_enable();
+	power_timer1_enable();
+}
+
 /** Event handler for the library USB Configuration Changed event. */
 void EVENT_USB_Device_ConfigurationChanged(void)
 {
+	USBtoUSART_Partial = false;
+
+	#if defined(USBSERIAL_SELF_UPDATE)
+	/* An image which was still arriving can't be completed after the endpoints are reset */
+	if (Update.State == USBSERIAL_UPDATE_Receiving)
+	  Update.State = USBSERIAL_UPDATE_Idle;
+	#endif
+
+	/* Endpoint memory is allocated in ascending endpoint order, so the raw channel's endpoint goes first */
+	#if defined(USBSERIAL_RAW_CHANNEL)
+	Endpoint_ConfigureEndpoint(RAW_RX_EPNUM, EP_TYPE_BULK, ENDPOINT_DIR_OUT, RAW_RX_EPSIZE, ENDPOINT_BANK_SINGLE);
+	#endif
+
 	CDC_Device_ConfigureEndpoints(&VirtualSerial_CDC_Interface);
 }
 
 /** Event handler for the library USB Unhandled Control Request event. */
 void EVENT_USB_Device_UnhandledControlRequest(void)
 {
+	if (Endpoint_IsSETUPReceived())
+	{
+		switch (USB_ControlRequest.bRequest)
+		{
+			case USBSERIAL_REQ_SetFlushPolicy:
+				if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+				{
+					Endpoint_ClearSETUP();
+					USARTtoUSB_SetFlushPolicy(USB_ControlRequest.wValue, USB_ControlRequest.wIndex);
+					Endpoint_ClearStatusStage();
+				}
+
+				break;
+			case USBSERIAL_REQ_GetFlushPolicy:
+				if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+				{
+					USBSerial_FlushPolicy_t Policy = FlushPolicy;
+
+					Endpoint_ClearSETUP();
+					Endpoint_Write_Control_Stream_LE(&Policy, sizeof(Policy));
+					Endpoint_ClearOUT();
+				}
+
+				break;
+			case USBSERIAL_REQ_EnterBootloader:
+				if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+				{
+					Endpoint_ClearSETUP();
+					BootEntry_Start(USB_ControlRequest.wValue);
+					Endpoint_ClearStatusStage();
+				}
+
+				break;
+			case USBSERIAL_REQ_GetUpdateStatus:
+				if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+				{
+					USBSerial_UpdateStatus_t Status = {.State = USBSERIAL_UPDATE_Unavailable};
+
+					#if defined(USBSERIAL_SELF_UPDATE)
+					if (Update_IsAvailable())
+					  Status.State = Update.State;
+
+					Status.Received  = Update.Received;
+					Status.MaxLength = USBSERIAL_UPDATE_MAX_LENGTH;
+					#endif
+
+					Endpoint_ClearSETUP();
+					Endpoint_Write_Control_Stream_LE(&Status, sizeof(Status));
+					Endpoint_ClearOUT();
+				}
+
+				break;
+			#if defined(USBSERIAL_SELF_UPDATE)
+			case USBSERIAL_REQ_UpdateBegin:
+				/* Requests which are left unhandled are stalled by the library */
+				if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+				    USB_ControlRequest.wValue && (USB_ControlRequest.wValue <= USBSERIAL_UPDATE_MAX_LENGTH) &&
+				    (Update.State != USBSERIAL_UPDATE_Installing) && Update_IsAvailable())
+				{
+					Endpoint_ClearSETUP();
+					Update_Begin(USB_ControlRequest.wValue, USB_ControlRequest.wIndex);
+					Endpoint_ClearStatusStage();
+				}
+
+				break;
+			case USBSERIAL_REQ_UpdateInstall:
+				if ((USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE)) &&
+				    (Update.State == USBSERIAL_UPDATE_Staged))
+				{
+					Endpoint_ClearSETUP();
+					Endpoint_ClearStatusStage();
+
+					/* The main loop leaves the bus and runs the installer */
+					Update.State = USBSERIAL_UPDATE_Installing;
+				}
+
+				break;
+			#endif
+			#if defined(USBSERIAL_STATS)
+			case USBSERIAL_REQ_GetStats:
+				if (USB_ControlRequest.bmRequestType == (REQDIR_DEVICETOHOST | REQTYPE_VENDOR | REQREC_DEVICE))
+				{
+					Endpoint_ClearSETUP();
+					Endpoint_Write_Control_Stream_LE(&Stats, sizeof(Stats));
+					Endpoint_ClearOUT();
+
+					if (USB_ControlRequest.wValue)
+					  memset(&Stats, 0x00, sizeof(Stats));
+				}
+
+				break;
+			#endif
+			#if defined(USBSERIAL_FLOW_CONTROL)
+			case USBSERIAL_REQ_SetFlowControl:
+				if (USB_ControlRequest.bmRequestType == (REQDIR_HOSTTODEVICE | REQTYPE_VENDOR | REQREC_DEVICE))
+				{
+					Endpoint_ClearSETUP();
+					USBtoUSART_SetFlowControl(USB_ControlRequest.wValue != 0);
+					Endpoint_ClearStatusStage();
+				}
+
+				break;
+			#endif
+		}
+	}
+
 	CDC_Device_ProcessControlRequest(&VirtualSerial_CDC_Interface);
 }
 
@@ -205,12 +1088,21 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
 			break;
 	}
 
+	/* Bytes still queued for the target belong to the old rate (e.g. the tail of the bootloader's
+	 * baud rate switch request), so send them out before the USART is reconfigured */
+	USBtoUSART_Drain();
+
+	/* Reconfiguring the USART also ends a break */
+	BreakTicks = 0;
+	PORTD |= (1 << 3);
+
 	/* Must turn off USART before reconfiguring it, otherwise incorrect operation may occur */
 	UCSR1B = 0;
 	UCSR1A = 0;
 	UCSR1C = 0;
 
-	/* Special case 57600 baud for compatibility with the ATmega328 bootloader. */	
+	/* Special case 57600 baud for compatibility with the ATmega328 bootloader. The high rates
+	 * the Pinoccio bootloader can switch to (250000, 500000, 1000000) are exact in double speed mode. */	
 	UBRR1  = (CDCInterfaceInfo->State.LineEncoding.BaudRateBPS == 57600)
 			 ? SERIAL_UBBRVAL(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS)
 			 : SERIAL_2X_UBBRVAL(CDCInterfaceInfo->State.LineEncoding.BaudRateBPS);	
@@ -218,6 +1110,17 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
 	UCSR1C = ConfigMask;
 	UCSR1A = (CDCInterfaceInfo->State.LineEncoding.BaudRateBPS == 57600) ? 0 : (1 << U2X1);
 	UCSR1B = ((1 << RXCIE1) | (1 << TXEN1) | (1 << RXEN1));
+
+	/* Character times have changed along with the line encoding */
+	USARTtoUSB_ConfigureIdleTimer();
+
+	#if defined(USBSERIAL_ISP)
+	ISPRequested = (CDCInterfaceInfo->State.LineEncoding.BaudRateBPS == USBSERIAL_ISP_BAUD);
+
+	/* The USART stays off until the main loop has handed the serial port back */
+	if (ISPRequested || ISPActive)
+	  UCSR1B = 0;
+	#endif
 }
 
 /** ISR to manage the reception of data from the serial port, placing received bytes into a circular buffer
@@ -225,10 +1128,100 @@ void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCI
  */
 ISR(USART1_RX_vect, ISR_BLOCK)
 {
+	/* The error flags belong to the byte in the receive buffer, so they must be read first */
+	uint8_t LineStatus   = UCSR1A;
 	uint8_t ReceivedByte = UDR1;
 
+	if (LineStatus & ((1 << FE1) | (1 << DOR1) | (1 << UPE1)))
+	{
+		/* A target holding its TX line low shows up as an all-zero byte without a stop bit */
+		if (LineStatus & (1 << FE1))
+		  SerialStateEvents |= (ReceivedByte ? CDC_CONTROL_LINE_IN_FRAMEERROR : CDC_CONTROL_LINE_IN_BREAK);
+
+		if (LineStatus & (1 << UPE1))
+		  SerialStateEvents |= CDC_CONTROL_LINE_IN_PARITYERROR;
+
+		if (LineStatus & (1 << DOR1))
+		  SerialStateEvents |= CDC_CONTROL_LINE_IN_OVERRUNERROR;
+	}
+
+	/* Restart the idle line timer, the line is still busy */
+	TCNT1  = 0;
+	TIFR1  = (1 << OCF1A);
+	TIMSK1 = (1 << OCIE1A);
+
+	BootEntry.TargetSpoke = true;
+
 	if (USB_DeviceState == DEVICE_STATE_Configured)
-	  RingBuffer_Insert(&USARTtoUSB_Buffer, ReceivedByte);
+	{
+		if (RingBuffer_IsFull(&USARTtoUSB_Buffer))
+		{
+			USBSERIAL_STATS_ADD(RxDropped, 1);
+			SerialStateEvents |= CDC_CONTROL_LINE_IN_OVERRUNERROR;
+		}
+		else
+		{
+			RingBuffer_Insert(&USARTtoUSB_Buffer, ReceivedByte);
+			USBSERIAL_STATS_HIGH(USARTtoUSBHighWater, RingBuffer_GetCount(&USARTtoUSB_Buffer));
+		}
+	}
+
+	#if defined(USBSERIAL_FLOW_CONTROL)
+	/* Hold the target off before the buffer overflows */
+	if (FlowControl && ((USART_TO_USB_BUFFER_SIZE - RingBuffer_GetCount(&USARTtoUSB_Buffer)) <= USBSERIAL_RTS_MARGIN))
+	  USBSERIAL_RTS_PORT |= USBSERIAL_RTS_MASK;
+	#endif
+}
+
+/** ISR for the idle line timer, flags the gap to the main loop once per quiet period; the USART receive
+ *  ISR arms it again with the next byte.
+ */
+ISR(TIMER1_COMPA_vect, ISR_BLOCK)
+{
+	TIMSK1 = 0;
+	LineIdlePending = true;
+}
+
+/** ISR for the flush timer, flags the tick to the main loop, wakes it from sleep and times the LED pulses. */
+ISR(TIMER0_OVF_vect, ISR_BLOCK)
+{
+	FlushTickPending = true;
+
+	/* Activity since the last tick (re)starts an LED pulse, which otherwise runs down and turns the LED off */
+	if (TxLEDActivity)
+	{
+		TxLEDActivity = false;
+		LEDs_TurnOnLEDs(LEDMASK_TX);
+		PulseMSRemaining.TxLEDPulse = TX_RX_LED_PULSE_MS;
+	}
+	else if (PulseMSRemaining.TxLEDPulse && !(--PulseMSRemaining.TxLEDPulse))
+	{
+		LEDs_TurnOffLEDs(LEDMASK_TX);
+	}
+
+	if (RxLEDActivity)
+	{
+		RxLEDActivity = false;
+		LEDs_TurnOnLEDs(LEDMASK_RX);
+		PulseMSRemaining.RxLEDPulse = TX_RX_LED_PULSE_MS;
+	}
+	else if (PulseMSRemaining.RxLEDPulse && !(--PulseMSRemaining.RxLEDPulse))
+	{
+		LEDs_TurnOffLEDs(LEDMASK_RX);
+	}
+}
+
+/** ISR to feed the serial port from the circular buffer of data received from the host, one byte per
+ *  data register empty interrupt. The interrupt is enabled from the main loop whenever data is waiting,
+ *  and disables itself once the buffer runs dry.
+ */
+ISR(USART1_UDRE_vect, ISR_BLOCK)
+{
+	/* The main loop enables the interrupt again once the target's RTS line allows it */
+	if (RingBuffer_IsEmpty(&USBtoUSART_Buffer) || USBtoUSART_IsBlocked())
+	  UCSR1B &= ~(1 << UDRIE1);
+	else
+	  UDR1 = RingBuffer_Remove(&USBtoUSART_Buffer);
 }
 
 /** Event handler for the CDC Class driver Host-to-Device Line Encoding Changed event.
@@ -239,8 +1232,54 @@ void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const C
 {
 	bool CurrentDTRState = (CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_DTR);
 
+	/* The target's bootloader doesn't drive RTS, so the host has to switch flow control on again after a reset */
 	if (CurrentDTRState)
-	  AVR_RESET_LINE_PORT &= ~AVR_RESET_LINE_MASK;
+	{
+		AVR_RESET_LINE_PORT &= ~AVR_RESET_LINE_MASK;
+		USBtoUSART_SetFlowControl(false);
+
+		/* The host has opened the port, tell it the bridge is up */
+		SerialStatePending = true;
+	}
 	else
 	  AVR_RESET_LINE_PORT |= AVR_RESET_LINE_MASK;
+
+	/* RTS is passed through to the target as is, for the target application to give it a meaning */
+	if (CDCInterfaceInfo->State.ControlLineStates.HostToDevice & CDC_CONTROL_LINE_OUT_RTS)
+	  USBSERIAL_HOST_RTS_PORT &= ~USBSERIAL_HOST_RTS_MASK;
+	else
+	  USBSERIAL_HOST_RTS_PORT |= USBSERIAL_HOST_RTS_MASK;
+}
+
+/** Event handler for the CDC Class driver Send Break event. The TX line to the target is held low for the
+ *  given time, rounded up to flush timer ticks, or until the host ends the break with a zero duration. A
+ *  target sees the break as a framing error on an all-zero byte, an out of band signal which needs no
+ *  escape sequences in the data.
+ *
+ *  \param[in] CDCInterfaceInfo  Pointer to the CDC class interface configuration structure being referenced
+ *  \param[in] Duration          Duration of the break in milliseconds, or \ref USBSERIAL_BREAK_INDEFINITE
+ */
+void EVENT_CDC_Device_BreakSent(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+                                const uint8_t Duration)
+{
+	if (!(Duration))
+	{
+		if (BreakTicks)
+		  USBtoUSART_EndBreak();
+
+		return;
+	}
+
+	/* No line to break while the USART is off, e.g. while the ISP programmer has the port */
+	if (!(BreakTicks) && !(UCSR1B & (1 << TXEN1)))
+	  return;
+
+	USBtoUSART_Drain();
+
+	BreakTicks = (Duration == USBSERIAL_BREAK_INDEFINITE) ? USBSERIAL_BREAK_INDEFINITE : ((Duration + 3) / 4);
+
+	/* With the transmitter off the port drives the TX pin */
+	PORTD  &= ~(1 << 3);
+	DDRD   |= (1 << 3);
+	UCSR1B &= ~((1 << TXEN1) | (1 << UDRIE1));
 }
\ No newline at end of file
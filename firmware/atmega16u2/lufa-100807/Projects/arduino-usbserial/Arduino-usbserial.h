@@ -36,15 +36,180 @@
 #ifndef _ARDUINO_USBSERIAL_H_
 #define _ARDUINO_USBSERIAL_H_
 
+	/* Macros: */
+		#if defined(USBSERIAL_HIGH_THROUGHPUT) || defined(__DOXYGEN__)
+			/** Size of the host to target ring buffer, in bytes. The host is throttled by NAKs on the OUT
+			 *  endpoint once this fills, so the high throughput profile spends its RAM on the other direction.
+			 */
+			#define USB_TO_USART_BUFFER_SIZE   64
+
+			/** Size of the target to host ring buffer, in bytes. The target cannot be throttled, so this must
+			 *  absorb everything received from the USART while the host is not polling the IN endpoint.
+			 */
+			#define USART_TO_USB_BUFFER_SIZE   256
+		#else
+			#define USB_TO_USART_BUFFER_SIZE   128
+			#define USART_TO_USB_BUFFER_SIZE   128
+		#endif
+
+		/** Number of bytes to hold in the target to host ring buffer before forcing a flush to the host,
+		 *  three quarters of the buffer size.
+		 */
+		#define USART_TO_USB_NEARLY_FULL       ((USART_TO_USB_BUFFER_SIZE / 4) * 3)
+
+		/** Default idle line gap, in character times, after which data buffered from the target is flushed
+		 *  to the host without waiting for the flush timer.
+		 */
+		#define USBSERIAL_FLUSH_IDLE_CHARS     2
+
+		/** Largest idle line gap accepted by \ref USBSERIAL_REQ_SetFlushPolicy, in character times. Longer
+		 *  gaps are pointless, as the flush timer expires first at all but the slowest baud rates.
+		 */
+		#define USBSERIAL_FLUSH_MAX_IDLE_CHARS 32
+
+		/** Vendor specific device request to set the flush policy. wValue holds the idle line gap in
+		 *  character times (zero disables idle flushing) and wIndex the packet size, which is rounded down
+		 *  to a power of two no larger than \ref CDC_TXRX_EPSIZE.
+		 */
+		#define USBSERIAL_REQ_SetFlushPolicy   0x01
+
+		/** Vendor specific device request to read back the flush policy, as a \ref USBSerial_FlushPolicy_t. */
+		#define USBSERIAL_REQ_GetFlushPolicy   0x02
+
+		/** Vendor specific device request to switch RTS/CTS flow control with the target on (wValue non-zero)
+		 *  or off. Flow control always starts off, and is switched off again whenever DTR resets the target,
+		 *  as the target's bootloader doesn't drive RTS. Only available in builds with \ref USBSERIAL_FLOW_CONTROL.
+		 */
+		#define USBSERIAL_REQ_SetFlowControl   0x03
+
+		/** Vendor specific device request to read the link statistics, as a \ref USBSerial_Stats_t. A non-zero
+		 *  wValue clears the counters once they have been read. Only available in builds with \ref USBSERIAL_STATS.
+		 */
+		#define USBSERIAL_REQ_GetStats         0x04
+
+		/** Vendor specific device request to reset the target into its STK500v2 bootloader. The bridge pulses
+		 *  the reset line and then offers the bootloader a sign-on message, with wValue as its sequence number,
+		 *  every flush timer tick until the target answers. The host just reads the sign-on answer from the
+		 *  serial port, which must already be set to the bootloader's baud rate, with DTR deasserted.
+		 */
+		#define USBSERIAL_REQ_EnterBootloader  0x05
+
+		/** Flush timer ticks, of about 4ms each, for which the reset line is held by \ref USBSERIAL_REQ_EnterBootloader. */
+		#define USBSERIAL_BOOT_RESET_TICKS     2
+
+		/** Flush timer ticks for which the bootloader is offered the sign-on message before the bridge gives up. */
+		#define USBSERIAL_BOOT_SIGNON_TICKS    62
+
+		/** Vendor specific device request to start staging a new bridge firmware image. wValue holds the image
+		 *  length in bytes and wIndex its CRC-CCITT; the image itself then follows as plain data on the raw channel
+		 *  endpoint, which no longer feeds the target until the update ends. The request is stalled if the image
+		 *  doesn't fit, or if the bootloader doesn't export the flash API (see Lib/BootloaderAPI.h). Only available
+		 *  in builds with \ref USBSERIAL_SELF_UPDATE.
+		 */
+		#define USBSERIAL_REQ_UpdateBegin      0x06
+
+		/** Vendor specific device request to read the progress of a firmware update, as a \ref USBSerial_UpdateStatus_t. */
+		#define USBSERIAL_REQ_GetUpdateStatus  0x07
+
+		/** Vendor specific device request to install a completely staged and verified firmware image. The bridge
+		 *  detaches from the bus, copies the image over itself and restarts through the watchdog. The request is
+		 *  stalled unless the update is in the \ref USBSERIAL_UPDATE_Staged state.
+		 */
+		#define USBSERIAL_REQ_UpdateInstall    0x08
+
+		#if defined(USBSERIAL_SELF_UPDATE) || defined(__DOXYGEN__)
+			#if !defined(USBSERIAL_RAW_CHANNEL)
+				#error USBSERIAL_SELF_UPDATE needs the raw channel, build with RAW_CHANNEL=1.
+			#endif
+
+			/** Byte address of the first flash page of the boot section, 4KB on the 16U2. */
+			#if !defined(USBSERIAL_UPDATE_BOOT_START)
+				#define USBSERIAL_UPDATE_BOOT_START    0x3000
+			#endif
+
+			/** Byte address of the flash page holding \ref Update_Install(), the last page below the boot section.
+			 *  Must match the .installer section start in the makefile.
+			 */
+			#define USBSERIAL_UPDATE_INSTALLER     (USBSERIAL_UPDATE_BOOT_START - SPM_PAGESIZE)
+
+			/** Byte address of the staging area, the flash between it and \ref USBSERIAL_UPDATE_INSTALLER. The running
+			 *  bridge must end below it, which \ref USBSERIAL_REQ_UpdateBegin checks.
+			 */
+			#define USBSERIAL_UPDATE_STAGING       0x1800
+
+			/** Largest firmware image which can be staged, in bytes. */
+			#define USBSERIAL_UPDATE_MAX_LENGTH    (USBSERIAL_UPDATE_INSTALLER - USBSERIAL_UPDATE_STAGING)
+		#endif
+
+		#if defined(USBSERIAL_FLOW_CONTROL) || defined(__DOXYGEN__)
+			/** RTS output to the target's CTS input, driven low while \ref USARTtoUSB_Buffer has room. The 16U2's
+			 *  own USART flow control pins are PD6 and PD7, which are the RX LED and the target reset line here,
+			 *  so the handshake lines are on spare PORTB pins instead.
+			 */
+			#define USBSERIAL_RTS_PORT         PORTB
+			#define USBSERIAL_RTS_DDR          DDRB
+			#define USBSERIAL_RTS_MASK         (1 << 4)
+
+			/** CTS input from the target's RTS output, low while the target can take more data. */
+			#define USBSERIAL_CTS_PIN          PINB
+			#define USBSERIAL_CTS_PORT         PORTB
+			#define USBSERIAL_CTS_MASK         (1 << 5)
+
+			/** Free space left in \ref USARTtoUSB_Buffer when RTS is deasserted, covering the bytes the target
+			 *  already has on their way. RTS is asserted again once twice this much space is free.
+			 */
+			#define USBSERIAL_RTS_MARGIN       8
+		#endif
+
+		#if defined(USBSERIAL_ISP) || defined(__DOXYGEN__)
+			/** Baud rate at which the virtual serial port is handed to the ISP programmer (Lib/ISPProgrammer.c)
+			 *  instead of the target's USART, e.g. avrdude -c stk500v2 -b 1200. Any other rate hands it back.
+			 */
+			#if !defined(USBSERIAL_ISP_BAUD)
+				#define USBSERIAL_ISP_BAUD     1200
+			#endif
+		#endif
+
+		/** Break duration, as truncated to a byte by the CDC class driver, for a break which lasts until the host
+		 *  ends it (a SEND_BREAK wValue of 0xFFFF, as sent for TIOCSBRK).
+		 */
+		#define USBSERIAL_BREAK_INDEFINITE     0xFF
+
+		/** Output to a spare input of the target which follows the host's RTS line, low while RTS is asserted.
+		 *  No such line is routed on the Pinoccio board, so it needs a wire to the target pin of choice.
+		 */
+		#if !defined(USBSERIAL_HOST_RTS_PORT)
+			#define USBSERIAL_HOST_RTS_PORT    PORTB
+			#define USBSERIAL_HOST_RTS_DDR     DDRB
+			#define USBSERIAL_HOST_RTS_MASK    (1 << 6)
+		#endif
+
+		/** Size of the largest ring buffer, which sets the width of the ring buffer indexes. */
+		#define RINGBUFF_MAX_SIZE              ((USB_TO_USART_BUFFER_SIZE > USART_TO_USB_BUFFER_SIZE) ? \
+		                                        USB_TO_USART_BUFFER_SIZE : USART_TO_USB_BUFFER_SIZE)
+
 	/* Includes: */
 		#include <avr/io.h>
 		#include <avr/wdt.h>
 		#include <avr/interrupt.h>
 		#include <avr/power.h>
+		#include <avr/sleep.h>
+
+		#include <string.h>
+
+		#if defined(USBSERIAL_SELF_UPDATE)
+			#include <util/crc16.h>
+			#include <util/delay.h>
+		#endif
 
 		#include "Descriptors.h"
 
 		#include "Lib/LightweightRingBuff.h"
+		#include "Lib/BootloaderAPI.h"
+
+		#if defined(USBSERIAL_ISP)
+			#include "Lib/ISPProgrammer.h"
+		#endif
 
 		#include <LUFA/Version.h>
 		#include <LUFA/Drivers/Board/LEDs.h>
@@ -65,15 +230,96 @@
 		/** LED mask for the library LED driver, to indicate that the USB interface is busy. */
 		#define LEDMASK_BUSY             (LEDS_LED1 | LEDS_LED2)		
 		
+	/* Type Defines: */
+		/** Type define for the policy deciding when data from the target is flushed to the host. */
+		typedef struct
+		{
+			uint8_t IdleChars; /**< Idle line gap, in character times, after which everything buffered is sent */
+			uint8_t PacketSize; /**< While data is still arriving, only multiples of this many bytes are sent */
+		} USBSerial_FlushPolicy_t;
+
+		/** Type define for the link statistics, read by the host with \ref USBSERIAL_REQ_GetStats. */
+		typedef struct
+		{
+			uint32_t HostToTargetBytes; /**< Bytes taken from the host's OUT endpoints */
+			uint32_t TargetToHostBytes; /**< Bytes written to the host's IN endpoint */
+			uint16_t USBtoUSARTHighWater; /**< Highest fill level seen in the host to target buffer */
+			uint16_t USARTtoUSBHighWater; /**< Highest fill level seen in the target to host buffer */
+			uint16_t RxDropped; /**< Bytes from the target dropped because the target to host buffer was full */
+			uint16_t FlushIdle; /**< Flushes to the host because the USART line went idle */
+			uint16_t FlushTimer; /**< Flushes to the host because the flush timer expired */
+			uint16_t FlushNearlyFull; /**< Flushes to the host because the target to host buffer was nearly full */
+			uint16_t FlushPacket; /**< Whole packet sends while data from the target was still streaming in */
+			uint16_t EndpointNotReady; /**< Times the IN endpoint had no free bank, so data from the target was left for a later pass */
+		} USBSerial_Stats_t;
+
+		/** Enum for the states of a bridge firmware update, see \ref USBSERIAL_REQ_UpdateBegin. */
+		enum USBSerial_UpdateStates_t
+		{
+			USBSERIAL_UPDATE_Idle        = 0, /**< No update in progress, the raw channel feeds the target */
+			USBSERIAL_UPDATE_Receiving   = 1, /**< Image data from the raw channel is being written to the staging area */
+			USBSERIAL_UPDATE_Staged      = 2, /**< The whole image has been staged and its CRC matched */
+			USBSERIAL_UPDATE_Failed      = 3, /**< The staged image didn't match the CRC given to \ref USBSERIAL_REQ_UpdateBegin */
+			USBSERIAL_UPDATE_Installing  = 4, /**< The image is about to be copied over the running bridge */
+			USBSERIAL_UPDATE_Unavailable = 5, /**< The bootloader doesn't export its flash API, or the bridge overlaps the staging area */
+		};
+
+		/** Type define for the progress of a bridge firmware update, read by the host with \ref USBSERIAL_REQ_GetUpdateStatus. */
+		typedef struct
+		{
+			uint8_t  State; /**< Current state, a value from the \ref USBSerial_UpdateStates_t enum */
+			uint16_t Received; /**< Image bytes staged so far */
+			uint16_t MaxLength; /**< Largest image which can be staged, zero in builds without \ref USBSERIAL_SELF_UPDATE */
+		} USBSerial_UpdateStatus_t;
+
+		#if defined(USBSERIAL_STATS) || defined(__DOXYGEN__)
+			/** Adds to one of the link statistics counters, atomically as the host may read them from the USB interrupt. */
+			#define USBSERIAL_STATS_ADD(Field, Value)   do { ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { Stats.Field += (Value); } } while (0)
+
+			/** Raises one of the link statistics high-water marks to the given level. */
+			#define USBSERIAL_STATS_HIGH(Field, Level)  do { if ((Level) > Stats.Field) Stats.Field = (Level); } while (0)
+		#else
+			#define USBSERIAL_STATS_ADD(Field, Value)
+			#define USBSERIAL_STATS_HIGH(Field, Level)
+		#endif
+
 	/* Function Prototypes: */
 		void SetupHardware(void);
+		void WaitForEvent(void);
+
+		void USBtoUSART_Task(void);
+		bool USBtoUSART_IsBlocked(void);
+		void USBtoUSART_SetFlowControl(const bool Enable);
+		void USBtoUSART_SetISPMode(const bool Enable);
+		void USBtoUSART_Drain(void);
+		void USBtoUSART_EndBreak(void);
+		void SerialState_Task(void);
+		void BootEntry_Start(const uint8_t Sequence);
+		void BootEntry_Tick(void);
+		bool USBtoUSART_ReadBlock(const uint8_t EndpointNumber);
+		bool USARTtoUSB_WriteBlock(RingBuff_Count_t BufferCount);
+		void USARTtoUSB_SetFlushPolicy(const uint16_t IdleChars,
+		                               const uint16_t PacketSize);
+		void USARTtoUSB_ConfigureIdleTimer(void);
+
+		#if defined(USBSERIAL_SELF_UPDATE)
+		bool Update_IsAvailable(void);
+		void Update_Begin(const uint16_t Length,
+		                  const uint16_t CRC);
+		void Update_ReadBlock(void);
+		void Update_Install(const uint16_t Length) ATTR_NO_RETURN __attribute__ ((section (".installer"), noinline));
+		#endif
 
 		void EVENT_USB_Device_Connect(void);
 		void EVENT_USB_Device_Disconnect(void);
+		void EVENT_USB_Device_Suspend(void);
+		void EVENT_USB_Device_WakeUp(void);
 		void EVENT_USB_Device_ConfigurationChanged(void);
 		void EVENT_USB_Device_UnhandledControlRequest(void);
 		
 		void EVENT_CDC_Device_LineEncodingChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
-		void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);		
+		void EVENT_CDC_Device_ControLineStateChanged(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo);
+		void EVENT_CDC_Device_BreakSent(USB_ClassInfo_CDC_Device_t* const CDCInterfaceInfo,
+		                                const uint8_t Duration);		
 
 #endif /* _ARDUINO_USBSERIAL_H_ */
\ No newline at end of file
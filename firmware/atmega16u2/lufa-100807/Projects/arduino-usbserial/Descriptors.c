@@ -59,9 +59,16 @@ const USB_Descriptor_Device_t PROGMEM DeviceDescriptor =
 	.Header                 = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
 		
 	.USBSpecification       = VERSION_BCD(01.10),
+#if defined(USBSERIAL_RAW_CHANNEL)
+	/* Composite device, the CDC interfaces are grouped by an interface association descriptor */
+	.Class                  = 0xEF,
+	.SubClass               = 0x02,
+	.Protocol               = 0x01,
+#else
 	.Class                  = 0x02,
 	.SubClass               = 0x00,
 	.Protocol               = 0x00,
+#endif
 				
 	.Endpoint0Size          = FIXED_CONTROL_ENDPOINT_SIZE,
 		
@@ -88,7 +95,11 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
 
 			.TotalConfigurationSize = sizeof(USB_Descriptor_Configuration_t),
+#if defined(USBSERIAL_RAW_CHANNEL)
+			.TotalInterfaces        = 3,
+#else
 			.TotalInterfaces        = 2,
+#endif
 				
 			.ConfigurationNumber    = 1,
 			.ConfigurationStrIndex  = NO_DESCRIPTOR,
@@ -98,6 +109,22 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.MaxPowerConsumption    = USB_CONFIG_POWER_MA(500)
 		},
 		
+#if defined(USBSERIAL_RAW_CHANNEL)
+	.CDC_IAD =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_Association_t), .Type = DTYPE_InterfaceAssociation},
+
+			.FirstInterfaceIndex    = 0,
+			.TotalInterfaces        = 2,
+
+			.Class                  = 0x02,
+			.SubClass               = 0x02,
+			.Protocol               = 0x01,
+
+			.IADStrIndex            = NO_DESCRIPTOR
+		},
+
+#endif
 	.CDC_CCI_Interface = 
 		{
 			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
@@ -145,7 +172,7 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_IN | CDC_NOTIFICATION_EPNUM),
 			.Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
 			.EndpointSize           = CDC_NOTIFICATION_EPSIZE,
-			.PollingIntervalMS      = 0xFF
+			.PollingIntervalMS      = 0x01
 		},
 
 	.CDC_DCI_Interface = 
@@ -182,7 +209,35 @@ const USB_Descriptor_Configuration_t PROGMEM ConfigurationDescriptor =
 			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
 			.EndpointSize           = CDC_TXRX_EPSIZE,
 			.PollingIntervalMS      = 0x01
-		}
+		},
+
+#if defined(USBSERIAL_RAW_CHANNEL)
+	.RAW_Interface =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+
+			.InterfaceNumber        = RAW_INTERFACE_NUMBER,
+			.AlternateSetting       = 0,
+
+			.TotalEndpoints         = 1,
+
+			.Class                  = 0xFF,
+			.SubClass               = 0x00,
+			.Protocol               = 0x00,
+
+			.InterfaceStrIndex      = NO_DESCRIPTOR
+		},
+
+	.RAW_DataOutEndpoint =
+		{
+			.Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+
+			.EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_OUT | RAW_RX_EPNUM),
+			.Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+			.EndpointSize           = RAW_RX_EPSIZE,
+			.PollingIntervalMS      = 0x01
+		},
+#endif
 };
 
 /** Language descriptor structure. This descriptor, located in FLASH memory, is returned when the host requests
@@ -60,8 +60,38 @@
 		/** Size in bytes of the CDC device-to-host notification IN endpoint. */
 		#define CDC_NOTIFICATION_EPSIZE        8
 
-		/** Size in bytes of the CDC data IN and OUT endpoints. */
-		#define CDC_TXRX_EPSIZE                64	
+		#if defined(USBSERIAL_HIGH_THROUGHPUT) || defined(__DOXYGEN__)
+			/** Size in bytes of the CDC data IN and OUT endpoints. The 176 bytes of endpoint DPRAM on the
+			 *  ATmega8U2/16U2/32U2 cannot hold two double banked 64 byte endpoints next to the control and
+			 *  notification endpoints, so these parts double bank 32 byte endpoints instead.
+			 */
+			#if (defined(__AVR_ATmega8U2__) || defined(__AVR_ATmega16U2__) || defined(__AVR_ATmega32U2__))
+				#define CDC_TXRX_EPSIZE        32
+			#else
+				#define CDC_TXRX_EPSIZE        64
+			#endif
+
+			/** Indicates if the CDC data IN and OUT endpoints are double banked, so that the host and the
+			 *  firmware can each work on one bank at the same time.
+			 */
+			#define CDC_TXRX_DOUBLEBANK        true
+		#else
+			#define CDC_TXRX_EPSIZE            64
+			#define CDC_TXRX_DOUBLEBANK        false
+		#endif
+
+		#if defined(USBSERIAL_RAW_CHANNEL) || defined(__DOXYGEN__)
+			/** Interface number of the vendor specific raw channel interface. */
+			#define RAW_INTERFACE_NUMBER       2
+
+			/** Endpoint number of the raw channel host-to-device bulk OUT endpoint. This is the last endpoint
+			 *  on the ATmega8U2/16U2/32U2, so the raw channel only runs from the host to the target.
+			 */
+			#define RAW_RX_EPNUM               1
+
+			/** Size in bytes of the raw channel OUT endpoint, which takes the last 32 bytes of endpoint DPRAM. */
+			#define RAW_RX_EPSIZE              32
+		#endif
 
 	/* Type Defines: */
 		/** Type define for the device configuration descriptor structure. This must be defined in the
@@ -71,6 +101,9 @@
 		typedef struct
 		{
 			USB_Descriptor_Configuration_Header_t    Config;
+			#if defined(USBSERIAL_RAW_CHANNEL)
+			USB_Descriptor_Interface_Association_t   CDC_IAD;
+			#endif
 			USB_Descriptor_Interface_t               CDC_CCI_Interface;
 			CDC_FUNCTIONAL_DESCRIPTOR(2)             CDC_Functional_IntHeader;
 			CDC_FUNCTIONAL_DESCRIPTOR(1)             CDC_Functional_AbstractControlManagement;
@@ -79,6 +112,10 @@
 			USB_Descriptor_Interface_t               CDC_DCI_Interface;
 			USB_Descriptor_Endpoint_t                CDC_DataOutEndpoint;
 			USB_Descriptor_Endpoint_t                CDC_DataInEndpoint;
+			#if defined(USBSERIAL_RAW_CHANNEL)
+			USB_Descriptor_Interface_t               RAW_Interface;
+			USB_Descriptor_Endpoint_t                RAW_DataOutEndpoint;
+			#endif
 		} USB_Descriptor_Configuration_t;
 
 	/* Function Prototypes: */
@@ -0,0 +1,92 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2010.
+
+  dean [at] fourwalledcubicle [dot] com
+      www.fourwalledcubicle.com
+*/
+
+/*
+  Copyright 2010  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Calls into the flash programming API exported by the bootloader. SPM only works from the boot
+ *  section, so an application which reprograms its own flash has to go through a jump table which
+ *  the bootloader places at the very end of flash. The table layout is the one of the LUFA DFU and
+ *  CDC bootloaders (BootloaderAPITable.S): one two byte RJMP per entry from the start of the table,
+ *  a class signature in the last word but one and \ref BOOTLOADER_MAGIC_SIGNATURE in the last word.
+ *  The stock Atmel DFU bootloader of the 16U2 doesn't export this table, check
+ *  \ref BootloaderAPI_IsAvailable() before the first call.
+ *
+ *  The calls are plain function pointer casts rather than functions, so that code running from a
+ *  fixed flash address (see \ref Update_Install()) can use them without calling back into the rest of
+ *  the application. The application section can't be read while a page is erased or written, so
+ *  interrupts must be off around every call.
+ */
+
+#ifndef _BOOTLOADER_API_H_
+#define _BOOTLOADER_API_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <avr/pgmspace.h>
+
+		#include <stdbool.h>
+		#include <stdint.h>
+
+	/* Macros: */
+		/** Size in bytes of the bootloader API table at the end of flash. */
+		#define BOOTLOADER_API_TABLE_SIZE          32
+
+		/** Byte address of the bootloader API table. */
+		#define BOOTLOADER_API_TABLE_START         ((FLASHEND + 1UL) - BOOTLOADER_API_TABLE_SIZE)
+
+		/** Word address of the given bootloader API table entry, as used for calls. */
+		#define BOOTLOADER_API_CALL(Index)         (void*)((BOOTLOADER_API_TABLE_START + ((Index) * 2)) / 2)
+
+		/** Byte address of the magic signature which marks a bootloader API table. */
+		#define BOOTLOADER_MAGIC_SIGNATURE_START   (BOOTLOADER_API_TABLE_START + (BOOTLOADER_API_TABLE_SIZE - 2))
+
+		/** Magic signature of a bootloader API table. */
+		#define BOOTLOADER_MAGIC_SIGNATURE         0xDCFB
+
+		/** Erases the flash page at the given byte address. Clears the page buffer. */
+		#define BootloaderAPI_ErasePage(Address)         ((void (*)(uint32_t))BOOTLOADER_API_CALL(0))(Address)
+
+		/** Writes the page buffer to the flash page at the given byte address, which must be erased. */
+		#define BootloaderAPI_WritePage(Address)         ((void (*)(uint32_t))BOOTLOADER_API_CALL(1))(Address)
+
+		/** Loads one word into the page buffer, at the offset of the given byte address within its page. */
+		#define BootloaderAPI_FillWord(Address, Word)    ((void (*)(uint32_t, uint16_t))BOOTLOADER_API_CALL(2))(Address, Word)
+
+	/* Inline Functions: */
+		/** Determines if the bootloader exports the API table.
+		 *
+		 *  \return Boolean true if the magic signature is present at the end of flash, false otherwise
+		 */
+		static inline bool BootloaderAPI_IsAvailable(void)
+		{
+			return (pgm_read_word(BOOTLOADER_MAGIC_SIGNATURE_START) == BOOTLOADER_MAGIC_SIGNATURE);
+		}
+
+#endif
@@ -0,0 +1,661 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2010.
+
+  dean [at] fourwalledcubicle [dot] com
+      www.fourwalledcubicle.com
+*/
+
+/*
+  Copyright 2010  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  AVRISP compatible programmer for the main MCU, built with USBSERIAL_ISP. The STK500v2 messages avrdude
+ *  sends to the virtual serial port are handled on the bridge and turned into ISP commands on the SPI bus,
+ *  so the target's flash, bootloader section included, can be programmed without a working bootloader.
+ *
+ *  The 16U2 has no RAM to spare for whole messages, so each one is handled as it streams in: the data of a
+ *  flash or EEPROM write goes straight into the target's page buffer, and the page is only written once the
+ *  message checksum has been verified. The reply to a page write goes out before the target has finished it;
+ *  the next command waits for the target, so the write overlaps with the host sending the next page, and a
+ *  write which timed out is reported by the next programming command. Memory reads are streamed back the
+ *  same way, as the output buffer drains.
+ */
+
+#define  INCLUDE_FROM_ISPPROGRAMMER_C
+#include "../Arduino-usbserial.h"
+
+#if defined(USBSERIAL_ISP)
+
+/** Current state of the message parser, a value from the \ref ISP_ParserStates_t enum. */
+static uint8_t  ParserState;
+
+/** Sequence number of the message being received, repeated in its reply. */
+static uint8_t  Sequence;
+
+/** Running XOR checksum of the message being received. */
+static uint8_t  Checksum;
+
+/** Size of the body of the message being received, and the number of body bytes received so far. */
+static uint16_t BodySize, BodyPosition;
+
+/** Command of the message being received, the first byte of its body. */
+static uint8_t  Command;
+
+/** Fixed parameters of the command, the body bytes after the command. */
+static uint8_t  Params[11];
+
+/** Flash word or EEPROM byte address of the next memory access, bit 31 set for flash above 128KB. */
+static uint32_t CurrentAddress;
+
+/** Indicates that the target must be sent the extended address byte before the next flash access. */
+static bool     MustLoadExtendedAddress;
+
+/** Address of the first byte of the current write, for the page write command. */
+static uint16_t StartAddress;
+
+/** Memory command of the current read or write, toggled between the low and high byte of flash words. */
+static uint8_t  MemoryCommand;
+
+/** Indicates that the target may still be busy with a write, see \ref ISP_WaitReady(). */
+static bool     TargetBusy;
+
+/** Indicates that the target is polled for the end of the current write rather than waited for. */
+static bool     BusyPollRdyBsy;
+
+/** Time the current write takes when it isn't polled, in milliseconds. */
+static uint8_t  BusyDelayMS;
+
+/** Status of the last write, reported with the reply to the next programming command. */
+static uint8_t  WriteStatus = STATUS_CMD_OK;
+
+/** Bytes still to be read from the target for the reply of the current memory read. */
+static uint16_t ReadRemaining;
+
+/** Indicates that the reply of a memory read is still being sent. */
+static bool     ReadPending;
+
+/** Bytes clocked back in by the current CMD_SPI_MULTI command, and their number. */
+static uint8_t  MultiRxData[ISP_SPI_MULTI_MAX_RX], MultiRxCount;
+
+/** Checksum of the reply being sent. */
+static uint8_t  ReplyChecksum;
+
+/** SCK duration set by the host, see \ref ISP_Start(). */
+static uint8_t  SCKDuration = ISP_DEFAULT_SCK_DURATION;
+
+/** Reset polarity set by the host, non-zero for the active low reset of AVRs. */
+static uint8_t  ResetPolarity = 1;
+
+/** Resets the message parser, for a new programming session. The target is left alone until the host
+ *  enters programming mode.
+ */
+void ISP_Start(void)
+{
+	ParserState = ISP_PARSE_Start;
+	ReadPending = false;
+	TargetBusy  = false;
+	WriteStatus = STATUS_CMD_OK;
+}
+
+/** Lets go of the target, releasing its reset line and the SPI bus (the backpack bus on the Pinoccio board). */
+void ISP_Stop(void)
+{
+	ISP_SetReset(false);
+	SPI_ShutDown();
+}
+
+/** Feeds the programmer with host data from the given buffer and writes its replies to the other. Input
+ *  is only taken while there is room for a reply, and not while the reply of a memory read is still going out.
+ *
+ *  \param[in,out] Input   Buffer holding the STK500v2 messages from the host
+ *  \param[in,out] Output  Buffer for the replies to the host
+ *
+ *  \return Boolean true if replies are waiting in the output buffer, which should be flushed to the host now
+ */
+bool ISP_Task(RingBuff_t* const Input,
+              RingBuff_t* const Output)
+{
+	if (ReadPending)
+	  ISP_ContinueRead(Output);
+
+	while (!(ReadPending) && !(RingBuffer_IsEmpty(Input)) &&
+	       ((RingBuffer_GetSize(Output) - RingBuffer_GetCount(Output)) >= ISP_REPLY_SPACE))
+	{
+		ISP_ParseByte(RingBuffer_Remove(Input), Output);
+	}
+
+	return (ReadPending || !(RingBuffer_IsEmpty(Output)));
+}
+
+/** Runs one byte from the host through the message parser, handling the command once its message is complete.
+ *
+ *  \param[in]     Byte    Next byte from the host
+ *  \param[in,out] Output  Buffer for the reply
+ */
+static void ISP_ParseByte(const uint8_t Byte,
+                          RingBuff_t* const Output)
+{
+	Checksum ^= Byte;
+
+	switch (ParserState)
+	{
+		case ISP_PARSE_Start:
+			if (Byte == MESSAGE_START)
+			{
+				Checksum    = MESSAGE_START;
+				ParserState = ISP_PARSE_Sequence;
+			}
+
+			break;
+		case ISP_PARSE_Sequence:
+			Sequence    = Byte;
+			ParserState = ISP_PARSE_SizeHigh;
+			break;
+		case ISP_PARSE_SizeHigh:
+			BodySize    = ((uint16_t)Byte << 8);
+			ParserState = ISP_PARSE_SizeLow;
+			break;
+		case ISP_PARSE_SizeLow:
+			BodySize   |= Byte;
+			ParserState = ISP_PARSE_Token;
+			break;
+		case ISP_PARSE_Token:
+			BodyPosition = 0;
+			ParserState  = ((Byte == TOKEN) && BodySize) ? ISP_PARSE_Body : ISP_PARSE_Start;
+			break;
+		case ISP_PARSE_Body:
+			ISP_BodyByte(Byte, BodyPosition);
+
+			if (++BodyPosition == BodySize)
+			  ParserState = ISP_PARSE_Checksum;
+
+			break;
+		case ISP_PARSE_Checksum:
+			ParserState = ISP_PARSE_Start;
+			ISP_ProcessCommand(Output, (Checksum == 0));
+			break;
+	}
+}
+
+/** Stores a byte of the message body, passing the data of memory writes and CMD_SPI_MULTI on to the target
+ *  as it arrives.
+ *
+ *  \param[in] Byte      Body byte
+ *  \param[in] Position  Offset of the byte in the body
+ */
+static void ISP_BodyByte(const uint8_t Byte,
+                         const uint16_t Position)
+{
+	if (!(Position))
+	{
+		Command      = Byte;
+		MultiRxCount = 0;
+		return;
+	}
+
+	if (Position <= sizeof(Params))
+	  Params[Position - 1] = Byte;
+
+	switch (Command)
+	{
+		case CMD_PROGRAM_FLASH_ISP:
+		case CMD_PROGRAM_EEPROM_ISP:
+			if (Position >= 10)
+			  ISP_ProgramByte(Byte, Position - 10);
+
+			break;
+		case CMD_SPI_MULTI:
+			if (Position >= 4)
+			{
+				if (Position == 4)
+				  ISP_WaitReady();
+
+				uint8_t RxByte = SPI_TransferByte(Byte);
+
+				/* Params[2] is the index of the first transmitted byte whose answer is returned */
+				if (((Position - 4) >= Params[2]) && (MultiRxCount < Params[1]) && (MultiRxCount < ISP_SPI_MULTI_MAX_RX))
+				  MultiRxData[MultiRxCount++] = RxByte;
+			}
+
+			break;
+	}
+}
+
+/** Loads one byte of a flash or EEPROM write into the target, writing it straight away in word mode. The
+ *  parameters are the number of bytes, mode, delay, load, write and read commands and the poll values.
+ *
+ *  \param[in] Byte   Data byte
+ *  \param[in] Index  Offset of the byte in the data of the write
+ */
+static void ISP_ProgramByte(const uint8_t Byte,
+                            const uint16_t Index)
+{
+	uint8_t Mode = Params[2];
+
+	if (!(Index))
+	{
+		StartAddress  = CurrentAddress;
+		MemoryCommand = Params[4];
+	}
+
+	ISP_WaitReady();
+
+	if ((Command == CMD_PROGRAM_FLASH_ISP) && MustLoadExtendedAddress)
+	  ISP_LoadExtendedAddress();
+
+	ISP_TransferCommand((const uint8_t[]){MemoryCommand, (CurrentAddress >> 8), CurrentAddress, Byte}, 0);
+
+	if (!(Mode & PROG_MODE_PAGED_WRITES_MASK))
+	  ISP_SetBusy(Mode & PROG_MODE_WORD_READYBSY_MASK, Params[3]);
+
+	/* Flash is addressed in words, so the address moves on after the high byte */
+	if (Command == CMD_PROGRAM_FLASH_ISP)
+	{
+		MemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+
+		if (MemoryCommand & READ_WRITE_HIGH_BYTE_MASK)
+		  return;
+	}
+
+	if (!((uint16_t)++CurrentAddress) && (CurrentAddress & 0x80000000))
+	  MustLoadExtendedAddress = true;
+}
+
+/** Handles a completely received message and sends its reply.
+ *
+ *  \param[in,out] Output      Buffer for the reply
+ *  \param[in]     ChecksumOK  Indicates that the message checksum matched
+ */
+static void ISP_ProcessCommand(RingBuff_t* const Output,
+                               const bool ChecksumOK)
+{
+	uint8_t Reply[3 + ISP_SPI_MULTI_MAX_RX] = {Command, STATUS_CMD_OK};
+	uint8_t ReplyLength = 2;
+
+	if (!(ChecksumOK))
+	{
+		/* The page buffer may hold the data of a broken write, which just isn't written to the page */
+		Reply[0] = ANSWER_CKSUM_ERROR;
+		Reply[1] = STATUS_CKSUM_ERROR;
+		ISP_SendReply(Output, Reply, ReplyLength);
+		return;
+	}
+
+	switch (Command)
+	{
+		case CMD_SIGN_ON:
+			ISP_SendReply(Output, (const uint8_t[]){CMD_SIGN_ON, STATUS_CMD_OK, 8, 'A', 'V', 'R', 'I', 'S', 'P', '_', '2'}, 11);
+			return;
+		case CMD_SET_PARAMETER:
+			if (Params[0] == PARAM_SCK_DURATION)
+			  SCKDuration = Params[1];
+			else if (Params[0] == PARAM_RESET_POLARITY)
+			  ResetPolarity = Params[1];
+
+			break;
+		case CMD_GET_PARAMETER:
+			switch (Params[0])
+			{
+				case PARAM_BUILD_NUMBER_LOW:
+				case PARAM_BUILD_NUMBER_HIGH:
+				case PARAM_HW_VER:
+					Reply[2] = 0;
+					break;
+				case PARAM_SW_MAJOR:
+					Reply[2] = 2;
+					break;
+				case PARAM_SW_MINOR:
+					Reply[2] = 10;
+					break;
+				case PARAM_VTARGET:
+					Reply[2] = 33;
+					break;
+				case PARAM_SCK_DURATION:
+					Reply[2] = SCKDuration;
+					break;
+				case PARAM_RESET_POLARITY:
+					Reply[2] = ResetPolarity;
+					break;
+				default:
+					Reply[1] = STATUS_CMD_FAILED;
+					break;
+			}
+
+			if (Reply[1] == STATUS_CMD_OK)
+			  ReplyLength = 3;
+
+			break;
+		case CMD_LOAD_ADDRESS:
+			CurrentAddress = (((uint32_t)Params[0] << 24) | ((uint32_t)Params[1] << 16) |
+			                  ((uint16_t)Params[2] << 8) | Params[3]);
+			MustLoadExtendedAddress = ((CurrentAddress & 0x80000000) != 0);
+			break;
+		case CMD_ENTER_PROGMODE_ISP:
+		{
+			/* Parameters: timeout, pin stabilisation delay, command execution delay, synchronisation loops,
+			 * byte delay, poll value, poll index and the programming enable command */
+			uint8_t SPISpeed = (SCKDuration == 0) ? SPI_SPEED_FCPU_DIV_16 : SPI_SPEED_FCPU_DIV_128;
+
+			SPI_Init(SPISpeed | SPI_SCK_LEAD_RISING | SPI_SAMPLE_LEADING | SPI_MODE_MASTER);
+			ISP_SetReset(true);
+			ISP_DelayMS(Params[1]);
+
+			TargetBusy  = false;
+			WriteStatus = STATUS_CMD_OK;
+			Reply[1]    = STATUS_CMD_FAILED;
+
+			for (uint8_t Loops = Params[3]; Loops; Loops--)
+			{
+				ISP_DelayMS(Params[4]);
+
+				if (!(Params[6]) || (ISP_TransferCommand(&Params[7], Params[6]) == Params[5]))
+				{
+					Reply[1] = STATUS_CMD_OK;
+					break;
+				}
+
+				/* Out of step with the target, pulse its reset to start again */
+				ISP_SetReset(false);
+				ISP_DelayMS(Params[1]);
+				ISP_SetReset(true);
+				ISP_DelayMS(Params[1]);
+			}
+
+			if (Reply[1] != STATUS_CMD_OK)
+			  ISP_Stop();
+
+			break;
+		}
+		case CMD_LEAVE_PROGMODE_ISP:
+			ISP_WaitReady();
+			ISP_DelayMS(Params[0]);
+			ISP_Stop();
+			ISP_DelayMS(Params[1]);
+			break;
+		case CMD_CHIP_ERASE_ISP:
+			/* Parameters: erase delay, poll method (non-zero for RDY/BSY) and the erase command */
+			ISP_WaitReady();
+			ISP_TransferCommand(&Params[2], 0);
+			ISP_SetBusy(Params[1], Params[0]);
+			ISP_WaitReady();
+
+			Reply[1]    = WriteStatus;
+			WriteStatus = STATUS_CMD_OK;
+			break;
+		case CMD_PROGRAM_FLASH_ISP:
+		case CMD_PROGRAM_EEPROM_ISP:
+			if ((Params[2] & PROG_MODE_PAGED_WRITES_MASK) && (Params[2] & PROG_MODE_COMMIT_PAGE_MASK))
+			{
+				ISP_WaitReady();
+				ISP_TransferCommand((const uint8_t[]){Params[5], (StartAddress >> 8), StartAddress, 0x00}, 0);
+
+				/* Not waited for here, the target writes the page while the next one arrives */
+				ISP_SetBusy(Params[2] & PROG_MODE_PAGED_READYBSY_MASK, Params[3]);
+			}
+
+			Reply[1]    = WriteStatus;
+			WriteStatus = STATUS_CMD_OK;
+			break;
+		case CMD_READ_FLASH_ISP:
+		case CMD_READ_EEPROM_ISP:
+		{
+			/* Parameters: number of bytes and the read command; the data is streamed by ISP_ContinueRead() */
+			uint16_t ReadLength = (((uint16_t)Params[0] << 8) | Params[1]);
+
+			ISP_WaitReady();
+
+			MemoryCommand = Params[2];
+			ReadRemaining = ReadLength;
+			ReadPending   = true;
+
+			ReplyChecksum = 0;
+			ISP_SendByte(Output, MESSAGE_START);
+			ISP_SendByte(Output, Sequence);
+			ISP_SendByte(Output, (ReadLength + 3) >> 8);
+			ISP_SendByte(Output, (ReadLength + 3));
+			ISP_SendByte(Output, TOKEN);
+			ISP_SendByte(Output, Command);
+			ISP_SendByte(Output, STATUS_CMD_OK);
+
+			ISP_ContinueRead(Output);
+			return;
+		}
+		case CMD_PROGRAM_FUSE_ISP:
+		case CMD_PROGRAM_LOCK_ISP:
+			ISP_WaitReady();
+			ISP_TransferCommand(&Params[0], 0);
+			ISP_SetBusy(false, ISP_FUSE_WRITE_DELAY_MS);
+
+			Reply[2]    = STATUS_CMD_OK;
+			ReplyLength = 3;
+			break;
+		case CMD_READ_FUSE_ISP:
+		case CMD_READ_LOCK_ISP:
+		case CMD_READ_SIGNATURE_ISP:
+		case CMD_READ_OSCCAL_ISP:
+			/* Parameters: index of the returned byte and the read command */
+			ISP_WaitReady();
+
+			Reply[2]    = ISP_TransferCommand(&Params[1], Params[0]);
+			Reply[3]    = STATUS_CMD_OK;
+			ReplyLength = 4;
+			break;
+		case CMD_SPI_MULTI:
+			/* Parameters: bytes to send, bytes to return and the index of the first returned byte; the bytes
+			 * were sent as they arrived, zeros are clocked out for answers beyond them */
+			if (Params[1] > ISP_SPI_MULTI_MAX_RX)
+			{
+				Reply[1] = STATUS_CMD_FAILED;
+				break;
+			}
+
+			if (BodySize == 4)
+			  ISP_WaitReady();
+
+			while (MultiRxCount < Params[1])
+			  MultiRxData[MultiRxCount++] = SPI_TransferByte(0x00);
+
+			memcpy(&Reply[2], MultiRxData, MultiRxCount);
+			ReplyLength = (2 + MultiRxCount);
+			Reply[ReplyLength++] = STATUS_CMD_OK;
+			break;
+		default:
+			Reply[1] = STATUS_CMD_UNKNOWN;
+			break;
+	}
+
+	ISP_SendReply(Output, Reply, ReplyLength);
+}
+
+/** Reads the next bytes of a memory read from the target, for as long as the output buffer has room, and
+ *  finishes the reply once they are all sent.
+ *
+ *  \param[in,out] Output  Buffer for the reply
+ */
+static void ISP_ContinueRead(RingBuff_t* const Output)
+{
+	while (ReadRemaining && !(RingBuffer_IsFull(Output)))
+	{
+		if ((Command == CMD_READ_FLASH_ISP) && MustLoadExtendedAddress)
+		  ISP_LoadExtendedAddress();
+
+		ISP_SendByte(Output, ISP_TransferCommand((const uint8_t[]){MemoryCommand, (CurrentAddress >> 8), CurrentAddress, 0x00}, 4));
+		ReadRemaining--;
+
+		if (Command == CMD_READ_FLASH_ISP)
+		{
+			MemoryCommand ^= READ_WRITE_HIGH_BYTE_MASK;
+
+			if (MemoryCommand & READ_WRITE_HIGH_BYTE_MASK)
+			  continue;
+		}
+
+		if (!((uint16_t)++CurrentAddress) && (CurrentAddress & 0x80000000))
+		  MustLoadExtendedAddress = true;
+	}
+
+	if (ReadRemaining || ((RingBuffer_GetSize(Output) - RingBuffer_GetCount(Output)) < 2))
+	  return;
+
+	ISP_SendByte(Output, STATUS_CMD_OK);
+	ISP_SendByte(Output, ReplyChecksum);
+	ReadPending = false;
+}
+
+/** Sends a complete reply message, the caller having made sure that the output buffer has room for it.
+ *
+ *  \param[in,out] Output  Buffer for the reply
+ *  \param[in]     Body    Reply body, starting with the command
+ *  \param[in]     Length  Length of the body in bytes
+ */
+static void ISP_SendReply(RingBuff_t* const Output,
+                          const uint8_t* const Body,
+                          const uint8_t Length)
+{
+	ReplyChecksum = 0;
+	ISP_SendByte(Output, MESSAGE_START);
+	ISP_SendByte(Output, Sequence);
+	ISP_SendByte(Output, 0);
+	ISP_SendByte(Output, Length);
+	ISP_SendByte(Output, TOKEN);
+
+	for (uint8_t i = 0; i < Length; i++)
+	  ISP_SendByte(Output, Body[i]);
+
+	ISP_SendByte(Output, ReplyChecksum);
+}
+
+/** Adds a byte to the reply being sent.
+ *
+ *  \param[in,out] Output  Buffer for the reply
+ *  \param[in]     Byte    Reply byte
+ */
+static void ISP_SendByte(RingBuff_t* const Output,
+                         const uint8_t Byte)
+{
+	ReplyChecksum ^= Byte;
+	RingBuffer_Insert(Output, Byte);
+}
+
+/** Sends a four byte ISP command to the target.
+ *
+ *  \param[in] Command     Command bytes
+ *  \param[in] ReplyIndex  Position of the returned byte, from 1 to 4, or 0 if no answer is needed
+ *
+ *  \return Byte clocked in while the selected command byte was sent
+ */
+static uint8_t ISP_TransferCommand(const uint8_t* const Command,
+                                   const uint8_t ReplyIndex)
+{
+	uint8_t Answer = 0;
+
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		uint8_t RxByte = SPI_TransferByte(Command[i]);
+
+		if (i == (ReplyIndex - 1))
+		  Answer = RxByte;
+	}
+
+	return Answer;
+}
+
+/** Sends the target the extended address byte of \ref CurrentAddress, for flash above 128KB. */
+static void ISP_LoadExtendedAddress(void)
+{
+	ISP_TransferCommand((const uint8_t[]){LOAD_EXTENDED_ADDRESS_CMD, 0x00, (CurrentAddress >> 16), 0x00}, 0);
+	MustLoadExtendedAddress = false;
+}
+
+/** Marks the target as busy with a write, which \ref ISP_WaitReady() waits for before the next access.
+ *
+ *  \param[in] PollRdyBsy  Indicates that the target is polled for the end of the write
+ *  \param[in] DelayMS     Time the write takes, waited for when it isn't polled; value polling falls back to this
+ */
+static void ISP_SetBusy(const bool PollRdyBsy,
+                        const uint8_t DelayMS)
+{
+	TargetBusy     = true;
+	BusyPollRdyBsy = PollRdyBsy;
+	BusyDelayMS    = DelayMS;
+}
+
+/** Waits for the target to finish the last write, recording a timeout in \ref WriteStatus. */
+static void ISP_WaitReady(void)
+{
+	if (!(TargetBusy))
+	  return;
+
+	TargetBusy = false;
+
+	if (!(BusyPollRdyBsy))
+	{
+		ISP_DelayMS(BusyDelayMS);
+		return;
+	}
+
+	for (uint16_t PollsRemaining = (ISP_BUSY_TIMEOUT_MS * 10); PollsRemaining; PollsRemaining--)
+	{
+		if (!(ISP_TransferCommand((const uint8_t[]){POLL_RDY_BSY_CMD, 0x00, 0x00, 0x00}, 4) & 0x01))
+		  return;
+
+		_delay_us(100);
+	}
+
+	WriteStatus = STATUS_RDY_BSY_TOUT;
+}
+
+/** Drives the target's reset line, or releases it so that the board's pull-up and the bridge's bootloader
+ *  reset take over again.
+ *
+ *  \param[in] Active  Indicates that the target is to be held in reset
+ */
+static void ISP_SetReset(const bool Active)
+{
+	if (!(Active))
+	{
+		USBSERIAL_ISP_RESET_DDR  &= ~USBSERIAL_ISP_RESET_MASK;
+		USBSERIAL_ISP_RESET_PORT &= ~USBSERIAL_ISP_RESET_MASK;
+		return;
+	}
+
+	if (ResetPolarity)
+	  USBSERIAL_ISP_RESET_PORT &= ~USBSERIAL_ISP_RESET_MASK;
+	else
+	  USBSERIAL_ISP_RESET_PORT |= USBSERIAL_ISP_RESET_MASK;
+
+	USBSERIAL_ISP_RESET_DDR |= USBSERIAL_ISP_RESET_MASK;
+}
+
+/** Waits for the given number of milliseconds, as given by the host.
+ *
+ *  \param[in] DelayMS  Time to wait, in milliseconds
+ */
+static void ISP_DelayMS(uint8_t DelayMS)
+{
+	while (DelayMS--)
+	  _delay_ms(1);
+}
+
+#endif
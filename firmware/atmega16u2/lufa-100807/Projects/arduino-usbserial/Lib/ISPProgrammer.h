@@ -0,0 +1,123 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2010.
+
+  dean [at] fourwalledcubicle [dot] com
+      www.fourwalledcubicle.com
+*/
+
+/*
+  Copyright 2010  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Header file for ISPProgrammer.c.
+ */
+
+#ifndef _ISP_PROGRAMMER_H_
+#define _ISP_PROGRAMMER_H_
+
+	/* Includes: */
+		#include <avr/io.h>
+		#include <util/delay.h>
+
+		#include <stdint.h>
+		#include <stdbool.h>
+
+		#include <LUFA/Drivers/Peripheral/SPI.h>
+
+		#include "LightweightRingBuff.h"
+		#include "V2ProtocolConstants.h"
+
+	/* Macros: */
+		#if !defined(USBSERIAL_ISP_RESET_PORT) || defined(__DOXYGEN__)
+			/** Output to the target's /RESET line, driven only while the target is in programming mode. The
+			 *  default is PB0, the 16U2's unused SPI slave select pin; the reset line the bridge pulses for the
+			 *  bootloader is AC coupled and can't hold the target in reset.
+			 */
+			#define USBSERIAL_ISP_RESET_PORT   PORTB
+			#define USBSERIAL_ISP_RESET_DDR    DDRB
+			#define USBSERIAL_ISP_RESET_MASK   (1 << 0)
+		#endif
+
+		/** Free space needed in the output buffer before the programmer takes another byte of a command, enough
+		 *  for the longest reply other than a memory read, which is streamed out as the buffer drains.
+		 */
+		#define ISP_REPLY_SPACE                20
+
+		/** Largest number of bytes a CMD_SPI_MULTI command may return. */
+		#define ISP_SPI_MULTI_MAX_RX           8
+
+		/** Longest time the target may stay busy after a write when RDY/BSY polling is used, in milliseconds. */
+		#define ISP_BUSY_TIMEOUT_MS            100
+
+		/** Time allowed for a fuse or lock bit write, which the protocol doesn't poll, in milliseconds. */
+		#define ISP_FUSE_WRITE_DELAY_MS        5
+
+		/** Default of PARAM_SCK_DURATION, slow enough for a target running from its 1MHz factory clock. */
+		#define ISP_DEFAULT_SCK_DURATION       1
+
+	/* Enums: */
+		/** Enum for the states of the STK500v2 message parser, one per message field. */
+		enum ISP_ParserStates_t
+		{
+			ISP_PARSE_Start    = 0, /**< Waiting for MESSAGE_START */
+			ISP_PARSE_Sequence = 1, /**< Waiting for the sequence number */
+			ISP_PARSE_SizeHigh = 2, /**< Waiting for the high byte of the body size */
+			ISP_PARSE_SizeLow  = 3, /**< Waiting for the low byte of the body size */
+			ISP_PARSE_Token    = 4, /**< Waiting for TOKEN */
+			ISP_PARSE_Body     = 5, /**< Receiving the message body */
+			ISP_PARSE_Checksum = 6, /**< Waiting for the checksum */
+		};
+
+	/* Function Prototypes: */
+		void ISP_Start(void);
+		void ISP_Stop(void);
+		bool ISP_Task(RingBuff_t* const Input,
+		              RingBuff_t* const Output);
+
+		#if defined(INCLUDE_FROM_ISPPROGRAMMER_C)
+			static void    ISP_ParseByte(const uint8_t Byte,
+			                             RingBuff_t* const Output);
+			static void    ISP_BodyByte(const uint8_t Byte,
+			                            const uint16_t Position);
+			static void    ISP_ProcessCommand(RingBuff_t* const Output,
+			                                  const bool ChecksumOK);
+			static void    ISP_ProgramByte(const uint8_t Byte,
+			                               const uint16_t Index);
+			static void    ISP_ContinueRead(RingBuff_t* const Output);
+			static void    ISP_SendReply(RingBuff_t* const Output,
+			                             const uint8_t* const Body,
+			                             const uint8_t Length);
+			static void    ISP_SendByte(RingBuff_t* const Output,
+			                            const uint8_t Byte);
+			static uint8_t ISP_TransferCommand(const uint8_t* const Command,
+			                                   const uint8_t ReplyIndex);
+			static void    ISP_LoadExtendedAddress(void);
+			static void    ISP_SetBusy(const bool PollRdyBsy,
+			                           const uint8_t DelayMS);
+			static void    ISP_WaitReady(void);
+			static void    ISP_SetReset(const bool Active);
+			static void    ISP_DelayMS(uint8_t DelayMS);
+		#endif
+
+#endif
@@ -31,6 +31,15 @@
 /** \file
  *
  *  Ultra lightweight ring buffer, for fast insertion/deletion.
+ *
+ *  Each buffer has exactly one producer and one consumer, which may run in different execution
+ *  threads (for example an ISR filling the buffer while the main program thread empties it). The
+ *  IN index is only ever written by the producer and the OUT index only by the consumer, and both
+ *  run freely, being wrapped into the storage with the buffer mask on access; the stored count is
+ *  their difference. Neither side needs to mask interrupts to update the buffer, as long as an
+ *  index can be read in a single access - which holds for the 8-bit indexes used whenever
+ *  \ref RINGBUFF_MAX_SIZE is 128 or less. Larger buffers fall back to a short atomic block around
+ *  each 16-bit index access.
  */
  
 #ifndef _ULW_RING_BUFF_H_
@@ -43,21 +52,23 @@
 		#include <stdbool.h>
 
 	/* Defines: */
-		/** Size of each ring buffer, in data elements - must be between 1 and 255. */
-		#define BUFFER_SIZE         128
-		
-		/** Maximum number of data elements to buffer before forcing a flush. 
-		 *  Must be less than BUFFER_SIZE
+		/** Size of the largest ring buffer in use, in data elements. Individual buffers are sized when
+		 *  they are initialized; each size must be a power of two no larger than this value, so that the
+		 *  storage indexes can be wrapped with a mask instead of a compare.
 		 */
-		#define BUFFER_NEARLY_FULL	96
-		
+		#if !defined(RINGBUFF_MAX_SIZE)
+			#define RINGBUFF_MAX_SIZE   128
+		#endif
+
 		/** Type of data to store into the buffer. */
 		#define RingBuff_Data_t     uint8_t
 
 		/** Datatype which may be used to store the count of data stored in a buffer, retrieved
-		 *  via a call to \ref RingBuffer_GetCount().
+		 *  via a call to \ref RingBuffer_GetCount(). The free-running IN and OUT indexes share this
+		 *  type, which must be able to hold one more value than the largest buffer size so that a
+		 *  full buffer can be told apart from an empty one.
 		 */
-		#if (BUFFER_SIZE <= 0xFF)
+		#if (RINGBUFF_MAX_SIZE <= 0x80)
 			#define RingBuff_Count_t   uint8_t
 		#else
 			#define RingBuff_Count_t   uint16_t
@@ -69,56 +80,108 @@
 		 */
 		typedef struct
 		{
-			RingBuff_Data_t  Buffer[BUFFER_SIZE]; /**< Internal ring buffer data, referenced by the buffer pointers. */
-			RingBuff_Data_t* In; /**< Current storage location in the circular buffer */
-			RingBuff_Data_t* Out; /**< Current retrieval location in the circular buffer */
-			RingBuff_Count_t Count;
+			RingBuff_Data_t* Buffer; /**< Storage for the buffer data, of (Mask + 1) elements. */
+			RingBuff_Count_t Mask; /**< Buffer size minus one, used to wrap the IN and OUT indexes */
+			volatile RingBuff_Count_t In; /**< Free-running storage index, written only by the producer */
+			volatile RingBuff_Count_t Out; /**< Free-running retrieval index, written only by the consumer */
 		} RingBuff_t;
 	
+	/* Private Interface - For use in library only: */
+	#if !defined(__DOXYGEN__)
+		/* Macros: */
+			/** Compiler barrier, keeping the element accesses on either side of an index update in order. */
+			#define RINGBUFF_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+		/* Inline Functions: */
+			static inline RingBuff_Count_t RingBuffer_ReadIndex(volatile RingBuff_Count_t* const Index)
+			{
+				RingBuff_Count_t Value;
+
+				if (sizeof(RingBuff_Count_t) == 1)
+				{
+					Value = *Index;
+				}
+				else
+				{
+					ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+					{
+						Value = *Index;
+					}
+				}
+
+				return Value;
+			}
+
+			static inline void RingBuffer_WriteIndex(volatile RingBuff_Count_t* const Index,
+			                                         const RingBuff_Count_t Value)
+			{
+				if (sizeof(RingBuff_Count_t) == 1)
+				{
+					*Index = Value;
+				}
+				else
+				{
+					ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+					{
+						*Index = Value;
+					}
+				}
+			}
+	#endif
+
 	/* Inline Functions: */
 		/** Initializes a ring buffer ready for use. Buffers must be initialized via this function
 		 *  before any operations are called upon them. Already initialized buffers may be reset
-		 *  by re-initializing them using this function.
+		 *  by re-initializing them using this function, while neither side is using the buffer.
 		 *
-		 *  \param[out] Buffer  Pointer to a ring buffer structure to initialize
+		 *  \param[out] Buffer   Pointer to a ring buffer structure to initialize
+		 *  \param[in]  Storage  Pointer to the storage array for the buffer's data
+		 *  \param[in]  Size     Number of elements in the storage array, a power of two no larger
+		 *                       than \ref RINGBUFF_MAX_SIZE
 		 */
-		static inline void RingBuffer_InitBuffer(RingBuff_t* const Buffer)
+		static inline void RingBuffer_InitBuffer(RingBuff_t* const Buffer,
+		                                         RingBuff_Data_t* const Storage,
+		                                         const uint16_t Size)
 		{
 			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 			{
-				Buffer->In  = Buffer->Buffer;
-				Buffer->Out = Buffer->Buffer;
+				Buffer->Buffer = Storage;
+				Buffer->Mask   = (Size - 1);
+				Buffer->In     = 0;
+				Buffer->Out    = 0;
 			}
 		}
 		
 		/** Retrieves the minimum number of bytes stored in a particular buffer. This value is computed
-		 *  by entering an atomic lock on the buffer while the IN and OUT locations are fetched, so that
-		 *  the buffer cannot be modified while the computation takes place. This value should be cached
-		 *  when reading out the contents of the buffer, so that as small a time as possible is spent
-		 *  in an atomic lock.
+		 *  from the IN and OUT indexes without locking the buffer, and should be cached when reading
+		 *  out the contents of the buffer rather than fetched again for every element.
 		 *
 		 *  \note The value returned by this function is guaranteed to only be the minimum number of bytes
-		 *        stored in the given buffer; this value may change as other threads write new data and so
-		 *        the returned number should be used only to determine how many successive reads may safely
+		 *        stored in the given buffer when called by the consumer, and the maximum when called by the
+		 *        producer; this value may change as the other thread moves its index and so the returned
+		 *        number should be used only to determine how many successive reads (or writes) may safely
 		 *        be performed on the buffer.
 		 *
 		 *  \param[in] Buffer  Pointer to a ring buffer structure whose count is to be computed
 		 */
 		static inline RingBuff_Count_t RingBuffer_GetCount(RingBuff_t* const Buffer)
 		{
-			RingBuff_Count_t Count;
-			
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Count = Buffer->Count;
-			}
-			
-			return Count;
+			return (RingBuff_Count_t)(RingBuffer_ReadIndex(&Buffer->In) - RingBuffer_ReadIndex(&Buffer->Out));
 		}
 		
-		/** Atomically determines if the specified ring buffer contains any free space. This should
-		 *  be tested before storing data to the buffer, to ensure that no data is lost due to a
-		 *  buffer overrun.
+		/** Retrieves the number of elements which may be stored in a particular buffer while it is empty.
+		 *
+		 *  \param[in] Buffer  Pointer to a ring buffer structure whose size is to be retrieved
+		 *
+		 *  \return Size of the buffer's storage, in data elements
+		 */
+		static inline uint16_t RingBuffer_GetSize(RingBuff_t* const Buffer)
+		{
+			return ((uint16_t)Buffer->Mask + 1);
+		}
+
+		/** Determines if the specified ring buffer contains any free space. This should be tested
+		 *  before storing data to the buffer, to ensure that no data is lost due to a buffer overrun.
 		 *
 		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to insert into
 		 *
@@ -126,27 +189,27 @@
 		 */		 
 		static inline bool RingBuffer_IsFull(RingBuff_t* const Buffer)
 		{
-			return (RingBuffer_GetCount(Buffer) == BUFFER_SIZE);
+			return (RingBuffer_GetCount(Buffer) > Buffer->Mask);
 		}
 
-		/** Atomically determines if the specified ring buffer contains any data. This should
-		 *  be tested before removing data from the buffer, to ensure that the buffer does not
-		 *  underflow.
+		/** Determines if the specified ring buffer contains any data. This should be tested
+		 *  before removing data from the buffer, to ensure that the buffer does not underflow.
 		 *
 		 *  If the data is to be removed in a loop, store the total number of bytes stored in the
 		 *  buffer (via a call to the \ref RingBuffer_GetCount() function) in a temporary variable
-		 *  to reduce the time spent in atomicity locks.
+		 *  rather than testing the buffer before every removal.
 		 *
 		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to insert into
 		 *
-		 *  \return Boolean true if the buffer contains no free space, false otherwise
+		 *  \return Boolean true if the buffer contains no data, false otherwise
 		 */		 
 		static inline bool RingBuffer_IsEmpty(RingBuff_t* const Buffer)
 		{
 			return (RingBuffer_GetCount(Buffer) == 0);
 		}
 
-		/** Inserts an element into the ring buffer.
+		/** Inserts an element into the ring buffer. The element is stored before the IN index is
+		 *  published, so the consumer never sees a location that has not yet been written.
 		 *
 		 *  \note Only one execution thread (main program thread or an ISR) may insert into a single buffer
 		 *        otherwise data corruption may occur. Insertion and removal may occur from different execution
@@ -158,18 +221,15 @@
 		static inline void RingBuffer_Insert(RingBuff_t* const Buffer,
 		                                     const RingBuff_Data_t Data)
 		{
-			*Buffer->In = Data;
-			
-			if (++Buffer->In == &Buffer->Buffer[BUFFER_SIZE])
-			  Buffer->In = Buffer->Buffer;
+			RingBuff_Count_t In = Buffer->In;
 
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Buffer->Count++;
-			}
+			Buffer->Buffer[In & Buffer->Mask] = Data;
+			RINGBUFF_BARRIER();
+			RingBuffer_WriteIndex(&Buffer->In, (In + 1));
 		}
 
-		/** Removes an element from the ring buffer.
+		/** Removes an element from the ring buffer. The element is read before the OUT index is
+		 *  released, so the producer never overwrites a location that is still being read.
 		 *
 		 *  \note Only one execution thread (main program thread or an ISR) may remove from a single buffer
 		 *        otherwise data corruption may occur. Insertion and removal may occur from different execution
@@ -181,17 +241,95 @@
 		 */
 		static inline RingBuff_Data_t RingBuffer_Remove(RingBuff_t* const Buffer)
 		{
-			RingBuff_Data_t Data = *Buffer->Out;
-			
-			if (++Buffer->Out == &Buffer->Buffer[BUFFER_SIZE])
-			  Buffer->Out = Buffer->Buffer;
+			RingBuff_Count_t Out  = Buffer->Out;
+			RingBuff_Data_t  Data = Buffer->Buffer[Out & Buffer->Mask];
 
-			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-			{
-				Buffer->Count--;
-			}
+			RINGBUFF_BARRIER();
+			RingBuffer_WriteIndex(&Buffer->Out, (Out + 1));
 			
 			return Data;
 		}
 
-#endif
\ No newline at end of file
+		/** Retrieves the buffer's current storage location, for block writers which fill a run of the
+		 *  buffer directly before committing it with \ref RingBuffer_AdvanceIn().
+		 *
+		 *  \param[in] Buffer  Pointer to a ring buffer structure to query
+		 *
+		 *  \return Pointer to the current IN location
+		 */
+		static inline RingBuff_Data_t* RingBuffer_GetInPtr(RingBuff_t* const Buffer)
+		{
+			return &Buffer->Buffer[Buffer->In & Buffer->Mask];
+		}
+
+		/** Retrieves the buffer's current retrieval location, for block readers which consume a run of
+		 *  the buffer directly before releasing it with \ref RingBuffer_AdvanceOut().
+		 *
+		 *  \param[in] Buffer  Pointer to a ring buffer structure to query
+		 *
+		 *  \return Pointer to the current OUT location
+		 */
+		static inline RingBuff_Data_t* RingBuffer_GetOutPtr(RingBuff_t* const Buffer)
+		{
+			return &Buffer->Buffer[Buffer->Out & Buffer->Mask];
+		}
+
+		/** Retrieves the number of elements which may be written at the buffer's current storage
+		 *  location before the storage wraps back to the start of the buffer. Block writers should
+		 *  limit each run to the lesser of this value and the free space in the buffer, then commit
+		 *  the run with \ref RingBuffer_AdvanceIn().
+		 *
+		 *  \param[in] Buffer  Pointer to a ring buffer structure to query
+		 *
+		 *  \return Number of contiguous storage locations from the current IN location
+		 */
+		static inline RingBuff_Count_t RingBuffer_GetInRun(RingBuff_t* const Buffer)
+		{
+			return (Buffer->Mask - (Buffer->In & Buffer->Mask) + 1);
+		}
+
+		/** Retrieves the number of elements which may be read from the buffer's current retrieval
+		 *  location before the storage wraps back to the start of the buffer. Block readers should
+		 *  limit each run to the lesser of this value and the buffer count, then release the run
+		 *  with \ref RingBuffer_AdvanceOut().
+		 *
+		 *  \param[in] Buffer  Pointer to a ring buffer structure to query
+		 *
+		 *  \return Number of contiguous retrieval locations from the current OUT location
+		 */
+		static inline RingBuff_Count_t RingBuffer_GetOutRun(RingBuff_t* const Buffer)
+		{
+			return (Buffer->Mask - (Buffer->Out & Buffer->Mask) + 1);
+		}
+
+		/** Commits a run of elements written directly at the buffer's IN location, publishing the whole
+		 *  run to the consumer with a single index update.
+		 *
+		 *  \note The same threading rules as \ref RingBuffer_Insert() apply.
+		 *
+		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to commit to
+		 *  \param[in]     Count   Number of elements written, at most \ref RingBuffer_GetInRun()
+		 */
+		static inline void RingBuffer_AdvanceIn(RingBuff_t* const Buffer,
+		                                        const RingBuff_Count_t Count)
+		{
+			RINGBUFF_BARRIER();
+			RingBuffer_WriteIndex(&Buffer->In, (Buffer->In + Count));
+		}
+
+		/** Releases a run of elements read directly from the buffer's OUT location, handing the whole
+		 *  run back to the producer with a single index update.
+		 *
+		 *  \note The same threading rules as \ref RingBuffer_Remove() apply.
+		 *
+		 *  \param[in,out] Buffer  Pointer to a ring buffer structure to release from
+		 *  \param[in]     Count   Number of elements read, at most \ref RingBuffer_GetOutRun()
+		 */
+		static inline void RingBuffer_AdvanceOut(RingBuff_t* const Buffer,
+		                                         const RingBuff_Count_t Count)
+		{
+			RINGBUFF_BARRIER();
+			RingBuffer_WriteIndex(&Buffer->Out, (Buffer->Out + Count));
+		}
+
+#endif
@@ -0,0 +1,103 @@
+/*
+             LUFA Library
+     Copyright (C) Dean Camera, 2010.
+
+  dean [at] fourwalledcubicle [dot] com
+      www.fourwalledcubicle.com
+*/
+
+/*
+  Copyright 2010  Dean Camera (dean [at] fourwalledcubicle [dot] com)
+
+  Permission to use, copy, modify, distribute, and sell this
+  software and its documentation for any purpose is hereby granted
+  without fee, provided that the above copyright notice appear in
+  all copies and that both that the copyright notice and this
+  permission notice and warranty disclaimer appear in supporting
+  documentation, and that the name of the author not be used in
+  advertising or publicity pertaining to distribution of the
+  software without specific, written prior permission.
+
+  The author disclaim all warranties with regard to this
+  software, including all implied warranties of merchantability
+  and fitness.  In no event shall the author be liable for any
+  special, indirect or consequential damages or any damages
+  whatsoever resulting from loss of use, data or profits, whether
+  in an action of contract, negligence or other tortious action,
+  arising out of or in connection with the use or performance of
+  this software.
+*/
+
+/** \file
+ *
+ *  Message and command constants of the STK500v2 protocol (Atmel application note AVR068), as spoken
+ *  by avrdude's stk500v2 programmer type. Only the ISP subset handled by ISPProgrammer.c is listed.
+ */
+
+#ifndef _V2_PROTOCOL_CONSTANTS_H_
+#define _V2_PROTOCOL_CONSTANTS_H_
+
+	/* Macros: */
+		#define MESSAGE_START                0x1B
+		#define TOKEN                        0x0E
+
+		#define CMD_SIGN_ON                  0x01
+		#define CMD_SET_PARAMETER            0x02
+		#define CMD_GET_PARAMETER            0x03
+		#define CMD_LOAD_ADDRESS             0x06
+
+		#define CMD_ENTER_PROGMODE_ISP       0x10
+		#define CMD_LEAVE_PROGMODE_ISP       0x11
+		#define CMD_CHIP_ERASE_ISP           0x12
+		#define CMD_PROGRAM_FLASH_ISP        0x13
+		#define CMD_READ_FLASH_ISP           0x14
+		#define CMD_PROGRAM_EEPROM_ISP       0x15
+		#define CMD_READ_EEPROM_ISP          0x16
+		#define CMD_PROGRAM_FUSE_ISP         0x17
+		#define CMD_READ_FUSE_ISP            0x18
+		#define CMD_PROGRAM_LOCK_ISP         0x19
+		#define CMD_READ_LOCK_ISP            0x1A
+		#define CMD_READ_SIGNATURE_ISP       0x1B
+		#define CMD_READ_OSCCAL_ISP          0x1C
+		#define CMD_SPI_MULTI                0x1D
+
+		#define STATUS_CMD_OK                0x00
+		#define STATUS_CMD_TOUT              0x80
+		#define STATUS_RDY_BSY_TOUT          0x81
+		#define STATUS_CMD_FAILED            0xC0
+		#define STATUS_CKSUM_ERROR           0xC1
+		#define STATUS_CMD_UNKNOWN           0xC9
+
+		#define ANSWER_CKSUM_ERROR           0xB0
+
+		#define PARAM_BUILD_NUMBER_LOW       0x80
+		#define PARAM_BUILD_NUMBER_HIGH      0x81
+		#define PARAM_HW_VER                 0x90
+		#define PARAM_SW_MAJOR               0x91
+		#define PARAM_SW_MINOR               0x92
+		#define PARAM_VTARGET                0x94
+		#define PARAM_SCK_DURATION           0x98
+		#define PARAM_RESET_POLARITY         0x9E
+
+		/** Programming mode bit of CMD_PROGRAM_FLASH_ISP and CMD_PROGRAM_EEPROM_ISP, set for page writes. */
+		#define PROG_MODE_PAGED_WRITES_MASK  (1 << 0)
+
+		/** Programming mode bit requesting RDY/BSY polling after each byte of a word mode write. */
+		#define PROG_MODE_WORD_READYBSY_MASK (1 << 3)
+
+		/** Programming mode bit requesting RDY/BSY polling after a page write. */
+		#define PROG_MODE_PAGED_READYBSY_MASK (1 << 6)
+
+		/** Programming mode bit set on the last block of a page, which is then written. */
+		#define PROG_MODE_COMMIT_PAGE_MASK   (1 << 7)
+
+		/** Memory command bit selecting the high byte of a flash word. */
+		#define READ_WRITE_HIGH_BYTE_MASK    (1 << 3)
+
+		/** ISP command to poll the target's RDY/BSY flag, returned in bit 0 of the last byte. */
+		#define POLL_RDY_BSY_CMD             0xF0
+
+		/** ISP command to load the extended address byte for flash above 128KB. */
+		#define LOAD_EXTENDED_ADDRESS_CMD    0x4D
+
+#endif
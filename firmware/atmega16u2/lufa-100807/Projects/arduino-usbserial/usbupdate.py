@@ -0,0 +1,150 @@
+#!/usr/bin/env python
+"""
+usbupdate.py - replace the USB bridge firmware without DFU
+
+The bridge must be built with SELF_UPDATE=1 (see the makefile) and sit
+on a bootloader which exports the LUFA bootloader API. The image is
+staged in a spare flash area through the raw channel bulk endpoint,
+checked against its CRC and then copied over the running bridge, which
+restarts and enumerates again. See USBSERIAL_REQ_UpdateBegin in
+Arduino-usbserial.h.
+
+Usage:
+ python usbupdate.py [OPTIONS] HEXFILE
+
+Options:
+ -d VID:PID USB ids of the bridge, default 1d50:6051
+ -n         stage and check the image, but don't install it
+ -s         only show the update status of the bridge
+ -h         show this help
+
+Example:
+ python usbupdate.py Arduino-usbserial.hex
+
+Needs pyusb 1.0.
+"""
+
+import sys, time, struct, getopt
+import usb.core, usb.util
+
+VID, PID = 0x1d50, 0x6051
+
+# vendor requests, same as USBSERIAL_REQ_* in Arduino-usbserial.h
+REQ_UPDATE_BEGIN = 0x06
+REQ_GET_UPDATE_STATUS = 0x07
+REQ_UPDATE_INSTALL = 0x08
+
+RAW_INTERFACE = 2
+RAW_EP = 0x01
+
+# the installer page is never replaced, USBSERIAL_UPDATE_INSTALLER
+INSTALLER_PAGE = 0x2f80
+
+STATES = ["idle", "receiving", "staged", "failed", "installing", "unavailable"]
+STATE_STAGED, STATE_FAILED, STATE_UNAVAILABLE = 2, 3, 5
+
+def crc_ccitt_update(crc, data):
+    """same as _crc_ccitt_update() of avr-libc"""
+    data ^= crc & 0xff
+    data ^= (data << 4) & 0xff
+    return (((data << 8) | (crc >> 8)) ^ (data >> 4) ^ (data << 3)) & 0xffff
+
+def crc_ccitt(data):
+    crc = 0
+    for c in bytearray(data):
+        crc = crc_ccitt_update(crc, c)
+    return crc
+
+def read_hex(fname):
+    """Intel hex to a dict address -> byte"""
+    mem = {}
+    base = 0
+    for ln in open(fname):
+        ln = ln.strip()
+        if not ln.startswith(":"):
+            continue
+        rec = bytearray.fromhex(ln[1:])
+        if sum(rec) & 0xff:
+            raise ValueError("checksum error in %r" % ln)
+        n, addr, typ = rec[0], (rec[1] << 8) | rec[2], rec[3]
+        if typ == 0:
+            for i in range(n):
+                mem[base + addr + i] = rec[4 + i]
+        elif typ == 1:
+            break
+        elif typ == 2:
+            base = ((rec[4] << 8) | rec[5]) << 4
+        elif typ == 4:
+            base = ((rec[4] << 8) | rec[5]) << 16
+    return mem
+
+def get_status(dev):
+    """returns (state, received, maxlength)"""
+    rv = dev.ctrl_transfer(0xc0, REQ_GET_UPDATE_STATUS, 0, 0, 5)
+    return struct.unpack("<BHH", rv.tostring())
+
+def make_image(mem, maxlength):
+    """the image starts at 0, the installer page of the new build is left out"""
+    mem = dict((a, b) for a, b in mem.items() if a < INSTALLER_PAGE)
+    if not mem:
+        raise ValueError("no data below 0x%x" % INSTALLER_PAGE)
+    length = max(mem.keys()) + 1
+    if length > maxlength:
+        raise ValueError("image of %d bytes, the bridge can stage %d" % (length, maxlength))
+    return str(bytearray(mem.get(a, 0xff) for a in range(length)))
+
+def update(dev, image, install = True):
+    (state, received, maxlength) = get_status(dev)
+    if state == STATE_UNAVAILABLE:
+        raise IOError("bridge can't update itself (no bootloader API or image too large)")
+    t = time.time()
+    dev.ctrl_transfer(0x40, REQ_UPDATE_BEGIN, len(image), crc_ccitt(image))
+    usb.util.claim_interface(dev, RAW_INTERFACE)
+    dev.write(RAW_EP, image, timeout = 5000)
+    tend = time.time() + 2.0
+    while True:
+        (state, received, maxlength) = get_status(dev)
+        if state in (STATE_STAGED, STATE_FAILED) or time.time() > tend:
+            break
+        time.sleep(0.01)
+    usb.util.release_interface(dev, RAW_INTERFACE)
+    t = time.time() - t
+    if state != STATE_STAGED:
+        raise IOError("staging failed: %s after %d/%d bytes" % (STATES[state], received, len(image)))
+    print "staged %d bytes in %.2f s" % (len(image), t)
+    if install:
+        dev.ctrl_transfer(0x40, REQ_UPDATE_INSTALL, 0, 0)
+        print "installing, the bridge restarts"
+
+if __name__ == "__main__":
+    vid, pid = VID, PID
+    install = True
+    status_only = False
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "d:nsh")
+        for o, v in opts:
+            if o == "-d":
+                vid, pid = [int(x, 16) for x in v.split(":")]
+            elif o == "-n":
+                install = False
+            elif o == "-s":
+                status_only = True
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if len(args) != (0 if status_only else 1):
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    dev = usb.core.find(idVendor = vid, idProduct = pid)
+    if dev is None:
+        print "no bridge %04x:%04x found" % (vid, pid)
+        sys.exit(1)
+    (state, received, maxlength) = get_status(dev)
+    if status_only:
+        print "state %s, %d bytes staged, max %d" % (STATES[state], received, maxlength)
+        sys.exit(0)
+    update(dev, make_image(read_hex(args[0]), maxlength), install)
@@ -0,0 +1,423 @@
+/*
+ * cyclebench.c
+ *
+ * CPU cycles per call of the uracoli routines the bootloader relies on
+ * and of the page programming, on the board or under simavr. The
+ * results go to the HIF, one line per routine and size, which
+ * cyclebench.py turns into CSV and compares with a baseline:
+ *
+ *   cyc name=crc32_block arg=256 n=8 min=.. avg=.. max=.. ovf=0
+ *
+ * arg is the size, or the number of timers in the wheel for the timer
+ * routines. Timer 3 counts the CPU clock, clk/64 for the long runs (the
+ * counts are scaled back), with interrupts off, so the ISRs are not in
+ * the numbers; the cost of starting and stopping the counter is taken
+ * off. ovf counts the calls longer than the counter.
+ *
+ * The HIF receive ring is filled by calling the receive ISR, which
+ * takes whatever the data register holds. The SPM routines of spm.c are
+ * linked into the boot section (.bootspm, see the Makefile), flashing
+ * the image with ISP replaces the bootloader. CYC_SPM_PAGE is written.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/pgmspace.h>
+#include <string.h>
+
+#include "board.h"
+#include "ioutil.h"
+#include "hif_uart.h"
+#include "timer.h"
+#include "crc_fast.h"
+#include "wibo.h"
+
+/* runs per routine and size */
+#define CYC_REPEAT	(8)
+#define CYC_POOL_BUFS	(8)
+#define CYC_BUFSZ	(128)
+#define CYC_TIMERS	(64)
+/* scratch page of boot_program_page(), the last one below the bootloader */
+#define CYC_SPM_PAGE	(0x3E000UL - SPM_PAGESIZE)
+
+/* clock select of timer 3 */
+#define CYC_FAST	(_BV(CS30))
+#define CYC_SLOW	(_BV(CS31) | _BV(CS30))
+#define CYC_SLOW_SHIFT	(6)
+
+/*
+ * \brief Count the cycles of stmt into the statistics st
+ */
+#define CYC_RUN(st, stmt)			\
+	do {					\
+		TCNT3 = 0;			\
+		TIFR3 = _BV(TOV3);		\
+		TCCR3B = CycClock;		\
+		stmt;				\
+		TCCR3B = 0;			\
+		cyc_add((st), TCNT3);		\
+	} while (0)
+
+typedef struct
+{
+	uint32_t min;
+	uint32_t max;
+	uint32_t sum;
+	uint16_t n;
+	uint8_t ovf;
+} cyc_stat_t;
+
+static uint8_t CycClock;
+static uint16_t CycOverhead;
+static uint8_t Data[SPM_PAGESIZE];
+static uint8_t PoolMem[sizeof(buffer_pool_t) + CYC_POOL_BUFS * BUFFER_ELSZ(CYC_BUFSZ)];
+
+TIMER_POOL_DEFINE(CYC_TIMERS);
+
+/* timer.c, called by the timer ISR */
+void tmr_process(void);
+#if HIF_TYPE_IS_UART
+void HIF_UART_RX_vect(void);
+#endif
+
+static void cyc_begin(cyc_stat_t *st, uint8_t clock)
+{
+	memset(st, 0, sizeof(cyc_stat_t));
+	st->min = 0xffffffffUL;
+	CycClock = clock;
+}
+
+static void cyc_add(cyc_stat_t *st, uint16_t ticks)
+{
+	uint32_t c;
+
+	if (TIFR3 & _BV(TOV3))
+	{
+		st->ovf++;
+	}
+	if (CycClock == CYC_FAST)
+	{
+		c = (ticks > CycOverhead) ? ticks - CycOverhead : 0;
+	}
+	else
+	{
+		c = (uint32_t) ticks << CYC_SLOW_SHIFT;
+	}
+	if (c < st->min)
+	{
+		st->min = c;
+	}
+	if (c > st->max)
+	{
+		st->max = c;
+	}
+	st->sum += c;
+	st->n++;
+}
+
+/*
+ * \brief Let the HIF send for ms milliseconds, interrupts are off after
+ */
+static void cyc_drain(uint8_t ms)
+{
+	sei();
+	DELAY_MS(ms);
+	cli();
+}
+
+/*
+ * \brief Print the result line of a routine, name is in flash
+ */
+static void cyc_report(const char *name, uint16_t arg, cyc_stat_t *st)
+{
+	sei();
+	PRINTF("cyc name=%S arg=%u n=%u min=%lu avg=%lu max=%lu ovf=%u\n\r",
+	       name, arg, st->n, st->n ? st->min : 0, st->n ? st->sum / st->n : 0,
+	       st->max, st->ovf);
+	cyc_drain(10);
+}
+
+static void bench_overhead(void)
+{
+	cyc_stat_t st;
+	uint8_t i;
+
+	CycOverhead = 0;
+	cyc_begin(&st, CYC_FAST);
+	for (i = 0; i < CYC_REPEAT; i++)
+	{
+		CYC_RUN(&st, (void) 0);
+	}
+	CycOverhead = st.min;
+	cyc_report(PSTR("overhead"), 0, &st);
+}
+
+static void bench_buffer(void)
+{
+	static const uint8_t sizes[] PROGMEM = {1, 16, 64, CYC_BUFSZ};
+	buffer_pool_t *pool;
+	buffer_t *bufs[CYC_POOL_BUFS];
+	cyc_stat_t sa, sf;
+	uint8_t i, r, sz;
+
+	pool = buffer_pool_init(PoolMem, sizeof(PoolMem), CYC_BUFSZ);
+	cyc_begin(&sa, CYC_FAST);
+	cyc_begin(&sf, CYC_FAST);
+	for (i = 0; i < CYC_POOL_BUFS; i++)
+	{
+		CYC_RUN(&sa, bufs[i] = buffer_alloc(pool, 0));
+	}
+	for (i = 0; i < CYC_POOL_BUFS; i++)
+	{
+		CYC_RUN(&sf, buffer_free(pool, bufs[i]));
+	}
+	cyc_report(PSTR("buffer_alloc"), CYC_POOL_BUFS, &sa);
+	cyc_report(PSTR("buffer_free"), CYC_POOL_BUFS, &sf);
+
+	for (i = 0; i < sizeof(sizes); i++)
+	{
+		sz = pgm_read_byte(&sizes[i]);
+		cyc_begin(&sa, CYC_FAST);
+		cyc_begin(&sf, CYC_FAST);
+		for (r = 0; r < CYC_REPEAT; r++)
+		{
+			bufs[0] = buffer_alloc(pool, 0);
+			CYC_RUN(&sa, buffer_append_block(bufs[0], Data, sz));
+			CYC_RUN(&sf, buffer_get_block(bufs[0], Data, sz));
+			buffer_free(pool, bufs[0]);
+		}
+		cyc_report(PSTR("buffer_append_block"), sz, &sa);
+		cyc_report(PSTR("buffer_get_block"), sz, &sf);
+	}
+}
+
+#if HIF_TYPE_IS_UART
+static void bench_hif(void)
+{
+	static const uint16_t sizes[] PROGMEM = {1, 16, 64, 256};
+	cyc_stat_t st;
+	uint16_t sz, k;
+	uint8_t i, r;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		sz = pgm_read_word(&sizes[i]);
+		cyc_begin(&st, CYC_FAST);
+		for (r = 0; r < CYC_REPEAT; r++)
+		{
+			CYC_RUN(&st, hif_put_blk(Data, sz));
+			/* 256 bytes at 115200 baud */
+			cyc_drain(25);
+		}
+		cyc_report(PSTR("hif_put_blk"), sz, &st);
+	}
+
+	cyc_begin(&st, CYC_FAST);
+	for (r = 0; r < CYC_REPEAT; r++)
+	{
+		CYC_RUN(&st, hif_get_blk(Data, sizeof(Data)));
+	}
+	cyc_report(PSTR("hif_get_blk"), 0, &st);
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		sz = pgm_read_word(&sizes[i]);
+		cyc_begin(&st, CYC_FAST);
+		for (r = 0; r < CYC_REPEAT; r++)
+		{
+			for (k = 0; k < sz; k++)
+			{
+				/* returns with reti */
+				HIF_UART_RX_vect();
+				cli();
+			}
+			CYC_RUN(&st, hif_get_blk(Data, sz));
+		}
+		cyc_report(PSTR("hif_get_blk"), sz, &st);
+	}
+}
+#endif
+
+static time_t cyc_timer_handler(timer_arg_t p)
+{
+	return 0;
+}
+
+/*
+ * \brief Empty wheel that only moves with tmr_process() of the bench
+ */
+static void cyc_timer_reset(void)
+{
+	timer_init();
+	/* HWTIMER_REG of the board, tmr_advance() of TIMER_TICKLESS reads it */
+	TCCR1B &= ~(_BV(CS12) | _BV(CS11) | _BV(CS10));
+}
+
+static void bench_timer(void)
+{
+	static const uint8_t depths[] PROGMEM = {0, 8, 32, CYC_TIMERS - 1};
+	cyc_stat_t ss, sp;
+	timer_hdl_t th;
+	uint8_t i, j, d, n;
+
+	for (i = 0; i < sizeof(depths); i++)
+	{
+		d = pgm_read_byte(&depths[i]);
+
+		/* d timers over both levels of the wheel */
+		cyc_timer_reset();
+		for (j = 0; j < d; j++)
+		{
+			timer_start(cyc_timer_handler, 1 + (j * 13) % 200, 0);
+		}
+		cyc_begin(&ss, CYC_FAST);
+		cyc_begin(&sp, CYC_FAST);
+		for (j = 0; j < CYC_REPEAT; j++)
+		{
+			CYC_RUN(&ss, th = timer_start(cyc_timer_handler, 50, 0));
+			CYC_RUN(&sp, timer_stop(th));
+		}
+		cyc_report(PSTR("timer_start"), d, &ss);
+		cyc_report(PSTR("timer_stop"), d, &sp);
+
+		/* one timer expires with each tick, cascades included */
+		cyc_timer_reset();
+		for (j = 0; j < d; j++)
+		{
+			timer_start(cyc_timer_handler, 1 + j, 0);
+		}
+		n = (d > CYC_REPEAT) ? d : CYC_REPEAT;
+		cyc_begin(&ss, CYC_FAST);
+		cyc_begin(&sp, CYC_FAST);
+		for (j = 0; j < n; j++)
+		{
+			CYC_RUN(&ss, tmr_process());
+			CYC_RUN(&sp, timer_task());
+		}
+		cyc_report(PSTR("tmr_process"), d, &ss);
+		cyc_report(PSTR("timer_task"), d, &sp);
+	}
+	timer_init();
+}
+
+static void bench_crc(void)
+{
+	static const uint16_t sizes[] PROGMEM = {16, 256};
+	cyc_stat_t sc, sd;
+	uint16_t sz;
+	uint8_t i, r;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		sz = pgm_read_word(&sizes[i]);
+		cyc_begin(&sc, CYC_FAST);
+		cyc_begin(&sd, CYC_FAST);
+		for (r = 0; r < CYC_REPEAT; r++)
+		{
+			CYC_RUN(&sc, crc_ccitt_block(0xffff, Data, sz));
+			CYC_RUN(&sd, crc32_block(0xffffffffUL, Data, sz));
+		}
+		cyc_report(PSTR("crc_ccitt_block"), sz, &sc);
+		cyc_report(PSTR("crc32_block"), sz, &sd);
+
+		cyc_begin(&sc, CYC_FAST);
+		cyc_begin(&sd, CYC_FAST);
+		for (r = 0; r < CYC_REPEAT; r++)
+		{
+			CYC_RUN(&sc, crc_ccitt_flash(0xffff, 0, sz));
+			CYC_RUN(&sd, crc32_flash(0xffffffffUL, 0, sz));
+		}
+		cyc_report(PSTR("crc_ccitt_flash"), sz, &sc);
+		cyc_report(PSTR("crc32_flash"), sz, &sd);
+	}
+
+	/* a block of the page CRC diff of stkflash.py */
+	cyc_begin(&sc, CYC_SLOW);
+	cyc_begin(&sd, CYC_SLOW);
+	for (r = 0; r < CYC_REPEAT; r++)
+	{
+		CYC_RUN(&sc, crc_ccitt_flash(0xffff, 0, 4096));
+		CYC_RUN(&sd, crc32_flash(0xffffffffUL, 0, 4096));
+	}
+	cyc_report(PSTR("crc_ccitt_flash"), 4096, &sc);
+	cyc_report(PSTR("crc32_flash"), 4096, &sd);
+}
+
+/*
+ * \brief boot_program_page() and RWW enable, runs from the boot section
+ *
+ * The application section can not be read until RWW is enabled again.
+ */
+__attribute__((section(".bootspm"), noinline))
+static void cyc_spm_program(uint32_t addr, uint8_t *buf)
+{
+	boot_program_page(addr, buf);
+	spm_rww_enable();
+	boot_spm_busy_wait();
+}
+
+__attribute__((section(".bootspm"), noinline))
+static void cyc_spm_fill(uint32_t addr, uint8_t *buf)
+{
+	spm_page_fill(addr, buf, SPM_PAGESIZE);
+	/* clears the page buffer */
+	spm_rww_enable();
+	boot_spm_busy_wait();
+}
+
+static void bench_spm(void)
+{
+	cyc_stat_t st;
+	uint8_t r;
+
+	cyc_begin(&st, CYC_FAST);
+	for (r = 0; r < CYC_REPEAT; r++)
+	{
+		CYC_RUN(&st, cyc_spm_fill(CYC_SPM_PAGE, Data));
+	}
+	cyc_report(PSTR("spm_page_fill"), SPM_PAGESIZE, &st);
+
+	/* erase and write, about 9 ms on the chip, a simulator may take none */
+	cyc_begin(&st, CYC_SLOW);
+	for (r = 0; r < CYC_REPEAT / 2; r++)
+	{
+		CYC_RUN(&st, cyc_spm_program(CYC_SPM_PAGE, Data));
+	}
+	cyc_report(PSTR("boot_program_page"), SPM_PAGESIZE, &st);
+}
+
+int main(void)
+{
+	uint16_t i;
+
+	TCCR3A = 0;
+	TCCR3B = 0;
+	for (i = 0; i < sizeof(Data); i++)
+	{
+		Data[i] = i * 7;
+	}
+	hif_init(HIF_DEFAULT_BAUDRATE);
+	sei();
+	PRINTF("cyc start f_cpu=%lu\n\r", F_CPU);
+	cyc_drain(10);
+
+	bench_overhead();
+	bench_buffer();
+#if HIF_TYPE_IS_UART
+	bench_hif();
+#endif
+	bench_timer();
+	bench_crc();
+	bench_spm();
+
+	sei();
+	PRINT("cyc done\n\r");
+	cyc_drain(10);
+	/* simavr stops on sleep with interrupts off */
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	sleep_enable();
+	sleep_cpu();
+	for (;;)
+	{
+	}
+}
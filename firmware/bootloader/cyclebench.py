@@ -0,0 +1,200 @@
+#!/usr/bin/env python
+"""
+cyclebench.py - CPU cycles per call of the uracoli and spm.c routines
+
+Runs bench/cyclebench.c under simavr, or reads its output from the HIF
+of a board, and writes one row per routine and size: the arg (size, or
+timers in the wheel), the number of calls and min/avg/max cycles. With
+a baseline from an earlier run it lists the routines that got slower
+than the tolerance and exits with 1, so a regression fails the build.
+
+Usage:
+ python cyclebench.py [OPTIONS]
+
+Options:
+ -s ELF     run ELF under simavr, default cyclebench.elf
+ -S SIMAVR  simavr command, default simavr
+ -m MCU     MCU for simavr, default atmega256rfr2
+ -f FREQ    F_CPU for simavr, default 16000000
+ -p PORT    read the HIF of a board running the bench at PORT instead
+ -L LABEL   label of the rows, e.g. the build under test
+ -o FILE    results, CSV for *.csv else JSON, default cyclebench.csv
+ -b FILE    baseline, a CSV or JSON of an earlier run
+ -t PCT     tolerance of the avg cycles against the baseline, default 2
+ -T SEC     give up after SEC seconds, default 120
+ -h         show this help
+
+Example:
+ make cyclebench CYCLE_ARGS="-b cyclebench-base.csv"
+ python cyclebench.py -p /dev/ttyACM0 -L board -o board.json
+"""
+
+import os, sys, re, time, getopt, subprocess, csv, json
+
+COLUMNS = ["label", "name", "arg", "n", "min", "avg", "max", "ovf"]
+NUMBERS = ["arg", "n", "min", "avg", "max", "ovf"]
+BAUDRATE = 115200
+
+# "cyc name=.. arg=.." anywhere in a line, simavr adds color codes
+RESULT = re.compile(r"cyc ((?:\w+=\S+ ?)+)")
+
+def parse(line):
+    """ a result of the line as dict, "start"/"done" or None """
+    m = RESULT.search(line)
+    if m:
+        row = dict([kv.split("=", 1) for kv in m.group(1).split()])
+        if "name" in row:
+            for k in NUMBERS:
+                row[k] = int(row.get(k, 0))
+            return row
+        return "start"
+    if "cyc done" in line:
+        return "done"
+    return None
+
+def lines_simavr(cmd, timeout):
+    """ output lines of the bench under simavr, stderr included """
+    p = subprocess.Popen(cmd, stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+    tend = time.time() + timeout
+    try:
+        while time.time() < tend:
+            ln = p.stdout.readline()
+            if not ln:
+                break
+            yield ln
+    finally:
+        if p.poll() is None:
+            p.kill()
+        p.wait()
+
+def lines_serial(port, timeout):
+    """ HIF lines of a board, the bench starts after a reset through DTR """
+    import serial
+    sport = serial.Serial(port, BAUDRATE, timeout = 0.5)
+    sport.setDTR(False)
+    time.sleep(0.1)
+    sport.flushInput()
+    sport.setDTR(True)
+    tend = time.time() + timeout
+    try:
+        while time.time() < tend:
+            ln = sport.readline()
+            if ln:
+                yield ln
+    finally:
+        sport.close()
+
+def run(lines, label):
+    rows, done = [], False
+    for ln in lines:
+        r = parse(ln)
+        if r == "done":
+            done = True
+            break
+        elif isinstance(r, dict):
+            r["label"] = label
+            rows.append(r)
+            print "%-20s %5d %8d %8d %8d%s" % (r["name"], r["arg"], r["min"],
+                r["avg"], r["max"], r["ovf"] and "  overflow" or "")
+    return rows, done
+
+def load(fname):
+    if fname.endswith(".csv"):
+        rows = list(csv.DictReader(open(fname, "rb")))
+        for r in rows:
+            for k in NUMBERS:
+                r[k] = int(r[k])
+        return rows
+    return json.load(open(fname))
+
+def save(fname, rows):
+    if fname.endswith(".csv"):
+        f = open(fname, "wb")
+        w = csv.DictWriter(f, COLUMNS, extrasaction = "ignore")
+        w.writerow(dict(zip(COLUMNS, COLUMNS)))
+        for r in rows:
+            w.writerow(r)
+        f.close()
+    else:
+        json.dump(rows, open(fname, "w"), indent = 1, sort_keys = True)
+
+def compare(rows, base, tolerance):
+    """ rows slower than the baseline by more than tolerance percent and
+        the routines of the baseline missing in rows """
+    now = dict([((r["name"], r["arg"]), r) for r in rows])
+    slower, missing = [], []
+    for b in base:
+        r = now.get((b["name"], b["arg"]))
+        if r is None:
+            missing.append(b)
+        elif r["avg"] > b["avg"] * (1.0 + tolerance / 100.0) and r["avg"] > b["avg"] + 1:
+            slower.append((r, b))
+    return slower, missing
+
+if __name__ == "__main__":
+    elf = "cyclebench.elf"
+    simavr = "simavr"
+    mcu = "atmega256rfr2"
+    freq = 16000000
+    port = None
+    label = ""
+    outname = "cyclebench.csv"
+    basename = None
+    tolerance = 2.0
+    timeout = 120.0
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "s:S:m:f:p:L:o:b:t:T:h")
+        for o, v in opts:
+            if o == "-s":
+                elf = v
+            elif o == "-S":
+                simavr = v
+            elif o == "-m":
+                mcu = v
+            elif o == "-f":
+                freq = int(v)
+            elif o == "-p":
+                port = v
+            elif o == "-L":
+                label = v
+            elif o == "-o":
+                outname = v
+            elif o == "-b":
+                basename = v
+            elif o == "-t":
+                tolerance = float(v)
+            elif o == "-T":
+                timeout = float(v)
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if args:
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    base = basename and load(basename)
+    if port:
+        lines = lines_serial(port, timeout)
+    else:
+        if not os.path.exists(elf):
+            print "no", elf
+            sys.exit(1)
+        lines = lines_simavr(simavr.split() + ["-m", mcu, "-f", str(freq), elf], timeout)
+    rows, done = run(lines, label)
+    save(outname, rows)
+    print "%d results in %s" % (len(rows), outname)
+    ok = done
+    if not done:
+        print "the bench did not finish"
+    if base:
+        slower, missing = compare(rows, base, tolerance)
+        for r, b in slower:
+            print "slower: %s arg=%d avg %d -> %d cycles (%+.1f%%)" % \
+                (r["name"], r["arg"], b["avg"], r["avg"], 100.0 * (r["avg"] - b["avg"]) / max(b["avg"], 1))
+        for b in missing:
+            print "missing: %s arg=%d" % (b["name"], b["arg"])
+        ok = ok and not slower and not missing
+    sys.exit(not ok and 1 or 0)
@@ -0,0 +1,221 @@
+#!/usr/bin/env python
+"""
+energymark.py - energy per operation from GPIO markers and a current trace
+
+A build with ENERGY_MARKERS (make PROFILE=energy, uracoli energy=1) sets
+a pin while a frame is sent or received, a flash page is programmed, the
+MCU sleeps, an ISR runs or the application takes a sensor sample, see
+energy_mark.h. A logic analyzer records the pins, a current meter (shunt
+and scope, Otii, Joulescope ...) the supply current. The current is
+integrated over the marked intervals:
+
+ - per class: operations (rising edges), mean duration, energy per
+   operation, the same above the idle power (net) and the mean power
+ - idle: the time and power with no marker set
+ - per frame: TX and RX
+ - per OTA page: all energy from the first to the last SPM interval over
+   the pages programmed, radio and CPU included
+ - per sensor sample: SAMPLE
+
+Both files are CSV with the time in seconds in the first column, a
+header line is skipped. A marker row holds the state of the pins from
+its time on, so a sampled export and a transition export both work. A
+current row is the current from its time to the next row. Meters which
+record the digital inputs along with the current need only -i, the
+current is then taken from column -C of the same file.
+
+Usage:
+ python energymark.py [OPTIONS] -i CURRENT.csv [-m MARKERS.csv]
+
+Options:
+ -i FILE    current trace, time and current
+ -m FILE    marker trace, time and one column per pin, default the -i file
+ -c MAP     columns of the markers, default tx=1,rx=2,spm=3,sleep=4,isr=5,sample=6
+ -C COL     column of the current, default 1
+ -u SCALE   current unit in A, e.g. 1e-3 for mA, default 1
+ -V VOLT    supply voltage, default 3.3
+ -d SEC     time of the marker trace minus that of the current trace, default 0
+ -L LABEL   label of the rows, e.g. the build under test
+ -o FILE    results, CSV for *.csv else JSON
+ -b FILE    baseline, a CSV or JSON of an earlier run, the change is printed
+ -h         show this help
+
+Example:
+ python energymark.py -m la.csv -i otii.csv -u 1e-3 -L lpl -o lpl.csv
+ python energymark.py -i joulescope.csv -c tx=2,rx=3,spm=4 -b lpl.csv
+"""
+
+import sys, getopt, bisect, csv, json
+
+CLASSES = ["tx", "rx", "spm", "sleep", "isr", "sample"]
+COLUMNS = ["label", "name", "n", "time_us", "energy_uj", "net_uj", "power_uw", "total_mj"]
+
+def rows(fname):
+    """ the numeric rows of a CSV, header lines are skipped """
+    for r in csv.reader(open(fname, "rb")):
+        try:
+            yield [float(v) for v in r]
+        except ValueError:
+            continue
+
+def load_markers(fname, cols, offset):
+    """ times and bit masks of the marker states, bit i = CLASSES[i] """
+    times, states = [], []
+    for r in rows(fname):
+        s = 0
+        for i, name in enumerate(CLASSES):
+            c = cols.get(name)
+            if c is not None and c < len(r) and r[c] > 0.5:
+                s |= 1 << i
+        if not states or s != states[-1]:
+            times.append(r[0] - offset)
+            states.append(s)
+    return times, states
+
+def edges(states, i):
+    """ number of intervals of class i """
+    m = 1 << i
+    return sum([1 for k in range(len(states))
+                if states[k] & m and not (k and states[k - 1] & m)])
+
+def integrate(fname, col, scale, volt, times, states):
+    """ per class: [intervals, seconds, joule], idle [seconds, joule] and
+        the energy from the start of the first SPM interval to the end
+        of the last """
+    acc = [[edges(states, i), 0.0, 0.0] for i in range(len(CLASSES))]
+    idle = [0.0, 0.0]
+    spm = 1 << CLASSES.index("spm")
+    spm_first = spm_last = None
+    energy = 0.0
+    prev_t = prev_p = None
+    for r in rows(fname):
+        t = r[0]
+        if prev_t is not None and t > prev_t:
+            dt = t - prev_t
+            k = bisect.bisect_right(times, prev_t) - 1
+            s = states[k] if k >= 0 else 0
+            e = prev_p * dt
+            for i in range(len(CLASSES)):
+                if s & (1 << i):
+                    acc[i][1] += dt
+                    acc[i][2] += e
+            if s == 0:
+                idle[0] += dt
+                idle[1] += e
+            if s & spm:
+                if spm_first is None:
+                    spm_first = energy
+                spm_last = energy + e
+            energy += e
+        if col < len(r):
+            prev_t, prev_p = t, r[col] * scale * volt
+    spm_energy = (spm_first is not None) and (spm_last - spm_first) or 0.0
+    return acc, idle, spm_energy
+
+def results(acc, idle, spm_energy, label):
+    base_w = idle[0] and idle[1] / idle[0] or 0.0
+    out = []
+    for i, name in enumerate(CLASSES):
+        n, sec, joule = acc[i]
+        if n == 0:
+            continue
+        out.append({"label": label, "name": name, "n": n,
+                    "time_us": round(sec / n * 1e6, 1),
+                    "energy_uj": round(joule / n * 1e6, 3),
+                    "net_uj": round((joule - base_w * sec) / n * 1e6, 3),
+                    "power_uw": sec and round(joule / sec * 1e6, 1) or 0,
+                    "total_mj": round(joule * 1e3, 3)})
+    pages = acc[CLASSES.index("spm")][0]
+    if pages:
+        out.append({"label": label, "name": "ota_page", "n": pages,
+                    "time_us": 0, "energy_uj": round(spm_energy / pages * 1e6, 3),
+                    "net_uj": 0, "power_uw": 0, "total_mj": round(spm_energy * 1e3, 3)})
+    out.append({"label": label, "name": "idle", "n": 0,
+                "time_us": round(idle[0] * 1e6, 1), "energy_uj": 0,
+                "net_uj": 0, "power_uw": round(base_w * 1e6, 1), "total_mj": round(idle[1] * 1e3, 3)})
+    return out
+
+def load(fname):
+    if fname.endswith(".csv"):
+        out = list(csv.DictReader(open(fname, "rb")))
+        for r in out:
+            for k in COLUMNS[2:]:
+                r[k] = float(r[k])
+        return out
+    return json.load(open(fname))
+
+def save(fname, out):
+    if fname.endswith(".csv"):
+        f = open(fname, "wb")
+        w = csv.DictWriter(f, COLUMNS, extrasaction = "ignore")
+        w.writerow(dict(zip(COLUMNS, COLUMNS)))
+        for r in out:
+            w.writerow(r)
+        f.close()
+    else:
+        json.dump(out, open(fname, "w"), indent = 1, sort_keys = True)
+
+if __name__ == "__main__":
+    curname = markname = outname = basename = None
+    cols = dict([(name, i + 1) for i, name in enumerate(CLASSES)])
+    col = 1
+    scale = 1.0
+    volt = 3.3
+    offset = 0.0
+    label = ""
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "i:m:c:C:u:V:d:L:o:b:h")
+        for o, v in opts:
+            if o == "-i":
+                curname = v
+            elif o == "-m":
+                markname = v
+            elif o == "-c":
+                cols = {}
+                for kv in v.split(","):
+                    k, c = kv.split("=")
+                    if k not in CLASSES:
+                        raise ValueError("unknown class %s" % k)
+                    cols[k] = int(c)
+            elif o == "-C":
+                col = int(v)
+            elif o == "-u":
+                scale = float(v)
+            elif o == "-V":
+                volt = float(v)
+            elif o == "-d":
+                offset = float(v)
+            elif o == "-L":
+                label = v
+            elif o == "-o":
+                outname = v
+            elif o == "-b":
+                basename = v
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if args or not curname:
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    times, states = load_markers(markname or curname, cols, offset)
+    acc, idle, spm_energy = integrate(curname, col, scale, volt, times, states)
+    out = results(acc, idle, spm_energy, label)
+    print "%-10s %7s %10s %12s %12s %10s %10s" % ("name", "n", "time_us", "energy_uJ",
+        "net_uJ", "power_uW", "total_mJ")
+    for r in out:
+        print "%-10s %7d %10.1f %12.3f %12.3f %10.1f %10.3f" % (r["name"], r["n"],
+            r["time_us"], r["energy_uj"], r["net_uj"], r["power_uw"], r["total_mj"])
+    if basename:
+        base = dict([(b["name"], b) for b in load(basename)])
+        for r in out:
+            b = base.get(r["name"])
+            if b and b["energy_uj"]:
+                print "%-10s %12.3f -> %12.3f uJ (%+.1f%%)" % (r["name"], b["energy_uj"],
+                    r["energy_uj"], 100.0 * (r["energy_uj"] - b["energy_uj"]) / b["energy_uj"])
+    if outname:
+        save(outname, out)
+        print "%d results in %s" % (len(out), outname)
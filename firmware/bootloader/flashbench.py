@@ -0,0 +1,380 @@
+#!/usr/bin/env python
+"""
+flashbench.py - flashing times of the serial and the OTA path
+
+Flashes a set of images to a device under test, once per configuration,
+and records the wall time of each phase, the bytes on the line, frames
+sent again and the verify time. Each configuration turns on one more
+feature of the bootloader or the host tools than the one before, so each
+feature shows up as the difference of two rows. The serial runs go
+through stkflash.py and the 16u2 bridge, the OTA runs through a WIBO
+host node and wibohost.py.
+
+The images are a small one (8 KB), a full one (248 KB, up to the
+bootloader) and a sparse one (1 KB every 16 KB), data of a fixed seed
+with repeats like code, plus the ones given with -i. Before each run
+another image with the same layout is written, so each run replaces
+every page; the "same" and "delta" configurations start from the image
+itself or from one with every 8th page changed.
+
+Usage:
+ python flashbench.py [OPTIONS]
+
+Options:
+ -p PORT    serial port of the bridge of the device, default /dev/ttyACM0,
+            "none" for OTA runs only
+ -P PORT    PORT:BAUD of the WIBO host node, enables the OTA runs
+ -a ADDR    short address of the device for the OTA runs, default 1
+ -u VID:PID read the link statistics of the bridge (STATS=1, pyusb)
+ -c CONFIGS comma separated configurations, default all of the paths
+            available, -l lists them
+ -i NAME=FILE
+            add FILE (intel hex) to the images, -I: only these
+ -n N       runs per configuration and image, default 1
+ -L LABEL   label of the rows, e.g. the bootloader and bridge builds
+ -o FILE    results, CSV for *.csv else JSON, default flashbench.json
+ -l         list the configurations
+ -h         show this help
+
+Example:
+ python flashbench.py -L production -o production.csv
+ python flashbench.py -p /dev/ttyACM0 -P /dev/ttyUSB0:38400 -c ota-hex,ota-lz
+"""
+
+import os, sys, time, struct, getopt, random, tempfile, shutil, csv, json
+import serial
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "uracoli-src-20131127", "wibo"))
+import stkflash
+from stkflash import STK500v2, STKError, Phases, BAUDRATE, enter_bootloader
+from wibohost import WIBONetwork, NodeList, read_hex_pages, hexline, \
+     PAGESIZE, BOOTLOADER_START, OQPSK250, BINFRAME_SOF
+
+# name, description, stkflash.flash() arguments, starting image
+SERIAL_CONFIGS = [
+    ("stk-avrdude", "one page per frame, 115200, read back (as avrdude)",
+     dict(baud = 115200, ahead = 0, pages = 1, do_diff = False, readback = True), "other"),
+    ("stk-blocks", "+ blocks of several pages",
+     dict(baud = 115200, ahead = 0, do_diff = False, readback = True), "other"),
+    ("stk-ahead", "+ next frame sent ahead",
+     dict(baud = 115200, do_diff = False, readback = True), "other"),
+    ("stk-1m", "+ 1 Mbaud after sign-on",
+     dict(baud = 1000000, do_diff = False, readback = True), "other"),
+    ("stk-crc", "+ CRC verify",
+     dict(baud = 1000000, do_diff = False), "other"),
+    ("stk-diff", "+ page CRC diff, every 8th page changed",
+     dict(baud = 1000000), "delta"),
+    ("stk-same", "+ page CRC diff, image already in place",
+     dict(baud = 1000000), "same"),
+]
+
+# name, description, WIBONetwork settings and flashhex variant, starting image
+OTA_CONFIGS = [
+    ("ota-hex", "hex lines as text", dict(), "other"),
+    ("ota-bin", "+ binary frames", dict(binary = True), "other"),
+    ("ota-queued", "+ queued feeding", dict(binary = True, queued = True), "other"),
+    ("ota-window", "windowed, selective retransmit", dict(binary = True, mode = "windowed"), "other"),
+    ("ota-sparse", "page runs, 0xFF pages erased", dict(mode = "sparse"), "other"),
+    ("ota-lz", "+ LZSS", dict(mode = "compressed"), "other"),
+    ("ota-rate", "queued binary at a high data rate", dict(binary = True, queued = True, rate = True), "other"),
+]
+
+# USBSERIAL_REQ_GetStats and USBSerial_Stats_t of Arduino-usbserial.h
+REQ_GET_STATS = 0x04
+BRIDGE_STATS = ["HostToTargetBytes", "TargetToHostBytes", "USBtoUSARTHighWater",
+                "USARTtoUSBHighWater", "RxDropped", "FlushIdle", "FlushTimer",
+                "FlushNearlyFull", "FlushPacket", "EndpointNotReady"]
+
+PHASES = ["sign-on", "baud", "diff", "connect", "rate", "program", "verify", "leave", "exit"]
+COLUMNS = ["label", "path", "config", "image", "run", "image_bytes", "ok", "error", "wall"] + \
+          ["t_" + p for p in PHASES] + ["programmed", "line_bytes", "frames", "retries"] + \
+          ["bridge_" + s for s in BRIDGE_STATS]
+
+# the WIBO bootloader is ready for OTA after reset within this time
+OTA_ENTRY_TIME = 5.0
+
+def synthetic(seed, runs):
+    """ page aligned segments of code like data: each 16 byte line is new
+        or a copy of an earlier one, runs is a list of (address, length) """
+    rnd = random.Random(seed)
+    segs = []
+    for address, length in runs:
+        data = bytearray()
+        while len(data) < length:
+            if len(data) >= 16 and rnd.random() < 0.4:
+                i = rnd.randrange(0, len(data) - 15) & ~15
+                data.extend(data[i:i + 16])
+            else:
+                data.extend([rnd.randrange(256) for i in range(16)])
+        segs.append((address, data[:length]))
+    return segs
+
+def variant(segs, every = 1):
+    """ same layout, every given page changed, 0xFF pages are left alone """
+    out = []
+    for a, d in segs:
+        d = bytearray(d)
+        for p in range(0, len(d), PAGESIZE):
+            if ((a + p) / PAGESIZE) % every == 0 and d[p:p + PAGESIZE] != bytearray([0xff] * PAGESIZE):
+                d[p:p + PAGESIZE] = bytearray([c ^ 0x55 for c in d[p:p + PAGESIZE]])
+        out.append((a, d))
+    return out
+
+def write_hex(fname, segs):
+    """ intel hex-file of the segments, for the wibohost flashhex calls """
+    f = open(fname, "w")
+    base = None
+    for a, d in segs:
+        for i in range(0, len(d), 16):
+            if (a + i) >> 16 != base:
+                base = (a + i) >> 16
+                rec = struct.pack(">BHBH", 2, 0, 4, base)
+                f.write(":%s%02X\n" % (rec.encode("hex").upper(), (-sum(bytearray(rec))) & 0xff))
+            f.write(hexline(a + i, str(d[i:i + 16])) + "\n")
+    f.write(":00000001FF\n")
+    f.close()
+
+class CountingNetwork(WIBONetwork):
+    """ WIBONetwork which counts the bytes to and from the host node, the
+        frames fed and the frames fed again with the same number """
+    def __init__(self, *args, **kwargs):
+        WIBONetwork.__init__(self, *args, **kwargs)
+        self.clear()
+
+    def clear(self):
+        self.txbytes, self.rxbytes, self.frames, self.retries = 0, 0, 0, 0
+        self.seqnos = set()
+
+    def write(self, data):
+        self.txbytes += len(data)
+        if data[:1] == chr(BINFRAME_SOF) or data.split(" ", 1)[0] in ("feedhex", "feedseq", "qfeed"):
+            self.frames += 1
+        return WIBONetwork.write(self, data)
+
+    def read(self, size = 1):
+        data = WIBONetwork.read(self, size)
+        self.rxbytes += len(data)
+        return data
+
+    def _seqno(self, seqno):
+        if seqno in self.seqnos:
+            self.retries += 1
+        self.seqnos.add(seqno)
+
+    def feedseq(self, nodeid, seqno, ln):
+        self._seqno(seqno)
+        return WIBONetwork.feedseq(self, nodeid, seqno, ln)
+
+    def feedbin(self, nodeid, data, seqno = None):
+        if seqno != None:
+            self._seqno(seqno)
+        return WIBONetwork.feedbin(self, nodeid, data, seqno)
+
+def bridge_stats(dev, clear):
+    """ link statistics of the bridge, cleared after reading with clear """
+    rv = dev.ctrl_transfer(0xc0, REQ_GET_STATS, clear and 1 or 0, 0, 24)
+    return dict(zip(BRIDGE_STATS, struct.unpack("<LLHHHHHHHH", rv.tostring())))
+
+def run_serial(sport, segs, args):
+    stk = STK500v2(sport)
+    ph = Phases(True)
+    try:
+        ph, nbytes = stkflash.flash(stk, segs, do_reset = True, ph = ph, **args)
+        row = dict(ok = 1, programmed = nbytes)
+    except STKError, e:
+        row = dict(ok = 0, error = str(e))
+    row.update(line_bytes = stk.txbytes + stk.rxbytes, retries = stk.retries)
+    return ph, row
+
+def ota_enter(wnwk, n, sport):
+    """ reset the device into the WIBO bootloader, through DTR if the
+        serial port is there, else with a jump_to_bootloader frame """
+    if sport:
+        enter_bootloader(sport)
+    else:
+        wnwk.jbootl(n)
+    tend = time.time() + OTA_ENTRY_TIME
+    while time.time() < tend:
+        ret = wnwk.ping(n)
+        if ret['code'] == 'OK' and ret['data']['appname'] == "wibo":
+            return True
+    return False
+
+def run_ota(wnwk, n, sport, fname, args):
+    ph = Phases(True)
+    wnwk.clear()
+    wnwk.nodes = NodeList()
+    wnwk.binary = args.get("binary", False)
+    wnwk.queued = args.get("queued", False)
+    row = dict(ok = 0)
+    if not ota_enter(wnwk, n, sport):
+        row["error"] = "node %d not in the bootloader" % n
+        return ph, row
+    ph.done("connect")
+    if args.get("rate"):
+        wnwk.negotiate_rate(n)
+        ph.done("rate")
+    mode = args.get("mode")
+    if mode == "windowed":
+        ok = wnwk.flashhex_windowed(n, fname)
+    elif mode == "sparse":
+        ok = wnwk.flashhex_sparse(n, fname)
+    elif mode == "compressed":
+        ok = wnwk.flashhex_compressed(n, fname) != None
+    else:
+        ok = wnwk.flashhex(n, fname) != False
+    if args.get("rate"):
+        wnwk.rate(n, OQPSK250)
+    ph.done("program")
+    if ok:
+        wnwk.checkcrc()
+        ok = [m['status'] for m in wnwk.nodes if m['short_addr'] == n] == ['OK']
+        ph.done("verify")
+        if not ok:
+            row["error"] = "CRC mismatch"
+    else:
+        row["error"] = "flashing failed"
+    wnwk.exit(n)
+    ph.done("exit")
+    row.update(ok = ok and 1 or 0, line_bytes = wnwk.txbytes + wnwk.rxbytes,
+               frames = wnwk.frames, retries = wnwk.retries)
+    return ph, row
+
+def prepare(start, image, sport, wnwk, n, tmpdir):
+    """ write the starting image of a run with the fastest path there is """
+    segs = {"other": image["other"], "delta": image["delta"], "same": image["segs"]}[start]
+    if sport:
+        stkflash.flash(STK500v2(sport), segs, do_reset = True, do_verify = False,
+                       ph = Phases(True))
+    else:
+        fname = os.path.join(tmpdir, "prepare.hex")
+        write_hex(fname, segs)
+        run_ota(wnwk, n, None, fname, dict(binary = True, queued = True))
+
+def save(fname, rows):
+    if fname.endswith(".csv"):
+        f = open(fname, "wb")
+        w = csv.DictWriter(f, COLUMNS, extrasaction = "ignore")
+        w.writerow(dict(zip(COLUMNS, COLUMNS)))
+        for r in rows:
+            w.writerow(r)
+        f.close()
+    else:
+        json.dump(rows, open(fname, "w"), indent = 1, sort_keys = True)
+
+if __name__ == "__main__":
+    port = "/dev/ttyACM0"
+    hostport = None
+    nodeid = 1
+    usbid = None
+    configs = None
+    extra = []
+    only_extra = False
+    nruns = 1
+    label = ""
+    outname = "flashbench.json"
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "p:P:a:u:c:i:In:L:o:lh")
+        for o, v in opts:
+            if o == "-p":
+                port = (v != "none") and v or None
+            elif o == "-P":
+                p, b = v.split(":")
+                hostport = (p, int(b))
+            elif o == "-a":
+                nodeid = int(v, 0)
+            elif o == "-u":
+                usbid = [int(x, 16) for x in v.split(":")]
+            elif o == "-c":
+                configs = v.split(",")
+            elif o == "-i":
+                name, fname = v.split("=", 1)
+                extra.append((name, read_hex_pages(fname, True)))
+            elif o == "-I":
+                only_extra = True
+            elif o == "-n":
+                nruns = int(v)
+            elif o == "-L":
+                label = v
+            elif o == "-o":
+                outname = v
+            elif o == "-l":
+                for c in SERIAL_CONFIGS + OTA_CONFIGS:
+                    print "%-12s %s" % (c[0], c[1])
+                sys.exit(0)
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if args or nruns < 1 or not (port or hostport):
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    runlist = (port and SERIAL_CONFIGS or []) + (hostport and OTA_CONFIGS or [])
+    if configs:
+        runlist = [c for c in SERIAL_CONFIGS + OTA_CONFIGS if c[0] in configs]
+    images = [] if only_extra else [
+        ("small", synthetic(1, [(0, 8 * 1024)])),
+        ("full", synthetic(2, [(0, BOOTLOADER_START)])),
+        ("sparse", synthetic(3, [(a, 1024) for a in range(0, BOOTLOADER_START, 16 * 1024)])),
+    ]
+    images += extra
+
+    sport = port and serial.Serial(port, BAUDRATE, timeout = 0.05)
+    wnwk = None
+    if hostport:
+        wnwk = CountingNetwork()
+        wnwk.setTimeout(1.0)
+        wnwk.setPort(hostport[0])
+        wnwk.setBaudrate(hostport[1])
+        wnwk.open()
+        time.sleep(0.1)
+        if wnwk.echo("HalloWibo")["code"] != "OK":
+            print "no WIBO host on", hostport[0]
+            sys.exit(1)
+    usbdev = None
+    if usbid:
+        import usb.core
+        usbdev = usb.core.find(idVendor = usbid[0], idProduct = usbid[1])
+
+    tmpdir = tempfile.mkdtemp(prefix = "flashbench")
+    rows = []
+    try:
+        for iname, segs in images:
+            image = dict(segs = segs, other = variant(segs), delta = variant(segs, 8))
+            fname = os.path.join(tmpdir, iname + ".hex")
+            write_hex(fname, segs)
+            nbytes = sum([len(d) for a, d in segs])
+            for cname, desc, args, start in runlist:
+                for i in range(nruns):
+                    try:
+                        prepare(start, image, sport, wnwk, nodeid, tmpdir)
+                    except STKError, e:
+                        print "%-12s %-8s prepare failed: %s" % (cname, iname, e)
+                        continue
+                    if usbdev and cname.startswith("stk"):
+                        bridge_stats(usbdev, True)
+                    t = time.time()
+                    if cname.startswith("stk"):
+                        ph, row = run_serial(sport, segs, args)
+                    else:
+                        ph, row = run_ota(wnwk, nodeid, sport, fname, args)
+                    row.update(wall = time.time() - t, label = label, config = cname,
+                               image = iname, image_bytes = nbytes, run = i,
+                               path = cname.startswith("stk") and "serial" or "ota")
+                    for name, dt, info in ph.phases:
+                        row["t_" + name] = dt
+                    if usbdev and cname.startswith("stk"):
+                        for k, v in bridge_stats(usbdev, False).items():
+                            row["bridge_" + k] = v
+                    rows.append(row)
+                    print "%-12s %-8s %8.3f s  verify %6.3f s  %8d bytes on the line  %3d retries  %s" % \
+                        (cname, iname, row["wall"], row.get("t_verify", 0), row.get("line_bytes", 0),
+                         row.get("retries", 0), row["ok"] and "OK" or row.get("error"))
+    finally:
+        shutil.rmtree(tmpdir)
+        save(outname, rows)
+        print "%d results in %s" % (len(rows), outname)
@@ -0,0 +1,148 @@
+#!/usr/bin/env python
+"""
+monitordump.py - pull a binary memory dump from the bootloader monitor
+
+The monitor (ENABLE_MONITOR, debug profile) is entered with "!!!" right
+after reset. Its 'D' command sends flash, EEPROM or RAM as raw bytes
+with a length prefix and a CRC, optionally at a higher baud rate, see
+DumpBinary() in src/main.c.
+
+Usage:
+ python monitordump.py [OPTIONS] OUTFILE
+
+Options:
+ -p PORT    serial port, default /dev/ttyACM0
+ -m MEM     memory F(lash), E(EPROM) or R(AM), default F
+ -a ADDR    start address, default 0
+ -n LEN     number of bytes, default: up to the end of the memory
+ -b BAUD    rate for the transfer: 115200, 250000, 500000 or 1000000,
+            needs ENABLE_BAUD_SWITCH for the others, default 1000000
+ -r         reset the node through DTR first and enter the monitor
+ -q         leave the monitor afterwards (jumps to the application)
+ -h         show this help
+
+Example:
+ python monitordump.py -r -p /dev/ttyACM0 flash.bin
+ python monitordump.py -m E eeprom.bin
+"""
+
+import sys, time, struct, getopt
+import serial
+
+BAUDRATE = 115200
+# index is the baud parameter of the request, same as baudTable in main.c
+BAUDTABLE = [115200, 250000, 500000, 1000000]
+
+def crc_ccitt_update(crc, data):
+    """same as _crc_ccitt_update() of avr-libc"""
+    data ^= crc & 0xff
+    data ^= (data << 4) & 0xff
+    return (((data << 8) | (crc >> 8)) ^ (data >> 4) ^ (data << 3)) & 0xffff
+
+def crc_ccitt(data):
+    crc = 0
+    for c in bytearray(data):
+        crc = crc_ccitt_update(crc, c)
+    return crc
+
+def read_until(sport, token, timeout = 3.0):
+    buf = ""
+    tend = time.time() + timeout
+    while not buf.endswith(token):
+        c = sport.read(1)
+        if c:
+            buf += c
+        elif time.time() > tend:
+            raise IOError("no answer from the monitor, got %r" % buf[-40:])
+    return buf
+
+def read_exact(sport, n):
+    buf = ""
+    while len(buf) < n:
+        c = sport.read(n - len(buf))
+        if not c:
+            raise IOError("dump stopped after %d/%d bytes" % (len(buf), n))
+        buf += c
+    return buf
+
+def enter_monitor(sport):
+    """reset through DTR (as avrdude does) and send the monitor entry"""
+    sport.setDTR(False)
+    time.sleep(0.1)
+    sport.setDTR(True)
+    time.sleep(0.05)
+    sport.flushInput()
+    sport.write("!!!")
+    read_until(sport, ">")
+
+def dump(sport, mem, addr, length, baud):
+    """run one 'D' request, returns the data"""
+    sport.write("D")
+    read_until(sport, "D ")
+    sport.write(mem + chr(BAUDTABLE.index(baud)) + struct.pack(">LL", addr, length))
+    if baud != BAUDRATE:
+        # the node switches after it read the request
+        sport.flush()
+        time.sleep(0.01)
+        sport.baudrate = baud
+        sport.write("\0")
+    try:
+        tmo = sport.timeout
+        sport.timeout = 1.0
+        (n,) = struct.unpack(">L", read_exact(sport, 4))
+        data = read_exact(sport, n)
+        (crc,) = struct.unpack(">H", read_exact(sport, 2))
+        sport.timeout = tmo
+    finally:
+        sport.baudrate = BAUDRATE
+    if crc != crc_ccitt(data):
+        raise IOError("CRC error: got 0x%04x, data has 0x%04x" % (crc, crc_ccitt(data)))
+    return data
+
+if __name__ == "__main__":
+    port = "/dev/ttyACM0"
+    mem = "F"
+    addr = 0
+    length = 0xffffffff
+    baud = 1000000
+    do_reset = False
+    do_quit = False
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "p:m:a:n:b:rqh")
+        for o, v in opts:
+            if o == "-p":
+                port = v
+            elif o == "-m":
+                mem = v[:1].upper()
+            elif o == "-a":
+                addr = int(v, 0)
+            elif o == "-n":
+                length = int(v, 0)
+            elif o == "-b":
+                baud = int(v)
+            elif o == "-r":
+                do_reset = True
+            elif o == "-q":
+                do_quit = True
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if mem not in "FER" or baud not in BAUDTABLE or len(args) != 1:
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    sport = serial.Serial(port, BAUDRATE, timeout = 0.2)
+    if do_reset:
+        enter_monitor(sport)
+    t = time.time()
+    data = dump(sport, mem, addr, length, baud)
+    t = time.time() - t
+    open(args[0], "wb").write(data)
+    print "%d bytes from 0x%x, %.1f s, %s" % (len(data), addr, t, args[0])
+    if do_quit:
+        read_until(sport, ">")
+        sport.write("Q")
+    sport.close()
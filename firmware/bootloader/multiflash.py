@@ -0,0 +1,200 @@
+#!/usr/bin/env python
+"""
+multiflash.py - flash all attached Pinoccio boards at once
+
+Finds the USB serial ports of the 16u2 bridge (VID:PID 1d50:6051, see
+PINOCCIO_PID in Descriptors.h) and tells the boards apart by the USB
+serial number of the bridge. Each board gets a worker process of its own
+that runs stkflash.flash() on its port, so the boards are flashed in
+parallel and the image is parsed only once, before the workers start.
+A failing board doesn't stop the others; each row of the report has the
+phases, the time and the error of one board.
+
+Usage:
+ python multiflash.py [OPTIONS] HEXFILE
+
+Options:
+ -u VID:PID USB id of the bridge, default 1d50:6051
+ -s SERIALS comma separated USB serial numbers, flash only these
+ -c COUNT   number of boards expected, fail before flashing if another
+            number is found
+ -j JOBS    worker processes at most, default one per board
+ -b BAUD    rate after sign-on, as stkflash.py, default 1000000
+ -f         write all pages of the image, don't compare page CRCs
+ -n         don't verify
+ -k         stay in the bootloader, don't start the application
+ -o FILE    report, CSV for *.csv else JSON
+ -l         list the boards found and exit
+ -h         show this help
+
+HEXFILE can also be an image container (see wibohost.py -W). The boards
+are reset into the bootloader through DTR, as with stkflash.py -r.
+
+Example:
+ python multiflash.py -c 8 -o lot42.csv Bootstrap.cpp.hex
+"""
+
+import os, sys, re, time, getopt, csv, json
+import serial
+import serial.tools.list_ports
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "uracoli-src-20131127", "wibo"))
+import stkflash
+from stkflash import STK500v2, STKError, Phases, BAUDRATE, BAUDTABLE, AHEAD
+from wibohost import read_hex_pages, read_page_crcs, BOOTLOADER_START, \
+     ImageError
+
+USB_ID = (0x1d50, 0x6051)
+PHASES = ["sign-on", "baud", "diff", "program", "verify", "leave"]
+COLUMNS = ["serial", "port", "ok", "seconds", "programmed", "line_bytes",
+           "retries", "error"] + PHASES
+
+# image and flash() arguments of the workers, set before the pool forks
+JOB = {}
+
+def find_boards(usbid = USB_ID):
+    """ (serial number, port) of the bridges with usbid, sorted by serial
+        number; the hardware id string of pyserial has VID:PID=vvvv:pppp
+        and SER= (SNR= in older versions)
+    """
+    boards = []
+    for p in serial.tools.list_ports.comports():
+        port, hwid = p[0], p[2]
+        m = re.search(r"VID:PID=([0-9a-fA-F]{4}):([0-9a-fA-F]{4})", hwid)
+        if m == None or (int(m.group(1), 16), int(m.group(2), 16)) != usbid:
+            continue
+        m = re.search(r"(?:SER|SNR)=(\S+)", hwid)
+        boards.append((m and m.group(1) or "", port))
+    return sorted(boards)
+
+def flash_board(board):
+    """ Flash one board, runs in a worker process. Returns its report row. """
+    serno, port = board
+    row = dict(serial = serno, port = port, ok = 0)
+    t = time.time()
+    try:
+        sport = serial.Serial(port, BAUDRATE, timeout = 0.05)
+    except serial.SerialException, e:
+        row.update(error = str(e), seconds = 0.0)
+        return row
+    stk = STK500v2(sport)
+    try:
+        ph, nbytes = stkflash.flash(stk, JOB["segs"], ph = Phases(True),
+                                    own = JOB["own"], **JOB["args"])
+        row.update(ok = 1, programmed = nbytes)
+        for name, dt, info in ph.phases:
+            row[name] = round(dt, 3)
+    except (STKError, serial.SerialException), e:
+        row["error"] = str(e)
+    finally:
+        sport.close()
+    row.update(seconds = round(time.time() - t, 3),
+               line_bytes = stk.txbytes + stk.rxbytes, retries = stk.retries)
+    return row
+
+def run(boards, jobs):
+    """ Flash the boards, jobs at a time. Returns the rows in the order of
+        the boards.
+    """
+    if jobs > 1 and len(boards) > 1:
+        import multiprocessing
+        pool = multiprocessing.Pool(jobs)
+        rows = pool.map(flash_board, boards, chunksize = 1)
+        pool.close()
+        pool.join()
+    else:
+        rows = map(flash_board, boards)
+    return rows
+
+def save(fname, rows):
+    if fname.endswith(".csv"):
+        f = open(fname, "wb")
+        w = csv.DictWriter(f, COLUMNS, extrasaction = "ignore")
+        w.writerow(dict(zip(COLUMNS, COLUMNS)))
+        for r in rows:
+            w.writerow(r)
+        f.close()
+    else:
+        json.dump(rows, open(fname, "w"), indent = 1, sort_keys = True)
+
+if __name__ == "__main__":
+    usbid = USB_ID
+    serials = None
+    count = None
+    jobs = None
+    outname = None
+    list_only = False
+    args = dict(baud = 1000000, ahead = AHEAD, do_reset = True, do_diff = True,
+                do_verify = True, do_leave = True)
+    try:
+        opts, files = getopt.getopt(sys.argv[1:], "u:s:c:j:b:fnko:lh")
+        for o, v in opts:
+            if o == "-u":
+                usbid = tuple([int(x, 16) for x in v.split(":")])
+            elif o == "-s":
+                serials = v.split(",")
+            elif o == "-c":
+                count = int(v)
+            elif o == "-j":
+                jobs = max(int(v), 1)
+            elif o == "-b":
+                args["baud"] = int(v)
+            elif o == "-f":
+                args["do_diff"] = False
+            elif o == "-n":
+                args["do_verify"] = False
+            elif o == "-k":
+                args["do_leave"] = False
+            elif o == "-o":
+                outname = v
+            elif o == "-l":
+                list_only = True
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if args["baud"] not in BAUDTABLE or len(usbid) != 2 or \
+                (len(files) != 1 and not list_only):
+            raise getopt.GetoptError("bad arguments")
+        if not list_only:
+            JOB["segs"] = read_hex_pages(files[0], True)
+            segs = JOB["segs"]
+            if not segs or segs[-1][0] + len(segs[-1][1]) > BOOTLOADER_START:
+                raise ValueError("no application image: %s" % files[0])
+            JOB["own"] = read_page_crcs(files[0])
+            JOB["args"] = args
+    except (getopt.GetoptError, ValueError, ImageError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    boards = find_boards(usbid)
+    if serials != None:
+        boards = [b for b in boards if b[0] in serials]
+        for s in set(serials) - set([b[0] for b in boards]):
+            print "WARN board %s not found" % s
+    if list_only:
+        for serno, port in boards:
+            print "%-24s %s" % (serno, port)
+        sys.exit(0)
+    if not boards or (count != None and len(boards) != count):
+        print "ERROR: %d boards found, %s expected" % (len(boards), count or "some")
+        sys.exit(1)
+
+    t = time.time()
+    rows = run(boards, min(jobs or len(boards), len(boards)))
+    wall = time.time() - t
+    print "%-24s %-14s %-4s %7s %7s  %s" % ("SERIAL", "PORT", "OK", "TIME", "kB/s", "PHASES / ERROR")
+    for r in rows:
+        rate = r.get("programmed", 0) / max(r.get("program", 0), 1e-3) / 1000
+        info = r["ok"] and " ".join(["%s %.2f" % (p, r[p]) for p in PHASES if p in r]) \
+               or r.get("error", "")
+        print "%-24s %-14s %-4s %7.2f %7.1f  %s" % (r["serial"], r["port"],
+            r["ok"] and "OK" or "FAIL", r["seconds"], rate, info)
+    nok = sum([r["ok"] for r in rows])
+    serial_time = sum([r["seconds"] for r in rows])
+    print "%d of %d boards OK, %.2f s wall, %.2f s one by one (%.1fx)" % \
+        (nok, len(rows), wall, serial_time, serial_time / max(wall, 1e-3))
+    if outname:
+        save(outname, rows)
+    sys.exit(nok != len(rows) and 1 or 0)
@@ -38,10 +38,21 @@
 
     local p2p = Proto ("p2p", "uracoli peer to peer protocoll")
 
+    -- command codes, see p2p_protocol.h
     local cmd_table = {
         [0x01] = "P2P_PING_REQ",
         [0x02] = "P2P_PING_CNF",
         [0x03] = "P2P_JUMP_BOOTL",
+        [0x04] = "P2P_FRAG",
+        [0x05] = "P2P_MESH_RREQ",
+        [0x06] = "P2P_MESH_RREP",
+        [0x07] = "P2P_MESH_DATA",
+        [0x08] = "P2P_PING_SHORT_REQ",
+        [0x09] = "P2P_PING_SHORT_CNF",
+        [0x0A] = "P2P_PHY_SET",
+        [0x0B] = "P2P_PHY_STATS_REQ",
+        [0x0C] = "P2P_PHY_STATS_CNF",
+        [0x0D] = "P2P_PHY_TEST",
         [0x20] = "P2P_WIBO_DATA",
         [0x21] = "P2P_WIBO_FINISH",
         [0x22] = "P2P_WIBO_RESET",
@@ -49,8 +60,23 @@
         [0x24] = "P2P_WIBO_TARGET",
         [0x25] = "P2P_WIBO_DEAF",
         [0x26] = "P2P_WIBO_ADDR",
-        [0x30] = "P2P_XMPL_LED",
+        [0x27] = "P2P_WIBO_BOOTLUP",
+        [0x28] = "P2P_WIBO_DATA_SEQ",
+        [0x29] = "P2P_WIBO_WINDOW_REQ",
+        [0x2A] = "P2P_WIBO_WINDOW_CNF",
+        [0x2B] = "P2P_WIBO_RATE",
+        [0x2C] = "P2P_WIBO_ZMODE",
+        [0x2D] = "P2P_WIBO_ERASE",
+        [0x2E] = "P2P_WIBO_DISCOVER",
+        [0x2F] = "P2P_WIBO_RESUME",
+        -- P2P_XMPL_LED has the same code, told apart by the length
+        [0x30] = "P2P_WIBO_COMMIT",
+        [0x31] = "P2P_WIBO_RELAY",
+        [0x32] = "P2P_WIBO_CHANNEL",
         [0x40] = "P2P_WUART_DATA",
+        [0x60] = "P2P_SENSOR_DATA",
+        [0x61] = "P2P_SENSOR_CAPTION",
+        [0x62] = "P2P_SENSOR_BATCH",
     }
 
     local targmem_table = {
@@ -59,6 +85,12 @@
         [string.byte("X")] = "X: Dry run",
     }
 
+    local zmode_table = {
+        [0] = "raw",
+        [1] = "LZSS",
+        [2] = "delta",
+    }
+
     p2p.fields.f_cmd = ProtoField.uint8("p2p.cmd", "cmd", nil, cmd_table)
     p2p.fields.f_rawdata = ProtoField.bytes("p2p.rawdata", "rawdata", base.HEX)
 
@@ -69,26 +101,190 @@
     p2p.fields.f_crc = ProtoField.uint16("p2p.crc", "crc", base.HEX)
     p2p.fields.f_appname = ProtoField.string("p2p.appname", "appname")
     p2p.fields.f_boardname = ProtoField.string("p2p.boardname", "boardname")
-    -- P2P_WIBO_DATA
+    -- PING_SHORT_REQ, WIBO_DISCOVER
+    p2p.fields.f_nslots = ProtoField.uint8("p2p.nslots", "nslots")
+    p2p.fields.f_round = ProtoField.uint8("p2p.round", "round")
+    -- PING_SHORT_CNF
+    p2p.fields.f_flags = ProtoField.uint8("p2p.flags", "flags", base.HEX)
+    -- P2P_FRAG
+    p2p.fields.f_fragcmd = ProtoField.uint8("p2p.frag.cmd", "cmd", nil, cmd_table)
+    p2p.fields.f_msgid = ProtoField.uint8("p2p.frag.msgid", "msgid")
+    p2p.fields.f_fragidx = ProtoField.uint8("p2p.frag.idx", "idx")
+    p2p.fields.f_fragcnt = ProtoField.uint8("p2p.frag.cnt", "cnt")
+    -- P2P_MESH_*
+    p2p.fields.f_orig = ProtoField.uint16("p2p.mesh.orig", "orig", base.HEX)
+    p2p.fields.f_target = ProtoField.uint16("p2p.mesh.target", "target", base.HEX)
+    p2p.fields.f_final = ProtoField.uint16("p2p.mesh.final", "final", base.HEX)
+    p2p.fields.f_rseq = ProtoField.uint8("p2p.mesh.rseq", "rseq")
+    p2p.fields.f_hops = ProtoField.uint8("p2p.mesh.hops", "hops")
+    p2p.fields.f_ttl = ProtoField.uint8("p2p.mesh.ttl", "ttl")
+    -- P2P_PHY_*
+    p2p.fields.f_profile = ProtoField.uint8("p2p.phy.profile", "profile")
+    p2p.fields.f_stored = ProtoField.uint8("p2p.phy.stored", "stored")
+    p2p.fields.f_clear = ProtoField.uint8("p2p.phy.clear", "clear")
+    p2p.fields.f_received = ProtoField.uint16("p2p.phy.received", "received")
+    p2p.fields.f_bytes = ProtoField.uint32("p2p.phy.bytes", "bytes")
+    -- P2P_WIBO_DATA, P2P_WIBO_DATA_SEQ, P2P_PHY_TEST
+    p2p.fields.f_seqno = ProtoField.uint16("p2p.seqno", "seqno")
     p2p.fields.f_dsize = ProtoField.uint8("p2p.dsize", "dsize")
     p2p.fields.f_data = ProtoField.bytes("p2p.data", "data")
+    -- P2P_WIBO_WINDOW_CNF
+    p2p.fields.f_wbase = ProtoField.uint16("p2p.window.base", "base")
+    p2p.fields.f_wreceived = ProtoField.uint16("p2p.window.received", "received", base.HEX)
+    p2p.fields.f_wmissing = ProtoField.uint8("p2p.window.missing", "missing")
     -- P2P_WIBO_TARGET
     p2p.fields.f_targmem = ProtoField.uint8("p2p.targmem", "targmem", nil, targmem_table)
-    -- P2P_WIBO_ADDR
-    p2p.fields.f_addr = ProtoField.uint32("p2p.addr", "addr")
+    -- P2P_WIBO_ADDR, P2P_WIBO_ERASE
+    p2p.fields.f_addr = ProtoField.uint32("p2p.addr", "addr", base.HEX)
+    p2p.fields.f_npages = ProtoField.uint16("p2p.npages", "npages")
+    -- P2P_WIBO_RATE, P2P_WIBO_CHANNEL
+    p2p.fields.f_rate = ProtoField.uint8("p2p.rate", "rate", base.HEX)
+    p2p.fields.f_channel = ProtoField.uint8("p2p.channel", "channel")
+    -- P2P_WIBO_ZMODE
+    p2p.fields.f_zmode = ProtoField.uint8("p2p.zmode", "zmode", nil, zmode_table)
+    p2p.fields.f_baselen = ProtoField.uint32("p2p.baselen", "baselen")
+    p2p.fields.f_basecrc = ProtoField.uint16("p2p.basecrc", "basecrc", base.HEX)
+    -- P2P_WIBO_RESUME, P2P_WIBO_COMMIT, P2P_WIBO_RELAY
+    p2p.fields.f_page = ProtoField.uint16("p2p.page", "page", base.HEX)
+    p2p.fields.f_len = ProtoField.uint32("p2p.len", "len")
+    p2p.fields.f_mac = ProtoField.bytes("p2p.mac", "mac")
     -- P2P_XMPL_LED
     p2p.fields.f_led = ProtoField.uint8("p2p.led", "led")
     p2p.fields.f_state = ProtoField.uint8("p2p.state", "state")
     -- P2P_WUART_DATA
     p2p.fields.f_mode = ProtoField.uint8("p2p.mode", "mode")
     p2p.fields.f_sdata = ProtoField.string("p2p.sdata", "sdata")
+    -- P2P_SENSOR_*
+    p2p.fields.f_caption = ProtoField.stringz("p2p.caption", "caption")
+    p2p.fields.f_nchan = ProtoField.uint8("p2p.batch.nchan", "nchan")
+    p2p.fields.f_rows = ProtoField.uint16("p2p.batch.rows", "rows")
+    p2p.fields.f_row = ProtoField.string("p2p.batch.row", "row")
+    -- derived from the frames before, see track_session()
+    p2p.fields.f_ifg = ProtoField.double("p2p.session.ifg", "inter-frame gap [ms]")
+    p2p.fields.f_goodput = ProtoField.double("p2p.session.goodput", "goodput [byte/s]")
+    p2p.fields.f_sbytes = ProtoField.uint32("p2p.session.bytes", "session bytes")
+    p2p.fields.f_sframes = ProtoField.uint32("p2p.session.frames", "session frames")
+    p2p.fields.f_retrans = ProtoField.double("p2p.session.retrans_ratio", "retransmission ratio")
 
     p2p.experts.too_short = ProtoExpert.new("short", "Packet too short", expert.group.MALFORMED, expert.severity.ERROR)
     p2p.experts.too_long = ProtoExpert.new("long", "Packet too long", expert.group.MALFORMED, expert.severity.ERROR)
     p2p.experts.unknown_cmd = ProtoExpert.new("unknown_cmd", "Unknown command", expert.group.MALFORMED, expert.severity.ERROR)
+    p2p.experts.seq_gap = ProtoExpert.new("seq_gap", "Data frames missing", expert.group.SEQUENCE, expert.severity.WARN)
+    p2p.experts.seq_retry = ProtoExpert.new("seq_retry", "Data frame retransmitted", expert.group.SEQUENCE, expert.severity.NOTE)
+
+    local f_wpan_src = Field.new("wpan.src16")
+    local f_wpan_dst = Field.new("wpan.dst16")
+    local f_wpan_seq = Field.new("wpan.seq_no")
+
+    -- per data stream (source > destination) state of the first pass,
+    -- and the results per frame number for all later passes
+    local sessions = {}
+    local frame_info = {}
 
     -- Init function, called before any packet is dissected
     function p2p.init()
+        sessions = {}
+        frame_info = {}
+    end
+
+    local function field_value(f)
+        local fi = f()
+        return fi and fi.value or nil
+    end
+
+    -- Update the session of the frame with a data frame, seqno is the
+    -- P2P_WIBO_DATA_SEQ frame number, or nil for P2P_WIBO_DATA, which
+    -- is followed by the MAC sequence number (mod 256).
+    -- kind is "reset" (new session), "data" or "end".
+    local function track_session(pinfo, kind, seqno, nbytes)
+        if pinfo.visited then
+            return frame_info[pinfo.number]
+        end
+        local key = tostring(field_value(f_wpan_src)) .. ">" ..
+                    tostring(field_value(f_wpan_dst))
+        local ts = pinfo.abs_ts
+        local s = sessions[key]
+        if kind == "reset" or s == nil then
+            s = {start = ts, last = nil, frames = 0, retries = 0,
+                 bytes = 0, seen = {}, nextseq = nil, macseq = nil}
+            sessions[key] = s
+        end
+        local info = {}
+        if kind ~= "data" then
+            info.bytes = s.bytes
+            info.frames = s.frames
+            frame_info[pinfo.number] = info
+            return info
+        end
+
+        if s.last then
+            info.ifg = (ts - s.last) * 1000
+        end
+        s.last = ts
+        s.frames = s.frames + 1
+        if seqno ~= nil then
+            if s.seen[seqno] then
+                info.retry = true
+            else
+                s.seen[seqno] = true
+                if s.nextseq and seqno > s.nextseq then
+                    info.gap = seqno - s.nextseq
+                end
+                if s.nextseq == nil or seqno >= s.nextseq then
+                    s.nextseq = seqno + 1
+                end
+            end
+        else
+            local mseq = field_value(f_wpan_seq)
+            if mseq ~= nil and s.macseq ~= nil then
+                local d = (mseq - s.macseq) % 256
+                if d == 0 then
+                    info.retry = true
+                elseif d > 1 and d < 128 then
+                    info.gap = d - 1
+                end
+            end
+            s.macseq = mseq
+        end
+        if info.retry then
+            s.retries = s.retries + 1
+        else
+            s.bytes = s.bytes + nbytes
+        end
+        if ts > s.start then
+            info.goodput = s.bytes / (ts - s.start)
+        end
+        info.ratio = s.retries / s.frames
+        info.bytes = s.bytes
+        info.frames = s.frames
+        frame_info[pinfo.number] = info
+        return info
+    end
+
+    local function add_session_info(tree, info, item)
+        if info == nil then
+            return ""
+        end
+        if info.ifg then
+            tree:add(p2p.fields.f_ifg, info.ifg):set_generated()
+        end
+        if info.goodput then
+            tree:add(p2p.fields.f_goodput, info.goodput):set_generated()
+        end
+        tree:add(p2p.fields.f_sbytes, info.bytes):set_generated()
+        tree:add(p2p.fields.f_sframes, info.frames):set_generated()
+        if info.ratio then
+            tree:add(p2p.fields.f_retrans, info.ratio):set_generated()
+        end
+        if info.gap then
+            tree:add_tvb_expert_info(p2p.experts.seq_gap, item,
+                                     string.format("%u data frames missing", info.gap))
+            return string.format(" [GAP %u]", info.gap)
+        elseif info.retry then
+            tree:add_tvb_expert_info(p2p.experts.seq_retry, item)
+            return " [RETRY]"
+        end
+        return ""
     end
 
     function dissect_ping_cnf (buffer, pinfo, tree)
@@ -101,11 +297,108 @@
         return buffer:len()
     end
 
+    function dissect_ping_short_req(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_nslots, buffer(0, 1))
+        return 1, string.format("%u slots", buffer(0, 1):uint())
+    end
+
+    function dissect_ping_short_cnf(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_flags, buffer(0, 1))
+        tree:add(p2p.fields.f_version, buffer(1, 1))
+        tree:add_le(p2p.fields.f_crc, buffer(2, 2))
+        return 4, string.format("flags=0x%02x crc=0x%04x",
+                                buffer(0, 1):uint(), buffer(2, 2):le_uint())
+    end
+
+    function dissect_frag(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_fragcmd, buffer(0, 1))
+        tree:add(p2p.fields.f_msgid, buffer(1, 1))
+        tree:add(p2p.fields.f_fragidx, buffer(2, 1))
+        tree:add(p2p.fields.f_fragcnt, buffer(3, 1))
+        tree:add(p2p.fields.f_data, buffer(4))
+        return buffer:len(), string.format("msg %u %u/%u",
+                buffer(1, 1):uint(), buffer(2, 1):uint() + 1, buffer(3, 1):uint())
+    end
+
+    function dissect_mesh_route(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_orig, buffer(0, 2))
+        tree:add_le(p2p.fields.f_target, buffer(2, 2))
+        tree:add(p2p.fields.f_rseq, buffer(4, 1))
+        tree:add(p2p.fields.f_hops, buffer(5, 1))
+        return 6, string.format("0x%04x -> 0x%04x hops=%u",
+                buffer(0, 2):le_uint(), buffer(2, 2):le_uint(), buffer(5, 1):uint())
+    end
+
+    function dissect_mesh_data(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_orig, buffer(0, 2))
+        tree:add_le(p2p.fields.f_final, buffer(2, 2))
+        tree:add(p2p.fields.f_ttl, buffer(4, 1))
+        -- the plain frame, from its command code on
+        local inner = tree:add(p2p, buffer(5), "Forwarded P2P frame")
+        local ok, msg = dissect_payload(buffer(5):tvb(), pinfo, inner)
+        return buffer:len(), string.format("0x%04x -> 0x%04x ttl=%u: %s",
+                buffer(0, 2):le_uint(), buffer(2, 2):le_uint(),
+                buffer(4, 1):uint(), msg or "?")
+    end
+
+    function dissect_phy_set(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_profile, buffer(0, 1))
+        tree:add(p2p.fields.f_flags, buffer(1, 1))
+        return 2, string.format("profile %u", buffer(0, 1):uint())
+    end
+
+    function dissect_phy_stats_req(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_clear, buffer(0, 1))
+        return 1
+    end
+
+    function dissect_phy_stats_cnf(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_profile, buffer(0, 1))
+        tree:add(p2p.fields.f_stored, buffer(1, 1))
+        tree:add_le(p2p.fields.f_received, buffer(2, 2))
+        tree:add_le(p2p.fields.f_bytes, buffer(4, 4))
+        return 8, string.format("%u frames", buffer(2, 2):le_uint())
+    end
+
+    function dissect_phy_test(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_seqno, buffer(0, 2))
+        return buffer:len(), string.format("#%u", buffer(0, 2):le_uint())
+    end
+
     function dissect_wibo_data(buffer, pinfo, tree)
         local size = buffer(0, 1)
         tree:add_le(p2p.fields.f_dsize, size)
         tree:add(p2p.fields.f_data, buffer(1, size:uint()))
-        return 1 + size:uint(), string.format("%u bytes", size:uint())
+        local info = track_session(pinfo, "data", nil, size:uint())
+        return 1 + size:uint(), string.format("%u bytes", size:uint()) ..
+               add_session_info(tree, info, size)
+    end
+
+    function dissect_wibo_data_seq(buffer, pinfo, tree)
+        local seqno = buffer(0, 2)
+        local size = buffer(2, 1)
+        tree:add_le(p2p.fields.f_seqno, seqno)
+        tree:add_le(p2p.fields.f_dsize, size)
+        tree:add(p2p.fields.f_data, buffer(3, size:uint()))
+        local info = track_session(pinfo, "data", seqno:le_uint(), size:uint())
+        return 3 + size:uint(), string.format("#%u %u bytes",
+                seqno:le_uint(), size:uint()) .. add_session_info(tree, info, seqno)
+    end
+
+    function dissect_wibo_window_cnf(buffer, pinfo, tree)
+        local rcvd = buffer(2, 2):le_uint()
+        local missing = 0
+        for i = 0, 15 do
+            if math.floor(rcvd / 2 ^ i) % 2 == 0 then
+                missing = missing + 1
+            end
+        end
+        tree:add_le(p2p.fields.f_wbase, buffer(0, 2))
+        tree:add_le(p2p.fields.f_wreceived, buffer(2, 2))
+        tree:add(p2p.fields.f_wmissing, missing):set_generated()
+        tree:add_le(p2p.fields.f_crc, buffer(4, 2))
+        return 6, string.format("base=%u received=0x%04x",
+                buffer(0, 2):le_uint(), rcvd)
     end
 
     function dissect_wibo_target(buffer, pinfo, tree)
@@ -117,10 +410,74 @@
     function dissect_wibo_addr(buffer, pinfo, tree)
         local addr = buffer(0, 4)
         tree:add_le(p2p.fields.f_addr, addr)
-        return 4, string.format("0x%08x", addr:uint())
+        return 4, string.format("0x%08x", addr:le_uint())
+    end
+
+    function dissect_wibo_reset(buffer, pinfo, tree)
+        track_session(pinfo, "reset")
+        return 0
+    end
+
+    function dissect_wibo_finish(buffer, pinfo, tree)
+        local info = track_session(pinfo, "end")
+        tree:add(p2p.fields.f_sbytes, info.bytes):set_generated()
+        tree:add(p2p.fields.f_sframes, info.frames):set_generated()
+        return 0, string.format("after %u bytes", info.bytes)
+    end
+
+    function dissect_wibo_rate(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_rate, buffer(0, 1))
+        return 1, string.format("0x%02x", buffer(0, 1):uint())
+    end
+
+    function dissect_wibo_zmode(buffer, pinfo, tree)
+        local mode = buffer(0, 1):uint()
+        tree:add(p2p.fields.f_zmode, buffer(0, 1))
+        tree:add_le(p2p.fields.f_baselen, buffer(1, 4))
+        tree:add_le(p2p.fields.f_basecrc, buffer(5, 2))
+        return 7, zmode_table[mode]
     end
 
-    function dissect_xmpl_led(buffer, pinfo, subtree)
+    function dissect_wibo_erase(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_addr, buffer(0, 4))
+        tree:add_le(p2p.fields.f_npages, buffer(4, 2))
+        return 6, string.format("0x%08x %u pages",
+                buffer(0, 4):le_uint(), buffer(4, 2):le_uint())
+    end
+
+    function dissect_wibo_discover(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_nslots, buffer(0, 1))
+        tree:add(p2p.fields.f_round, buffer(1, 1))
+        return 2, string.format("%u slots", buffer(0, 1):uint())
+    end
+
+    function dissect_wibo_resume(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_page, buffer(0, 2))
+        tree:add_le(p2p.fields.f_crc, buffer(2, 2))
+        return 4, string.format("page 0x%04x", buffer(0, 2):le_uint())
+    end
+
+    function dissect_wibo_commit(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_len, buffer(0, 4))
+        tree:add_le(p2p.fields.f_crc, buffer(4, 2))
+        tree:add(p2p.fields.f_mac, buffer(6, 16))
+        return 22, string.format("%u bytes crc=0x%04x",
+                buffer(0, 4):le_uint(), buffer(4, 2):le_uint())
+    end
+
+    function dissect_wibo_relay(buffer, pinfo, tree)
+        tree:add_le(p2p.fields.f_target, buffer(0, 2))
+        tree:add_le(p2p.fields.f_len, buffer(2, 4))
+        tree:add_le(p2p.fields.f_crc, buffer(6, 2))
+        return 8, string.format("to 0x%04x", buffer(0, 2):le_uint())
+    end
+
+    function dissect_wibo_channel(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_channel, buffer(0, 1))
+        return 1, string.format("%u", buffer(0, 1):uint())
+    end
+
+    function dissect_xmpl_led(buffer, pinfo, tree)
         tree:add(p2p.fields.f_led, buffer(0, 1))
         tree:add(p2p.fields.f_state, buffer(1, 1))
         return 1 + 1
@@ -132,51 +489,133 @@
         return buffer:len()
     end
 
-    -- The main dissector function
-    function real_dissector (buffer, pinfo, subtree)
+    function dissect_sensor_caption(buffer, pinfo, tree)
+        tree:add(p2p.fields.f_caption, buffer())
+        return buffer:len(), buffer():stringz()
+    end
+
+    -- varint of a sensor batch row, returns value and next offset
+    local function batch_varint(buffer, pos)
+        local v, shift = 0, 0
+        while true do
+            local b = buffer(pos, 1):uint()
+            pos = pos + 1
+            v = v + (b % 128) * 2 ^ shift
+            shift = shift + 7
+            if b < 128 then
+                return math.floor(v), pos
+            end
+        end
+    end
+
+    -- see sensor_batch.h and sniffer/sensorbatch.py
+    function dissect_sensor_batch(buffer, pinfo, tree)
+        local nchan = buffer(0, 1):uint()
+        local pos, rows, t = 1, 0, 0
+        local last = {}
+        tree:add(p2p.fields.f_nchan, buffer(0, 1))
+        for i = 1, nchan do
+            last[i] = 0
+        end
+        while pos < buffer:len() do
+            local start, dt, z = pos
+            dt, pos = batch_varint(buffer, pos)
+            t = (rows == 0) and dt or (t + dt) % 65536
+            for i = 1, nchan do
+                z, pos = batch_varint(buffer, pos)
+                local d = (z % 2 == 0) and math.floor(z / 2) or -math.floor((z + 1) / 2)
+                last[i] = (last[i] + d + 32768) % 65536 - 32768
+            end
+            tree:add(p2p.fields.f_row, buffer(start, pos - start),
+                     string.format("t=%u %s", t, table.concat(last, " ")))
+            rows = rows + 1
+        end
+        tree:add(p2p.fields.f_rows, rows):set_generated()
+        return buffer:len(), string.format("%u channels, %u rows", nchan, rows)
+    end
+
+    local dissect_table = {
+        ["P2P_PING_CNF"] = dissect_ping_cnf,
+        ["P2P_FRAG"] = dissect_frag,
+        ["P2P_MESH_RREQ"] = dissect_mesh_route,
+        ["P2P_MESH_RREP"] = dissect_mesh_route,
+        ["P2P_MESH_DATA"] = dissect_mesh_data,
+        ["P2P_PING_SHORT_REQ"] = dissect_ping_short_req,
+        ["P2P_PING_SHORT_CNF"] = dissect_ping_short_cnf,
+        ["P2P_PHY_SET"] = dissect_phy_set,
+        ["P2P_PHY_STATS_REQ"] = dissect_phy_stats_req,
+        ["P2P_PHY_STATS_CNF"] = dissect_phy_stats_cnf,
+        ["P2P_PHY_TEST"] = dissect_phy_test,
+        ["P2P_WIBO_DATA"] = dissect_wibo_data,
+        ["P2P_WIBO_FINISH"] = dissect_wibo_finish,
+        ["P2P_WIBO_RESET"] = dissect_wibo_reset,
+        ["P2P_WIBO_TARGET"] = dissect_wibo_target,
+        ["P2P_WIBO_ADDR"] = dissect_wibo_addr,
+        ["P2P_WIBO_DATA_SEQ"] = dissect_wibo_data_seq,
+        ["P2P_WIBO_WINDOW_CNF"] = dissect_wibo_window_cnf,
+        ["P2P_WIBO_RATE"] = dissect_wibo_rate,
+        ["P2P_WIBO_ZMODE"] = dissect_wibo_zmode,
+        ["P2P_WIBO_ERASE"] = dissect_wibo_erase,
+        ["P2P_WIBO_DISCOVER"] = dissect_wibo_discover,
+        ["P2P_WIBO_RESUME"] = dissect_wibo_resume,
+        ["P2P_WIBO_COMMIT"] = dissect_wibo_commit,
+        ["P2P_WIBO_RELAY"] = dissect_wibo_relay,
+        ["P2P_WIBO_CHANNEL"] = dissect_wibo_channel,
+        ["P2P_XMPL_LED"] = dissect_xmpl_led,
+        ["P2P_WUART_DATA"] = dissect_wuart_data,
+        ["P2P_SENSOR_CAPTION"] = dissect_sensor_caption,
+        ["P2P_SENSOR_BATCH"] = dissect_sensor_batch,
+    }
+
+    -- Decode a frame from its command code on, returns the validity
+    -- and the info text
+    function dissect_payload(buffer, pinfo, subtree)
         local cmd = buffer(0,1)
         subtree:add(p2p.fields.f_cmd, cmd)
 
-        cmdname = cmd_table[cmd:uint()]
+        local cmdname = cmd_table[cmd:uint()]
         if (not cmdname) then
             subtree:add_tvb_expert_info(p2p.experts.unknown_cmd, cmd)
             return false
         end
+        if (cmdname == "P2P_WIBO_COMMIT" and buffer:len() == 3) then
+            cmdname = "P2P_XMPL_LED"
+        end
 
         -- Skip 1 byte of p2p command
-        subbuf = buffer(1):tvb()
+        local subbuf = buffer(1):tvb()
 
         if (subbuf:len() > 0) then
             subtree:add(p2p.fields.f_rawdata, subbuf())
         end
 
         -- decode frame internals
-        if (cmdname == "P2P_PING_CNF") then
-            len, msg = dissect_ping_cnf(subbuf, pinfo, subtree)
-        elseif (cmdname == "P2P_WIBO_DATA") then
-            len, msg = dissect_wibo_data(subbuf, pinfo, subtree)
-        elseif (cmdname == "P2P_WIBO_TARGET") then
-            len, msg = dissect_wibo_target(subbuf, pinfo, subtree)
-        elseif (cmdname == "P2P_WIBO_ADDR") then
-            len, msg = dissect_wibo_addr(subbuf, pinfo, subtree)
-        elseif (cmdname == "P2P_XMPL_LED") then
-            len, msg = dissect_xmpl_led(subbuf, pinfo, subtree)
-        elseif (cmdname == "P2P_WUART_DATA") then
-            len, msg = dissect_wuart_data(subbuf, pinfo, subtree)
-        else
-            len = 0
-            msg = nil
+        local len, msg = 0, nil
+        local fn = dissect_table[cmdname]
+        if fn then
+            len, msg = fn(subbuf, pinfo, subtree)
+        elseif (cmdname == "P2P_SENSOR_DATA") then
+            len = subbuf:len()
         end
 
         if subbuf:len() ~= len then
             subtree:add_tvb_expert_info(p2p.experts.too_long, subbuf(len))
             return false
         end
+        return true, string.format("%s %s", cmdname, msg or "")
+    end
+
+    -- The main dissector function
+    function real_dissector (buffer, pinfo, subtree)
+        local ok, msg = dissect_payload(buffer, pinfo, subtree)
+        if not ok then
+            return false
+        end
 
         -- Only set the protocol info last, so we only set it for
         -- packets that look valid.
         pinfo.cols.protocol = "P2P"
-        pinfo.cols.info = string.format("%s %s", cmdname, msg or "")
+        pinfo.cols.info = msg
 
         return true
     end
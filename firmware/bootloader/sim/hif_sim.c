@@ -0,0 +1,108 @@
+/*
+ * hif_sim.c
+ *
+ * Host interface of uracoli (hif.h) on the UART of the simulated node,
+ * replaces hif_uart.c in the plugins. The ring sizes are the ones of
+ * board_cfg.h, the bytes take their time at the baud rate of hif_init().
+ * Scatter/gather transmissions are written out right away, the done
+ * function runs before hif_put_sg() returns.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "board.h"
+#include "ioutil.h"
+
+void hif_init(const uint32_t baudrate)
+{
+	sim_uart_init(baudrate, UART_RXBUFSIZE, UART_TXBUFSIZE);
+}
+
+int hif_putc(int c)
+{
+	return (sim_uart_putc((uint8_t) c) < 0) ? EOF : c;
+}
+
+void hif_puts_p(const char *progmem_s)
+{
+	char c;
+
+	while ((c = pgm_read_byte(progmem_s++)))
+	{
+		while (hif_putc(c) != c)
+			;
+	}
+}
+
+void hif_puts(const char *s)
+{
+	while (*s)
+	{
+		while (hif_putc(*s) != *s)
+			;
+		s++;
+	}
+}
+
+hif_blk_t hif_put_blk(unsigned char *data, hif_blk_t size)
+{
+	hif_blk_t i;
+
+	for (i = 0; i < size; i++)
+	{
+		if (hif_putc(data[i]) == EOF)
+		{
+			break;
+		}
+	}
+	return i;
+}
+
+uint8_t hif_put_sg(const hif_iov_t *iov, uint8_t iovcnt,
+		hif_sg_done_t *done, void *ctx)
+{
+	uint16_t i;
+
+	for (; iovcnt; iovcnt--, iov++)
+	{
+		for (i = 0; i < iov->len; i++)
+		{
+			while (hif_putc(iov->data[i]) != iov->data[i])
+				;
+		}
+	}
+	if (done != NULL)
+	{
+		done(ctx);
+	}
+	return 1;
+}
+
+uint8_t hif_put_sg_busy(void)
+{
+	return 0;
+}
+
+int hif_getc(void)
+{
+	int c = sim_uart_getc();
+
+	return (c < 0) ? EOF : c;
+}
+
+hif_blk_t hif_get_blk(unsigned char *data, hif_blk_t max_size)
+{
+	hif_blk_t i;
+	int c;
+
+	for (i = 0; i < max_size; i++)
+	{
+		if ((c = sim_uart_getc()) < 0)
+		{
+			break;
+		}
+		data[i] = c;
+	}
+	return i;
+}
@@ -0,0 +1,36 @@
+/*
+ * avr/boot.h
+ *
+ * Stand-in for avr-libc in the host simulation, SPM on the flash of the
+ * node, see sim_spm(). The command codes are the SPMCSR values.
+ */
+
+#ifndef SIM_AVR_BOOT_H_
+#define SIM_AVR_BOOT_H_
+
+#include <stddef.h>
+#include <avr/io.h>
+
+#define __BOOT_PAGE_FILL   (0x01)
+#define __BOOT_PAGE_ERASE  (0x03)
+#define __BOOT_PAGE_WRITE  (0x05)
+#define __BOOT_RWW_ENABLE  (0x11)
+#define __BOOT_LOCK_BITS_SET (0x09)
+
+#define boot_spm_busy()      sim_spm_busy()
+#define boot_spm_busy_wait() sim_spm_wait()
+#define boot_rww_busy()      (0)
+
+#define boot_page_fill(a, w) do { \
+	uint16_t w_ = (w); \
+	sim_spm((a), __BOOT_PAGE_FILL, (const uint8_t *) &w_, 2); \
+} while (0)
+#define boot_page_erase(a)   sim_spm((a), __BOOT_PAGE_ERASE, NULL, 0)
+#define boot_page_write(a)   sim_spm((a), __BOOT_PAGE_WRITE, NULL, 0)
+#define boot_rww_enable()    sim_spm(0, __BOOT_RWW_ENABLE, NULL, 0)
+#define boot_page_fill_safe(a, w) boot_page_fill(a, w)
+#define boot_page_erase_safe(a)   do { boot_spm_busy_wait(); boot_page_erase(a); } while (0)
+#define boot_page_write_safe(a)   do { boot_spm_busy_wait(); boot_page_write(a); } while (0)
+#define boot_rww_enable_safe()    do { boot_spm_busy_wait(); boot_rww_enable(); } while (0)
+
+#endif /* SIM_AVR_BOOT_H_ */
@@ -0,0 +1,106 @@
+/*
+ * avr/eeprom.h
+ *
+ * Stand-in for avr-libc in the host simulation, on the EEPROM of the
+ * node. The addresses are EEPROM offsets as on the AVR, a byte written
+ * takes SIM_EE_NS, the update functions skip the unchanged bytes.
+ */
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sim.h"
+
+#define EEMEM
+#define eeprom_busy_wait() do {} while (0)
+#define eeprom_is_ready()  (1)
+
+#define SIM_EE_ADDR(p) ((uint16_t) (uintptr_t) (p))
+
+static inline uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	return sim_ee_read(SIM_EE_ADDR(p));
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		((uint8_t *) dst)[i] = sim_ee_read(SIM_EE_ADDR(src) + i);
+	}
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t *p)
+{
+	uint16_t v;
+
+	eeprom_read_block(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t eeprom_read_dword(const uint32_t *p)
+{
+	uint32_t v;
+
+	eeprom_read_block(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void eeprom_write_byte(uint8_t *p, uint8_t v)
+{
+	sim_ee_write(SIM_EE_ADDR(p), v);
+}
+
+static inline void eeprom_update_byte(uint8_t *p, uint8_t v)
+{
+	if (sim_ee_read(SIM_EE_ADDR(p)) != v)
+	{
+		sim_ee_write(SIM_EE_ADDR(p), v);
+	}
+}
+
+static inline void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		sim_ee_write(SIM_EE_ADDR(dst) + i, ((const uint8_t *) src)[i]);
+	}
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+	{
+		eeprom_update_byte((uint8_t *) dst + i, ((const uint8_t *) src)[i]);
+	}
+}
+
+static inline void eeprom_write_word(uint16_t *p, uint16_t v)
+{
+	eeprom_write_block(&v, p, sizeof(v));
+}
+
+static inline void eeprom_update_word(uint16_t *p, uint16_t v)
+{
+	eeprom_update_block(&v, p, sizeof(v));
+}
+
+static inline void eeprom_write_dword(uint32_t *p, uint32_t v)
+{
+	eeprom_write_block(&v, p, sizeof(v));
+}
+
+static inline void eeprom_update_dword(uint32_t *p, uint32_t v)
+{
+	eeprom_update_block(&v, p, sizeof(v));
+}
+
+#endif /* SIM_AVR_EEPROM_H_ */
@@ -0,0 +1,26 @@
+/*
+ * avr/interrupt.h
+ *
+ * Stand-in for avr-libc in the host simulation. cli() clears the I bit
+ * of the node's SREG, sei() sets it and runs the pending interrupts.
+ * ISR(v) defines sim_isr_<v>, the simulation looks the handlers up by
+ * that name, SIM_TRX_vect and SIM_TIMER_vect are known (board_sim.h).
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+#define cli() do { SREG &= ~0x80; } while (0)
+#define sei() sim_sei()
+
+#define SIM_ISR_(v) void sim_isr_##v(void); void sim_isr_##v(void)
+#define ISR(v, ...) SIM_ISR_(v)
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define EMPTY_INTERRUPT(v) SIM_ISR_(v) {}
+#define reti() return
+
+#endif /* SIM_AVR_INTERRUPT_H_ */
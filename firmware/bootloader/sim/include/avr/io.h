@@ -0,0 +1,128 @@
+/*
+ * avr/io.h
+ *
+ * Stand-in for avr-libc in the host simulation. The I/O registers are
+ * the io[] array of the node that runs (sim_io()), at the data space
+ * addresses of the ATmega256RFR2, so they keep their values per node
+ * but have no function. The peripherals the plugins use are reached
+ * through board_sim.h instead.
+ */
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+#include "sim.h"
+
+#define _BV(bit) (1 << (bit))
+#define _SFR_MEM8(a)  (sim_io()[(a)])
+#define _SFR_MEM16(a) (*(uint16_t *) &sim_io()[(a)])
+#define _SFR_IO8(a)   _SFR_MEM8((a) + 0x20)
+#define _SFR_IO16(a)  _SFR_MEM16((a) + 0x20)
+
+#define bit_is_set(sfr, bit)   ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit)   do { sim_poll(SIM_NEVER); } while (bit_is_clear(sfr, bit))
+#define loop_until_bit_is_clear(sfr, bit) do { sim_poll(SIM_NEVER); } while (bit_is_set(sfr, bit))
+
+#define SPM_PAGESIZE (SIM_PAGESIZE)
+#define FLASHEND     (SIM_FLASH_SIZE - 1)
+#define RAMSTART     (0x200)
+#define RAMEND       (0x7FFF)
+#define E2END        (SIM_EEPROM_SIZE - 1)
+#define E2PAGESIZE   (8)
+
+/* CPU */
+#define SREG    _SFR_MEM8(SIM_SREG)
+#define SP      _SFR_MEM16(0x5D)
+#define SPL     _SFR_MEM8(0x5D)
+#define SPH     _SFR_MEM8(0x5E)
+#define RAMPZ   _SFR_MEM8(0x5B)
+#define MCUCR   _SFR_MEM8(0x55)
+#define IVSEL   1
+#define IVCE    0
+#define MCUSR   _SFR_MEM8(0x54)
+#define PORF    0
+#define EXTRF   1
+#define BORF    2
+#define WDRF    3
+#define JTRF    4
+#define SMCR    _SFR_MEM8(0x53)
+#define SPMCSR  _SFR_MEM8(0x57)
+#define GPIOR0  _SFR_MEM8(0x3E)
+#define GPIOR1  _SFR_MEM8(0x4A)
+#define GPIOR2  _SFR_MEM8(0x4B)
+#define WDTCSR  _SFR_MEM8(0x60)
+#define CLKPR   _SFR_MEM8(0x61)
+#define PRR0    _SFR_MEM8(0x64)
+#define PRR1    _SFR_MEM8(0x65)
+#define OSCCAL  _SFR_MEM8(0x66)
+
+/* ports */
+#define PINA    _SFR_MEM8(0x20)
+#define DDRA    _SFR_MEM8(0x21)
+#define PORTA   _SFR_MEM8(0x22)
+#define PINB    _SFR_MEM8(0x23)
+#define DDRB    _SFR_MEM8(0x24)
+#define PORTB   _SFR_MEM8(0x25)
+#define PINC    _SFR_MEM8(0x26)
+#define DDRC    _SFR_MEM8(0x27)
+#define PORTC   _SFR_MEM8(0x28)
+#define PIND    _SFR_MEM8(0x29)
+#define DDRD    _SFR_MEM8(0x2A)
+#define PORTD   _SFR_MEM8(0x2B)
+#define PINE    _SFR_MEM8(0x2C)
+#define DDRE    _SFR_MEM8(0x2D)
+#define PORTE   _SFR_MEM8(0x2E)
+#define PINF    _SFR_MEM8(0x2F)
+#define DDRF    _SFR_MEM8(0x30)
+#define PORTF   _SFR_MEM8(0x31)
+#define PING    _SFR_MEM8(0x32)
+#define DDRG    _SFR_MEM8(0x33)
+#define PORTG   _SFR_MEM8(0x34)
+
+/* external interrupts */
+#define EIFR    _SFR_MEM8(0x3C)
+#define EIMSK   _SFR_MEM8(0x3D)
+#define EICRA   _SFR_MEM8(0x69)
+#define EICRB   _SFR_MEM8(0x6A)
+
+/* SPI */
+#define SPCR    _SFR_MEM8(0x4C)
+#define SPSR    _SFR_MEM8(0x4D)
+#define SPDR    _SFR_MEM8(0x4E)
+#define SPR0    0
+#define SPR1    1
+#define MSTR    4
+#define SPE     6
+#define SPI2X   0
+#define SPIF    7
+
+/* EEPROM */
+#define EECR    _SFR_MEM8(0x3F)
+#define EEDR    _SFR_MEM8(0x40)
+#define EEAR    _SFR_MEM16(0x41)
+
+/* timer 1 */
+#define TCCR1A  _SFR_MEM8(0x80)
+#define TCCR1B  _SFR_MEM8(0x81)
+#define TCNT1   _SFR_MEM16(0x84)
+#define OCR1A   _SFR_MEM16(0x88)
+#define TIMSK1  _SFR_MEM8(0x6F)
+#define TIFR1   _SFR_MEM8(0x36)
+#define CS10    0
+#define TOIE1   0
+
+/* UART 0 and 1 */
+#define UCSR0A  _SFR_MEM8(0xC0)
+#define UCSR0B  _SFR_MEM8(0xC1)
+#define UCSR0C  _SFR_MEM8(0xC2)
+#define UBRR0   _SFR_MEM16(0xC4)
+#define UDR0    _SFR_MEM8(0xC6)
+#define UCSR1A  _SFR_MEM8(0xC8)
+#define UCSR1B  _SFR_MEM8(0xC9)
+#define UCSR1C  _SFR_MEM8(0xCA)
+#define UBRR1   _SFR_MEM16(0xCC)
+#define UDR1    _SFR_MEM8(0xCE)
+
+#endif /* SIM_AVR_IO_H_ */
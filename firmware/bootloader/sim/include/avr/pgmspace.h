@@ -0,0 +1,53 @@
+/*
+ * avr/pgmspace.h
+ *
+ * Stand-in for avr-libc in the host simulation. Constants in PROGMEM
+ * stay in the host memory of the plugin, the near reads dereference the
+ * pointer. The far reads take a flash byte address and read the flash
+ * of the node, as pgm_read_byte_far() does on the AVR.
+ */
+
+#ifndef SIM_AVR_PGMSPACE_H_
+#define SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include "sim.h"
+
+#define PROGMEM
+#define PGM_P const char *
+#define PGM_VOID_P const void *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(p)  (*(const uint8_t *) (p))
+#define pgm_read_word(p)  (*(const uint16_t *) (p))
+#define pgm_read_dword(p) (*(const uint32_t *) (p))
+#define pgm_read_ptr(p)   (*(void * const *) (p))
+#define pgm_read_byte_near(p) pgm_read_byte(p)
+#define pgm_read_word_near(p) pgm_read_word(p)
+
+#define pgm_read_byte_far(a)  sim_flash_byte(a)
+#define pgm_read_word_far(a)  (sim_flash_byte(a) | (sim_flash_byte((a) + 1) << 8))
+#define pgm_read_dword_far(a) ((uint32_t) pgm_read_word_far(a) \
+		| ((uint32_t) pgm_read_word_far((a) + 2) << 16))
+
+#define memcpy_P    memcpy
+#define memcmp_P    memcmp
+#define strlen_P    strlen
+#define strcpy_P    strcpy
+#define strncpy_P   strncpy
+#define strcmp_P    strcmp
+#define strncmp_P   strncmp
+#define strcasecmp_P strcasecmp
+#define strncasecmp_P strncasecmp
+#define strstr_P    strstr
+#define printf_P    printf
+#define sprintf_P   sprintf
+#define snprintf_P  snprintf
+#define vsnprintf_P vsnprintf
+#define fputs_P     fputs
+
+#endif /* SIM_AVR_PGMSPACE_H_ */
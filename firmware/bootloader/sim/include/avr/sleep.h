@@ -0,0 +1,26 @@
+/*
+ * avr/sleep.h
+ *
+ * Stand-in for avr-libc in the host simulation, sleeping parks the node
+ * until an interrupt is pending.
+ */
+
+#ifndef SIM_AVR_SLEEP_H_
+#define SIM_AVR_SLEEP_H_
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE      (0)
+#define SLEEP_MODE_ADC       (2)
+#define SLEEP_MODE_PWR_DOWN  (4)
+#define SLEEP_MODE_PWR_SAVE  (6)
+#define SLEEP_MODE_STANDBY   (12)
+#define SLEEP_MODE_EXT_STANDBY (14)
+
+#define set_sleep_mode(m) do { SMCR = (m); } while (0)
+#define sleep_enable()    do { SMCR |= 1; } while (0)
+#define sleep_disable()   do { SMCR &= ~1; } while (0)
+#define sleep_cpu()       sim_sleep()
+#define sleep_mode()      sim_sleep()
+
+#endif /* SIM_AVR_SLEEP_H_ */
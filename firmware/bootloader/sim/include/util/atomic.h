@@ -0,0 +1,68 @@
+/*
+ * util/atomic.h
+ *
+ * Stand-in for avr-libc in the host simulation, on the I bit of the
+ * node's SREG, as the avr-libc macros.
+ */
+
+#ifndef SIM_UTIL_ATOMIC_H_
+#define SIM_UTIL_ATOMIC_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+static inline uint8_t sim_atomic_cli(void)
+{
+	uint8_t s = SREG;
+
+	cli();
+	return s;
+}
+
+static inline void sim_atomic_restore(const uint8_t *s)
+{
+	if (*s & 0x80)
+	{
+		sei();
+	}
+	else
+	{
+		cli();
+	}
+}
+
+static inline void sim_atomic_on(const uint8_t *s)
+{
+	(void) s;
+	sei();
+}
+
+static inline void sim_atomic_off(const uint8_t *s)
+{
+	(void) s;
+	cli();
+}
+
+static inline uint8_t sim_atomic_sei(void)
+{
+	uint8_t s = SREG;
+
+	sei();
+	return s;
+}
+
+#define ATOMIC_BLOCK(type) \
+	for (type, sim_atomic_once_ = 1; sim_atomic_once_; sim_atomic_once_ = 0)
+#define ATOMIC_RESTORESTATE \
+	uint8_t sreg_save_ __attribute__((__cleanup__(sim_atomic_restore))) = sim_atomic_cli()
+#define ATOMIC_FORCEON \
+	uint8_t sreg_save_ __attribute__((__cleanup__(sim_atomic_on))) = sim_atomic_cli()
+
+#define NONATOMIC_BLOCK(type) \
+	for (type, sim_atomic_once_ = 1; sim_atomic_once_; sim_atomic_once_ = 0)
+#define NONATOMIC_RESTORESTATE \
+	uint8_t sreg_save_ __attribute__((__cleanup__(sim_atomic_restore))) = sim_atomic_sei()
+#define NONATOMIC_FORCEOFF \
+	uint8_t sreg_save_ __attribute__((__cleanup__(sim_atomic_off))) = sim_atomic_sei()
+
+#endif /* SIM_UTIL_ATOMIC_H_ */
@@ -0,0 +1,57 @@
+/*
+ * util/crc16.h
+ *
+ * Stand-in for avr-libc in the host simulation, the C versions of the
+ * documentation of avr-libc.
+ */
+
+#ifndef SIM_UTIL_CRC16_H_
+#define SIM_UTIL_CRC16_H_
+
+#include <stdint.h>
+
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+	int i;
+
+	crc ^= a;
+	for (i = 0; i < 8; ++i)
+	{
+		crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_xmodem_update(uint16_t crc, uint8_t data)
+{
+	int i;
+
+	crc = crc ^ ((uint16_t) data << 8);
+	for (i = 0; i < 8; i++)
+	{
+		crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4)
+			^ ((uint16_t) data << 3));
+}
+
+static inline uint8_t _crc_ibutton_update(uint8_t crc, uint8_t data)
+{
+	uint8_t i;
+
+	crc = crc ^ data;
+	for (i = 0; i < 8; i++)
+	{
+		crc = (crc & 0x01) ? (crc >> 1) ^ 0x8C : crc >> 1;
+	}
+	return crc;
+}
+
+#endif /* SIM_UTIL_CRC16_H_ */
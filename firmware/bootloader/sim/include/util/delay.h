@@ -0,0 +1,16 @@
+/*
+ * util/delay.h
+ *
+ * Stand-in for avr-libc in the host simulation, the delays take their
+ * time on the virtual clock of the node.
+ */
+
+#ifndef SIM_UTIL_DELAY_H_
+#define SIM_UTIL_DELAY_H_
+
+#include "sim.h"
+
+#define _delay_ms(ms) sim_delay((sim_time_t) ((ms) * 1.0e6))
+#define _delay_us(us) sim_delay((sim_time_t) ((us) * 1.0e3))
+
+#endif /* SIM_UTIL_DELAY_H_ */
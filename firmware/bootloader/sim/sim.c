@@ -0,0 +1,1078 @@
+/*
+ * sim.c
+ *
+ * Scheduler, memories, UART and timer of the simulated nodes, see sim.h
+ *
+ * There are two heaps. The event heap has the state changes: radio
+ * events of trx_sim.c, timer ticks. The resume heap has the nodes that
+ * wait for their local clock to come. Both are run in the order of
+ * time, events first.
+ *
+ * A running node is not switched out at each cost, it runs ahead of
+ * the global time until its clock passes the next event or sim_t plus
+ * SIM_LOOKAHEAD. Nothing it can see changes before that: the next event
+ * is the next state change, and what another node does at sim_t or
+ * later reaches it over the air at the end of the SHR (160us) at the
+ * earliest. So the result is the same as with a switch at every step.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sim_int.h"
+
+#define NODE_STACK (256 * 1024)
+
+typedef struct
+{
+	sim_time_t t;
+	uint64_t seq;
+	sim_evfunc_t fn;
+	sim_node_t *n;
+	uint32_t gen;
+	uintptr_t arg;
+} sim_ev_t;
+
+typedef struct
+{
+	sim_time_t t;
+	uint64_t seq;
+	sim_node_t *n;
+	uint32_t rseq;
+} sim_res_t;
+
+sim_node_t *sim_cur;
+sim_node_t *sim_nodes[SIM_NODES_MAX];
+int sim_nnodes;
+sim_time_t sim_t;
+sim_time_t sim_latency_max;	// largest link latency, trx_sim.c keeps the frames that long
+
+static ucontext_t sched_ctx;
+static uint64_t seqno;
+static uint32_t seed;
+static char tmpdir[64];
+static sim_linkcfg_t link_default = { -1, 0.0, 0.0, 0 };
+
+static struct
+{
+	sim_ev_t *v;
+	size_t len, cap;
+} evq;
+
+static struct
+{
+	sim_res_t *v;
+	size_t len, cap;
+} resq;
+
+/* === heaps ============================================================== */
+
+#define HEAP_LESS(a, b) ((a).t < (b).t || ((a).t == (b).t && (a).seq < (b).seq))
+
+#define HEAP_PUSH(h, e) do { \
+	size_t i_, p_; \
+	if ((h).len == (h).cap) \
+	{ \
+		(h).cap = (h).cap ? 2 * (h).cap : 256; \
+		(h).v = realloc((h).v, (h).cap * sizeof(*(h).v)); \
+	} \
+	i_ = (h).len++; \
+	while (i_ > 0) \
+	{ \
+		p_ = (i_ - 1) / 2; \
+		if (!HEAP_LESS((e), (h).v[p_])) break; \
+		(h).v[i_] = (h).v[p_]; \
+		i_ = p_; \
+	} \
+	(h).v[i_] = (e); \
+} while (0)
+
+#define HEAP_POP(h) do { \
+	size_t i_ = 0, c_; \
+	(h).len--; \
+	while ((c_ = 2 * i_ + 1) < (h).len) \
+	{ \
+		if (c_ + 1 < (h).len && HEAP_LESS((h).v[c_ + 1], (h).v[c_])) c_++; \
+		if (!HEAP_LESS((h).v[c_], (h).v[(h).len])) break; \
+		(h).v[i_] = (h).v[c_]; \
+		i_ = c_; \
+	} \
+	(h).v[i_] = (h).v[(h).len]; \
+} while (0)
+
+void sim_event(sim_time_t t, sim_evfunc_t fn, sim_node_t *n, uintptr_t arg)
+{
+	sim_ev_t e = { t, seqno++, fn, n, n ? n->gen : 0, arg };
+
+	HEAP_PUSH(evq, e);
+}
+
+static void node_resume_at(sim_node_t *n, sim_time_t t)
+{
+	sim_res_t r = { t, seqno++, n, ++n->rseq };
+
+	HEAP_PUSH(resq, r);
+}
+
+/* === byte queues ======================================================== */
+
+static void bytes_put(sim_bytes_t *q, sim_time_t t, uint8_t c)
+{
+	if (q->head - q->tail == q->size)
+	{
+		uint32_t i, n = q->size ? 2 * q->size : 256;
+		sim_byte_t *b = malloc(n * sizeof(*b));
+
+		for (i = q->tail; i != q->head; i++)
+		{
+			b[i & (n - 1)] = q->b[i & (q->size - 1)];
+		}
+		free(q->b);
+		q->b = b;
+		q->size = n;
+	}
+	q->b[q->head++ & (q->size - 1)] = (sim_byte_t) { t, c };
+}
+
+static inline uint32_t bytes_len(const sim_bytes_t *q)
+{
+	return q->head - q->tail;
+}
+
+static inline sim_byte_t *bytes_first(const sim_bytes_t *q)
+{
+	return &q->b[q->tail & (q->size - 1)];
+}
+
+static void bytes_free(sim_bytes_t *q)
+{
+	free(q->b);
+	memset(q, 0, sizeof(*q));
+}
+
+/* === random numbers ===================================================== */
+
+uint32_t sim_random(sim_node_t *n)
+{
+	n->rnd ^= n->rnd >> 12;
+	n->rnd ^= n->rnd << 25;
+	n->rnd ^= n->rnd >> 27;
+	return (uint32_t) ((n->rnd * 2685821657736338717ULL) >> 32);
+}
+
+double sim_uniform(sim_node_t *n)
+{
+	return sim_random(n) / 4294967296.0;
+}
+
+/* === node side ========================================================== */
+
+static void node_switch(void)
+{
+	swapcontext(&sim_cur->ctx, &sched_ctx);
+}
+
+static sim_time_t node_limit(void)
+{
+	sim_time_t l = sim_t + SIM_LOOKAHEAD;
+
+	if (evq.len && evq.v[0].t < l)
+	{
+		l = evq.v[0].t;
+	}
+	return l;
+}
+
+static inline uint8_t node_irq_ready(const sim_node_t *n)
+{
+	return (n->io[SIM_SREG] & 0x80) && (n->pend & n->en);
+}
+
+static void node_dispatch(sim_node_t *n)
+{
+	uint8_t irq;
+
+	while (node_irq_ready(n))
+	{
+		for (irq = 0; !((n->pend & n->en) & (1 << irq)); irq++)
+			;
+		n->pend &= ~(1 << irq);
+		if (n->isr[irq] != NULL)
+		{
+			n->io[SIM_SREG] &= ~0x80;
+			n->isr[irq]();
+			n->io[SIM_SREG] |= 0x80;
+		}
+	}
+}
+
+/*
+ * \brief Give the CPU to the scheduler
+ *
+ * @param st NODE_READY: resume at the local clock, NODE_WAIT or
+ *           NODE_PARKED: at wake at the latest
+ */
+static void node_yield(uint8_t st, sim_time_t wake)
+{
+	sim_node_t *n = sim_cur;
+
+	n->st = st;
+	n->wake = wake;
+	if (NODE_READY == st)
+	{
+		node_resume_at(n, n->t);
+	}
+	else if (SIM_NEVER != wake)
+	{
+		node_resume_at(n, wake);
+	}
+	else
+	{
+		n->rseq++;
+	}
+	node_switch();
+}
+
+static void node_entry(void)
+{
+	sim_node_t *n = sim_cur;
+
+	n->main();
+	if (SIM_NODE_APP != n->info.state)
+	{
+		n->info.state = SIM_NODE_HALT;
+	}
+	n->st = NODE_HALTED;
+	n->rseq++;
+	for (;;)
+	{
+		node_switch();
+	}
+}
+
+uint8_t *sim_io(void)
+{
+	return sim_cur->io;
+}
+
+void sim_active(void)
+{
+	sim_cur->polls = 0;
+	sim_cur->poll_until = SIM_NEVER;
+}
+
+void sim_cost(sim_time_t ns)
+{
+	sim_node_t *n = sim_cur;
+
+	n->t += ns;
+	if (n->t > node_limit())
+	{
+		node_yield(NODE_READY, 0);
+	}
+	node_dispatch(n);
+}
+
+void sim_delay(sim_time_t ns)
+{
+	sim_node_t *n = sim_cur;
+	sim_time_t deadline = n->t + ns, left;
+
+	sim_active();
+	if (deadline <= node_limit())
+	{
+		n->t = deadline;
+		node_dispatch(n);
+		return;
+	}
+	while (n->t < deadline)
+	{
+		node_yield(NODE_WAIT, deadline);
+		if (n->t < deadline)
+		{
+			/* woken for an interrupt, the delay loop stands still */
+			left = deadline - n->t;
+			node_dispatch(n);
+			deadline = n->t + left;
+		}
+	}
+	node_dispatch(n);
+}
+
+void sim_poll(sim_time_t until)
+{
+	sim_node_t *n = sim_cur;
+	sim_time_t wake;
+
+	n->t += SIM_LOOP_NS;
+	if (until < n->poll_until)
+	{
+		n->poll_until = until;
+	}
+	if (++n->polls < SIM_POLL_PARK)
+	{
+		if (n->t > node_limit())
+		{
+			node_yield(NODE_READY, 0);
+		}
+		node_dispatch(n);
+		return;
+	}
+	wake = n->poll_until;
+	sim_active();
+	if (wake > n->t)
+	{
+		node_yield(NODE_PARKED, wake);
+	}
+	node_dispatch(n);
+}
+
+void sim_sleep(void)
+{
+	sim_node_t *n = sim_cur;
+	/* the UART has no interrupt here, its next byte wakes the node as
+	 * the RX interrupt would */
+	sim_time_t wake = (n->baud && bytes_len(&n->urx)) ?
+			bytes_first(&n->urx)->t : SIM_NEVER;
+
+	sim_active();
+	if (!node_irq_ready(sim_cur))
+	{
+		node_yield(NODE_PARKED, wake);
+	}
+	node_dispatch(sim_cur);
+}
+
+void sim_sei(void)
+{
+	sim_cur->io[SIM_SREG] |= 0x80;
+	node_dispatch(sim_cur);
+}
+
+void sim_irq_enable(uint8_t irq, uint8_t on)
+{
+	if (on)
+	{
+		sim_cur->en |= 1 << irq;
+		node_dispatch(sim_cur);
+	}
+	else
+	{
+		sim_cur->en &= ~(1 << irq);
+	}
+}
+
+void sim_halt(void)
+{
+	sim_cur->st = NODE_HALTED;
+	sim_cur->rseq++;
+	for (;;)
+	{
+		node_switch();
+	}
+}
+
+/*
+ * \brief Something changed for the node, called from the events
+ *
+ * A parked node polls again, a waiting one only if it can take an
+ * interrupt now.
+ */
+void sim_wake(sim_node_t *n)
+{
+	sim_time_t t = n->t > sim_t ? n->t : sim_t;
+
+	if ((NODE_PARKED == n->st || (NODE_WAIT == n->st && node_irq_ready(n)))
+			&& t < n->wake)
+	{
+		n->wake = t;
+		node_resume_at(n, t);
+	}
+}
+
+static void node_wake_at(sim_node_t *n, sim_time_t t)
+{
+	if (NODE_PARKED == n->st && t < n->wake)
+	{
+		if (t < n->t)
+		{
+			t = n->t;
+		}
+		n->wake = t;
+		node_resume_at(n, t);
+	}
+}
+
+void sim_raise(sim_node_t *n, uint8_t irq)
+{
+	n->pend |= 1 << irq;
+	sim_wake(n);
+}
+
+/* === flash and EEPROM =================================================== */
+
+uint8_t sim_flash_byte(uint32_t addr)
+{
+	return sim_cur->flash[addr % SIM_FLASH_SIZE];
+}
+
+uint8_t sim_spm_busy(void)
+{
+	sim_node_t *n = sim_cur;
+
+	if (n->t < n->spm_busy)
+	{
+		sim_poll(n->spm_busy);
+		return 1;
+	}
+	return 0;
+}
+
+void sim_spm_wait(void)
+{
+	if (sim_cur->t < sim_cur->spm_busy)
+	{
+		sim_delay(sim_cur->spm_busy - sim_cur->t);
+	}
+}
+
+/*
+ * \brief SPM instruction, cmd as the value of SPMCSR
+ *
+ * The page buffer is filled with buf (size bytes at addr), an erase or
+ * write starts SIM_SPM_NS of busy time. The flash content changes at
+ * once, a read of the page while busy gives the new data.
+ */
+void sim_spm(uint32_t addr, uint8_t cmd, const uint8_t *buf, uint16_t size)
+{
+	sim_node_t *n = sim_cur;
+	uint32_t page = (addr % SIM_FLASH_SIZE) & ~(uint32_t) (SIM_PAGESIZE - 1);
+	uint16_t i, o = addr & (SIM_PAGESIZE - 1);
+
+	sim_active();
+	switch (cmd)
+	{
+	case 0x01: /* page fill */
+		for (i = 0; i < size && o + i < SIM_PAGESIZE; i++)
+		{
+			n->pagebuf[o + i] = buf[i];
+		}
+		sim_cost(size * 125);
+		break;
+	case 0x03: /* page erase */
+		sim_spm_wait();
+		memset(n->flash + page, 0xFF, SIM_PAGESIZE);
+		n->spm_busy = n->t + SIM_SPM_NS;
+		break;
+	case 0x05: /* page write */
+		sim_spm_wait();
+		for (i = 0; i < SIM_PAGESIZE; i++)
+		{
+			n->flash[page + i] &= n->pagebuf[i];
+		}
+		memset(n->pagebuf, 0xFF, SIM_PAGESIZE);
+		n->spm_busy = n->t + SIM_SPM_NS;
+		n->info.spm_pages++;
+		break;
+	default: /* RWW enable, lock bits */
+		sim_spm_wait();
+		break;
+	}
+}
+
+uint8_t sim_ee_read(uint16_t addr)
+{
+	sim_cost(SIM_SPI_NS);
+	return sim_cur->eeprom[addr % SIM_EEPROM_SIZE];
+}
+
+void sim_ee_write(uint16_t addr, uint8_t val)
+{
+	sim_cur->eeprom[addr % SIM_EEPROM_SIZE] = val;
+	sim_delay(SIM_EE_NS);
+}
+
+/* === UART =============================================================== */
+
+void sim_uart_init(uint32_t baud, uint16_t rxsize, uint16_t txsize)
+{
+	sim_node_t *n = sim_cur;
+
+	n->baud = baud;
+	n->byte_ns = 10000000000ULL / baud;
+	n->urx_cap = rxsize - 1;
+	n->utx_cap = txsize - 1;
+}
+
+/* move the bytes that came in up to the local clock into the ring */
+static void uart_rx_move(sim_node_t *n)
+{
+	sim_byte_t *b;
+
+	while (bytes_len(&n->urx) && (b = bytes_first(&n->urx))->t <= n->t)
+	{
+		if (bytes_len(&n->uring) < n->urx_cap)
+		{
+			bytes_put(&n->uring, b->t, b->c);
+		}
+		else
+		{
+			n->info.uart_ovf++;
+		}
+		n->urx.tail++;
+	}
+}
+
+int sim_uart_getc(void)
+{
+	sim_node_t *n = sim_cur;
+	uint8_t c;
+
+	if (0 == n->baud)
+	{
+		return -1;
+	}
+	uart_rx_move(n);
+	if (0 == bytes_len(&n->uring))
+	{
+		sim_poll(bytes_len(&n->urx) ? bytes_first(&n->urx)->t : SIM_NEVER);
+		return -1;
+	}
+	c = bytes_first(&n->uring)->c;
+	n->uring.tail++;
+	sim_active();
+	sim_cost(SIM_LOOP_NS);
+	return c;
+}
+
+uint16_t sim_uart_txfree(void)
+{
+	sim_node_t *n = sim_cur;
+	uint32_t inflight = 0;
+
+	if (n->utx_last > n->t)
+	{
+		inflight = (n->utx_last - n->t + n->byte_ns - 1) / n->byte_ns;
+	}
+	return inflight < n->utx_cap ? n->utx_cap - inflight : 0;
+}
+
+int sim_uart_putc(uint8_t c)
+{
+	sim_node_t *n = sim_cur;
+	sim_time_t t;
+
+	if (0 == n->baud)
+	{
+		return -1;
+	}
+	if (0 == sim_uart_txfree())
+	{
+		/* wait for the oldest byte in the ring to go out */
+		sim_poll(n->utx_last - (uint64_t) n->utx_cap * n->byte_ns);
+		return -1;
+	}
+	t = (n->utx_last > n->t ? n->utx_last : n->t) + n->byte_ns;
+	n->utx_last = t;
+	bytes_put(&n->utx, t, c);
+	n->info.uart_tx++;
+	sim_active();
+	sim_cost(SIM_LOOP_NS);
+	return c;
+}
+
+/* === timer ============================================================== */
+
+static void timer_tick(sim_node_t *n, uintptr_t arg)
+{
+	n->tick_last = sim_t;
+	n->tick_count = 0;
+	sim_event(sim_t + n->tick, timer_tick, n, 0);
+	sim_raise(n, SIM_IRQ_TIMER);
+}
+
+void sim_timer_init(sim_time_t period)
+{
+	sim_node_t *n = sim_cur;
+
+	if (0 == n->tick)
+	{
+		sim_event(n->t + period, timer_tick, n, 0);
+	}
+	n->tick = period;
+	n->tick_last = n->t;
+	n->en |= 1 << SIM_IRQ_TIMER;
+}
+
+/* hardware counter in us since the last tick */
+uint16_t *sim_timer_count(void)
+{
+	sim_node_t *n = sim_cur;
+
+	n->tick_count = (n->t - n->tick_last) / SIM_US;
+	return &n->tick_count;
+}
+
+/* === node config and state ============================================== */
+
+void sim_node_cfg(uint8_t *channel, uint16_t *pan_id, uint16_t *short_addr,
+		uint64_t *ieee_addr)
+{
+	*channel = sim_cur->channel;
+	*pan_id = sim_cur->pan_id;
+	*short_addr = sim_cur->short_addr;
+	*ieee_addr = sim_cur->ieee_addr;
+}
+
+void sim_app_start(void)
+{
+	sim_cur->info.state = SIM_NODE_APP;
+	sim_cur->info.app_starts++;
+	sim_cur->info.t_app = sim_cur->t;
+}
+
+/* === links ============================================================== */
+
+const sim_linkcfg_t *sim_link_get(const sim_node_t *from, const sim_node_t *to)
+{
+	int i;
+
+	for (i = 0; i < from->nlinks; i++)
+	{
+		if (from->links[i].to == to->id)
+		{
+			return &from->links[i];
+		}
+	}
+	return &link_default;
+}
+
+void sim_link_default(double loss, double ber, uint32_t latency_us)
+{
+	link_default.loss = loss;
+	link_default.ber = ber;
+	link_default.latency = latency_us * SIM_US;
+	if (link_default.latency > sim_latency_max)
+	{
+		sim_latency_max = link_default.latency;
+	}
+}
+
+/*
+ * \brief Link from one node to another, the default for the rest
+ *
+ * @param loss Probability that a frame is not received at all, 1.0:
+ *             out of range, the frames don't collide at the receiver
+ * @param ber Bit error rate on the link, the frame is received with
+ *            a bad CRC
+ */
+void sim_link(int from, int to, double loss, double ber, uint32_t latency_us)
+{
+	sim_node_t *n = sim_nodes[from];
+	sim_linkcfg_t *l = NULL;
+	int i;
+
+	for (i = 0; i < n->nlinks; i++)
+	{
+		if (n->links[i].to == to)
+		{
+			l = &n->links[i];
+		}
+	}
+	if (l == NULL)
+	{
+		n->links = realloc(n->links, (n->nlinks + 1) * sizeof(*l));
+		l = &n->links[n->nlinks++];
+	}
+	*l = (sim_linkcfg_t) { to, loss, ber, latency_us * SIM_US };
+	if (l->latency > sim_latency_max)
+	{
+		sim_latency_max = l->latency;
+	}
+}
+
+/* === SIM_API ============================================================ */
+
+void sim_init(uint32_t s)
+{
+	Dl_info self;
+	char path[sizeof(tmpdir) + 16];
+
+	sim_exit();
+	seed = s;
+	sim_t = 0;
+	sim_latency_max = 0;
+	seqno = 0;
+	link_default = (sim_linkcfg_t) { -1, 0.0, 0.0, 0 };
+	snprintf(tmpdir, sizeof(tmpdir), "/tmp/wibosim.XXXXXX");
+	if (mkdtemp(tmpdir) == NULL)
+	{
+		perror("mkdtemp");
+		exit(1);
+	}
+	/* the plugin copies find this library through their $ORIGIN */
+	if (dladdr((void *) sim_init, &self) && self.dli_fname != NULL)
+	{
+		snprintf(path, sizeof(path), "%s/libwibosim.so", tmpdir);
+		if (symlink(self.dli_fname, path) < 0)
+		{
+			perror("symlink");
+		}
+	}
+}
+
+static void node_unload(sim_node_t *n)
+{
+	if (n->so != NULL)
+	{
+		dlclose(n->so);
+		n->so = NULL;
+	}
+}
+
+void sim_exit(void)
+{
+	int i;
+
+	for (i = 0; i < sim_nnodes; i++)
+	{
+		sim_node_t *n = sim_nodes[i];
+
+		node_unload(n);
+		unlink(n->copy);
+		munmap(n->stack, NODE_STACK);
+		trx_sim_free(n);
+		bytes_free(&n->urx);
+		bytes_free(&n->uring);
+		bytes_free(&n->utx);
+		free(n->links);
+		free(n->flash);
+		free(n->eeprom);
+		free(n);
+		sim_nodes[i] = NULL;
+	}
+	sim_nnodes = 0;
+	evq.len = resq.len = 0;
+	trx_sim_exit();
+	if (tmpdir[0])
+	{
+		char path[sizeof(tmpdir) + 16];
+
+		snprintf(path, sizeof(path), "%s/libwibosim.so", tmpdir);
+		unlink(path);
+		rmdir(tmpdir);
+		tmpdir[0] = 0;
+	}
+}
+
+static int copy_file(const char *from, const char *to)
+{
+	char buf[65536];
+	int in, out;
+	ssize_t len;
+
+	in = open(from, O_RDONLY);
+	if (in < 0)
+	{
+		return -1;
+	}
+	out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0700);
+	if (out < 0)
+	{
+		close(in);
+		return -1;
+	}
+	while ((len = read(in, buf, sizeof(buf))) > 0)
+	{
+		if (write(out, buf, len) != len)
+		{
+			len = -1;
+			break;
+		}
+	}
+	close(in);
+	close(out);
+	return len < 0 ? -1 : 0;
+}
+
+/* load the plugin copy of the node and set it up to run main() from sim_t */
+static int node_load(sim_node_t *n)
+{
+	n->so = dlopen(n->copy, RTLD_NOW | RTLD_LOCAL);
+	if (n->so == NULL)
+	{
+		fprintf(stderr, "sim: %s\n", dlerror());
+		return -1;
+	}
+	n->main = (int (*)(void)) dlsym(n->so, "main");
+	n->isr[SIM_IRQ_TRX] = (void (*)(void)) dlsym(n->so, "sim_isr_SIM_TRX_vect");
+	n->isr[SIM_IRQ_TIMER] = (void (*)(void)) dlsym(n->so, "sim_isr_SIM_TIMER_vect");
+	if (n->main == NULL)
+	{
+		fprintf(stderr, "sim: no main() in %s\n", n->plugin);
+		return -1;
+	}
+	memset(n->io, 0, sizeof(n->io));
+	memset(n->pagebuf, 0xFF, sizeof(n->pagebuf));
+	n->pend = n->en = 0;
+	n->spm_busy = 0;
+	n->baud = 0;
+	n->urx.tail = n->urx.head;
+	n->uring.tail = n->uring.head;
+	n->utx.tail = n->utx.head;
+	n->urx_last = n->utx_last = 0;
+	n->tick = 0;
+	n->polls = 0;
+	n->poll_until = SIM_NEVER;
+	n->gen++;
+	n->t = sim_t;
+	n->info.state = SIM_NODE_BOOT;
+	trx_sim_reset(n);
+
+	getcontext(&n->ctx);
+	n->ctx.uc_stack.ss_sp = n->stack;
+	n->ctx.uc_stack.ss_size = NODE_STACK;
+	n->ctx.uc_link = NULL;
+	makecontext(&n->ctx, node_entry, 0);
+	n->st = NODE_READY;
+	node_resume_at(n, sim_t);
+	return 0;
+}
+
+/*
+ * \brief Add a node running the plugin
+ *
+ * @return The node id, -1 on error
+ */
+int sim_node_add(const char *plugin, uint8_t channel, uint16_t pan_id,
+		uint16_t short_addr, uint64_t ieee_addr)
+{
+	sim_node_t *n;
+
+	if (sim_nnodes == SIM_NODES_MAX || !tmpdir[0])
+	{
+		return -1;
+	}
+	n = calloc(1, sizeof(*n));
+	n->id = sim_nnodes;
+	snprintf(n->plugin, sizeof(n->plugin), "%s", plugin);
+	snprintf(n->copy, sizeof(n->copy), "%s/node%d.so", tmpdir, n->id);
+	if (copy_file(plugin, n->copy) < 0)
+	{
+		fprintf(stderr, "sim: can't copy %s\n", plugin);
+		free(n);
+		return -1;
+	}
+	n->stack = mmap(NULL, NODE_STACK, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	n->flash = malloc(SIM_FLASH_SIZE);
+	memset(n->flash, 0xFF, SIM_FLASH_SIZE);
+	n->eeprom = malloc(SIM_EEPROM_SIZE);
+	memset(n->eeprom, 0xFF, SIM_EEPROM_SIZE);
+	n->channel = channel;
+	n->pan_id = pan_id;
+	n->short_addr = short_addr;
+	n->ieee_addr = ieee_addr;
+	n->rnd = (seed + 1) * 0x9E3779B97F4A7C15ULL ^ (n->id + 1) * 0xBF58476D1CE4E5B9ULL;
+	sim_nodes[sim_nnodes++] = n;
+	if (node_load(n) < 0)
+	{
+		sim_nnodes--;
+		return -1;
+	}
+	return n->id;
+}
+
+/* power cycle: fresh globals and registers, flash and EEPROM stay */
+int sim_node_reset(int id)
+{
+	sim_node_t *n = sim_nodes[id];
+
+	node_unload(n);
+	n->info.resets++;
+	return node_load(n);
+}
+
+sim_time_t sim_now(void)
+{
+	return sim_t;
+}
+
+/*
+ * \brief Run all nodes up to the time until
+ *
+ * @return The global time, until
+ */
+sim_time_t sim_run(sim_time_t until)
+{
+	sim_node_t *n;
+
+	for (;;)
+	{
+		sim_time_t te = evq.len ? evq.v[0].t : SIM_NEVER;
+		sim_time_t tr = resq.len ? resq.v[0].t : SIM_NEVER;
+
+		if (te <= tr)
+		{
+			sim_ev_t e;
+
+			if (te > until)
+			{
+				break;
+			}
+			e = evq.v[0];
+			HEAP_POP(evq);
+			if (e.n != NULL && e.gen != e.n->gen)
+			{
+				continue;
+			}
+			sim_t = e.t;
+			e.fn(e.n, e.arg);
+		}
+		else
+		{
+			sim_res_t r;
+
+			if (tr > until)
+			{
+				break;
+			}
+			r = resq.v[0];
+			HEAP_POP(resq);
+			n = r.n;
+			if (r.rseq != n->rseq || NODE_HALTED == n->st)
+			{
+				continue;
+			}
+			sim_t = r.t;
+			if (n->t < r.t)
+			{
+				n->t = r.t;
+			}
+			n->st = NODE_RUN;
+			n->rseq++;
+			sim_cur = n;
+			swapcontext(&sched_ctx, &n->ctx);
+			sim_cur = NULL;
+		}
+	}
+	if (sim_t < until)
+	{
+		sim_t = until;
+	}
+	return sim_t;
+}
+
+/*
+ * \brief Bytes from the harness to the UART of a node, they come in at
+ *        the baud rate of the node from sim_now() or after the ones
+ *        before
+ */
+uint16_t sim_uart_write(int id, const uint8_t *data, uint16_t len)
+{
+	sim_node_t *n = sim_nodes[id];
+	sim_time_t t, first = SIM_NEVER;
+	uint16_t i;
+
+	if (0 == n->baud)
+	{
+		return 0;
+	}
+	t = n->urx_last > sim_t ? n->urx_last : sim_t;
+	for (i = 0; i < len; i++)
+	{
+		t += n->byte_ns;
+		if (SIM_NEVER == first)
+		{
+			first = t;
+		}
+		bytes_put(&n->urx, t, data[i]);
+	}
+	n->urx_last = t;
+	n->info.uart_rx += len;
+	if (len)
+	{
+		node_wake_at(n, first);
+	}
+	return len;
+}
+
+/* bytes sent by the node up to sim_now() */
+uint16_t sim_uart_read(int id, uint8_t *data, uint16_t len)
+{
+	sim_node_t *n = sim_nodes[id];
+	uint16_t i = 0;
+
+	while (i < len && bytes_len(&n->utx) && bytes_first(&n->utx)->t <= sim_t)
+	{
+		data[i++] = bytes_first(&n->utx)->c;
+		n->utx.tail++;
+	}
+	return i;
+}
+
+uint16_t sim_uart_pending(int id)
+{
+	sim_node_t *n = sim_nodes[id];
+	uint32_t i, cnt = 0;
+
+	for (i = n->utx.tail; i != n->utx.head; i++)
+	{
+		if (n->utx.b[i & (n->utx.size - 1)].t > sim_t)
+		{
+			break;
+		}
+		cnt++;
+	}
+	return cnt > 0xFFFF ? 0xFFFF : cnt;
+}
+
+void sim_flash_load(int id, uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	if (addr < SIM_FLASH_SIZE && len <= SIM_FLASH_SIZE - addr)
+	{
+		memcpy(sim_nodes[id]->flash + addr, data, len);
+	}
+}
+
+void sim_flash_dump(int id, uint32_t addr, uint8_t *data, uint32_t len)
+{
+	if (addr < SIM_FLASH_SIZE && len <= SIM_FLASH_SIZE - addr)
+	{
+		memcpy(data, sim_nodes[id]->flash + addr, len);
+	}
+}
+
+void sim_eeprom_load(int id, uint16_t addr, const uint8_t *data, uint16_t len)
+{
+	if (addr < SIM_EEPROM_SIZE && len <= SIM_EEPROM_SIZE - addr)
+	{
+		memcpy(sim_nodes[id]->eeprom + addr, data, len);
+	}
+}
+
+void sim_eeprom_dump(int id, uint16_t addr, uint8_t *data, uint16_t len)
+{
+	if (addr < SIM_EEPROM_SIZE && len <= SIM_EEPROM_SIZE - addr)
+	{
+		memcpy(data, sim_nodes[id]->eeprom + addr, len);
+	}
+}
+
+void sim_node_info(int id, sim_node_info_t *info)
+{
+	*info = sim_nodes[id]->info;
+}
+
+/* ns the medium was busy on any channel, overlaps counted once */
+uint64_t sim_airtime(void)
+{
+	return trx_sim_airtime();
+}
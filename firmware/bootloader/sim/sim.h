@@ -0,0 +1,142 @@
+/*
+ * sim.h
+ *
+ * Host simulation of WIBO nodes and hosts, see the bootloader README.md
+ *
+ * Many virtual nodes run in one process. Every node is a copy of a
+ * plugin (node.so with the bootloader's wibo.c, host.so with wibohost)
+ * of its own, so each has its own globals, and runs as a coroutine on a
+ * virtual clock. The plugins are the unchanged AVR sources, built
+ * against the stand-in headers of include/ and the board "sim"
+ * (board_sim.h): register, flash and EEPROM accesses go to the node's
+ * own arrays here, the SPI bus of the RF23x access functions of
+ * libradio goes to a register-level AT86RF231 model (trx_sim.c) on a
+ * shared medium with per-link loss, bit errors and latency, and the
+ * data rates of the radio.
+ *
+ * Time only passes where the AVR would spend it: delays, SPI bytes, SPM
+ * and EEPROM writes, UART bytes and the SIM_LOOP_NS of a poll that found
+ * nothing. A node that polls without success SIM_POLL_PARK times in a
+ * row is parked until something changes for it (a radio event, a UART
+ * byte, its timer tick), so idle nodes cost nothing.
+ *
+ * The functions below SIM_API are the interface of libwibosim.so for
+ * wibosim.py (ctypes), the rest is used by the stand-in headers and the
+ * sim sources of the plugins.
+ */
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+
+/* virtual time in ns */
+typedef uint64_t sim_time_t;
+
+#define SIM_NEVER       (~(sim_time_t) 0)
+#define SIM_US          (1000ULL)
+#define SIM_MS          (1000000ULL)
+
+#define SIM_NODES_MAX   (1024)
+#define SIM_FLASH_SIZE  (0x40000UL)	// ATmega256RFR2
+#define SIM_PAGESIZE    (256)
+#define SIM_EEPROM_SIZE (8192)
+#define SIM_IO_SIZE     (0x200)
+
+#define SIM_SPM_NS      (4100 * SIM_US)	// page erase or page write
+#define SIM_EE_NS       (3400 * SIM_US)	// one EEPROM byte
+#define SIM_SPI_NS      (1 * SIM_US)	// 8 bit at 8 MHz, SPI_RATE_1_2
+#define SIM_LOOP_NS     (2 * SIM_US)	// a poll that found nothing
+#define SIM_POLL_PARK   (8)
+#define SIM_LOOKAHEAD   (128 * SIM_US)	// below the SHR, see sim.c
+#define SIM_SREG        (0x5F)	// io[] address of SREG
+
+/* node interrupts, sim_irq_enable(), the plugins name the handlers
+ * with ISR(SIM_TRX_vect) and ISR(SIM_TIMER_vect)
+ */
+#define SIM_IRQ_TRX     (0)
+#define SIM_IRQ_TIMER   (1)
+#define SIM_NIRQS       (2)
+
+/* sim_node_info_t.state */
+#define SIM_NODE_BOOT   (0)	// in main(), before sim_app_start()
+#define SIM_NODE_APP    (1)	// the bootloader started the application
+#define SIM_NODE_HALT   (2)	// main() returned before sim_app_start(), sim_halt()
+
+/* === plugin side ======================================================== */
+uint8_t *sim_io(void);
+void sim_cost(sim_time_t ns);
+void sim_delay(sim_time_t ns);
+void sim_poll(sim_time_t until);
+void sim_sleep(void);
+void sim_sei(void);
+void sim_irq_enable(uint8_t irq, uint8_t on);
+void sim_halt(void);
+
+uint8_t sim_flash_byte(uint32_t addr);
+void sim_spm(uint32_t addr, uint8_t cmd, const uint8_t *buf, uint16_t size);
+uint8_t sim_spm_busy(void);
+void sim_spm_wait(void);
+uint8_t sim_ee_read(uint16_t addr);
+void sim_ee_write(uint16_t addr, uint8_t val);
+
+void sim_spi_select(uint8_t on);
+uint8_t sim_spi_xfer(uint8_t mosi);
+void sim_trx_pin(uint8_t slptr, uint8_t reset);
+
+void sim_uart_init(uint32_t baud, uint16_t rxsize, uint16_t txsize);
+int sim_uart_getc(void);
+int sim_uart_putc(uint8_t c);
+uint16_t sim_uart_txfree(void);
+
+void sim_timer_init(sim_time_t period);
+uint16_t *sim_timer_count(void);
+
+void sim_node_cfg(uint8_t *channel, uint16_t *pan_id, uint16_t *short_addr,
+		uint64_t *ieee_addr);
+void sim_app_start(void);
+
+/* === SIM_API, libwibosim.so for wibosim.py ============================= */
+typedef struct
+{
+	uint32_t tx_frames;	// frames sent, ACKs and retries included
+	uint32_t tx_acks;
+	uint32_t tx_retries;	// ARET frame retries
+	uint32_t tx_ccafail;	// ARET channel access failures
+	uint32_t tx_noack;
+	uint64_t tx_airtime;	// ns on air, ACKs included
+	uint32_t rx_frames;	// frames handed to the node, TRX_END
+	uint32_t rx_lost;	// dropped by the link loss
+	uint32_t rx_crcfail;	// bit errors or collisions
+	uint32_t rx_collided;
+	uint32_t rx_missed;	// not listening, busy or buffer protected
+	uint32_t uart_rx;	// bytes to the node
+	uint32_t uart_tx;	// bytes from the node
+	uint32_t uart_ovf;	// bytes dropped at a full ring
+	uint32_t spm_pages;	// page writes
+	uint32_t resets;
+	uint32_t app_starts;
+	uint8_t state;		// SIM_NODE_*
+	uint64_t t_app;		// virtual time of the last sim_app_start()
+} sim_node_info_t;
+
+void sim_init(uint32_t seed);
+void sim_exit(void);
+int sim_node_add(const char *plugin, uint8_t channel, uint16_t pan_id,
+		uint16_t short_addr, uint64_t ieee_addr);
+int sim_node_reset(int id);
+void sim_link(int from, int to, double loss, double ber, uint32_t latency_us);
+void sim_link_default(double loss, double ber, uint32_t latency_us);
+sim_time_t sim_now(void);
+sim_time_t sim_run(sim_time_t until);
+uint16_t sim_uart_write(int id, const uint8_t *data, uint16_t len);
+uint16_t sim_uart_read(int id, uint8_t *data, uint16_t len);
+uint16_t sim_uart_pending(int id);
+void sim_flash_load(int id, uint32_t addr, const uint8_t *data, uint32_t len);
+void sim_flash_dump(int id, uint32_t addr, uint8_t *data, uint32_t len);
+void sim_eeprom_load(int id, uint16_t addr, const uint8_t *data, uint16_t len);
+void sim_eeprom_dump(int id, uint16_t addr, uint8_t *data, uint16_t len);
+void sim_node_info(int id, sim_node_info_t *info);
+uint64_t sim_airtime(void);
+
+#endif /* SIM_H_ */
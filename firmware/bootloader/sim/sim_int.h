@@ -0,0 +1,126 @@
+/*
+ * sim_int.h
+ *
+ * Node and event types shared by the scheduler (sim.c) and the
+ * transceiver model (trx_sim.c) of libwibosim.so, not seen by the
+ * plugins.
+ */
+
+#ifndef SIM_INT_H_
+#define SIM_INT_H_
+
+#include <stdint.h>
+#include <ucontext.h>
+
+#include "sim.h"
+
+/* scheduler state of a node */
+#define NODE_READY  (0)	// resumes at its resume time
+#define NODE_WAIT   (1)	// delay, woken early for a dispatchable interrupt
+#define NODE_PARKED (2)	// poll found nothing, woken by any event of the node
+#define NODE_HALTED (3)
+#define NODE_RUN    (4)
+
+/* one byte on the UART, usable at t */
+typedef struct
+{
+	sim_time_t t;
+	uint8_t c;
+} sim_byte_t;
+
+typedef struct
+{
+	sim_byte_t *b;
+	uint32_t head, tail, size;	// size is a power of 2
+} sim_bytes_t;
+
+/* per-link parameters, see sim_link() */
+typedef struct
+{
+	int to;
+	double loss;
+	double ber;
+	sim_time_t latency;
+} sim_linkcfg_t;
+
+struct sim_trx;
+
+typedef struct sim_node
+{
+	int id;
+	char plugin[256];
+	char copy[256];
+	void *so;
+	int (*main)(void);
+	void (*isr[SIM_NIRQS])(void);
+
+	ucontext_t ctx;
+	void *stack;
+	uint8_t st;
+	sim_time_t t;		// local clock
+	sim_time_t wake;	// deadline of NODE_WAIT and NODE_PARKED
+	uint32_t rseq;		// current entry in the resume heap
+	uint32_t gen;		// resets, events of an older one are dropped
+	uint8_t polls;
+	sim_time_t poll_until;
+
+	uint8_t io[SIM_IO_SIZE];
+	uint8_t pend;		// interrupt flags
+	uint8_t en;		// interrupt enables
+
+	uint8_t *flash;
+	uint8_t pagebuf[SIM_PAGESIZE];
+	sim_time_t spm_busy;
+	uint8_t *eeprom;
+
+	uint32_t baud;
+	sim_time_t byte_ns;
+	sim_bytes_t urx;	// sent by the harness, not yet in the ring
+	sim_bytes_t uring;	// the hif ring
+	uint16_t urx_cap;
+	sim_time_t urx_last;
+	sim_bytes_t utx;	// sent by the node, t = end of the stop bit
+	uint16_t utx_cap;
+	sim_time_t utx_last;
+
+	sim_time_t tick;	// timer period, 0: no timer
+	sim_time_t tick_last;
+	uint16_t tick_count;
+
+	uint8_t channel;
+	uint16_t pan_id;
+	uint16_t short_addr;
+	uint64_t ieee_addr;
+
+	sim_linkcfg_t *links;	// overrides of the default link, as sender
+	int nlinks;
+
+	uint64_t rnd;		// xorshift state
+	struct sim_trx *trx;
+	sim_node_info_t info;
+} sim_node_t;
+
+typedef void (*sim_evfunc_t)(sim_node_t *n, uintptr_t arg);
+
+/* sim.c */
+extern sim_node_t *sim_cur;
+extern sim_node_t *sim_nodes[SIM_NODES_MAX];
+extern int sim_nnodes;
+extern sim_time_t sim_t;
+extern sim_time_t sim_latency_max;
+
+void sim_event(sim_time_t t, sim_evfunc_t fn, sim_node_t *n, uintptr_t arg);
+void sim_wake(sim_node_t *n);
+void sim_raise(sim_node_t *n, uint8_t irq);
+void sim_active(void);
+const sim_linkcfg_t *sim_link_get(const sim_node_t *from, const sim_node_t *to);
+uint32_t sim_random(sim_node_t *n);
+double sim_uniform(sim_node_t *n);
+
+/* trx_sim.c */
+void trx_sim_reset(sim_node_t *n);
+void trx_sim_free(sim_node_t *n);
+void trx_sim_exit(void);
+uint64_t trx_sim_airtime(void);
+
+#endif /* SIM_INT_H_ */
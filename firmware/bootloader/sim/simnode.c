@@ -0,0 +1,28 @@
+/*
+ * simnode.c
+ *
+ * main() of node.so, the WIBO part of the bootloader on a simulated
+ * node: wibo_init() with the addresses given to sim_node_add(), then
+ * wibo_run() as main.c calls it for an OTA request. When wibo_run()
+ * returns, the application would be started, the node stays halted in
+ * SIM_NODE_APP until sim_node_reset().
+ */
+
+#include <stdint.h>
+
+#include "board.h"
+#include "wibo.h"
+
+int main(void)
+{
+	uint8_t channel;
+	uint16_t pan_id, short_addr;
+	uint64_t ieee_addr;
+
+	sim_node_cfg(&channel, &pan_id, &short_addr, &ieee_addr);
+	wibo_init(channel, pan_id, short_addr, ieee_addr);
+	wibo_run();
+	wibo_stop();
+	sim_app_start();
+	return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * spm_sim.c
+ *
+ * The SPM sequences of src/spm.c on the flash of the simulated node, the
+ * page erase and the page write keep it busy for SIM_SPM_NS.
+ */
+
+#include <avr/io.h>
+#include <avr/boot.h>
+
+#include "spm.h"
+
+void spm_page_fill(uint32_t addr, const uint8_t *buf, uint16_t size)
+{
+	sim_spm(addr, __BOOT_PAGE_FILL, buf, size);
+}
+
+void spm_command(uint32_t addr, uint8_t cmd)
+{
+	sim_spm(addr, cmd, NULL, 0);
+}
+
+void spm_page_program(uint32_t addr, const uint8_t *buf)
+{
+	spm_page_fill(addr, buf, SPM_PAGESIZE);
+	spm_page_erase(addr);
+	boot_spm_busy_wait();
+	spm_page_write(addr);
+	boot_spm_busy_wait();
+}
@@ -0,0 +1,1185 @@
+/*
+ * trx_sim.c
+ *
+ * Register level model of the AT86RF231 behind the SPI access functions
+ * of libradio (trx_rf230*.c), and the medium the transceivers share.
+ *
+ * Modelled:
+ *  - the SPI commands (register, frame buffer and SRAM access), the
+ *    register file with its reset values, IRQ_STATUS clear on read and
+ *    the IRQ line as IRQ_STATUS & IRQ_MASK
+ *  - the states of the basic and the extended operating mode, commands
+ *    during BUSY_* states are done when the state ends, FORCE_TRX_OFF
+ *    aborts; TX_START and SLP_TR start a transmission
+ *  - TX_AUTO_CRC, RX_SAFE_MODE, the data rates of TRX_CTRL_2
+ *  - a channel change in one of the PLL states re-locks the PLL,
+ *    PLL_LOCK after tPLL_CH
+ *  - RX_AACK: address filter, promiscuous mode, ACKs as real frames on
+ *    the medium after aTurnaroundTime
+ *  - TX_ARET: unslotted CSMA-CA with the CSMA_BE and XAH_CTRL_0 limits,
+ *    frame retries, TRAC_STATUS
+ *
+ * The frame buffer is read when the PHR goes on air, 160us after the
+ * start, as by the chip, so the frame can be written after TX_START.
+ * Airtime is the SHR and the PHR at 250 kb/s and the PSDU at the rate.
+ *
+ * A frame reaches the nodes on its channel the link to which is not out
+ * of range (sim_link(), loss < 1.0), after the link latency; the
+ * receiver locks at the end of the PHR if it listens. On a link loss it
+ * doesn't see the frame at all; bit errors and frames that overlap at
+ * the receiver give a bad CRC. Anything else (transmit modes, frame
+ * buffer protected, other rate) misses it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_int.h"
+
+/* registers */
+#define REG_TRX_STATUS  (0x01)
+#define REG_TRX_STATE   (0x02)
+#define REG_TRX_CTRL_1  (0x04)
+#define REG_PHY_RSSI    (0x06)
+#define REG_PHY_ED      (0x07)
+#define REG_PHY_CC_CCA  (0x08)
+#define REG_TRX_CTRL_2  (0x0C)
+#define REG_IRQ_MASK    (0x0E)
+#define REG_IRQ_STATUS  (0x0F)
+#define REG_XAH_CTRL_1  (0x17)
+#define REG_SHORT_ADDR  (0x20)
+#define REG_PAN_ID      (0x22)
+#define REG_IEEE_ADDR   (0x24)
+#define REG_XAH_CTRL_0  (0x2C)
+#define REG_CSMA_SEED_1 (0x2E)
+#define REG_CSMA_BE     (0x2F)
+
+/* TRX_STATUS */
+#define ST_P_ON         (0)
+#define ST_BUSY_RX      (1)
+#define ST_BUSY_TX      (2)
+#define ST_RX_ON        (6)
+#define ST_TRX_OFF      (8)
+#define ST_PLL_ON       (9)
+#define ST_SLEEP        (15)
+#define ST_BUSY_RX_AACK (17)
+#define ST_BUSY_TX_ARET (18)
+#define ST_RX_AACK_ON   (22)
+#define ST_TX_ARET_ON   (25)
+
+/* TRX_CMD */
+#define CMD_NOP         (0)
+#define CMD_TX_START    (2)
+#define CMD_FORCE_OFF   (3)
+#define CMD_FORCE_PLL   (4)
+
+#define IRQ_PLL_LOCK    (0x01)
+#define IRQ_RX_START    (0x04)
+#define IRQ_TRX_END     (0x08)
+#define IRQ_AMI         (0x20)
+
+#define TRAC_SUCCESS    (0)
+#define TRAC_CA_FAIL    (3)
+#define TRAC_NO_ACK     (5)
+
+/* timing */
+#define T_TX_START      (16 * SIM_US)	// TX_START to the air
+#define T_SHR           (160 * SIM_US)
+#define T_PHR           (192 * SIM_US)	// SHR and PHR
+#define T_TURNAROUND    (192 * SIM_US)	// aTurnaroundTime, 12 symbols
+#define T_BACKOFF       (320 * SIM_US)	// aUnitBackoffPeriod
+#define T_CCA           (128 * SIM_US)
+#define T_ACK_WAIT      (864 * SIM_US)	// macAckWaitDuration
+#define T_PLL_CH        (11 * SIM_US)	// tPLL_CH, channel change
+
+/* SPI transaction */
+#define SPI_IDLE        (0)
+#define SPI_CMD         (1)
+#define SPI_REG_WRITE   (2)
+#define SPI_REG_READ    (3)
+#define SPI_FRAME_WRITE (4)
+#define SPI_FRAME_READ  (5)
+#define SPI_SRAM_ADDR   (6)
+#define SPI_SRAM        (7)
+
+/* ARET phases */
+#define ARET_IDLE       (0)
+#define ARET_CSMA       (1)
+#define ARET_TX         (2)
+#define ARET_ACK_WAIT   (3)
+
+/* a transmission on the medium */
+typedef struct sim_tx
+{
+	struct sim_tx *next;
+	sim_node_t *src;
+	int refs;
+	uint8_t channel;
+	uint16_t kbps;
+	uint8_t ack;		// the transmitter's ACK of a frame
+	uint8_t aborted;	// the sender went off while on air
+	sim_time_t start;	// SHR on air
+	sim_time_t end;		// SIM_NEVER until the PHR is read
+	uint8_t len;
+	uint8_t data[128];
+} sim_tx_t;
+
+/* a frame on its way to one receiver */
+typedef struct
+{
+	sim_tx_t *tx;
+	sim_node_t *n;
+	uint32_t gen;
+	sim_time_t lat;
+} sim_rx_t;
+
+typedef struct sim_trx
+{
+	uint8_t reg[64];
+	uint8_t fb[128];	// frame buffer, fb[0] is the PHR
+	uint8_t lqi;
+	uint8_t state;
+	uint8_t deferred;	// command given during a BUSY state
+	uint8_t line;		// IRQ line
+	uint8_t slptr;
+	uint8_t reset;
+	uint8_t protect;	// RX_SAFE_MODE, a frame was not read yet
+	uint32_t gen;		// resets of the node
+	uint32_t op;		// stale timed events have an older op
+
+	uint8_t spi;
+	uint8_t spi_addr;
+	uint8_t spi_pos;
+	uint8_t spi_len;
+	int16_t last_addr;	// repeated reads of the same value are polls
+	uint8_t last_val;
+
+	sim_tx_t *txcur;
+	sim_rx_t *rx;		// frame being received
+	uint8_t rx_ack;		// rx is the ACK for the ARET frame
+
+	uint8_t aret;
+	uint8_t aret_nb;
+	uint8_t aret_be;
+	uint8_t aret_retries;
+	uint8_t aret_seq;
+	uint8_t ack_seq;	// of the frame to acknowledge
+} sim_trx_t;
+
+static sim_tx_t *medium;
+static sim_tx_t **medium_tail = &medium;
+static uint64_t airtime;
+static sim_time_t air_busy;
+
+static const uint8_t reg_reset[64] =
+{
+	[0x01] = ST_TRX_OFF,
+	[0x04] = 0x20,
+	[0x05] = 0xC0,
+	[0x08] = 0x2B,
+	[0x09] = 0xC7,
+	[0x0A] = 0xB7,
+	[0x0B] = 0xA7,
+	[0x0E] = 0xFF,
+	[0x10] = 0x04,
+	[0x11] = 0x22,
+	[0x12] = 0xF0,
+	[0x15] = 0x08,
+	[0x17] = 0x00,
+	[0x1A] = 0x57,
+	[0x1C] = 0x03,
+	[0x1D] = 0x02,
+	[0x1E] = 0x1F,
+	[0x20] = 0xFF, [0x21] = 0xFF, [0x22] = 0xFF, [0x23] = 0xFF,
+	[0x2C] = 0x38,
+	[0x2D] = 0xEA,
+	[0x2E] = 0x42,
+	[0x2F] = 0x53,
+};
+
+static void trx_tx_phr(sim_node_t *n, uintptr_t arg);
+static void trx_rx_lock(sim_node_t *unused, uintptr_t arg);
+static void trx_rx_end(sim_node_t *unused, uintptr_t arg);
+static void aret_backoff(sim_trx_t *x, sim_node_t *n, sim_time_t t);
+
+/* === helpers ============================================================ */
+
+static uint16_t crc_ccitt(const uint8_t *p, uint8_t len)
+{
+	uint16_t crc = 0;
+	uint8_t i;
+
+	while (len--)
+	{
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+		}
+	}
+	return crc;
+}
+
+static uint16_t trx_kbps(const sim_trx_t *x)
+{
+	static const uint16_t rates[4] = { 250, 500, 1000, 2000 };
+
+	return rates[x->reg[REG_TRX_CTRL_2] & 3];
+}
+
+static uint8_t trx_channel(const sim_trx_t *x)
+{
+	return x->reg[REG_PHY_CC_CCA] & 0x1F;
+}
+
+static void tx_release(sim_tx_t *tx)
+{
+	tx->refs--;
+}
+
+/* frames the last of whose receivers is done, and that no CCA sees */
+static void medium_prune(void)
+{
+	sim_tx_t **p = &medium, *tx;
+
+	while ((tx = *p) != NULL)
+	{
+		if (tx->refs == 0 && tx->end != SIM_NEVER
+				&& tx->end + sim_latency_max + T_PHR < sim_t)
+		{
+			*p = tx->next;
+			free(tx);
+		}
+		else
+		{
+			p = &tx->next;
+		}
+	}
+	for (medium_tail = &medium; *medium_tail; medium_tail = &(*medium_tail)->next)
+		;
+}
+
+static uint8_t link_audible(const sim_node_t *from, const sim_node_t *to)
+{
+	return sim_link_get(from, to)->loss < 1.0;
+}
+
+/* a frame of another node is on air at n during [t0, t1] */
+static uint8_t medium_busy(sim_node_t *n, sim_time_t t0, sim_time_t t1,
+		const sim_tx_t *except)
+{
+	const sim_tx_t *tx;
+	sim_time_t lat;
+
+	for (tx = medium; tx != NULL; tx = tx->next)
+	{
+		if (tx == except || tx->src == n || tx->channel != trx_channel(n->trx)
+				|| !link_audible(tx->src, n))
+		{
+			continue;
+		}
+		lat = sim_link_get(tx->src, n)->latency;
+		if (tx->start + lat <= t1 && (SIM_NEVER == tx->end || tx->end + lat >= t0))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* === IRQ and state ====================================================== */
+
+static void trx_irq(sim_node_t *n, uint8_t bits)
+{
+	sim_trx_t *x = n->trx;
+	uint8_t line;
+
+	x->reg[REG_IRQ_STATUS] |= bits;
+	line = 0 != (x->reg[REG_IRQ_STATUS] & x->reg[REG_IRQ_MASK]);
+	if (line && !x->line)
+	{
+		sim_raise(n, SIM_IRQ_TRX);
+	}
+	x->line = line;
+	sim_wake(n);
+}
+
+static void trx_line_update(sim_trx_t *x)
+{
+	x->line = 0 != (x->reg[REG_IRQ_STATUS] & x->reg[REG_IRQ_MASK]);
+}
+
+static uint8_t state_busy(uint8_t st)
+{
+	return ST_BUSY_RX == st || ST_BUSY_TX == st || ST_BUSY_RX_AACK == st
+			|| ST_BUSY_TX_ARET == st;
+}
+
+static void trx_unlock_rx(sim_trx_t *x)
+{
+	x->rx = NULL;
+	x->rx_ack = 0;
+}
+
+/* abort whatever is on air or being received */
+static void trx_abort(sim_node_t *n)
+{
+	sim_trx_t *x = n->trx;
+
+	x->op++;
+	trx_unlock_rx(x);
+	x->aret = ARET_IDLE;
+	x->deferred = CMD_NOP;
+	if (x->txcur != NULL)
+	{
+		x->txcur->aborted = 1;
+		if (x->txcur->end > n->t)
+		{
+			x->txcur->end = n->t;
+		}
+		tx_release(x->txcur);
+		x->txcur = NULL;
+	}
+}
+
+static void trx_cmd(sim_node_t *n, uint8_t cmd);
+
+/* the BUSY state ended, back to the listening or transmit state */
+static void trx_idle(sim_node_t *n, uint8_t st)
+{
+	sim_trx_t *x = n->trx;
+	uint8_t cmd = x->deferred;
+
+	x->state = st;
+	x->deferred = CMD_NOP;
+	if (CMD_NOP != cmd)
+	{
+		trx_cmd(n, cmd);
+	}
+	sim_wake(n);
+}
+
+static void trx_cmd(sim_node_t *n, uint8_t cmd)
+{
+	sim_trx_t *x = n->trx;
+	uint8_t st = x->state;
+
+	if (CMD_FORCE_OFF == cmd || CMD_FORCE_PLL == cmd)
+	{
+		trx_abort(n);
+		x->state = ST_TRX_OFF;
+		x->protect = 0;
+		if (CMD_FORCE_PLL == cmd)
+		{
+			x->state = ST_PLL_ON;
+		}
+		sim_wake(n);
+		return;
+	}
+	if (ST_SLEEP == st || (ST_P_ON == st && ST_TRX_OFF != cmd))
+	{
+		return;
+	}
+	if (state_busy(st))
+	{
+		/* TRX_OFF leaves a frame being received, the rest waits */
+		if (ST_TRX_OFF == cmd && (ST_BUSY_RX == st || ST_BUSY_RX_AACK == st)
+				&& !x->txcur)
+		{
+			trx_unlock_rx(x);
+			x->state = ST_TRX_OFF;
+		}
+		else if (CMD_TX_START != cmd)
+		{
+			x->deferred = cmd;
+		}
+		return;
+	}
+	switch (cmd)
+	{
+	case ST_TRX_OFF:
+		x->state = ST_TRX_OFF;
+		x->protect = 0;
+		break;
+	case ST_PLL_ON:
+	case ST_RX_ON:
+	case ST_RX_AACK_ON:
+	case ST_TX_ARET_ON:
+		if (ST_TRX_OFF == st)
+		{
+			trx_irq(n, IRQ_PLL_LOCK);
+		}
+		if (cmd != st)
+		{
+			x->protect = 0;
+		}
+		x->state = cmd;
+		break;
+	default:	// TX_START, see reg_write()
+		break;
+	}
+	sim_wake(n);
+}
+
+/* === transmission ======================================================= */
+
+/* SHR on air at t, the frame is taken from fb at the PHR, or data for ACKs */
+static void medium_start(sim_node_t *n, sim_time_t t, const uint8_t *ack)
+{
+	sim_trx_t *x = n->trx;
+	sim_tx_t *tx = calloc(1, sizeof(*tx));
+
+	tx->src = n;
+	tx->refs = 1;		// x->txcur
+	tx->channel = trx_channel(x);
+	tx->kbps = trx_kbps(x);
+	tx->start = t;
+	tx->end = SIM_NEVER;
+	if (ack != NULL)
+	{
+		tx->ack = 1;
+		tx->len = 5;
+		memcpy(tx->data, ack, 5);
+	}
+	*medium_tail = tx;
+	medium_tail = &tx->next;
+	x->txcur = tx;
+	n->info.tx_frames++;
+	if (ack != NULL)
+	{
+		n->info.tx_acks++;
+	}
+	sim_event(t + T_SHR, trx_tx_phr, n, x->op);
+}
+
+static void trx_tx_end(sim_node_t *n, uintptr_t op);
+
+/* the PHR goes on air: the frame is fixed, the receivers get it */
+static void trx_tx_phr(sim_node_t *n, uintptr_t op)
+{
+	sim_trx_t *x = n->trx;
+	sim_tx_t *tx = x->txcur;
+	sim_time_t lat;
+	uint16_t crc;
+	int i;
+
+	if (op != x->op || tx == NULL)
+	{
+		return;
+	}
+	if (!tx->ack)
+	{
+		tx->len = x->fb[0] & 0x7F;
+		memcpy(tx->data, x->fb + 1, tx->len);
+		if ((x->reg[REG_TRX_CTRL_1] & 0x20) && tx->len >= 2)
+		{
+			crc = crc_ccitt(tx->data, tx->len - 2);
+			tx->data[tx->len - 2] = crc & 0xFF;
+			tx->data[tx->len - 1] = crc >> 8;
+		}
+	}
+	tx->end = tx->start + T_PHR + (sim_time_t) tx->len * 8 * SIM_MS / tx->kbps;
+	n->info.tx_airtime += tx->end - tx->start;
+	if (tx->start >= air_busy)
+	{
+		airtime += tx->end - tx->start;
+		air_busy = tx->end;
+	}
+	else if (tx->end > air_busy)
+	{
+		airtime += tx->end - air_busy;
+		air_busy = tx->end;
+	}
+
+	for (i = 0; i < sim_nnodes; i++)
+	{
+		sim_node_t *r = sim_nodes[i];
+		sim_rx_t *rx;
+
+		if (r == n || r->trx == NULL || NODE_HALTED == r->st
+				|| !link_audible(n, r))
+		{
+			continue;
+		}
+		lat = sim_link_get(n, r)->latency;
+		rx = malloc(sizeof(*rx));
+		rx->tx = tx;
+		rx->n = r;
+		rx->gen = r->trx->gen;
+		rx->lat = lat;
+		tx->refs++;
+		sim_event(tx->start + lat + T_PHR, trx_rx_lock, NULL, (uintptr_t) rx);
+	}
+	sim_event(tx->end, trx_tx_end, n, x->op);
+	medium_prune();
+}
+
+static void aret_finish(sim_node_t *n, uint8_t trac)
+{
+	sim_trx_t *x = n->trx;
+
+	x->aret = ARET_IDLE;
+	x->reg[REG_TRX_STATE] = (trac << 5) | (x->reg[REG_TRX_STATE] & 0x1F);
+	if (TRAC_CA_FAIL == trac)
+	{
+		n->info.tx_ccafail++;
+	}
+	else if (TRAC_NO_ACK == trac)
+	{
+		n->info.tx_noack++;
+	}
+	x->op++;
+	trx_idle(n, ST_TX_ARET_ON);
+	trx_irq(n, IRQ_TRX_END);
+}
+
+static void aret_ack_timeout(sim_node_t *n, uintptr_t op)
+{
+	sim_trx_t *x = n->trx;
+
+	if (op != x->op || ARET_ACK_WAIT != x->aret)
+	{
+		return;
+	}
+	trx_unlock_rx(x);
+	if (x->aret_retries > 0)
+	{
+		x->aret_retries--;
+		n->info.tx_retries++;
+		x->aret_nb = 0;
+		x->aret_be = x->reg[REG_CSMA_BE] & 0x0F;
+		x->aret = ARET_CSMA;
+		aret_backoff(x, n, sim_t);
+	}
+	else
+	{
+		aret_finish(n, TRAC_NO_ACK);
+	}
+}
+
+static void trx_ack_end(sim_node_t *n);
+
+static void trx_tx_end(sim_node_t *n, uintptr_t op)
+{
+	sim_trx_t *x = n->trx;
+	sim_tx_t *tx = x->txcur;
+
+	if (op != x->op || tx == NULL)
+	{
+		return;
+	}
+	x->txcur = NULL;
+	tx_release(tx);
+	if (tx->ack)
+	{
+		trx_ack_end(n);
+	}
+	else if (ST_BUSY_TX == x->state)
+	{
+		trx_idle(n, ST_PLL_ON);
+		trx_irq(n, IRQ_TRX_END);
+	}
+	else if (ARET_TX == x->aret)
+	{
+		/* ACK request set and not to the broadcast address */
+		if ((tx->data[0] & 0x20) && tx->len >= 7
+				&& !(tx->data[5] == 0xFF && tx->data[6] == 0xFF))
+		{
+			x->aret = ARET_ACK_WAIT;
+			x->aret_seq = tx->data[2];
+			sim_event(sim_t + T_ACK_WAIT, aret_ack_timeout, n, x->op);
+		}
+		else
+		{
+			aret_finish(n, TRAC_SUCCESS);
+		}
+	}
+}
+
+static void aret_cca(sim_node_t *n, uintptr_t op)
+{
+	sim_trx_t *x = n->trx;
+	uint8_t be_max = x->reg[REG_CSMA_BE] >> 4;
+	uint8_t nb_max = (x->reg[REG_XAH_CTRL_0] >> 1) & 7;
+
+	if (op != x->op || ARET_CSMA != x->aret)
+	{
+		return;
+	}
+	if (!medium_busy(n, sim_t - T_CCA, sim_t, NULL))
+	{
+		x->aret = ARET_TX;
+		medium_start(n, sim_t + T_TURNAROUND, NULL);
+		return;
+	}
+	x->aret_nb++;
+	if (x->aret_be < be_max)
+	{
+		x->aret_be++;
+	}
+	if (x->aret_nb > nb_max)
+	{
+		aret_finish(n, TRAC_CA_FAIL);
+	}
+	else
+	{
+		aret_backoff(x, n, sim_t);
+	}
+}
+
+static void aret_backoff(sim_trx_t *x, sim_node_t *n, sim_time_t t)
+{
+	sim_time_t slots = sim_random(n) & ((1 << x->aret_be) - 1);
+
+	sim_event(t + slots * T_BACKOFF + T_CCA, aret_cca, n, x->op);
+}
+
+/* TX_START, or SLP_TR in PLL_ON or TX_ARET_ON */
+static void trx_tx_start(sim_node_t *n)
+{
+	sim_trx_t *x = n->trx;
+
+	if (ST_PLL_ON == x->state)
+	{
+		x->state = ST_BUSY_TX;
+		medium_start(n, n->t + T_TX_START, NULL);
+	}
+	else if (ST_TX_ARET_ON == x->state)
+	{
+		x->state = ST_BUSY_TX_ARET;
+		x->aret_retries = x->reg[REG_XAH_CTRL_0] >> 4;
+		x->aret_nb = 0;
+		x->aret_be = x->reg[REG_CSMA_BE] & 0x0F;
+		if (7 == ((x->reg[REG_XAH_CTRL_0] >> 1) & 7))
+		{
+			/* no CSMA */
+			x->aret = ARET_TX;
+			medium_start(n, n->t + T_TX_START, NULL);
+		}
+		else
+		{
+			x->aret = ARET_CSMA;
+			aret_backoff(x, n, n->t);
+		}
+	}
+	sim_wake(n);
+}
+
+static void trx_ack_start(sim_node_t *n, uintptr_t op)
+{
+	sim_trx_t *x = n->trx;
+	uint8_t ack[5];
+	uint16_t crc;
+
+	if (op != x->op || ST_BUSY_RX_AACK != x->state)
+	{
+		return;
+	}
+	ack[0] = 0x02;
+	ack[1] = 0x00;
+	ack[2] = x->ack_seq;
+	crc = crc_ccitt(ack, 3);
+	ack[3] = crc & 0xFF;
+	ack[4] = crc >> 8;
+	medium_start(n, sim_t, ack);
+}
+
+static void trx_ack_end(sim_node_t *n)
+{
+	trx_idle(n, ST_RX_AACK_ON);
+}
+
+/* === reception ========================================================== */
+
+static void trx_rx_lock(sim_node_t *unused, uintptr_t arg)
+{
+	sim_rx_t *rx = (sim_rx_t *) arg;
+	sim_node_t *r = rx->n;
+	sim_trx_t *x = r->trx;
+	sim_tx_t *tx = rx->tx;
+	uint8_t st = x->state;
+
+	if (rx->gen != x->gen || tx->channel != trx_channel(x) || tx->aborted)
+	{
+		goto drop;
+	}
+	if (sim_uniform(r) < sim_link_get(tx->src, r)->loss)
+	{
+		r->info.rx_lost++;
+		goto drop;
+	}
+	if (tx->kbps != trx_kbps(x) || x->rx != NULL)
+	{
+		r->info.rx_missed++;
+		goto drop;
+	}
+	if (ARET_ACK_WAIT == x->aret && tx->ack)
+	{
+		x->rx = rx;
+		x->rx_ack = 1;
+	}
+	else if ((ST_RX_ON == st || ST_RX_AACK_ON == st) && !x->protect)
+	{
+		x->rx = rx;
+		x->state = (ST_RX_ON == st) ? ST_BUSY_RX : ST_BUSY_RX_AACK;
+		trx_irq(r, IRQ_RX_START);
+	}
+	else
+	{
+		r->info.rx_missed++;
+		goto drop;
+	}
+	sim_event(tx->end + rx->lat, trx_rx_end, NULL, (uintptr_t) rx);
+	return;
+
+drop:
+	tx_release(tx);
+	free(rx);
+}
+
+/* frame for this node in RX_AACK, -1: not, 0: broadcast, 1: unicast */
+static int aack_filter(const sim_trx_t *x, const uint8_t *d, uint8_t len)
+{
+	uint8_t dmode, type;
+	uint16_t pan, addr;
+
+	if (x->reg[REG_XAH_CTRL_1] & 0x02)
+	{
+		return 0;
+	}
+	if (len < 5)
+	{
+		return -1;
+	}
+	type = d[0] & 7;
+	dmode = (d[1] >> 2) & 3;
+	if (2 == type || 0 == dmode)
+	{
+		return (0 == dmode && 2 != type) ? 0 : -1;
+	}
+	pan = d[3] | (d[4] << 8);
+	if (pan != 0xFFFF && pan != (x->reg[REG_PAN_ID] | (x->reg[REG_PAN_ID + 1] << 8)))
+	{
+		return -1;
+	}
+	if (2 == dmode)
+	{
+		if (len < 7)
+		{
+			return -1;
+		}
+		addr = d[5] | (d[6] << 8);
+		if (0xFFFF == addr)
+		{
+			return 0;
+		}
+		return addr == (x->reg[REG_SHORT_ADDR] | (x->reg[REG_SHORT_ADDR + 1] << 8))
+				? 1 : -1;
+	}
+	if (3 == dmode && len >= 13 && 0 == memcmp(d + 5, x->reg + REG_IEEE_ADDR, 8))
+	{
+		return 1;
+	}
+	return -1;
+}
+
+static void trx_rx_end(sim_node_t *unused, uintptr_t arg)
+{
+	sim_rx_t *rx = (sim_rx_t *) arg;
+	sim_node_t *r = rx->n;
+	sim_trx_t *x = r->trx;
+	sim_tx_t *tx = rx->tx;
+	const sim_linkcfg_t *l;
+	uint8_t data[128], ok, len = tx->len;
+	sim_tx_t *y;
+	int match;
+
+	if (rx->gen != x->gen || x->rx != rx)
+	{
+		goto done;
+	}
+	x->rx = NULL;
+	memcpy(data, tx->data, len);
+
+	/* collisions: another frame on air at r while this one was */
+	ok = !tx->aborted;
+	for (y = medium; y != NULL; y = y->next)
+	{
+		sim_time_t lat;
+
+		if (y == tx || y->src == r || y->channel != tx->channel
+				|| !link_audible(y->src, r))
+		{
+			continue;
+		}
+		lat = sim_link_get(y->src, r)->latency;
+		if (y->start + lat < tx->end + rx->lat
+				&& (SIM_NEVER == y->end || y->end + lat > tx->start + rx->lat))
+		{
+			r->info.rx_collided++;
+			ok = 0;
+			break;
+		}
+	}
+	l = sim_link_get(tx->src, r);
+	if (ok && l->ber > 0.0 && len)
+	{
+		double p = 1.0, q = 1.0 - l->ber;
+		int bits = len * 8;
+
+		while (bits--)
+		{
+			p *= q;
+		}
+		if (sim_uniform(r) >= p)
+		{
+			ok = 0;
+		}
+	}
+	if (!ok && len)
+	{
+		data[sim_random(r) % len] ^= 1 << (sim_random(r) & 7);
+	}
+	ok = (len >= 2 && 0 == crc_ccitt(data, len));
+
+	if (x->rx_ack)
+	{
+		x->rx_ack = 0;
+		if (ok && ARET_ACK_WAIT == x->aret && data[2] == x->aret_seq)
+		{
+			aret_finish(r, TRAC_SUCCESS);
+		}
+		goto done;
+	}
+
+	match = 0;
+	if (ST_BUSY_RX_AACK == x->state)
+	{
+		match = aack_filter(x, data, len);
+		if (match < 0)
+		{
+			trx_idle(r, ST_RX_AACK_ON);
+			goto done;
+		}
+	}
+	x->fb[0] = len;
+	memcpy(x->fb + 1, data, len);
+	x->lqi = ok ? 0xFF : (sim_random(r) & 0x7F);
+	x->reg[REG_PHY_RSSI] = (ok ? 0x80 : 0) | 0x10;
+	x->reg[REG_PHY_ED] = 0x40;
+	if (x->reg[REG_TRX_CTRL_2] & 0x80)
+	{
+		x->protect = 1;
+	}
+	r->info.rx_frames++;
+	if (!ok)
+	{
+		r->info.rx_crcfail++;
+	}
+	if (ST_BUSY_RX == x->state)
+	{
+		trx_idle(r, ST_RX_ON);
+	}
+	else if (1 == match && ok && (data[0] & 0x20)
+			&& !(x->reg[REG_CSMA_SEED_1] & 0x10))
+	{
+		/* stays BUSY_RX_AACK until the ACK is out */
+		x->ack_seq = data[2];
+		sim_event(sim_t + T_TURNAROUND, trx_ack_start, r, x->op);
+	}
+	else
+	{
+		trx_idle(r, ST_RX_AACK_ON);
+	}
+	trx_irq(r, IRQ_TRX_END | (match > 0 ? IRQ_AMI : 0));
+
+done:
+	tx_release(tx);
+	free(rx);
+}
+
+/* the PLL has locked on a new channel */
+static void trx_pll_lock(sim_node_t *n, uintptr_t arg)
+{
+	uint8_t st = n->trx->state;
+
+	if (ST_TRX_OFF != st && ST_SLEEP != st && ST_P_ON != st)
+	{
+		trx_irq(n, IRQ_PLL_LOCK);
+	}
+}
+
+/* === registers and SPI ================================================== */
+
+static uint8_t reg_read(sim_node_t *n, uint8_t addr)
+{
+	sim_trx_t *x = n->trx;
+	uint8_t v = x->reg[addr];
+
+	switch (addr)
+	{
+	case REG_TRX_STATUS:
+		v = x->state;
+		break;
+	case REG_PHY_RSSI:
+		v = (v & 0x9F) | (sim_random(n) & 0x60);
+		break;
+	case REG_IRQ_STATUS:
+		x->reg[REG_IRQ_STATUS] = 0;
+		trx_line_update(x);
+		break;
+	default:
+		break;
+	}
+	return v;
+}
+
+static void reg_write(sim_node_t *n, uint8_t addr, uint8_t v)
+{
+	sim_trx_t *x = n->trx;
+
+	switch (addr)
+	{
+	case REG_TRX_STATUS:
+	case REG_IRQ_STATUS:
+	case 0x1C: case 0x1D: case 0x1E: case 0x1F:
+		break;
+	case REG_TRX_STATE:
+		x->reg[addr] = (x->reg[addr] & 0xE0) | (v & 0x1F);
+		trx_cmd(n, v & 0x1F);
+		if (CMD_TX_START == (v & 0x1F))
+		{
+			trx_tx_start(n);
+		}
+		break;
+	case REG_IRQ_MASK:
+		x->reg[addr] = v;
+		trx_irq(n, 0);
+		break;
+	case REG_PHY_CC_CCA:
+		if (((x->reg[addr] ^ v) & 0x1F) && ST_TRX_OFF != x->state &&
+		    ST_SLEEP != x->state && ST_P_ON != x->state)
+		{
+			sim_event(sim_t + T_PLL_CH, trx_pll_lock, n, 0);
+		}
+		x->reg[addr] = v;
+		break;
+	default:
+		x->reg[addr] = v;
+		break;
+	}
+}
+
+void sim_spi_select(uint8_t on)
+{
+	sim_trx_t *x = sim_cur->trx;
+
+	if (on)
+	{
+		x->spi = SPI_CMD;
+	}
+	else
+	{
+		if (SPI_FRAME_READ == x->spi)
+		{
+			x->protect = 0;
+		}
+		x->spi = SPI_IDLE;
+	}
+}
+
+/* one SPI byte, the MISO byte is the answer to the previous MOSI byte */
+uint8_t sim_spi_xfer(uint8_t mosi)
+{
+	sim_node_t *n = sim_cur;
+	sim_trx_t *x = n->trx;
+	uint8_t miso = 0, len;
+
+	sim_cost(SIM_SPI_NS);
+	if (x->reset || ST_SLEEP == x->state)
+	{
+		return 0;
+	}
+	switch (x->spi)
+	{
+	case SPI_CMD:
+		x->spi_addr = mosi & 0x3F;
+		x->spi_pos = 0;
+		if ((mosi & 0xC0) == 0xC0)
+		{
+			x->spi = SPI_REG_WRITE;
+		}
+		else if ((mosi & 0xC0) == 0x80)
+		{
+			x->spi = SPI_REG_READ;
+		}
+		else if ((mosi & 0xE0) == 0x60)
+		{
+			x->spi = SPI_FRAME_WRITE;
+		}
+		else if ((mosi & 0xE0) == 0x20)
+		{
+			x->spi = SPI_FRAME_READ;
+		}
+		else
+		{
+			x->spi = SPI_SRAM_ADDR;
+			x->spi_len = mosi & 0x40;	// write
+		}
+		if (SPI_REG_READ != x->spi)
+		{
+			sim_active();
+		}
+		break;
+	case SPI_REG_WRITE:
+		sim_active();
+		reg_write(n, x->spi_addr, mosi);
+		x->spi = SPI_IDLE;
+		x->last_addr = -1;
+		break;
+	case SPI_REG_READ:
+		miso = reg_read(n, x->spi_addr);
+		x->spi = SPI_IDLE;
+		if ((REG_IRQ_STATUS == x->spi_addr && 0 == miso)
+				|| (x->last_addr == x->spi_addr && x->last_val == miso))
+		{
+			sim_poll(SIM_NEVER);
+		}
+		else
+		{
+			sim_active();
+		}
+		x->last_addr = x->spi_addr;
+		x->last_val = miso;
+		break;
+	case SPI_FRAME_WRITE:
+		if (x->spi_pos < sizeof(x->fb))
+		{
+			x->fb[x->spi_pos] = mosi;
+		}
+		x->spi_pos++;
+		break;
+	case SPI_FRAME_READ:
+		len = x->fb[0] & 0x7F;
+		if (x->spi_pos <= len)
+		{
+			miso = x->fb[x->spi_pos];
+		}
+		else if (x->spi_pos == len + 1)
+		{
+			miso = x->lqi;
+		}
+		x->spi_pos++;
+		break;
+	case SPI_SRAM_ADDR:
+		x->spi_pos = mosi & 0x7F;
+		x->spi = SPI_SRAM;
+		break;
+	case SPI_SRAM:
+		if (x->spi_len)
+		{
+			x->fb[x->spi_pos & 0x7F] = mosi;
+		}
+		else
+		{
+			miso = x->fb[x->spi_pos & 0x7F];
+		}
+		x->spi_pos++;
+		break;
+	default:
+		break;
+	}
+	return miso;
+}
+
+/*
+ * \brief The SLP_TR and RESET pins, 0xFF leaves a pin as it is
+ */
+void sim_trx_pin(uint8_t slptr, uint8_t reset)
+{
+	sim_node_t *n = sim_cur;
+	sim_trx_t *x = n->trx;
+
+	sim_active();
+	if (reset != 0xFF && (reset == 0) != x->reset)
+	{
+		x->reset = (reset == 0);	// the pin is low active
+		if (x->reset)
+		{
+			trx_abort(n);
+			memcpy(x->reg, reg_reset, sizeof(x->reg));
+			x->state = ST_TRX_OFF;
+			x->protect = 0;
+			x->line = 0;
+		}
+	}
+	if (slptr != 0xFF && slptr != x->slptr)
+	{
+		x->slptr = slptr;
+		if (slptr)
+		{
+			if (ST_PLL_ON == x->state || ST_TX_ARET_ON == x->state)
+			{
+				trx_tx_start(n);
+			}
+			else if (ST_TRX_OFF == x->state)
+			{
+				x->state = ST_SLEEP;
+			}
+		}
+		else if (ST_SLEEP == x->state)
+		{
+			x->state = ST_TRX_OFF;
+		}
+	}
+}
+
+/* === sim.c ============================================================== */
+
+void trx_sim_reset(sim_node_t *n)
+{
+	sim_trx_t *x = n->trx;
+	uint32_t gen = 0;
+
+	if (x == NULL)
+	{
+		x = n->trx = calloc(1, sizeof(*x));
+	}
+	else
+	{
+		trx_abort(n);
+		gen = x->gen + 1;
+	}
+	memset(x, 0, sizeof(*x));
+	memcpy(x->reg, reg_reset, sizeof(x->reg));
+	x->gen = gen;
+	x->state = ST_P_ON;
+	x->reset = 0;
+	x->last_addr = -1;
+}
+
+void trx_sim_free(sim_node_t *n)
+{
+	free(n->trx);
+	n->trx = NULL;
+}
+
+void trx_sim_exit(void)
+{
+	sim_tx_t *tx;
+
+	while ((tx = medium) != NULL)
+	{
+		medium = tx->next;
+		free(tx);
+	}
+	medium_tail = &medium;
+	airtime = 0;
+	air_busy = 0;
+}
+
+uint64_t trx_sim_airtime(void)
+{
+	return airtime;
+}
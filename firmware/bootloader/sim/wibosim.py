@@ -0,0 +1,389 @@
+#!/usr/bin/env python
+"""
+wibosim.py - OTA updates of a simulated fleet, in virtual time
+
+Runs the OTA variants of wibohost.py against the host simulation
+(libwibosim.so, see the bootloader README.md): a host.so with wibohost
+behind the UART of the script and NODES node.so with the WIBO part of
+the bootloader, on one channel, with the loss, bit errors and latency
+of -l, -e and -d on every link. time.time() and time.sleep() of
+wibohost.py follow the virtual clock, so an update of a fleet of
+hundreds of nodes takes seconds of CPU time. Each variant gets a fresh
+simulation with the same seed; the flash of every node is compared with
+the image at the end.
+
+Usage:
+ python wibosim.py [OPTIONS] [HEXFILE]
+
+Options:
+ -n NODES   number of nodes, default 10
+ -m METHODS comma separated OTA variants, default all of them:
+            plain     flashhex() as broadcast, no retransmits (-U)
+            queued    the same with queued feeding of the host (-U -q)
+            windowed  flashhex_windowed(), one node after the other (-u -w)
+            multicast flashhex_multicast(), merged retransmits (-U -w)
+            fountain  flashhex_fountain(), coded blocks (-U -f)
+ -b         binary feed frames instead of hex text (wibohost.py -b)
+ -l LOSS    frame loss of each link, 0..1, default 0
+ -e BER     bit error rate of each link, default 0
+ -d US      latency of each link in us, default 0
+ -S SIZE    random image of SIZE bytes (at most 64K) instead of HEXFILE,
+            default 8192
+ -s SEED    seed of the simulation and of wibohost.py, default 1
+ -o FILE    report, CSV for *.csv else JSON
+ -v         increase verbose level of wibohost.py
+ -h         show this help
+
+Columns of the report: nodes with the image, virtual seconds until the
+variant returned, seconds the channel was busy (overlapping frames count
+once), frames sent by host and nodes, ARET retries, frames lost to the
+link loss and to collisions or bit errors, the RTO of the host over
+all nodes in ms after the update, and the CPU seconds it took. A variant
+fails when a node misses the image or the RTO is not below the 500 ms
+clamp of wibohost.c, i.e. the round trip estimate went wrong.
+
+Example:
+ python wibosim.py -n 50 -l 0.05 -m multicast,fountain -b Bootstrap.cpp.hex
+
+make in this directory builds the plugins and the library first.
+"""
+
+import os, sys, time, getopt, csv, json, random, tempfile, ctypes, types
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, "..", "uracoli-src-20131127", "wibo"))
+
+try:
+    import serial
+except ImportError:
+    # only the Serial class is needed, the UART is the one of the host.so
+    serial = types.ModuleType("serial")
+    class _Serial(object):
+        def __init__(self, *args, **kwargs):
+            pass
+    serial.Serial = _Serial
+    sys.modules["serial"] = serial
+
+import wibohost
+from wibohost import WIBONetwork, read_hex_mem, hexline
+
+SIM_US = 1000
+SIM_S = 1000000000
+CHANNEL = 11
+PAN_ID = 0x0001
+HOST_ADDR = 0x0000
+BOOT_TIME = 0.1 # host banner and wibo_init() of the nodes
+RTO_MAX_US = 500000 # clamp of the reply timeouts, RTO_MAX_US of wibohost.c
+READ_STEP = 0.0005 # virtual seconds between two looks at the UART
+READ_TIMEOUT = 5.0 # readline() and read() of the script, virtual seconds
+METHODS = ["plain", "queued", "windowed", "multicast", "fountain"]
+COLUMNS = ["method", "nodes", "ok", "seconds", "airtime", "tx_frames",
+           "tx_retries", "rx_lost", "rx_crcfail", "rto_ms", "cpu"]
+
+class SimNodeInfo(ctypes.Structure):
+    """ sim_node_info_t of sim.h """
+    _fields_ = [("tx_frames", ctypes.c_uint32),
+                ("tx_acks", ctypes.c_uint32),
+                ("tx_retries", ctypes.c_uint32),
+                ("tx_ccafail", ctypes.c_uint32),
+                ("tx_noack", ctypes.c_uint32),
+                ("tx_airtime", ctypes.c_uint64),
+                ("rx_frames", ctypes.c_uint32),
+                ("rx_lost", ctypes.c_uint32),
+                ("rx_crcfail", ctypes.c_uint32),
+                ("rx_collided", ctypes.c_uint32),
+                ("rx_missed", ctypes.c_uint32),
+                ("uart_rx", ctypes.c_uint32),
+                ("uart_tx", ctypes.c_uint32),
+                ("uart_ovf", ctypes.c_uint32),
+                ("spm_pages", ctypes.c_uint32),
+                ("resets", ctypes.c_uint32),
+                ("app_starts", ctypes.c_uint32),
+                ("state", ctypes.c_uint8),
+                ("t_app", ctypes.c_uint64)]
+
+class Sim(object):
+    """ SIM_API of libwibosim.so, times in seconds """
+
+    def __init__(self, seed = 1, libdir = HERE):
+        self.libdir = libdir
+        self.lib = ctypes.CDLL(os.path.join(libdir, "libwibosim.so"),
+                               mode = ctypes.RTLD_GLOBAL)
+        l = self.lib
+        l.sim_node_add.argtypes = [ctypes.c_char_p, ctypes.c_uint8,
+                                   ctypes.c_uint16, ctypes.c_uint16, ctypes.c_uint64]
+        l.sim_link.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_double,
+                               ctypes.c_double, ctypes.c_uint32]
+        l.sim_link_default.argtypes = [ctypes.c_double, ctypes.c_double,
+                                       ctypes.c_uint32]
+        l.sim_now.restype = ctypes.c_uint64
+        l.sim_run.argtypes = [ctypes.c_uint64]
+        l.sim_run.restype = ctypes.c_uint64
+        l.sim_uart_write.argtypes = [ctypes.c_int, ctypes.c_char_p, ctypes.c_uint16]
+        l.sim_uart_write.restype = ctypes.c_uint16
+        l.sim_uart_read.argtypes = [ctypes.c_int, ctypes.c_void_p, ctypes.c_uint16]
+        l.sim_uart_read.restype = ctypes.c_uint16
+        l.sim_flash_load.argtypes = [ctypes.c_int, ctypes.c_uint32,
+                                     ctypes.c_char_p, ctypes.c_uint32]
+        l.sim_flash_dump.argtypes = [ctypes.c_int, ctypes.c_uint32,
+                                     ctypes.c_void_p, ctypes.c_uint32]
+        l.sim_airtime.restype = ctypes.c_uint64
+        l.sim_init(seed)
+
+    def close(self):
+        self.lib.sim_exit()
+
+    def add(self, plugin, short_addr, channel = CHANNEL, pan_id = PAN_ID,
+            ieee_addr = 0):
+        """ Add a node running plugin ("node" or "host"), returns its id """
+        nid = self.lib.sim_node_add(os.path.join(self.libdir, plugin + ".so"),
+                                    channel, pan_id, short_addr, ieee_addr)
+        if nid < 0:
+            raise RuntimeError("can't add %s, see make in %s" % (plugin, self.libdir))
+        return nid
+
+    def reset(self, nid):
+        self.lib.sim_node_reset(nid)
+
+    def link(self, loss = 0.0, ber = 0.0, latency_us = 0, frm = None, to = None):
+        """ Default link, or the one from frm to to """
+        if frm == None:
+            self.lib.sim_link_default(loss, ber, latency_us)
+        else:
+            self.lib.sim_link(frm, to, loss, ber, latency_us)
+
+    def now(self):
+        return float(self.lib.sim_now()) / SIM_S
+
+    def run(self, seconds):
+        self.lib.sim_run(self.lib.sim_now() + int(seconds * SIM_S))
+
+    def uart_write(self, nid, data):
+        return self.lib.sim_uart_write(nid, data, len(data))
+
+    def uart_read(self, nid, size = 4096):
+        buf = ctypes.create_string_buffer(size)
+        n = self.lib.sim_uart_read(nid, buf, size)
+        return buf.raw[:n]
+
+    def flash_dump(self, nid, address, size):
+        buf = ctypes.create_string_buffer(size)
+        self.lib.sim_flash_dump(nid, address, buf, size)
+        return buf.raw
+
+    def info(self, nid):
+        inf = SimNodeInfo()
+        self.lib.sim_node_info(nid, ctypes.byref(inf))
+        return inf
+
+    def airtime(self):
+        return float(self.lib.sim_airtime()) / SIM_S
+
+class SimClock(object):
+    """ time.time() and time.sleep() of wibohost.py on the virtual clock """
+
+    def __init__(self, sim):
+        self.sim = sim
+
+    def time(self):
+        return self.sim.now()
+
+    def sleep(self, seconds):
+        self.sim.run(seconds)
+
+    def __getattr__(self, name):
+        return getattr(time, name)
+
+class SimWIBONetwork(WIBONetwork):
+    """ WIBONetwork on the UART of a simulated host, the serial.Serial
+        methods wibohost.py uses run the simulation until the reply is there
+    """
+
+    def __init__(self, sim, nid):
+        WIBONetwork.__init__(self)
+        self.sim = sim
+        self.nid = nid
+        self.rxbuf = ""
+
+    def _fill(self):
+        self.rxbuf += self.sim.uart_read(self.nid)
+
+    def write(self, data):
+        self.sim.uart_write(self.nid, data)
+        return len(data)
+
+    def inWaiting(self):
+        self._fill()
+        return len(self.rxbuf)
+
+    def read(self, size = 1):
+        tend = self.sim.now() + READ_TIMEOUT
+        self._fill()
+        while len(self.rxbuf) < size and self.sim.now() < tend:
+            self.sim.run(READ_STEP)
+            self._fill()
+        ret, self.rxbuf = self.rxbuf[:size], self.rxbuf[size:]
+        return ret
+
+    def readline(self):
+        tend = self.sim.now() + READ_TIMEOUT
+        self._fill()
+        while "\n" not in self.rxbuf and self.sim.now() < tend:
+            self.sim.run(READ_STEP)
+            self._fill()
+        i = self.rxbuf.find("\n") + 1 or len(self.rxbuf)
+        ret, self.rxbuf = self.rxbuf[:i], self.rxbuf[i:]
+        return ret
+
+def random_image(size, seed):
+    """ Hex-file of size random bytes from address 0, returns its name """
+    rnd = random.Random(seed)
+    data = "".join([chr(rnd.getrandbits(8)) for i in range(size)])
+    fd, fname = tempfile.mkstemp(".hex", "wibosim")
+    f = os.fdopen(fd, "w")
+    for a in range(0, size, 16):
+        f.write(hexline(a, data[a:a+16]) + "\n")
+    f.write(":00000001FF\n")
+    f.close()
+    return fname
+
+def flash_ok(sim, nid, mem):
+    """ The flash of the node holds the bytes of mem """
+    lo, hi = min(mem), max(mem) + 1
+    flash = sim.flash_dump(nid, lo, hi - lo)
+    for a, d in mem.iteritems():
+        if ord(flash[a - lo]) != d:
+            return False
+    return True
+
+def run(method, fname, nnodes, binary = False, loss = 0.0, ber = 0.0,
+        latency = 0, seed = 1, verbose = 0):
+    """ Update nnodes simulated nodes with the variant method, returns the
+        report row
+    """
+    cpu = time.time()
+    sim = Sim(seed)
+    random.seed(seed)
+    wibohost.time = SimClock(sim)
+    try:
+        sim.link(loss, ber, latency)
+        host = sim.add("host", HOST_ADDR)
+        addrs = range(1, nnodes + 1)
+        nodes = [sim.add("node", a) for a in addrs]
+        sim.run(BOOT_TIME)
+        h = SimWIBONetwork(sim, host)
+        h.VERBOSE = verbose
+        h.binary = binary
+        h.nodes = wibohost.NodeList([dict(short_addr = a, status = None)
+                                     for a in addrs])
+        t0 = sim.now()
+        if method == "plain":
+            h.flashhex(0xFFFF, fname)
+        elif method == "queued":
+            h.queued = True
+            h.flashhex(0xFFFF, fname)
+        elif method == "windowed":
+            for nid, a in zip(nodes, addrs):
+                sim.reset(nid) # the earlier ones took longer than WIBO_TIMEOUT
+                sim.run(BOOT_TIME)
+                h.flashhex_windowed(a, fname)
+        elif method == "multicast":
+            h.flashhex_multicast(addrs, fname)
+        elif method == "fountain":
+            h.flashhex_fountain(addrs, fname)
+        else:
+            raise ValueError("unknown method %s" % method)
+        seconds = sim.now() - t0
+        ret = h.rtt(0xFFFF)
+        rto = ret['code'] == 'OK' and ret['data']['rto'] or RTO_MAX_US
+        sim.run(BOOT_TIME) # the last pages of the nodes
+        mem = read_hex_mem(fname)
+        infos = [sim.info(n) for n in [host] + nodes]
+        row = dict(method = method, nodes = nnodes,
+                   ok = len([n for n in nodes if flash_ok(sim, n, mem)]),
+                   seconds = round(seconds, 3),
+                   airtime = round(sim.airtime(), 3),
+                   tx_frames = sum([i.tx_frames for i in infos]),
+                   tx_retries = sum([i.tx_retries for i in infos]),
+                   rx_lost = sum([i.rx_lost for i in infos]),
+                   rx_crcfail = sum([i.rx_crcfail for i in infos]),
+                   rto_ms = rto / 1000.0)
+    finally:
+        wibohost.time = time
+        sim.close()
+    row["cpu"] = round(time.time() - cpu, 2)
+    return row
+
+def save(fname, rows):
+    if fname.endswith(".csv"):
+        f = open(fname, "wb")
+        w = csv.DictWriter(f, COLUMNS, extrasaction = "ignore")
+        w.writerow(dict(zip(COLUMNS, COLUMNS)))
+        for r in rows:
+            w.writerow(r)
+        f.close()
+    else:
+        json.dump(rows, open(fname, "w"), indent = 1, sort_keys = True)
+
+if __name__ == "__main__":
+    nnodes = 10
+    methods = METHODS
+    args = dict(binary = False, loss = 0.0, ber = 0.0, latency = 0, seed = 1,
+                verbose = 0)
+    size = 8192
+    outname = None
+    try:
+        opts, files = getopt.getopt(sys.argv[1:], "n:m:bl:e:d:S:s:o:vh")
+        for o, v in opts:
+            if o == "-n":
+                nnodes = int(v)
+            elif o == "-m":
+                methods = v.split(",")
+            elif o == "-b":
+                args["binary"] = True
+            elif o == "-l":
+                args["loss"] = float(v)
+            elif o == "-e":
+                args["ber"] = float(v)
+            elif o == "-d":
+                args["latency"] = int(v)
+            elif o == "-S":
+                size = int(v, 0)
+            elif o == "-s":
+                args["seed"] = int(v)
+            elif o == "-o":
+                outname = v
+            elif o == "-v":
+                args["verbose"] += 1
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if len(files) > 1 or [m for m in methods if m not in METHODS] or \
+                not 0 < nnodes < 1024 or not 0 < size <= 0x10000:
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    fname = files and files[0] or random_image(size, args["seed"])
+    rows = []
+    try:
+        print "%-10s %6s %6s %9s %9s %9s %8s %8s %8s %7s %7s" % ("METHOD",
+            "NODES", "OK", "SECONDS", "AIRTIME", "FRAMES", "RETRIES", "LOST",
+            "CRCFAIL", "RTO", "CPU")
+        for m in methods:
+            r = run(m, fname, nnodes, **args)
+            rows.append(r)
+            print "%-10s %6d %6d %9.2f %9.2f %9d %8d %8d %8d %7.1f %7.2f" % (m,
+                r["nodes"], r["ok"], r["seconds"], r["airtime"], r["tx_frames"],
+                r["tx_retries"], r["rx_lost"], r["rx_crcfail"], r["rto_ms"],
+                r["cpu"])
+            sys.stdout.flush()
+    finally:
+        if not files:
+            os.unlink(fname)
+    if outname:
+        save(outname, rows)
+    sys.exit(len([r for r in rows if r["ok"] != r["nodes"] or
+                  r["rto_ms"] * 1000 >= RTO_MAX_US]) and 1 or 0)
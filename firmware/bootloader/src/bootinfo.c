@@ -0,0 +1,37 @@
+/*
+ * bootinfo.c
+ *
+ * Boot info record for the application, see bootinfo.h
+ */
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "bootinfo.h"
+#include "prof.h"
+
+#if defined(ENABLE_BOOTINFO)
+
+bootinfo_t bootinfo;
+
+/*
+ * \brief Complete the record and copy it for the application
+ */
+void bootinfo_save(void)
+{
+	bootinfo_t *rec = (bootinfo_t *) BOOTINFO_ADDR;
+	uint8_t *p = (uint8_t *) &bootinfo;
+	uint8_t i, x = 0;
+
+	bootinfo.magic = BOOTINFO_MAGIC;
+	bootinfo.time = prof_now();
+	bootinfo.check = 0;
+	for (i = 0; i < sizeof(bootinfo); i++)
+	{
+		x ^= p[i];
+	}
+	bootinfo.check = x;
+	memcpy(rec, &bootinfo, sizeof(bootinfo));
+}
+
+#endif /* defined(ENABLE_BOOTINFO) */
@@ -0,0 +1,49 @@
+/*
+ * bootinfo.h
+ *
+ * Boot info record for the application, built with ENABLE_BOOTINFO.
+ *
+ * The bootloader writes the record into SRAM right before it starts the
+ * application, 256 bytes below RAMEND, where the stack of the
+ * application does not reach early. Read it at the start of setup() (or
+ * from .init3) and check magic and checksum, it is not kept over a reset
+ * of the application. GPIOR0 still carries MCUSR as before.
+ *
+ * The record is saved while main() of the bootloader is still running,
+ * so the bootloader starts its stack right below BOOTINFO_ADDR
+ * (BOOT_STACK_TOP in main.c) and leaves the 256 bytes above to the
+ * records for the application.
+ */
+
+#ifndef BOOTINFO_H_
+#define BOOTINFO_H_
+
+#include <stdint.h>
+
+#define BOOTINFO_ADDR   (RAMEND - 0xFF)	// 16 bytes
+#define BOOTINFO_MAGIC  (0xB1)
+
+/* path: bits set for each part of the bootloader that ran, 0: direct */
+#define BOOTINFO_SERIAL (0x01)	// STK500v2 session
+#define BOOTINFO_WIBO   (0x02)	// WIBO frames received
+#define BOOTINFO_OTAREQ (0x04)	// entered on an OTA request of the application
+
+typedef struct
+{
+	uint8_t magic;	// BOOTINFO_MAGIC
+	uint8_t path;
+	uint8_t mcusr;	// reset cause, same as GPIOR0
+	uint8_t check;	// the bytes of the record XOR to 0
+	uint32_t time;	// ticks of 1024 / F_CPU in the bootloader (64 us at 16 MHz)
+	uint32_t otabytes;	// WIBO data bytes received
+	uint16_t lost;	// frames dropped by a full receive queue or a bad CRC, or reported missing
+	uint16_t crc;	// data CRC of the last WIBO update
+} bootinfo_t;
+
+#if defined(ENABLE_BOOTINFO)
+extern bootinfo_t bootinfo;
+
+void bootinfo_save(void);
+#endif
+
+#endif /* BOOTINFO_H_ */
@@ -76,6 +76,21 @@
 #define CMD_READ_SIGNATURE_HVSP             0x3B
 #define CMD_READ_OSCCAL_HVSP                0x3C
 
+// *****************[ Pinoccio vendor command constants ]**********************
+
+// Request: count (2 bytes, MSB first), starting at the current (page aligned) address.
+// Answer:  STATUS_CMD_OK, count CRC16 values (LSB first, one per flash page), STATUS_CMD_OK.
+// The CRC is _crc_ccitt_update() with start value 0, as used for WIBO data.
+// The address advances by count pages.
+#define CMD_PINOCCIO_PAGE_CRC               0x50
+
+// Request: length in bytes (4 bytes, MSB first), type (1 byte: 0 = CRC16, 1 = CRC32),
+//          starting at the current address.
+// Answer:  STATUS_CMD_OK, CRC (2 or 4 bytes, LSB first), STATUS_CMD_OK.
+// CRC16 is the one of CMD_PINOCCIO_PAGE_CRC, CRC32 is IEEE 802.3 (zlib crc32()).
+// The address is left unchanged.
+#define CMD_PINOCCIO_FLASH_CRC              0x51
+
 // *****************[ STK status constants ]***************************
 
 // Success
@@ -108,6 +123,18 @@
 #define PARAM_RESET_POLARITY                0x9E
 #define PARAM_CONTROLLER_INIT               0x9F
 
+// *****************[ Pinoccio vendor parameters ]***************************
+// Value selects the serial rate after the reply to CMD_SET_PARAMETER:
+// 0 = BAUDRATE (115200), 1 = 250000, 2 = 500000, 3 = 1000000.
+// The bootloader falls back to BAUDRATE if the first frame at the new
+// rate is broken or does not arrive.
+#define PARAM_PINOCCIO_BAUDRATE             0xC0
+// CMD_GET_PARAMETER only: number of flash pages a single CMD_PROGRAM_FLASH_ISP
+// or CMD_READ_FLASH_ISP block may span.
+#define PARAM_PINOCCIO_BLOCKSIZE            0xC1
+// CMD_GET_PARAMETER only: EEPROM bytes still queued for writing (saturates at 255).
+#define PARAM_PINOCCIO_EEPROM_PENDING       0xC2
+
 // *****************[ STK answer constants ]***************************
 
 #define ANSWER_CKSUM_ERROR                  0xB0
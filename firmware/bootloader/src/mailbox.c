@@ -0,0 +1,36 @@
+/*
+ * mailbox.c
+ *
+ * OTA request of the application in SRAM, see mailbox.h
+ */
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "mailbox.h"
+
+#if defined(ENABLE_OTA_MAILBOX)
+
+/*
+ * \brief Copy the request and clear it, call once at boot
+ *
+ * @return 1 if the application left a valid request
+ */
+uint8_t mailbox_take(mailbox_t *req)
+{
+	mailbox_t *mb = (mailbox_t *) MAILBOX_ADDR;
+
+	memcpy(req, mb, sizeof(mailbox_t));
+	mb->magic = 0;
+	if ((req->magic != MAILBOX_MAGIC) || (req->crc != mailbox_crc(req)))
+	{
+		return 0;
+	}
+	if ((req->channel < 11) || (req->channel > 26))
+	{
+		req->channel = 0;
+	}
+	return 1;
+}
+
+#endif /* defined(ENABLE_OTA_MAILBOX) */
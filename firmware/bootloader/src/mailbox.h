@@ -0,0 +1,76 @@
+/*
+ * mailbox.h
+ *
+ * OTA request of the application in SRAM, built with ENABLE_OTA_MAILBOX.
+ *
+ * Instead of clearing EEPROM 8125, the application fills the record
+ * with mailbox_request() and resets through the watchdog. SRAM keeps
+ * its content over that reset, the bootloader takes the record before
+ * its own stack gets near it and clears the magic, so the request is
+ * served once. After a power-up the magic and the CRC do not match.
+ *
+ * The record also tells WIBO where the host is: channel and data rate
+ * of the session and the short address of the host, so the node does
+ * not go through the rendezvous channel and its probe goes to the host
+ * only. The EEPROM flag keeps working for applications that use it.
+ */
+
+#ifndef MAILBOX_H_
+#define MAILBOX_H_
+
+#include <stdint.h>
+#include <util/crc16.h>
+
+/*
+ * 768 bytes below RAMEND. mailbox_take() runs at the start of main(), whose
+ * frame is small since msgBuffer is static; the stack is far above the
+ * record then. Later on the bootloader stack may reach it, the record has
+ * been taken by then.
+ */
+#define MAILBOX_ADDR   (RAMEND - 0x2FF)	// 8 bytes
+#define MAILBOX_MAGIC  (0x0B7A)
+
+#define MAILBOX_ANY_HOST (0xFFFF)
+
+typedef struct
+{
+	uint16_t magic;	// MAILBOX_MAGIC
+	uint8_t channel;	// 11..26, 0: the configured one
+	uint8_t rate;	// data rate hash code of radio.h, e.g. OQPSK1000, 0: 250 kbit/s
+	uint16_t host;	// short address of the host, MAILBOX_ANY_HOST: unknown
+	uint8_t flags;	// reserved, 0
+	uint8_t crc;	// _crc_ibutton_update() over the bytes before
+} mailbox_t;
+
+static inline uint8_t mailbox_crc(const mailbox_t *mb)
+{
+	const uint8_t *p = (const uint8_t *) mb;
+	uint8_t i, crc = 0;
+
+	for (i = 0; i < sizeof(mailbox_t) - 1; i++)
+	{
+		crc = _crc_ibutton_update(crc, p[i]);
+	}
+	return crc;
+}
+
+/*
+ * \brief Application side, fill the record, then reset through the watchdog
+ */
+static inline void mailbox_request(uint8_t channel, uint8_t rate, uint16_t host)
+{
+	mailbox_t *mb = (mailbox_t *) MAILBOX_ADDR;
+
+	mb->magic = MAILBOX_MAGIC;
+	mb->channel = channel;
+	mb->rate = rate;
+	mb->host = host;
+	mb->flags = 0;
+	mb->crc = mailbox_crc(mb);
+}
+
+#if defined(ENABLE_OTA_MAILBOX)
+uint8_t mailbox_take(mailbox_t *req);
+#endif
+
+#endif /* MAILBOX_H_ */
@@ -105,18 +105,32 @@ LICENSE:
 #include  <avr/boot.h>
 #include  <avr/pgmspace.h>
 #include  <util/delay.h>
+#include  <util/crc16.h>
 #include  <avr/eeprom.h>
 #include  <avr/common.h>
 #include  <stdlib.h>
 #include  "command.h"
 
 #include "board.h" // uracoli
+#include "crc_fast.h"
 
 #include "wibo.h"
+#include "prof.h"
+#include "bootinfo.h"
+#include "nodecfg.h"
+#include "mailbox.h"
+#include "spm.h"
+#include "trace.h"
+#include "stackpaint.h"
+#if defined(ENABLE_EEPROM_JOURNAL)
+#include "ee_journal.h"
+#endif
 
 #if defined(_MEGA_BOARD_) || defined(_BOARD_AMBER128_) || defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__) || defined(__AVR_ATmega2561__) || defined(__AVR_ATmega1284P__) || defined(__AVR_ATmega256RFR2__) || defined(ENABLE_MONITOR)
+  #if !defined(BOOTLOADER_CONFIG)	// the debug profile of the Makefile enables it
   #undef    ENABLE_MONITOR
   //#define    ENABLE_MONITOR
+  #endif
   static void  RunMonitor(void);
 #endif
 
@@ -126,12 +140,38 @@ LICENSE:
 #ifndef EEMWE
   #define EEMWE   2
 #endif
+#ifndef EEPE
+  #define EEPE    EEWE
+#endif
+#ifndef EEMPE
+  #define EEMPE   EEMWE
+#endif
+
+/*
+ * The Makefile profiles (PROFILE=minimal|production|debug) select the
+ * features in a generated config.h, included in front of this file.
+ * The defaults below are for builds without it.
+ */
+#if !defined(BOOTLOADER_CONFIG)
 
 //#define  _DEBUG_SERIAL_ (1)
 //#define  _DEBUG_WITH_LEDS_ (1)
 
 #if defined( _PINOCCIO_256RFR2_ )
   #define FANCY_BOOTLOADER_LED		// fancy RGB LED with PWM (zOMG!!)
+  #define ENABLE_PAGE_PIPELINE		// overlap page erase/write with reception of the next frame
+  #define ENABLE_UART_RX_ISR		// receive into a ring buffer from the USART RX interrupt
+  #define ENABLE_UART_TX_ISR		// replies drained from a ring buffer by the USART UDRE interrupt
+  #define ENABLE_AUTOBAUD		// baud rate taken from the first MESSAGE_START of the host
+  #define ENABLE_WIBO_LISTEN		// boot window waits for the UART and the radio at once
+  #define ENABLE_OTA_MAILBOX		// OTA request and session parameters in SRAM, see mailbox.h
+  #define ENABLE_BAUD_SWITCH		// host may switch to 250k/500k/1M via CMD_SET_PARAMETER
+  #define ENABLE_SKIP_UNCHANGED		// do not erase/write pages that already hold the data
+  #define ENABLE_FLASH_VERIFY		// CRC over a flash range instead of reading it back
+  #define ENABLE_BOOT_TIMER		// boot window timed by timer 3, configurable in EEPROM
+  #define ENABLE_EEPROM_STREAM		// EEPROM written in the background, equal bytes skipped
+  #define ENABLE_CHIP_ERASE		// CMD_CHIP_ERASE_ISP erases the application, later writes skip the erase
+  #define ENABLE_STREAM_READ		// CMD_READ_FLASH_ISP sends the words while reading them
 #endif
 
 /*
@@ -140,8 +180,24 @@ LICENSE:
 #define  REMOVE_PROGRAM_LOCK_BIT_SUPPORT    // disable program lock bits
 //#define  REMOVE_BOOTLOADER_LED        // no LED to show active bootloader
 //#define  REMOVE_CMD_SPI_MULTI        // disable processing of SPI_MULTI commands, Remark this line for AVRDUDE <Worapoht>
+//#define  ENABLE_PAGE_PIPELINE        // reply to CMD_PROGRAM_FLASH_ISP before the page is written
+//#define  ENABLE_UART_RX_ISR          // interrupt fed receive ring, needs timer 3 for the timeout
+//#define  ENABLE_UART_TX_ISR          // interrupt drained transmit ring, needs ENABLE_UART_RX_ISR
+//#define  ENABLE_AUTOBAUD             // measure the first MESSAGE_START with timer 4, BAUDRATE is ignored
+//#define  ENABLE_WIBO_LISTEN          // enter WIBO from the boot window on a received frame, not only after an OTA request
+//#define  ENABLE_OTA_MAILBOX          // OTA request in SRAM instead of EEPROM 8125, needs 32k SRAM (mailbox.h)
+//#define  ENABLE_BAUD_SWITCH          // vendor PARAM_PINOCCIO_BAUDRATE, see command.h
+//#define  ENABLE_SKIP_UNCHANGED       // skip equal pages, adds CMD_PINOCCIO_PAGE_CRC
+//#define  ENABLE_FLASH_VERIFY         // adds CMD_PINOCCIO_FLASH_CRC
+//#define  ENABLE_BOOT_TIMER           // boot window from timer 3 and EEPROM 8126
+//#define  ENABLE_EEPROM_STREAM        // reply to CMD_PROGRAM_EEPROM_ISP before the bytes are written
+//#define  ENABLE_CHIP_ERASE           // real CMD_CHIP_ERASE_ISP, one bit of SRAM per application page
+//#define  ENABLE_STREAM_READ          // CMD_READ_FLASH_ISP not limited to MAX_BLOCK_SIZE
+//#define  ENABLE_EEPROM_JOURNAL       // OTA flag, LED and node config also from the wear levelled journal (ee_journal.h)
 //
 
+#endif /* !defined(BOOTLOADER_CONFIG) */
+
 //************************************************************************
 //*  LED on pin "PROGLED_PIN" on port "PROGLED_PORT"
 //*  indicates that bootloader is active
@@ -332,6 +388,12 @@ volatile unsigned char ledToggle = 0;
   #define  UART_RECEIVE_COMPLETE    RXC1
   #define  UART_DATA_REG        UDR1
   #define  UART_DOUBLE_SPEED      U2X1
+  #define  UART_RECEIVE_INTERRUPT  RXCIE1
+  #define  UART_RECEIVE_VECT      USART1_RX_vect
+  #define  UART_UDRE_INTERRUPT    UDRIE1
+  #define  UART_UDRE_VECT        USART1_UDRE_vect
+  #define  UART_RXD_PINREG      PIND
+  #define  UART_RXD_BIT        PD2
 #elif defined(_BOARD_ROBOTX_) || defined(__AVR_AT90USB1287__) || defined(__AVR_AT90USB1286__)
   #define  UART_BAUD_RATE_LOW      UBRR1L
   #define  UART_STATUS_REG        UCSR1A
@@ -342,6 +404,12 @@ volatile unsigned char ledToggle = 0;
   #define  UART_RECEIVE_COMPLETE    RXC1
   #define  UART_DATA_REG        UDR1
   #define  UART_DOUBLE_SPEED      U2X1
+  #define  UART_RECEIVE_INTERRUPT  RXCIE1
+  #define  UART_RECEIVE_VECT      USART1_RX_vect
+  #define  UART_UDRE_INTERRUPT    UDRIE1
+  #define  UART_UDRE_VECT        USART1_UDRE_vect
+  #define  UART_RXD_PINREG      PIND
+  #define  UART_RXD_BIT        PD2
 
 #elif defined(__AVR_ATmega8__) || defined(__AVR_ATmega16__) || defined(__AVR_ATmega32__) \
   || defined(__AVR_ATmega8515__) || defined(__AVR_ATmega8535__)
@@ -369,6 +437,12 @@ volatile unsigned char ledToggle = 0;
   #define  UART_RECEIVE_COMPLETE    RXC0
   #define  UART_DATA_REG        UDR0
   #define  UART_DOUBLE_SPEED      U2X0
+  #define  UART_RECEIVE_INTERRUPT  RXCIE0
+  #define  UART_RECEIVE_VECT      USART0_RX_vect
+  #define  UART_UDRE_INTERRUPT    UDRIE0
+  #define  UART_UDRE_VECT        USART0_UDRE_vect
+  #define  UART_RXD_PINREG      PINE
+  #define  UART_RXD_BIT        PE0
 #elif defined(UBRR0L) && defined(UCSR0A) && defined(TXEN0)
   /* ATMega with two USART, use UART0 */
   #define  UART_BAUD_RATE_LOW      UBRR0L
@@ -395,6 +469,63 @@ volatile unsigned char ledToggle = 0;
   #error "no UART definition for MCU available"
 #endif
 
+#if defined(ENABLE_UART_RX_ISR)
+  #if !defined(UART_RECEIVE_VECT)
+    #error "ENABLE_UART_RX_ISR: no receive interrupt vector for this UART"
+  #endif
+#endif
+
+#if defined(ENABLE_UART_TX_ISR)
+  #if !defined(ENABLE_UART_RX_ISR)
+    #error "ENABLE_UART_TX_ISR needs ENABLE_UART_RX_ISR (vectors and interrupts stay on for the session)"
+  #endif
+  #if !defined(UART_UDRE_VECT)
+    #error "ENABLE_UART_TX_ISR: no data register empty vector for this UART"
+  #endif
+#endif
+
+#if defined(ENABLE_AUTOBAUD)
+  #if !UART_BAUDRATE_DOUBLE_SPEED
+    #error "ENABLE_AUTOBAUD: the measurement assumes UART double speed operation"
+  #endif
+  #if !defined(UART_RXD_PINREG) || !defined(TCNT4)
+    #error "ENABLE_AUTOBAUD: needs the RXD pin of the UART and timer 4"
+  #endif
+#endif
+
+#if defined(ENABLE_WIBO_LISTEN)
+  #if defined(WIBO_FLAVOUR_KEYPRESS) || defined(WIBO_FLAVOUR_MAILBOX)
+    #error "ENABLE_WIBO_LISTEN: wibo_init() would start the application before the boot window"
+  #endif
+#endif
+
+#if defined(ENABLE_OTA_MAILBOX) && (RAMEND < 0x2000)
+  #error "ENABLE_OTA_MAILBOX: MAILBOX_ADDR would be in the data of the bootloader"
+#endif
+
+//*  bootinfo_save(), nodecfg_save() and wibo_radio_save() write the records for
+//*  the application while main() still has its frame on the stack, so the stack
+//*  starts below them. The 256 bytes from BOOTINFO_ADDR up to RAMEND are never
+//*  used by the bootloader.
+#if defined(ENABLE_BOOTINFO) || defined(RADIO_HANDOFF)
+  #define  BOOT_STACK_TOP  (BOOTINFO_ADDR - 1)
+  #if (NODECFG_ADDR <= BOOT_STACK_TOP) || ((NODECFG_ADDR + 16 - 1) > RAMEND)
+    #error "NODECFG_ADDR must be in the SRAM above BOOT_STACK_TOP"
+  #endif
+  #if defined(RADIO_HANDOFF) && ((RADIO_HANDOFF <= BOOT_STACK_TOP) || ((RADIO_HANDOFF + 8 - 1) > RAMEND))
+    #error "RADIO_HANDOFF must be in the SRAM above BOOT_STACK_TOP"
+  #endif
+#else
+  #define  BOOT_STACK_TOP  RAMEND
+#endif
+
+#if defined(ENABLE_UART_RX_ISR) || defined(ENABLE_BOOT_TIMER)
+  #if !defined(TCNT3)
+    #error "timer 3 is needed as time base for ENABLE_UART_RX_ISR / ENABLE_BOOT_TIMER"
+  #endif
+  #define USE_TIMER3
+#endif
+
 /*
  * Macro to calculate UBBR from XTAL and baudrate
  */
@@ -408,6 +539,52 @@ volatile unsigned char ledToggle = 0;
   #define UART_BAUD_SELECT(baudRate,xtalCpu) (((float)(xtalCpu))/(((float)(baudRate))*16.0)-1.0+0.5)
 #endif
 
+#if defined(ENABLE_BAUD_SWITCH)
+  #if !UART_BAUDRATE_DOUBLE_SPEED
+    #error "ENABLE_BAUD_SWITCH: 1 Mbaud needs UART double speed operation"
+  #endif
+/*
+ * UBRR values selected by PARAM_PINOCCIO_BAUDRATE, index is the parameter value.
+ * The bridge (16u2) computes the same divisor in double speed mode, so
+ * the rates above 115200 are exact at 16 MHz.
+ */
+static const unsigned char baudTable[] PROGMEM =
+{
+  UART_BAUD_SELECT(BAUDRATE,F_CPU),
+  UART_BAUD_SELECT(250000,F_CPU),
+  UART_BAUD_SELECT(500000,F_CPU),
+  UART_BAUD_SELECT(1000000,F_CPU),
+};
+
+#if (FLASHEND > 0x10000)
+  //*  the table is in the bootloader section above 64K, out of reach of LPM
+  #define  BAUD_TABLE(i)  pgm_read_byte_far(pgm_get_far_address(baudTable) + (i))
+#else
+  #define  BAUD_TABLE(i)  pgm_read_byte(&baudTable[i])
+#endif
+
+#if defined(ENABLE_AUTOBAUD)
+  #define  UBRR_DEFAULT  ubrrDefault  //*  the measured rate, see autobaud()
+#else
+  #define  UBRR_DEFAULT  BAUD_TABLE(0)
+#endif
+#endif
+
+
+/*
+ * Largest data block of CMD_PROGRAM_FLASH_ISP / CMD_READ_FLASH_ISP, a multiple
+ * of SPM_PAGESIZE. Blocks larger than a page are written page by page.
+ */
+#ifndef MAX_BLOCK_SIZE
+  #if defined( _PINOCCIO_256RFR2_ )
+    #define MAX_BLOCK_SIZE  (4 * SPM_PAGESIZE)
+  #else
+    #define MAX_BLOCK_SIZE  SPM_PAGESIZE
+  #endif
+#endif
+#if (MAX_BLOCK_SIZE % SPM_PAGESIZE)
+  #error "MAX_BLOCK_SIZE must be a multiple of SPM_PAGESIZE"
+#endif
 
 /*
  * States used in the receive state machine
@@ -435,6 +612,19 @@ volatile unsigned char ledToggle = 0;
  */
 void sendchar(char c);
 static unsigned char recchar(void);
+#if defined(ENABLE_UART_TX_ISR)
+static void uart_tx_drain(void);
+#endif
+#if defined(ENABLE_PAGE_PIPELINE)
+static void page_service(void);
+static unsigned char page_flush(void);
+static void page_wait(void);
+static void page_start(address_t address, unsigned char *p, unsigned int size);
+#endif
+#if defined(ENABLE_EEPROM_STREAM)
+static void ee_service(void);
+static void ee_wait(void);
+#endif
 
 /*
  * since this bootloader is not linked against the avr-gcc crt1 functions,
@@ -452,14 +642,14 @@ void __jumpMain(void)
 //*  July 17, 2010  <MLS> Added stack pointer initialzation
 //*  the first line did not do the job on the ATmega128
 
-  asm volatile ( ".set __stack, %0" :: "i" (RAMEND) );
+  asm volatile ( ".set __stack, %0" :: "i" (BOOT_STACK_TOP) );
 
-//*  set stack pointer to top of RAM
+//*  set stack pointer to top of RAM, below the records for the application
 
-  asm volatile ( "ldi  16, %0" :: "i" (RAMEND >> 8) );
+  asm volatile ( "ldi  16, %0" :: "i" (BOOT_STACK_TOP >> 8) );
   asm volatile ( "out %0,16" :: "i" (AVR_STACK_POINTER_HI_ADDR) );
 
-  asm volatile ( "ldi  16, %0" :: "i" (RAMEND & 0x0ff) );
+  asm volatile ( "ldi  16, %0" :: "i" (BOOT_STACK_TOP & 0x0ff) );
   asm volatile ( "out %0,16" :: "i" (AVR_STACK_POINTER_LO_ADDR) );
 
   asm volatile ( "clr __zero_reg__" );                  // GCC depends on register r1 set to 0
@@ -474,6 +664,74 @@ void  PrintString(char *textString);
 void  PrintHexByte(unsigned char theByte);
 
 
+#if defined(ENABLE_UART_TX_ISR)
+//************************************************************************
+//*  Interrupt drained transmit ring
+//*  sendchar() only waits while the ring is full, the UDRE interrupt moves
+//*  the bytes to UDR. A reply is still going out while the next message is
+//*  received and processed. Same 8 bit index scheme as the receive ring.
+//************************************************************************
+#define  TX_RING_SIZE      256
+
+static volatile unsigned char  txRing[TX_RING_SIZE];
+static volatile unsigned char  txHead  =  0;
+static volatile unsigned char  txTail  =  0;
+static unsigned char      txUsed  =  0;  //*  a byte was sent since the last drain
+
+ISR(UART_UDRE_VECT)
+{
+  unsigned char  tail  =  txTail;
+
+  if (tail == txHead)
+  {
+    UART_CONTROL_REG  &=  ~(1 << UART_UDRE_INTERRUPT);  // ring empty
+    return;
+  }
+  UART_STATUS_REG  |=  (1 << UART_TRANSMIT_COMPLETE);  // delete TXCflag, set again after the last byte
+  UART_DATA_REG  =  txRing[tail];
+  txTail      =  tail + 1;
+}
+
+//*****************************************************************************
+/*
+ * queue single byte for the USART, wait only if the ring is full
+ */
+void sendchar(char c)
+{
+  unsigned char  next  =  txHead + 1;
+
+  while (next == txTail)
+  {
+    // wait for room
+  }
+  txRing[txHead]  =  c;
+  txHead      =  next;
+  txUsed      =  1;
+  UART_CONTROL_REG  |=  (1 << UART_UDRE_INTERRUPT);
+}
+
+//*****************************************************************************
+/*
+ * wait until the ring is empty and the last stop bit is out,
+ * needed before the baud rate is changed or the bootloader is left
+ */
+static void uart_tx_drain(void)
+{
+  if (!txUsed)
+  {
+    return;  //*  TXC is not set if nothing was sent
+  }
+  while (UART_CONTROL_REG & (1 << UART_UDRE_INTERRUPT))
+  {
+    // wait for the ring
+  }
+  while (!(UART_STATUS_REG & (1 << UART_TRANSMIT_COMPLETE)))
+  {
+    // wait for the shift register
+  }
+  txUsed  =  0;
+}
+#else
 //*****************************************************************************
 /*
  * send single byte to USART, wait until transmission is completed
@@ -484,7 +742,143 @@ void sendchar(char c)
   while (!(UART_STATUS_REG & (1 << UART_TRANSMIT_COMPLETE)));  // wait until byte sent
   UART_STATUS_REG |= (1 << UART_TRANSMIT_COMPLETE);      // delete TXCflag
 }
+#endif
+
+
+#if defined(USE_TIMER3)
+//************************************************************************
+//*  Timer 3 runs free at F_CPU/1024 (64 us at 16 MHz) as time base for the
+//*  boot window and the receive timeout, a full turn takes about 4 s.
+//************************************************************************
+#define  TIMER_TICKS(ms)  ((uint16_t)((F_CPU / 1024UL) * (ms) / 1000UL))
+#define  BLINK_TICKS  TIMER_TICKS(250)
+
+static void timer_init(void)
+{
+  TCCR3A  =  0;
+  TCCR3B  =  (1 << CS32) | (1 << CS30);  // free running, F_CPU/1024
+}
+
+static void timer_stop(void)
+{
+  TCCR3B  =  0;
+  TCNT3  =  0;
+}
+#endif
+
+#if defined(ENABLE_BOOT_TIMER)
+/*
+ * Boot window when EEPROM 8126 is erased. Roughly what the old
+ * 10000 loop count with _delay_ms(0.001) ticks amounted to.
+ */
+  #ifndef BOOT_WINDOW_MS
+    #define BOOT_WINDOW_MS  500
+  #endif
+#endif
+
+#if defined(BLINK_LED_WHILE_WAITING) && defined(USE_TIMER3)
+  #define BLINK_LED_ISR  // blink from the timer 3 compare match, see blink_start()
+#endif
+
+#if defined(ENABLE_UART_RX_ISR)
+//************************************************************************
+//*  Interrupt fed receive ring
+//*  The ISR only stores UDR, so no byte is lost while the main loop is
+//*  busy with a page write or a reply. The 8 bit indices wrap by themselves,
+//*  a full ring drops the newest byte.
+//*  The receive timeout is taken from timer 3 (F_CPU/1024) instead of
+//*  counting loop iterations.
+//************************************************************************
+#define  RX_RING_SIZE      256
+#ifndef RX_TIMEOUT_MS
+  #define  RX_TIMEOUT_MS    2000
+#endif
+#define  RX_TIMEOUT_TICKS  TIMER_TICKS(RX_TIMEOUT_MS)
+
+static volatile unsigned char  rxRing[RX_RING_SIZE];
+static volatile unsigned char  rxHead  =  0;
+static unsigned char      rxTail  =  0;
+
+ISR(UART_RECEIVE_VECT)
+{
+  unsigned char  c    =  UART_DATA_REG;
+  unsigned char  next  =  rxHead + 1;
+
+  if (next != rxTail)
+  {
+    rxRing[rxHead]  =  c;
+    rxHead      =  next;
+  }
+}
+
+static void uart_rx_isr_init(void)
+{
+  // Point interrupt vectors to bootloader section for the whole session
+  MCUCR = (1 << IVCE);
+  MCUCR = (1 << IVSEL);
+
+  UART_CONTROL_REG  |=  (1 << UART_RECEIVE_INTERRUPT);
+  sei();
+}
+
+static void uart_rx_isr_exit(void)
+{
+  cli();
+  UART_CONTROL_REG  &=  ~(1 << UART_RECEIVE_INTERRUPT);
+
+  // Point interrupt vectors back to main section
+  MCUCR = (1 << IVCE);
+  MCUCR = (0 << IVSEL);
+}
+
+//************************************************************************
+static int  Serial_Available(void)
+{
+  return(rxHead != rxTail);
+}
+
+
+//*****************************************************************************
+/*
+ * Read single byte from the receive ring, block if no data available
+ */
+static unsigned char recchar(void)
+{
+  unsigned char  c;
+
+  while (rxHead == rxTail)
+  {
+    // wait for data
+  }
+  c  =  rxRing[rxTail];
+  rxTail++;
+  return c;
+}
+
+//*****************************************************************************
+static unsigned char recchar_timeout(unsigned char* timedout)
+{
+uint16_t start = TCNT3;
+
+  while (rxHead == rxTail)
+  {
+    // wait for data
+#if defined(ENABLE_PAGE_PIPELINE)
+    page_service();
+#endif
+#if defined(ENABLE_EEPROM_STREAM)
+    ee_service();
+#endif
+    if ((uint16_t)(TCNT3 - start) > RX_TIMEOUT_TICKS)
+    {
+		*timedout = 1;
+		return 0;	// NULL character
+    }
+  }
+  return recchar();
+}
 
+#else
 
 //************************************************************************
 static int  Serial_Available(void)
@@ -515,6 +909,12 @@ uint32_t count = 0;
   while (!(UART_STATUS_REG & (1 << UART_RECEIVE_COMPLETE)))
   {
     // wait for data
+#if defined(ENABLE_PAGE_PIPELINE)
+    page_service();
+#endif
+#if defined(ENABLE_EEPROM_STREAM)
+    ee_service();
+#endif
     count++;
     if (count > MAX_TIME_COUNT)
     {
@@ -524,11 +924,92 @@ uint32_t count = 0;
   }
   return UART_DATA_REG;
 }
+#endif
+
+#if defined(ENABLE_AUTOBAUD)
+//************************************************************************
+//*  Autobaud
+//*  MESSAGE_START (0x1B) on the line, LSB first, in bit times from the
+//*  falling edge of the start bit:
+//*    low 0..1, high 1..3, low 3..4, high 4..6, low 6..9, stop bit from 9
+//*  Timer 4 (F_CPU/8) measures the 3 bit times from the rising edge at 1
+//*  to the one at 4, in double speed mode these are 3 * (UBRR + 1) ticks,
+//*  so the latency of seeing the start bit does not matter. UBRR is set
+//*  during the low phase, the receiver is switched on right after the
+//*  rising edge at 9, in time for the start bit of the next byte. The 8 bit
+//*  times up to there tell a MESSAGE_START from other bytes and noise.
+//*  The receiver is off until then, the byte itself is never received.
+//************************************************************************
+#define  RXD_HIGH  (UART_RXD_PINREG & (1 << UART_RXD_BIT))
+#define  AUTOBAUD_WAIT(cond)  while (cond) { if (TIFR4 & (1 << TOV4)) goto fail; }
+
+static unsigned char  ubrrDefault  =  UART_BAUD_SELECT(BAUDRATE,F_CPU);
+
+static unsigned char autobaud(void)
+{
+  unsigned char  sreg  =  SREG;
+  unsigned char  ucsrb  =  UART_CONTROL_REG | (1 << UART_ENABLE_RECEIVER);
+  uint16_t    t1, t4, t9;
+  uint16_t    div;
+
+  cli();  //*  no ISR between the edges
+  TCCR4A  =  0;
+  TCCR4B  =  0;
+  TCNT4  =  0;
+  TIFR4  =  (1 << TOV4);
+  TCCR4B  =  (1 << CS41);  // F_CPU/8, overflow after 32 ms
+  AUTOBAUD_WAIT(!RXD_HIGH);  // start bit
+  t1  =  TCNT4;
+  AUTOBAUD_WAIT(RXD_HIGH);  // bits 0, 1
+  AUTOBAUD_WAIT(!RXD_HIGH);  // bit 2
+  t4  =  TCNT4 - t1;
+  if (t4 < 255)
+  {
+    //*  (t4 + 1) / 3, no time for a division at 1 Mbaud; unsigned 16 bit,
+    //*  the product passes 32767 from t4 = 191 (28800 baud) on
+    div  =  (uint16_t)((uint16_t)(t4 + 1) * 171u) >> 9;
+  }
+  else
+  {
+    div  =  (t4 + 1) / 3;
+  }
+  if ((div == 0) || (div > 256))
+  {
+    goto fail;
+  }
+  UART_BAUD_RATE_LOW  =  div - 1;
+  AUTOBAUD_WAIT(RXD_HIGH);  // bits 3, 4
+  AUTOBAUD_WAIT(!RXD_HIGH);  // bits 5..7
+  UART_CONTROL_REG  =  ucsrb;  // stop bit
+  t9  =  TCNT4 - t1;
+  TCCR4B  =  0;
+  SREG  =  sreg;
+  if ((t9 < 7 * div) || (t9 > 9 * div))
+  {
+    UART_CONTROL_REG  &=  ~(1 << UART_ENABLE_RECEIVER);  // not a MESSAGE_START
+    UART_BAUD_RATE_LOW  =  ubrrDefault;
+    return 0;
+  }
+  ubrrDefault  =  div - 1;
+  return 1;
+
+fail:
+  TCCR4B  =  0;
+  UART_BAUD_RATE_LOW  =  ubrrDefault;
+  SREG  =  sreg;
+  return 0;
+}
+#endif
 
 ISR(SPM_READY_vect) {} // empty vector, just wake us up
 
 static void spm_wait(void)
 {
+#if defined(ENABLE_PROFILER)
+  uint32_t  t  =  prof_now();
+#endif
+  TRACE(TRACE_SPM, SPMCSR);
+
   // Point interrupt vectors to bootloader section
   MCUCR = (1 << IVCE);
   MCUCR = (1 << IVSEL);
@@ -537,17 +1018,324 @@ static void spm_wait(void)
   SPMCSR |= (1 << SPMIE);
   set_sleep_mode(SLEEP_MODE_IDLE);
   sleep_enable();
-  sei();
-  sleep_cpu();
-  cli();
+  do {
+    // other interrupts (UART receive) may wake us up before SPM is done
+    ENERGY_MARK_ON(ENERGY_SLEEP);
+    sei();
+    sleep_cpu();
+    cli();
+    ENERGY_MARK_OFF(ENERGY_SLEEP);
+  } while (boot_spm_busy());
   sleep_disable();
   // Disable SPM interupt again
   SPMCSR &= ~(1 << SPMIE);
+#if defined(ENABLE_PROFILER)
+  prof_add(PROF_SPM, prof_now() - t);
+#endif
 
+#if defined(ENABLE_UART_RX_ISR)
+  sei();  // receive ring stays active, vectors stay in the bootloader section
+#else
   // Point interrupt vectors back to main section
   MCUCR = (1 << IVCE);
   MCUCR = (0 << IVSEL);
+#endif
+}
+
+#if (FLASHEND > 0x10000)
+  #define read_flash_word(addr)  pgm_read_word_far(addr)
+#else
+  #define read_flash_word(addr)  pgm_read_word_near(addr)
+#endif
+
+#if defined(ENABLE_SKIP_UNCHANGED)
+//*****************************************************************************
+/*
+ * check if a flash page already holds the block, bytes beyond size compare
+ * against the erased value. RWW section must be readable.
+ */
+static unsigned char flash_page_matches(address_t pageAddress, unsigned char *p, unsigned int size)
+{
+  unsigned int  ii;
+
+  for (ii = 0; ii < SPM_PAGESIZE; ii += 2)
+  {
+    unsigned int  data  =  (ii < size) ? (p[ii] | (p[ii + 1] << 8)) : 0xFFFF;
+
+    if (read_flash_word(pageAddress + ii) != data)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+#endif
+
+#if defined(ENABLE_CHIP_ERASE)
+//*****************************************************************************
+/*
+ * CMD_CHIP_ERASE_ISP erases the application section and marks each page,
+ * pages that are blank already are only marked. Writing a marked page
+ * skips its erase and clears the mark.
+ */
+#define APP_PAGES  (APP_END / SPM_PAGESIZE)
+
+static unsigned char  erasedPages[(APP_PAGES + 7) / 8];
+
+//*  return and clear the mark of a page
+static unsigned char page_take_erased(address_t pageAddress)
+{
+  unsigned int  page  =  pageAddress / SPM_PAGESIZE;
+  unsigned char  mask  =  1 << (page & 7);
+
+  if (!(erasedPages[page >> 3] & mask))
+  {
+    return 0;
+  }
+  erasedPages[page >> 3]  &=  ~mask;
+  return 1;
+}
+
+static void chip_erase(void)
+{
+  unsigned int  page, ii;
+  address_t    pageAddress;
+
+  for (page = 0; page < APP_PAGES; page++)
+  {
+    pageAddress  =  (address_t)page * SPM_PAGESIZE;
+    for (ii = 0; ii < SPM_PAGESIZE; ii += 2)
+    {
+      if (read_flash_word(pageAddress + ii) != 0xFFFF)
+      {
+        break;
+      }
+    }
+    if (ii < SPM_PAGESIZE)
+    {
+      spm_page_erase(pageAddress);
+      spm_wait();
+      spm_rww_enable();    // the next page is read for the blank check
+    }
+    erasedPages[page >> 3]  |=  1 << (page & 7);
+  }
+}
+#endif
+
+#if !defined(ENABLE_PAGE_PIPELINE)
+//*****************************************************************************
+/*
+ * erase and write one flash page, bytes beyond size keep the erased value
+ */
+static void flash_write_page(address_t pageAddress, unsigned char *p, unsigned int size)
+{
+#if defined(ENABLE_SKIP_UNCHANGED)
+  if (flash_page_matches(pageAddress, p, size))
+  {
+    return;  // saves the erase/write time and an endurance cycle
+  }
+#endif
+
+  spm_page_fill(pageAddress, p, size);  // the page buffer survives the erase
+
+#if defined(ENABLE_CHIP_ERASE)
+  if (!page_take_erased(pageAddress))
+#endif
+  {
+    spm_page_erase(pageAddress);  // Perform page erase
+    spm_wait();
+  }
+  spm_page_write(pageAddress);
+  spm_wait();
+  spm_rww_enable();        // Re-enable the RWW section
+}
+#endif
+
+#if defined(ENABLE_PAGE_PIPELINE)
+//************************************************************************
+//*  Page pipeline
+//*  CMD_PROGRAM_FLASH_ISP only copies the page into pageBuffer, fills the
+//*  SPM page buffer, starts the erase and replies. page_service() is polled
+//*  while the next frame is received and walks the page through write and
+//*  verify without blocking. Nothing may enable RWW or write the EEPROM
+//*  while a page is pending, the SPM page buffer would be lost. A failed
+//*  verify is reported on the status of the next flash command (or
+//*  CMD_LEAVE_PROGMODE_ISP).
+//************************************************************************
+#define PAGE_IDLE     0
+#define PAGE_ERASING  1
+#define PAGE_WRITING  2
+
+static unsigned char  pageBuffer[SPM_PAGESIZE];
+static address_t    pageAddress;
+static unsigned char  pageState  =  PAGE_IDLE;
+static unsigned char  pageError  =  0;
+#if defined(ENABLE_PROFILER)
+static uint32_t    pageTime;  // erase started
+#endif
+
+static void page_service(void)
+{
+  unsigned int  ii;
+
+  if ((pageState == PAGE_IDLE) || boot_spm_busy())
+  {
+    return;
+  }
+
+  if (pageState == PAGE_ERASING)
+  {
+    spm_page_write(pageAddress);  //*  filled by page_start()
+    pageState  =  PAGE_WRITING;
+  }
+  else
+  {
+    spm_rww_enable();        // Re-enable the RWW section
+    boot_spm_busy_wait();
+    for (ii = 0; ii < SPM_PAGESIZE; ii += 2)
+    {
+      if (read_flash_word(pageAddress + ii) != (pageBuffer[ii] | (pageBuffer[ii + 1] << 8)))
+      {
+        pageError  =  1;
+        break;
+      }
+    }
+    pageState  =  PAGE_IDLE;
+#if defined(ENABLE_PROFILER)
+    prof_add(PROF_SPM, prof_now() - pageTime);
+#endif
+  }
+}
+
+//*  complete a pending page, return its late status and clear it
+static unsigned char page_flush(void)
+{
+  unsigned char  status;
+
+  while (pageState != PAGE_IDLE)
+  {
+    page_service();
+  }
+  status    =  pageError ? STATUS_CMD_FAILED : STATUS_CMD_OK;
+  pageError  =  0;
+  return status;
+}
+
+//*  complete a pending page, keep its status for later
+static void page_wait(void)
+{
+  while (pageState != PAGE_IDLE)
+  {
+    page_service();
+  }
+}
+
+//*  queue one page, bytes beyond size keep the erased value
+static void page_start(address_t address, unsigned char *p, unsigned int size)
+{
+  unsigned int  ii;
+
+  page_wait();
+#if defined(ENABLE_SKIP_UNCHANGED)
+  if (flash_page_matches(address, p, size))
+  {
+    return;  // saves the erase/write time and an endurance cycle
+  }
+#endif
+  for (ii = 0; ii < SPM_PAGESIZE; ii++)
+  {
+    pageBuffer[ii]  =  (ii < size) ? p[ii] : 0xFF;
+  }
+  spm_page_fill(address, pageBuffer, SPM_PAGESIZE);  //*  before the erase, the write follows it at once
+  pageAddress  =  address;
+  pageState  =  PAGE_ERASING;
+#if defined(ENABLE_PROFILER)
+  pageTime  =  prof_now();
+#endif
+#if defined(ENABLE_CHIP_ERASE)
+  if (page_take_erased(address))
+  {
+    return;  // no erase to wait for, page_service() issues the write at once
+  }
+#endif
+  spm_page_erase(address);  // Start page erase, page_service() does the rest
+}
+#endif
+
+#if defined(ENABLE_EEPROM_STREAM)
+//************************************************************************
+//*  EEPROM stream
+//*  CMD_PROGRAM_EEPROM_ISP copies the block into eeBuffer and replies.
+//*  ee_service() is polled while the next frame is received, it starts
+//*  one byte write whenever the EEPROM is ready and skips bytes that
+//*  already hold the value. SPM and EEPROM writes exclude each other, so
+//*  flash commands wait for the stream and EEPROM commands for the page
+//*  pipeline. PARAM_PINOCCIO_EEPROM_PENDING reports the bytes left.
+//************************************************************************
+#define  EE_BUFFER_SIZE  SPM_PAGESIZE
+
+static unsigned char  eeBuffer[EE_BUFFER_SIZE];
+static uint16_t    eeAddress;  //*  EEPROM address of eeBuffer[eeIndex]
+static unsigned int  eeIndex  =  0;
+static unsigned int  eeCount  =  0;
+
+static void ee_service(void)
+{
+  unsigned char  sreg;
+
+  while (eeIndex < eeCount)
+  {
+    if ((EECR & (1 << EEPE)) || boot_spm_busy())
+    {
+      return;  //*  previous write still running
+    }
+    EEAR  =  eeAddress;
+    EECR  |=  (1 << EERE);
+    if (EEDR != eeBuffer[eeIndex])
+    {
+      EEDR  =  eeBuffer[eeIndex];
+      sreg  =  SREG;
+      cli();  //*  EEPE must follow EEMPE within 4 cycles
+      EECR  |=  (1 << EEMPE);
+      EECR  |=  (1 << EEPE);
+      SREG  =  sreg;
+      eeAddress++;
+      eeIndex++;
+      return;
+    }
+    eeAddress++;
+    eeIndex++;
+  }
+}
+
+//*  complete all queued bytes
+static void ee_wait(void)
+{
+  while (eeIndex < eeCount)
+  {
+    ee_service();
+  }
+  while (EECR & (1 << EEPE))
+  {
+    // wait for the last write
+  }
+}
+
+//*  queue a block, waits for the previous one first
+static void ee_queue(uint16_t address, unsigned char *p, unsigned int size)
+{
+  unsigned int  ii;
+
+  ee_wait();
+  for (ii = 0; ii < size; ii++)
+  {
+    eeBuffer[ii]  =  p[ii];
+  }
+  eeAddress  =  address;
+  eeIndex  =  0;
+  eeCount  =  size;
 }
+#endif
 
 //*  for watch dog timer startup
 void (*app_start)(void) = 0x0000;
@@ -558,6 +1346,52 @@ void (*app_start)(void) = 0x0000;
 #define ledsOn() OCR1A = 0xFF - redLedVal; OCR1B = 0xFF - greenLedVal; OCR2A = 0xFF - blueLedVal;
 #define toggleLed() ledToggle = !ledToggle; if (ledToggle) { ledsOn(); } else { ledsOff(); }
 
+#endif
+
+#if defined(BLINK_LED_ISR)
+//************************************************************************
+//*  The LED blinks from the timer 3 compare match while the bootloader
+//*  waits for the host, the wait loop only polls the UART and the window.
+//*  OCR3A steps along the free running counter, timer 3 stays as it is.
+//************************************************************************
+ISR(TIMER3_COMPA_vect)
+{
+  OCR3A  +=  BLINK_TICKS;
+#if defined( _PINOCCIO_256RFR2_ )
+  #if !defined( FANCY_BOOTLOADER_LED )
+  PROGLED_PORT ^= (1<<PROGLED_RED)|(1<<PROGLED_GREEN)|(1<<PROGLED_BLUE);
+  #else
+  toggleLed();
+  #endif
+#else
+  PROGLED_PORT  ^=  (1<<PROGLED_PIN);
+#endif
+}
+
+static void blink_start(void)
+{
+  OCR3A  =  TCNT3 + BLINK_TICKS;
+  TIFR3  =  (1 << OCF3A);
+  TIMSK3  |=  (1 << OCIE3A);
+#if !defined(ENABLE_UART_RX_ISR)
+  // Point interrupt vectors to bootloader section for the boot window
+  MCUCR = (1 << IVCE);
+  MCUCR = (1 << IVSEL);
+  sei();
+#endif
+}
+
+static void blink_stop(void)
+{
+#if !defined(ENABLE_UART_RX_ISR)
+  cli();
+  // Point interrupt vectors back to main section
+  MCUCR = (1 << IVCE);
+  MCUCR = (0 << IVSEL);
+#endif
+  TIMSK3  &=  ~(1 << OCIE3A);
+  OCR3A  =  0;
+}
 #endif
 //*****************************************************************************
 int main(void)
@@ -568,25 +1402,56 @@ int main(void)
   unsigned char  checksum    =  0;
   unsigned char  seqNum      =  0;
   unsigned int  msgLength    =  0;
-  unsigned char  msgBuffer[285];
+  //*  static, in the frame of main() it would cover the SRAM below RAMEND that
+  //*  is read before the first message, see MAILBOX_ADDR in mailbox.h
+  static unsigned char  msgBuffer[MAX_BLOCK_SIZE + 29];
+#if defined(ENABLE_STREAM_READ)
+  unsigned int  streamSize  =  0;  //*  flash bytes sent after msgBuffer, see below
+#endif
   unsigned char  c, *p;
   unsigned char   isLeave = 0;
   unsigned char   isTimeout = 0;
   unsigned char  wdtReset = 0;
   unsigned char badMessage = 0;
+#if defined(ENABLE_BAUD_SWITCH)
+  unsigned char  newBaud    =  0;  //*  baudTable index + 1 to switch to after the reply
+  unsigned char  baudProbe  =  0;  //*  first frame at the new rate is not yet received
+#endif
+#if defined(ENABLE_AUTOBAUD)
+  unsigned char  baudMeasured  =  0;  //*  MESSAGE_START was taken by autobaud()
+#endif
+#if defined(ENABLE_OTA_MAILBOX)
+  mailbox_t    otaReq;
+  unsigned char  otaMailbox  =  0;  //*  otaReq holds the request of the application
+#endif
+#if defined(ENABLE_WIBO_LISTEN)
+  unsigned char  wiboListen  =  0;  //*  radio is on for the boot window
+  unsigned char  wiboFirst  =  0;  //*  a frame came in before any serial data
+#endif
   unsigned long  boot_timeout;
   unsigned long  boot_timer;
   unsigned int  boot_state;
+#if defined(ENABLE_BOOT_TIMER)
+  unsigned char  bootCfg;
+  unsigned char  fastBoot  =  0;
+#endif
+#if defined(BLINK_LED_WHILE_WAITING) && !defined(BLINK_LED_ISR)
+  uint16_t    blinkCount  =  _BLINK_LOOP_COUNT_;
+#endif
 #ifdef ENABLE_MONITOR
   unsigned int  exPointCntr    =  0;
   unsigned int  rcvdCharCntr  =  0;
 #endif
+#if defined(ENABLE_PROFILER)
+  uint32_t    profTime;
+  unsigned char  profCmd;
+#endif
 
   //*  some chips dont set the stack properly
-  asm volatile ( ".set __stack, %0" :: "i" (RAMEND) );
-  asm volatile ( "ldi  16, %0" :: "i" (RAMEND >> 8) );
+  asm volatile ( ".set __stack, %0" :: "i" (BOOT_STACK_TOP) );
+  asm volatile ( "ldi  16, %0" :: "i" (BOOT_STACK_TOP >> 8) );
   asm volatile ( "out %0,16" :: "i" (AVR_STACK_POINTER_HI_ADDR) );
-  asm volatile ( "ldi  16, %0" :: "i" (RAMEND & 0x0ff) );
+  asm volatile ( "ldi  16, %0" :: "i" (BOOT_STACK_TOP & 0x0ff) );
   asm volatile ( "out %0,16" :: "i" (AVR_STACK_POINTER_LO_ADDR) );
 
 
@@ -595,12 +1460,73 @@ int main(void)
   * Do not clear WDT status flag, leave that for the main app
   */
  GPIOR0 = MCUSR;	// store status register in GPIOR0 to provide feedback on reset reason to main app
+#if defined(PROF_TIMEBASE)
+ prof_init();
+#endif
+#if defined(ENABLE_TRACE)
+ trace_init();
+#endif
+ ENERGY_MARK_INIT();
+#if defined(ENABLE_BOOTINFO)
+ bootinfo.mcusr = GPIOR0;
+#endif
+ nodecfg_load();	// radio parameters, once for the bootloader and the application
  
+#if defined(ENABLE_EEPROM_JOURNAL)
+ // OTA request in EEPROM 8125 or as journal record EE_JOURNAL_KEY_OTA, 0 = pending
+ uint8_t otaJournal = 0xFF;
+ ee_journal_read(EE_JOURNAL_KEY_OTA, &otaJournal, 1);
+#endif
+#if defined(ENABLE_OTA_MAILBOX)
+ // SRAM RAMEND - 0x2FF - 8 bytes - OTA request with the session parameters, see mailbox.h
+ if (mailbox_take(&otaReq) && (GPIOR0 & _BV(WDRF)))	// no EEPROM access for it
+ {
+	 wdtReset = 1;
+	 otaMailbox = 1;
+#if defined(ENABLE_BOOTINFO)
+	 bootinfo.path |= BOOTINFO_OTAREQ;
+#endif
+ }
+ else
+#endif
+#if defined(ENABLE_EEPROM_JOURNAL)
+ if (GPIOR0 & _BV(WDRF) && (!(eeprom_read_byte((uint8_t *)8125)) || !otaJournal))
+ {
+	 wdtReset = 1;
+	 if (!otaJournal)
+	 {
+		 otaJournal = 0xFF;
+		 ee_journal_write(EE_JOURNAL_KEY_OTA, &otaJournal, 1);	// clear OTA request
+	 }
+	 eeprom_update_byte((uint8_t *)8125, 0xFF);
+#else
  if (GPIOR0 & _BV(WDRF) && (!(eeprom_read_byte((uint8_t *)8125))))	// If we watchdogged and have an OTA request pending, fly the flag
  {
 	 wdtReset = 1;
 	 eeprom_write_byte((uint8_t *)8125, 0xFF);	// clear OTA request
+#endif
+#if defined(ENABLE_BOOTINFO)
+	 bootinfo.path |= BOOTINFO_OTAREQ;
+#endif
+ }
+#if defined(WIBO_FLAVOUR_DELTA) && !defined(WIBO_FLAVOUR_SLOTS)
+ // Address 8123 - 2 bytes - next page of a broken delta OTA update, 0xFFFF = none
+ if (eeprom_read_word((uint16_t *)8123) != 0xFFFF)	// application is half patched, don't run it
+ {
+	 wdtReset = 1;
  }
+#endif
+#if defined(WIBO_FLAVOUR_RESUME) && !defined(WIBO_FLAVOUR_SLOTS)
+ // Address 8119 - 4 bytes - checkpoint page and data CRC of a broken OTA update, page 0xFFFF = none
+ if (eeprom_read_word((uint16_t *)8119) != 0xFFFF)	// application is half written, don't run it
+ {
+	 wdtReset = 1;
+ }
+#endif
+
+#if defined(ENABLE_STACK_PAINT)
+ stack_paint();	// after mailbox_take(), the request lies in the painted SRAM
+#endif
 
  // make sure watchdog is off!
  __asm__ __volatile__ ("cli");
@@ -610,7 +1536,26 @@ int main(void)
  WDTCSR  =  0;
  __asm__ __volatile__ ("sei");
    
+#if defined(ENABLE_BOOT_TIMER)
+ // Address 8126 - 1 byte - Boot window: 0xFF = BOOT_WINDOW_MS, else
+ //                         bit 0..6 window in 10 ms steps (0 = BOOT_WINDOW_MS),
+ //                         bit 7 skip the window after power-on/brown-out reset
+ bootCfg  =  eeprom_read_byte((uint8_t *)8126);
+ boot_timeout  =  TIMER_TICKS(BOOT_WINDOW_MS);
+ if (bootCfg != 0xFF)
+ {
+	 if (bootCfg & 0x7F)
+	 {
+		 boot_timeout  =  (bootCfg & 0x7F) * TIMER_TICKS(10);
+	 }
+	 if ((bootCfg & 0x80) && (GPIOR0 & (_BV(PORF) | _BV(BORF))) && !(GPIOR0 & _BV(EXTRF)))
+	 {
+		 fastBoot  =  1;	// nobody can be waiting to upload right after power-up
+	 }
+ }
+#else
  boot_timeout  =   10000;    //*  short delay for serial
+#endif
  boot_timer  =  0;
  boot_state  =  0;
 
@@ -632,9 +1577,19 @@ int main(void)
 		TCCR2A |= _BV(COM2A1) | _BV(WGM21) | _BV(WGM20);
 		TCCR2B |= _BV(CS20);
 
-		redLedVal = eeprom_read_byte((uint8_t *)8127);
-		greenLedVal = eeprom_read_byte((uint8_t *)8128);
-		blueLedVal = eeprom_read_byte((uint8_t *)8129);
+#if defined(ENABLE_EEPROM_JOURNAL)
+		uint8_t rgb[3];
+		if (ee_journal_read(EE_JOURNAL_KEY_LED, rgb, sizeof(rgb)) == sizeof(rgb)) {
+			redLedVal = rgb[0];
+			greenLedVal = rgb[1];
+			blueLedVal = rgb[2];
+		} else
+#endif
+		{
+			redLedVal = eeprom_read_byte((uint8_t *)8127);
+			greenLedVal = eeprom_read_byte((uint8_t *)8128);
+			blueLedVal = eeprom_read_byte((uint8_t *)8129);
+		}
 
 		if (redLedVal == 0x00 && greenLedVal == 0x00 && blueLedVal == 0x00) {
 			 redLedVal = 0x00;
@@ -676,6 +1631,15 @@ int main(void)
 #endif
   UART_BAUD_RATE_LOW  =  UART_BAUD_SELECT(BAUDRATE,F_CPU);
   UART_CONTROL_REG  =  (1 << UART_ENABLE_RECEIVER) | (1 << UART_ENABLE_TRANSMITTER);
+#if defined(USE_TIMER3)
+  timer_init();
+#endif
+#if defined(ENABLE_UART_RX_ISR)
+  uart_rx_isr_init();
+#endif
+#if defined(ENABLE_PROFILER)
+  prof_add(PROF_RESET_UART, prof_now());
+#endif
 
   asm volatile ("nop");      // wait until port has changed
 
@@ -702,24 +1666,67 @@ int main(void)
 		}
 		else {
 		  boot_state=0;
+		#if defined(ENABLE_BOOT_TIMER)
+		  boot_timer=TCNT3;
+		#else
 		  boot_timer=0;
+		#endif
 		  isLeave=0;
 		  isTimeout=0;
+		#if defined(BLINK_LED_ISR)
+		  blink_start();
+		#endif
+		#if defined(ENABLE_AUTOBAUD)
+		  UART_CONTROL_REG  &=  ~(1 << UART_ENABLE_RECEIVER);  //*  switched on by autobaud()
+		#endif
+		#if defined(ENABLE_WIBO_LISTEN)
+		  #if defined(ENABLE_BOOT_TIMER)
+		  if (!fastBoot)
+		  #endif
+		  {
+			wibo_init(nodecfg.channel, nodecfg.pan_id, nodecfg.short_addr, nodecfg.ieee_addr);
+			wibo_listen();
+			wiboListen  =  1;
+		  }
+		#endif
 		}
+	#if defined(ENABLE_PROFILER)
+	  profTime  =  prof_now();
+	#endif
 	  while (boot_state==0)
 	  {
 		while ((!(Serial_Available())) && (boot_state == 0))    // wait for data
 		{
+		#if defined(ENABLE_AUTOBAUD)
+		  if (!RXD_HIGH && autobaud())
+		  {
+			baudMeasured  =  1;
+			break;  //*  boot_state is incremented to 1 below
+		  }
+		#endif
+		#if defined(ENABLE_WIBO_LISTEN)
+		  if (wiboListen && wibo_available())
+		  {
+			wiboFirst  =  1;
+			isTimeout  =  1;  //*  same as after an OTA request, see below
+			boot_state  =  1; // get us out, this is incremented to 2 below
+		  }
+		#endif
+		#if defined(ENABLE_BOOT_TIMER)
+		  if (fastBoot || ((uint16_t)(TCNT3 - (uint16_t)boot_timer) > boot_timeout))
+		#else
 		  _delay_ms(0.001);
 		  boot_timer++;
 		  if (boot_timer > boot_timeout)
+		#endif
 		  {
 			  isTimeout = 1;
 			boot_state  =  1; // get us out, this is incremented to 2 below
 		  }
-	#ifdef BLINK_LED_WHILE_WAITING
-		  if ((boot_timer % _BLINK_LOOP_COUNT_) == 0)
+	#if defined(BLINK_LED_WHILE_WAITING) && !defined(BLINK_LED_ISR)
+		  if (--blinkCount == 0)
 		  {
+			blinkCount  =  _BLINK_LOOP_COUNT_;
 			#if defined( _PINOCCIO_256RFR2_ )
 			  #if !defined( FANCY_BOOTLOADER_LED )
 				PROGLED_PORT ^= (1<<PROGLED_RED)|(1<<PROGLED_GREEN)|(1<<PROGLED_BLUE);
@@ -734,7 +1741,31 @@ int main(void)
 	#endif
 		}
 		boot_state++; // increment to 1 for serial bootloader, 2 for other purposes
+	#if defined(ENABLE_BOOT_TIMER)
+		fastBoot  =  0; // no valid application: wait the full window next time
+	#endif
+	  }
+	#if defined(BLINK_LED_ISR)
+	  blink_stop();
+	#endif
+	#if defined(ENABLE_WIBO_LISTEN)
+	  if (wiboListen && !wiboFirst)
+	  {
+		wibo_stop();  //*  serial data or nothing at all
+		#if !defined(ENABLE_UART_RX_ISR)
+		cli();
+		// Point interrupt vectors back to main section
+		MCUCR = (1 << IVCE);
+		MCUCR = (0 << IVSEL);
+		#endif
+	  }
+	#endif
+	#if defined(ENABLE_PROFILER)
+	  if (!wdtReset)
+	  {
+		prof_add(PROF_WAIT, prof_now() - profTime);
 	  }
+	#endif
 
 	  if (boot_state==1) // enter serial bootloader
 	  {
@@ -750,7 +1781,15 @@ int main(void)
 			if (boot_state==1)
 			{
 			  boot_state  =  0;
-			  c      =  UART_DATA_REG;
+			#if defined(ENABLE_AUTOBAUD)
+			  if (baudMeasured)
+			  {
+				baudMeasured  =  0;
+				c      =  MESSAGE_START;
+			  }
+			  else
+			#endif
+			  c      =  recchar();  //*  already received, does not block
 			}
 			else
 			{
@@ -789,6 +1828,15 @@ int main(void)
 				}
 				else
 				{
+				#if defined(ENABLE_BAUD_SWITCH)
+					if (baudProbe)
+					{
+						//*  garbage at the new rate, go back to the default one
+						UART_BAUD_RATE_LOW  =  UBRR_DEFAULT;
+						baudProbe  =  0;
+						break;
+					}
+				#endif
 					if (badMessage++ > 5) { isTimeout = 1; }	// isLeave is now a forced boot to main app
 				}
 				break;
@@ -822,6 +1870,10 @@ int main(void)
 				msgLength    |=  c;
 				msgParseState  =  ST_GET_TOKEN;
 				checksum    ^=  c;
+				if ((msgLength == 0) || (msgLength > sizeof(msgBuffer)))
+				{
+				  msgParseState  =  ST_START;  //*  would overrun msgBuffer
+				}
 				break;
 
 			  case ST_GET_TOKEN:
@@ -855,13 +1907,39 @@ int main(void)
 				{
 				  msgParseState  =  ST_START;
 				}
+			  #if defined(ENABLE_BAUD_SWITCH)
+				if (baudProbe && (msgParseState != ST_PROCESS))
+				{
+				  UART_BAUD_RATE_LOW  =  UBRR_DEFAULT;
+				}
+				baudProbe  =  0;
+			  #endif
 				break;
 			}  //  switch
 		  }  //  while(msgParseState)
 
+		#if defined(ENABLE_BAUD_SWITCH)
+		  if (baudProbe && isTimeout)
+		  {
+			//*  host did not follow to the new rate, wait for it at the default one
+			UART_BAUD_RATE_LOW  =  UBRR_DEFAULT;
+			baudProbe  =  0;
+			isTimeout  =  0;
+			continue;
+		  }
+		#endif
+
 		  /*
 		   * Now process the STK500 commands, see Atmel Appnote AVR068
 		   */
+		#if defined(ENABLE_PROFILER)
+		  profCmd  =  msgBuffer[0];
+		  profTime  =  prof_now();
+		#endif
+		  TRACE(TRACE_STK_CMD, msgBuffer[0]);
+		#if defined(ENABLE_BOOTINFO)
+		  bootinfo.path  |=  BOOTINFO_SERIAL;
+		#endif
 
 		  switch (msgBuffer[0])
 		  {
@@ -967,6 +2045,14 @@ int main(void)
 				case PARAM_SW_MINOR:
 				  value  =  CONFIG_PARAM_SW_MINOR;
 				  break;
+				case PARAM_PINOCCIO_BLOCKSIZE:
+				  value  =  MAX_BLOCK_SIZE / SPM_PAGESIZE;
+				  break;
+			#if defined(ENABLE_EEPROM_STREAM)
+				case PARAM_PINOCCIO_EEPROM_PENDING:
+				  value  =  ((eeCount - eeIndex) > 255) ? 255 : (eeCount - eeIndex);
+				  break;
+			#endif
 				default:
 				  value  =  0;
 				  break;
@@ -979,9 +2065,35 @@ int main(void)
 
 			case CMD_LEAVE_PROGMODE_ISP:
 			  isLeave  =  1;
+		  #if defined(ENABLE_EEPROM_STREAM)
+			  ee_wait();
+		  #endif
+		  #if defined(ENABLE_PAGE_PIPELINE)
+			  msgLength    =  2;
+			  msgBuffer[1]  =  page_flush();  //*  late status of the last page
+			  break;
+		  #endif
 			  //*  fall thru
 
 			case CMD_SET_PARAMETER:
+		  #if defined(ENABLE_BAUD_SWITCH)
+			  //*  CMD_LEAVE_PROGMODE_ISP falls in here too, its byte 1 is the preDelay
+			  if ((msgBuffer[0] == CMD_SET_PARAMETER) && (msgBuffer[1] == PARAM_PINOCCIO_BAUDRATE))
+			  {
+				msgLength    =  2;
+				if (msgBuffer[2] < sizeof(baudTable))
+				{
+				  newBaud      =  msgBuffer[2] + 1;  //*  switch after the reply is sent
+				  msgBuffer[1]  =  STATUS_CMD_OK;
+				}
+				else
+				{
+				  msgBuffer[1]  =  STATUS_CMD_FAILED;
+				}
+				break;
+			  }
+		  #endif
+			  //*  fall thru
 			case CMD_ENTER_PROGMODE_ISP:
 			  msgLength    =  2;
 			  msgBuffer[1]  =  STATUS_CMD_OK;
@@ -1052,8 +2164,20 @@ int main(void)
 	  #endif
 			case CMD_CHIP_ERASE_ISP:
 			  msgLength    =  2;
+		#if defined(ENABLE_CHIP_ERASE)
+			#if defined(ENABLE_PAGE_PIPELINE)
+			  msgBuffer[1]  =  page_flush();
+			#else
+			  msgBuffer[1]  =  STATUS_CMD_OK;
+			#endif
+			#if defined(ENABLE_EEPROM_STREAM)
+			  ee_wait();  //*  no SPM while the EEPROM is written
+			#endif
+			  chip_erase();
+		#else
 			//  msgBuffer[1]  =  STATUS_CMD_OK;
 			  msgBuffer[1]  =  STATUS_CMD_FAILED;  //*  isue 543, return FAILED instead of OK
+		#endif
 			  break;
 
 			case CMD_LOAD_ADDRESS:
@@ -1071,39 +2195,44 @@ int main(void)
 			  {
 				unsigned int  size  =  ((msgBuffer[1])<<8) | msgBuffer[2];
 				unsigned char  *p  =  msgBuffer+10;
-				unsigned int  data;
-				unsigned char  highByte, lowByte;
-				address_t tempAddress;
-			
+
+			#if defined(ENABLE_PAGE_PIPELINE)
+				//*  previous page must be done before its buffer is reused (or EEPROM written)
+				page_wait();
+			#endif
+			#if defined(ENABLE_EEPROM_STREAM)
+				if ( msgBuffer[0] == CMD_PROGRAM_FLASH_ISP )
+				{
+				  ee_wait();  //*  no SPM while the EEPROM is written
+				}
+			#endif
+
 				if ( msgBuffer[0] == CMD_PROGRAM_FLASH_ISP )
 				{
 				  // erase only main section (bootloader protection)
-				  if ((!(size % 2)) && (!(address % SPM_PAGESIZE)) && (size <= SPM_PAGESIZE) && (address + size <= APP_END))
+				  if ((!(size % 2)) && (!(address % SPM_PAGESIZE)) && (size <= MAX_BLOCK_SIZE) && (address + size <= APP_END))
 				  {
-				  
-					boot_page_erase(address);  // Perform page erase
-					spm_wait();
-								  
-					/* Write FLASH */
-					tempAddress = address;
-					do {
-					
-						lowByte    =  *p++;
-						highByte   =  *p++;
-					
-						data    =  (highByte << 8) | lowByte;
-						boot_page_fill(tempAddress,data);
-
-						tempAddress  =  tempAddress + 2;  // Select next word in memory
-						size  -=  2;        // Reduce number of bytes to write by two
-					} while (size);          // Loop until all bytes written
-
-					boot_page_write(address);
-					spm_wait();
-					boot_rww_enable();        // Re-enable the RWW section
-				
 					msgLength    =  2;
-					msgBuffer[1]  =  STATUS_CMD_OK;				
+				#if defined(ENABLE_PAGE_PIPELINE)
+					msgBuffer[1]  =  page_flush();  //*  late status of the previous block
+				#else
+					msgBuffer[1]  =  STATUS_CMD_OK;
+				#endif
+
+					//*  a block may span several pages, they are written one after the other
+					while (size)
+					{
+						unsigned int  chunk  =  (size > SPM_PAGESIZE) ? SPM_PAGESIZE : size;
+
+					#if defined(ENABLE_PAGE_PIPELINE)
+						page_start(address, p, chunk);
+					#else
+						flash_write_page(address, p, chunk);
+					#endif
+						address  +=  SPM_PAGESIZE;
+						p    +=  chunk;
+						size  -=  chunk;
+					}
 				  }
 				  else
 				  {
@@ -1115,6 +2244,25 @@ int main(void)
 				{
 					//*  issue 543, this should work, It has not been tested.
 					uint16_t ii = address >> 1;
+
+				#if defined(ENABLE_EEPROM_STREAM)
+					msgLength    =  2;
+					if ((unsigned long)ii + size > (E2END + 1))
+					{
+						msgBuffer[1]  =  STATUS_CMD_FAILED;
+						break;
+					}
+					while (size) {
+						unsigned int  chunk  =  (size > EE_BUFFER_SIZE) ? EE_BUFFER_SIZE : size;
+
+						ee_queue(ii, p, chunk);  //*  ee_service() writes it in the background
+						address  +=  2 * chunk;
+						ii    +=  chunk;
+						p    +=  chunk;
+						size  -=  chunk;
+					}
+					msgBuffer[1]  =  STATUS_CMD_OK;
+				#else
 					/* write EEPROM */
 					while (size) {
 						eeprom_write_byte((uint8_t*)ii, *p++);
@@ -1124,6 +2272,7 @@ int main(void)
 					}
 					msgLength    =  2;
 					msgBuffer[1]  =  STATUS_CMD_OK;
+				#endif
 				}
 			  }
 			  break;
@@ -1135,6 +2284,37 @@ int main(void)
 				unsigned char  *p    =  msgBuffer+1;
 				msgLength        =  size+3;
 
+			#if defined(ENABLE_STREAM_READ)
+				if (msgBuffer[0] == CMD_READ_FLASH_ISP)
+				{
+				  //*  the words are read while sending the reply, so the size is only
+				  //*  limited by the length field of the message and the end of flash
+				  if ((size == 0) || (size & 1) || (size > 0xFFFF - 3) || (address + size > (address_t)FLASHEND + 1))
+				  {
+					msgLength    =  2;
+					msgBuffer[1]  =  STATUS_CMD_FAILED;
+					break;
+				  }
+				#if defined(ENABLE_PAGE_PIPELINE)
+				  page_wait();  //*  RWW section is not readable while a page is written
+				#endif
+				  msgBuffer[1]  =  STATUS_CMD_OK;
+				  streamSize  =  size;
+				  break;
+				}
+			#endif
+
+				if ((size == 0) || (size > MAX_BLOCK_SIZE))
+				{
+				  msgLength    =  2;
+				  msgBuffer[1]  =  STATUS_CMD_FAILED;  //*  reply would not fit into msgBuffer
+				  break;
+				}
+
+			#if defined(ENABLE_PAGE_PIPELINE)
+				page_wait();  //*  RWW section is not readable while a page is written
+			#endif
+
 				*p++  =  STATUS_CMD_OK;
 				if (msgBuffer[0] == CMD_READ_FLASH_ISP )
 				{
@@ -1157,10 +2337,15 @@ int main(void)
 				else
 				{
 				  /* Read EEPROM */
+				#if defined(ENABLE_EEPROM_STREAM)
+				  ee_wait();
+				#endif
 				  do {
-					EEARL  =  address;      // Setup EEPROM address
-					EEARH  =  ((address >> 8));
-					address++;          // Select next EEPROM byte
+					//*  same (doubled) address scheme as CMD_PROGRAM_EEPROM_ISP in every
+					//*  build: the host loads the byte address, CMD_LOAD_ADDRESS doubles it
+					EEARL  =  address >> 1;      // Setup EEPROM address
+					EEARH  =  ((address >> 9));
+					address  +=  2;        // Select next EEPROM byte
 					EECR  |=  (1<<EERE);      // Read EEPROM
 					*p++  =  EEDR;        // Send EEPROM data
 					size--;
@@ -1170,6 +2355,78 @@ int main(void)
 			  }
 			  break;
 
+	  #if defined(ENABLE_SKIP_UNCHANGED)
+			case CMD_PINOCCIO_PAGE_CRC:
+			  {
+				unsigned int  count  =  ((msgBuffer[1])<<8) | msgBuffer[2];
+				unsigned char  *p    =  msgBuffer+1;
+
+			#if defined(ENABLE_PAGE_PIPELINE)
+				page_wait();  //*  RWW section is not readable while a page is written
+			#endif
+				//*  count is bounded before it is doubled, count * 2 would wrap in 16 bit
+				if ((count == 0) || (count > (sizeof(msgBuffer) - 3) / 2) || (address % SPM_PAGESIZE))
+				{
+				  msgLength    =  2;
+				  msgBuffer[1]  =  STATUS_CMD_FAILED;
+				  break;
+				}
+				msgLength  =  count * 2 + 3;
+				*p++    =  STATUS_CMD_OK;
+				do {
+				  uint16_t  crc  =  crc_ccitt_flash(0, address, SPM_PAGESIZE);  //*  same start value as the WIBO data CRC
+
+				  *p++    =  (unsigned char)crc;    //LSB
+				  *p++    =  (unsigned char)(crc >> 8);  //MSB
+				  address  +=  SPM_PAGESIZE;
+				} while (--count);
+				*p++  =  STATUS_CMD_OK;
+			  }
+			  break;
+	  #endif
+
+	  #if defined(ENABLE_FLASH_VERIFY)
+			case CMD_PINOCCIO_FLASH_CRC:
+			  {
+				address_t  length  =  ((address_t)(msgBuffer[1])<<24)|((address_t)(msgBuffer[2])<<16)|((address_t)(msgBuffer[3])<<8)|(msgBuffer[4]);
+				unsigned char  crcType  =  msgBuffer[5];
+				unsigned char  *p  =  msgBuffer+1;
+				uint32_t    crc;
+
+			#if defined(ENABLE_PAGE_PIPELINE)
+				page_wait();  //*  RWW section is not readable while a page is written
+			#endif
+				//*  address + length could wrap, the length is checked against the rest of the flash
+				if ((length == 0) || (address > (address_t)FLASHEND) ||
+				    (length > (address_t)FLASHEND + 1 - address) || (crcType > 1))
+				{
+				  msgLength    =  2;
+				  msgBuffer[1]  =  STATUS_CMD_FAILED;
+				  break;
+				}
+				if (crcType == 0)
+				{
+				  crc    =  crc_ccitt_flash(0, address, length);
+				  msgLength  =  5;
+				}
+				else
+				{
+				  crc    =  crc32_flash(0, address, length);  //*  matches zlib's crc32() on the host
+				  msgLength  =  7;
+				}
+				*p++  =  STATUS_CMD_OK;
+				*p++  =  (unsigned char)crc;    //LSB first
+				*p++  =  (unsigned char)(crc >> 8);
+				if (crcType != 0)
+				{
+				  *p++  =  (unsigned char)(crc >> 16);
+				  *p++  =  (unsigned char)(crc >> 24);
+				}
+				*p++  =  STATUS_CMD_OK;
+			  }
+			  break;
+	  #endif
+
 			default:
 			  msgLength    =  2;
 			  msgBuffer[1]  =  STATUS_CMD_FAILED;
@@ -1197,6 +2454,12 @@ int main(void)
 		  checksum ^= TOKEN;
 
 		  p  =  msgBuffer;
+		#if defined(ENABLE_STREAM_READ)
+		  if (streamSize)
+		  {
+			msgLength  =  2;  //*  command and status, the data follows from flash
+		  }
+		#endif
 		  while ( msgLength )
 		  {
 			c  =  *p++;
@@ -1204,8 +2467,57 @@ int main(void)
 			checksum ^=c;
 			msgLength--;
 		  }
+		#if defined(ENABLE_STREAM_READ)
+		  if (streamSize)
+		  {
+			//*  the next word is read while the USART shifts out the last byte
+			do {
+			  unsigned int data  =  read_flash_word(address);
+
+			  c      =  (unsigned char)data;    //LSB
+			  sendchar(c);
+			  checksum  ^=  c;
+			  c      =  (unsigned char)(data >> 8);  //MSB
+			  sendchar(c);
+			  checksum  ^=  c;
+			  address  +=  2;
+			  streamSize  -=  2;
+			} while (streamSize);
+			sendchar(STATUS_CMD_OK);
+			checksum  ^=  STATUS_CMD_OK;
+		  }
+		#endif
 		  sendchar(checksum);
 		  seqNum++;
+		  TRACE(TRACE_STK_DONE, msgBuffer[0]);
+
+		#if defined(ENABLE_PROFILER)
+		  if (profCmd == CMD_PROGRAM_FLASH_ISP)
+		  {
+			prof_add(PROF_FLASH_PROG, prof_now() - profTime);
+		  }
+		  else if (profCmd == CMD_READ_FLASH_ISP)
+		  {
+			prof_add(PROF_FLASH_READ, prof_now() - profTime);
+		  }
+		#endif
+
+		#if defined(ENABLE_BAUD_SWITCH)
+		  if (newBaud)
+		  {
+		  #if defined(ENABLE_UART_TX_ISR)
+			uart_tx_drain();
+		  #endif
+			//*  the last stop bit of the reply is out, safe to switch now
+		  #if defined(ENABLE_AUTOBAUD)
+			UART_BAUD_RATE_LOW  =  (newBaud == 1) ? UBRR_DEFAULT : BAUD_TABLE(newBaud - 1);
+		  #else
+			UART_BAUD_RATE_LOW  =  BAUD_TABLE(newBaud - 1);
+		  #endif
+			baudProbe  =  (newBaud != 1);
+			newBaud    =  0;
+		  }
+		#endif
 
 		#ifndef REMOVE_BOOTLOADER_LED
 			#if defined( _PINOCCIO_256RFR2_ )
@@ -1226,7 +2538,11 @@ int main(void)
  
 	  else {
 	  
+	  #if defined(ENABLE_WIBO_LISTEN)
+		 if (wdtReset || wiboFirst) {
+	  #else
 		 if (wdtReset) {
+	  #endif
 
 			  #ifdef FANCY_BOOTLOADER_LED	// turn PWM off in preparation for wibo.  leave port directions configured.
 
@@ -1243,31 +2559,38 @@ int main(void)
 				  #endif
 			  #endif
 
-			  /* decide here where to fetch IEEE 802.15.4 comm parameters */
-			  #if defined(_PINOCCIO_256RFR2_)
-			  // Address 8130 - 32 bytes - HQ Token
-			  // Address 8162 - 16 bytes - Security Key
-			  // Address 8178 - 1 byte   - Transmitter Power
-			  // Address 8179 - 1 byte   - Frequency Channel
-			  // Address 8180 - 2 bytes  - Network Identifier/Troop ID
-			  // Address 8182 - 2 bytes  - Network Address/Scout ID
-			  // Address 8184 - 4 bytes  - Unique ID
-			  // Address 8188 - 2 bytes  - HW family
-			  // Address 8190 - 1 byte   - HW Version
-			  // Address 8191 - 1 byte   - EEPROM Version
-				wibo_init(eeprom_read_byte((uint8_t *)8179), eeprom_read_word((uint16_t *)8180), eeprom_read_word((uint16_t *)8182), 0);
-			  #else
-				node_config_t nodeconfig;
-				get_node_config(&nodeconfig);
-				wibo_init(nodeconfig.channel ,nodeconfig.pan_id ,nodeconfig.short_addr, nodeconfig.ieee_addr);
-			  #endif
+			  /* IEEE 802.15.4 comm parameters, read at boot, see nodecfg.h
+			   * Address 8130 - 32 bytes - HQ Token
+			   * Address 8162 - 16 bytes - Security Key
+			   * Address 8178 - 14 bytes - node config map
+			   */
+			#if defined(ENABLE_WIBO_LISTEN)
+				if (!wiboFirst)	// else the radio is on since the boot window, the frame is waiting
+			#endif
+				wibo_init(nodecfg.channel, nodecfg.pan_id, nodecfg.short_addr, nodecfg.ieee_addr);
+			#if defined(ENABLE_OTA_MAILBOX)
+				if (otaMailbox)
+				{
+					wibo_handoff(otaReq.channel, otaReq.rate, otaReq.host);
+				}
+			#endif
 		 
 				wibo_run();
 		 }
 
 	  }
 
-		boot_rww_enable();        // enable application section so we can read from it
+	#if defined(ENABLE_PAGE_PIPELINE)
+		page_wait();              // a timed out session may still have a page in flight
+	#endif
+	#if defined(ENABLE_EEPROM_STREAM)
+		ee_wait();
+	#endif
+		spm_rww_enable();        // enable application section so we can read from it
+	#if defined(WIBO_FLAVOUR_SLOTS)
+		// Address 8112 - 7 bytes - boot pointer 0xA5 = install the staged OTA image, length, CRC
+		wibo_slot_install();      // also completes a copy cut short by power loss
+	#endif
 		
 		unsigned int  data;
 		#if (FLASHEND > 0x10000)
@@ -1278,6 +2601,21 @@ int main(void)
 
 		  if ((isLeave) || (isTimeout && (data != 0xffff)))          //*  require valid flash address on timeout
 		  {
+			#if defined(ENABLE_BOOTINFO)
+				bootinfo_save();     // SRAM RAMEND - 0xFF, see bootinfo.h
+				nodecfg_save();      // SRAM RAMEND - 0xEF, see nodecfg.h
+			#endif
+			#if defined(RADIO_HANDOFF)
+				wibo_radio_save();   // SRAM RAMEND - 0xDF, see get_radio_handoff() in board.h
+			#endif
+			#if defined(ENABLE_PROFILER)
+				// Address 8042 - 70 bytes - profiler summary, see prof.h
+				prof_save();
+			#endif
+				TRACE(TRACE_APP, data);
+			#if defined(PROF_TIMEBASE)
+				prof_stop();
+			#endif
 
 				#ifdef _DEBUG_SERIAL_
 				  sendchar('j');
@@ -1328,7 +2666,16 @@ int main(void)
 				   * Now leave bootloader
 				   */
 
+				#if defined(ENABLE_UART_TX_ISR)
+				  uart_tx_drain();  //*  the last reply is still in the ring
+				#endif
 				  UART_STATUS_REG  &=  0xfd;
+				#if defined(ENABLE_UART_RX_ISR)
+				  uart_rx_isr_exit();
+				#endif
+				#if defined(USE_TIMER3)
+				  timer_stop();
+				#endif
 
 				  #ifdef FANCY_BOOTLOADER_LED	// turn timers and LED off
   
@@ -1438,6 +2785,7 @@ void  PrintDecInt(int theNumber, int digitCnt);
   const char  gTextMsg_HELP_MSG_QM[]    PROGMEM  =  "?=CPU stats";
   const char  gTextMsg_HELP_MSG_AT[]    PROGMEM  =  "@=EEPROM test";
   const char  gTextMsg_HELP_MSG_B[]    PROGMEM  =  "B=Blink LED";
+  const char  gTextMsg_HELP_MSG_D[]    PROGMEM  =  "D=Binary dump";
   const char  gTextMsg_HELP_MSG_E[]    PROGMEM  =  "E=Dump EEPROM";
   const char  gTextMsg_HELP_MSG_F[]    PROGMEM  =  "F=Dump FLASH";
   const char  gTextMsg_HELP_MSG_H[]    PROGMEM  =  "H=Help";
@@ -1445,6 +2793,11 @@ void  PrintDecInt(int theNumber, int digitCnt);
 //  const char  gTextMsg_HELP_MSG_Q[]    PROGMEM  =  "Q=Quit & jump to user pgm";
   const char  gTextMsg_HELP_MSG_Q[]    PROGMEM  =  "Q=Quit";
   const char  gTextMsg_HELP_MSG_R[]    PROGMEM  =  "R=Dump RAM";
+#if defined(ENABLE_STACK_PAINT)
+  const char  gTextMsg_HELP_MSG_S[]    PROGMEM  =  "S=Stack peak & free SRAM";
+  const char  gTextMsg_STACK_PEAK[]    PROGMEM  =  "Stack peak=0x";
+  const char  gTextMsg_SRAM_FREE[]    PROGMEM  =  "Free SRAM =0x";
+#endif
   const char  gTextMsg_HELP_MSG_V[]    PROGMEM  =  "V=show interrupt Vectors";
   const char  gTextMsg_HELP_MSG_Y[]    PROGMEM  =  "Y=Port blink";
 
@@ -1637,6 +2990,30 @@ enum
   kDUMP_RAM
 };
 
+//************************************************************************
+static unsigned char  ReadMemByte(unsigned char dumpWhat, unsigned long theAddress)
+{
+unsigned char  *ramPtr;
+
+  ramPtr  =  0;
+  switch(dumpWhat)
+  {
+    case kDUMP_FLASH:
+    #if (FLASHEND > 0x10000)
+      return pgm_read_byte_far(theAddress);
+    #else
+      return pgm_read_byte_near(theAddress);
+    #endif
+
+    case kDUMP_EEPROM:
+      return eeprom_read_byte((uint8_t *)(uint16_t)theAddress);
+
+    case kDUMP_RAM:
+      return ramPtr[theAddress];
+  }
+  return 0;
+}
+
 //************************************************************************
 static void  DumpHex(unsigned char dumpWhat, unsigned long startAddress, unsigned char numRows)
 {
@@ -1644,11 +3021,8 @@ unsigned long  myAddressPointer;
 uint8_t      ii;
 unsigned char  theValue;
 char      asciiDump[18];
-unsigned char  *ramPtr;
 
 
-  ramPtr        =  0;
-  theValue      =  0;
   myAddressPointer  =  startAddress;
   while (numRows > 0)
   {
@@ -1665,25 +3039,7 @@ unsigned char  *ramPtr;
     asciiDump[0]    =  0;
     for (ii=0; ii<16; ii++)
     {
-      switch(dumpWhat)
-      {
-        case kDUMP_FLASH:
-        #if (FLASHEND > 0x10000)
-          theValue  =  pgm_read_byte_far(myAddressPointer);
-        #else
-          theValue  =  pgm_read_byte_near(myAddressPointer);
-        #endif
-          break;
-
-        case kDUMP_EEPROM:
-          theValue  =  eeprom_read_byte((uint8_t *)(uint16_t)myAddressPointer);
-          break;
-
-        case kDUMP_RAM:
-          theValue  =  ramPtr[myAddressPointer];
-          break;
-
-      }
+      theValue  =  ReadMemByte(dumpWhat, myAddressPointer);
       PrintHexByte(theValue);
       sendchar(0x20);
       if ((theValue >= 0x20) && (theValue < 0x7f))
@@ -1707,6 +3063,115 @@ unsigned char  *ramPtr;
 
 
 
+//************************************************************************
+static unsigned long  RecvLong(void)
+{
+unsigned long  theValue;
+uint8_t      ii;
+
+  theValue  =  0;
+  for (ii=0; ii<4; ii++)
+  {
+    theValue  =  (theValue << 8) | recchar();
+  }
+  return theValue;
+}
+
+//************************************************************************
+static void  SendLong(unsigned long theValue)
+{
+uint8_t      ii;
+
+  for (ii=0; ii<4; ii++)
+  {
+    sendchar(theValue >> 24);
+    theValue  <<=  8;
+  }
+}
+
+//************************************************************************
+//*  Binary dump for the host, see monitordump.py
+//*  request (after 'D'): memory 'F'/'E'/'R', baud index (see baudTable),
+//*  start address and length, 4 bytes each, MSB first.
+//*  With a baud index other than 0 the monitor switches to that rate and
+//*  waits for the host to send a sync char at it before the reply.
+//*  reply: length clipped to the memory size (4 bytes), the data, CRC CCITT
+//*  (start 0, as the WIBO data CRC) over the data, MSB first.
+//*  The monitor is back at BAUDRATE afterwards.
+//************************************************************************
+static void  DumpBinary(void)
+{
+unsigned char  dumpWhat;
+unsigned char  baudIndex;
+unsigned long  startAddress;
+unsigned long  numBytes;
+unsigned long  memSize;
+unsigned char  theValue;
+uint16_t    crc;
+
+  switch(recchar())
+  {
+    case 'E':
+      dumpWhat  =  kDUMP_EEPROM;
+      memSize    =  (unsigned long)E2END + 1;
+      break;
+
+    case 'R':
+      dumpWhat  =  kDUMP_RAM;
+      memSize    =  (unsigned long)RAMEND + 1;
+      break;
+
+    default:
+      dumpWhat  =  kDUMP_FLASH;
+      memSize    =  (unsigned long)FLASHEND + 1;
+      break;
+  }
+  baudIndex    =  recchar();
+  startAddress  =  RecvLong();
+  numBytes    =  RecvLong();
+
+  if (startAddress >= memSize)
+  {
+    numBytes  =  0;
+  }
+  else if (numBytes > (memSize - startAddress))
+  {
+    numBytes  =  memSize - startAddress;
+  }
+
+#if defined(ENABLE_BAUD_SWITCH)
+  if ((baudIndex != 0) && (baudIndex < sizeof(baudTable)))
+  {
+  #if defined(ENABLE_UART_TX_ISR)
+    uart_tx_drain();
+  #endif
+    //*  sendchar() returned after the last stop bit, safe to switch now
+    UART_BAUD_RATE_LOW  =  BAUD_TABLE(baudIndex);
+    recchar();  //*  sync char from the host at the new rate
+  }
+#else
+  (void)baudIndex;
+#endif
+
+  SendLong(numBytes);
+  crc  =  0;
+  while (numBytes--)
+  {
+    theValue  =  ReadMemByte(dumpWhat, startAddress++);
+    crc    =  _crc_ccitt_update(crc, theValue);
+    sendchar(theValue);
+  }
+  sendchar(crc >> 8);
+  sendchar(crc & 0xff);
+
+#if defined(ENABLE_BAUD_SWITCH)
+  #if defined(ENABLE_UART_TX_ISR)
+  uart_tx_drain();
+  #endif
+  UART_BAUD_RATE_LOW  =  UBRR_DEFAULT;
+#endif
+}
+
 //************************************************************************
 //*  returns amount of extended memory
 static void  EEPROMtest(void)
@@ -2157,6 +3622,7 @@ static void PrintHelp(void)
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_QM, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_AT, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_B, 0);
+  PrintFromPROGMEMln(gTextMsg_HELP_MSG_D, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_E, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_F, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_H, 0);
@@ -2164,6 +3630,9 @@ static void PrintHelp(void)
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_L, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_Q, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_R, 0);
+#if defined(ENABLE_STACK_PAINT)
+  PrintFromPROGMEMln(gTextMsg_HELP_MSG_S, 0);
+#endif
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_V, 0);
   PrintFromPROGMEMln(gTextMsg_HELP_MSG_Y, 0);
 }
@@ -2230,6 +3699,10 @@ int        ii, jj;
         BlinkLED();
         break;
 
+      case 'D':
+        DumpBinary();
+        break;
+
       case 'E':
         PrintFromPROGMEMln(gTextMsg_HELP_MSG_E, 2);
         DumpHex(kDUMP_EEPROM, gEepromIndex, 16);
@@ -2267,6 +3740,22 @@ int        ii, jj;
         gRamIndex  +=  256;
         break;
 
+#if defined(ENABLE_STACK_PAINT)
+      case 'S':
+        PrintFromPROGMEMln(gTextMsg_HELP_MSG_S, 2);
+        ii  =  stack_peak();
+        PrintFromPROGMEM(gTextMsg_STACK_PEAK, 0);
+        PrintHexByte(ii >> 8);
+        PrintHexByte(ii & 0xFF);
+        PrintNewLine();
+        ii  =  stack_free();
+        PrintFromPROGMEM(gTextMsg_SRAM_FREE, 0);
+        PrintHexByte(ii >> 8);
+        PrintHexByte(ii & 0xFF);
+        PrintNewLine();
+        break;
+#endif
+
       case 'V':
         PrintFromPROGMEMln(gTextMsg_HELP_MSG_V, 2);
         VectorDisplay();
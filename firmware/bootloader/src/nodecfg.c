@@ -0,0 +1,75 @@
+/*
+ * nodecfg.c
+ *
+ * Node configuration record, see nodecfg.h
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <string.h>
+
+#include "nodecfg.h"
+#if defined(ENABLE_EEPROM_JOURNAL)
+#include "ee_journal.h"
+#endif
+
+node_config_t nodecfg;
+
+/*
+ * \brief Fill the record, call once at boot
+ */
+void nodecfg_load(void)
+{
+	uint8_t *p = (uint8_t *) &nodecfg;
+	uint8_t i, crc = 0;
+
+#if defined(_PINOCCIO_256RFR2_)
+	uint8_t map[14];
+
+#if defined(ENABLE_EEPROM_JOURNAL)
+	// the journal record first, it has the layout of the map
+	if (ee_journal_read(EE_JOURNAL_KEY_NODECFG, map, sizeof(map)) != sizeof(map))
+#endif
+	{
+		eeprom_read_block(map, (const void *) NODECFG_EEADDR, sizeof(map));
+	}
+	NODECFG_TXPWR(&nodecfg) = map[0];
+	nodecfg.channel = map[1];
+	memcpy(&nodecfg.pan_id, &map[2], 2);
+	memcpy(&nodecfg.short_addr, &map[4], 2);
+	memcpy(&nodecfg.ieee_addr, &map[6], 8);
+	NODECFG_SOURCE(&nodecfg) = NODECFG_EEPROM;
+	if ((nodecfg.channel < 11) || (nodecfg.channel > 26))
+#endif
+	{
+		if (0 == get_node_config(&nodecfg))
+		{
+			NODECFG_SOURCE(&nodecfg) = NODECFG_FLASH;
+		}
+		else
+		{
+			memset(&nodecfg, 0, sizeof(nodecfg));
+			nodecfg.channel = NODECFG_DEFAULT_CHANNEL;
+			nodecfg.pan_id = NODECFG_DEFAULT_PAN_ID;
+			nodecfg.short_addr = NODECFG_DEFAULT_ADDR;
+			NODECFG_SOURCE(&nodecfg) = NODECFG_DEFAULT;
+		}
+	}
+
+	for (i = 0; i < sizeof(nodecfg) - 1; i++)
+	{
+		crc = _crc_ibutton_update(crc, p[i]);
+	}
+	nodecfg.crc = crc;
+}
+
+#if defined(ENABLE_BOOTINFO)
+/*
+ * \brief Copy the record for the application
+ */
+void nodecfg_save(void)
+{
+	memcpy((void *) NODECFG_ADDR, &nodecfg, sizeof(nodecfg));
+}
+#endif
@@ -0,0 +1,55 @@
+/*
+ * nodecfg.h
+ *
+ * Node configuration record, read once per boot.
+ *
+ * The record has the layout of the uracoli node_config_t, so the
+ * application takes it as is (get_node_config_handoff() in board.h).
+ * On the Pinoccio it is filled from the EEPROM map in one pass:
+ *
+ *   8178  1 byte  Transmitter Power   -> _reserved_[0]
+ *   8179  1 byte  Frequency Channel   -> channel
+ *   8180  2 bytes Troop ID            -> pan_id
+ *   8182  2 bytes Scout ID            -> short_addr
+ *   8184  8 bytes Unique ID, HW family, HW and EEPROM version -> ieee_addr
+ *
+ * Other boards and a Pinoccio with an erased map use the record at
+ * FLASHEND, then the defaults below. _reserved_[1] tells where it came
+ * from, the ibutton CRC covers the whole record.
+ *
+ * With ENABLE_BOOTINFO the record is copied for the application right
+ * above the boot info record, see bootinfo.h. Like that one it is in the
+ * SRAM above the stack of the bootloader (BOOT_STACK_TOP in main.c), as
+ * nodecfg_save() runs with the frame of main() still on the stack.
+ */
+
+#ifndef NODECFG_H_
+#define NODECFG_H_
+
+#include <stdint.h>
+#include "board.h" // uracoli, node_config_t
+
+#define NODECFG_ADDR     (RAMEND - 0xEF)	// 16 bytes, same as NODE_CONFIG_HANDOFF
+#define NODECFG_EEADDR   (8178)	// first byte of the Pinoccio map, 14 bytes
+
+#define NODECFG_TXPWR(nc)  ((nc)->_reserved_[0])
+#define NODECFG_SOURCE(nc) ((nc)->_reserved_[1])
+
+/* NODECFG_SOURCE() */
+#define NODECFG_EEPROM   ('E')
+#define NODECFG_FLASH    ('F')
+#define NODECFG_DEFAULT  ('D')
+
+/* defaults, same as nc_flash of libradio */
+#define NODECFG_DEFAULT_CHANNEL (17)
+#define NODECFG_DEFAULT_PAN_ID  (0x3412)
+#define NODECFG_DEFAULT_ADDR    (0xFECA)
+
+extern node_config_t nodecfg;
+
+void nodecfg_load(void);
+#if defined(ENABLE_BOOTINFO)
+void nodecfg_save(void);
+#endif
+
+#endif /* NODECFG_H_ */
@@ -0,0 +1,101 @@
+/*
+ * prof.c
+ *
+ * Boot and flashing profiler, see prof.h
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <string.h>
+
+#include "prof.h"
+
+#if defined(PROF_TIMEBASE)
+
+#if defined(ENABLE_PROFILER)
+static prof_stat_t prof[PROF_NPHASES];
+#endif
+static uint16_t prof_ovf;
+
+/*
+ * \brief Start the time base, as early after reset as possible
+ */
+void prof_init(void)
+{
+	TCCR5B = 0;
+	TCCR5A = 0;
+	TCNT5 = 0;
+	TIFR5 = _BV(TOV5);
+	prof_ovf = 0;
+#if defined(ENABLE_PROFILER)
+	memset(prof, 0, sizeof(prof));
+#endif
+	TCCR5B = _BV(CS52) | _BV(CS50); /* free running, F_CPU/1024 */
+}
+
+/*
+ * \brief Read the time base
+ *
+ * @return Ticks since prof_init()
+ */
+uint32_t prof_now(void)
+{
+	uint8_t sreg = SREG;
+	uint16_t t;
+
+	__asm__ __volatile__ ("cli");
+	t = TCNT5;
+	if (TIFR5 & _BV(TOV5))
+	{
+		TIFR5 = _BV(TOV5);
+		prof_ovf++;
+		t = TCNT5; /* the first read may be from before the overflow */
+	}
+	SREG = sreg;
+	return ((uint32_t) prof_ovf << 16) | t;
+}
+
+/*
+ * \brief Stop the time base, the application gets timer 5 as after reset
+ */
+void prof_stop(void)
+{
+	TCCR5B = 0;
+	TCNT5 = 0;
+	TIFR5 = _BV(TOV5);
+}
+
+#if defined(ENABLE_PROFILER)
+
+/*
+ * \brief Account a sample to a phase
+ *
+ * @param phase One of PROF_RESET_UART ... PROF_WIBO_PAGE
+ * @param ticks Duration
+ */
+void prof_add(uint8_t phase, uint32_t ticks)
+{
+	prof_stat_t *s = &prof[phase];
+
+	if (s->n != 0xFFFF)
+	{
+		s->n++;
+		s->sum += ticks;
+	}
+	if (ticks > s->max)
+	{
+		s->max = ticks;
+	}
+}
+
+/*
+ * \brief Store the summary for the application
+ */
+void prof_save(void)
+{
+	eeprom_update_block(prof, (void *) PROF_EEADDR, sizeof(prof));
+	eeprom_busy_wait();
+}
+#endif /* defined(ENABLE_PROFILER) */
+
+#endif /* defined(PROF_TIMEBASE) */
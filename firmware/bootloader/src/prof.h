@@ -0,0 +1,54 @@
+/*
+ * prof.h
+ *
+ * Boot and flashing profiler, built with ENABLE_PROFILER
+ * (make PROFILE=profiler).
+ *
+ * Timer 5 runs free at F_CPU/1024 (64 us at 16 MHz), the overflows are
+ * counted while it is read, so it has to be read at least every 4 s.
+ * Each phase collects count, sum and maximum in timer ticks. The table
+ * is written to the EEPROM before the application is started:
+ *
+ *   Address 8042 - 70 bytes - 7 x { uint16_t n; uint32_t sum; uint32_t max; }
+ *                             in the order of the PROF_ numbers, little endian
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+
+#define PROF_RESET_UART (0)	// reset to UART init
+#define PROF_WAIT       (1)	// boot window until the first byte or the timeout
+#define PROF_FLASH_PROG (2)	// CMD_PROGRAM_FLASH_ISP, end of message to end of reply
+#define PROF_FLASH_READ (3)	// CMD_READ_FLASH_ISP, same
+#define PROF_SPM        (4)	// SPM busy: erase or write, a whole page with the pipeline
+#define PROF_WIBO_GAP   (5)	// between two received WIBO frames
+#define PROF_WIBO_PAGE  (6)	// programming of a WIBO page
+#define PROF_NPHASES    (7)
+
+#define PROF_EEADDR     (8042)
+#define PROF_TICK_US    (1024000000UL / F_CPU)
+
+typedef struct
+{
+	uint16_t n;	// saturates at 0xFFFF
+	uint32_t sum;
+	uint32_t max;
+} prof_stat_t;
+
+/* the time base is also used for the boot info record and the trace */
+#if defined(ENABLE_PROFILER) || defined(ENABLE_BOOTINFO) || defined(ENABLE_TRACE)
+#define PROF_TIMEBASE (1)
+
+void prof_init(void);
+uint32_t prof_now(void);
+void prof_stop(void);
+#endif
+
+#if defined(ENABLE_PROFILER)
+void prof_add(uint8_t phase, uint32_t ticks);
+void prof_save(void);
+#endif
+
+#endif /* PROF_H_ */
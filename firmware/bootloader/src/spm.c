@@ -0,0 +1,104 @@
+/*
+ * spm.c
+ *
+ * Flash page programming, see spm.h
+ */
+
+#include <avr/io.h>
+#include <avr/boot.h>
+
+#include "spm.h"
+#include "energy_mark.h"
+
+/*
+ * \brief Load words into the page buffer
+ *
+ * @param addr Flash address of the first word, its page is filled
+ * @param *buf Data, little-endian words
+ * @param size Number of bytes, even, 2 ... SPM_PAGESIZE. Words not loaded
+ *             keep the erased value.
+ */
+void spm_page_fill(uint32_t addr, const uint8_t *buf, uint16_t size)
+{
+	uint8_t n = size >> 1; /* 128 words at most */
+	uint8_t sreg;
+
+	__asm__ __volatile__ (
+#if defined(RAMPZ)
+		"out %[rampz], %C[addr]"	"\n\t"
+#endif
+		"movw r30, %A[addr]"		"\n\t"
+		"1:"				"\n\t"
+		"ld r0, %a[buf]+"		"\n\t"
+		"ld r1, %a[buf]+"		"\n\t"
+		"in %[sreg], __SREG__"		"\n\t"
+		"cli"				"\n\t"
+		"sts %[spmreg], %[cmd]"		"\n\t"
+		"spm"				"\n\t"
+		"out __SREG__, %[sreg]"		"\n\t"
+		"adiw r30, 2"			"\n\t"
+		"dec %[n]"			"\n\t"
+		"brne 1b"			"\n\t"
+		"clr __zero_reg__"		"\n\t"
+		: [buf] "+x" (buf), [n] "+r" (n), [sreg] "=&r" (sreg)
+		: [addr] "r" (addr), [cmd] "r" ((uint8_t) __BOOT_PAGE_FILL),
+		  [spmreg] "i" (_SFR_MEM_ADDR(__SPM_REG))
+#if defined(RAMPZ)
+		, [rampz] "i" (_SFR_IO_ADDR(RAMPZ))
+#endif
+		: "r0", "r30", "r31", "memory");
+}
+
+/*
+ * \brief Start a page erase, page write or RWW enable, does not wait
+ *
+ * @param addr Flash address in the page
+ * @param cmd __BOOT_PAGE_ERASE, __BOOT_PAGE_WRITE or __BOOT_RWW_ENABLE
+ */
+void spm_command(uint32_t addr, uint8_t cmd)
+{
+	uint8_t sreg;
+
+#if defined(ENERGY_MARKERS)
+	/* a page is done when the section is readable again */
+	if (cmd == __BOOT_RWW_ENABLE)
+		ENERGY_MARK_OFF(ENERGY_SPM);
+	else
+		ENERGY_MARK_ON(ENERGY_SPM);
+#endif
+	__asm__ __volatile__ (
+#if defined(RAMPZ)
+		"out %[rampz], %C[addr]"	"\n\t"
+#endif
+		"movw r30, %A[addr]"		"\n\t"
+		"in %[sreg], __SREG__"		"\n\t"
+		"cli"				"\n\t"
+		"sts %[spmreg], %[cmd]"		"\n\t"
+		"spm"				"\n\t"
+		"out __SREG__, %[sreg]"		"\n\t"
+		: [sreg] "=&r" (sreg)
+		: [addr] "r" (addr), [cmd] "r" (cmd),
+		  [spmreg] "i" (_SFR_MEM_ADDR(__SPM_REG))
+#if defined(RAMPZ)
+		, [rampz] "i" (_SFR_IO_ADDR(RAMPZ))
+#endif
+		: "r30", "r31", "memory");
+}
+
+/*
+ * \brief Program a page and wait for it, RWW stays disabled
+ *
+ * The buffer is filled before the erase, so the write starts as soon as
+ * the erase is done.
+ *
+ * @param addr The address of the page
+ * @param *buf Page content, SPM_PAGESIZE bytes
+ */
+void spm_page_program(uint32_t addr, const uint8_t *buf)
+{
+	spm_page_fill(addr, buf, SPM_PAGESIZE);
+	spm_page_erase(addr);
+	boot_spm_busy_wait();
+	spm_page_write(addr);
+	boot_spm_busy_wait();
+}
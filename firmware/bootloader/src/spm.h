@@ -0,0 +1,39 @@
+/*
+ * spm.h
+ *
+ * Flash page programming, shared by the STK500v2 and the WIBO paths.
+ *
+ * spm_page_fill() loads the page buffer in one assembler loop: RAMPZ
+ * and Z are set up once per page, Z steps by ADIW and the data comes
+ * from X with post increment, about 15 cycles per word. Every SPM, also
+ * those of spm_command(), runs with interrupts off from the SPMCSR write
+ * to the SPM only, so receive ISRs may stay enabled.
+ *
+ * The page buffer is only cleared by a page write, by RWWSRE and by an
+ * EEPROM write, so it can be filled before the erase. The write then
+ * follows the erase at once and the CPU is free while both run:
+ *
+ *   spm_page_fill(a, buf, SPM_PAGESIZE);
+ *   spm_page_erase(a);    ... until !boot_spm_busy()
+ *   spm_page_write(a);    ... until !boot_spm_busy()
+ *   spm_rww_enable();
+ *
+ * Code that does this must not enable RWW or write the EEPROM between
+ * the fill and the write.
+ */
+
+#ifndef SPM_H_
+#define SPM_H_
+
+#include <stdint.h>
+#include <avr/boot.h>
+
+#define spm_page_erase(a)  spm_command((a), __BOOT_PAGE_ERASE)
+#define spm_page_write(a)  spm_command((a), __BOOT_PAGE_WRITE)
+#define spm_rww_enable()   spm_command(0, __BOOT_RWW_ENABLE)
+
+void spm_page_fill(uint32_t addr, const uint8_t *buf, uint16_t size);
+void spm_command(uint32_t addr, uint8_t cmd);
+void spm_page_program(uint32_t addr, const uint8_t *buf);
+
+#endif /* SPM_H_ */
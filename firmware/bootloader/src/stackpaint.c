@@ -0,0 +1,52 @@
+/*
+ * stackpaint.c
+ *
+ * Stack high-water mark of the bootloader, see stackpaint.h
+ */
+
+#include <avr/io.h>
+
+#include "stackpaint.h"
+
+#if defined(ENABLE_STACK_PAINT)
+
+extern uint8_t __heap_start;	// end of .data and .bss, from the linker script
+
+/*
+ * \brief Fill the SRAM below the stack with the pattern
+ *
+ * Called with the interrupts off, nothing else writes below SP then.
+ */
+void stack_paint(void)
+{
+	uint8_t *p = &__heap_start;
+
+	while (p < (uint8_t *) SP)
+	{
+		*p++ = STACK_PAINT;
+	}
+}
+
+/*
+ * \brief Bytes from RAMEND down to the deepest stack byte since stack_paint()
+ */
+uint16_t stack_peak(void)
+{
+	uint8_t *p = &__heap_start;
+
+	while ((p < (uint8_t *) SP) && (*p == STACK_PAINT))
+	{
+		p++;
+	}
+	return RAMEND - (uint16_t) p + 1;
+}
+
+/*
+ * \brief Bytes from the end of .bss to the stack pointer
+ */
+uint16_t stack_free(void)
+{
+	return SP - (uint16_t) &__heap_start;
+}
+
+#endif /* defined(ENABLE_STACK_PAINT) */
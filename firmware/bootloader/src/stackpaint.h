@@ -0,0 +1,30 @@
+/*
+ * stackpaint.h
+ *
+ * Stack high-water mark of the bootloader, built with ENABLE_STACK_PAINT
+ * (in the debug and trace profiles).
+ *
+ * Right after the OTA request is taken from the mailbox, the SRAM from
+ * the end of .bss (__heap_start) up to the current stack pointer is
+ * filled with STACK_PAINT. The stack overwrites the pattern as it grows,
+ * the first byte from below which does not carry it any more is the
+ * deepest the stack has been. The monitor command S prints the peak
+ * depth below RAMEND and the SRAM between .bss and the stack pointer
+ * now. An interrupt may write the pattern value itself, then the peak
+ * is a byte or two too low.
+ */
+
+#ifndef STACKPAINT_H_
+#define STACKPAINT_H_
+
+#include <stdint.h>
+
+#define STACK_PAINT (0xC5)
+
+#if defined(ENABLE_STACK_PAINT)
+void stack_paint(void);
+uint16_t stack_peak(void);
+uint16_t stack_free(void);
+#endif
+
+#endif /* STACKPAINT_H_ */
@@ -0,0 +1,30 @@
+/*
+ * trace.c
+ *
+ * Binary event trace, see trace.h
+ */
+
+#include <avr/io.h>
+#include <string.h>
+
+#include "trace.h"
+
+#if defined(ENABLE_TRACE)
+
+/* not cleared by the startup code, see trace_init() */
+trace_buf_t trace_buf __attribute__ ((section (".noinit")));
+
+/*
+ * \brief Take over the ring of the run before, or clear it at power up
+ */
+void trace_init(void)
+{
+	if (TRACE_MAGIC != trace_buf.magic)
+	{
+		memset(&trace_buf, 0, sizeof(trace_buf));
+		trace_buf.magic = TRACE_MAGIC;
+	}
+	TRACE(TRACE_BOOT, GPIOR0);
+}
+
+#endif /* defined(ENABLE_TRACE) */
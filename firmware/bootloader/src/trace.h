@@ -0,0 +1,80 @@
+/*
+ * trace.h
+ *
+ * Binary event trace, built with ENABLE_TRACE (make PROFILE=trace).
+ *
+ * TRACE(id, arg) puts a 5 byte record into a ring in SRAM, with
+ * interrupts off for a dozen cycles and no formatting, so the timing of
+ * the hot paths stays as it is. The time stamp is TCNT5 of the profiler
+ * time base (64 us at 16 MHz, see prof.h), it wraps every 4.2 s.
+ *
+ * The ring is in .noinit and survives a reset, trace_init() clears it
+ * only if the magic is gone (power up), so after a watchdog reset the
+ * events of the run before are still there. It is read with the RAM dump
+ * of the monitor, tracedump.py takes the address of trace_buf from the
+ * ELF file and the event names from this file:
+ *
+ *   trace_buf: { uint16_t magic; uint8_t head; trace_rec_t rec[TRACE_SIZE]; }
+ *              head counts the records written, the oldest is at head
+ *              modulo TRACE_SIZE once the ring is full, id 0 is unused
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+#define TRACE_SIZE      (64)	// records, a power of 2 up to 256
+#define TRACE_MAGIC     (0x7ACE)
+
+/* event ids, tracedump.py reads the names from here: TRACE_<name> (id) // arg */
+#define TRACE_BOOT      (1)	// MCUSR
+#define TRACE_APP       (2)	// first word of the application, before the jump
+#define TRACE_STK_CMD   (3)	// STK500v2 command, message received
+#define TRACE_STK_DONE  (4)	// STK500v2 command, answer sent
+#define TRACE_SPM       (5)	// SPMCSR at the start of the SPM wait
+#define TRACE_WIBO_RX   (6)	// p2p command << 8 | sequence number
+#define TRACE_WIBO_LOST (7)	// p2p command of a damaged frame, 0xFFFF: receive queue full
+#define TRACE_WIBO_ADDR (8)	// image address / 256
+#define TRACE_WIBO_PAGE (9)	// image address / 256 of the page being programmed
+#define TRACE_WIBO_DONE (10)	// data CRC at finish or exit
+
+typedef struct
+{
+	uint8_t id;
+	uint16_t arg;
+	uint16_t ts;	// TCNT5
+} trace_rec_t;
+
+typedef struct
+{
+	uint16_t magic;
+	uint8_t head;
+	trace_rec_t rec[TRACE_SIZE];
+} trace_buf_t;
+
+#if defined(ENABLE_TRACE)
+extern trace_buf_t trace_buf;
+
+void trace_init(void);
+
+static inline void trace_put(uint8_t id, uint16_t arg)
+{
+	uint8_t sreg = SREG;
+	trace_rec_t *r;
+
+	__asm__ __volatile__ ("cli");
+	r = &trace_buf.rec[trace_buf.head++ & (TRACE_SIZE - 1)];
+	r->id = id;
+	r->arg = arg;
+	r->ts = TCNT5;
+	SREG = sreg;
+}
+
+#define TRACE(id, arg) trace_put((id), (arg))
+#else
+#define TRACE(id, arg) do { } while (0)
+#endif
+
+#endif /* TRACE_H_ */
@@ -60,12 +60,101 @@
  * WIBO_FLAVOUR_MAILBOX_CODE
  *    the secret value
  *    example: #define WIBO_FLAVOUR_MAILBOX_CODE (0xB5)
+ *
+ * WIBO_FLAVOUR_WINDOW
+ *   accept sequence numbered data (P2P_WIBO_DATA_SEQ), buffer frames that
+ *   arrive out of order and report missing ones on P2P_WIBO_WINDOW_REQ,
+ *   along with the pages written and the frames dropped for a bad CRC
+ *
+ * WIBO_FLAVOUR_RATE
+ *   switch the PHY data rate on P2P_WIBO_RATE, fall back to 250kbps
+ *   when no frame is received for WIBO_RATE_TIMEOUT milliseconds
+ *
+ * WIBO_FLAVOUR_LZ
+ *   accept a LZSS compressed data stream after P2P_WIBO_ZMODE, back
+ *   references are read from the page buffer and from flash written before
+ *
+ * WIBO_FLAVOUR_DELTA (requires WIBO_FLAVOUR_LZ)
+ *   accept a patch stream against the installed application after
+ *   P2P_WIBO_ZMODE with P2P_WIBO_ZMODE_DELTA, the page to resume with
+ *   is kept in EEPROM so an update broken by power loss can be completed
+ *
+ * WIBO_FLAVOUR_ERASE
+ *   erase page ranges on P2P_WIBO_ERASE, the host skips sending pages
+ *   that are all 0xFF
+ *
+ * WIBO_FLAVOUR_DISCOVER
+ *   answer P2P_WIBO_DISCOVER with a ping reply in a slot derived from
+ *   the short address, so a whole troop replies to one broadcast
+ *
+ * WIBO_FLAVOUR_RENDEZVOUS
+ *   listen on WIBO_RENDEZVOUS_CHANNEL for the first WIBO_RENDEZVOUS_MS,
+ *   then on the configured channel. P2P_WIBO_CHANNEL from the host on
+ *   the rendezvous channel names the channel the update continues on,
+ *   so nodes with a stale channel in EEPROM are found without a scan
+ *
+ * WIBO_FLAVOUR_PINGSHORT
+ *   answer P2P_PING_SHORT_REQ with version, CRC and status only, in a
+ *   random slot of the window, so polling a troop costs little airtime
+ *
+ * WIBO_FLAVOUR_RESUME
+ *   keep a checkpoint page and the data CRC up to it in EEPROM, so a
+ *   raw update broken by timeout or power loss is continued there after
+ *   P2P_WIBO_RESUME instead of starting over
+ *
+ * WIBO_FLAVOUR_RXQUEUE
+ *   receive frames from the TRX24_RX_END interrupt into a ring of
+ *   WIBO_RXQ_LEN buffers, so no frame is lost while a page is programmed.
+ *   The frame buffer is protected (RX_SAFE_MODE) until the frame is
+ *   read, a frame held while the ring is full is taken when a slot is free
+ *
+ * WIBO_FLAVOUR_SLOTS
+ *   write the update into the upper half of the application section, the
+ *   running image stays intact. P2P_WIBO_COMMIT verifies length and CRC
+ *   of the staged image and sets the EEPROM boot pointer, wibo_slot_install()
+ *   then copies the image to address 0 before the application is started
+ *
+ * WIBO_FLAVOUR_APPSPM
+ *   export a service table at a fixed address (section .wibo_svc, see
+ *   Makefile and wibosvc.h of uracoli): page erase and write, flash CRC
+ *   and EEPROM writes for the application, with WIBO_FLAVOUR_SLOTS also
+ *   wibo_spm_page(), so a running application can download into the
+ *   staging slot, see wibo/wiboapp.c of uracoli
+ *
+ * WIBO_FLAVOUR_BOOTLUP
+ *   copy a bootloader image staged behind a header page into the
+ *   bootloader section on P2P_WIBO_BOOTLUP, CRC checked before and after
+ *
+ * WIBO_FLAVOUR_SIGNED
+ *   with WIBO_FLAVOUR_SLOTS, a staged image is only installed when its
+ *   AES-CMAC matches, the key is the security key in the EEPROM. The MAC
+ *   is computed by the AES engine while the pages are programmed
+ *
+ * WIBO_FLAVOUR_PROBE
+ *   broadcast P2P_PING_REQ on entry, a host answers it with P2P_PING_CNF.
+ *   Without an answer after WIBO_PROBE_TRIES tries of WIBO_PROBE_MS each,
+ *   the application is started at once instead of after WIBO_TIMEOUT
+ *
+ * WIBO_FLAVOUR_EEPROM
+ *   write the data to the EEPROM after P2P_WIBO_TARGET 'E', from the
+ *   address of P2P_WIBO_ADDR on. Unchanged bytes are skipped, a byte is
+ *   only erased or only written where that is enough. The data has its
+ *   own CRC, reported by ping while the target is 'E', it starts over
+ *   with each P2P_WIBO_TARGET 'E'. The image CRC is not touched
+ *
+ * WIBO_FLAVOUR_FEC
+ *   decode P2P_WIBO_FEC symbols, XOR combinations of the symbols of a
+ *   block of 2 KB, and program the block once P2P_WIBO_FEC_K independent
+ *   ones arrived, whichever they are. A multicast needs no feedback per
+ *   frame, nodes with different losses complete with the same symbols.
+ *   P2P_WIBO_FEC_REQ reports the blocks done and, when all are, their CRC
  */
 
 /* avr-libc inclusions */
 #include <avr/io.h>
 #include <avr/boot.h>
 #include <avr/pgmspace.h>
+#include <avr/eeprom.h>
 #include <util/crc16.h>
 #include <util/delay.h>
 #include <string.h>
@@ -73,11 +162,15 @@
 /* uracoli inclusions */
 #include <board.h>
 #include <ioutil.h>
+#include <crc_fast.h>
 #include <transceiver.h>
 #include <p2p_protocol.h>
 
 /* project inclusions */
 #include "wibo.h"
+#include "prof.h"
+#include "bootinfo.h"
+#include "trace.h"
 
 #ifndef _SW_VERSION_
 #error "Symbol _SW_VERSION_ not defined"
@@ -87,12 +180,121 @@
 #define PROGLED (2) // use the green one
 
 #define WIBO_TIMEOUT 10000	// timeout in milliseconds to exit Wibo
+#define WIBO_RATE_TIMEOUT 1000	// timeout in milliseconds to fall back to 250kbps
+
+#if defined(WIBO_FLAVOUR_PROBE)
+#if !defined(WIBO_PROBE_MS)
+#define WIBO_PROBE_MS 20	// wait for the host reply, per try
+#endif
+#if !defined(WIBO_PROBE_TRIES)
+#define WIBO_PROBE_TRIES 3
+#endif
+#endif
+
+#if defined(WIBO_FLAVOUR_EEPROM)
+#include <avr/interrupt.h>
+#endif
+
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+#if !defined(WIBO_RENDEZVOUS_CHANNEL)
+#define WIBO_RENDEZVOUS_CHANNEL (26)
+#endif
+#if !defined(WIBO_RENDEZVOUS_MS)
+#define WIBO_RENDEZVOUS_MS 250	// listen time on the rendezvous channel
+#endif
+#endif
+
+#if defined(WIBO_FLAVOUR_DELTA)
+#if !defined(WIBO_FLAVOUR_LZ)
+#error "WIBO_FLAVOUR_DELTA requires WIBO_FLAVOUR_LZ"
+#endif
+#if !defined(WIBO_DELTA_EEADDR)
+#define WIBO_DELTA_EEADDR (8123)	// 2 bytes, next page of a delta update, 0xFFFF: none
+#endif
+#endif
+
+#if defined(WIBO_FLAVOUR_RESUME)
+#if !defined(WIBO_RESUME_EEADDR)
+#define WIBO_RESUME_EEADDR (8119)	// 2 bytes page, 0xFFFF: none, 2 bytes data CRC
+#endif
+#if !defined(WIBO_RESUME_PAGES)
+#define WIBO_RESUME_PAGES (16)	// pages between checkpoints, spares the EEPROM
+#endif
+#endif
+
+#if defined(WIBO_FLAVOUR_SLOTS)
+#if !defined(WIBO_SLOT_EEADDR)
+#define WIBO_SLOT_EEADDR (8112)	// 1 byte boot pointer, 4 bytes image length, 2 bytes CRC
+#endif
+#if defined(WIBO_FLAVOUR_SIGNED)
+#define WIBO_SLOT_PENDING (0x5A)	// boot pointer: install the staged image, MAC checked
+#else
+#define WIBO_SLOT_PENDING (0xA5)	// boot pointer: install the staged image
+#endif
+/* BOOTLOADER_ADDRESS is a word address, so this is half of the
+ * application section, the staged image starts there
+ */
+#define WIBO_SLOT_SIZE ((uint32_t) BOOTLOADER_ADDRESS & ~(uint32_t) (SPM_PAGESIZE - 1))
+#define WIBO_PHYS(a) ((a) + WIBO_SLOT_SIZE)
+#else
+#define WIBO_PHYS(a) (a)
+#endif
+
+#if defined(WIBO_FLAVOUR_SIGNED)
+#if !defined(WIBO_FLAVOUR_SLOTS)
+#error "WIBO_FLAVOUR_SIGNED requires WIBO_FLAVOUR_SLOTS"
+#endif
+#if !defined(WIBO_KEY_EEADDR)
+#define WIBO_KEY_EEADDR (8162)	// 16 bytes security key
+#endif
+#define WIBO_MAC_SIZE (16)
+#define WIBO_MAC_BROKEN (0xFFFFFFFFUL)	// pages not programmed in order
+#endif
+
+#if defined(WIBO_FLAVOUR_BOOTLUP)
+#include <avr/interrupt.h>
+#if !defined(WIBO_BOOTLUP_ADDR)
+#define WIBO_BOOTLUP_ADDR (0x3FD00UL)	// .bootlup, see Makefile
+#endif
+#define WIBO_BOOTLUP_END ((uint32_t) FLASHEND + 1 - SPM_PAGESIZE)	// last page: service table, config
+#define WIBO_BOOTLUP_CFG ((uint32_t) FLASHEND + 1 - 16)	// config record, never copied
+#define WIBO_BOOTLUP_MAGIC (0x4C42)	// "BL", header page of the staged image
+#define WIBO_BOOTLUP_SRC (WIBO_PHYS(0) + SPM_PAGESIZE)	// image behind the header page
+#define WIBO_BOOTLUP_TRIES (3)
+#endif
+
+#if defined(WIBO_FLAVOUR_APPSPM)
+#include <avr/interrupt.h>
+#define WIBO_SVC_PROVIDER
+#include <wibosvc.h>
+#endif
 
 #if defined(_DEBUG_SERIAL_)
 #include <avr/interrupt.h>
 #define EOL "\r\n"
 #endif
 
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+#include <avr/interrupt.h>
+#if !defined(TRX_IF_RFA1)
+#error "WIBO_FLAVOUR_RXQUEUE requires the TRX24 interrupts"
+#endif
+#if !defined(WIBO_RXQ_LEN)
+#define WIBO_RXQ_LEN (4)	// power of 2
+#endif
+#endif
+
+#if !defined(TRX_IF_RFA1)
+/* The IRQ_STATUS of the RF23x clears on read and wibo_run() asks
+ * wibo_available() twice, the flag is latched here until the frame has
+ * been taken.
+ */
+static uint8_t rxpending;
+#define WIBO_RX_CLEAR() do { rxpending = 0; } while (0)
+#else
+#define WIBO_RX_CLEAR() trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_RX_END)
+#endif
+
 /* incoming frames are collected here */
 static union
 {
@@ -102,20 +304,91 @@ static union
 	p2p_wibo_finish_t wibo_finish;
 	p2p_wibo_target_t wibo_target;
 	p2p_wibo_addr_t wibo_addr;
+#if defined(WIBO_FLAVOUR_WINDOW)
+	p2p_wibo_data_seq_t wibo_data_seq;
+#endif
+#if defined(WIBO_FLAVOUR_FEC)
+	p2p_wibo_fec_t wibo_fec;
+#endif
+#if defined(WIBO_FLAVOUR_RATE)
+	p2p_wibo_rate_t wibo_rate;
+#endif
+#if defined(WIBO_FLAVOUR_LZ)
+	p2p_wibo_zmode_t wibo_zmode;
+#endif
+#if defined(WIBO_FLAVOUR_ERASE)
+	p2p_wibo_erase_t wibo_erase;
+#endif
+#if defined(WIBO_FLAVOUR_DISCOVER)
+	p2p_wibo_discover_t wibo_discover;
+#endif
+#if defined(WIBO_FLAVOUR_PINGSHORT)
+	p2p_ping_short_req_t ping_short;
+#endif
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+	p2p_wibo_channel_t wibo_channel;
+#endif
+#if defined(WIBO_FLAVOUR_RESUME)
+	p2p_wibo_resume_t wibo_resume;
+#endif
+#if defined(WIBO_FLAVOUR_SLOTS)
+	p2p_wibo_commit_t wibo_commit;
+#endif
 } rxbuf;
 
 #define PAGEBUFSIZE (SPM_PAGESIZE)
 
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+/* frames received by the ISR, a slot with len != 0 is in use */
+static struct
+{
+	volatile uint8_t ridx;
+	volatile uint8_t widx;
+	struct
+	{
+		volatile uint8_t len;
+		uint8_t frame[MAX_FRAME_SIZE];
+	} slot[WIBO_RXQ_LEN];
+	volatile uint8_t held;	// a frame waits in the protected frame buffer
+} rxq;
+
+/* With RX_SAFE_MODE no frame is received while the last one is not read,
+ * so it is not acknowledged and the host repeats it, instead of the next
+ * frame overwriting the buffer while an SPM stalls the CPU. Clearing the
+ * bit releases the buffer, setting it again protects the next frame.
+ */
+#define WIBO_RX_RELEASE() do { TRX_CTRL_2 &= ~_BV(RX_SAFE_MODE); \
+		TRX_CTRL_2 |= _BV(RX_SAFE_MODE); } while (0)
+#endif
+
 /* the only outgoing command, create in SRAM here
- * the values assigned here never have to changed
+ * the values assigned here never have to changed, the two bytes after
+ * the board name take the page size (p2p_ping_cnf_pagesize())
  */
 static p2p_ping_cnf_t pingrep =
 { .hdr.cmd = P2P_PING_CNF, .hdr.fcf = 0x8841, /* short addressing, frame type: data, no ACK requested */
-.version = _SW_VERSION_, .appname = "wibo", .boardname = BOARD_NAME };
+.version = _SW_VERSION_, .appname = "wibo", .boardname = BOARD_NAME "\0\0" };
+#define PINGREP_SIZE (sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME) + 2)
+
+#if defined(WIBO_FLAVOUR_PROBE)
+/* broadcast on entry, see wibo_probe() */
+static p2p_ping_req_t probereq =
+{ .hdr.cmd = P2P_PING_REQ, .hdr.fcf = 0x8841, .hdr.dst = 0xFFFF };
+#endif
 
 /* collect memory page data here, FLASH and EEPROM */
 static uint8_t pagebuf[PAGEBUFSIZE];
 
+#if defined(RADIO_HANDOFF)
+static uint8_t trxready; /* wibo_init() ran, see wibo_radio_save() */
+#endif
+
+
+#if FLASHEND > 0xFFFF
+#define wibo_read_flash(a) pgm_read_byte_far(a)
+#else
+#define wibo_read_flash(a) pgm_read_byte(a)
+#endif
 
 #if FLASHEND > 0x7FFF
 static uint32_t addr = 0;
@@ -123,69 +396,912 @@ static uint32_t addr = 0;
 static uint16_t addr = 0;
 #endif
 
-#if SPM_PAGESIZE > 255
-static uint16_t pagebufidx = 0;
-#else
-static uint8_t pagebufidx = 0;
+#if SPM_PAGESIZE > 255
+static uint16_t pagebufidx = 0;
+#else
+static uint8_t pagebufidx = 0;
+#endif
+static uint8_t deaf = 0;
+
+
+static node_config_t nodeconfig;
+
+/* Target for program data
+ 'F' : flash memory
+ 'E' : eeprom memory
+ 'X' : None, dry run
+ */
+static uint8_t target = 'F'; /* for backwards compatibility */
+#if defined(WIBO_FLAVOUR_EEPROM)
+static uint16_t eecrc; /* checksum for EEPROM data */
+#endif
+
+/* do not initialize variables to save code space, BSS segment sets all variables to zero
+ *
+ * compiler throws warning, please ignore
+ */
+uint8_t *ptr;
+uint8_t tmp;
+uint16_t datacrc = 0; /* checksum for received data */
+
+#if defined(ENABLE_PROFILER)
+static uint32_t proflastrx; /* time of the last frame, 0: none yet */
+#endif
+
+#if defined(WIBO_FLAVOUR_RATE)
+static uint8_t highrate = 0; /* not at the default 250kbps */
+
+/*
+ * \brief Switch data rate and return to RX_AACK_ON
+ *
+ * @param rate Data rate hash code, e.g. OQPSK1000
+ */
+static void wibo_setrate(uint8_t rate)
+{
+	if (RATE_NONE != trx_set_datarate(rate))
+	{
+		highrate = (OQPSK250 != rate);
+	}
+	trx_reg_write(RG_TRX_STATE, CMD_RX_AACK_ON); /* left TRX_OFF */
+}
+#endif
+
+#if defined(WIBO_FLAVOUR_RESUME)
+static uint16_t ckptcrc; /* datacrc at the start of the page buffer */
+static uint8_t ckptfirst; /* no checkpoint written since P2P_WIBO_RESET */
+
+static p2p_wibo_resume_t resumerep =
+{ .hdr.cmd = P2P_WIBO_RESUME, .hdr.fcf = 0x8841 };
+#endif
+
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+static uint8_t rendezvous; /* still on the rendezvous channel */
+#endif
+
+#if defined(WIBO_FLAVOUR_PINGSHORT)
+static p2p_ping_short_cnf_t shortrep =
+{ .hdr.cmd = P2P_PING_SHORT_CNF, .hdr.fcf = 0x8841, .version = _SW_VERSION_ };
+#endif
+
+#if defined(WIBO_FLAVOUR_LZ)
+static uint8_t zmode; /* P2P_WIBO_ZMODE_* */
+static uint8_t zflags; /* token flags, LSB first, 1: literal */
+static uint8_t zbits; /* tokens left for zflags */
+static uint8_t zphase; /* 1: first byte of a match received */
+static uint8_t zlow; /* offset low byte of a match */
+#endif
+
+#if defined(WIBO_FLAVOUR_DELTA)
+/* old content of the page before addr, it is still referenced by the
+ * patch after the page was programmed
+ */
+static uint8_t oldbuf[SPM_PAGESIZE];
+static uint8_t oldvalid;
+#endif
+
+#if defined(WIBO_FLAVOUR_WINDOW)
+#define WINDOW_DATA_MAX (MAX_FRAME_SIZE - sizeof(p2p_wibo_data_seq_t) - 2)
+
+static uint16_t rxseq; /* next frame number to go into the page buffer */
+static uint16_t winmap; /* bit i: frame rxseq+i is held in winbuf */
+
+/* frames received ahead of rxseq, slot is frame number modulo window size */
+static struct
+{
+	uint8_t dsize;
+	uint8_t data[WINDOW_DATA_MAX];
+} winbuf[P2P_WIBO_WINDOW_SIZE];
+
+static p2p_wibo_window_cnf_t windowrep =
+{ .hdr.cmd = P2P_WIBO_WINDOW_CNF, .hdr.fcf = 0x8841 };
+static uint16_t winpages; /* pages written since P2P_WIBO_RESET */
+static uint16_t winlost; /* frames dropped since P2P_WIBO_RESET, also the rxq ISR */
+#endif
+
+#if defined(WIBO_FLAVOUR_FEC)
+#define FEC_BLOCKSIZE ((uint16_t) P2P_WIBO_FEC_K * P2P_WIBO_FEC_SYMBOL)
+#if ((P2P_WIBO_FEC_K * P2P_WIBO_FEC_SYMBOL) % SPM_PAGESIZE)
+#error "WIBO_FLAVOUR_FEC needs whole pages per block"
+#endif
+
+static uint16_t fecblock; /* block being decoded */
+static uint8_t fecrank; /* independent symbols of fecblock so far */
+
+/* row i holds a received symbol whose lowest mask bit is i, 0: none,
+ * the rows are in page order, so the decoded block is programmed from here
+ */
+static uint32_t fecmask[P2P_WIBO_FEC_K];
+static uint8_t fecrow[P2P_WIBO_FEC_K][P2P_WIBO_FEC_SYMBOL];
+
+static p2p_wibo_fec_cnf_t fecrep =
+{ .hdr.cmd = P2P_WIBO_FEC_CNF, .hdr.fcf = 0x8841 };
+#endif
+
+/*
+ * \brief Support to update WIBO itself
+ * Put a little snippet at the end of bootloader that copies code from start
+ * of application section to start of bootloader section
+ *
+ * The staged image starts with a header page (magic, length, CRC), the
+ * bootloader image follows. The pages of the snippet itself and the
+ * config record at the end of flash are kept. Everything it calls lives in
+ * the same section, the rest of the bootloader is overwritten meanwhile.
+ */
+#if defined(WIBO_FLAVOUR_BOOTLUP)
+
+#define BOOTLUP_SECTION __attribute__ ((section (".bootlup"), noinline))
+#define bootlup_word(a) (wibo_read_flash(a) | ((uint16_t) wibo_read_flash((a) + 1) << 8))
+
+static uint8_t BOOTLUP_SECTION bootlup_kept(uint32_t a)
+{
+	return ((a >= WIBO_BOOTLUP_ADDR) && (a < WIBO_BOOTLUP_END))
+			|| (a >= WIBO_BOOTLUP_CFG);
+}
+
+/*
+ * \brief CRC of the bootloader image
+ *
+ * @param len Image length
+ * @param installed 0: the staged image, 1: the bootloader section, the
+ *        kept bytes taken from the staged image
+ */
+static uint16_t BOOTLUP_SECTION bootlup_crc(uint16_t len, uint8_t installed)
+{
+	const uint32_t to = (uint32_t) BOOTLOADER_ADDRESS * 2;
+	uint16_t o, crc = 0;
+
+	for (o = 0; o < len; o++)
+	{
+		uint32_t a = (installed && !bootlup_kept(to + o)) ?
+				to + o : WIBO_BOOTLUP_SRC + o;
+		crc = _crc_ccitt_update(crc, wibo_read_flash(a));
+	}
+	return crc;
+}
+
+/* word of the page to program, kept words are read back */
+static uint16_t BOOTLUP_SECTION bootlup_new(uint32_t a, uint16_t o)
+{
+	return bootlup_word(bootlup_kept(a) ? a : WIBO_BOOTLUP_SRC + o);
+}
+
+/*
+ * \brief Copy the staged bootloader image
+ * Pages that are already identical are not erased.
+ *
+ * @return 0 if the staged image is rejected, nothing is written then.
+ *         Else it jumps into the new bootloader.
+ */
+static uint8_t BOOTLUP_SECTION bootlup(void)
+{
+	const uint32_t to = (uint32_t) BOOTLOADER_ADDRESS * 2; /* byte address of bootloader */
+	uint16_t len = bootlup_word(WIBO_PHYS(2));
+	uint16_t crc = bootlup_word(WIBO_PHYS(4));
+	uint16_t o, i;
+	uint8_t tries, differ;
+
+	if ((WIBO_BOOTLUP_MAGIC != bootlup_word(WIBO_PHYS(0))) || (0 == len)
+			|| (len > (uint32_t) FLASHEND + 1 - to)
+			|| (bootlup_crc(len, 0) != crc))
+	{
+		return 0;
+	}
+
+	cli(); /* the vectors of the bootloader are rewritten */
+	for (tries = 0; tries < WIBO_BOOTLUP_TRIES; tries++)
+	{
+		for (o = 0; o < len; o += SPM_PAGESIZE)
+		{
+			differ = 0;
+			for (i = 0; i < SPM_PAGESIZE; i += 2)
+			{
+				differ |= (bootlup_new(to + o + i, o + i) != bootlup_word(to + o + i));
+			}
+			if (!differ)
+			{
+				continue; /* spares an erase cycle */
+			}
+
+			ENERGY_MARK_ON(ENERGY_SPM);
+			boot_page_erase(to + o);
+			boot_spm_busy_wait();
+			for (i = 0; i < SPM_PAGESIZE; i += 2)
+			{
+				boot_page_fill(to + o + i, bootlup_new(to + o + i, o + i));
+			}
+			boot_page_write(to + o);
+			boot_spm_busy_wait();
+		}
+		boot_rww_enable();
+		ENERGY_MARK_OFF(ENERGY_SPM);
+
+		if (bootlup_crc(len, 1) == crc)
+		{
+			break;
+		}
+	}
+
+	jump_to_bootloader();
+	return 1;
+}
+#endif /* defined(WIBO_FLAVOUR_BOOTLUP) */
+
+/*
+ * \brief Transmit a reply frame and return to RX_AACK_ON
+ *
+ * @param len Frame length including 2 bytes CRC
+ * @param *frm Frame buffer
+ */
+static void wibo_send(uint8_t len, uint8_t *frm)
+{
+	trx_reg_write(RG_TRX_STATE, CMD_TX_ARET_ON);
+	/* the ACK of the frame just received may still be on air, the state
+	 * changes after it and SLP_TR would be ignored until then */
+	while (TX_ARET_ON != trx_bit_read(SR_TRX_STATUS))
+		;
+
+	/* no need to make block atomic since no IRQs are used */
+	TRX_SLPTR_HIGH()
+	;
+	TRX_SLPTR_LOW()
+	;
+	trx_frame_write(len, frm);
+	/*******************************************************/
+	ENERGY_MARK_ON(ENERGY_TX);
+
+#if defined(TRX_IF_RFA1)
+	while (!(trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_TX_END))
+		;
+	trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_TX_END); /* clear the flag */
+#else
+	while (!(trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_TRX_END))
+	;
+#endif /* defined(TRX_IF_RFA1) */
+	ENERGY_MARK_OFF(ENERGY_TX);
+	trx_reg_write(RG_TRX_STATE, CMD_RX_AACK_ON);
+}
+
+#if defined(WIBO_FLAVOUR_SIGNED)
+/*
+ * AES-CMAC (RFC 4493) of the image. The pages are absorbed while they
+ * are programmed, the last one is held back, it carries the end of the
+ * image. The AES registers are used directly, the helpers only use the
+ * stack, they are also called from the application (WIBO_SVC_COMMIT).
+ */
+static uint8_t macx[WIBO_MAC_SIZE];	/* CBC state up to machold */
+static uint8_t machold[SPM_PAGESIZE];	/* last page programmed */
+static uint32_t macaddr;		/* image address after machold */
+
+static void wibo_aes_key(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < WIBO_MAC_SIZE; i++)
+	{
+		AES_KEY = eeprom_read_byte((uint8_t *) (WIBO_KEY_EEADDR + i));
+	}
+}
+
+static void wibo_aes_encrypt(uint8_t *blk)
+{
+	uint8_t i;
+
+	AES_CTRL = 0; /* ECB, encryption */
+	for (i = 0; i < WIBO_MAC_SIZE; i++)
+	{
+		AES_STATE = blk[i];
+	}
+	AES_CTRL = _BV(AES_REQUEST);
+	while (!(AES_STATUS & _BV(AES_DONE)))
+	{
+		/* about 24us */
+	}
+	for (i = 0; i < WIBO_MAC_SIZE; i++)
+	{
+		blk[i] = AES_STATE;
+	}
+}
+
+static void wibo_mac_absorb(uint8_t *x, const uint8_t *blk)
+{
+	uint8_t i;
+
+	for (i = 0; i < WIBO_MAC_SIZE; i++)
+	{
+		x[i] ^= blk[i];
+	}
+	wibo_aes_encrypt(x);
+}
+
+/* multiply by x in GF(2^128), subkey derivation */
+static void wibo_mac_dbl(uint8_t *k)
+{
+	uint8_t i, msb = k[0] & 0x80;
+
+	for (i = 0; i < WIBO_MAC_SIZE - 1; i++)
+	{
+		k[i] = (k[i] << 1) | (k[i + 1] >> 7);
+	}
+	k[WIBO_MAC_SIZE - 1] <<= 1;
+	if (msb)
+	{
+		k[WIBO_MAC_SIZE - 1] ^= 0x87;
+	}
+}
+
+static void wibo_mac_reset(void)
+{
+	memset(macx, 0, sizeof(macx));
+	macaddr = 0;
+	wibo_aes_key();
+}
+
+/*
+ * \brief Absorb a page as it is programmed
+ *
+ * @param a Address in the image
+ * @param *buf Page content, NULL for an erased page
+ */
+static void wibo_mac_page(uint32_t a, uint8_t *buf)
+{
+	uint16_t i;
+
+	if (a != macaddr)
+	{
+		macaddr = WIBO_MAC_BROKEN; /* the commit reads the slot again */
+		return;
+	}
+	if (a)
+	{
+		for (i = 0; i < SPM_PAGESIZE; i += WIBO_MAC_SIZE)
+		{
+			wibo_mac_absorb(macx, machold + i);
+		}
+	}
+	if (buf)
+	{
+		memcpy(machold, buf, SPM_PAGESIZE);
+	}
+	else
+	{
+		memset(machold, 0xFF, SPM_PAGESIZE);
+	}
+	macaddr = a + SPM_PAGESIZE;
+}
+
+/*
+ * \brief Check the MAC of the staged image
+ * The absorbed pages are used when they end in the last page of the
+ * image, else the staged image is read once more. The RWW section has
+ * to be readable.
+ *
+ * @param len Image length
+ * @param *mac Expected MAC
+ * @param incremental 0: ignore the absorbed pages (RAM of the caller)
+ * @return 1 if the MAC matches
+ */
+static uint8_t wibo_mac_check(uint32_t len, const uint8_t *mac, uint8_t incremental)
+{
+	uint8_t x[WIBO_MAC_SIZE], k[WIBO_MAC_SIZE];
+	uint32_t a, start = 0;
+	uint8_t i, n;
+
+	if (0 == len)
+	{
+		return 0;
+	}
+	wibo_aes_key();
+	incremental = incremental && (macaddr != WIBO_MAC_BROKEN)
+			&& (len <= macaddr) && (len + SPM_PAGESIZE > macaddr);
+	if (incremental)
+	{
+		memcpy(x, macx, sizeof(x));
+		start = macaddr - SPM_PAGESIZE;
+	}
+	else
+	{
+		memset(x, 0, sizeof(x));
+	}
+
+	a = start;
+	do
+	{
+		n = (len - a > WIBO_MAC_SIZE) ? WIBO_MAC_SIZE : (uint8_t) (len - a);
+		for (i = 0; i < WIBO_MAC_SIZE; i++)
+		{
+			if (i < n)
+			{
+				k[i] = incremental ? machold[a - start + i]
+						: wibo_read_flash(WIBO_PHYS(a + i));
+			}
+			else
+			{
+				k[i] = (i == n) ? 0x80 : 0; /* padding of the last block */
+			}
+		}
+		a += n;
+		if (a < len)
+		{
+			wibo_mac_absorb(x, k);
+		}
+	} while (a < len);
+
+	/* last block: XOR with K1 when complete, with K2 when padded */
+	{
+		uint8_t sub[WIBO_MAC_SIZE];
+
+		memset(sub, 0, sizeof(sub));
+		wibo_aes_encrypt(sub);
+		wibo_mac_dbl(sub);
+		if (n < WIBO_MAC_SIZE)
+		{
+			wibo_mac_dbl(sub);
+		}
+		for (i = 0; i < WIBO_MAC_SIZE; i++)
+		{
+			k[i] ^= sub[i];
+		}
+	}
+	wibo_mac_absorb(x, k);
+	return (0 == memcmp(x, mac, WIBO_MAC_SIZE));
+}
+#endif
+
+/*
+ * \brief Program a page of the image, into the staging slot with
+ * WIBO_FLAVOUR_SLOTS
+ *
+ * @param a Address in the image
+ * @param *buf Page content
+ */
+static void wibo_program(uint32_t a, uint8_t *buf)
+{
+#if defined(WIBO_FLAVOUR_SLOTS)
+	if (a >= WIBO_SLOT_SIZE)
+	{
+		return; /* would overwrite the running image */
+	}
+#endif
+#if defined(ENABLE_PROFILER)
+	uint32_t t = prof_now();
+#endif
+	TRACE(TRACE_WIBO_PAGE, a >> 8);
+#if defined(WIBO_FLAVOUR_SIGNED)
+	wibo_mac_page(a, buf);
+#endif
+	boot_program_page(WIBO_PHYS(a), buf);
+#if defined(ENABLE_PROFILER)
+	prof_add(PROF_WIBO_PAGE, prof_now() - t);
+#endif
+}
+
+#if defined(WIBO_FLAVOUR_SLOTS)
+/*
+ * \brief Check the staged image and set the boot pointer
+ * Only uses the stack, it is also called from the application.
+ *
+ * @param len Image length from address 0
+ * @param crc CRC CCITT of the image
+ * @param *mac AES-CMAC of the image (WIBO_FLAVOUR_SIGNED)
+ * @param incremental Use the MAC absorbed during the update
+ * @param *pc Returns the CRC of the staged image
+ * @return P2P_ERROR_SUCCESS, P2P_ERROR_COMMIT or P2P_ERROR_SIGNATURE
+ */
+static p2p_error_t wibo_slot_commit(uint32_t len, uint16_t crc,
+		const uint8_t *mac, uint8_t incremental, uint16_t *pc)
+{
+	uint16_t c;
+
+	*pc = 0;
+	if (len > WIBO_SLOT_SIZE)
+	{
+		return P2P_ERROR_COMMIT;
+	}
+	spm_rww_enable();
+	c = crc_ccitt_flash(0, WIBO_PHYS(0), len);
+	*pc = c;
+	if (c != crc)
+	{
+		return P2P_ERROR_COMMIT;
+	}
+#if defined(WIBO_FLAVOUR_SIGNED)
+	if (!wibo_mac_check(len, mac, incremental))
+	{
+		return P2P_ERROR_SIGNATURE;
+	}
+#endif
+	eeprom_update_dword((uint32_t *) (WIBO_SLOT_EEADDR + 1), len);
+	eeprom_update_word((uint16_t *) (WIBO_SLOT_EEADDR + 5), crc);
+	/* the single byte write is the atomic flip */
+	eeprom_update_byte((uint8_t *) WIBO_SLOT_EEADDR, WIBO_SLOT_PENDING);
+	return P2P_ERROR_SUCCESS;
+}
+#endif
+
+#if defined(WIBO_FLAVOUR_EEPROM)
+/*
+ * \brief Write bytes to the EEPROM, unchanged bytes are skipped
+ *
+ * Parts with EEPM (split erase and write, e.g. megaRFR2) only erase a
+ * byte that becomes 0xFF and only write a byte that has bits cleared,
+ * each in half the time of an erase and write.
+ *
+ * @param a EEPROM address, bytes beyond E2END are dropped
+ * @param *buf Data
+ * @param len Number of bytes
+ */
+static void wibo_ee_write(uint32_t a, const uint8_t *buf, uint16_t len)
+{
+	uint8_t b, old, sreg;
+
+	while (len-- && (a <= E2END))
+	{
+		b = *buf++;
+		eeprom_busy_wait();
+		EEAR = a;
+		EECR |= (1 << EERE);
+		old = EEDR;
+		if (old != b)
+		{
+#if defined(EEPM1)
+			if (0xFF == b)
+			{
+				EECR = (1 << EEPM0); /* erase only */
+			}
+			else if ((old & b) == b)
+			{
+				EECR = (1 << EEPM1); /* write only, no bit goes to 1 */
+			}
+			else
+			{
+				EECR = 0; /* erase and write */
+			}
+#endif
+			EEDR = b;
+			sreg = SREG;
+			cli(); /* EEPE must follow EEMPE within 4 cycles */
+			EECR |= (1 << EEMPE);
+			EECR |= (1 << EEPE);
+			SREG = sreg;
+		}
+		a++;
+	}
+	eeprom_busy_wait(); /* no SPM while the EEPROM is written */
+}
+#endif
+
+/*
+ * \brief Put one byte into the page buffer, program the page when it is full
+ *
+ * @param b Data byte
+ */
+#if defined(WIBO_FLAVOUR_LZ)
+static void wibo_put(uint8_t b)
+#else
+static inline void wibo_put(uint8_t b)
+#endif
+{
+	pagebuf[pagebufidx++] = b;
+	if (pagebufidx >= PAGEBUFSIZE)
+	{
+		/* LED off to save current and avoid flash corruption
+		 *  because of possible voltage drops
+		 */
+#if !defined(NO_LEDS)
+		LED_CLR(PROGLED);
+#endif
+
+		if (target == 'F') /* Flash memory */
+		{
+#if defined(WIBO_FLAVOUR_DELTA)
+			if (P2P_WIBO_ZMODE_DELTA == zmode)
+			{
+				uint8_t same = 1;
+				uint16_t i = 0;
+
+				/* keep the old page for references, most pages of a
+				 * patch come out unchanged and are not written at all
+				 */
+				do
+				{
+					oldbuf[i] = wibo_read_flash(addr + i);
+					same &= (oldbuf[i] == pagebuf[i]);
+				} while (++i < SPM_PAGESIZE);
+				oldvalid = 1;
+#if defined(WIBO_FLAVOUR_SLOTS)
+				same = 0; /* the staging slot does not hold the old page */
+#endif
+				if (!same)
+				{
+					wibo_program(addr, pagebuf);
+				}
+				eeprom_write_word((uint16_t *) WIBO_DELTA_EEADDR,
+						(addr + SPM_PAGESIZE) / SPM_PAGESIZE);
+			}
+			else
+#endif
+			{
+#if defined(WIBO_FLAVOUR_RESUME)
+				/* the checkpoint is this page, so a write broken by
+				 * power loss is repeated, compressed streams are not
+				 * resumable
+				 */
+#if defined(WIBO_FLAVOUR_LZ)
+				if (P2P_WIBO_ZMODE_RAW == zmode)
+#endif
+				if (ckptfirst || !((addr / SPM_PAGESIZE) % WIBO_RESUME_PAGES))
+				{
+					eeprom_update_word((uint16_t *) WIBO_RESUME_EEADDR,
+							addr / SPM_PAGESIZE);
+					eeprom_update_word((uint16_t *) (WIBO_RESUME_EEADDR + 2),
+							ckptcrc);
+					ckptfirst = 0;
+				}
+#endif
+				wibo_program(addr, pagebuf);
+			}
+#if defined(WIBO_FLAVOUR_LZ)
+			spm_rww_enable(); /* page is read back for references */
+#endif
+		}
+		else if (target == 'E')
+		{
+#if defined(WIBO_FLAVOUR_EEPROM)
+			wibo_ee_write(addr, pagebuf, PAGEBUFSIZE);
+#endif
+		}
+		else
+		{
+			/* unknown target, dry run */
+		}
+
+		/* also for dry run! */
+		addr += SPM_PAGESIZE;
+		pagebufidx = 0;
+#if defined(WIBO_FLAVOUR_WINDOW)
+		winpages++;
 #endif
-static uint8_t deaf = 0;
+#if defined(WIBO_FLAVOUR_RESUME)
+		ckptcrc = datacrc;
+#endif
+	}
+}
 
+#if defined(WIBO_FLAVOUR_LZ)
+/*
+ * \brief Decode one byte of the LZSS stream
+ *
+ * A flags byte announces 8 tokens, LSB first. A set bit is a literal byte,
+ * a cleared bit a match of two bytes:
+ *   offset[7:0], offset[11:8] << 4 | (length - P2P_WIBO_LZ_MINMATCH)
+ * The match copies length bytes from offset bytes back in the output.
+ */
+static void wibo_unz(uint8_t b)
+{
+	uint16_t offset;
+	uint8_t len;
+	uint32_t from;
 
-static node_config_t nodeconfig;
+	if (0 == zbits)
+	{
+		zflags = b;
+		zbits = 8;
+		return;
+	}
+	if (zflags & 1)
+	{
+		wibo_put(b);
+	}
+	else if (0 == zphase)
+	{
+		zlow = b;
+		zphase = 1;
+		return;
+	}
+	else
+	{
+		zphase = 0;
+		offset = zlow | ((uint16_t) (b & 0xF0) << 4);
+		len = (b & 0x0F) + P2P_WIBO_LZ_MINMATCH;
+#if defined(WIBO_FLAVOUR_DELTA)
+		if (P2P_WIBO_ZMODE_DELTA == zmode)
+		{
+			/* signed offset into the old image, seen from the output */
+			from = addr + pagebufidx + ((int16_t) (offset << 4) >> 4);
+			do
+			{
+				if (from >= addr)
+				{
+					b = wibo_read_flash(from); /* not programmed yet */
+				}
+				else if (oldvalid && (from >= addr - SPM_PAGESIZE))
+				{
+					b = oldbuf[(uint16_t) (from - (addr - SPM_PAGESIZE))];
+				}
+				else
+				{
+					b = wibo_read_flash(WIBO_PHYS(from)); /* new content */
+				}
+				wibo_put(b);
+				from++;
+			} while (--len);
+			zflags >>= 1;
+			zbits--;
+			return;
+		}
+#endif
+		from = addr + pagebufidx - offset;
+		do
+		{
+			/* pagebufidx and addr change in wibo_put() */
+			if (from >= addr)
+			{
+				b = pagebuf[(uint16_t) (from - addr)];
+			}
+			else
+			{
+				b = wibo_read_flash(WIBO_PHYS(from));
+			}
+			wibo_put(b);
+			from++;
+		} while (--len);
+	}
+	zflags >>= 1;
+	zbits--;
+}
+#endif
 
-/* Target for program data
- 'F' : flash memory
- 'E' : eeprom memory
- 'X' : None, dry run
+/*
+ * \brief Take data in stream order, program a page whenever it is full
+ *
+ * @param *data Data of one frame
+ * @param len Number of bytes, not zero
  */
-static uint8_t target = 'F'; /* for backwards compatibility */
+static void wibo_consume(uint8_t *data, uint8_t len)
+{
+#if defined(WIBO_FLAVOUR_EEPROM)
+	if (target == 'E')
+	{
+		eecrc = crc_ccitt_block(eecrc, data, len);
+	}
+	else
+#endif
+	datacrc = crc_ccitt_block(datacrc, data, len);
+	tmp = len;
+	ptr = data;
+	do
+	{
+#if defined(WIBO_FLAVOUR_LZ)
+		if (zmode && (target != 'E')) /* EEPROM data is raw */
+		{
+			wibo_unz(*ptr);
+		}
+		else
+#endif
+		wibo_put(*ptr);
+		ptr++;
+	} while (--tmp);
+#if defined(ENABLE_BOOTINFO)
+	bootinfo.otabytes += len;
+	bootinfo.crc = datacrc;
+#endif
+}
 
-/* do not initialize variables to save code space, BSS segment sets all variables to zero
+#if defined(WIBO_FLAVOUR_FEC)
+/*
+ * \brief Start over with a block, the rows of the last one are dropped
  *
- * compiler throws warning, please ignore
+ * @param block Block number
  */
-uint8_t *ptr;
-uint8_t tmp;
-uint16_t datacrc = 0; /* checksum for received data */
+static void wibo_fec_start(uint16_t block)
+{
+	fecblock = block;
+	fecrank = 0;
+	memset(fecmask, 0, sizeof(fecmask));
+}
 
 /*
- * \brief Support to update WIBO itself
- * Put a little snippet at the end of bootloader that copies code from start
- * of application section to start of bootloader section
+ * \brief XOR a symbol into another one
+ */
+static void wibo_fec_xor(uint8_t *dst, const uint8_t *src)
+{
+	uint8_t i = P2P_WIBO_FEC_SYMBOL;
+
+	do
+	{
+		*dst++ ^= *src++;
+	} while (--i);
+}
+
+/*
+ * \brief Take a coded symbol of fecblock
  *
+ * The symbol is reduced by the rows held, in the order of their bits,
+ * so it ends up without the lowest bit of any of them. Nothing left
+ * means it was a combination of those, else it becomes the row of its
+ * lowest bit. With all rows the block is solved from the last row up,
+ * a row only has bits of the rows below it left.
  *
+ * @param mask Source symbols in the symbol
+ * @param *data Symbol, changed here
+ * @return 1 if the block is decoded into fecrow
  */
-#if defined(WIBO_FLAVOUR_BOOTLUP)
+static uint8_t wibo_fec_add(uint32_t mask, uint8_t *data)
+{
+	uint8_t i, j;
+
+	for (i = 0; i < P2P_WIBO_FEC_K; i++)
+	{
+		if ((mask & ((uint32_t) 1 << i)) && fecmask[i])
+		{
+			mask ^= fecmask[i];
+			wibo_fec_xor(data, fecrow[i]);
+		}
+	}
+	if (0 == mask)
+	{
+		return 0;
+	}
+	for (i = 0; !(mask & ((uint32_t) 1 << i)); i++)
+		;
+	fecmask[i] = mask;
+	memcpy(fecrow[i], data, P2P_WIBO_FEC_SYMBOL);
+	if (++fecrank < P2P_WIBO_FEC_K)
+	{
+		return 0;
+	}
+
+	i = P2P_WIBO_FEC_K - 1;
+	while (i--)
+	{
+		for (j = i + 1; j < P2P_WIBO_FEC_K; j++)
+		{
+			if (fecmask[i] & ((uint32_t) 1 << j))
+			{
+				wibo_fec_xor(fecrow[i], fecrow[j]);
+			}
+		}
+	}
+	return 1;
+}
 
-void __attribute__ ((section (".bootlup"))) __attribute__((noreturn)) bootlup()
+/*
+ * \brief Program the decoded fecblock, the image CRC is taken once the
+ * last block is done
+ */
+static void wibo_fec_program(void)
 {
-	const uint32_t addr_to = (uint32_t)BOOTLOADER_ADDRESS*2; /* byte address of bootloader */
-	const uint8_t nbpages=3072/SPM_PAGESIZE; /* maximum of 3k bootloader at the moment */
-#if SPM_PAGESIZE > 255
-	uint16_t i;
-#else
+	uint32_t a = addr + (uint32_t) fecblock * FEC_BLOCKSIZE;
 	uint8_t i;
+
+#if !defined(NO_LEDS)
+	LED_CLR(PROGLED);
 #endif
-	for(uint8_t page=0;page<nbpages;page++)
+	for (i = 0; i < FEC_BLOCKSIZE / SPM_PAGESIZE; i++)
 	{
-		boot_page_erase(addr_to+page*SPM_PAGESIZE);
-		boot_spm_busy_wait ();      // Wait until the memory is erased
+		wibo_program(a + (uint16_t) i * SPM_PAGESIZE,
+				fecrow[0] + (uint16_t) i * SPM_PAGESIZE);
+	}
+	spm_rww_enable();
+	fecrep.done[fecblock >> 3] |= (1 << (fecblock & 7));
+#if defined(ENABLE_BOOTINFO)
+	bootinfo.otabytes += FEC_BLOCKSIZE;
+#endif
 
-		for (i=0; i<SPM_PAGESIZE; i+=2)
+	for (i = 0; i < fecrep.nblocks; i++)
+	{
+		if (!(fecrep.done[i >> 3] & (1 << (i & 7))))
 		{
-			uint16_t w = pgm_read_word(page*SPM_PAGESIZE+i);
-			boot_page_fill (addr_to+page*SPM_PAGESIZE+i, w);
+			return;
 		}
-
-		boot_page_write (addr_to+page*SPM_PAGESIZE); // Store buffer in flash page
-		boot_spm_busy_wait ();// Wait until the memory is erased
 	}
-
-	boot_rww_enable ();
-
-	jump_to_bootloader();
+	datacrc = crc_ccitt_flash(0, WIBO_PHYS(addr),
+			(uint32_t) fecrep.nblocks * FEC_BLOCKSIZE);
+#if defined(ENABLE_BOOTINFO)
+	bootinfo.crc = datacrc;
+#endif
 }
-#endif /* defined(WIBO_FLAVOUR_BOOTLUP) */
+#endif
 
 void wibo_init(uint8_t channel, uint16_t pan_id, uint16_t short_addr, uint64_t ieee_addr)
 {
@@ -253,6 +1369,42 @@ LED_SET(PROGLED);
 	/* setup network addresses for auto modes */
 	pingrep.hdr.pan = nodeconfig.pan_id;
 	pingrep.hdr.src = nodeconfig.short_addr;
+	pingrep.boardname[sizeof(BOARD_NAME)] = PAGEBUFSIZE & 0xFF;
+	pingrep.boardname[sizeof(BOARD_NAME) + 1] = PAGEBUFSIZE >> 8;
+#if defined(WIBO_FLAVOUR_PROBE)
+	probereq.hdr.pan = nodeconfig.pan_id;
+	probereq.hdr.src = nodeconfig.short_addr;
+#endif
+#if defined(WIBO_FLAVOUR_DELTA)
+	/* report the page to resume a broken delta update with */
+	if (0xFFFF != eeprom_read_word((uint16_t *) WIBO_DELTA_EEADDR))
+	{
+		pingrep.status = P2P_STATUS_RECEIVINGDATA;
+		pingrep.errno = P2P_ERROR_DELTA_RESUME;
+	}
+#endif
+#if defined(WIBO_FLAVOUR_RESUME)
+	/* report a broken update */
+	if (0xFFFF != eeprom_read_word((uint16_t *) WIBO_RESUME_EEADDR))
+	{
+		pingrep.status = P2P_STATUS_RECEIVINGDATA;
+		pingrep.errno = P2P_ERROR_RESUME;
+	}
+	resumerep.hdr.pan = nodeconfig.pan_id;
+	resumerep.hdr.src = nodeconfig.short_addr;
+#endif
+#if defined(WIBO_FLAVOUR_WINDOW)
+	windowrep.hdr.pan = nodeconfig.pan_id;
+	windowrep.hdr.src = nodeconfig.short_addr;
+#endif
+#if defined(WIBO_FLAVOUR_FEC)
+	fecrep.hdr.pan = nodeconfig.pan_id;
+	fecrep.hdr.src = nodeconfig.short_addr;
+#endif
+#if defined(WIBO_FLAVOUR_PINGSHORT)
+	shortrep.hdr.pan = nodeconfig.pan_id;
+	shortrep.hdr.src = nodeconfig.short_addr;
+#endif
 
 	trx_set_panid(nodeconfig.pan_id);
 	trx_set_shortaddr(nodeconfig.short_addr);
@@ -260,7 +1412,13 @@ LED_SET(PROGLED);
 	/* use register write to save code space, overwrites Bits CCA_REQUEST CCA_MODE[1] CCA_MODE[0]
 	 * which is accepted
 	 */
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+	/* the host may look for us there, see wibo_run() */
+	rendezvous = (WIBO_RENDEZVOUS_CHANNEL != nodeconfig.channel);
+	trx_reg_write(RG_PHY_CC_CCA, WIBO_RENDEZVOUS_CHANNEL);
+#else
 	trx_reg_write(RG_PHY_CC_CCA, nodeconfig.channel);
+#endif
 
 #if RADIO_TYPE == RADIO_AT86RF212
 
@@ -273,7 +1431,7 @@ LED_SET(PROGLED);
 
 	trx_reg_write(RG_CSMA_SEED_0, nodeconfig.short_addr); /* some seeding */
 	trx_reg_write(RG_TRX_STATE, CMD_RX_AACK_ON);
-	trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_RX_END); /* clear the flag */
+	WIBO_RX_CLEAR(); /* clear the flag */
 
 #if defined(_DEBUG_SERIAL_)
 	void sendchar(char c);
@@ -284,46 +1442,390 @@ LED_SET(PROGLED);
 	printf("PANID=%04X SHORTADDR=%04X CHANNEL=%d"EOL,
 			nodeconfig.pan_id, nodeconfig.short_addr, nodeconfig.channel);
 #endif
+#if defined(RADIO_HANDOFF)
+	trxready = 1;
+#endif
 }
 
-#if defined(TRX_IF_RFA1)
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+/*
+ * \brief Move the received frame into the ring, interrupts off
+ *
+ * If the ring is full the frame stays in the protected frame buffer,
+ * the reader takes it when it frees a slot.
+ */
+static void wibo_rxq_take(void)
+{
+	uint8_t lqi;
+	bool crc_ok;
+
+	if (rxq.slot[rxq.widx].len != 0)
+	{
+		rxq.held = 1;
+		return;
+	}
+	rxq.held = 0;
+	rxq.slot[rxq.widx].len = trx_frame_read_data_crc(rxq.slot[rxq.widx].frame,
+			MAX_FRAME_SIZE, &lqi, &crc_ok);
+	WIBO_RX_RELEASE();
+	/* drop the frame if the CRC is wrong */
+	if (crc_ok)
+	{
+		rxq.widx = (rxq.widx + 1) & (WIBO_RXQ_LEN - 1);
+	}
+	else
+	{
+		rxq.slot[rxq.widx].len = 0;
+#if defined(ENABLE_BOOTINFO)
+		bootinfo.lost++;
+#endif
+#if defined(WIBO_FLAVOUR_WINDOW)
+		winlost++;
+#endif
+		TRACE(TRACE_WIBO_LOST, ((p2p_hdr_t*) rxq.slot[rxq.widx].frame)->cmd);
+	}
+}
+
+ISR(TRX24_RX_END_vect)
+{
+	ENERGY_MARK_ON(ENERGY_ISR);
+	ENERGY_MARK_ON(ENERGY_RX);
+	wibo_rxq_take();
+	trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_RX_END); /* clear the flag */
+	ENERGY_MARK_OFF(ENERGY_RX);
+	ENERGY_MARK_OFF(ENERGY_ISR);
+}
+
+/*
+ * \brief Move the vectors to the bootloader section and start receiving
+ * from the interrupt
+ */
+static void wibo_rxq_start(void)
+{
+	MCUCR = (1 << IVCE);
+	MCUCR = (1 << IVSEL);
+	rxq.held = 0;
+	TRX_CTRL_2 |= _BV(RX_SAFE_MODE);
+	trx_reg_write(RG_IRQ_MASK, TRX_IRQ_RX_END);
+	sei();
+}
+
+/*
+ * \brief Stop the interrupt and give the vectors back to the application
+ */
+static void wibo_rxq_stop(void)
+{
+	cli();
+	trx_reg_write(RG_IRQ_MASK, 0);
+	TRX_CTRL_2 &= ~_BV(RX_SAFE_MODE);
+	MCUCR = (1 << IVCE);
+	MCUCR = (0 << IVSEL);
+}
+
+uint8_t wibo_available(void)
+{
+#if defined(PROF_TIMEBASE)
+	prof_now(); /* the waits poll here, keeps the time base going */
+#endif
+	return (0 != rxq.slot[rxq.ridx].len);
+}
+#elif defined(TRX_IF_RFA1)
 uint8_t wibo_available(void)
 {
+#if defined(PROF_TIMEBASE)
+	prof_now(); /* the waits poll here, keeps the time base going */
+#endif
 	return (0 != (trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_RX_END));
 }
 #else
-#error "Cannot use this function"
+uint8_t wibo_available(void)
+{
+#if defined(PROF_TIMEBASE)
+	prof_now(); /* the waits poll here, keeps the time base going */
+#endif
+	if (trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_TRX_END)
+	{
+		rxpending = 1;
+	}
+	return rxpending;
+}
+#endif
+
+/*
+ * \brief Receive during the boot window of the serial bootloader, which
+ * polls wibo_available() next to the UART. wibo_init() must have run.
+ */
+void wibo_listen(void)
+{
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+	wibo_rxq_start();
+#endif
+}
+
+/*
+ * \brief The serial bootloader got the host first, radio off again.
+ * The vectors are left to the serial bootloader.
+ */
+void wibo_stop(void)
+{
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+	trx_reg_write(RG_IRQ_MASK, 0);
+#endif
+	trx_reg_write(RG_TRX_STATE, CMD_FORCE_TRX_OFF);
+}
+
+#if defined(WIBO_FLAVOUR_PROBE)
+/*
+ * \brief Ask whether a host is around, any frame received counts
+ *
+ * @return 1 if a frame is waiting, 0 if nobody answered
+ */
+static uint8_t wibo_probe(void)
+{
+	uint8_t tries;
+	uint8_t ms;
+
+	for (tries = 0; tries < WIBO_PROBE_TRIES; tries++)
+	{
+		if (wibo_available())
+		{
+			return 1;
+		}
+		probereq.hdr.seq++;
+		wibo_send(sizeof(p2p_ping_req_t) + 2, (uint8_t*) &probereq);
+		for (ms = 0; ms < WIBO_PROBE_MS; ms++)
+		{
+			if (wibo_available())
+			{
+				return 1;
+			}
+			_delay_ms(1);
+		}
+	}
+	return wibo_available();
+}
+#endif
+
+/*
+ * \brief Session parameters the application left for the OTA request,
+ * see mailbox.h of the bootloader. Call after wibo_init().
+ *
+ * @param channel Channel of the host, 0: the configured one
+ * @param rate Data rate hash code, 0: 250kbps
+ * @param host Short address of the host, 0xFFFF: unknown
+ */
+void wibo_handoff(uint8_t channel, uint8_t rate, uint16_t host)
+{
+	if (channel)
+	{
+		nodeconfig.channel = channel;
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+		rendezvous = 0; /* the host is known to be there */
+#endif
+		trx_reg_write(RG_PHY_CC_CCA, channel);
+	}
+#if defined(WIBO_FLAVOUR_RATE)
+	if (rate)
+	{
+		wibo_setrate(rate);
+	}
+#else
+	(void) rate;
+#endif
+#if defined(WIBO_FLAVOUR_PROBE)
+	probereq.hdr.dst = host;
+#else
+	(void) host;
+#endif
+}
+
+#if defined(RADIO_HANDOFF)
+/*
+ * \brief Leave the transceiver to the application, call right before it
+ * is started. radio_init() of uracoli skips the reset when the record at
+ * RADIO_HANDOFF is valid, see get_radio_handoff() in board.h.
+ */
+void wibo_radio_save(void)
+{
+	radio_handoff_t *rh = (radio_handoff_t *) RADIO_HANDOFF;
+	uint8_t *p = (uint8_t *) rh;
+	uint8_t i, crc = 0;
+
+	rh->magic = 0;
+	if (!trxready)
+	{
+		return; /* still in reset state, nothing to skip */
+	}
+#if defined(WIBO_FLAVOUR_RATE)
+	if (highrate)
+	{
+		wibo_setrate(OQPSK250);
+	}
+#endif
+	trx_reg_write(RG_IRQ_MASK, 0);
+	trx_reg_write(RG_TRX_STATE, CMD_FORCE_TRX_OFF);
+	trx_reg_write(RG_IRQ_STATUS, 0xFF); /* clear all flags */
+
+	rh->magic = RADIO_HANDOFF_MAGIC;
+	rh->state = TRX_OFF;
+	rh->channel = trx_bit_read(SR_CHANNEL);
+	rh->pan_id = nodeconfig.pan_id;
+	rh->short_addr = nodeconfig.short_addr;
+	for (i = 0; i < sizeof(radio_handoff_t) - 1; i++)
+	{
+		crc = _crc_ibutton_update(crc, p[i]);
+	}
+	rh->crc = crc;
+}
+#endif
+
+uint8_t wibo_run(void)
+{
+	uint8_t isLeave=0;
+	uint8_t isStay=0;
+	unsigned long timeout = WIBO_TIMEOUT;
+	
+#if defined(WIBO_FLAVOUR_DELTA) && !defined(WIBO_FLAVOUR_SLOTS)
+	/* the application is half patched, wait for the host to complete it */
+	if (0xFFFF != eeprom_read_word((uint16_t *) WIBO_DELTA_EEADDR))
+	{
+		isStay=1;
+	}
+#endif
+#if defined(WIBO_FLAVOUR_RESUME) && !defined(WIBO_FLAVOUR_SLOTS)
+	/* the application is half written, wait for the host to resume */
+	if (0xFFFF != eeprom_read_word((uint16_t *) WIBO_RESUME_EEADDR))
+	{
+		isStay=1;
+	}
+#endif
+
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+	wibo_rxq_start();
+#endif
+
+#if defined(WIBO_FLAVOUR_PROBE)
+	if (!isStay)
+	{
+		uint8_t found = wibo_probe();
+
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+		if (!found && rendezvous)
+		{
+			/* the host may sit on the configured channel */
+			rendezvous = 0;
+			trx_reg_write(RG_PHY_CC_CCA, nodeconfig.channel);
+			found = wibo_probe();
+		}
+#endif
+		if (!found)	/* no host, don't keep the application waiting */
+		{
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+			wibo_rxq_stop();
+#endif
+			return 1;
+		}
+	}
 #endif
 
-uint8_t wibo_run(void)
-{
-	uint8_t isLeave=0;
-	uint8_t isStay=0;
-	unsigned long timeout = WIBO_TIMEOUT;
-	
 	while(!isLeave) {
 #if !defined(NO_LEDS)
 		LED_CLR(PROGLED);
 #endif
 		if (!(isStay))
 		{
-			while(!(wibo_available()) && (timeout--))  _delay_ms(1);	// minimum frame time @ 250kbps ~ 2ms.
+			while(!(wibo_available()) && (timeout--))
+			{
+				_delay_ms(1);	// minimum frame time @ 250kbps ~ 2ms.
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+				if (rendezvous && (WIBO_TIMEOUT - timeout >= WIBO_RENDEZVOUS_MS))
+				{
+					/* nobody there, back to the configured channel */
+					rendezvous = 0;
+					trx_reg_write(RG_PHY_CC_CCA, nodeconfig.channel);
+				}
+#endif
+			}
 		
 			if (!(wibo_available()))	// no packets received, bye bye!
 			{
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+				wibo_rxq_stop();
+#endif
 				isLeave=1;
 				return isLeave;
 			}			
 		}
 		else
 		{
+#if defined(WIBO_FLAVOUR_RATE)
+			uint16_t idle = WIBO_RATE_TIMEOUT;
+
+			/* at high rates the link may have broken, then the host
+			 * talks to us at 250kbps again
+			 */
+			while(!(wibo_available()) && (!highrate || idle--))
+			{
+				if (highrate) _delay_ms(1);
+			}
+			if (!(wibo_available()))
+			{
+				wibo_setrate(OQPSK250);
+				continue;
+			}
+#else
 			while(!(wibo_available()));	// wait for next packet
+#endif
 		}
 
-		trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_RX_END); /* clear the flag */
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+		memcpy(rxbuf.data, rxq.slot[rxq.ridx].frame, sizeof(rxbuf.data));
+		rxq.slot[rxq.ridx].len = 0;
+		rxq.ridx = (rxq.ridx + 1) & (WIBO_RXQ_LEN - 1);
+		if (rxq.held)
+		{
+			cli();
+			wibo_rxq_take();
+			sei();
+		}
+#else
+		WIBO_RX_CLEAR(); /* clear the flag */
+
+		{
+			bool crc_ok;
+
+			trx_frame_read_data_crc(rxbuf.data,
+					sizeof(rxbuf.data) / sizeof(rxbuf.data[0]),
+					&tmp, &crc_ok); /* dont use LQI, write into tmp variable */
+			if (!crc_ok)
+			{
+				/* never act on a damaged command, the host repeats it */
+#if defined(ENABLE_BOOTINFO)
+				bootinfo.lost++;
+#endif
+#if defined(WIBO_FLAVOUR_WINDOW)
+				winlost++;
+#endif
+				TRACE(TRACE_WIBO_LOST, rxbuf.hdr.cmd);
+				continue;
+			}
+		}
+#endif
+#if defined(ENABLE_PROFILER)
+		{
+			uint32_t t = prof_now();
 
-		trx_frame_read(rxbuf.data, sizeof(rxbuf.data) / sizeof(rxbuf.data[0]),
-				&tmp); /* dont use LQI, write into tmp variable */
+			if (proflastrx)
+			{
+				prof_add(PROF_WIBO_GAP, t - proflastrx);
+			}
+			proflastrx = t;
+		}
+#endif
+#if defined(ENABLE_BOOTINFO)
+		bootinfo.path |= BOOTINFO_WIBO;
+#endif
+		TRACE(TRACE_WIBO_RX, ((uint16_t) rxbuf.hdr.cmd << 8) | rxbuf.hdr.seq);
 
 #if !defined(NO_LEDS)
 		LED_SET(PROGLED);
@@ -333,44 +1835,127 @@ uint8_t wibo_run(void)
 		switch (rxbuf.hdr.cmd)
 		{
 
+#if defined(WIBO_FLAVOUR_DISCOVER)
+		case P2P_WIBO_DISCOVER:
+			if (0 == deaf)
+			{
+				uint16_t h;
+				uint8_t slot;
+
+				/* the round mixes in, nodes that collided meet
+				 * in different slots next time
+				 */
+				h = _crc_ccitt_update(0, nodeconfig.short_addr & 0xFF);
+				h = _crc_ccitt_update(h, nodeconfig.short_addr >> 8);
+				h = _crc_ccitt_update(h, rxbuf.wibo_discover.round);
+				slot = rxbuf.wibo_discover.nslots ?
+						(h % rxbuf.wibo_discover.nslots) : 0;
+				while (slot--)
+				{
+					_delay_ms(P2P_WIBO_DISCOVER_SLOT_MS);
+				}
+			}
+			/* no break, reply as to a ping */
+#endif
 		case P2P_PING_REQ:
 			isStay=1;
 			if (0 == deaf)
 			{
 				pingrep.hdr.dst = rxbuf.hdr.src;
 				pingrep.hdr.seq++;
+#if defined(WIBO_FLAVOUR_DELTA)
+				if (P2P_ERROR_DELTA_RESUME == pingrep.errno)
+				{
+					pingrep.crc = eeprom_read_word((uint16_t *) WIBO_DELTA_EEADDR);
+				}
+				else
+#endif
+#if defined(WIBO_FLAVOUR_EEPROM)
+				if (target == 'E')
+				{
+					pingrep.crc = eecrc;
+				}
+				else
+#endif
 				pingrep.crc = datacrc;
 
-				trx_reg_write(RG_TRX_STATE, CMD_TX_ARET_ON);
-
-				/* no need to make block atomic since no IRQs are used */
-				TRX_SLPTR_HIGH()
-				;
-				TRX_SLPTR_LOW()
-				;
-				trx_frame_write(sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME) + 2,
-						(uint8_t*) &pingrep);
-				/*******************************************************/
+				wibo_send(PINGREP_SIZE + 2, (uint8_t*) &pingrep);
 
 #if defined(_DEBUG_SERIAL_)
 				printf("Pinged by 0x%04X"EOL, rxbuf.hdr.src);
 #endif
-
-#if defined(TRX_IF_RFA1)
-				while (!(trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_TX_END))
-					;
-				trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_TX_END); /* clear the flag */
-#else
-				while (!(trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_TRX_END))
-				;
-#endif /* defined(TRX_IF_RFA1) */
-				trx_reg_write(RG_TRX_STATE, CMD_RX_AACK_ON);
 			} /* (0 == deaf) */
 			break;
 
+#if defined(WIBO_FLAVOUR_RENDEZVOUS)
+		case P2P_WIBO_CHANNEL:
+			isStay=1;
+			if ((TRX_MIN_CHANNEL <= rxbuf.wibo_channel.channel)
+					&& (TRX_MAX_CHANNEL >= rxbuf.wibo_channel.channel))
+			{
+				rendezvous = 0;
+				trx_reg_write(RG_PHY_CC_CCA, rxbuf.wibo_channel.channel);
+#if defined(_DEBUG_SERIAL_)
+				printf("Channel %d"EOL, rxbuf.wibo_channel.channel);
+#endif
+			}
+			break;
+#endif
+
+#if defined(WIBO_FLAVOUR_PINGSHORT)
+		case P2P_PING_SHORT_REQ:
+			isStay=1;
+			if (0 == deaf)
+			{
+				uint16_t h;
+				uint8_t slot, i;
+
+				/* RND_VALUE gives 2 random bits in receive state, the
+				 * address keeps nodes apart that read the same bits
+				 */
+				h = _crc_ccitt_update(0, nodeconfig.short_addr & 0xFF);
+				h = _crc_ccitt_update(h, nodeconfig.short_addr >> 8);
+				for (i = 0; i < 4; i++)
+				{
+					h = _crc_ccitt_update(h, (trx_reg_read(RG_PHY_RSSI) >> 5) & 3);
+				}
+				slot = rxbuf.ping_short.nslots ?
+						(h % rxbuf.ping_short.nslots) : 0;
+				while (slot--)
+				{
+					_delay_ms(P2P_PING_SHORT_SLOT_MS);
+				}
+				shortrep.hdr.dst = rxbuf.hdr.src;
+				shortrep.hdr.seq++;
+				shortrep.flags = P2P_PING_SHORT_BOOTL
+						| P2P_PING_SHORT_FLAGS(pingrep.status, pingrep.errno);
+				shortrep.crc = datacrc;
+#if defined(WIBO_FLAVOUR_EEPROM)
+				if (target == 'E')
+				{
+					shortrep.crc = eecrc;
+				}
+#endif
+#if defined(WIBO_FLAVOUR_DELTA)
+				if (P2P_ERROR_DELTA_RESUME == pingrep.errno)
+				{
+					shortrep.crc = eeprom_read_word((uint16_t *) WIBO_DELTA_EEADDR);
+				}
+#endif
+				wibo_send(sizeof(p2p_ping_short_cnf_t) + 2, (uint8_t*) &shortrep);
+			}
+			break;
+#endif
+
 		case P2P_WIBO_TARGET:
 			isStay=1;
 			target = rxbuf.wibo_target.targmem;
+#if defined(WIBO_FLAVOUR_EEPROM)
+			if (target == 'E')
+			{
+				eecrc = 0;
+			}
+#endif
 #if defined(_DEBUG_SERIAL_)
 			printf("Set Target to %c"EOL, target);
 #endif
@@ -393,15 +1978,83 @@ uint8_t wibo_run(void)
 			datacrc = 0;
 			pagebufidx = 0;
 			deaf = 0;
+#if defined(WIBO_FLAVOUR_WINDOW)
+			rxseq = 0;
+			winmap = 0;
+			winpages = 0;
+			winlost = 0;
+#endif
+#if defined(WIBO_FLAVOUR_FEC)
+			fecrep.nblocks = 0;
+			memset(fecrep.done, 0, sizeof(fecrep.done));
+			wibo_fec_start(0);
+#endif
+#if defined(WIBO_FLAVOUR_LZ)
+			zmode = P2P_WIBO_ZMODE_RAW;
+			zbits = 0;
+			zphase = 0;
+#endif
+#if defined(WIBO_FLAVOUR_DELTA)
+			oldvalid = 0;
+#endif
+#if defined(WIBO_FLAVOUR_RESUME)
+			ckptcrc = 0;
+			ckptfirst = 1;
+#endif
+#if defined(WIBO_FLAVOUR_SLOTS)
+			/* a committed image is overwritten from now on */
+			eeprom_update_byte((uint8_t *) WIBO_SLOT_EEADDR, 0xFF);
+#endif
+#if defined(WIBO_FLAVOUR_SIGNED)
+			wibo_mac_reset();
+#endif
+			break;
+
+#if defined(WIBO_FLAVOUR_RESUME)
+		case P2P_WIBO_RESUME:
+			isStay=1;
+			resumerep.page = eeprom_read_word((uint16_t *) WIBO_RESUME_EEADDR);
+			resumerep.crc = eeprom_read_word((uint16_t *) (WIBO_RESUME_EEADDR + 2));
+
+			/* only the checkpoint itself can be continued */
+			if ((0xFFFF != resumerep.page)
+					&& (rxbuf.wibo_resume.page == resumerep.page)
+					&& (rxbuf.wibo_resume.crc == resumerep.crc))
+			{
+				addr = (uint32_t) resumerep.page * SPM_PAGESIZE;
+				datacrc = resumerep.crc;
+				ckptcrc = resumerep.crc;
+				ckptfirst = 0;
+				pagebufidx = 0;
+				target = 'F';
+#if defined(WIBO_FLAVOUR_LZ)
+				zmode = P2P_WIBO_ZMODE_RAW;
+#endif
+			}
+			resumerep.hdr.dst = rxbuf.hdr.src;
+			resumerep.hdr.seq++;
+			wibo_send(sizeof(p2p_wibo_resume_t) + 2, (uint8_t*) &resumerep);
 			break;
+#endif
 
 		case P2P_WIBO_ADDR:
 			isStay=1;
 #if defined(_DEBUG_SERIAL_)
 			printf("Set address: 0x%08lX"EOL, rxbuf.wibo_addr.address);
 #endif
+			TRACE(TRACE_WIBO_ADDR, rxbuf.wibo_addr.address >> 8);
 			addr = rxbuf.wibo_addr.address;
 			pagebufidx = 0;
+#if defined(WIBO_FLAVOUR_LZ)
+			zbits = 0; /* host compresses each address range on its own */
+			zphase = 0;
+#endif
+#if defined(WIBO_FLAVOUR_DELTA)
+			oldvalid = 0;
+#endif
+#if defined(WIBO_FLAVOUR_RESUME)
+			ckptcrc = datacrc;
+#endif
 			break;
 
 		case P2P_WIBO_DATA:
@@ -418,60 +2071,234 @@ uint8_t wibo_run(void)
 				printf("...");
 			printf(EOL);
 #endif
-			tmp = rxbuf.wibo_data.dsize;
-			ptr = rxbuf.wibo_data.data;
-			do
+			wibo_consume(rxbuf.wibo_data.data, rxbuf.wibo_data.dsize);
+			break;
+
+#if defined(WIBO_FLAVOUR_WINDOW)
+		case P2P_WIBO_DATA_SEQ:
+			isStay=1;
 			{
-				datacrc = _crc_ccitt_update(datacrc, *ptr);
-				pagebuf[pagebufidx++] = *ptr;
-				if (pagebufidx >= PAGEBUFSIZE)
+				uint16_t offset = rxbuf.wibo_data_seq.seqno - rxseq;
+				uint8_t slot = rxbuf.wibo_data_seq.seqno % P2P_WIBO_WINDOW_SIZE;
+
+				/* duplicates and frames beyond the window are dropped,
+				 * the host learns about them from the window reply
+				 */
+				if ((offset < P2P_WIBO_WINDOW_SIZE) && !(winmap & (1 << offset))
+						&& (rxbuf.wibo_data_seq.dsize > 0)
+						&& (rxbuf.wibo_data_seq.dsize <= WINDOW_DATA_MAX))
 				{
-					/* LED off to save current and avoid flash corruption
-					 *  because of possible voltage drops
-					 */
-#if !defined(NO_LEDS)
-					LED_CLR(PROGLED);
-#endif
+					winbuf[slot].dsize = rxbuf.wibo_data_seq.dsize;
+					memcpy(winbuf[slot].data, rxbuf.wibo_data_seq.data,
+							rxbuf.wibo_data_seq.dsize);
+					winmap |= (1 << offset);
 
-					if (target == 'F') /* Flash memory */
+					/* move everything that is in order now to the page buffer */
+					while (winmap & 1)
 					{
-						boot_program_page(addr, pagebuf);
+						slot = rxseq % P2P_WIBO_WINDOW_SIZE;
+						wibo_consume(winbuf[slot].data, winbuf[slot].dsize);
+						winmap >>= 1;
+						rxseq++;
 					}
-					else if (target == 'E')
+				}
+			}
+			break;
+
+		case P2P_WIBO_WINDOW_REQ:
+			isStay=1;
+			windowrep.hdr.dst = rxbuf.hdr.src;
+			windowrep.hdr.seq++;
+			windowrep.base = rxseq;
+			windowrep.received = winmap;
+			windowrep.crc = datacrc;
+			windowrep.pages = winpages;
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+			cli();
+			windowrep.lost = winlost;
+			sei();
+#else
+			windowrep.lost = winlost;
+#endif
+#if defined(ENABLE_BOOTINFO)
+			{
+				/* holes below the last frame received */
+				uint16_t m = winmap;
+
+				for (; m; m >>= 1)
+				{
+					bootinfo.lost += !(m & 1);
+				}
+			}
+#endif
+			wibo_send(sizeof(p2p_wibo_window_cnf_t) + 2, (uint8_t*) &windowrep);
+			break;
+#endif /* defined(WIBO_FLAVOUR_WINDOW) */
+
+#if defined(WIBO_FLAVOUR_FEC)
+		case P2P_WIBO_FEC:
+			isStay=1;
+			{
+				uint16_t b = rxbuf.wibo_fec.block;
+
+				/* symbols of blocks done already are dropped, so are
+				 * blocks that would reach into the bootloader
+				 */
+#if defined(WIBO_FLAVOUR_SLOTS)
+				if ((target == 'F') && (b < rxbuf.wibo_fec.nblocks)
+						&& (b < P2P_WIBO_FEC_MAXBLOCKS)
+						&& !(fecrep.done[b >> 3] & (1 << (b & 7)))
+						&& (addr + (uint32_t) (b + 1) * FEC_BLOCKSIZE
+						<= WIBO_SLOT_SIZE))
+#else
+				if ((target == 'F') && (b < rxbuf.wibo_fec.nblocks)
+						&& (b < P2P_WIBO_FEC_MAXBLOCKS)
+						&& !(fecrep.done[b >> 3] & (1 << (b & 7)))
+						&& (addr + (uint32_t) (b + 1) * FEC_BLOCKSIZE
+						<= (uint32_t) BOOTLOADER_ADDRESS * 2))
+#endif
+				{
+					fecrep.nblocks = rxbuf.wibo_fec.nblocks;
+					if (b != fecblock)
 					{
-						/* not implemented */
+						/* the host moved on, a later pass repairs it */
+						wibo_fec_start(b);
 					}
-					else
+					if (wibo_fec_add(rxbuf.wibo_fec.mask, rxbuf.wibo_fec.data))
 					{
-						/* unknown target, dry run */
+						wibo_fec_program();
+						wibo_fec_start(b);
 					}
+				}
+			}
+			break;
+
+		case P2P_WIBO_FEC_REQ:
+			isStay=1;
+			fecrep.hdr.dst = rxbuf.hdr.src;
+			fecrep.hdr.seq++;
+			fecrep.crc = datacrc;
+			wibo_send(sizeof(p2p_wibo_fec_cnf_t) + 2, (uint8_t*) &fecrep);
+			break;
+#endif /* defined(WIBO_FLAVOUR_FEC) */
+
+#if defined(WIBO_FLAVOUR_LZ)
+		case P2P_WIBO_ZMODE:
+			isStay=1;
+			zmode = rxbuf.wibo_zmode.mode;
+			zbits = 0;
+			zphase = 0;
+#if defined(WIBO_FLAVOUR_DELTA)
+			if (P2P_WIBO_ZMODE_DELTA == zmode)
+			{
+				/* the patch only fits the image it was made against */
+				if (crc_ccitt_flash(0, 0, rxbuf.wibo_zmode.baselen)
+						!= rxbuf.wibo_zmode.basecrc)
+				{
+					target = 'X'; /* dry run, keep the application */
+					pingrep.status = P2P_STATUS_ERROR;
+					pingrep.errno = P2P_ERROR_DELTA_BASE;
+				}
+				else
+				{
+					pingrep.status = P2P_STATUS_RECEIVINGDATA;
+					pingrep.errno = P2P_ERROR_NONE;
+				}
+			}
+#endif
+			break;
+#endif
 
-					/* also for dry run! */
-					addr += SPM_PAGESIZE;
-					pagebufidx = 0;
+#if defined(WIBO_FLAVOUR_ERASE)
+		case P2P_WIBO_ERASE:
+			isStay=1;
+#if defined(WIBO_FLAVOUR_SLOTS)
+			if ((target == 'F') && (rxbuf.wibo_erase.address
+					+ (uint32_t) rxbuf.wibo_erase.npages * SPM_PAGESIZE
+					<= WIBO_SLOT_SIZE))
+#else
+			if ((target == 'F') && (rxbuf.wibo_erase.address
+					+ (uint32_t) rxbuf.wibo_erase.npages * SPM_PAGESIZE
+					<= (uint32_t) BOOTLOADER_ADDRESS * 2))
+#endif
+			{
+				uint32_t a = WIBO_PHYS(rxbuf.wibo_erase.address);
+				uint16_t n = rxbuf.wibo_erase.npages;
+
+#if !defined(NO_LEDS)
+				LED_CLR(PROGLED);
+#endif
+				while (n--)
+				{
+#if defined(WIBO_FLAVOUR_SIGNED)
+					wibo_mac_page(a - WIBO_PHYS(0), NULL);
+#endif
+					spm_page_erase(a);
+					boot_spm_busy_wait();
+					a += SPM_PAGESIZE;
 				}
-				ptr++;
-			} while (--tmp);
+				spm_rww_enable();
+			}
+			break;
+#endif
+
+#if defined(WIBO_FLAVOUR_RATE)
+		case P2P_WIBO_RATE:
+			isStay=1;
+			wibo_setrate(rxbuf.wibo_rate.rate);
 			break;
+#endif
 #if defined(WIBO_FLAVOUR_BOOTLUP)
 		case P2P_WIBO_BOOTLUP:
 			isStay=1;
-			bootlup();
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+			wibo_rxq_stop();
+#endif
+			bootlup(); /* only returns if the staged image is rejected */
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+			wibo_rxq_start();
+#endif
+			pingrep.status = P2P_STATUS_ERROR;
+			pingrep.errno = P2P_ERROR_BOOTLUP;
 		break;
 #endif
 
+#if defined(WIBO_FLAVOUR_SLOTS)
+		case P2P_WIBO_COMMIT:
+			isStay=1;
+			{
+				uint16_t crc;
+
+				pingrep.errno = wibo_slot_commit(rxbuf.wibo_commit.len,
+						rxbuf.wibo_commit.crc, rxbuf.wibo_commit.mac, 1, &crc);
+				pingrep.status = (P2P_ERROR_SUCCESS == pingrep.errno) ?
+						P2P_STATUS_IDLE : P2P_STATUS_ERROR;
+				pingrep.hdr.dst = rxbuf.hdr.src;
+				pingrep.hdr.seq++;
+				pingrep.crc = crc;
+				wibo_send(PINGREP_SIZE + 2, (uint8_t*) &pingrep);
+			}
+			break;
+#endif
+
 		case P2P_WIBO_FINISH:
 			isStay=1;
 #if defined(_DEBUG_SERIAL_)
 			printf("Finish"EOL);
 #endif
+			TRACE(TRACE_WIBO_DONE, datacrc);
 			if (target == 'F') /* Flash memory */
 			{
-				boot_program_page(addr, pagebuf);
+#if defined(WIBO_FLAVOUR_SIGNED)
+				if (pagebufidx) /* an empty page is not part of the image */
+#endif
+				wibo_program(addr, pagebuf);
 			}
 			else if (target == 'E')
 			{
-				/* not implemented */
+#if defined(WIBO_FLAVOUR_EEPROM)
+				wibo_ee_write(addr, pagebuf, pagebufidx);
+#endif
 			}
 			else
 			{
@@ -487,6 +2314,13 @@ uint8_t wibo_run(void)
 		case P2P_WIBO_EXIT:
 #if defined(_DEBUG_SERIAL_)
 			printf("Exit"EOL);
+#endif
+			TRACE(TRACE_WIBO_DONE, datacrc);
+#if defined(WIBO_FLAVOUR_DELTA)
+			eeprom_write_word((uint16_t *) WIBO_DELTA_EEADDR, 0xFFFF);
+#endif
+#if defined(WIBO_FLAVOUR_RESUME)
+			eeprom_update_word((uint16_t *) WIBO_RESUME_EEADDR, 0xFFFF);
 #endif
 #if !defined(NO_LEDS)
 			LED_CLR(PROGLED);
@@ -509,8 +2343,186 @@ uint8_t wibo_run(void)
 		}; /* switch (rxbuf.hdr.cmd) */
 	}
 
+#if defined(WIBO_FLAVOUR_RXQUEUE)
+	wibo_rxq_stop();
+#endif
 	return isLeave;
 }
 
+#if defined(WIBO_FLAVOUR_SLOTS)
+/*
+ * \brief Copy a committed image from the staging slot to address 0
+ *
+ * Called before the application is started. Power loss during the copy
+ * leaves the boot pointer set, so the copy is repeated on the next boot,
+ * the staged image is not touched by it.
+ */
+void wibo_slot_install(void)
+{
+	uint32_t len, a;
+	uint16_t crc = 0;
+#if SPM_PAGESIZE > 255
+	uint16_t i;
+#else
+	uint8_t i;
+#endif
+
+	if (WIBO_SLOT_PENDING != eeprom_read_byte((uint8_t *) WIBO_SLOT_EEADDR))
+	{
+		return;
+	}
+	len = eeprom_read_dword((uint32_t *) (WIBO_SLOT_EEADDR + 1));
+	if (len > WIBO_SLOT_SIZE)
+	{
+		eeprom_update_byte((uint8_t *) WIBO_SLOT_EEADDR, 0xFF);
+		return;
+	}
+	for (a = 0; a < len; a += SPM_PAGESIZE)
+	{
+		i = 0;
+		do
+		{
+			pagebuf[i] = wibo_read_flash(WIBO_PHYS(a) + i);
+		} while (++i < SPM_PAGESIZE);
+		boot_program_page(a, pagebuf);
+	}
+	spm_rww_enable();
+
+	for (a = 0; a < len; a++)
+	{
+		crc = _crc_ccitt_update(crc, wibo_read_flash(a));
+	}
+	if (crc == eeprom_read_word((uint16_t *) (WIBO_SLOT_EEADDR + 5)))
+	{
+		eeprom_update_byte((uint8_t *) WIBO_SLOT_EEADDR, 0xFF);
+	}
+}
+#endif
+
+#if defined(WIBO_FLAVOUR_APPSPM)
+/*
+ * The services are called by the application through the table, see
+ * wibosvc.h. Interrupts are off until the application section is
+ * readable again, the vectors of the application are in it.
+ */
+
+/*
+ * \brief Erase and program a page for the application
+ *
+ * @param addr Page address, below the bootloader section
+ * @param *buf Page content, NULL to erase only
+ */
+static uint8_t wibo_svc_program(uint32_t addr, uint8_t *buf)
+{
+	uint8_t sreg;
+
+	if ((addr >= (uint32_t) BOOTLOADER_ADDRESS * 2) || (addr & (SPM_PAGESIZE - 1)))
+	{
+		return WIBO_SVC_REJECTED;
+	}
+	sreg = SREG;
+	cli();
+	eeprom_busy_wait(); /* no SPM while the EEPROM is written */
+	if (buf)
+	{
+		boot_program_page(addr, buf);
+	}
+	else
+	{
+		spm_page_erase(addr);
+		boot_spm_busy_wait();
+	}
+	spm_rww_enable();
+	SREG = sreg;
+	return WIBO_SVC_OK;
+}
+
+/*
+ * \brief Program a page of the staging slot
+ *
+ * @param addr Page address, inside the staging slot
+ * @param *buf Page content
+ */
+uint8_t wibo_spm_page(uint32_t addr, uint8_t *buf)
+{
+#if defined(WIBO_FLAVOUR_SLOTS)
+	if ((addr >= WIBO_SLOT_SIZE) && (addr < 2 * WIBO_SLOT_SIZE) && buf)
+	{
+		return wibo_svc_program(addr, buf);
+	}
+#endif
+	return WIBO_SVC_REJECTED;
+}
+
+uint8_t wibo_svc_page_erase(uint32_t addr)
+{
+	return wibo_svc_program(addr, NULL);
+}
+
+uint8_t wibo_svc_page_write(uint32_t addr, uint8_t *buf)
+{
+	return buf ? wibo_svc_program(addr, buf) : WIBO_SVC_REJECTED;
+}
+
+uint16_t wibo_svc_crc(uint32_t addr, uint32_t len)
+{
+	uint16_t crc = 0;
+
+	while (len-- && (addr <= FLASHEND))
+	{
+		crc = _crc_ccitt_update(crc, wibo_read_flash(addr++));
+	}
+	return crc;
+}
+
+uint8_t wibo_svc_ee_write(uint16_t addr, const uint8_t *buf, uint8_t len)
+{
+	if ((uint32_t) addr + len > (uint32_t) E2END + 1)
+	{
+		return WIBO_SVC_REJECTED;
+	}
+	eeprom_update_block(buf, (void *) addr, len);
+	eeprom_busy_wait();
+	return WIBO_SVC_OK;
+}
+
+uint8_t wibo_svc_commit(uint32_t len, uint16_t crc, const uint8_t *mac)
+{
+#if defined(WIBO_FLAVOUR_SLOTS)
+	uint16_t c;
+
+	switch (wibo_slot_commit(len, crc, mac, 0, &c))
+	{
+	case P2P_ERROR_SUCCESS:
+		return WIBO_SVC_OK;
+	case P2P_ERROR_SIGNATURE:
+		return WIBO_SVC_BAD_MAC;
+	default:
+		return WIBO_SVC_BAD_CRC;
+	}
+#else
+	return WIBO_SVC_REJECTED;
+#endif
+}
+
+/*
+ * \brief The table, at the fixed address WIBO_SVC_ADDR, entries are
+ * only appended
+ */
+void __attribute__ ((naked, section (".wibo_svc"))) wibo_svc_table(void)
+{
+	__asm__ __volatile__ (
+		".word %0"			"\n\t"
+		".word %1"			"\n\t"
+		"jmp wibo_spm_page"		"\n\t"
+		"jmp wibo_svc_page_erase"	"\n\t"
+		"jmp wibo_svc_page_write"	"\n\t"
+		"jmp wibo_svc_crc"		"\n\t"
+		"jmp wibo_svc_ee_write"		"\n\t"
+		"jmp wibo_svc_commit"		"\n\t"
+		:: "i" (WIBO_SVC_MAGIC), "i" (WIBO_SVC_VERSION));
+}
+#endif
+
 /* EOF */
 
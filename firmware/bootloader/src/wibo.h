@@ -8,24 +8,23 @@
 #ifndef WIBO_H_
 #define WIBO_H_
 
+#include "spm.h"
+
 /*
  * \brief Program a page
- * (1) Erase the page containing at the given address
- * (2) Fill the page buffer
+ * (1) Fill the page buffer
+ * (2) Erase the page containing at the given address
  * (3) Write the page buffer
  * (4) Wait for finish
  *
+ * The SPMs of spm.c are safe against the receive ISR of
+ * WIBO_FLAVOUR_RXQUEUE.
+ *
  * @param addr The address containing the page to program
  * @param *buf Pointer to buffer of page content
  */
 static inline void boot_program_page(uint32_t addr, uint8_t *buf)
 {
-#if SPM_PAGESIZE > 255
-	uint16_t i;
-#else
-	uint8_t i;
-#endif
-
 #if defined(SERIALDEBUG)
 	printf("Write Flash addr=%04lX"EOL, addr);
 	/*
@@ -42,28 +41,28 @@ static inline void boot_program_page(uint32_t addr, uint8_t *buf)
 	 putchar('\n');
 	 */
 #else /* defined(SERIALDEBUG) */
-	boot_page_erase(addr);
-	boot_spm_busy_wait();
-
-	i = SPM_PAGESIZE;
-	do
-	{
-		/* Set up little-endian word */
-		uint16_t w = *buf++;
-		w += (*buf++) << 8;
-
-		boot_page_fill(addr + SPM_PAGESIZE - i, w);
-
-		i -= 2;
-	} while (i);
-
-	boot_page_write(addr);
-	boot_spm_busy_wait();
+	spm_page_program(addr, buf);
 #endif /* defined(SERIALDEBUG) */
 }
 
 void wibo_init(uint8_t channel, uint16_t pan_id, uint16_t short_addr, uint64_t ieee_addr);
 uint8_t wibo_available(void);
+void wibo_listen(void);
+void wibo_stop(void);
+void wibo_handoff(uint8_t channel, uint8_t rate, uint16_t host);
+void wibo_radio_save(void);	// with RADIO_HANDOFF of the board
 uint8_t wibo_run(void);
+#if defined(WIBO_FLAVOUR_SLOTS)
+void wibo_slot_install(void);
+#endif
+#if defined(WIBO_FLAVOUR_APPSPM)
+uint8_t wibo_spm_page(uint32_t addr, uint8_t *buf);
+uint8_t wibo_svc_page_erase(uint32_t addr);
+uint8_t wibo_svc_page_write(uint32_t addr, uint8_t *buf);
+uint16_t wibo_svc_crc(uint32_t addr, uint32_t len);
+uint8_t wibo_svc_ee_write(uint16_t addr, const uint8_t *buf, uint8_t len);
+uint8_t wibo_svc_commit(uint32_t len, uint16_t crc, const uint8_t *mac);
+void wibo_svc_table(void);
+#endif
 
 #endif /* WIBO_H_ */
@@ -0,0 +1,399 @@
+#!/usr/bin/env python
+"""
+stkflash.py - fast serial flashing through the STK500v2 bootloader
+
+Speaks the Pinoccio extensions of the bootloader protocol which avrdude
+doesn't use: blocks of several pages per CMD_PROGRAM_FLASH_ISP
+(PARAM_PINOCCIO_BLOCKSIZE), a higher serial rate after sign-on
+(PARAM_PINOCCIO_BAUDRATE), page CRCs to leave out pages that are already
+in place (CMD_PINOCCIO_PAGE_CRC) and a CRC verify instead of reading the
+image back (CMD_PINOCCIO_FLASH_CRC), see src/command.h. The first bytes
+of the next frame are sent while the bootloader still programs the
+current block, its receive ring holds them.
+
+The image is prepared as for wibohost.py -s: page aligned runs, pages
+that are all 0xFF are not sent. With the extensions, those pages are
+compared against the device like all others and erased if they aren't
+erased already. A bootloader without them (PROFILE=minimal) is flashed
+with plain blocks at 115200 and verified by reading back; the pages left
+out keep their old content then, as the bootloader does no chip erase.
+
+HEXFILE can also be an image container (wibohost.py -W, wiboimage.py),
+its page CRCs are compared with those of the device as they are.
+
+Usage:
+ python stkflash.py [OPTIONS] HEXFILE
+
+Options:
+ -p PORT    serial port, default /dev/ttyACM0
+ -b BAUD    rate after sign-on: 115200, 250000, 500000 or 1000000,
+            default 1000000
+ -r         reset the node through DTR first
+ -f         write all pages of the image, don't compare page CRCs
+ -a BYTES   bytes of the next frame sent ahead, default 192,
+            0 waits for each reply (no effect without the extensions)
+ -B PAGES   pages per block at most, default: as many as the bootloader takes
+ -n         don't verify
+ -R         verify by reading back, also with the CRC command
+ -k         stay in the bootloader, don't start the application
+ -v         show the frames
+ -h         show this help
+
+Example:
+ python stkflash.py -r -p /dev/ttyACM0 Bootstrap.cpp.hex
+"""
+
+import os, sys, time, struct, getopt
+import serial
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "uracoli-src-20131127", "wibo"))
+from wibohost import read_hex_pages, read_page_crcs, erase_runs, \
+     changed_runs, data_crc32, PAGESIZE, BOOTLOADER_START, ImageError
+
+BAUDRATE = 115200
+# index is the value of PARAM_PINOCCIO_BAUDRATE, same as baudTable in main.c
+BAUDTABLE = [115200, 250000, 500000, 1000000]
+
+# src/command.h
+MESSAGE_START = 0x1b
+TOKEN = 0x0e
+CMD_SIGN_ON = 0x01
+CMD_SET_PARAMETER = 0x02
+CMD_GET_PARAMETER = 0x03
+CMD_LOAD_ADDRESS = 0x06
+CMD_ENTER_PROGMODE_ISP = 0x10
+CMD_LEAVE_PROGMODE_ISP = 0x11
+CMD_PROGRAM_FLASH_ISP = 0x13
+CMD_READ_FLASH_ISP = 0x14
+CMD_PINOCCIO_PAGE_CRC = 0x50
+CMD_PINOCCIO_FLASH_CRC = 0x51
+STATUS_CMD_OK = 0x00
+PARAM_PINOCCIO_BAUDRATE = 0xc0
+PARAM_PINOCCIO_BLOCKSIZE = 0xc1
+
+# RX_RING_SIZE of main.c is 256, the rest is margin
+AHEAD = 192
+# pages per CMD_PINOCCIO_PAGE_CRC, the reply fits a one page msgBuffer
+CRC_PAGES = 128
+# a block of four pages takes about 40 ms to erase and write
+REPLY_TIMEOUT = 1.0
+
+class STKError(IOError):
+    pass
+
+class STK500v2(object):
+    def __init__(self, sport, verbose = False):
+        self.sport = sport
+        self.verbose = verbose
+        self.seq = 0
+        self.ahead = 0
+        # bytes on the serial line and frames sent again, for flashbench.py
+        self.txbytes = 0
+        self.rxbytes = 0
+        self.retries = 0
+
+    def write(self, data):
+        self.txbytes += len(data)
+        self.sport.write(data)
+
+    def frame(self, body):
+        """ message with header and checksum, returns (seq, frame) """
+        self.seq = (self.seq + 1) & 0xff
+        frm = struct.pack(">BBHB", MESSAGE_START, self.seq, len(body), TOKEN) + body
+        cs = 0
+        for c in bytearray(frm):
+            cs ^= c
+        return self.seq, frm + chr(cs)
+
+    def reply(self, seq, cmd, timeout = REPLY_TIMEOUT):
+        """ body of the answer to seq, bytes before MESSAGE_START are skipped """
+        tend = time.time() + timeout
+        def read(n):
+            buf = ""
+            while len(buf) < n:
+                c = self.sport.read(n - len(buf))
+                if c:
+                    buf += c
+                    self.rxbytes += len(c)
+                elif time.time() > tend:
+                    raise STKError("no answer to command 0x%02x" % cmd)
+            return buf
+        while ord(read(1)) != MESSAGE_START:
+            pass
+        (rseq, n, tok) = struct.unpack(">BHB", read(4))
+        body = read(n)
+        cs = ord(read(1))
+        for c in bytearray(struct.pack(">BBHB", MESSAGE_START, rseq, n, tok) + body):
+            cs ^= c
+        if cs or tok != TOKEN or rseq != seq or not body or ord(body[0]) != cmd:
+            raise STKError("bad answer to command 0x%02x: %r" % (cmd, body[:8]))
+        if self.verbose:
+            print "<", body[:8].encode("hex")
+        return body
+
+    def command(self, body, timeout = REPLY_TIMEOUT):
+        seq, frm = self.frame(body)
+        if self.verbose:
+            print ">", body[:8].encode("hex")
+        self.write(frm)
+        return self.reply(seq, ord(body[0]), timeout)
+
+    def commands(self, bodies):
+        """ Run a sequence of commands, the first self.ahead bytes of each
+            frame go out before the answer to the previous one is read.
+            Returns the answers.
+        """
+        frames = [self.frame(b) for b in bodies]
+        replies = []
+        sent = 0
+        for i, (seq, frm) in enumerate(frames):
+            self.write(frm[sent:])
+            sent = 0
+            if self.ahead and i + 1 < len(frames):
+                sent = min(self.ahead, len(frames[i + 1][1]))
+                self.write(frames[i + 1][1][:sent])
+            replies.append(self.reply(seq, ord(bodies[i][0])))
+        return replies
+
+    def sign_on(self, tries = 1):
+        for i in range(tries):
+            try:
+                body = self.command(chr(CMD_SIGN_ON), 0.25)
+                if body[1:2] == chr(STATUS_CMD_OK) and body[3:11] == "AVRISP_2":
+                    return True
+            except STKError:
+                self.retries += 1
+                self.sport.flushInput()
+        return False
+
+    def get_parameter(self, param):
+        body = self.command(struct.pack(">BB", CMD_GET_PARAMETER, param))
+        return ord(body[2])
+
+    def load_address(self, address):
+        return struct.pack(">BL", CMD_LOAD_ADDRESS, address >> 1)
+
+    def program(self, data):
+        """ CMD_PROGRAM_FLASH_ISP in page mode, fields besides the data are
+            not used by the bootloader """
+        return struct.pack(">BHBBBBBBB", CMD_PROGRAM_FLASH_ISP, len(data),
+                           0xc1, 10, 0x40, 0x4c, 0x20, 0, 0) + str(data)
+
+    def page_crcs(self, address, npages):
+        """ device CRCs of npages pages from address, None without
+            CMD_PINOCCIO_PAGE_CRC """
+        crcs = {}
+        while npages:
+            n = min(npages, CRC_PAGES)
+            (a, body) = self.commands([self.load_address(address),
+                                       struct.pack(">BH", CMD_PINOCCIO_PAGE_CRC, n)])
+            if ord(body[1]) != STATUS_CMD_OK:
+                return None
+            for i, crc in enumerate(struct.unpack("<%dH" % n, body[2:2 + 2 * n])):
+                crcs[address + i * PAGESIZE] = crc
+            address += n * PAGESIZE
+            npages -= n
+        return crcs
+
+    def flash_crc(self, address, length, crc32 = False):
+        """ CRC16 (data_crc) or CRC32 (data_crc32) of a flash range,
+            None without CMD_PINOCCIO_FLASH_CRC
+        """
+        (a, body) = self.commands([self.load_address(address),
+                                   struct.pack(">BLB", CMD_PINOCCIO_FLASH_CRC, length, int(crc32))])
+        if ord(body[1]) != STATUS_CMD_OK:
+            return None
+        return struct.unpack(crc32 and "<L" or "<H", body[2:2 + (crc32 and 4 or 2)])[0]
+
+    def read_flash(self, address, length, blocksize):
+        bodies = [self.load_address(address)]
+        for i in range(0, length, blocksize):
+            bodies.append(struct.pack(">BHB", CMD_READ_FLASH_ISP, min(blocksize, length - i), 0x20))
+        data = ""
+        for body in self.commands(bodies)[1:]:
+            if ord(body[1]) != STATUS_CMD_OK:
+                raise STKError("read failed at 0x%05x" % (address + len(data)))
+            data += body[2:-1]
+        return data
+
+def enter_bootloader(sport):
+    """ reset through DTR (as avrdude does) """
+    sport.setDTR(False)
+    time.sleep(0.1)
+    sport.setDTR(True)
+    time.sleep(0.05)
+    sport.flushInput()
+
+def switch_baud(stk, baud):
+    """ move the session to baud, back to BAUDRATE if the first frame at
+        the new rate gets no answer (the bootloader falls back as well) """
+    body = stk.command(struct.pack(">BBB", CMD_SET_PARAMETER, PARAM_PINOCCIO_BAUDRATE,
+                                   BAUDTABLE.index(baud)))
+    if ord(body[1]) != STATUS_CMD_OK:
+        return False
+    # the bootloader switches after the last stop bit of the answer
+    time.sleep(0.005)
+    stk.sport.baudrate = baud
+    if stk.sign_on():
+        return True
+    stk.sport.baudrate = BAUDRATE
+    stk.retries += 1
+    return stk.sign_on(10)
+
+def blocks(stk, runs, blocksize):
+    """ command bodies writing the runs, the address advances past each block """
+    bodies = []
+    for address, data in runs:
+        bodies.append(stk.load_address(address))
+        for i in range(0, len(data), blocksize):
+            bodies.append(stk.program(data[i:i + blocksize]))
+    return bodies
+
+class Phases(object):
+    """ wall clock time of each phase """
+    def __init__(self, quiet = False):
+        self.phases = []
+        self.quiet = quiet
+        self.t = time.time()
+
+    def done(self, name, info = ""):
+        t = time.time()
+        self.phases.append((name, t - self.t, info))
+        if not self.quiet:
+            print "%-8s %6.3f s  %s" % (name, t - self.t, info)
+        self.t = t
+
+    def total(self):
+        return sum([p[1] for p in self.phases])
+
+def flash(stk, segs, baud = 1000000, ahead = AHEAD, do_reset = False,
+          do_diff = True, do_verify = True, do_leave = True, ph = None,
+          pages = None, readback = False, own = None):
+    """ Flash the page aligned segments (read_hex_pages(fname, True)) through
+        the bootloader on stk.sport, the session starts at BAUDRATE. pages limits
+        the block size, readback verifies by reading the flash, own are the
+        page CRCs of the image (read_page_crcs(fname)) if known. Returns the
+        Phases and the number of bytes programmed, raises STKError.
+    """
+    sport = stk.sport
+    sport.baudrate = BAUDRATE
+    if ph == None:
+        ph = Phases()
+    if do_reset:
+        enter_bootloader(sport)
+    if not stk.sign_on(20):
+        raise STKError("no bootloader on %s" % sport.port)
+    stk.command(struct.pack(">BBBBBBBBBBBB", CMD_ENTER_PROGMODE_ISP,
+                            200, 100, 25, 32, 0, 0x53, 3, 0xac, 0x53, 0, 0))
+    blocksize = max(stk.get_parameter(PARAM_PINOCCIO_BLOCKSIZE), 1)
+    blocksize = min(blocksize, pages or blocksize) * PAGESIZE
+    # all builds with the CRC commands also have the receive ring and the baud switch
+    extended = stk.flash_crc(0, 2) != None
+    ph.done("sign-on", "%s, %d byte blocks" % (extended and "extended" or "plain", blocksize))
+
+    if extended:
+        stk.ahead = ahead
+        if baud != BAUDRATE:
+            if not switch_baud(stk, baud):
+                raise STKError("lost the bootloader after the baud switch")
+            ph.done("baud", "%d" % sport.baudrate)
+
+    runs = segs
+    if extended and do_diff:
+        # pages between the runs have to be erased
+        segs = sorted(segs + [(a, bytearray([0xff] * (n * PAGESIZE))) for a, n in erase_runs(segs)])
+        start = segs[0][0]
+        crcs = stk.page_crcs(start, (segs[-1][0] + len(segs[-1][1]) - start) / PAGESIZE)
+        if crcs != None:
+            runs = changed_runs(segs, crcs, own)
+        ph.done("diff", "%d of %d pages changed" % (sum([len(d) for a, d in runs]) / PAGESIZE,
+                                                   sum([len(d) for a, d in segs]) / PAGESIZE))
+
+    nbytes = sum([len(d) for a, d in runs])
+    if runs:
+        replies = stk.commands(blocks(stk, runs, blocksize))
+        for body in replies:
+            # late status, it belongs to the block before
+            if ord(body[1]) != STATUS_CMD_OK:
+                raise STKError("programming failed")
+    t = time.time() - ph.t
+    ph.done("program", "%d bytes, %.1f kB/s" % (nbytes, nbytes / max(t, 1e-3) / 1000))
+
+    if do_verify and runs:
+        for address, data in runs:
+            if extended and not readback:
+                ok = stk.flash_crc(address, len(data), True) == data_crc32(data)
+            else:
+                ok = stk.read_flash(address, len(data), blocksize) == str(data)
+            if not ok:
+                raise STKError("verify failed in 0x%05x..0x%05x" % (address, address + len(data)))
+        ph.done("verify", (extended and not readback) and "CRC" or "read back")
+
+    if do_leave:
+        body = stk.command(struct.pack(">BBB", CMD_LEAVE_PROGMODE_ISP, 1, 1))
+        if ord(body[1]) != STATUS_CMD_OK:
+            raise STKError("programming of the last block failed")
+        ph.done("leave")
+    return ph, nbytes
+
+if __name__ == "__main__":
+    port = "/dev/ttyACM0"
+    baud = 1000000
+    ahead = AHEAD
+    do_reset = False
+    do_diff = True
+    do_verify = True
+    do_leave = True
+    verbose = False
+    pages = None
+    readback = False
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "p:b:ra:fB:nRkvh")
+        for o, v in opts:
+            if o == "-p":
+                port = v
+            elif o == "-b":
+                baud = int(v)
+            elif o == "-r":
+                do_reset = True
+            elif o == "-a":
+                ahead = int(v)
+            elif o == "-f":
+                do_diff = False
+            elif o == "-B":
+                pages = max(int(v), 0)
+            elif o == "-n":
+                do_verify = False
+            elif o == "-R":
+                readback = True
+            elif o == "-k":
+                do_leave = False
+            elif o == "-v":
+                verbose = True
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if baud not in BAUDTABLE or ahead < 0 or pages == 0 or len(args) != 1:
+            raise getopt.GetoptError("bad arguments")
+        segs = read_hex_pages(args[0], True)
+        if not segs or segs[-1][0] + len(segs[-1][1]) > BOOTLOADER_START:
+            raise ValueError("no application image: %s" % args[0])
+        own = read_page_crcs(args[0])
+    except (getopt.GetoptError, ValueError, ImageError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    sport = serial.Serial(port, BAUDRATE, timeout = 0.05)
+    stk = STK500v2(sport, verbose)
+    try:
+        ph, nbytes = flash(stk, segs, baud, ahead, do_reset, do_diff, do_verify, do_leave,
+                           pages = pages, readback = readback, own = own)
+        print "%-8s %6.3f s  %d bytes on the line, %d retries" % \
+            ("total", ph.total(), stk.txbytes + stk.rxbytes, stk.retries)
+    except STKError, e:
+        print "ERROR:", e
+        sys.exit(1)
+    finally:
+        sport.close()
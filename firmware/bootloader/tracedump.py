@@ -0,0 +1,147 @@
+#!/usr/bin/env python
+"""
+tracedump.py - read and decode the binary event trace of the bootloader
+
+The trace build (make PROFILE=trace) records events into a ring in SRAM,
+see src/trace.h. The ring is read with the RAM dump of the monitor
+(send "!!!" right after reset, see monitordump.py). It survives the
+reset, so the events before it are shown too. The address of the ring
+is taken from the ELF file, the event names from src/trace.h.
+
+Usage:
+ python tracedump.py [OPTIONS]
+
+Options:
+ -p PORT    serial port, default /dev/ttyACM0
+ -e ELF     ELF file of the bootloader, default bootloader-trace.elf
+ -a ADDR    RAM address of trace_buf, instead of looking it up in the ELF
+ -t FILE    header with the event ids, default src/trace.h
+ -i FILE    decode a RAM dump of trace_buf from FILE, no serial port
+ -b BAUD    rate for the transfer, see monitordump.py, default 1000000
+ -r         reset the node through DTR first and enter the monitor
+ -q         leave the monitor afterwards (jumps to the application)
+ -h         show this help
+
+Example:
+ python tracedump.py -r -q -p /dev/ttyACM0
+"""
+
+import sys, re, struct, getopt, subprocess
+
+TRACE_MAGIC = 0x7ace
+HEADER_FMT = "<HB"
+RECORD_FMT = "<BHH"
+TICK_MS = 1024 * 1000.0 / 16000000 # F_CPU / 1024 time base, see prof.h
+AVR_RAM_OFFSET = 0x800000 # data addresses in the ELF file
+
+def read_events(fname):
+    """id -> (name, description of arg) from the TRACE_ defines"""
+    pat = re.compile(r"#define\s+TRACE_(\w+)\s+\((\d+)\)\s*//\s*(.*)")
+    events = {}
+    size = 64
+    for ln in open(fname):
+        m = pat.match(ln)
+        if m == None:
+            continue
+        name, val, desc = m.group(1), int(m.group(2)), m.group(3).strip()
+        if name == "SIZE":
+            size = val
+        elif name != "MAGIC":
+            events[val] = (name, desc)
+    return events, size
+
+def lookup_symbol(elf, symbol = "trace_buf"):
+    out = subprocess.Popen(["avr-nm", elf], stdout = subprocess.PIPE).communicate()[0]
+    for ln in out.splitlines():
+        f = ln.split()
+        if len(f) == 3 and f[2] == symbol:
+            return int(f[0], 16) & ~AVR_RAM_OFFSET
+    raise ValueError("no symbol %s in %s" % (symbol, elf))
+
+def decode(data, size):
+    """returns the records, oldest first: [(id, arg, ts), ...]"""
+    hsz = struct.calcsize(HEADER_FMT)
+    rsz = struct.calcsize(RECORD_FMT)
+    if len(data) < hsz + size * rsz:
+        raise ValueError("dump too short: %d bytes" % len(data))
+    (magic, head) = struct.unpack(HEADER_FMT, data[:hsz])
+    if magic != TRACE_MAGIC:
+        raise ValueError("bad magic 0x%04x, no trace build?" % magic)
+    recs = []
+    for i in range(size):
+        j = (head + i) % size
+        rec = struct.unpack(RECORD_FMT, data[hsz + j * rsz:hsz + (j + 1) * rsz])
+        if rec[0] != 0:
+            recs.append(rec)
+    return recs
+
+def show(recs, events):
+    """time stamps are 16 bit, gaps of more than 4.2 s are not seen"""
+    t = 0
+    last = None
+    for (eid, arg, ts) in recs:
+        if last != None:
+            t += (ts - last) & 0xffff
+        last = ts
+        name, desc = events.get(eid, ("EVENT_%d" % eid, ""))
+        if name == "BOOT":
+            t = 0
+            print "-" * 60
+        print "%10.3f ms  %-10s 0x%04x  %s" % (t * TICK_MS, name, arg, desc)
+
+if __name__ == "__main__":
+    port = "/dev/ttyACM0"
+    elf = "bootloader-trace.elf"
+    addr = None
+    header = "src/trace.h"
+    infile = None
+    baud = 1000000
+    do_reset = False
+    do_quit = False
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "p:e:a:t:i:b:rqh")
+        for o, v in opts:
+            if o == "-p":
+                port = v
+            elif o == "-e":
+                elf = v
+            elif o == "-a":
+                addr = int(v, 0)
+            elif o == "-t":
+                header = v
+            elif o == "-i":
+                infile = v
+            elif o == "-b":
+                baud = int(v)
+            elif o == "-r":
+                do_reset = True
+            elif o == "-q":
+                do_quit = True
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if args:
+            raise getopt.GetoptError("bad arguments")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    events, size = read_events(header)
+    length = struct.calcsize(HEADER_FMT) + size * struct.calcsize(RECORD_FMT)
+    if infile != None:
+        data = open(infile, "rb").read()
+    else:
+        import serial
+        import monitordump
+        if addr == None:
+            addr = lookup_symbol(elf)
+        sport = serial.Serial(port, monitordump.BAUDRATE, timeout = 0.2)
+        if do_reset:
+            monitordump.enter_monitor(sport)
+        data = monitordump.dump(sport, "R", addr, length, baud)
+        if do_quit:
+            monitordump.read_until(sport, ">")
+            sport.write("Q")
+        sport.close()
+    show(decode(data, size), events)
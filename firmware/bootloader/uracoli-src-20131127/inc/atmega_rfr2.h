@@ -89,6 +89,7 @@ typedef uint8_t trx_regaddr_t;
     #define CMD_PLL_ON (9)
     #define CMD_RX_AACK_ON (22)
     #define CMD_TX_ARET_ON (25)
+    #define CMD_PREP_DEEP_SLEEP (16)
 /** Offset for register TRX_CTRL_0 */
 #define RG_TRX_CTRL_0 (0x3)
   /** Access parameters for sub-register PAD_IO in register TRX_CTRL_0 */
@@ -247,6 +248,20 @@ typedef uint8_t trx_regaddr_t;
   #define SR_RX_PDT_DIS 0x15,0x80,7
   /** Access parameters for sub-register RX_PDT_LEVEL in register RX_SYN */
   #define SR_RX_PDT_LEVEL 0x15,0xf,0
+/** Offset for register TRX_RPC */
+#define RG_TRX_RPC (0x16)
+  /** Access parameters for sub-register RX_RPC_CTRL in register TRX_RPC */
+  #define SR_RX_RPC_CTRL 0x16,0xc0,6
+  /** Access parameters for sub-register RX_RPC_EN in register TRX_RPC */
+  #define SR_RX_RPC_EN 0x16,0x20,5
+  /** Access parameters for sub-register PDT_RPC_EN in register TRX_RPC */
+  #define SR_PDT_RPC_EN 0x16,0x10,4
+  /** Access parameters for sub-register PLL_RPC_EN in register TRX_RPC */
+  #define SR_PLL_RPC_EN 0x16,0x8,3
+  /** Access parameters for sub-register XAH_TX_RPC_EN in register TRX_RPC */
+  #define SR_XAH_TX_RPC_EN 0x16,0x4,2
+  /** Access parameters for sub-register IPAN_RPC_EN in register TRX_RPC */
+  #define SR_IPAN_RPC_EN 0x16,0x2,1
 /** Offset for register XAH_CTRL_1 */
 #define RG_XAH_CTRL_1 (0x17)
   /** Access parameters for sub-register AACK_FLTR_RES_FT in register XAH_CTRL_1 */
@@ -366,6 +381,12 @@ typedef uint8_t trx_regaddr_t;
   #define SR_MAX_BE 0x2f,0xf0,4
   /** Access parameters for sub-register MIN_BE in register CSMA_BE */
   #define SR_MIN_BE 0x2f,0xf,0
+/** Offset for register XAH_CTRL_2 */
+#define RG_XAH_CTRL_2 (0x37)
+  /** Access parameters for sub-register ARET_FRAME_RETRIES in register XAH_CTRL_2 */
+  #define SR_ARET_FRAME_RETRIES 0x37,0xf0,4
+  /** Access parameters for sub-register ARET_CSMA_RETRIES in register XAH_CTRL_2 */
+  #define SR_ARET_CSMA_RETRIES 0x37,0xe,1
 /** name string of the radio */
 #define RADIO_NAME "ATmega256RFR2"
 
@@ -49,6 +49,8 @@
 #include <util/delay.h>
 #include <avr/pgmspace.h>
 #include <avr/eeprom.h>
+#include "energy_mark.h"
+#include "pm.h"
 #include <util/crc16.h>
 #include "const.h"
 #include "board_cfg.h"
@@ -91,9 +93,19 @@
 #define SLEEP_ON_IDLE()\
         do{\
             set_sleep_mode(SLEEP_MODE_IDLE);\
+            ENERGY_MARK_ON(ENERGY_SLEEP);\
             sleep_mode();\
+            ENERGY_MARK_OFF(ENERGY_SLEEP);\
         }while(0);
 
+#ifndef BUSY_WAIT
+/**
+ * Body of a loop that waits for a flag of an interrupt routine. The
+ * host simulation gives the CPU to the other nodes there.
+ */
+# define BUSY_WAIT() do{}while(0)
+#endif
+
 
 #ifdef NO_TIMER
 //# define HAVE_MALLOC_TIMERS
@@ -283,6 +295,90 @@ static inline uint8_t get_node_config_eeprom(node_config_t *ncfg, uint8_t * offs
     return crc;
 }
 
+#if defined(NODE_CONFIG_HANDOFF)
+/**
+ * Take the node_config_t structure the bootloader left in the SRAM at
+ * NODE_CONFIG_HANDOFF. The bootloader fills it once per boot from its
+ * own sources, _reserved_[0] is the transmit power and _reserved_[1] the
+ * source ('E', 'F' or 'D'), see nodecfg.h of the bootloader. Call it
+ * early, the stack grows over the record.
+ *
+ * @param ncfg
+ *        Pointer to the node config structure that is filled.
+ * @return
+ *        Returns 0 if the crc over the structure is correct.
+ */
+static inline uint8_t get_node_config_handoff(node_config_t *ncfg)
+{
+    uint8_t i = sizeof(node_config_t);
+    uint8_t *pram = (uint8_t*)ncfg;
+    const uint8_t *psram = (const uint8_t*)(NODE_CONFIG_HANDOFF);
+    uint8_t crc = 0;
+    do
+    {
+        *pram = *psram++;
+        crc = _crc_ibutton_update(crc, *pram);
+        pram ++;
+    }
+    while(--i);
+    if ((ncfg->_reserved_[1] != 'E') && (ncfg->_reserved_[1] != 'F')
+            && (ncfg->_reserved_[1] != 'D'))
+    {
+        /* left over from a bootloader without the record */
+        crc = 0x55;
+    }
+    return crc;
+}
+#endif
+
+#if defined(RADIO_HANDOFF)
+/** State of the transceiver the bootloader leaves at RADIO_HANDOFF. */
+typedef struct
+{
+    uint8_t magic;          /**< RADIO_HANDOFF_MAGIC */
+    uint8_t state;          /**< TRX_STATUS, TRX_OFF */
+    uint8_t channel;        /**< channel register */
+    uint16_t pan_id;        /**< PAN id of the bootloader */
+    uint16_t short_addr;    /**< short address of the bootloader */
+    uint8_t crc;            /**< _crc_ibutton_update() over the bytes before */
+} radio_handoff_t;
+
+#define RADIO_HANDOFF_MAGIC (0xA7)
+
+/**
+ * Take the record the bootloader left at RADIO_HANDOFF when it started
+ * the application with the transceiver already out of reset, in TRX_OFF,
+ * IRQs masked and the data rate at its default. The other registers hold
+ * the values of the bootloader. The record is taken once, call it early,
+ * the stack grows over it. radio_init() uses it to skip the reset.
+ *
+ * @param rh
+ *        Pointer to the record that is filled.
+ * @return
+ *        Returns 0 if magic and crc are correct.
+ */
+static inline uint8_t get_radio_handoff(radio_handoff_t *rh)
+{
+    uint8_t i = sizeof(radio_handoff_t);
+    uint8_t *pram = (uint8_t*)rh;
+    uint8_t *psram = (uint8_t*)(RADIO_HANDOFF);
+    uint8_t crc = 0;
+    do
+    {
+        *pram = *psram++;
+        crc = _crc_ibutton_update(crc, *pram);
+        pram ++;
+    }
+    while(--i);
+    *(uint8_t*)(RADIO_HANDOFF) = 0;
+    if (rh->magic != RADIO_HANDOFF_MAGIC)
+    {
+        crc = 0x55;
+    }
+    return crc;
+}
+#endif
+
 /**
  * Read the node_config_t structure from an offset in the EEPROM.
  *
@@ -40,6 +40,12 @@
 
 #elif defined(stb256rfr2)
 # define BOOTLOADER_ADDRESS (0x1f000)
+# if !defined(UART_TXBUFSIZE)
+#  define UART_TXBUFSIZE (1024)
+# endif
+# if !defined(UART_RXBUFSIZE)
+#  define UART_RXBUFSIZE (512)
+# endif
 # include "boards/board_stbrfa1.h"
 
 #elif defined(bat)
@@ -190,6 +196,12 @@
 # if !defined(HIF_DEFAULT_BAUDRATE)
 #  define HIF_DEFAULT_BAUDRATE (115200)
 # endif
+# if !defined(UART_TXBUFSIZE)
+#  define UART_TXBUFSIZE (1024)
+# endif
+# if !defined(UART_RXBUFSIZE)
+#  define UART_RXBUFSIZE (512)
+# endif
 # include "boards/board_derfa.h"
 
 #elif defined(zigduino)
@@ -305,6 +317,19 @@
 # define BOOTLOADER_ADDRESS (0x3800)
 # include "boards/board_museII232.h"
 
+#elif defined(sim)
+# define BOOTLOADER_ADDRESS (0x1f000)
+# if !defined(HIF_DEFAULT_BAUDRATE)
+#  define HIF_DEFAULT_BAUDRATE (115200)
+# endif
+# if !defined(UART_TXBUFSIZE)
+#  define UART_TXBUFSIZE (1024)
+# endif
+# if !defined(UART_RXBUFSIZE)
+#  define UART_RXBUFSIZE (512)
+# endif
+# include "boards/board_sim.h"
+
 #else
 # error "BOARD_TYPE is not defined or wrong"
 #endif
@@ -100,6 +100,10 @@ radiofaro:
 # define BOARD_TYPE BOARD_PINOCCIO
 # define BOARD_NAME "pinoccio"
 # define RADIO_TYPE (RADIO_ATMEGA256RFR2)
+/* record of the bootloader, see get_node_config_handoff() */
+# define NODE_CONFIG_HANDOFF (RAMEND - 0xEF)
+/* radio set up by the bootloader, see get_radio_handoff() */
+# define RADIO_HANDOFF (RAMEND - 0xDF)
 #elif defined(raspbee)
 # define BOARD_TYPE BOARD_RASPBEE
 # define BOARD_NAME "raspbee"
@@ -318,6 +322,23 @@ radiofaro:
 
 #if BOARD_TYPE == BOARD_PINOCCIO
 #define HIF_UART_FORCE_U2X (1)
+
+/* Optional RTS/CTS handshake with the ATmega16U2 USB bridge (build the
+ * bridge with FLOW_CONTROL=1 and add -DHIF_UART_FLOWCTRL here). The lines
+ * are not routed on the board: wire PE2 (RTS out) to 16U2 PB5 and
+ * PB7 (CTS in, PCINT7) to 16U2 PB4. */
+# if defined(HIF_UART_FLOWCTRL)
+#  define HIF_UART_RTS_PORT   PORTE
+#  define HIF_UART_RTS_DDR    DDRE
+#  define HIF_UART_RTS_BIT    (2)
+#  define HIF_UART_CTS_PIN    PINB
+#  define HIF_UART_CTS_PORT   PORTB
+#  define HIF_UART_CTS_BIT    (7)
+#  define HIF_UART_CTS_PCMSK  PCMSK0
+#  define HIF_UART_CTS_PCINT  (PCINT7)
+#  define HIF_UART_CTS_PCIE   (PCIE0)
+#  define HIF_UART_CTS_vect   PCINT0_vect
+# endif
 #endif
 
 
@@ -392,6 +413,53 @@ radiofaro:
     #define FT245_TX_IS_BLOCKED()    (0 != (FT245_PIN & FT245_TXE))
     #define FT245_RX_HAS_DATA()      (0 == (FT245_PIN & FT245_RXF))
 
+    /*
+     * Block access for hif_put_blk()/hif_get_blk(): the bus is switched
+     * over to the FT245 once per run, and the FIFO flag is sampled with a
+     * single pin test before each byte. The run ends early when the flag
+     * goes inactive, the caller waits for it and starts the next run.
+     */
+    static inline uint8_t hif_usb_write_blk(const uint8_t *data, uint8_t n)
+    {
+        uint8_t i;
+
+        DDRB = 0xFF;
+        for (i = 0; i < n; i++)
+        {
+            PORTB = data[i];
+            if (FT245_TX_IS_BLOCKED())
+            {
+                break;
+            }
+            PORTD = (PORTD & ~0xc0);    /* select FT245 -> /WR pulse */
+            __asm volatile("nop");
+            PORTD = (PORTD & ~0xc0) | 0x80; /* re-select SRAM */
+        }
+        DDRB = 0;
+        PORTB = 0;                  /* avoid pullups */
+        return i;
+    }
+
+    static inline uint8_t hif_usb_read_blk(uint8_t *data, uint8_t n)
+    {
+        uint8_t i;
+
+        PORTE |= 0x10;              /* de-assert /WR */
+        PORTD = (PORTD & ~0xc0);    /* select FT245 */
+        for (i = 0; i < n && FT245_RX_HAS_DATA(); i++)
+        {
+            PORTE &= ~0x20;             /* /RD pulse */
+            PORTE |= 0x20;
+            __asm volatile("nop");
+            data[i] = PINB;
+        }
+        PORTD = (PORTD & ~0xc0) | 0x80; /* re-select SRAM */
+        PORTE &= ~0x10;                 /* re-assert /WR */
+        return i;
+    }
+    #define HIF_USB_WRITE_BLK(d, n) hif_usb_write_blk(d, n)
+    #define HIF_USB_READ_BLK(d, n)  hif_usb_read_blk(d, n)
+
 #endif
 
 #define TRX_RESET_LOW()   do { TRXPR &= ~_BV(TRXRST); } while (0)
@@ -406,12 +474,26 @@ radiofaro:
 #define HWTIMER_REG     (TCNT1)
 #define TIMER_TICK      (HWTIMER_TICK_NB * HWTIMER_TICK)
 #define TIMER_POOL_SIZE (4)
+#if defined(TIMER_TICKLESS)
+/* timer 1 runs freely at F_CPU/1024, so a system tick of
+ * 0x10000 CPU clocks is 64 counts, and OCR1A is set to the next
+ * expiry instead of taking an overflow interrupt per tick */
+# define HWTIMER_TICKLESS_COUNTS (64)
+# define HWTIMER_TICKLESS_CMP    (OCR1A)
+# define TIMER_INIT() \
+    do{ \
+        TCCR1B |= (_BV(CS12) | _BV(CS10)); \
+        TIMSK1 |= _BV(OCIE1A); \
+    }while(0)
+# define TIMER_IRQ_vect   TIMER1_COMPA_vect
+#else
 #define TIMER_INIT() \
     do{ \
         TCCR1B |= (_BV(CS10)); \
         TIMSK1 |= _BV(TOIE1); \
     }while(0)
 #define TIMER_IRQ_vect   TIMER1_OVF_vect
+#endif
 
 /*=== PA/LNA init ==================================================*/
 #if BOARD_TYPE == BOARD_RASPBEE || BOARD_TYPE == BOARD_DERFN256U0PA || BOARD_TYPE == BOARD_DERFN128U0
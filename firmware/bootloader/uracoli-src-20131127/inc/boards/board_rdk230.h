@@ -152,6 +152,11 @@ Bootloader:
 
 #define SLEEP_ON_KEY_vect INT5_vect
 
+/* key interrupt of the key event service, see key_event.h */
+#define KEY_IRQ_vect  SLEEP_ON_KEY_vect
+#define KEY_IRQ_ENABLE()  do{ EIMSK |= _BV(INT5); }while(0)
+#define KEY_IRQ_DISABLE() do{ EIMSK &= ~_BV(INT5); }while(0)
+
 /*=== Host Interface ================================================*/
 #define HIF_TYPE (HIF_UART_1)
 
@@ -0,0 +1,127 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Simulated node of the host simulation, see "Host simulation" in the
+ *        README.md of the bootloader.
+ *
+ * The sources are built with the host compiler against the stand-in
+ * avr-libc headers of the simulation. The radio is an AT86RF231 on
+ * the SPI bus, the bus, the pins and the IRQ go to the transceiver
+ * model of the simulation, so the RF23x access functions of libradio
+ * (trx_rf230*.c) run unchanged. The host interface is the UART of the
+ * simulated node (hif_sim.c instead of hif_uart.c), the timer ticks
+ * every ms on the virtual clock, there are no LEDs and no keys.
+ *
+ * @ingroup grpBoard
+ */
+
+#if defined(sim)
+# define BOARD_TYPE (BOARD_SIM)
+# define BOARD_NAME "sim"
+# define RADIO_TYPE (RADIO_AT86RF231)
+#endif
+
+#ifndef BOARD_SIM_H
+#define BOARD_SIM_H
+
+#include "sim.h"
+
+/*=== Compile time parameters ========================================*/
+#ifndef MAX_FRAME_SIZE
+# define MAX_FRAME_SIZE (127) /**< maximum allowed frame size */
+#endif
+
+#ifndef DEFAULT_SPI_RATE
+# define DEFAULT_SPI_RATE  (SPI_RATE_1_2)
+#endif
+
+/*=== TRX pin access macros ==========================================*/
+#define TRX_RESET_INIT() do{}while(0)
+#define TRX_RESET_HIGH() sim_trx_pin(0xFF, 1)
+#define TRX_RESET_LOW()  sim_trx_pin(0xFF, 0)
+#define TRX_SLPTR_INIT() do{}while(0)
+#define TRX_SLPTR_HIGH() sim_trx_pin(1, 0xFF)
+#define TRX_SLPTR_LOW()  sim_trx_pin(0, 0xFF)
+
+/*=== IRQ access macros ==============================================*/
+# define TRX_IRQ_vect    SIM_TRX_vect  /**< interrupt vector name */
+# define TRX_IRQ_INIT()  do{}while(0)
+
+/** disable TRX interrupt */
+#define DI_TRX_IRQ() {sim_irq_enable(SIM_IRQ_TRX, 0);}
+/** enable TRX interrupt */
+#define EI_TRX_IRQ() {sim_irq_enable(SIM_IRQ_TRX, 1);}
+
+/** timestamp register for RX_START event */
+#define TRX_TSTAMP_REG HWTIMER_REG
+
+/*=== SPI access macros ==============================================*/
+#define SPI_DATA_REG SPDR  /**< abstraction for SPI data register */
+
+/**
+ * @brief inline function for SPI initialization
+ */
+static inline void SPI_INIT(uint8_t spirate)
+{
+    SPCR = (_BV(SPE) | _BV(MSTR)) | (spirate & 0x03);
+}
+
+/** set SS line to low level */
+#define SPI_SELN_LOW()       uint8_t sreg = SREG; cli(); sim_spi_select(1)
+/** set SS line to high level */
+#define SPI_SELN_HIGH()      sim_spi_select(0); SREG = sreg
+/** shift the byte in SPDR out, SPDR has the byte of the radio then */
+#define SPI_WAITFOR()        do { SPDR = sim_spi_xfer(SPDR); } while(0)
+
+/** the loops on interrupt flags let the other nodes run */
+#define BUSY_WAIT()          sim_poll(SIM_NEVER)
+
+/*=== LED and KEY access macros ======================================*/
+#define NO_LEDS       (1)
+#define NO_KEYS       (1)
+
+/*=== Host Interface ================================================*/
+#define HIF_TYPE    (HIF_UART_0)
+
+/*=== TIMER Interface ===============================================*/
+/**
+ * The counter is in us since the last tick of the virtual clock,
+ * @ref TIMER_IRQ_vect is called every ms.
+ */
+#define HWTIMER_TICK    (1.0e-6)
+#define HWTIMER_TICK_NB (1000UL)
+#define HWTIMER_REG     (*sim_timer_count())
+#define TIMER_TICK      (HWTIMER_TICK_NB * HWTIMER_TICK)
+#define TIMER_POOL_SIZE (4)
+#define TIMER_INIT()    sim_timer_init(HWTIMER_TICK_NB * SIM_US)
+#define TIMER_IRQ_vect  SIM_TIMER_vect
+
+#endif /* BOARD_SIM_H */
@@ -320,6 +320,53 @@ static inline uint8_t hif_key_read(void)
 #define FT245_TX_IS_BLOCKED()    (0 != (FT245_PIN & FT245_TXE))
 #define FT245_RX_HAS_DATA()      (0 == (FT245_PIN & FT245_RXF))
 
+/*
+ * Block access for hif_put_blk()/hif_get_blk(): the bus is switched
+ * over to the FT245 once per run, and the FIFO flag is sampled with a
+ * single pin test before each byte. The run ends early when the flag
+ * goes inactive, the caller waits for it and starts the next run.
+ */
+static inline uint8_t hif_usb_write_blk(const uint8_t *data, uint8_t n)
+{
+    uint8_t i;
+
+    DDRB = 0xFF;
+    for (i = 0; i < n; i++)
+    {
+        PORTB = data[i];
+        if (FT245_TX_IS_BLOCKED())
+        {
+            break;
+        }
+        PORTD = (PORTD & ~0xc0);    /* select FT245 -> /WR pulse */
+        __asm volatile("nop");
+        PORTD = (PORTD & ~0xc0) | 0x80; /* re-select SRAM */
+    }
+    DDRB = 0;
+    PORTB = 0;                  /* avoid pullups */
+    return i;
+}
+
+static inline uint8_t hif_usb_read_blk(uint8_t *data, uint8_t n)
+{
+    uint8_t i;
+
+    PORTE |= 0x10;              /* de-assert /WR */
+    PORTD = (PORTD & ~0xc0);    /* select FT245 */
+    for (i = 0; i < n && FT245_RX_HAS_DATA(); i++)
+    {
+        PORTE &= ~0x20;             /* /RD pulse */
+        PORTE |= 0x20;
+        __asm volatile("nop");
+        data[i] = PINB;
+    }
+    PORTD = (PORTD & ~0xc0) | 0x80; /* re-select SRAM */
+    PORTE &= ~0x10;                 /* re-assert /WR */
+    return i;
+}
+#define HIF_USB_WRITE_BLK(d, n) hif_usb_write_blk(d, n)
+#define HIF_USB_READ_BLK(d, n)  hif_usb_read_blk(d, n)
+
 /*=== TIMER Interface ===============================================*/
 #define HWTMR_PRESCALE  (1)
 #define HWTIMER_TICK    ((1.0*HWTMR_PRESCALE)/F_CPU)
@@ -142,6 +142,7 @@
 #define BOARD_DERFN256U0PA (88)
 #define BOARD_DERFN128 (89)
 #define BOARD_DERFN128U0 (90)
+#define BOARD_SIM (91)
 
 #define BOARD_LAST (BOARD_RASPBEE)
 /** @} */
@@ -0,0 +1,80 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+/* $Id$ */
+/**
+ * @file
+ * @brief Interface of the block and flash range CRCs.
+ *
+ * CRC16 is the CCITT CRC of _crc_ccitt_update() (reflected 0x8408), the
+ * data CRC of WIBO and of the bootloader tools; start with 0 for the
+ * WIBO data CRC, 0xFFFF for the binary frames of cmdif.c. The byte step
+ * is that of avr-libc, which at 17 cycles and no table is faster than
+ * any table lookup on the AVR. The block functions only save the loop
+ * and, for flash, read four bytes per address setup.
+ *
+ * CRC32 is IEEE 802.3 (reflected 0xEDB88320), same as zlib's crc32():
+ * pass 0 for the first block and the last result for the next one. It
+ * is table driven with two nibble tables in PROGMEM (128 bytes), the
+ * entries of the low and the high nibble of a byte, so a byte costs two
+ * lookups and an 8 bit shift instead of eight bitwise steps.
+ *
+ * The host counterparts are data_crc() and data_crc32() of wibohost.py.
+ *
+ * On devices with more than 64K flash the tables and the ranges are read
+ * with ELPM, the tables through pgm_get_far_address() (avr-libc 1.8),
+ * so this also works from a bootloader above 64K.
+ */
+#ifndef CRC_FAST_H
+#define CRC_FAST_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+
+/* === prototypes ========================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** CRC16 CCITT of a buffer in RAM */
+uint16_t crc_ccitt_block(uint16_t crc, const uint8_t *p, uint16_t len);
+/** CRC16 CCITT of a flash range, byte address */
+uint16_t crc_ccitt_flash(uint16_t crc, uint32_t addr, uint32_t len);
+/** CRC32 of a buffer in RAM */
+uint32_t crc32_block(uint32_t crc, const uint8_t *p, uint16_t len);
+/** CRC32 of a flash range, byte address */
+uint32_t crc32_flash(uint32_t crc, uint32_t addr, uint32_t len);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef CRC_FAST_H */
@@ -0,0 +1,129 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Wear levelled journal of small settings in the EEPROM.
+ *
+ * Settings that change often (OTA request, LED colour, node
+ * configuration, values of the application) are kept as records in a
+ * ring of @ref EE_JOURNAL_SLOTS slots instead of at a fixed address:
+ *
+ *  - 1 byte key, 0 ... EE_JOURNAL_KEYS - 1, 0xFF is a free slot
+ *  - 4 byte sequence number, one more with each record written
+ *  - 1 byte length of the data
+ *  - EE_JOURNAL_DATA_MAX bytes data
+ *  - 1 byte CRC (_crc_ibutton_update()) of the bytes before
+ *
+ * The record of a key with the highest sequence number is its value.
+ * ee_journal_init() reads the slots once and keeps the slot of each key
+ * in RAM, a read is one block read from that slot. A write goes to the
+ * next slot that holds no current record, so the records of keys which
+ * change often go round the ring, those which do not stay in place.
+ * Values equal to the current one are not written, the others with
+ * eeprom_update_block(). The old record stays valid until the new one
+ * is complete with its CRC.
+ *
+ * The bootloader and the application use the same area,
+ * ENABLE_EEPROM_JOURNAL in the bootloader.
+ */
+#ifndef EE_JOURNAL_H
+#define EE_JOURNAL_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+
+/* === macros ============================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+#ifndef EE_JOURNAL_ADDR
+/** first byte of the area, up to 8039 below the profiler summary at 8042 */
+# define EE_JOURNAL_ADDR  (7800)
+#endif
+#ifndef EE_JOURNAL_SLOTS
+/** number of record slots, at least EE_JOURNAL_KEYS + 2 */
+# define EE_JOURNAL_SLOTS (10)
+#endif
+/** number of keys */
+#define EE_JOURNAL_KEYS     (8)
+/** data bytes of a record */
+#define EE_JOURNAL_DATA_MAX (17)
+
+/** keys of the bootloader, the others are free for the application */
+#define EE_JOURNAL_KEY_OTA     (0)  /**< 1 byte, 0 = OTA request as EEPROM 8125 */
+#define EE_JOURNAL_KEY_LED     (1)  /**< 3 bytes, R G B as EEPROM 8127 */
+#define EE_JOURNAL_KEY_NODECFG (2)  /**< 14 bytes, the map at EEPROM 8178 */
+#define EE_JOURNAL_KEY_APP     (3)  /**< first key of the application */
+
+/** return codes */
+#define EE_JOURNAL_OK       (0)
+#define EE_JOURNAL_REJECTED (1)  /**< bad key or length */
+
+/* === types =============================================================== */
+/** A record as it is in the EEPROM. */
+typedef struct
+{
+    uint8_t  key;
+    uint32_t seq;
+    uint8_t  len;
+    uint8_t  data[EE_JOURNAL_DATA_MAX];
+    uint8_t  crc;
+} ee_journal_rec_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Read the slots and find the current record of each key.
+     */
+    void ee_journal_init(void);
+
+    /**
+     * @brief Read the value of a key.
+     * @param buf  the data, at most max bytes
+     * @return length of the value, 0 if the key has none
+     */
+    uint8_t ee_journal_read(uint8_t key, void *buf, uint8_t max);
+
+    /**
+     * @brief Write a new value of a key, 1 ... EE_JOURNAL_DATA_MAX bytes.
+     *
+     * Returns when the record is in the EEPROM.
+     */
+    uint8_t ee_journal_write(uint8_t key, const void *data, uint8_t len);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef EE_JOURNAL_H */
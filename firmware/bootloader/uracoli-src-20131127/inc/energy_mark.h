@@ -0,0 +1,102 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief GPIO markers for energy measurements.
+ *
+ * Built with ENERGY_MARKERS (make -C src energy=1 ..., the bootloader
+ * has PROFILE=energy). Each class of operation drives one pin of
+ * ENERGY_PORT high while it runs:
+ *
+ *  - ENERGY_TX:     radio_send_frame() until TX_END, in TX_ARET with
+ *                   CSMA, retries and the ACK
+ *  - ENERGY_RX:     RX_START until the frame is read in the RX_END ISR,
+ *                   on the RF230 and in the bootloader only the read
+ *  - ENERGY_SPM:    page erase until the RWW section is enabled again
+ *  - ENERGY_SLEEP:  the MCU in a sleep mode, including the ISR which
+ *                   wakes it up
+ *  - ENERGY_ISR:    the ISRs of the ISR profiler: radio, timer, UART RX
+ *  - ENERGY_SAMPLE: a sensor sample, set by the application
+ *
+ * A logic analyzer records the pins along with the supply current,
+ * energymark.py (in the bootloader directory) integrates the current
+ * over the marked intervals. The markers are nested where the
+ * operations are (an ISR during a TX), each class is accounted on its
+ * own.
+ *
+ * The pins default to PF0 .. PF5 (A0 .. A5) on pinoccio, JTAG must be
+ * off for PF4/PF5. Other boards define ENERGY_PORT and ENERGY_DDR, and
+ * ENERGY_SHIFT for the first pin. A marker is a SBI/CBI on the lower
+ * I/O ports, 2 cycles and no register.
+ */
+#ifndef ENERGY_MARK_H
+#define ENERGY_MARK_H
+
+/* === macros ============================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+#define ENERGY_TX       (0) /**< frame transmission */
+#define ENERGY_RX       (1) /**< frame reception */
+#define ENERGY_SPM      (2) /**< flash page programming */
+#define ENERGY_SLEEP    (3) /**< MCU sleep */
+#define ENERGY_ISR      (4) /**< profiled ISR bodies */
+#define ENERGY_SAMPLE   (5) /**< sensor sample of the application */
+#define ENERGY_NCLASSES (6)
+
+#if defined(ENERGY_MARKERS)
+# if !defined(ENERGY_PORT)
+#  if defined(pinoccio)
+#   define ENERGY_PORT  PORTF
+#   define ENERGY_DDR   DDRF
+#  else
+#   error "ENERGY_MARKERS needs ENERGY_PORT and ENERGY_DDR for this board"
+#  endif
+# endif
+# if !defined(ENERGY_SHIFT)
+#  define ENERGY_SHIFT (0)
+# endif
+# define ENERGY_MASK (((1 << ENERGY_NCLASSES) - 1) << ENERGY_SHIFT)
+/** marker pins to output low */
+# define ENERGY_MARK_INIT() \
+        do{ENERGY_PORT &= ~ENERGY_MASK; ENERGY_DDR |= ENERGY_MASK;}while(0)
+/** start of an operation of class c */
+# define ENERGY_MARK_ON(c)  do{ENERGY_PORT |= _BV((c) + ENERGY_SHIFT);}while(0)
+/** end of an operation of class c */
+# define ENERGY_MARK_OFF(c) do{ENERGY_PORT &= ~_BV((c) + ENERGY_SHIFT);}while(0)
+#else
+# define ENERGY_MARK_INIT() do{}while(0)
+# define ENERGY_MARK_ON(c)  do{}while(0)
+# define ENERGY_MARK_OFF(c) do{}while(0)
+#endif
+
+/** @} */
+#endif  /* #ifndef ENERGY_MARK_H */
@@ -0,0 +1,181 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Append-only record log in the unused flash of the application.
+ *
+ * The log is a ring of flash pages, written through the page service of
+ * the bootloader (wibosvc.h, WIBO_FLAVOUR_APPSPM). Records are collected
+ * in a page buffer in RAM and a page is written once, when it is full
+ * or at flash_log_flush(). The page with sequence number s is at page
+ * s % npages of the region, so the pages are written in turn and each
+ * one is erased once per round (wear levelling).
+ *
+ * Page layout:
+ *  - header: magic, sequence number, the consumed position (tail) at
+ *    the time of the write, used bytes, CRC16 of the header
+ *  - records: length, tag, CRC16 of tag and data, data
+ *  - the rest is 0xFF
+ *
+ * Records are read in order from the tail with flash_log_read(), once
+ * uploaded they are given up with flash_log_consume(). The position is
+ * kept in the header of the next page written, the pages behind it are
+ * free again. Compaction is sequential: the tail only moves forward, so
+ * nothing behind it is still live and there is nothing to copy.
+ *
+ * The index (head and tail) is rebuilt from the page headers on the
+ * first call after flash_log_init(). Records of the RAM page which were
+ * not flushed are lost at a reset. Each page write takes some ms with
+ * interrupts off, see wibosvc.h.
+ *
+ * The region must not overlap the application or, with
+ * WIBO_FLAVOUR_SLOTS, the staging slot in the upper half of the
+ * application section.
+ */
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <avr/io.h>
+
+/* === macros ============================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+/** "FL", first word of a page */
+#define FLASH_LOG_MAGIC     (0x4C46)
+/** bytes of the page header */
+#define FLASH_LOG_HDR_SIZE  (14)
+/** bytes of the record header */
+#define FLASH_LOG_REC_SIZE  (4)
+/** record bytes of a page */
+#define FLASH_LOG_DATA_SIZE (SPM_PAGESIZE - FLASH_LOG_HDR_SIZE)
+/** largest record data */
+#define FLASH_LOG_MAX_LEN   (FLASH_LOG_DATA_SIZE - FLASH_LOG_REC_SIZE)
+
+/** flash_log_t::flags, when the ring is full the oldest records are
+ *  dropped instead of rejecting new ones */
+#define FLASH_LOG_OVERWRITE (1)
+
+/** return codes */
+#define FLASH_LOG_OK        (0)
+#define FLASH_LOG_FULL      (1)  /**< no free page, consume records first */
+#define FLASH_LOG_TOOBIG    (2)  /**< more than @ref FLASH_LOG_MAX_LEN */
+#define FLASH_LOG_NOSVC     (3)  /**< no compatible service table */
+#define FLASH_LOG_REJECTED  (4)  /**< the bootloader refused the page */
+
+/* === types =============================================================== */
+/** Position of a record, sequence number of the page and offset. */
+typedef struct
+{
+    uint32_t seq;
+    uint8_t  off;
+} flash_log_pos_t;
+
+/** A log, the members are private to flash_log.c. */
+typedef struct
+{
+    uint32_t start;         /**< byte address of the region */
+    uint16_t npages;        /**< pages of the region */
+    uint8_t  flags;         /**< FLASH_LOG_OVERWRITE */
+    bool     mounted;       /**< head and tail are known */
+    bool     tail_dirty;    /**< tail changed since the last page write */
+    uint8_t  used;          /**< record bytes in buf */
+    uint16_t crc_errors;    /**< records skipped by flash_log_read() */
+    uint32_t head;          /**< sequence number of the page in buf */
+    flash_log_pos_t tail;   /**< oldest record not consumed */
+    uint8_t  buf[SPM_PAGESIZE]; /**< page being filled */
+} flash_log_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Set up a log, the flash is read with the first call.
+     * @param fl      the log
+     * @param start   page aligned byte address of the region
+     * @param npages  pages of the region, at least 2
+     * @param flags   FLASH_LOG_OVERWRITE or 0
+     */
+    void flash_log_init(flash_log_t *fl, uint32_t start, uint16_t npages,
+                        uint8_t flags);
+
+    /**
+     * @brief Append a record, writes the page before if it is full.
+     * @return FLASH_LOG_OK or an error code
+     */
+    uint8_t flash_log_append(flash_log_t *fl, uint8_t tag,
+                             const void *data, uint8_t len);
+
+    /**
+     * @brief Write the records of the RAM page and the tail now.
+     *
+     * The rest of the page stays unused, the next record starts a
+     * new page.
+     */
+    uint8_t flash_log_flush(flash_log_t *fl);
+
+    /**
+     * @brief Start a read at the oldest record not consumed.
+     */
+    void flash_log_rewind(flash_log_t *fl, flash_log_pos_t *pos);
+
+    /**
+     * @brief Read the record at pos and step pos to the next one.
+     *
+     * Records with a bad CRC are skipped.
+     *
+     * @param tag  the tag of the record
+     * @param buf  the data, at most max bytes
+     * @return length of the record, -1 at the end of the log
+     */
+    int16_t flash_log_read(flash_log_t *fl, flash_log_pos_t *pos,
+                           uint8_t *tag, void *buf, uint8_t max);
+
+    /**
+     * @brief Give up the records before pos, e.g. after an upload.
+     */
+    void flash_log_consume(flash_log_t *fl, const flash_log_pos_t *pos);
+
+    /**
+     * @brief Number of pages which can be written before the log is full.
+     */
+    uint16_t flash_log_free_pages(flash_log_t *fl);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef FLASH_LOG_H */
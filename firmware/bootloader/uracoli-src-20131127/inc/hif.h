@@ -64,6 +64,29 @@
 #endif
 
 
+#if HIF_TYPE_IS_UART || defined DOXYGEN
+# ifndef UART_TXBUFSIZE
+/** Size of the UART transmit ring in bytes, a power of 2,
+ *  may be set per board in board_cfg.h */
+#  define UART_TXBUFSIZE (128)
+# endif
+# ifndef UART_RXBUFSIZE
+/** Size of the UART receive ring in bytes, a power of 2,
+ *  may be set per board in board_cfg.h */
+#  define UART_RXBUFSIZE (128)
+# endif
+#endif
+
+/**
+ * Data type for the sizes of @ref hif_put_blk() and @ref hif_get_blk().
+ * It is only 16 bit wide, if an UART ring is larger than 256 bytes.
+ */
+#if HIF_TYPE_IS_UART && ((UART_TXBUFSIZE > 256) || (UART_RXBUFSIZE > 256))
+typedef uint16_t hif_blk_t;
+#else
+typedef uint8_t hif_blk_t;
+#endif
+
 /* === Prototypes ====================================== */
 
 #if HIF_TYPE != HIF_NONE || defined DOXYGEN
@@ -98,7 +121,55 @@ void hif_puts(const char *s );
  * @param size  size of the block.
  * @return num  number of bytes, which was send.
  */
-uint8_t hif_put_blk(unsigned char *data, uint8_t size);
+hif_blk_t hif_put_blk(unsigned char *data, hif_blk_t size);
+
+/**
+ * Data block of a scatter/gather transmission, see @ref hif_put_sg().
+ */
+typedef struct
+{
+    /** start of the block */
+    const uint8_t *data;
+    /** number of bytes in the block */
+    uint16_t len;
+} hif_iov_t;
+
+/**
+ * Function type, which is called when a scatter/gather transmission
+ * is done. It is called from interrupt context and may start the
+ * next transmission.
+ */
+typedef void (hif_sg_done_t)(void *ctx);
+
+/**
+ * @brief Send a list of data blocks without copying them.
+ *
+ * The blocks are streamed by the transmit interrupt directly from
+ * the memory of the caller, after the bytes which are already in the
+ * transmit buffer. The block list and the blocks must not be changed
+ * until @p done is called. While the transmission is in flight, the
+ * other hif_put* functions do not accept data.
+ *
+ * This function is only available for UART host interfaces.
+ *
+ * @param iov     array of data blocks
+ * @param iovcnt  number of blocks in @p iov
+ * @param done    function, which is called after the last byte was
+ *                written to the UART, may be NULL
+ * @param ctx     argument, which is given to @p done
+ * @return 1 if the transmission was started,
+ *         0 if there is still one in flight.
+ */
+uint8_t hif_put_sg(const hif_iov_t *iov, uint8_t iovcnt,
+                   hif_sg_done_t *done, void *ctx);
+
+/**
+ * @brief Check for a scatter/gather transmission in flight.
+ *
+ * @return 1 until the @p done function of the last @ref hif_put_sg()
+ *         call was run, 0 otherwise.
+ */
+uint8_t hif_put_sg_busy(void);
 
 /**
  * @brief Send a character to the interface.
@@ -145,7 +216,7 @@ int hif_getc(void);
  * @param max_size maximum number of bytes, which can be stored in the buffer.
  * @return  number of bytes stored in the buffer
  */
-uint8_t hif_get_blk(unsigned char *data, uint8_t max_size);
+hif_blk_t hif_get_blk(unsigned char *data, hif_blk_t max_size);
 
 
 /**
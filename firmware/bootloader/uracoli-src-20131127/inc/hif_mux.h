@@ -0,0 +1,153 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Channels multiplexed over the host interface.
+ *
+ * The HIF is one byte stream. With the multiplexer, several streams
+ * share it, e.g. a console, a trace and binary data, each with its own
+ * transmit and receive ring, and each available as a FILE (avr-libc
+ * stdio), so it can be used with fprintf() and fgetc().
+ *
+ * On the line, the data of a channel is sent in chunks. Each chunk
+ * starts with the two bytes DLE (0x10) and '0' + channel, the same
+ * tagging as the star mode of wuart, a data byte 0x10 is sent as DLE
+ * DLE. Since every chunk carries its tag, a receiver which starts in
+ * the middle of the stream or lost bytes is in sync again at the next
+ * chunk. The host tags its data the same way, data before the first
+ * tag goes to channel 0.
+ *
+ * The rings are filled and emptied in the main context, hif_mux_task()
+ * moves the data between them and the HIF, one chunk per channel in
+ * turn, so a busy channel does not hold back the others. Writing to a
+ * full ring runs hif_mux_task() until there is space, unless the
+ * channel is HIF_MUX_NONBLOCK, then the byte is dropped and counted,
+ * e.g. for a trace which must not slow down the application. Received
+ * bytes for a full ring are dropped and counted as well.
+ *
+ * hif_mux_task() also empties the HIF receive buffer, the application
+ * must not call hif_getc() or hif_get_blk() itself.
+ */
+#ifndef HIF_MUX_H
+#define HIF_MUX_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include <stdio.h>
+#include "hif.h"
+
+/* === macros ============================================================== */
+/** @addtogroup grpHIF
+ *  @{
+ */
+#ifndef HIF_MUX_NCHAN
+/** number of channels, at most 10 */
+# define HIF_MUX_NCHAN   (3)
+#endif
+#ifndef HIF_MUX_BUFSIZE
+/** size of each ring in bytes, a power of 2, at most 128 */
+# define HIF_MUX_BUFSIZE (64)
+#endif
+#ifndef HIF_MUX_CHUNK
+/** maximum data bytes of a chunk, at most 126 */
+# define HIF_MUX_CHUNK   (32)
+#endif
+
+/** tag byte, followed by '0' + channel */
+#define HIF_MUX_DLE      (0x10)
+
+/** channel flags, see hif_mux_set_flags() */
+#define HIF_MUX_NONBLOCK (1) /**< drop output if the ring is full */
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Set up the rings and streams, hif_init() is done before.
+     */
+    void hif_mux_init(void);
+
+    /**
+     * @brief Stream of a channel, for fprintf(), fputc(), fgetc() ...
+     *
+     * Reading returns EOF if the receive ring is empty.
+     */
+    FILE * hif_mux_stream(uint8_t ch);
+
+    /**
+     * @brief Set the flags of a channel, HIF_MUX_NONBLOCK or 0.
+     */
+    void hif_mux_set_flags(uint8_t ch, uint8_t flags);
+
+    /**
+     * @brief Put a byte into the transmit ring of a channel.
+     * @return the byte or EOF if it was dropped
+     */
+    int hif_mux_putc(uint8_t ch, int c);
+
+    /**
+     * @brief Put a block into the transmit ring of a channel, never
+     *        blocks.
+     * @return number of bytes taken
+     */
+    hif_blk_t hif_mux_write(uint8_t ch, const void *data, hif_blk_t size);
+
+    /**
+     * @brief Get a byte from the receive ring of a channel.
+     * @return the byte or EOF if the ring is empty
+     */
+    int hif_mux_getc(uint8_t ch);
+
+    /**
+     * @brief Get a block from the receive ring of a channel.
+     * @return number of bytes stored in data
+     */
+    hif_blk_t hif_mux_read(uint8_t ch, void *data, hif_blk_t max_size);
+
+    /**
+     * @brief Bytes dropped on a channel, transmit and receive.
+     */
+    uint16_t hif_mux_drops(uint8_t ch);
+
+    /**
+     * @brief Move data between the rings and the HIF, called from the
+     *        main loop.
+     */
+    void hif_mux_task(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef HIF_MUX_H */
@@ -355,4 +355,34 @@ typedef struct
 # error "An UART is not supported for the current MCU type."
 #endif /* defined(__ARV_xxxxx__) */
 
+/* === hardware flow control ============================= */
+/*
+ * RTS/CTS handshake on GPIOs, enabled when the board header defines the
+ * HIF_UART_RTS_* and HIF_UART_CTS_* pins. Both lines are active low. RTS
+ * is deasserted when the RX buffer is down to HIF_UART_RTS_MARGIN free
+ * bytes, the transmitter stops while CTS is deasserted and a pin change
+ * interrupt restarts it.
+ */
+#if defined(HIF_UART_RTS_BIT) && defined(HIF_UART_CTS_BIT)
+# define HIF_UART_FLOW_CONTROL (1)
+# ifndef HIF_UART_RTS_MARGIN
+#  define HIF_UART_RTS_MARGIN (8)
+# endif
+# define HIF_UART_RTS_ASSERT()   (HIF_UART_RTS_PORT &= ~_BV(HIF_UART_RTS_BIT))
+# define HIF_UART_RTS_DEASSERT() (HIF_UART_RTS_PORT |= _BV(HIF_UART_RTS_BIT))
+# define HIF_UART_RTS_IS_ASSERTED() (!(HIF_UART_RTS_PORT & _BV(HIF_UART_RTS_BIT)))
+# define HIF_UART_CTS_BLOCKED()  (HIF_UART_CTS_PIN & _BV(HIF_UART_CTS_BIT))
+# define HIF_UART_CTS_IRQ_EI()   (HIF_UART_CTS_PCMSK |= _BV(HIF_UART_CTS_PCINT))
+# define HIF_UART_CTS_IRQ_DI()   (HIF_UART_CTS_PCMSK &= ~_BV(HIF_UART_CTS_PCINT))
+# define HIF_UART_FLOW_INIT() \
+    do { \
+        HIF_UART_RTS_ASSERT(); \
+        HIF_UART_RTS_DDR |= _BV(HIF_UART_RTS_BIT); \
+        HIF_UART_CTS_PORT |= _BV(HIF_UART_CTS_BIT); \
+        PCICR |= _BV(HIF_UART_CTS_PCIE); \
+    } while(0)
+#else
+# define HIF_UART_FLOW_CONTROL (0)
+#endif
+
 #endif /* ! defined(HIF_UART_H) && HIF_TYPE_IS_UART */
@@ -35,8 +35,40 @@
 #include <util/twi.h>
 
 /* === macros ============================================================== */
+/** @ref i2c_xfer_t::status of a queued or running transaction */
+#define I2C_XFER_PENDING (0)
+/** @ref i2c_xfer_t::status of a completed transaction */
+#define I2C_XFER_OK      (1)
+/** @ref i2c_xfer_t::status of a transaction, which was NAKed or failed */
+#define I2C_XFER_ERROR   (2)
 
 /* === types =============================================================== */
+struct i2c_xfer_tag;
+
+/**
+ * Completion function of an asynchronous transaction,
+ * called from the TWI interrupt. It may submit further transactions.
+ */
+typedef void (i2c_done_t)(struct i2c_xfer_tag *xfer);
+
+/**
+ * Asynchronous I2C transaction: an optional write phase, followed by an
+ * optional read phase after a repeated start, as with
+ * i2c_master_writeread(). The structure and the buffers are owned
+ * by the caller and must stay valid until the done function was called.
+ */
+typedef struct i2c_xfer_tag
+{
+    uint8_t devaddr;           /**< 7 bit device address */
+    uint8_t *writebuf;         /**< bytes to write */
+    uint8_t bytestowrite;      /**< number of bytes to write */
+    uint8_t *readbuf;          /**< buffer for the bytes read */
+    uint8_t bytestoread;       /**< number of bytes to read */
+    i2c_done_t *done;          /**< completion function, may be NULL */
+    void *ctx;                 /**< user data for the completion function */
+    volatile uint8_t status;   /**< I2C_XFER_PENDING, _OK or _ERROR */
+    struct i2c_xfer_tag *next; /**< queue link, private */
+} i2c_xfer_t;
 
 /* === prototypes ========================================================== */
 #ifdef __cplusplus
@@ -52,6 +84,16 @@ extern "C" {
     uint8_t i2c_probe(uint8_t devaddr);
     uint8_t i2c_master_writeread(uint8_t devaddr, uint8_t *writebuf, uint8_t bytestowrite, uint8_t *readbuf, uint8_t bytestoread);
 
+    /**
+     * @brief Queue an asynchronous transaction.
+     *
+     * The transaction is run by the TWI interrupt after the ones
+     * queued before; global interrupts need to be enabled.
+     */
+    void i2c_submit(i2c_xfer_t *xfer);
+    /** @brief Return 1 while asynchronous transactions are queued. */
+    uint8_t i2c_busy(void);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -92,10 +92,22 @@ typedef struct
     uint8_t nb;
     /** total size of a buffer element */
     uint8_t elsz;
+    /** first free buffer, the free buffers are linked via next */
+    buffer_t *free;
     /** data block seperated into buffer_t elemente */
     uint8_t pool[];
 } buffer_pool_t;
 
+/** fifo of buffers, linked via next, e.g. to pass filled buffers
+ *  from an ISR to the main loop */
+typedef struct
+{
+    /** oldest buffer, NULL if empty */
+    buffer_t * volatile head;
+    /** newest buffer */
+    buffer_t *tail;
+} buffer_queue_t;
+
 /** @} */
 
 /* === Macros ================================================================ */
@@ -386,9 +398,24 @@ uint8_t buffer_prepend_block(buffer_t *b, void *pdata, uint8_t size);
 uint8_t buffer_get_block(buffer_t *b, void *pdata, uint8_t size);
 
 
+/** format a chunk of memory as pool of buffers with bsz data bytes */
 buffer_pool_t * buffer_pool_init(uint8_t *pmem, size_t memsz, uint8_t bsz);
+/** take a buffer from the pool, NULL if none is free,
+ *  not interrupt safe (use in ISR or with interrupts off) */
 buffer_t * buffer_alloc(buffer_pool_t *ppool, uint8_t istart);
-void buffer_free(buffer_t * pbuf);
+/** return a buffer to its pool, not interrupt safe */
+void buffer_free(buffer_pool_t *ppool, buffer_t * pbuf);
+/** same as buffer_alloc(), with interrupts off meanwhile */
+buffer_t * buffer_alloc_atomic(buffer_pool_t *ppool, uint8_t istart);
+/** same as buffer_free(), with interrupts off meanwhile */
+void buffer_free_atomic(buffer_pool_t *ppool, buffer_t * pbuf);
+
+/** empty a buffer queue */
+void buffer_queue_init(buffer_queue_t *pq);
+/** append a buffer to a queue, interrupt safe */
+void buffer_queue_push(buffer_queue_t *pq, buffer_t *pbuf);
+/** take the oldest buffer from a queue, NULL if empty, interrupt safe */
+buffer_t * buffer_queue_pop(buffer_queue_t *pq);
 
 
 
@@ -403,6 +430,11 @@ typedef struct
     buffer_t *pbufout;
     void (*incb)(buffer_t *pbuf);
     void (*outcb)(buffer_t *pbuf);
+    /** output watermark, 0 calls outcb after every character,
+     *  see buffer_stream_set_watermark() */
+    uint8_t outmark;
+    /** character, which flushes the output buffer, or EOF */
+    int flushchar;
 } buffer_stream_t;
 
 
@@ -414,6 +446,29 @@ int buffer_stream_init( buffer_stream_t *pbs,
 int buffer_stream_putchar(char c,FILE *f);
 int buffer_stream_getchar(FILE *f);
 
+/**
+ * @brief Switch the stream to block mode.
+ *
+ * In block mode, outcb is called only if the output buffer is full,
+ * holds at least outmark bytes or flushchar was written, and incb is
+ * called only if the input buffer runs empty. Both callbacks then
+ * handle a whole frame, e.g. outcb sends the buffer and resets it.
+ *
+ * @param outmark   output watermark, 0 restores the per character mode
+ * @param flushchar character, which flushes the output, or EOF
+ */
+void buffer_stream_set_watermark(buffer_stream_t *pbs, uint8_t outmark,
+                                 int flushchar);
+/** @brief Write a block, calling outcb each time the buffer fills up.
+ *  @return number of bytes written */
+uint8_t buffer_stream_write(buffer_stream_t *pbs, const void *pdata,
+                            uint8_t size);
+/** @brief Read a block from the input buffer.
+ *  @return number of bytes read */
+uint8_t buffer_stream_read(buffer_stream_t *pbs, void *pdata, uint8_t size);
+/** @brief Pass pending output to outcb. */
+void buffer_stream_flush(buffer_stream_t *pbs);
+
 
 
 /** @} */
@@ -0,0 +1,121 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Interface of the ISR profiler.
+ *
+ * Built with ISR_PROFILE (make -C src isrprof=1 ...). The radio, timer
+ * and UART receive ISRs read a hardware timer at entry and exit and
+ * account the duration in CPU cycles per vector: count, min, max, sum
+ * and a histogram. The timer ISR also records its latency, the count of
+ * the tick timer at entry, which is how long the overflow waited for
+ * other ISRs and cli() sections. ISR_PROF_FRAME_READ times the frame
+ * download within the radio ISR, for comparison with the whole ISR.
+ *
+ * The clock is the tick timer of the board (@ref HWTIMER_REG at F_CPU),
+ * another free running 16 bit counter at F_CPU may be given with
+ * ISR_PROF_REG. Durations above 65535 cycles wrap.
+ *
+ * The accounting is a function call from the ISR, which adds a few
+ * dozen cycles and the registers it clobbers to every profiled ISR.
+ */
+#ifndef ISR_PROF_H
+#define ISR_PROF_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include "board.h"
+
+/* === macros ============================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+#define ISR_PROF_RADIO      (0) /**< TRX24_RX_END_vect or TRX_IRQ_vect */
+#define ISR_PROF_FRAME_READ (1) /**< frame download in the radio ISR */
+#define ISR_PROF_TIMER      (2) /**< TIMER_IRQ_vect, tmr_process() */
+#define ISR_PROF_UART_RX    (3) /**< HIF_UART_RX_vect */
+#define ISR_PROF_NSLOTS     (4)
+
+/** histogram bins: < 64, < 128, ... < 4096, >= 4096 cycles */
+#define ISR_PROF_NBINS      (8)
+#define ISR_PROF_BIN0_SHIFT (6)
+
+#if defined(ISR_PROFILE)
+# if !defined(ISR_PROF_REG)
+#  if defined(TIMER_TICKLESS) || !defined(HWTIMER_REG) || (HWTMR_PRESCALE != 1)
+#   error "ISR_PROFILE needs a 16 bit counter at F_CPU, define ISR_PROF_REG"
+#  endif
+#  define ISR_PROF_REG (HWTIMER_REG)
+# endif
+/** take the entry time, first statement of the ISR */
+# define ISR_PROF_ENTER(var) uint16_t var = ISR_PROF_REG
+/** account the time since ISR_PROF_ENTER() to a slot */
+# define ISR_PROF_EXIT(slot, var) isr_prof_add((slot), (var), 0)
+/** same, with a latency in cycles */
+# define ISR_PROF_EXIT_LATE(slot, var, late) isr_prof_add((slot), (var), (late))
+#else
+# define ISR_PROF_ENTER(var)
+# define ISR_PROF_EXIT(slot, var)
+# define ISR_PROF_EXIT_LATE(slot, var, late)
+#endif
+
+/* === types =============================================================== */
+/** statistics of one slot, times in CPU cycles */
+typedef struct
+{
+    uint16_t count;    /**< saturates at 0xFFFF */
+    uint16_t min;
+    uint16_t max;
+    uint16_t late_max; /**< maximum latency, if the slot has one */
+    uint32_t sum;
+    uint16_t hist[ISR_PROF_NBINS];
+} isr_prof_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(ISR_PROFILE)
+/** account a sample, called by ISR_PROF_EXIT() with interrupts off */
+void isr_prof_add(uint8_t slot, uint16_t t0, uint16_t late);
+/** copy the statistics of a slot, interrupt safe */
+void isr_prof_get(uint8_t slot, isr_prof_t *p);
+/** clear all slots */
+void isr_prof_reset(void);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef ISR_PROF_H */
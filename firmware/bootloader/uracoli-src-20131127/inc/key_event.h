@@ -0,0 +1,125 @@
+/* Copyright (c) 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Debounced key events from a timer callback.
+ *
+ * The keys (KEY_GET()) are sampled by a timer of the timer module, a
+ * state is taken over after @ref KEY_EVENT_DEBOUNCE equal samples.
+ * Each change is put into an event queue, which the main loop empties
+ * with key_event_get() and may sleep in between.
+ *
+ * Boards which define KEY_IRQ_vect, KEY_IRQ_ENABLE() and
+ * KEY_IRQ_DISABLE() (an external or pin change interrupt of the keys)
+ * run the timer only while a key is pressed or bouncing, otherwise
+ * the keys are sampled all the time.
+ */
+#ifndef KEY_EVENT_H
+#define KEY_EVENT_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include <stdbool.h>
+#include "timer.h"
+
+/* === macros ============================================================== */
+#ifndef KEY_EVENT_SAMPLE_TICKS
+/** sample period of the keys in timer ticks */
+# define KEY_EVENT_SAMPLE_TICKS (MSEC(10) ? MSEC(10) : 1)
+#endif
+
+#ifndef KEY_EVENT_DEBOUNCE
+/** number of equal samples, before a key state is valid */
+# define KEY_EVENT_DEBOUNCE (4)
+#endif
+
+#ifndef KEY_EVENT_LONG_TICKS
+/** time from the press of a key until @ref KEY_EVENT_LONG */
+# define KEY_EVENT_LONG_TICKS (MSEC(800))
+#endif
+
+#ifndef KEY_EVENT_QUEUE_LEN
+/** length of the event queue, a power of 2 */
+# define KEY_EVENT_QUEUE_LEN (4)
+#endif
+
+/** key_event_t::type, the keys went down */
+#define KEY_EVENT_PRESS   (1)
+/** key_event_t::type, the keys went up */
+#define KEY_EVENT_RELEASE (2)
+/** key_event_t::type, the keys are held longer
+ *  than @ref KEY_EVENT_LONG_TICKS, sent once per press */
+#define KEY_EVENT_LONG    (3)
+
+/* === types =============================================================== */
+/** One key event. */
+typedef struct
+{
+    uint8_t type;   /**< KEY_EVENT_PRESS, _RELEASE or _LONG */
+    uint8_t keys;   /**< mask of the keys, as KEY_GET() */
+} key_event_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Initialize the keys and start the event service.
+     *
+     * The timer module must be initialized before.
+     */
+    void key_event_init(void);
+
+    /**
+     * @brief Take the oldest event from the queue.
+     * @param ev  the event
+     * @return false if the queue is empty
+     */
+    bool key_event_get(key_event_t *ev);
+
+    /**
+     * @brief Number of events lost, because the queue was full.
+     */
+    uint8_t key_event_overruns(void);
+
+    /**
+     * @brief The sample timer is running.
+     *
+     * When false (only with KEY_IRQ_vect), the MCU can go to a
+     * sleep mode without the timer, the key interrupt wakes it.
+     */
+    bool key_event_busy(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  /* #ifndef KEY_EVENT_H */
@@ -31,13 +31,67 @@
 
 /* === includes ============================================================ */
 #include "p2p_protocol.h"
+#include "ioutil.h"
 /* === macros ============================================================== */
 
 /* === send flags =========================================================== */
 #define P2P_ACK    (1)
 #define P2P_NO_CCA (2)
+#define P2P_SECURE (4) /**< AES-CCM* encrypt frame, see p2p_secure() */
+
+/* === security ============================================================= */
+/** security enabled bit in the frame control field */
+#define P2P_FCF_SECURITY  (0x0008)
+/** size of the frame counter, inserted after the p2p header */
+#define P2P_SEC_FCSIZE    (4)
+/** size of the message integrity code, appended to the payload */
+#define P2P_SEC_MICSIZE   (4)
+/** additional bytes of a secured frame */
+#define P2P_SEC_OVERHEAD  (P2P_SEC_FCSIZE + P2P_SEC_MICSIZE)
+/** security level ENC-MIC-32 */
+#define P2P_SEC_LEVEL     (5)
+
+/* === fragmentation ======================================================== */
+/** payload of one @ref P2P_FRAG frame */
+#define P2P_FRAG_PAYLOAD  (MAX_FRAME_SIZE - sizeof(p2p_frag_t) - 2)
+/** maximum number of fragments per message (one bit each in the rx mask) */
+#define P2P_FRAG_MAX_CNT  (16)
+
+/* === mesh ================================================================= */
+/** additional bytes of a @ref P2P_MESH_DATA frame */
+#define P2P_MESH_OVERHEAD (sizeof(p2p_mesh_data_t) - sizeof(p2p_hdr_t))
+/** next hop of a destination without route */
+#define P2P_MESH_NOROUTE  (0xFFFF)
+
+/* === header compression =================================================== */
+/** bytes of the IPv6 header */
+#define P2P_IPHC_IPV6_HDR (40)
+/** bytes of the UDP header */
+#define P2P_IPHC_UDP_HDR  (8)
+/** longest compressed IPv6 and UDP header, all fields inline */
+#define P2P_IPHC_MAX_HDR  (48)
+
+/* === frame buffers ======================================================== */
+/** room in front of the payload for the p2p, mesh and security headers */
+#define P2P_HEADROOM      (sizeof(p2p_hdr_t) + P2P_MESH_OVERHEAD + P2P_SEC_FCSIZE)
+/** data size of a tx buffer for p2p_send_buffer(), a full payload plus
+ *  headroom and MIC */
+#define P2P_BUFFER_SIZE   (P2P_HEADROOM + MAX_FRAME_SIZE - 2 - \
+                           sizeof(p2p_hdr_t) + P2P_SEC_MICSIZE)
 
 /* === types =============================================================== */
+/** Reassembly context of @ref p2p_frag_receive */
+typedef struct
+{
+    uint8_t *buf;       /**< message buffer */
+    uint16_t bufsz;     /**< size of buf */
+    uint16_t src;       /**< sender of the pending message */
+    uint8_t msgid;      /**< id of the pending message */
+    uint8_t cmd;        /**< command code of the pending message */
+    uint8_t cnt;        /**< number of fragments */
+    uint16_t rxmask;    /**< one bit per received fragment */
+    uint16_t len;       /**< message length, known with the last fragment */
+} p2p_reasm_t;
 
 /* === prototypes ========================================================== */
 #ifdef __cplusplus
@@ -47,6 +101,194 @@ char p2p_init(void);
 void p2p_send(uint16_t dst, uint8_t cmd, uint8_t flags,
               uint8_t *data, uint8_t lendata);
 node_config_t* p2p_get_config(void);
+/**
+ * @brief Send the payload of a buffer, the headers are prepended in place.
+ *
+ * The buffer holds the payload only (after p2p_hdr_t), e.g. set up with
+ * buffer_init(mem, BUFFER_ELSZ(P2P_BUFFER_SIZE), P2P_HEADROOM). The p2p
+ * header goes into the headroom, with P2P_SECURE the frame counter too
+ * and the MIC behind the payload. The radio sends from the buffer, the
+ * payload is never copied. Afterwards the buffer holds the sent frame.
+ *
+ * @return 1 if sent, 0 if the head- or tailroom is too small or the
+ *         frame too long
+ */
+uint8_t p2p_send_buffer(uint16_t dst, uint8_t cmd, uint8_t flags,
+                        buffer_t *pbuf);
+#if defined(RADIO_TXQUEUE)
+/**
+ * @brief Send a message of up to P2P_FRAG_MAX_CNT * P2P_FRAG_PAYLOAD bytes.
+ *
+ * The message is split into @ref P2P_FRAG frames which are put into the
+ * radio tx queue, so they leave back to back. The function waits for a
+ * free queue slot (interrupts must be enabled), but not for the
+ * transmission itself. P2P_SECURE is not supported here.
+ *
+ * @return number of fragments queued, 0 if the message is too long
+ */
+uint8_t p2p_send_msg(uint16_t dst, uint8_t cmd, uint8_t flags,
+                     uint8_t *msg, uint16_t lenmsg, uint8_t retries);
+#endif
+/** attach a reassembly buffer to @c ctx */
+void p2p_frag_init(p2p_reasm_t *ctx, uint8_t *buf, uint16_t bufsz);
+/**
+ * @brief Feed a received @ref P2P_FRAG frame into reassembly.
+ *
+ * A fragment of a new message (other source or msgid) drops the
+ * pending message.
+ *
+ * @return length of the message in ctx->buf once all fragments are
+ *         there (command code in ctx->cmd), 0 otherwise.
+ */
+uint16_t p2p_frag_receive(p2p_reasm_t *ctx, uint8_t *frm, uint8_t len);
+#if defined(P2P_SECURITY)
+/** set the network key, e.g. the security key from EEPROM */
+void p2p_set_key(const uint8_t *key);
+/**
+ * @brief Secure a frame in place with AES-CCM* (ENC-MIC-32).
+ *
+ * The p2p header is authenticated, the payload after the header is
+ * encrypted. The buffer needs @ref P2P_SEC_OVERHEAD spare bytes.
+ *
+ * @param frm frame, starting with p2p_hdr_t, without FCS
+ * @param len length of the frame
+ * @return length of the secured frame
+ */
+uint8_t p2p_secure(uint8_t *frm, uint8_t len);
+/**
+ * @brief Same as p2p_secure() for a frame in a buffer.
+ *
+ * The header is moved into the headroom to make room for the frame
+ * counter, so the payload stays where it is.
+ *
+ * @param pbuf frame, starting with p2p_hdr_t, P2P_SEC_FCSIZE bytes
+ *        headroom and P2P_SEC_MICSIZE bytes tailroom
+ * @return length of the secured frame, 0 if there is no room
+ */
+uint8_t p2p_secure_buffer(buffer_t *pbuf);
+/**
+ * @brief Verify and decrypt a secured frame in place.
+ *
+ * @param frm frame, starting with p2p_hdr_t, without FCS
+ * @param len length of the secured frame
+ * @param fc  frame counter of the sender, may be NULL
+ * @return length of the plain frame, 0 if the MIC did not match
+ */
+uint8_t p2p_unsecure(uint8_t *frm, uint8_t len, uint32_t *fc);
+#endif
+#if defined(P2P_MESH)
+/**
+ * @brief Start the mesh layer.
+ *
+ * It keeps its own copy of PAN and address, so it works with
+ * p2p_init() as well as with applications that set up the radio
+ * themselves. The route table is cleared.
+ */
+void p2p_mesh_init(uint16_t pan_id, uint16_t short_addr);
+/**
+ * @brief Handle a received frame, call it from the main loop.
+ *
+ * Routes are learned from every frame. Route requests and replies are
+ * answered or forwarded, @ref P2P_MESH_DATA frames for other nodes are
+ * forwarded to the next hop (with ACK request, so each hop retries
+ * on its own). A @ref P2P_MESH_DATA frame for this node is turned into
+ * the plain frame in place.
+ *
+ * @param frm frame, starting with p2p_hdr_t, without FCS
+ * @param len length of the frame
+ * @return length of the frame for the application, 0 if the mesh
+ *         layer consumed it
+ */
+uint8_t p2p_mesh_receive(uint8_t *frm, uint8_t len);
+/**
+ * @brief Send a frame to a node, through the mesh if needed.
+ *
+ * Like p2p_send(), the header is filled in here. Neighbours and
+ * broadcasts get the plain frame, nodes further away a
+ * @ref P2P_MESH_DATA frame to the next hop, the buffer needs
+ * @ref P2P_MESH_OVERHEAD spare bytes for it.
+ *
+ * @return 1 if sent, 0 if there is no route yet (a route request is
+ *         sent instead, try again later) or the frame is too long
+ */
+uint8_t p2p_mesh_send(uint16_t dst, uint8_t cmd, uint8_t *data,
+                      uint8_t lendata);
+/**
+ * @brief Same as p2p_mesh_send() for the payload of a buffer.
+ *
+ * The p2p header, and for nodes further away the P2P_MESH_DATA header,
+ * are prepended in the headroom (@ref P2P_HEADROOM), the payload is not
+ * moved.
+ */
+uint8_t p2p_mesh_send_buffer(uint16_t dst, uint8_t cmd, buffer_t *pbuf);
+/** flood a route request for @c dst */
+void p2p_mesh_discover(uint16_t dst);
+/**
+ * @brief Look up the route to a node.
+ * @param hops returns the number of hops, may be NULL
+ * @return next hop, @ref P2P_MESH_NOROUTE if the route is unknown
+ */
+uint16_t p2p_mesh_nexthop(uint16_t dst, uint8_t *hops);
+/** age the routes, call it about once a second */
+void p2p_mesh_tick(void);
+#endif
+#if defined(P2P_IPHC)
+/**
+ * @brief Set the /64 prefix of context 0, e.g. the one of the PAN.
+ * @param prefix 8 bytes, NULL for no context
+ */
+void p2p_iphc_set_context(const uint8_t *prefix);
+/**
+ * @brief Compress the IPv6 and UDP header of a datagram in place.
+ *
+ * @param ip     the datagram, starting with the IPv6 header
+ * @param iplen  length of the datagram
+ * @param l2src  short address of the sender, for the source IID
+ * @param l2dst  short address of the receiver, for the destination IID
+ * @return length of the compressed datagram, -1 if it is not IPv6
+ */
+int16_t p2p_iphc_compress(uint8_t *ip, uint16_t iplen,
+                          uint16_t l2src, uint16_t l2dst);
+/**
+ * @brief Restore a datagram compressed by p2p_iphc_compress().
+ *
+ * A reassembled message (ctx->cmd == @ref P2P_IPHC_DATA) is passed
+ * with ctx->src and the own address.
+ *
+ * @param ipsz size of ip, the compressed data must not overlap it
+ * @return length of the datagram in ip, -1 if it is not supported or
+ *         does not fit
+ */
+int16_t p2p_iphc_decompress(const uint8_t *in, uint16_t inlen,
+                            uint16_t l2src, uint16_t l2dst,
+                            uint8_t *ip, uint16_t ipsz);
+/**
+ * @brief Send an IPv6 datagram with compressed header.
+ *
+ * The datagram is compressed in place. It goes in one @ref P2P_IPHC_DATA
+ * frame if it fits, else, with RADIO_TXQUEUE, as a message of
+ * @ref P2P_FRAG frames with that command code (see p2p_send_msg()).
+ *
+ * @return number of frames sent or queued, 0 if not sent
+ */
+uint8_t p2p_iphc_send(uint16_t dst, uint8_t flags, uint8_t *ip,
+                      uint16_t iplen, uint8_t retries);
+/**
+ * @brief Restore the datagram of a single @ref P2P_IPHC_DATA frame.
+ * @param frm frame, starting with p2p_hdr_t, without FCS
+ * @return length of the datagram in ip, -1 on failure
+ */
+int16_t p2p_iphc_receive(const uint8_t *frm, uint8_t len,
+                         uint8_t *ip, uint16_t ipsz);
+#endif
+#if defined(RADIO_TXQUEUE)
+/** like p2p_send(), but appends the frame to the radio tx queue, the
+ *  priority class follows from cmd: WIBO data, FEC symbols, fragments
+ *  and PHY test frames are bulk, pings, exit, deaf, reset, time sync
+ *  and the window/FEC requests and replies control frames */
+int16_t p2p_send_queued(uint16_t dst, uint8_t cmd, uint8_t flags,
+                        uint8_t *data, uint8_t lendata, uint8_t retries);
+#endif
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -48,6 +48,31 @@
 #define P2P_PING_CNF (0x02)          /**< Reply to a ping request */
 #define P2P_JUMP_BOOTL (0x03)        /**< forces the application to jump to
                                           bootloader */
+#define P2P_FRAG (0x04)              /**< fragment of a message that does not
+                                          fit into one frame */
+#define P2P_MESH_RREQ (0x05)         /**< route request, flooded by all nodes */
+#define P2P_MESH_RREP (0x06)         /**< route reply, travels back to the
+                                          originator of the request */
+#define P2P_MESH_DATA (0x07)         /**< p2p frame for a node out of radio
+                                          range, forwarded hop by hop */
+#define P2P_PING_SHORT_REQ (0x08)    /**< Ping for version, CRC and status
+                                          only, suited for broadcasts */
+#define P2P_PING_SHORT_CNF (0x09)    /**< Reply to a short ping */
+#define P2P_PHY_SET (0x0A)           /**< Switch the PHY profile of a node */
+#define P2P_PHY_STATS_REQ (0x0B)     /**< Ask a node for its test frame
+                                          counters */
+#define P2P_PHY_STATS_CNF (0x0C)     /**< Reply to a stats request */
+#define P2P_PHY_TEST (0x0D)          /**< Test frame of a PHY benchmark,
+                                          only counted by the node */
+#define P2P_TSYNC (0x0E)             /**< Time sync beacon, broadcast by
+                                          all synchronised nodes */
+#define P2P_TDMA_SCHED (0x0F)        /**< Slot owners of the TDMA superframe,
+                                          sent by the coordinator in slot 0 */
+#define P2P_TDMA_REQ (0x10)          /**< Ask the coordinator for slots */
+#define P2P_IPHC_DATA (0x11)         /**< IPv6 datagram with compressed
+                                          header, see p2p_iphc_send() */
+/** hops a route request or data frame goes at most */
+#define P2P_MESH_MAXHOPS (8)
 /* === wibo ================================================================= */
 #define P2P_WIBO_DATA (0x20)          /**< Feed a node with data */
 #define P2P_WIBO_FINISH (0x21)        /**< Force a write of all received data */
@@ -58,6 +83,72 @@
 #define P2P_WIBO_DEAF (0x25)          /**< Put node to deaf (no reply to ping) */
 #define P2P_WIBO_ADDR (0x26)          /**< Set address */
 #define P2P_WIBO_BOOTLUP (0x27)       /**< Initiate bootloader update */
+#define P2P_WIBO_DATA_SEQ (0x28)      /**< Feed a node with sequence numbered data */
+#define P2P_WIBO_WINDOW_REQ (0x29)    /**< Ask a node which frames of the window it has */
+#define P2P_WIBO_WINDOW_CNF (0x2A)    /**< Reply to a window request */
+#define P2P_WIBO_RATE (0x2B)          /**< Switch PHY data rate */
+#define P2P_WIBO_ZMODE (0x2C)         /**< Select encoding of the data stream */
+#define P2P_WIBO_ERASE (0x2D)         /**< Erase pages without sending data */
+#define P2P_WIBO_DISCOVER (0x2E)      /**< Broadcast ping, answered in a random slot */
+#define P2P_WIBO_RESUME (0x2F)        /**< Query or continue a broken update */
+#define P2P_WIBO_COMMIT (0x30)        /**< Verify the staged image and install it */
+#define P2P_WIBO_RELAY (0x31)         /**< Pass the committed staged image on
+                                           to another node */
+#define P2P_WIBO_CHANNEL (0x32)       /**< Leave the rendezvous channel for
+                                           the data channel */
+#define P2P_WIBO_FEC (0x33)           /**< Coded symbol of a block of the image */
+#define P2P_WIBO_FEC_REQ (0x34)       /**< Ask a node which blocks it has decoded */
+#define P2P_WIBO_FEC_CNF (0x35)       /**< Reply to a FEC request */
+
+/** Data stream is taken as is */
+#define P2P_WIBO_ZMODE_RAW (0)
+/** Data stream is LZSS compressed, 12 bit offset, 4 bit length */
+#define P2P_WIBO_ZMODE_LZSS (1)
+/** Data stream is a patch, same tokens as LZSS, but the offset is signed
+ * and points into the installed image at the output position */
+#define P2P_WIBO_ZMODE_DELTA (2)
+/** Shortest match of the LZSS stream, length field 0 */
+#define P2P_WIBO_LZ_MINMATCH (3)
+
+/** Number of frames a node buffers ahead of the next expected
+ * @ref P2P_WIBO_DATA_SEQ frame, one bit each in
+ * p2p_wibo_window_cnf_t::received */
+#define P2P_WIBO_WINDOW_SIZE (16)
+
+/** Bytes of a @ref P2P_WIBO_FEC symbol */
+#define P2P_WIBO_FEC_SYMBOL (64)
+/** Symbols of a block, one bit each in p2p_wibo_fec_t::mask. A block
+ * (2 KB) holds whole pages and is programmed once it is decoded */
+#define P2P_WIBO_FEC_K (32)
+/** Blocks of an image at most, one bit each in p2p_wibo_fec_cnf_t::done */
+#define P2P_WIBO_FEC_MAXBLOCKS (128)
+
+/** Length of a reply slot of @ref P2P_WIBO_DISCOVER in milliseconds,
+ * one @ref P2P_PING_CNF at 250kbps including CSMA fits in */
+#define P2P_WIBO_DISCOVER_SLOT_MS (3)
+
+/** Length of a reply slot of @ref P2P_PING_SHORT_REQ in milliseconds,
+ * one @ref P2P_PING_SHORT_CNF at 250kbps including CSMA fits in */
+#define P2P_PING_SHORT_SLOT_MS (2)
+
+/** Flags of p2p_ping_short_cnf_t::flags, the error code is in the high
+ * nibble, the full @ref P2P_PING_REQ tells the rest */
+#define P2P_PING_SHORT_BOOTL     (0x01) /**< the bootloader replied */
+#define P2P_PING_SHORT_RECEIVING (0x02) /**< a data stream is in progress */
+#define P2P_PING_SHORT_RELAYING  (0x04) /**< @ref P2P_STATUS_RELAYING */
+#define P2P_PING_SHORT_FAILED    (0x08) /**< @ref P2P_STATUS_ERROR */
+#define P2P_PING_SHORT_ERRNO(f)  ((p2p_error_t) ((f) >> 4))
+#define P2P_PING_SHORT_FLAGS(st, err) \
+    ((uint8_t) ((((err) & 0x0f) << 4) | \
+     ((st) == P2P_STATUS_RECEIVINGDATA ? P2P_PING_SHORT_RECEIVING : 0) | \
+     ((st) == P2P_STATUS_RELAYING ? P2P_PING_SHORT_RELAYING : 0) | \
+     ((st) == P2P_STATUS_ERROR ? P2P_PING_SHORT_FAILED : 0)))
+
+/** Flag of p2p_phy_set_t::flags, the node keeps the profile after reset */
+#define P2P_PHY_PERSIST (0x01)
+/** A node that switched without @ref P2P_PHY_PERSIST and hears no
+ * P2P_PHY_* frame for that many seconds returns to its stored profile */
+#define P2P_PHY_REVERT_S (3)
 
 /* === wibo example application ============================================= */
 #define P2P_XMPL_LED (0x30)           /**< P2P Example command */
@@ -68,19 +159,34 @@
 /* === Sensor Apps ========================================================== */
 #define P2P_SENSOR_DATA (0x60)
 #define P2P_SENSOR_CAPTION (0x61)
+#define P2P_SENSOR_BATCH (0x62)     /**< delta encoded samples, see sensor_batch.h */
 
 /* === Types ================================================================ */
 
 typedef enum {
     P2P_STATUS_IDLE = 0x00,
     P2P_STATUS_RECEIVINGDATA = 0x01,
+    P2P_STATUS_RELAYING = 0x02,  /**< sending its image to another node,
+                                      see @ref P2P_WIBO_RELAY */
     P2P_STATUS_ERROR = 0xFF
 } p2p_status_t;
 
 typedef enum {
     P2P_ERROR_NONE = 0x00,
     P2P_ERROR_NONE_DATAMISS,
-    P2P_ERROR_SUCCESS
+    P2P_ERROR_SUCCESS,
+    P2P_ERROR_DELTA_BASE,    /**< patch does not fit the installed image */
+    P2P_ERROR_DELTA_RESUME,  /**< delta update broken, ping crc field
+                                  carries the page to resume with */
+    P2P_ERROR_RESUME,        /**< update broken, see @ref P2P_WIBO_RESUME */
+    P2P_ERROR_COMMIT,        /**< staged image does not match the
+                                  @ref P2P_WIBO_COMMIT length and CRC */
+    P2P_ERROR_SIGNATURE,     /**< MAC of the staged image is wrong */
+    P2P_ERROR_BOOTLUP,       /**< staged bootloader has no valid header
+                                  or CRC, see @ref P2P_WIBO_BOOTLUP */
+    P2P_ERROR_RELAY          /**< no committed image with the length and
+                                  CRC of @ref P2P_WIBO_RELAY, or the
+                                  target did not take it */
 } p2p_error_t;
 
 /**
@@ -143,15 +249,162 @@ typedef struct
     uint8_t version;      /**< software version */
     uint16_t crc;         /**< checksum of received data (only used from WIBO)*/
     char appname[16];     /**< application identification string */
-    char boardname[];     /**< board identification string */
+    char boardname[];     /**< board identification string, WIBO appends
+                               the page size, see p2p_ping_cnf_pagesize() */
 } p2p_ping_cnf_t;
 
+/** Flash page size in bytes a node sent behind the board name of
+ * @ref P2P_PING_CNF, 0 if there is none (applications, older nodes).
+ * @p len is the frame length without FCS.
+ */
+static inline uint16_t p2p_ping_cnf_pagesize(p2p_ping_cnf_t *pr, uint8_t len)
+{
+    uint8_t i = sizeof(p2p_ping_cnf_t);
+    uint8_t *p = (uint8_t *)pr;
+
+    while ((i < len) && (p[i] != 0))
+    {
+        i++;
+    }
+    if (i + 3 > len)
+    {
+        return 0;
+    }
+    return p[i + 1] | (p[i + 2] << 8);
+}
+
+/** Frame structure for @ref P2P_PING_SHORT_REQ.
+ *
+ * A node waits a random number of slots below nslots before it replies,
+ * so replies to a broadcast spread over the window. With nslots 0 the
+ * node replies at once.
+ */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t nslots;   /**< number of reply slots of the window */
+} p2p_ping_short_req_t;
+
+/** Frame structure for @ref P2P_PING_SHORT_CNF. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t flags;    /**< P2P_PING_SHORT_BOOTL ..., error code */
+    uint8_t version;  /**< software version */
+    uint16_t crc;     /**< same as p2p_ping_cnf_t::crc */
+} p2p_ping_short_cnf_t;
+
+/** Frame structure for @ref P2P_PHY_SET, see radio_phy_set().
+ * The node does not reply, it switches as soon as the frame is in. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t profile;  /**< profile index */
+    uint8_t flags;    /**< @ref P2P_PHY_PERSIST */
+} p2p_phy_set_t;
+
+/** Frame structure for @ref P2P_PHY_STATS_REQ. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t clear;    /**< clear the counters after the reply */
+} p2p_phy_stats_req_t;
+
+/** Frame structure for @ref P2P_PHY_STATS_CNF. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t profile;   /**< profile in use */
+    uint8_t stored;    /**< profile applied after reset */
+    uint16_t received; /**< P2P_PHY_TEST frames since the last clear */
+    uint32_t bytes;    /**< their length, including header and FCS */
+} p2p_phy_stats_cnf_t;
+
+/** Frame structure for @ref P2P_PHY_TEST. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t seqno;   /**< frame number of the burst */
+    uint8_t data[];   /**< filler */
+} p2p_phy_test_t;
+
+/** Frame structure for @ref P2P_TSYNC.
+ *
+ * The time of a beacon can't be known before its SFD went out, so each
+ * beacon carries the global time of the SFD of the previous beacon of
+ * the same sender. A receiver pairs it with the local SFD time stamp it
+ * took of that previous beacon.
+ */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t root;     /**< short address of the time root */
+    uint8_t rootseq;   /**< round of the root the time is derived from */
+    uint8_t txseq;     /**< number of this beacon */
+    uint8_t prevseq;   /**< number of the beacon prevtime belongs to,
+                            txseq if there is none */
+    uint32_t prevtime; /**< global time at the SFD of beacon prevseq,
+                            symbol counter ticks */
+} p2p_tsync_t;
+
+/** Frame structure for @ref P2P_TDMA_SCHED. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t slots;     /**< slots of the superframe */
+    uint16_t owner[];  /**< short address of the owner of each slot,
+                            0xffff if free */
+} p2p_tdma_sched_t;
+
+/** Frame structure for @ref P2P_TDMA_REQ. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t nslots;    /**< slots wanted in total, 0 gives all back */
+} p2p_tdma_req_t;
+
 /** Frame structure for @ref P2P_JUMP_BOOTL. */
 typedef struct
 {
     p2p_hdr_t hdr;
 } p2p_jump_bootl_t;
 
+/** Frame structure for @ref P2P_FRAG. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t cmd;     /**< command code of the reassembled message */
+    uint8_t msgid;   /**< message number, same for all fragments */
+    uint8_t idx;     /**< fragment index, 0 ... cnt-1 */
+    uint8_t cnt;     /**< number of fragments of the message */
+    uint8_t data[];  /**< fragment data, all but the last one are full */
+} p2p_frag_t;
+
+/** Frame structure for @ref P2P_MESH_RREQ and @ref P2P_MESH_RREP. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t orig;   /**< node that looks for the route */
+    uint16_t target; /**< node the route goes to */
+    uint8_t rseq;    /**< request number of orig, duplicates are dropped */
+    uint8_t hops;    /**< hops the frame made so far */
+} p2p_mesh_route_t;
+
+/** Frame structure for @ref P2P_MESH_DATA.
+ *
+ * The final node turns it back into a plain frame with orig as source
+ * and cmd as command code, the payload follows as it was.
+ */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t orig;   /**< source of the plain frame */
+    uint16_t final;  /**< destination of the plain frame */
+    uint8_t ttl;     /**< hops left */
+    uint8_t cmd;     /**< command code of the plain frame */
+    uint8_t data[];  /**< payload of the plain frame */
+} p2p_mesh_data_t;
+
 /** Frame structure for @ref P2P_WIBO_DATA. */
 typedef struct {
     p2p_hdr_t hdr;
@@ -159,6 +412,144 @@ typedef struct {
     uint8_t data[];  /**< data container */
 } p2p_wibo_data_t;
 
+/** Frame structure for @ref P2P_WIBO_DATA_SEQ. */
+typedef struct {
+    p2p_hdr_t hdr;
+    uint16_t seqno;  /**< frame number, counts from 0 after P2P_WIBO_RESET */
+    uint8_t dsize;   /**< size of data packet */
+    uint8_t data[];  /**< data container */
+} p2p_wibo_data_seq_t;
+
+/** Frame structure for @ref P2P_WIBO_WINDOW_REQ. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+} p2p_wibo_window_req_t;
+
+/** Frame structure for @ref P2P_WIBO_WINDOW_CNF. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t base;      /**< lowest frame number not received yet */
+    uint16_t received;  /**< bit i set: frame base+i is already buffered,
+                             cleared bits are the frames to retransmit */
+    uint16_t crc;       /**< checksum of data taken in order so far */
+    uint16_t pages;     /**< pages written since P2P_WIBO_RESET */
+    uint16_t lost;      /**< frames dropped for a bad CRC since P2P_WIBO_RESET,
+                             older nodes end the frame before pages */
+} p2p_wibo_window_cnf_t;
+
+/** Frame structure for @ref P2P_WIBO_FEC.
+ *
+ * The symbol is the XOR of the source symbols of the block selected by
+ * mask, source symbol i starts at byte i * P2P_WIBO_FEC_SYMBOL of the
+ * block. Block b starts at the address of P2P_WIBO_ADDR plus
+ * b * P2P_WIBO_FEC_K * P2P_WIBO_FEC_SYMBOL, the image is padded with
+ * 0xFF to whole blocks. Any P2P_WIBO_FEC_K independent symbols decode a
+ * block, a node drops the rest of a block when the host moves on.
+ */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t block;    /**< block number */
+    uint16_t nblocks;  /**< blocks of the image */
+    uint32_t mask;     /**< bit i set: source symbol i is in data */
+    uint8_t data[P2P_WIBO_FEC_SYMBOL]; /**< coded symbol */
+} p2p_wibo_fec_t;
+
+/** Frame structure for @ref P2P_WIBO_FEC_REQ. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+} p2p_wibo_fec_req_t;
+
+/** Frame structure for @ref P2P_WIBO_FEC_CNF. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t nblocks;  /**< blocks of the image, 0: no coded transfer yet */
+    uint16_t crc;      /**< CRC of the nblocks blocks once all are decoded,
+                            else the data CRC of the node */
+    uint8_t done[P2P_WIBO_FEC_MAXBLOCKS / 8]; /**< bit b%8 of byte b/8 set:
+                                                   block b is programmed */
+} p2p_wibo_fec_cnf_t;
+
+/** Frame structure for @ref P2P_WIBO_RATE. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t rate;  /**< data rate hash code, e.g. @ref OQPSK1000 */
+} p2p_wibo_rate_t;
+
+/** Frame structure for @ref P2P_WIBO_ZMODE. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t mode;  /**< P2P_WIBO_ZMODE_RAW, _LZSS or _DELTA,
+                        reset to raw by P2P_WIBO_RESET */
+    uint32_t baselen;  /**< DELTA: length of image the patch was made against */
+    uint16_t basecrc;  /**< DELTA: CRC-16 CCITT (start 0) of that image */
+} p2p_wibo_zmode_t;
+
+/** Frame structure for @ref P2P_WIBO_ERASE. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint32_t address;  /**< page aligned start address */
+    uint16_t npages;   /**< number of pages to erase */
+} p2p_wibo_erase_t;
+
+/** Frame structure for @ref P2P_WIBO_DISCOVER. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t nslots;  /**< number of reply slots of the window */
+    uint8_t round;   /**< varies the slot of a node from round to round */
+} p2p_wibo_discover_t;
+
+/** Frame structure for @ref P2P_WIBO_CHANNEL.
+ *
+ * Sent by the host on the rendezvous channel to broadcast address and
+ * PAN 0xFFFF, so nodes with a stale PAN ID take it as well.
+ */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint8_t channel;  /**< channel for the rest of the session */
+} p2p_wibo_channel_t;
+
+/** Frame structure for @ref P2P_WIBO_RESUME, host to node and reply */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t page;  /**< request: page to continue with, 0xFFFF: query only
+                         reply: checkpoint page, 0xFFFF: none */
+    uint16_t crc;   /**< data CRC up to that page */
+} p2p_wibo_resume_t;
+
+/** Frame structure for @ref P2P_WIBO_COMMIT, answered with a ping reply */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint32_t len;   /**< image length in bytes from address 0 */
+    uint16_t crc;   /**< CRC CCITT (avr-libc _crc_ccitt_update(), start 0)
+                         of the image, gaps filled with 0xFF */
+    uint8_t mac[16]; /**< AES-CMAC (RFC 4493) of the same bytes, checked
+                          by bootloaders with WIBO_FLAVOUR_SIGNED */
+} p2p_wibo_commit_t;
+
+/** Frame structure for @ref P2P_WIBO_RELAY, host to relay.
+ * The relay feeds its staging slot to the target like a host does
+ * (reset, data, finish, commit with its own MAC), the result is in its
+ * next ping reply once the status is no longer P2P_STATUS_RELAYING. */
+typedef struct
+{
+    p2p_hdr_t hdr;
+    uint16_t target; /**< node to update */
+    uint32_t len;    /**< image length, same as the last P2P_WIBO_COMMIT */
+    uint16_t crc;    /**< image CRC, same as the last P2P_WIBO_COMMIT */
+} p2p_wibo_relay_t;
+
 /** Frame structure for @ref P2P_WIBO_FINISH. */
 typedef struct
 {
@@ -192,7 +583,10 @@ typedef struct
     p2p_hdr_t hdr;
 } p2p_wibo_exit_t;
 
-/** Frame structure for @ref P2P_WIBO_BOOTLUP. */
+/** Frame structure for @ref P2P_WIBO_BOOTLUP.
+ * The staged image starts with a header page: 2 bytes magic "BL"
+ * (0x4C42), 2 bytes length and 2 bytes CRC CCITT of the bootloader image
+ * that follows in the next page, see wibohost.py -L. */
 typedef struct
 {
     p2p_hdr_t hdr;
@@ -226,6 +620,14 @@ typedef struct
     uint8_t caption[]; /**< NULL terminated string */
 } p2p_sensor_caption_t;
 
+/** Frame structure for @ref P2P_SENSOR_BATCH. */
+typedef struct
+{
+    p2p_hdr_t hdr;     /**< p2p frame header */
+    uint8_t nchan;     /**< number of values per sample row */
+    uint8_t data[];    /**< sample rows, see sensor_batch.h */
+} p2p_sensor_batch_t;
+
 /* === prototypes ========================================================== */
 #ifdef __cplusplus
 extern "C" {
@@ -0,0 +1,122 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Idle sleep of the main loop.
+ *
+ * An application announces the peripherals which have to wake it with
+ * pm_set_active() and calls pm_idle() at the end of each pass of its
+ * main loop. pm_idle() selects the deepest sleep mode which keeps
+ * these peripherals running:
+ *
+ *  - @ref PM_HIF, @ref PM_TIMER, @ref PM_ADC: idle, the UART, timer 1
+ *    and the ADC run from the I/O clock
+ *  - @ref PM_RADIO alone: power save on the RFA1/RFR2, the TRX24
+ *    interrupts wake the MCU there. With an external transceiver the
+ *    IRQ pin is the input capture of timer 1, so it is idle.
+ *  - nothing: power down, the MCU wakes on external, pin change and
+ *    watchdog interrupts only
+ *
+ * Wake-up from power save and power down takes the start-up time of the
+ * oscillator (fuses). An application that has to answer a frame faster
+ * keeps PM_TIMER or PM_HIF set.
+ *
+ * The ISRs of the library call PM_EVENT(). pm_idle() does not sleep if
+ * an interrupt came after the last pm_idle() returned, so an event
+ * arriving after its flag was checked in the main loop is handled in
+ * the next pass, not after the next interrupt. ISRs of the application
+ * call PM_EVENT() as well. The flag is a bit in @ref PM_EVENT_REG (one
+ * OUT instruction). Without it, the check falls back to the next
+ * interrupt.
+ */
+#ifndef PM_H
+#define PM_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+
+/* === macros ============================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+#define PM_HIF      (0x01) /**< HIF RX or TX */
+#define PM_TIMER    (0x02) /**< system tick of the timer module */
+#define PM_RADIO    (0x04) /**< transceiver interrupts (RX, TX_END) */
+#define PM_ADC      (0x08) /**< ADC conversion complete */
+
+#if !defined(PM_EVENT_REG) && defined(GPIOR1)
+/** I/O register of the event flag, GPIOR0 holds MCUSR from the bootloader */
+# define PM_EVENT_REG GPIOR1
+#endif
+
+#if defined(PM_EVENT_REG)
+/** an interrupt happened, pm_idle() returns without sleeping */
+# define PM_EVENT() do{PM_EVENT_REG = 1;}while(0)
+#else
+# define PM_EVENT() do{}while(0)
+#endif
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Peripherals which have to wake the MCU from now on.
+     * @param mask   PM_HIF, PM_TIMER, PM_RADIO, PM_ADC
+     */
+    void pm_set_active(uint8_t mask);
+
+    /**
+     * @brief Peripherals which no longer need to wake the MCU.
+     */
+    void pm_clr_active(uint8_t mask);
+
+    /**
+     * @brief The sleep mode pm_idle() selects now, SLEEP_MODE_xxx.
+     */
+    uint8_t pm_sleep_mode(void);
+
+    /**
+     * @brief Sleep until the next interrupt.
+     *
+     * Returns at once, if there was an interrupt since the last call.
+     * Call it with interrupts enabled, at the end of the main loop.
+     */
+    void pm_idle(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef PM_H */
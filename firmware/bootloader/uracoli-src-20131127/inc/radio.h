@@ -66,6 +66,9 @@
 #define STATE_RXAUTO (4)
 /** Sleep state (lowest power consumption). */
 #define STATE_SLEEP (5)
+/** Deep sleep state, register contents are lost and restored at wakeup
+ *  (ATmega256RFR2 only). */
+#define STATE_DEEPSLEEP (6)
 
 
 /** Radio state type */
@@ -80,6 +83,10 @@ typedef enum
     TX_CCA_FAIL,		/**< channel was busy (TX_AUTO only) */
     TX_NO_ACK,			/**< no ACK received (TX_AUTO only) */
     TX_FAIL,			/**< unexpected error */
+#if defined(RADIO_INDIRECT)
+    TX_DATA_PENDING,		/**< ACK with frame pending bit, the parent
+				 *   has queued data (TX_AUTO only) */
+#endif
 } radio_tx_done_t;
 
 
@@ -143,10 +150,35 @@ typedef enum SHORTENUM
     /** PA enable */
     phyTxPa,
     /** LNA enable */
-    phyRxLna
+    phyRxLna,
+    /** Antenna diversity, one of RADIO_ANT_OFF, RADIO_ANT_0, RADIO_ANT_1,
+     *  RADIO_ANT_DIVERSITY, only on transceivers with ANT_DIV_EN */
+    phyAntDiv,
+    /** Dynamic frame buffer protection (RX_SAFE_MODE), no frame is
+     *  received and acknowledged until the last one is read */
+    phyRxProtect,
+    /** Reduced power consumption modes, an OR of RADIO_RPC_..., only on
+     *  transceivers with TRX_RPC (RFR2, RF233) */
+    phyRpc
 
 } radio_attribute_t;
 
+/** values of phyAntDiv */
+#define RADIO_ANT_OFF       (0) /**< no antenna switch, the reset default */
+#define RADIO_ANT_0         (1) /**< switch at antenna 0 */
+#define RADIO_ANT_1         (2) /**< switch at antenna 1 */
+#define RADIO_ANT_DIVERSITY (3) /**< antenna picked at each preamble */
+
+/** values of phyRpc, the bits of TRX_RPC. The receiver saves current
+ *  in the gaps of the listening, at the cost of some sensitivity. */
+#define RADIO_RPC_OFF  (0x00) /**< full power, the default */
+#define RADIO_RPC_RX   (0x20) /**< smart receiving in RX_ON and RX_AACK_ON */
+#define RADIO_RPC_PDT  (0x10) /**< reduced power preamble detector */
+#define RADIO_RPC_PLL  (0x08) /**< PLL in low power while in PLL_ON/TX_ARET_ON */
+#define RADIO_RPC_XAH  (0x04) /**< TX_ARET, low power while waiting for the ACK */
+#define RADIO_RPC_IPAN (0x02) /**< RX_AACK, low power after a frame of another PAN */
+#define RADIO_RPC_ALL  (0x3e) /**< all of them */
+
 
 /**
  * @brief Container for handover of radio parameter values.
@@ -162,7 +194,7 @@ typedef union radio_param_t
 public:
     radio_param_t(int8_t c) { channel = c; } /* also used for txpwr_t */
     //radio_param_t(radio_state_t s) { idle_state = s; }
-    radio_param_t(uint8_t m) { cca_mode = m; } /* also used for data_rate, tx_pa, rx_lna */
+    radio_param_t(uint8_t m) { cca_mode = m; } /* also used for data_rate, tx_pa, rx_lna, ant_div, rx_protect, rpc */
     radio_param_t(uint16_t p) { pan_id = p; } /* also used for short_addr */
     radio_param_t(uint64_t *la) { long_addr = la; }
 #endif
@@ -187,6 +219,12 @@ public:
     uint8_t tx_pa;
     /** RX LNA type */
     uint8_t rx_lna;
+    /** antenna diversity mode */
+    uint8_t ant_div;
+    /** boolean, frame buffer protection */
+    uint8_t rx_protect;
+    /** reduced power consumption modes */
+    uint8_t rpc;
 
 } radio_param_t;
 
@@ -204,6 +242,7 @@ typedef enum SHORTENUM
     SET_PARM_FAILED,    /**< function radio_set_param failed */
     GET_PARM_FAILED,    /**< function radio_get_param failed */
     GENERAL_ERROR,      /**< something unexpected happened */
+    RXPOOL_EMPTY,       /**< frame dropped, no free buffer in rx pool */
 } radio_error_t;
 
 
@@ -222,8 +261,268 @@ typedef struct
     uint8_t  rxframesz;     /**< Length of the buffer rxframesz */
     uint8_t tx_pa;
     uint8_t rx_lna;
+    uint8_t ant_div;        /**< phyAntDiv setting */
+    uint8_t rx_protect;     /**< phyRxProtect setting */
+    uint8_t rpc;            /**< phyRpc setting */
 } radio_status_t;
 
+#if defined(RADIO_RXPOOL)
+#include "ioutil.h"
+/**
+ * @brief Meta data of a frame stored in the rx buffer pool.
+ *
+ * The structure is placed at the beginning of the data block of
+ * each buffer, the frame itself starts at BUFFER_PDATA(b) and
+ * has the length BUFFER_SIZE(b).
+ */
+typedef struct
+{
+    uint8_t  lqi;       /**< LQI value reported by transceiver */
+    int8_t   ed;        /**< ED level at the end of the frame */
+    uint8_t  crc_fail;  /**< boolean, frame failed FCS verification */
+    uint32_t tstamp;    /**< symbol counter at the SFD, see trx_tstamp_sfd() */
+    uint8_t  ant;       /**< antenna of the frame, see @ref radio_get_antenna */
+} radio_rxmeta_t;
+
+/** pointer to the meta data of a buffer returned by @ref radio_rxpool_get */
+#define RADIO_RXMETA(b) ((radio_rxmeta_t*)((b)->data))
+/** size of a pool element for a frame of maximum length */
+#define RADIO_RXPOOL_ELSZ BUFFER_ELSZ(sizeof(radio_rxmeta_t) + MAX_FRAME_SIZE)
+/** memory needed for a rx pool with @c n frame buffers */
+#define RADIO_RXPOOL_MEMSZ(n) (sizeof(buffer_pool_t) + (n) * RADIO_RXPOOL_ELSZ)
+#endif
+
+#if defined(RADIO_LINK)
+#ifndef RADIO_LINK_PEERS
+/** number of peers tracked by the link manager */
+# define RADIO_LINK_PEERS (8)
+#endif
+/**
+ * @brief Link record of one peer, see @ref radio_link_get.
+ */
+typedef struct
+{
+    uint16_t addr;     /**< short address of the peer */
+    uint8_t  used;     /**< entry is valid */
+    uint8_t  age;      /**< LRU counter */
+    uint8_t  lqi;      /**< averaged LQI of received frames */
+    int8_t   ed;       /**< averaged ED of received frames */
+    uint8_t  goodrun;  /**< successful transmissions in a row */
+    uint8_t  txpwr;    /**< SR_TX_PWR value */
+    uint8_t  fretries; /**< SR_MAX_FRAME_RETRES value */
+    uint8_t  cretries; /**< SR_MAX_CSMA_RETRES value */
+    uint8_t  max_be;   /**< SR_MAX_BE value */
+} radio_link_t;
+#endif
+
+#ifndef RADIO_CHSW_TIMEOUT_US
+/** longest wait for the PLL lock after a fast channel switch */
+# define RADIO_CHSW_TIMEOUT_US (200)
+#endif
+/**
+ * @brief Latencies of the fast channel switches, see
+ *        @ref radio_set_channel_fast.
+ */
+typedef struct
+{
+    uint16_t switches; /**< switches with a PLL lock */
+    uint16_t fails;    /**< no lock within RADIO_CHSW_TIMEOUT_US */
+    uint8_t  last_us;  /**< channel write to PLL lock, last switch */
+    uint8_t  min_us;
+    uint8_t  max_us;
+    uint32_t sum_us;   /**< for the average, sum_us / switches */
+} radio_chsw_stats_t;
+
+#if defined(RADIO_SCAN)
+#ifndef RADIO_SCAN_SAMPLE_MS
+/** interval of the ED samples during a channel scan */
+# define RADIO_SCAN_SAMPLE_MS (10)
+#endif
+/**
+ * @brief Result of one channel, see @ref radio_scan_start.
+ */
+typedef struct
+{
+    uint8_t  channel;  /**< channel number */
+    uint8_t  frames;   /**< frames received (saturated at 255) */
+    uint8_t  crc_ok;   /**< frames with valid CRC */
+    uint8_t  edmax;    /**< peak ED value */
+    uint8_t  nbed;     /**< number of ED samples */
+    uint16_t edsum;    /**< sum of ED samples */
+    uint16_t lqisum;   /**< sum of LQI of frames with valid CRC */
+    uint16_t score;    /**< ranking score, lower is better */
+} radio_scan_result_t;
+
+/** callback at the end of a scan, called in timer ISR context */
+typedef void (radio_scan_done_t)(radio_scan_result_t *res, uint8_t n);
+#endif
+
+#if defined(RADIO_TXQUEUE)
+#ifndef RADIO_TXQ_SLOTS
+/** number of frame slots in the tx queue */
+# define RADIO_TXQ_SLOTS (4)
+#endif
+/** priority classes of the tx queue, see @ref radio_txq_put_prio */
+#define RADIO_TXQ_BULK    (0) /**< data streams, e.g. OTA image data */
+#define RADIO_TXQ_NORMAL  (1) /**< default, radio_txq_put() */
+#define RADIO_TXQ_CONTROL (2) /**< short commands and replies, ping, exit */
+#ifndef RADIO_TXQ_RESERVE
+/** slots which bulk frames can not take, kept for the other classes */
+# define RADIO_TXQ_RESERVE (1)
+#endif
+/**
+ * @brief Completion callback of a queued frame, called in ISR context.
+ *
+ * @param handle  value returned by @ref radio_txq_put
+ * @param status  completion status, @ref radio_tx_done_t
+ * @param trac    TRAC_STATUS of the last attempt
+ * @param retries number of repeated transmissions
+ */
+typedef void (*radio_txq_cb_t)(uint8_t handle, radio_tx_done_t status,
+                               uint8_t trac, uint8_t retries);
+#endif
+
+#if defined(RADIO_INDIRECT)
+#ifndef RADIO_INDIRECT_SLOTS
+/** frames the parent holds for sleeping children */
+# define RADIO_INDIRECT_SLOTS (4)
+#endif
+#ifndef RADIO_INDIRECT_TTL
+/** seconds a frame waits for the poll of its child */
+# define RADIO_INDIRECT_TTL (30)
+#endif
+/** length of a MAC data request command frame, including the FCS */
+#define RADIO_DATA_REQUEST_SIZE (12)
+#endif
+
+#if defined(RADIO_LPL)
+#if !defined(RADIO_TXQUEUE)
+# error "RADIO_LPL needs RADIO_TXQUEUE, the strobes are sent by the queue"
+#endif
+#ifndef RADIO_LPL_WAKE_MS
+/** default wake interval of a low power listening node */
+# define RADIO_LPL_WAKE_MS (250)
+#endif
+#ifndef RADIO_LPL_LISTEN_MS
+/** receive window after each wake up, longer than the gap between two
+ *  strobes plus the longest frame */
+# define RADIO_LPL_LISTEN_MS (10)
+#endif
+#ifndef RADIO_LPL_HOLD_MS
+/** the radio stays on that long after the last frame received or sent */
+# define RADIO_LPL_HOLD_MS (100)
+#endif
+#endif
+
+/**
+ * @brief Settings of a PHY profile, see @ref radio_phy_set.
+ */
+typedef struct
+{
+    uint8_t rate;      /**< data rate hash code, e.g. OQPSK250 */
+    uint8_t txpwr;     /**< SR_TX_PWR value, RADIO_PHY_KEEP leaves it */
+    uint8_t ccamode;   /**< SR_CCA_MODE value */
+    uint8_t edthres;   /**< SR_CCA_ED_THRES value */
+    uint8_t fretries;  /**< SR_MAX_FRAME_RETRES value */
+    uint8_t cretries;  /**< SR_MAX_CSMA_RETRES value */
+} radio_phy_profile_t;
+/** field of radio_phy_profile_t is not changed */
+#define RADIO_PHY_KEEP (0xFF)
+/** no profile set since reset */
+#define RADIO_PHY_NONE (0xFF)
+/** size of a profile name, including the terminating 0 */
+#define RADIO_PHY_NAME_LEN (10)
+
+#if defined(RADIO_CSMA)
+/** CSMA and CCA counters, see radio_csma_stats() */
+typedef struct
+{
+    uint16_t cca_free;      /**< CCA found the channel free */
+    uint16_t cca_busy;      /**< CCA found the channel busy */
+    uint16_t cca_fail;      /**< CCA did not finish */
+    uint16_t ed_count;      /**< ED samples taken with the CCAs */
+    uint32_t ed_sum;        /**< sum of the ED samples, for the mean */
+    uint8_t  ed_max;        /**< highest ED sample */
+    uint16_t aret_frames;   /**< frames sent in TX_ARET */
+    uint16_t aret_cca_fail; /**< ... given up with a busy channel */
+    uint16_t aret_no_ack;   /**< ... given up without ACK */
+    uint16_t aret_csma_retries;  /**< CSMA retries of them (RFR2) */
+    uint16_t aret_frame_retries; /**< frame retries of them (RFR2) */
+    uint16_t csma_frames;   /**< frames of radio_csma_send() */
+    uint32_t csma_backoffs; /**< unit backoff periods waited by them */
+    uint16_t csma_fail;     /**< ... given up with a busy channel */
+} radio_csma_stats_t;
+#endif
+
+#if defined(RADIO_RX_FILTER)
+#ifndef RADIO_RX_HDRLEN
+/** bytes read for usr_radio_rx_filter(): FCF, seq, PAN ID, short dst and src */
+# define RADIO_RX_HDRLEN (9)
+#endif
+#endif
+
+#if defined(RADIO_DUPCHECK)
+#ifndef RADIO_DUP_ENTRIES
+/** senders tracked by the duplicate detection, a power of 2 */
+# define RADIO_DUP_ENTRIES (8)
+#endif
+#endif
+
+#if defined(RADIO_TSYNC)
+#ifndef RADIO_TSYNC_PEERS
+/** neighbours whose last beacon is remembered by the time sync */
+# define RADIO_TSYNC_PEERS (4)
+#endif
+#ifndef RADIO_TSYNC_ENTRIES
+/** reference points of the drift regression */
+# define RADIO_TSYNC_ENTRIES (8)
+#endif
+#ifndef RADIO_TSYNC_MIN_ENTRIES
+/** reference points needed before a node counts as synchronised and
+ * sends beacons itself */
+# define RADIO_TSYNC_MIN_ENTRIES (3)
+#endif
+#ifndef RADIO_TSYNC_ROOT_TIMEOUT
+/** beacon periods without news from the root until a node takes over */
+# define RADIO_TSYNC_ROOT_TIMEOUT (3)
+#endif
+#ifndef RADIO_TSYNC_ERROR_LIMIT
+/** deviation in symbol ticks from the estimate a new reference point may
+ * have, beyond that it is taken as an outlier */
+# define RADIO_TSYNC_ERROR_LIMIT (32)
+#endif
+/** length of a @ref radio_tsync_beacon frame: p2p_tsync_t and FCS */
+#define RADIO_TSYNC_BEACON_SIZE (21)
+#endif
+
+#if defined(RADIO_TDMA)
+#if !defined(RADIO_TSYNC)
+# error "RADIO_TDMA needs RADIO_TSYNC, the slots run on the global time"
+#endif
+#ifndef RADIO_TDMA_SLOTS
+/** slots of a superframe, a power of 2 up to 32. Slot 0 carries the
+ * schedule, the last slot is left to CSMA traffic */
+# define RADIO_TDMA_SLOTS (16)
+#endif
+#ifndef RADIO_TDMA_SLOT_TICKS
+/** slot length in symbol ticks, a power of 2. 512 ticks (8.2ms) hold a
+ * frame of maximum length at 250kbps with some slack */
+# define RADIO_TDMA_SLOT_TICKS (512)
+#endif
+#ifndef RADIO_TDMA_GUARD
+/** symbol ticks a node waits after the slot boundary before it sends,
+ * this covers the error of the time sync */
+# define RADIO_TDMA_GUARD (8)
+#endif
+#ifndef RADIO_TDMA_IDLE
+/** superframes after which the coordinator takes back a slot its owner
+ * did not use, and a node drops its slots without schedule */
+# define RADIO_TDMA_IDLE (32)
+#endif
+/** length of a @ref radio_tdma_request frame: p2p_tdma_req_t and FCS */
+#define RADIO_TDMA_REQUEST_SIZE (13)
+#endif
+
 /* === Macros ================================================================ */
 
 /**
@@ -352,6 +651,42 @@ typedef struct
 #  define RP_RX_LNA(x) phyRxLna,(radio_param_t){.rx_lna=x}
 #endif
 
+#if defined(DOXYGEN)
+/**
+ * Helper macro to construct the arguments for @ref radio_set_param in
+ * order to set the antenna diversity mode to @c x (RADIO_ANT_...).
+ */
+#  define RP_ANT_DIV(x)
+#elif defined __cplusplus
+#  define RP_ANT_DIV(x) phyAntDiv,radio_param_t((uint8_t)x)
+#else
+#  define RP_ANT_DIV(x) phyAntDiv,(radio_param_t){.ant_div=x}
+#endif
+
+#if defined(DOXYGEN)
+/**
+ * Helper macro to construct the arguments for @ref radio_set_param in
+ * order to switch the frame buffer protection on (@c x = 1) or off.
+ */
+#  define RP_RX_PROTECT(x)
+#elif defined __cplusplus
+#  define RP_RX_PROTECT(x) phyRxProtect,radio_param_t((uint8_t)x)
+#else
+#  define RP_RX_PROTECT(x) phyRxProtect,(radio_param_t){.rx_protect=x}
+#endif
+
+#if defined(DOXYGEN)
+/**
+ * Helper macro to construct the arguments for @ref radio_set_param in
+ * order to set the reduced power consumption modes to @c x (RADIO_RPC_...).
+ */
+#  define RP_RPC(x)
+#elif defined __cplusplus
+#  define RP_RPC(x) phyRpc,radio_param_t((uint8_t)x)
+#else
+#  define RP_RPC(x) phyRpc,(radio_param_t){.rpc=x}
+#endif
+
 #define CRC_CCITT_UPDATE(crc, data) _crc_ccitt_update(crc, data)
 
 #ifndef RADIO_CFG_EEOFFSET
@@ -426,6 +761,18 @@ void radio_set_state(radio_state_t state);
  */
 void radio_set_param(radio_attribute_t attr, radio_param_t parm);
 
+/**
+ * @brief Antenna of the last received frame.
+ *
+ * With RADIO_ANT_DIVERSITY the transceiver picks the antenna during
+ * the preamble of each frame, and transmits the ACK and the next
+ * frames on it. Valid in usr_radio_receive_frame(), with
+ * RADIO_RXPOOL it is kept in @ref radio_rxmeta_t.
+ *
+ * @return 0 or 1, 0 without antenna diversity support
+ */
+uint8_t radio_get_antenna(void);
+
 /**
  * @brief Frame transmission
  *
@@ -503,6 +850,24 @@ void usr_radio_irq(uint8_t cause);
  */
 uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi, int8_t ed, uint8_t crc_fail);
 
+#if defined(RADIO_RX_FILTER)
+/**
+ * @brief Receive filter on the MAC header.
+ *
+ * Called in RX_END context before the frame is read, with the first
+ * @ref RADIO_RX_HDRLEN bytes of it only (trx_frame_read_head()). A
+ * dropped frame costs this short transfer instead of the whole frame,
+ * the CRC is not checked yet. The default of the library reads every
+ * frame.
+ *
+ * @param len    length of the frame, including the FCS
+ * @param hdr    start of the frame
+ * @param hdrlen valid bytes at @c hdr, min(len, RADIO_RX_HDRLEN)
+ * @return true to read the frame, false to drop it
+ */
+bool usr_radio_rx_filter(uint8_t len, uint8_t *hdr, uint8_t hdrlen);
+#endif
+
 
 /**
  * Transmit done callback function.
@@ -511,6 +876,514 @@ uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi, int8_t
  */
 void usr_radio_tx_done(radio_tx_done_t status);
 
+#if defined(RADIO_SCAN)
+/**
+ * @brief Start a channel quality scan.
+ *
+ * The radio is set to STATE_RX, the original channel is restored
+ * after the scan, the state is left for the caller to restore.
+ * Needs one timer of the timer pool while running.
+ *
+ * @param chmask   bit mask of channels to scan
+ * @param dwell_ms time spent on each channel
+ * @param res      array with one element per channel in @c chmask,
+ *                 sorted best first when the scan is done
+ * @param done     callback after the last channel, may be NULL
+ * @return number of channels to scan, 0 if the scan was not started
+ */
+uint8_t radio_scan_start(uint32_t chmask, uint16_t dwell_ms,
+                         radio_scan_result_t *res, radio_scan_done_t *done);
+
+/** returns true while a scan is running */
+bool radio_scan_busy(void);
+
+/** account a received frame for the current channel (RX_END context) */
+void radio_scan_frame(uint8_t crc_fail, uint8_t lqi);
+#endif
+
+/**
+ * @brief Change the channel in one of the PLL states.
+ *
+ * Unlike radio_set_param(RP_CHANNEL(ch)) followed by a fixed delay,
+ * the transceiver stays in its state (RX_ON, PLL_ON, RX_AACK_ON ...)
+ * and the function returns as soon as the PLL has locked on the new
+ * channel, typically after 11 us, at most after
+ * @ref RADIO_CHSW_TIMEOUT_US. In TRX_OFF only the channel is set, the
+ * PLL locks when the transceiver is switched on. Not while a frame is
+ * sent or received (BUSY_TX/BUSY_RX).
+ *
+ * On the RFA/RFR the PLL_LOCK flag is polled. On the SPI radios reading
+ * IRQ_STATUS would clear the other IRQs, the PLL_LOCK IRQ is enabled
+ * for the switch and the transceiver ISR reports it with
+ * @ref radio_chsw_irq, so the function must not be called with
+ * interrupts disabled there.
+ *
+ * @return 1 if the PLL locked (or TRX_OFF), 0 on a timeout or a
+ *         channel the transceiver does not support
+ */
+uint8_t radio_set_channel_fast(channel_t ch);
+
+/**
+ * @brief Copy the latency statistics of the fast channel switches.
+ * @param clear  restart them afterwards
+ */
+void radio_chsw_stats(radio_chsw_stats_t *st, bool clear);
+
+/** note a PLL_LOCK IRQ, called by the ISR of the SPI radios */
+void radio_chsw_irq(void);
+
+#if defined(RADIO_LINK)
+/**
+ * @brief Find or create the link record of a peer.
+ *
+ * The link functions are fed from the RX_END/TX_END interrupts
+ * and from radio_send_frame(), they must not be called from an
+ * application ISR.
+ */
+radio_link_t * radio_link_get(uint16_t addr);
+
+/** update the LQI/ED average of peer @c src */
+void radio_link_rx(uint16_t src, uint8_t lqi, int8_t ed);
+
+/** update the link record of @c dst with a TX_AUTO result */
+void radio_link_tx_done(uint16_t dst, radio_tx_done_t status);
+
+/** write TX power and CSMA/retry parameters for @c dst to the transceiver */
+void radio_link_apply(uint16_t dst);
+
+/**
+ * @brief Get the short destination (@c src = 0) or source (@c src = 1)
+ *        address of an IEEE 802.15.4 frame with PAN ID compression.
+ * @return 1 if found and not broadcast, 0 otherwise
+ */
+uint8_t radio_link_frame_addr(uint8_t *frm, uint8_t src, uint16_t *addr);
+#endif
+
+#if defined(RADIO_TXQUEUE)
+/**
+ * @brief Initialize the tx queue.
+ *
+ * Frames of the queue are sent back to back, the next one is started
+ * from the TX_END interrupt. With a callback set, usr_radio_tx_done()
+ * is not called anymore for any frame.
+ */
+void radio_txq_init(radio_txq_cb_t cb);
+
+/**
+ * @brief Copy a frame into the tx queue, class @ref RADIO_TXQ_NORMAL.
+ *
+ * @param len     frame length including the 2 FCS bytes
+ * @param frm     frame data
+ * @param state   STATE_TX or STATE_TXAUTO
+ * @param retries number of repetitions on TX_CCA_FAIL/TX_NO_ACK/TX_FAIL
+ * @return frame handle (0...255), -1 if the queue is full
+ */
+int16_t radio_txq_put(uint8_t len, uint8_t *frm, radio_state_t state,
+                      uint8_t retries);
+
+/**
+ * @brief Copy a frame into the tx queue with a priority class.
+ *
+ * When a frame is done, the oldest frame of the highest class goes
+ * next, frames of one class are sent in order. A frame that failed
+ * and is repeated lets the frames of higher classes go first. Bulk
+ * frames do not get the last @ref RADIO_TXQ_RESERVE slots, so a
+ * control frame finds a slot while a data stream fills the queue, and
+ * waits for at most one frame in the air.
+ *
+ * @param prio    @ref RADIO_TXQ_BULK, @ref RADIO_TXQ_NORMAL or
+ *                @ref RADIO_TXQ_CONTROL
+ * @return frame handle (0...255), -1 if no slot is free for the class
+ */
+int16_t radio_txq_put_prio(uint8_t len, uint8_t *frm, radio_state_t state,
+                           uint8_t retries, uint8_t prio);
+
+/**
+ * @brief Number of frames in the queue, including the active one.
+ */
+uint8_t radio_txq_pending(void);
+#endif
+
+#if defined(RADIO_LPL)
+/**
+ * @brief Start low power listening.
+ *
+ * The radio sleeps and wakes up every @c wake_ms for a receive window of
+ * @ref RADIO_LPL_LISTEN_MS in the idle state (STATE_RXAUTO). A frame
+ * received or sent keeps it on for @ref RADIO_LPL_HOLD_MS, so replies
+ * and data streams (OTA) go through at full speed. Needs one timer of
+ * the timer pool. Frames must be sent with @ref radio_lpl_send or
+ * @ref radio_txq_put meanwhile, radio_send_frame() would race with the
+ * wake up timer.
+ *
+ * @param wake_ms wake interval, the same for all nodes of the network
+ * @return 1 if started
+ */
+uint8_t radio_lpl_start(uint16_t wake_ms);
+
+/**
+ * @brief Stop low power listening, the radio is left in the idle state.
+ */
+void radio_lpl_stop(void);
+
+/**
+ * @brief Send a frame to a low power listening node.
+ *
+ * The frame is repeated back to back for one wake interval, so the
+ * receiver sees it in its next receive window. A frame with ACK request
+ * stops at the first ACK, a broadcast is repeated for the whole interval
+ * (receivers drop the copies, see @ref radio_lpl_duplicate).
+ *
+ * @param len frame length including the 2 FCS bytes
+ * @param frm frame data
+ * @return frame handle (0...255), -1 if the queue is full
+ */
+int16_t radio_lpl_send(uint8_t len, uint8_t *frm);
+
+/** note radio traffic, keeps the radio on (RX_END/TX_END context) */
+void radio_lpl_activity(void);
+
+/** returns true for another copy of the last broadcast received */
+bool radio_lpl_duplicate(uint8_t len, uint8_t *frm);
+#endif
+
+/**
+ * @brief Apply a PHY profile.
+ *
+ * The transceiver is left in TRX_OFF, set the state afterwards
+ * (radio_set_state()). Both ends of a link have to use the same data
+ * rate.
+ *
+ * @param idx profile index, 0 ... radio_phy_count()-1
+ * @return 1 if the profile was applied
+ */
+uint8_t radio_phy_set(uint8_t idx);
+
+/** @return index of the profile set last, @ref RADIO_PHY_NONE if none */
+uint8_t radio_phy_get(void);
+
+/** @return number of profiles of this radio */
+uint8_t radio_phy_count(void);
+
+/** @return name of a profile in program memory, NULL if out of range */
+const char * radio_phy_name_p(uint8_t idx);
+
+/** copy the settings of a profile, @return 0 if out of range */
+uint8_t radio_phy_read(uint8_t idx, radio_phy_profile_t *prof);
+
+#if defined(RADIO_CSMA)
+/** @brief Count a CCA result and its ED sample, used by the radio drivers. */
+void radio_csma_cca_done(radio_cca_t cca, uint8_t ed);
+
+/** @brief Count a TX_ARET frame in TX_END context, used by the radio drivers. */
+void radio_csma_aret_done(uint8_t trac);
+
+/**
+ * @brief Copy the CSMA statistics.
+ *
+ * @param st    destination
+ * @param clear reset the counters after the copy
+ */
+void radio_csma_stats(radio_csma_stats_t *st, bool clear);
+
+#if defined(TRX_IF_RFA1)
+/**
+ * @brief Send a frame with CSMA-CA in interrupt context.
+ *
+ * Unslotted CSMA-CA with MIN_BE, MAX_BE and MAX_CSMA_RETRES of the
+ * transceiver. The backoffs run on the MAC symbol counter and the CCA
+ * is interrupt driven, so the function returns at once. The radio is
+ * set to STATE_RX for the CCAs, the frame is sent in STATE_TX and
+ * usr_radio_tx_done() reports TX_OK or TX_CCA_FAIL.
+ *
+ * @param len frame length including the 2 FCS bytes
+ * @param frm frame data, must be kept until usr_radio_tx_done()
+ * @return 0 if started, -1 if a frame is still in CSMA
+ */
+int8_t radio_csma_send(uint8_t len, uint8_t *frm);
+
+/** @return true while a frame of radio_csma_send() waits for the channel */
+bool radio_csma_busy(void);
+#endif
+#endif
+
+#if defined(RADIO_DUPCHECK)
+/**
+ * @brief Check a received frame against the last one of its sender.
+ *
+ * Called in RX_END context before usr_radio_receive_frame(), a duplicate
+ * is dropped there. Only frames with ACK request and short addresses are
+ * checked, see @ref RADIO_DUP_ENTRIES.
+ *
+ * @param len frame length including the 2 FCS bytes
+ * @param frm frame data
+ * @return true if sender and sequence number are the same as before
+ */
+bool radio_dup_check(uint8_t len, uint8_t *frm);
+
+/** @brief Forget all senders, e.g. after a reset of the network. */
+void radio_dup_reset(void);
+#endif
+
+#if defined(RADIO_TSYNC)
+/**
+ * @brief Start the network time synchronisation.
+ *
+ * The nodes flood @ref P2P_TSYNC beacons and agree on the clock of the
+ * node with the lowest short address (the root). Each node keeps a
+ * linear regression of the global time over its own symbol counter,
+ * taken from the SFD time stamps of the beacons, so that the drift of
+ * the crystals is compensated between two beacons. A node which hears
+ * nothing from the root for @ref RADIO_TSYNC_ROOT_TIMEOUT beacon
+ * periods becomes root itself, its global time goes on from its last
+ * estimate. Call after radio_init(), which starts the symbol counter.
+ *
+ * @param pan_id PAN ID of the beacons
+ * @param short_addr own short address
+ */
+void radio_tsync_init(uint16_t pan_id, uint16_t short_addr);
+
+/**
+ * @brief Build the next beacon of this node.
+ *
+ * Call once per beacon period (some seconds) and send the frame without
+ * ACK request, with radio_send_frame() or the tx queue. A strobed LPL
+ * broadcast does not work, its receivers don't stamp the same copy as
+ * the sender. Only the root and synchronised nodes send beacons.
+ *
+ * @param frm buffer of at least @ref RADIO_TSYNC_BEACON_SIZE bytes
+ * @return frame length including the FCS, 0 if no beacon is due
+ */
+uint8_t radio_tsync_beacon(uint8_t *frm);
+
+/**
+ * @brief Take a received beacon, called in RX_END context.
+ *
+ * @param len frame length including the 2 FCS bytes
+ * @param frm frame data
+ * @param sfd local symbol counter value at the SFD of the frame
+ * @return true if the frame was a beacon, it is dropped then
+ */
+bool radio_tsync_rx(uint8_t len, uint8_t *frm, uint32_t sfd);
+
+/**
+ * @brief Note the global time of a beacon, called in TX_END context
+ * after a successful transmission.
+ *
+ * @param frm the transmitted frame
+ */
+void radio_tsync_tx_done(uint8_t *frm);
+
+/**
+ * @brief Convert a local symbol counter value to global time.
+ *
+ * @param local value of trx_tstamp_now() or trx_tstamp_sfd()
+ * @return global time in symbol ticks (@ref TRX_TSTAMP_SYMBOL_US)
+ */
+uint32_t radio_tsync_global(uint32_t local);
+
+/**
+ * @brief Convert global time to the local symbol counter, e.g. to wake
+ * up at a time agreed in the network.
+ */
+uint32_t radio_tsync_local(uint32_t global);
+
+/**
+ * @brief Synchronised clock in microseconds.
+ *
+ * The global symbol time times 16, the value wraps after 71 minutes
+ * the same way on all nodes.
+ */
+uint32_t radio_tsync_now_us(void);
+
+/** @return true if this node is root or has enough reference points */
+bool radio_tsync_synced(void);
+
+/** @return short address of the root, 0xffff while there is none */
+uint16_t radio_tsync_root(void);
+#endif
+
+#if defined(RADIO_TDMA)
+/**
+ * @brief Start the TDMA schedule.
+ *
+ * The superframe of @ref RADIO_TDMA_SLOTS slots is laid over the global
+ * time of radio_tsync_global(), so all nodes agree on the slot
+ * boundaries. The coordinator sends the slot owners in slot 0, a node
+ * sends its frames of radio_tdma_send() in its own slots without CSMA.
+ * The last slot is the contention slot for everything else: slot
+ * requests, time sync beacons and other frames. Slots which stay unused
+ * for @ref RADIO_TDMA_IDLE superframes go back to the free list. The
+ * compare unit 2 of the symbol counter marks the slots.
+ *
+ * @param pan_id PAN ID of the schedule
+ * @param short_addr own short address
+ * @param coord short address of the coordinator, the own one makes
+ *        this node the coordinator
+ */
+void radio_tdma_init(uint16_t pan_id, uint16_t short_addr, uint16_t coord);
+
+/**
+ * @brief Build a slot request to the coordinator.
+ *
+ * Send it like any other frame, in the contention slot (see
+ * radio_tdma_contention()). The next schedule tells what was granted.
+ *
+ * @param frm buffer of at least @ref RADIO_TDMA_REQUEST_SIZE bytes
+ * @param nslots slots wanted in total, 0 gives all slots back
+ * @return frame length including the FCS
+ */
+uint8_t radio_tdma_request(uint8_t *frm, uint8_t nslots);
+
+/**
+ * @brief Send a frame in the next own slot.
+ *
+ * The frame goes out in STATE_TX, without CSMA and without ACK, the
+ * buffer must stay valid until usr_radio_tx_done() is called.
+ *
+ * @param len frame length including the FCS
+ * @param frm frame data
+ * @return 0 if queued, -1 if a frame is pending or the node has no slot
+ */
+int8_t radio_tdma_send(uint8_t len, uint8_t *frm);
+
+/** @return true while a frame of radio_tdma_send() waits for its slot */
+bool radio_tdma_busy(void);
+
+/** @return number of slots this node owns */
+uint8_t radio_tdma_slots(void);
+
+/** @return true during the contention slot, or if there is no schedule */
+bool radio_tdma_contention(void);
+
+/**
+ * @brief Take a received frame, called in RX_END context.
+ *
+ * The coordinator notes the use of the slots from the SFD time @p sfd.
+ *
+ * @return true if the frame was a schedule or request, it is dropped then
+ */
+bool radio_tdma_rx(uint8_t len, uint8_t *frm, uint32_t sfd);
+
+/**
+ * @brief Called in TX_END context after a frame in STATE_TX.
+ *
+ * @return true if it was the schedule of the coordinator, the
+ *         application is not told about it
+ */
+bool radio_tdma_tx_done(void);
+#endif
+
+#if defined(RADIO_INDIRECT)
+/**
+ * @brief Build a MAC data request command to poll the parent.
+ *
+ * A sleeping child sends it with ACK request. If the parent has frames
+ * queued for it, the ACK has the frame pending bit set and
+ * usr_radio_tx_done() reports TX_DATA_PENDING (a tx queue callback sees
+ * TRAC_SUCCESS_DATA_PENDING), the child stays in receive state then
+ * until the frames arrived.
+ *
+ * @param frm buffer of at least @ref RADIO_DATA_REQUEST_SIZE bytes
+ * @param seq sequence number
+ * @param pan_id PAN ID
+ * @param parent short address of the parent
+ * @param src short address of the child
+ * @return frame length, including the FCS
+ */
+uint8_t radio_indirect_request(uint8_t *frm, uint8_t seq, uint16_t pan_id,
+                               uint16_t parent, uint16_t src);
+
+#if defined(RADIO_TXQUEUE)
+/**
+ * @brief Queue a frame on the parent until its child polls.
+ *
+ * While frames are queued, the ACK of each data request has the frame
+ * pending bit set (AACK_SET_PD). Frames not polled within
+ * @ref RADIO_INDIRECT_TTL seconds are dropped.
+ *
+ * @param dst short address of the child
+ * @param len frame length including the 2 FCS bytes
+ * @param frm frame data, copied
+ * @return 1 if queued, 0 if all slots are in use
+ */
+uint8_t radio_indirect_put(uint16_t dst, uint8_t len, uint8_t *frm);
+
+/** @return number of frames queued for the child @c dst */
+uint8_t radio_indirect_pending(uint16_t dst);
+
+/**
+ * @brief Send the frames of the children that polled, expire old ones.
+ *
+ * Call it from the main loop, the frames go out through the tx queue.
+ */
+void radio_indirect_task(void);
+
+/** check a received frame for a data request (RX_END context) */
+void radio_indirect_rx(uint8_t len, uint8_t *frm);
+#endif
+#endif
+
+#if defined(RADIO_TXQUEUE)
+/**
+ * @brief Copy a frame into the tx queue, to be sent several times.
+ *
+ * In STATE_TXAUTO the frame is repeated until it is acknowledged, up to
+ * @c n times, in STATE_TX it is sent @c n + 1 times regardless.
+ *
+ * @return frame handle (0...255), -1 if the queue is full
+ */
+int16_t radio_txq_strobe(uint8_t len, uint8_t *frm, radio_state_t state,
+                         uint8_t n);
+#endif
+
+#if defined(RADIO_RXPOOL)
+/**
+ * @brief Initialize the receive buffer pool.
+ *
+ * The RX_END ISR takes a free buffer from the pool, reads the frame
+ * directly into it and appends it to the queue of received frames,
+ * usr_radio_receive_frame() is not called in this mode. If no buffer
+ * is free, the frame is dropped and usr_radio_error(RXPOOL_EMPTY)
+ * is called. With phyRxProtect it is held in the frame buffer instead,
+ * see @ref radio_rx_held.
+ *
+ * @param pmem   memory block for the pool, see @ref RADIO_RXPOOL_MEMSZ
+ * @param memsz  size of @c pmem in bytes
+ */
+void radio_rxpool_init(uint8_t *pmem, size_t memsz);
+
+/**
+ * @brief Get the oldest received frame.
+ *
+ * @return buffer with meta data (@ref RADIO_RXMETA) and frame,
+ *         or NULL if no frame is pending.
+ */
+buffer_t * radio_rxpool_get(void);
+
+/**
+ * @brief Return a buffer obtained by @ref radio_rxpool_get to the pool.
+ */
+void radio_rxpool_release(buffer_t *pbuf);
+
+/**
+ * @brief A received frame waits in the protected frame buffer.
+ *
+ * With phyRxProtect a frame for which no pool buffer was free is
+ * not dropped. It stays in the frame buffer and the transceiver
+ * receives nothing else, so the senders repeat their frames. It is
+ * taken by @ref radio_rxpool_release or @ref radio_rx_drain. If
+ * there is still no buffer at the next radio_set_state() or
+ * radio_send_frame(), which need the frame buffer, it is dropped.
+ */
+bool radio_rx_held(void);
+
+/**
+ * @brief Take a held frame into the pool, if there is a free buffer.
+ */
+void radio_rx_drain(void);
+#endif
+
 
 #ifdef __cplusplus
 } /* extern "C" */
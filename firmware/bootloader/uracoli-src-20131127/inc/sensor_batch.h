@@ -0,0 +1,122 @@
+/* Copyright (c) 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Delta encoded batches of sensor samples.
+ *
+ * Sensor values change little from one sample to the next, so instead
+ * of one raw reading per frame, a @ref P2P_SENSOR_BATCH frame carries
+ * a time series of rows, each row holding one value of every channel.
+ *
+ * Row format, a varint is 7 bits per byte, LSB first, bit 7 set in
+ * all but the last byte:
+ *
+ * - varint time: the sample time of the first row (low word of
+ *   timer_systime()), and the difference to the previous row in all
+ *   further rows
+ * - per channel p2p_sensor_batch_t::nchan times, a varint of the
+ *   zigzag mapped difference (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...)
+ *   to the value of the previous row, or to 0 in the first row
+ *
+ * A row of slowly changing values and a constant period takes one
+ * byte per channel plus one or two bytes for the time.
+ * The decoder for the host is sniffer/sensorbatch.py.
+ */
+#ifndef SENSOR_BATCH_H
+#define SENSOR_BATCH_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include "p2p_protocol.h"
+
+/* === macros ============================================================== */
+#ifndef SENSOR_BATCH_MAX_CHAN
+/** largest number of channels per row */
+# define SENSOR_BATCH_MAX_CHAN (8)
+#endif
+
+/* === types =============================================================== */
+/** Encoder state of one batch frame. */
+typedef struct
+{
+    p2p_sensor_batch_t *frm;            /**< the frame being filled */
+    uint8_t maxlen;                     /**< size of the frame buffer */
+    uint8_t len;                        /**< current frame length */
+    uint8_t rows;                       /**< number of rows in the frame */
+    uint16_t time;                      /**< time of the last row */
+    int16_t last[SENSOR_BATCH_MAX_CHAN]; /**< values of the last row */
+} sensor_batch_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Start a new batch frame.
+     *
+     * Only the command code of the header is set, the addressing
+     * fields are left to the application.
+     *
+     * @param b      encoder state
+     * @param frm    frame buffer
+     * @param maxlen size of the frame buffer, excluding the CRC bytes
+     * @param nchan  number of values per row,
+     *               see @ref SENSOR_BATCH_MAX_CHAN
+     * @return 0 if the parameters are invalid, otherwise 1
+     */
+    uint8_t sensor_batch_init(sensor_batch_t *b, p2p_sensor_batch_t *frm,
+                              uint8_t maxlen, uint8_t nchan);
+
+    /**
+     * @brief Append one row of samples.
+     * @param b      encoder state
+     * @param time   sample time, low word of timer_systime()
+     * @param values nchan values
+     * @return 0 if the row does not fit the frame any more, the
+     *         frame is left unchanged then, otherwise 1
+     */
+    uint8_t sensor_batch_add(sensor_batch_t *b, uint16_t time,
+                             const int16_t *values);
+
+    /**
+     * @brief Length of the frame, excluding the CRC bytes, or 0 if
+     *        the frame has no row yet.
+     */
+    static inline uint8_t sensor_batch_len(sensor_batch_t *b)
+    {
+        return (b->rows != 0) ? b->len : 0;
+    }
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  /* #ifndef SENSOR_BATCH_H */
@@ -0,0 +1,147 @@
+/* Copyright (c) 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Batched sampling of I2C sensors.
+ *
+ * The scheduler reads all registered sensor channels in one burst of
+ * queued asynchronous I2C transactions per period, and stores the
+ * results as compact records in a byte ring. From there, the
+ * application packs as many records as fit into one
+ * @ref P2P_SENSOR_DATA frame.
+ *
+ * Record format, as copied by sensor_sched_pack():
+ *
+ * - 1 byte total length of the record, including this byte
+ * - 2 bytes sample time, low word of timer_systime(), little endian
+ * - per channel, that was read successfully:
+ *   - 1 byte (id << 3) | len, with id 0 ... 31 and len 1 ... 7
+ *   - len bytes of raw sensor data, as delivered by the device
+ */
+#ifndef SENSOR_SCHED_H
+#define SENSOR_SCHED_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include "i2c.h"
+#include "timer.h"
+#include "p2p_protocol.h"
+
+/* === macros ============================================================== */
+#ifndef SENSOR_SCHED_RING_SIZE
+/** size of the sample ring in bytes, a power of 2, up to 128 */
+# define SENSOR_SCHED_RING_SIZE (128)
+#endif
+
+/** largest number of data bytes of one channel */
+#define SENSOR_CHAN_MAX_LEN (7)
+
+/** largest channel id */
+#define SENSOR_CHAN_MAX_ID (31)
+
+/** header byte of a channel inside a record */
+#define SENSOR_CHAN_HDR(id, len) ((uint8_t)(((id) << 3) | ((len) & 7)))
+
+/* === types =============================================================== */
+/**
+ * One sensor value, read with a register write and a data read
+ * after a repeated start. The structure is owned by the application.
+ */
+typedef struct sensor_chan_tag
+{
+    i2c_xfer_t xfer;                    /**< the read transaction, private */
+    uint8_t reg;                        /**< register or command byte */
+    uint8_t id;                         /**< channel id within a record */
+    uint8_t value[SENSOR_CHAN_MAX_LEN]; /**< last value read */
+    struct sensor_chan_tag *next;       /**< channel list, private */
+} sensor_chan_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+    /**
+     * @brief Register a sensor channel.
+     *
+     * @param ch      caller owned channel structure
+     * @param id      channel id, see @ref SENSOR_CHAN_MAX_ID
+     * @param devaddr 7 bit I2C address of the device
+     * @param reg     register or command byte, written before the read
+     * @param len     number of bytes to read,
+     *                see @ref SENSOR_CHAN_MAX_LEN
+     * @return 0 if the parameters are invalid, otherwise 1
+     */
+    uint8_t sensor_sched_add(sensor_chan_t *ch, uint8_t id, uint8_t devaddr,
+                             uint8_t reg, uint8_t len);
+
+    /**
+     * @brief Start periodic sampling of the registered channels.
+     * @param period sample period in timer ticks
+     * @return 0 if no timer was available, otherwise 1
+     */
+    uint8_t sensor_sched_start(time_t period);
+
+    /** @brief Stop periodic sampling. */
+    void sensor_sched_stop(void);
+
+    /** @brief Number of record bytes waiting in the ring. */
+    uint8_t sensor_sched_available(void);
+
+    /** @brief Number of records lost, because the ring was full. */
+    uint8_t sensor_sched_overruns(void);
+
+    /**
+     * @brief Move whole records from the ring into a buffer.
+     * @param buf    destination, e.g. p2p_sensor_data_t::data
+     * @param maxlen size of the destination buffer
+     * @return number of bytes copied
+     */
+    uint8_t sensor_sched_pack(uint8_t *buf, uint8_t maxlen);
+
+    /**
+     * @brief Fill a @ref P2P_SENSOR_DATA frame with pending records.
+     *
+     * Only the command code of the header is set, the addressing
+     * fields are left to the application.
+     *
+     * @param frm    frame buffer
+     * @param maxlen size of the frame buffer,
+     *               excluding the CRC bytes
+     * @return frame length, excluding the CRC bytes,
+     *         or 0 if no record was pending
+     */
+    uint8_t sensor_sched_frame(p2p_sensor_data_t *frm, uint8_t maxlen);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  /* #ifndef SENSOR_SCHED_H */
@@ -0,0 +1,92 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Stack high-water mark and free SRAM of an application.
+ *
+ * The first call of stack_watch_get() links stack_watch.c, which fills
+ * the SRAM from the end of .bss (__heap_start) up to STACK_WATCH_TOP
+ * with STACK_WATCH_PAINT from .init3, before .data and .bss are set up.
+ * The stack overwrites the pattern as it grows, the lowest byte which
+ * lost it is the deepest the stack has been since the reset. The
+ * applications of uracoli build the query with stackwatch=1
+ * (STACK_WATCH): the command "stack" of wibohost, the line "STACK:" of
+ * the sniffer command "parms".
+ *
+ * STACK_WATCH_TOP defaults to 256 bytes below RAMEND, the boot info
+ * record, the node config and the radio handoff of the bootloader lie
+ * above it and stay intact for the application to read. A peak of 256 or
+ * less therefore means "did not reach STACK_WATCH_TOP". The malloc()
+ * heap is not accounted, none of the uracoli applications use it, a
+ * heap would show as stack.
+ */
+#ifndef STACK_WATCH_H
+#define STACK_WATCH_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+
+/* === macros ============================================================== */
+/** @addtogroup grpIoUtil
+ *  @{
+ */
+#define STACK_WATCH_PAINT (0xC5)
+
+#if !defined(STACK_WATCH_TOP)
+/** first byte above the painted SRAM */
+# define STACK_WATCH_TOP (RAMEND - 0xFF)
+#endif
+
+/* === types =============================================================== */
+/** SRAM use in bytes */
+typedef struct
+{
+    uint16_t data;   /**< .data and .bss, RAMSTART to __heap_start */
+    uint16_t peak;   /**< deepest stack since reset, RAMEND down */
+    uint16_t unused; /**< painted bytes never touched by the stack */
+    uint16_t free;   /**< __heap_start to the stack pointer now */
+} stack_watch_t;
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** measure the SRAM use, scans the unused bytes from below */
+void stack_watch_get(stack_watch_t *st);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/** @} */
+#endif  /* #ifndef STACK_WATCH_H */
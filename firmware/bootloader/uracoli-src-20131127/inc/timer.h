@@ -97,6 +97,47 @@ typedef time_t (timer_handler_t)(timer_arg_t p);
 /** Symbolic name for invalid timer handle */
 #define NONE_TIMER (0)
 
+/** Largest number of timers in a timer pool */
+#define TIMER_POOL_MAX (254)
+
+/**
+ * Data type for timer pool entries. The members are private
+ * to the timer module, the type is only public so that
+ * @ref TIMER_POOL_DEFINE() can size the pool.
+ */
+typedef struct timer_tag
+{
+    /** reference number of the timer */
+    timer_hdl_t hdl;
+    /** value, when the timer expires in wheel ticks */
+    time_t expire;
+    /** pointer to a timer handler function */
+    timer_handler_t *func;
+    /** pointer to a argument, which is given to the
+     * timer handler function */
+    timer_arg_t arg;
+    /** pointer to the next timer in the same wheel slot
+     *  (or in the free list).
+     */
+    struct timer_tag * next;
+    /** pointer to the link, which points to this timer,
+     *  NULL if the timer is not queued.
+     */
+    struct timer_tag ** pprev;
+} timer_entry_t;
+
+/**
+ * Define the timer pool of an application with n timers
+ * (1 ... @ref TIMER_POOL_MAX), overriding the TIMER_POOL_SIZE
+ * default of the board. The macro has to be used once, at file
+ * scope of one source file of the application; the default pool
+ * is then not linked in.
+ */
+#define TIMER_POOL_DEFINE(n) \
+    typedef char timer_pool_size_check[((n) >= 1 && (n) <= TIMER_POOL_MAX) ? 1 : -1]; \
+    timer_entry_t timer_pool[(n)]; \
+    const uint8_t timer_pool_size = (n)
+
 /* === Prototypes ================================ */
 /**
  * @brief Initialization of the timer module
@@ -154,6 +195,17 @@ timer_hdl_t timer_restart(timer_hdl_t th, time_t duration);
  */
 timer_hdl_t timer_stop(timer_hdl_t th);
 
+/**
+ * @brief Run the handler functions of expired timers.
+ *
+ * If the library is built with TIMER_DEFERRED_CALLBACKS, the timer
+ * ISR only marks expired timers as pending, and their handlers are
+ * run from this function, which needs to be called from the main
+ * loop. Otherwise the handlers are run from the ISR and this function
+ * does nothing, so applications may call it in either case.
+ */
+void timer_task(void);
+
 /**
  * @brief Return the current system time in ticks.
  */
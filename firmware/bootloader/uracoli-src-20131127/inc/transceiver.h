@@ -94,6 +94,15 @@
  */
 typedef void (*trx_irq_handler_t)(uint8_t cause);
 
+/** Entry of a register sequence, see @ref trx_reg_seq */
+typedef struct
+{
+    trx_regaddr_t addr;  /**< register address */
+    trx_regval_t  mask;  /**< bits to modify, 0xff writes the register
+                              without reading it first */
+    trx_regval_t  value; /**< new value of the bits in @c mask */
+} trx_regseq_t;
+
 typedef enum
 {
    CFG_FLASH,
@@ -110,6 +119,15 @@ typedef enum
 /** trx pll check function failed (PLL_LOCK coult not be observed in PLL_ON) */
 #define TRX_PLL_FAIL  (2)
 
+/** register sequence entry that writes a whole register */
+#define TRX_REGSEQ_REG(addr, val) {(addr), 0xff, (val)}
+/** helper for @ref TRX_REGSEQ_SR, expands the SR_* triple */
+#define TRX_REGSEQ_SUBREG(addr, mask, pos, val) \
+            {(addr), (mask), (((val) << (pos)) & (mask))}
+/** register sequence entry that modifies a sub register, e.g.
+ *  TRX_REGSEQ_SR(SR_TX_AUTO_CRC_ON, 1) */
+#define TRX_REGSEQ_SR(sr, val) TRX_REGSEQ_SUBREG(sr, val)
+
 #define INVALID_PART_NUM (2)  /**< flag for invalid part number */
 #define INVALID_REV_NUM  (1)  /**< flag for invalid revision number */
 
@@ -228,6 +246,40 @@ void trx_io_init (uint8_t spirate);
  */
 void trx_set_irq_handler(trx_irq_handler_t irqhandler);
 
+#if defined(TRX_IF_RFA1) && !defined(DOXYGEN)
+/*
+ * The transceiver registers of the RFA1/RFR2 are memory mapped, so the
+ * register layer is inlined here instead of trx_rfa.c. With constant
+ * arguments (RG_*, SR_*) a subregister access folds to one lds/sts or
+ * lds/andi/ori/sts, the registers are above the sbi/cbi range.
+ * always_inline, because libradio is built with -fno-inline.
+ */
+#define TRX_REG(addr) (*(volatile uint8_t*)(TRX_REGISTER_BASEADDR + (addr)))
+
+static inline __attribute__((always_inline))
+void trx_reg_write(trx_regaddr_t addr, trx_regval_t val)
+{
+    TRX_REG(addr) = val;
+}
+
+static inline __attribute__((always_inline))
+uint8_t trx_reg_read(trx_regaddr_t addr)
+{
+    return TRX_REG(addr);
+}
+
+static inline __attribute__((always_inline))
+trx_regval_t trx_bit_read(trx_regaddr_t addr, trx_regval_t mask, uint8_t pos)
+{
+    return (TRX_REG(addr) & mask) >> pos;
+}
+
+static inline __attribute__((always_inline))
+void trx_bit_write(trx_regaddr_t addr, trx_regval_t mask, uint8_t pos, trx_regval_t value)
+{
+    TRX_REG(addr) = (TRX_REG(addr) & ~mask) | ((value << pos) & mask);
+}
+#else
 /**
  * @brief Write Register
  *
@@ -284,6 +336,21 @@ trx_regval_t trx_bit_read(trx_regaddr_t addr, trx_regval_t mask, uint8_t pos);
  *
  */
 void trx_bit_write(trx_regaddr_t addr, trx_regval_t mask, uint8_t pos, trx_regval_t value);
+#endif /* defined(TRX_IF_RFA1) */
+
+/**
+ * @brief Apply a register sequence stored in flash
+ *
+ * The entries are applied in one run with interrupts locked and
+ * inline SPI transfers, instead of one trx_reg_write/trx_bit_write call
+ * per register. Entries with a mask other than 0xff are done as
+ * read-modify-write. The transceiver needs a /SEL cycle per register
+ * access, so the chip select is still toggled for each entry.
+ *
+ * @param seq pointer to a PROGMEM array of @ref trx_regseq_t
+ * @param n   number of entries
+ */
+void trx_reg_seq(const trx_regseq_t *seq, uint8_t n);
 
 /**
  * @brief Frame Write
@@ -358,6 +425,19 @@ uint8_t trx_frame_read_data_crc(uint8_t *data, uint8_t datasz, uint8_t *lqi, boo
 
 uint8_t trx_frame_get_length(void);
 
+/**
+ * @brief Read the start of a received frame
+ *
+ * Reads the frame length and at most @c n bytes from the start of the
+ * PSDU, the frame buffer access is ended there. A receive filter can
+ * look at the MAC header without the transfer of the whole frame.
+ *
+ * @retval data buffer for min(n, length) bytes
+ * @param  n maximum number of bytes
+ * @return length of the frame, including the FCS
+ */
+uint8_t trx_frame_read_head(uint8_t *data, uint8_t n);
+
 /**
  * @brief Write SRAM
  *
@@ -380,6 +460,71 @@ void trx_sram_write(trx_ramaddr_t addr, uint8_t length, uint8_t *data);
  */
 void trx_sram_read(trx_ramaddr_t addr, uint8_t length, uint8_t *data);
 
+#if defined(TRX_IF_RFA1)
+/** duration of one tick of the MAC symbol counter in microseconds */
+#define TRX_TSTAMP_SYMBOL_US (16)
+/** number of symbol counter ticks per second */
+#define TRX_TSTAMP_SYMBOLS_PER_SEC (62500UL)
+
+/**
+ * @brief Start the MAC symbol counter with automatic SFD time stamping.
+ *
+ * The counter runs from the 16MHz crystal (16us per tick), with
+ * SCTSE set the hardware captures the counter value at the SFD of
+ * each received frame and at the SFD of each transmitted frame.
+ */
+void trx_tstamp_init(void);
+
+/** current value of the symbol counter */
+uint32_t trx_tstamp_now(void);
+
+/**
+ * @brief Symbol counter value captured at the SFD of the last frame.
+ *
+ * Valid from RX_START until the next frame starts, and after TX_END
+ * for the transmitted frame.
+ */
+uint32_t trx_tstamp_sfd(void);
+
+/** block size of the AES engine */
+#define TRX_AES_BLOCKSIZE (16)
+
+/**
+ * @brief Load a 128 bit key into the AES engine.
+ *
+ * The decryption key is derived here, so this function has to be called
+ * once before any other trx_aes_* function.
+ */
+void trx_aes_setkey(const uint8_t *key);
+
+/**
+ * @brief Encrypt one block in place (ECB).
+ * @return 0 on success, 1 if the engine reported an error
+ */
+uint8_t trx_aes_ecb_encrypt(uint8_t *blk);
+
+/**
+ * @brief Decrypt one block in place (ECB).
+ * @return 0 on success, 1 if the engine reported an error
+ */
+uint8_t trx_aes_ecb_decrypt(uint8_t *blk);
+
+/**
+ * @brief Encrypt @c nblocks blocks in place (CBC).
+ *
+ * @param iv initial vector, updated with the last cipher block,
+ *           so consecutive calls continue the chain.
+ */
+uint8_t trx_aes_cbc_encrypt(uint8_t *data, uint8_t nblocks, uint8_t *iv);
+
+/**
+ * @brief Decrypt @c nblocks blocks in place (CBC).
+ *
+ * @param iv initial vector, updated with the last cipher block.
+ */
+uint8_t trx_aes_cbc_decrypt(uint8_t *data, uint8_t nblocks, uint8_t *iv);
+#endif
+
 /**
  * @brief Get static transceiver parameters
  *
@@ -430,6 +575,15 @@ uint8_t trx_get_datarate(void);
  */
 uint8_t trx_get_number_datarates(void);
 
+/**
+ * @brief return the hash code of a supported data rate.
+ *
+ * @param  idx Index of the data rate, 0 ... trx_get_number_datarates()-1.
+ * @return hash code, e.g. @ref OQPSK250, or @ref RATE_NONE if @c idx
+ *         is out of range.
+ */
+uint8_t trx_get_datarate_hash(uint8_t idx);
+
 /**
  * @brief return a pointer to a datarate string in the programm
  *        memory.
@@ -0,0 +1,197 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Service table of the bootloader for applications
+ *
+ * SPM only works from the bootloader section. A bootloader built with
+ * WIBO_FLAVOUR_APPSPM exports flash and EEPROM services in a table at
+ * the fixed address WIBO_SVC_ADDR:
+ *
+ *  - 2 byte magic WIBO_SVC_MAGIC
+ *  - 2 byte ABI version, major in the high byte
+ *  - one 4 byte jmp per entry, WIBO_SVC_SPM_SLOT ...
+ *
+ * Entries are only appended, a new minor version keeps the old ones.
+ * Check wibo_svc_available() before the first call.
+ *
+ * The calls run with interrupts off, the vectors of the application can
+ * not be read while a page is erased or written (about 4-9ms each).
+ * The services only use the stack of the caller, the RAM of the
+ * bootloader belongs to the application meanwhile.
+ *
+ * @ingroup grpAppWiBo
+ */
+#ifndef WIBOSVC_H
+#define WIBOSVC_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#define WIBO_SVC_MAGIC   (0x5357)  /**< "WS" */
+#define WIBO_SVC_VERSION (0x0101)  /**< ABI version 1.1 */
+
+/** byte address of the table, the last flash page */
+#ifndef WIBO_SVC_ADDR
+# define WIBO_SVC_ADDR ((uint32_t) FLASHEND + 1 - SPM_PAGESIZE)
+#endif
+
+/* === table entries ======================================================= */
+/** uint8_t (uint32_t addr, uint8_t *buf): program a page of the staging
+ *  slot (WIBO_FLAVOUR_SLOTS), addr is the physical address */
+#define WIBO_SVC_SPM_SLOT   (0)
+/** uint8_t (uint32_t addr): erase a page of the application section */
+#define WIBO_SVC_PAGE_ERASE (1)
+/** uint8_t (uint32_t addr, uint8_t *buf): erase and program a page of
+ *  the application section */
+#define WIBO_SVC_PAGE_WRITE (2)
+/** uint16_t (uint32_t addr, uint32_t len): CRC CCITT (start 0) of flash */
+#define WIBO_SVC_CRC        (3)
+/** uint8_t (uint16_t addr, const uint8_t *buf, uint8_t len): update
+ *  EEPROM bytes, waits until they are written */
+#define WIBO_SVC_EE_WRITE   (4)
+/** uint8_t (uint32_t len, uint16_t crc, const uint8_t *mac): check the
+ *  staged image like @ref P2P_WIBO_COMMIT and set the boot pointer,
+ *  since 1.1. It uses the AES engine, set the key of the application
+ *  again afterwards. */
+#define WIBO_SVC_COMMIT     (5)
+
+/** return codes */
+#define WIBO_SVC_OK       (0)
+#define WIBO_SVC_REJECTED (1)  /**< address not page aligned or out of range */
+#define WIBO_SVC_BAD_CRC  (2)  /**< staged image does not match length and CRC */
+#define WIBO_SVC_BAD_MAC  (3)  /**< MAC of the staged image is wrong */
+
+/** word address of an entry, as used for calls */
+#define WIBO_SVC_ENTRY(n) ((WIBO_SVC_ADDR + 4 + 4UL * (n)) / 2)
+
+/*
+ * Indirect calls use EIND for the address bits above 128K, interrupts
+ * are off meanwhile, so no ISR calls through a wrong EIND.
+ */
+#if defined(EIND)
+# define WIBO_SVC_CALL(rv, n, type, ...) \
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) \
+    { \
+        uint8_t eind_ = EIND; \
+        EIND = (uint8_t) (WIBO_SVC_ENTRY(n) >> 16); \
+        rv = ((type) (uint16_t) WIBO_SVC_ENTRY(n))(__VA_ARGS__); \
+        EIND = eind_; \
+    }
+#else
+# define WIBO_SVC_CALL(rv, n, type, ...) \
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) \
+    { \
+        rv = ((type) (uint16_t) WIBO_SVC_ENTRY(n))(__VA_ARGS__); \
+    }
+#endif
+
+#if FLASHEND > 0xffffL
+# define WIBO_SVC_READ_WORD(a) pgm_read_word_far(a)
+#else
+# define WIBO_SVC_READ_WORD(a) pgm_read_word(a)
+#endif
+
+/* === application side ==================================================== */
+#if !defined(WIBO_SVC_PROVIDER)
+
+/**
+ * @brief Check that the bootloader exports a compatible table
+ * @return 1 if the magic matches and the major version is the same
+ */
+static inline uint8_t wibo_svc_available(void)
+{
+    return (WIBO_SVC_MAGIC == WIBO_SVC_READ_WORD(WIBO_SVC_ADDR))
+        && ((WIBO_SVC_VERSION >> 8)
+            == (WIBO_SVC_READ_WORD(WIBO_SVC_ADDR + 2) >> 8));
+}
+
+/** @return ABI version of the bootloader */
+static inline uint16_t wibo_svc_version(void)
+{
+    return WIBO_SVC_READ_WORD(WIBO_SVC_ADDR + 2);
+}
+
+static inline uint8_t wibo_svc_spm_slot(uint32_t addr, uint8_t *buf)
+{
+    uint8_t rv;
+    WIBO_SVC_CALL(rv, WIBO_SVC_SPM_SLOT, uint8_t (*)(uint32_t, uint8_t *),
+                  addr, buf);
+    return rv;
+}
+
+static inline uint8_t wibo_svc_page_erase(uint32_t addr)
+{
+    uint8_t rv;
+    WIBO_SVC_CALL(rv, WIBO_SVC_PAGE_ERASE, uint8_t (*)(uint32_t), addr);
+    return rv;
+}
+
+static inline uint8_t wibo_svc_page_write(uint32_t addr, uint8_t *buf)
+{
+    uint8_t rv;
+    WIBO_SVC_CALL(rv, WIBO_SVC_PAGE_WRITE, uint8_t (*)(uint32_t, uint8_t *),
+                  addr, buf);
+    return rv;
+}
+
+static inline uint16_t wibo_svc_crc(uint32_t addr, uint32_t len)
+{
+    uint16_t rv;
+    WIBO_SVC_CALL(rv, WIBO_SVC_CRC, uint16_t (*)(uint32_t, uint32_t),
+                  addr, len);
+    return rv;
+}
+
+static inline uint8_t wibo_svc_ee_write(uint16_t addr, const uint8_t *buf,
+                                        uint8_t len)
+{
+    uint8_t rv;
+    WIBO_SVC_CALL(rv, WIBO_SVC_EE_WRITE,
+                  uint8_t (*)(uint16_t, const uint8_t *, uint8_t),
+                  addr, buf, len);
+    return rv;
+}
+
+static inline uint8_t wibo_svc_commit(uint32_t len, uint16_t crc,
+                                      const uint8_t *mac)
+{
+    uint8_t rv;
+    WIBO_SVC_CALL(rv, WIBO_SVC_COMMIT,
+                  uint8_t (*)(uint32_t, uint16_t, const uint8_t *),
+                  len, crc, mac);
+    return rv;
+}
+
+#endif /* !defined(WIBO_SVC_PROVIDER) */
+
+#endif /* WIBOSVC_H */
@@ -0,0 +1,434 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @addtogroup grpAppRndis
+ * @{
+ *
+ * @file
+ * @brief USB Ethernet gateway to the 802.15.4 network, see rndis.h
+ *
+ * Host to radio: the IPv6 header of the frame from the host is
+ * compressed in place in the Ethernet buffer, the p2p header (or the
+ * P2P_FRAG header of each fragment) is written in front of the data
+ * and the radio sends from there.
+ *
+ * Radio to host: the radio receives into a ring of frame buffers, the
+ * ISR hands the next free one to the radio. The main loop expands
+ * IPHC frames, and messages reassembled from P2P_FRAG frames, into the
+ * Ethernet buffer to the host.
+ *
+ * Other Ethertypes than IPv6 are dropped. Frames to the radio are sent
+ * one after the other, with ACK request and the retries of TX_ARET for
+ * unicasts.
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "p2p.h"
+#include "rndis.h"
+
+/* === macros ============================================================== */
+#if !defined(P2P_IPHC)
+# error "the gateway needs the radio library built with iphc=1"
+#endif
+
+#ifndef RNDIS_RX_SLOTS
+/** receive buffers, the one of p2p_init() comes on top */
+# define RNDIS_RX_SLOTS (4)
+#endif
+/** entries of the buffer rings, more than all buffers */
+#define RX_RING_SIZE (8)
+#define RX_RING_MASK (RX_RING_SIZE - 1)
+#if RNDIS_RX_SLOTS + 1 >= RX_RING_SIZE
+# error "RNDIS_RX_SLOTS too large for RX_RING_SIZE"
+#endif
+
+#define ICMP6_NH    (58)
+#define ICMP6_NS    (135)
+#define ICMP6_NA    (136)
+/** ICMPv6 NA with target link layer address option */
+#define ND_NA_SIZE  (32)
+
+/* === types =============================================================== */
+/* the P2P_FRAG header of the first fragment replaces the Ethernet header */
+typedef char rndis_headroom_check[(sizeof(p2p_frag_t) <= RNDIS_ETH_HDR) ? 1 : -1];
+
+/* === globals ============================================================= */
+static uint8_t RxBuf[RNDIS_RX_SLOTS][MAX_FRAME_SIZE];
+/** received frames, written by the ISR */
+static uint8_t *RxFull[RX_RING_SIZE];
+static uint8_t RxFullLen[RX_RING_SIZE];
+static volatile uint8_t RxFullHead, RxFullTail;
+/** free buffers, written by the main loop */
+static uint8_t *RxFree[RX_RING_SIZE];
+static volatile uint8_t RxFreeHead, RxFreeTail;
+
+static p2p_reasm_t Reasm;
+static uint8_t ReasmBuf[RNDIS_FRAME_SIZE - RNDIS_ETH_HDR];
+
+static volatile bool TxPending;
+static volatile radio_tx_done_t TxStatus;
+/** id of the next fragmented message */
+static uint8_t MsgId;
+
+static uint16_t OwnAddr;
+/** the MAC address of the host interface */
+static uint8_t HostMac[6];
+
+static const uint8_t PROGMEM iid16[6] = {0, 0, 0, 0xff, 0xfe, 0};
+
+/* === functions =========================================================== */
+/** MAC address of a radio node, 02:00:00:00:XX:XX */
+static void gw_node_mac(uint8_t *mac, uint16_t addr)
+{
+    mac[0] = 0x02;
+    mac[1] = 0;
+    mac[2] = 0;
+    mac[3] = 0;
+    mac[4] = addr >> 8;
+    mac[5] = addr & 0xff;
+}
+
+static uint32_t gw_sum(uint32_t sum, const uint8_t *p, uint16_t n)
+{
+    while (n > 1)
+    {
+        sum += ((uint16_t)p[0] << 8) | p[1];
+        p += 2;
+        n -= 2;
+    }
+    if (n)
+    {
+        sum += (uint16_t)p[0] << 8;
+    }
+    return sum;
+}
+
+/**
+ * Send a frame and wait for its end.
+ * @return true if sent (and acknowledged)
+ */
+static bool gw_send(uint16_t dst, uint8_t cmd, uint8_t *frm, uint8_t len)
+{
+    TxPending = true;
+    p2p_send(dst, cmd, (dst == 0xffff) ? 0 : P2P_ACK, frm, len);
+    while (TxPending)
+    {
+        /* TX_END */
+    }
+    return TxStatus == TX_OK;
+}
+
+/**
+ * Send a compressed datagram as P2P_FRAG message. The header of a
+ * fragment goes over the end of the one before, which is sent already.
+ */
+static void gw_send_msg(uint16_t dst, uint8_t *msg, uint16_t len)
+{
+p2p_frag_t *pfrag;
+uint8_t idx, cnt, dlen;
+
+    cnt = (len + P2P_FRAG_PAYLOAD - 1) / P2P_FRAG_PAYLOAD;
+    if (cnt > P2P_FRAG_MAX_CNT)
+    {
+        return;
+    }
+    MsgId++;
+    for (idx = 0; idx < cnt; idx++)
+    {
+        dlen = (len > P2P_FRAG_PAYLOAD) ? P2P_FRAG_PAYLOAD : len;
+        pfrag = (p2p_frag_t *)(msg - sizeof(p2p_frag_t));
+        pfrag->cmd = P2P_IPHC_DATA;
+        pfrag->msgid = MsgId;
+        pfrag->idx = idx;
+        pfrag->cnt = cnt;
+        if (!gw_send(dst, P2P_FRAG, (uint8_t *)pfrag,
+                     sizeof(p2p_frag_t) + dlen))
+        {
+            /* the receiver drops the message anyway */
+            return;
+        }
+        msg += dlen;
+        len -= dlen;
+    }
+}
+
+/**
+ * Answer a neighbour solicitation of the host for a radio node.
+ * @return true if the frame is consumed
+ */
+static bool gw_nd_proxy(const uint8_t *eth, uint16_t len)
+{
+const uint8_t *ip = eth + RNDIS_ETH_HDR;
+const uint8_t *target = ip + P2P_IPHC_IPV6_HDR + 8;
+uint8_t *out, *na;
+uint32_t sum;
+uint16_t addr;
+uint8_t i;
+
+    if ((len < RNDIS_ETH_HDR + P2P_IPHC_IPV6_HDR + 24) ||
+        (ip[6] != ICMP6_NH) || (ip[P2P_IPHC_IPV6_HDR] != ICMP6_NS) ||
+        (memcmp_P(target + 8, iid16, sizeof(iid16)) != 0))
+    {
+        return false;
+    }
+    addr = ((uint16_t)target[14] << 8) | target[15];
+    if (addr == OwnAddr)
+    {
+        return false;
+    }
+    for (i = 0; (i < 16) && (ip[8 + i] == 0); i++)
+    {
+    }
+    if (i == 16)
+    {
+        /* duplicate address detection of the host, not for the air */
+        return true;
+    }
+    out = rndis_usb_tx_frame();
+    if (out == NULL)
+    {
+        /* the host asks again */
+        return true;
+    }
+
+    memcpy(out, eth + 6, 6);
+    gw_node_mac(out + 6, addr);
+    out[12] = RNDIS_ETH_IPV6 >> 8;
+    out[13] = RNDIS_ETH_IPV6 & 0xff;
+
+    memset(out + RNDIS_ETH_HDR, 0, P2P_IPHC_IPV6_HDR + ND_NA_SIZE);
+    out[RNDIS_ETH_HDR] = 0x60;
+    out[RNDIS_ETH_HDR + 5] = ND_NA_SIZE;
+    out[RNDIS_ETH_HDR + 6] = ICMP6_NH;
+    out[RNDIS_ETH_HDR + 7] = 255;
+    memcpy(out + RNDIS_ETH_HDR + 8, target, 16);
+    memcpy(out + RNDIS_ETH_HDR + 24, ip + 8, 16);
+
+    na = out + RNDIS_ETH_HDR + P2P_IPHC_IPV6_HDR;
+    na[0] = ICMP6_NA;
+    na[4] = 0x60;           /* solicited, override */
+    memcpy(na + 8, target, 16);
+    na[24] = 2;             /* target link layer address */
+    na[25] = 1;
+    gw_node_mac(na + 26, addr);
+
+    sum = gw_sum(ND_NA_SIZE + ICMP6_NH, out + RNDIS_ETH_HDR + 8, 32);
+    sum = gw_sum(sum, na, ND_NA_SIZE);
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    sum = ~sum;
+    na[2] = sum >> 8;
+    na[3] = sum;
+
+    rndis_usb_tx_send(RNDIS_ETH_HDR + P2P_IPHC_IPV6_HDR + ND_NA_SIZE);
+    return true;
+}
+
+/** forward a frame of the host to the radio */
+static void gw_host_to_radio(void)
+{
+uint8_t *eth, *ip;
+uint16_t len, dst;
+int16_t clen;
+
+    eth = rndis_usb_rx_frame(&len);
+    if (eth == NULL)
+    {
+        return;
+    }
+    ip = eth + RNDIS_ETH_HDR;
+    if ((len < RNDIS_ETH_HDR + P2P_IPHC_IPV6_HDR) ||
+        (eth[12] != (RNDIS_ETH_IPV6 >> 8)) ||
+        (eth[13] != (RNDIS_ETH_IPV6 & 0xff)) ||
+        gw_nd_proxy(eth, len))
+    {
+        rndis_usb_rx_done();
+        return;
+    }
+    if ((eth[0] == 0x33) && (eth[1] == 0x33))
+    {
+        dst = 0xffff;
+    }
+    else if ((eth[0] == 0x02) && (eth[1] == 0) && (eth[2] == 0) && (eth[3] == 0))
+    {
+        dst = ((uint16_t)eth[4] << 8) | eth[5];
+    }
+    else
+    {
+        rndis_usb_rx_done();
+        return;
+    }
+
+    clen = p2p_iphc_compress(ip, len - RNDIS_ETH_HDR, OwnAddr, dst);
+    if (clen > 0)
+    {
+        LED_TOGGLE(0);
+        if (clen <= (int16_t)(MAX_FRAME_SIZE - 2 - sizeof(p2p_hdr_t)))
+        {
+            gw_send(dst, P2P_IPHC_DATA, ip - sizeof(p2p_hdr_t),
+                    sizeof(p2p_hdr_t) + clen);
+        }
+        else
+        {
+            gw_send_msg(dst, ip, clen);
+        }
+    }
+    rndis_usb_rx_done();
+}
+
+/** forward a received frame to the host */
+static void gw_radio_to_host(void)
+{
+uint8_t *frm, *out, *ip;
+p2p_hdr_t *hdr;
+uint8_t len;
+uint16_t n;
+int16_t iplen = -1;
+
+    if ((RxFullTail == RxFullHead) || ((out = rndis_usb_tx_frame()) == NULL))
+    {
+        /* frames wait in the ring until the host took the last one */
+        return;
+    }
+    frm = RxFull[RxFullTail];
+    len = RxFullLen[RxFullTail];
+    hdr = (p2p_hdr_t *) frm;
+    ip = out + RNDIS_ETH_HDR;
+
+    if (hdr->cmd == P2P_IPHC_DATA)
+    {
+        iplen = p2p_iphc_decompress(frm + sizeof(p2p_hdr_t),
+                                    len - sizeof(p2p_hdr_t), hdr->src,
+                                    hdr->dst, ip,
+                                    RNDIS_FRAME_SIZE - RNDIS_ETH_HDR);
+    }
+    else if (hdr->cmd == P2P_FRAG)
+    {
+        n = p2p_frag_receive(&Reasm, frm, len);
+        if ((n > 0) && (Reasm.cmd == P2P_IPHC_DATA))
+        {
+            iplen = p2p_iphc_decompress(ReasmBuf, n, Reasm.src, OwnAddr, ip,
+                                        RNDIS_FRAME_SIZE - RNDIS_ETH_HDR);
+        }
+    }
+
+    if (iplen > 0)
+    {
+        LED_TOGGLE(1);
+        if (ip[24] == 0xff)
+        {
+            /* 33:33 and the last 32 bits of the group */
+            out[0] = 0x33;
+            out[1] = 0x33;
+            memcpy(out + 2, ip + 36, 4);
+        }
+        else
+        {
+            memcpy(out, HostMac, sizeof(HostMac));
+        }
+        gw_node_mac(out + 6, hdr->src);
+        out[12] = RNDIS_ETH_IPV6 >> 8;
+        out[13] = RNDIS_ETH_IPV6 & 0xff;
+        rndis_usb_tx_send(RNDIS_ETH_HDR + iplen);
+    }
+
+    /* the buffer is free again */
+    RxFullTail = (RxFullTail + 1) & RX_RING_MASK;
+    RxFree[RxFreeHead] = frm;
+    RxFreeHead = (RxFreeHead + 1) & RX_RING_MASK;
+}
+
+int main(void)
+{
+uint8_t i;
+
+    LED_INIT();
+    LED_SET_VALUE(0);
+    p2p_init();
+    OwnAddr = p2p_get_config()->short_addr;
+    gw_node_mac(HostMac, OwnAddr);
+    for (i = 0; i < RNDIS_RX_SLOTS; i++)
+    {
+        RxFree[RxFreeHead++] = RxBuf[i];
+    }
+    p2p_frag_init(&Reasm, ReasmBuf, sizeof(ReasmBuf));
+
+    radio_set_param(RP_IDLESTATE(STATE_RXAUTO));
+    radio_set_state(STATE_RXAUTO);
+    rndis_usb_init(HostMac);
+    sei();
+
+    for(;;)
+    {
+        rndis_usb_task();
+        gw_host_to_radio();
+        gw_radio_to_host();
+    }
+}
+
+/**
+ * Implementation of callback function @ref usr_radio_tx_done.
+ */
+void usr_radio_tx_done(radio_tx_done_t status)
+{
+    TxStatus = status;
+    TxPending = false;
+}
+
+/**
+ * The frame goes into the ring, the radio gets the next free buffer.
+ * @copydoc usr_radio_receive_frame
+ */
+uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi,
+                                  int8_t ed, uint8_t crc_fail)
+{
+uint8_t *next;
+
+    if (crc_fail || (len < sizeof(p2p_hdr_t) + 2) ||
+        (RxFreeTail == RxFreeHead))
+    {
+        return frm;
+    }
+    RxFull[RxFullHead] = frm;
+    RxFullLen[RxFullHead] = len - 2;
+    RxFullHead = (RxFullHead + 1) & RX_RING_MASK;
+    next = RxFree[RxFreeTail];
+    RxFreeTail = (RxFreeTail + 1) & RX_RING_MASK;
+    return next;
+}
+
+/** @} */
+/* EOF */
@@ -0,0 +1,99 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Interface of the USB Ethernet gateway
+ *
+ * The gateway is a USB network interface (RNDIS, the LUFA class driver)
+ * to the 802.15.4 network. IPv6 datagrams go through unchanged, with
+ * the header compressed for the air by p2p_iphc.c. rndis.c bridges the
+ * frames, rndis_usb.c holds the LUFA side, so neither needs the headers
+ * of the other.
+ *
+ * Each radio node appears on the Ethernet side with the MAC address
+ * 02:00:00:00:XX:XX of its short address XXXX. The host interface has
+ * the one of the gateway. Its EUI-64 interface identifier is then
+ * 0000:00ff:fe00:XXXX, which IPHC elides, so link local traffic costs
+ * only a few header bytes per frame. The gateway answers the neighbour
+ * solicitations of the host for such addresses itself.
+ */
+#ifndef RNDIS_H
+#define RNDIS_H
+
+/* === includes ============================================================ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* === macros ============================================================== */
+/** largest Ethernet frame, without FCS */
+#define RNDIS_FRAME_SIZE  (1500)
+/** bytes of the Ethernet header */
+#define RNDIS_ETH_HDR     (14)
+/** ethertype of IPv6 */
+#define RNDIS_ETH_IPV6    (0x86DD)
+
+/* === prototypes ========================================================== */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start the USB device, the host sees the interface with @c mac.
+ */
+void rndis_usb_init(const uint8_t *mac);
+
+/** run the USB device and the RNDIS class driver, call it from the main loop */
+void rndis_usb_task(void);
+
+/**
+ * @brief Frame from the host.
+ * @param len returns the length of the Ethernet frame
+ * @return the frame, NULL if none is there; it stays until
+ *         rndis_usb_rx_done()
+ */
+uint8_t *rndis_usb_rx_frame(uint16_t *len);
+
+/** give the frame of rndis_usb_rx_frame() back to the driver */
+void rndis_usb_rx_done(void);
+
+/**
+ * @brief Buffer for the next frame to the host.
+ * @return RNDIS_FRAME_SIZE bytes, NULL while the last frame is not sent
+ */
+uint8_t *rndis_usb_tx_frame(void);
+
+/** send the frame of rndis_usb_tx_frame() to the host */
+void rndis_usb_tx_send(uint16_t len);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif  /* #ifndef RNDIS_H */
@@ -0,0 +1,301 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief USB side of the gateway: descriptors and the LUFA RNDIS driver
+ *
+ * The frames are the FrameIN and FrameOUT buffers of the class driver,
+ * rndis.c works on them in place.
+ *
+ * @ingroup grpAppRndis
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include <avr/power.h>
+#include <avr/pgmspace.h>
+#include <LUFA/Drivers/USB/USB.h>
+#include <LUFA/Drivers/USB/Class/RNDIS.h>
+
+#include "const.h"
+#include "rndis.h"
+
+/* === macros ============================================================== */
+#define RNDIS_NOTIFICATION_EPNUM  (2)
+#define RNDIS_TX_EPNUM            (3)
+#define RNDIS_RX_EPNUM            (4)
+#define RNDIS_NOTIFICATION_EPSIZE (8)
+#define RNDIS_TXRX_EPSIZE         (64)
+
+#if RNDIS_FRAME_SIZE != ETHERNET_FRAME_SIZE_MAX
+# error "RNDIS_FRAME_SIZE does not match the LUFA frame buffers"
+#endif
+
+/* === types =============================================================== */
+typedef struct
+{
+    USB_Descriptor_Configuration_Header_t Config;
+    USB_Descriptor_Interface_t            CCI_Interface;
+    CDC_FUNCTIONAL_DESCRIPTOR(2)          Functional_Header;
+    CDC_FUNCTIONAL_DESCRIPTOR(1)          Functional_ACM;
+    CDC_FUNCTIONAL_DESCRIPTOR(2)          Functional_Union;
+    USB_Descriptor_Endpoint_t             NotificationEndpoint;
+    USB_Descriptor_Interface_t            DCI_Interface;
+    USB_Descriptor_Endpoint_t             DataOutEndpoint;
+    USB_Descriptor_Endpoint_t             DataInEndpoint;
+} rndis_config_descriptor_t;
+
+/* === globals ============================================================= */
+static const USB_Descriptor_Device_t PROGMEM DeviceDescriptor =
+{
+    .Header                 = {.Size = sizeof(USB_Descriptor_Device_t), .Type = DTYPE_Device},
+    .USBSpecification       = VERSION_BCD(01.10),
+    .Class                  = 0x02,
+    .SubClass               = 0x00,
+    .Protocol               = 0x00,
+    .Endpoint0Size          = FIXED_CONTROL_ENDPOINT_SIZE,
+    .VendorID               = URACOLI_USB_VID,
+    .ProductID              = URACOLI_USB_PID,
+    .ReleaseNumber          = URACOLI_USB_BCD_RELEASE,
+    .ManufacturerStrIndex   = 0x01,
+    .ProductStrIndex        = 0x02,
+    .SerialNumStrIndex      = USE_INTERNAL_SERIAL,
+    .NumberOfConfigurations = FIXED_NUM_CONFIGURATIONS
+};
+
+static const rndis_config_descriptor_t PROGMEM ConfigurationDescriptor =
+{
+    .Config =
+    {
+        .Header                 = {.Size = sizeof(USB_Descriptor_Configuration_Header_t), .Type = DTYPE_Configuration},
+        .TotalConfigurationSize = sizeof(rndis_config_descriptor_t),
+        .TotalInterfaces        = 2,
+        .ConfigurationNumber    = 1,
+        .ConfigurationStrIndex  = NO_DESCRIPTOR,
+        .ConfigAttributes       = USB_CONFIG_ATTR_BUSPOWERED,
+        .MaxPowerConsumption    = USB_CONFIG_POWER_MA(100)
+    },
+    /* CDC ACM with the vendor specific protocol, which is RNDIS */
+    .CCI_Interface =
+    {
+        .Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+        .InterfaceNumber        = 0,
+        .AlternateSetting       = 0,
+        .TotalEndpoints         = 1,
+        .Class                  = 0x02,
+        .SubClass               = 0x02,
+        .Protocol               = 0xFF,
+        .InterfaceStrIndex      = NO_DESCRIPTOR
+    },
+    .Functional_Header =
+    {
+        .Header                 = {.Size = sizeof(CDC_FUNCTIONAL_DESCRIPTOR(2)), .Type = 0x24},
+        .SubType                = 0x00,
+        .Data                   = {0x10, 0x01}
+    },
+    .Functional_ACM =
+    {
+        .Header                 = {.Size = sizeof(CDC_FUNCTIONAL_DESCRIPTOR(1)), .Type = 0x24},
+        .SubType                = 0x02,
+        .Data                   = {0x00}
+    },
+    .Functional_Union =
+    {
+        .Header                 = {.Size = sizeof(CDC_FUNCTIONAL_DESCRIPTOR(2)), .Type = 0x24},
+        .SubType                = 0x06,
+        .Data                   = {0x00, 0x01}
+    },
+    .NotificationEndpoint =
+    {
+        .Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+        .EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_IN | RNDIS_NOTIFICATION_EPNUM),
+        .Attributes             = (EP_TYPE_INTERRUPT | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+        .EndpointSize           = RNDIS_NOTIFICATION_EPSIZE,
+        .PollingIntervalMS      = 0xFF
+    },
+    .DCI_Interface =
+    {
+        .Header                 = {.Size = sizeof(USB_Descriptor_Interface_t), .Type = DTYPE_Interface},
+        .InterfaceNumber        = 1,
+        .AlternateSetting       = 0,
+        .TotalEndpoints         = 2,
+        .Class                  = 0x0A,
+        .SubClass               = 0x00,
+        .Protocol               = 0x00,
+        .InterfaceStrIndex      = NO_DESCRIPTOR
+    },
+    .DataOutEndpoint =
+    {
+        .Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+        .EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_OUT | RNDIS_RX_EPNUM),
+        .Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+        .EndpointSize           = RNDIS_TXRX_EPSIZE,
+        .PollingIntervalMS      = 0x01
+    },
+    .DataInEndpoint =
+    {
+        .Header                 = {.Size = sizeof(USB_Descriptor_Endpoint_t), .Type = DTYPE_Endpoint},
+        .EndpointAddress        = (ENDPOINT_DESCRIPTOR_DIR_IN | RNDIS_TX_EPNUM),
+        .Attributes             = (EP_TYPE_BULK | ENDPOINT_ATTR_NO_SYNC | ENDPOINT_USAGE_DATA),
+        .EndpointSize           = RNDIS_TXRX_EPSIZE,
+        .PollingIntervalMS      = 0x01
+    }
+};
+
+static const USB_Descriptor_String_t PROGMEM LanguageString =
+{
+    .Header                 = {.Size = USB_STRING_LEN(1), .Type = DTYPE_String},
+    .UnicodeString          = {LANGUAGE_ID_ENG}
+};
+
+static const USB_Descriptor_String_t PROGMEM ManufacturerString =
+{
+    .Header                 = {.Size = USB_STRING_LEN(7), .Type = DTYPE_String},
+    .UnicodeString          = URACOLI_USB_VENDOR_NAME
+};
+
+static const USB_Descriptor_String_t PROGMEM ProductString =
+{
+    .Header                 = {.Size = USB_STRING_LEN(13), .Type = DTYPE_String},
+    .UnicodeString          = L"RNDIS Gateway"
+};
+
+/** the class driver, the MAC address is set by rndis_usb_init() */
+static USB_ClassInfo_RNDIS_Device_t Gateway_RNDIS =
+{
+    .Config =
+    {
+        .ControlInterfaceNumber         = 0,
+        .DataINEndpointNumber           = RNDIS_TX_EPNUM,
+        .DataINEndpointSize             = RNDIS_TXRX_EPSIZE,
+        .DataINEndpointDoubleBank       = true,
+        .DataOUTEndpointNumber          = RNDIS_RX_EPNUM,
+        .DataOUTEndpointSize            = RNDIS_TXRX_EPSIZE,
+        .DataOUTEndpointDoubleBank      = true,
+        .NotificationEndpointNumber     = RNDIS_NOTIFICATION_EPNUM,
+        .NotificationEndpointSize       = RNDIS_NOTIFICATION_EPSIZE,
+        .NotificationEndpointDoubleBank = false,
+        .AdapterVendorDescription       = "uracoli 802.15.4 gateway",
+    },
+};
+
+/* === functions =========================================================== */
+void rndis_usb_init(const uint8_t *mac)
+{
+    /* Config is const for the class driver, it is set once before
+     * the device attaches */
+    memcpy((void *)&Gateway_RNDIS.Config.AdapterMACAddress, mac,
+           sizeof(MAC_Address_t));
+    clock_prescale_set(clock_div_1);
+    USB_Init();
+}
+
+void rndis_usb_task(void)
+{
+    RNDIS_Device_USBTask(&Gateway_RNDIS);
+    USB_USBTask();
+}
+
+uint8_t *rndis_usb_rx_frame(uint16_t *len)
+{
+    if (!Gateway_RNDIS.State.FrameIN.FrameInBuffer)
+    {
+        return NULL;
+    }
+    *len = Gateway_RNDIS.State.FrameIN.FrameLength;
+    return Gateway_RNDIS.State.FrameIN.FrameData;
+}
+
+void rndis_usb_rx_done(void)
+{
+    Gateway_RNDIS.State.FrameIN.FrameInBuffer = false;
+}
+
+uint8_t *rndis_usb_tx_frame(void)
+{
+    if ((USB_DeviceState != DEVICE_STATE_Configured) ||
+        Gateway_RNDIS.State.FrameOUT.FrameInBuffer)
+    {
+        return NULL;
+    }
+    return Gateway_RNDIS.State.FrameOUT.FrameData;
+}
+
+void rndis_usb_tx_send(uint16_t len)
+{
+    Gateway_RNDIS.State.FrameOUT.FrameLength = len;
+    Gateway_RNDIS.State.FrameOUT.FrameInBuffer = true;
+}
+
+void EVENT_USB_Device_ConfigurationChanged(void)
+{
+    RNDIS_Device_ConfigureEndpoints(&Gateway_RNDIS);
+}
+
+void EVENT_USB_Device_UnhandledControlRequest(void)
+{
+    RNDIS_Device_ProcessControlRequest(&Gateway_RNDIS);
+}
+
+uint16_t CALLBACK_USB_GetDescriptor(const uint16_t wValue,
+                                    const uint8_t wIndex,
+                                    void** const DescriptorAddress)
+{
+void *addr = NULL;
+uint16_t size = NO_DESCRIPTOR;
+
+    switch (wValue >> 8)
+    {
+        case DTYPE_Device:
+            addr = (void *) &DeviceDescriptor;
+            size = sizeof(USB_Descriptor_Device_t);
+            break;
+        case DTYPE_Configuration:
+            addr = (void *) &ConfigurationDescriptor;
+            size = sizeof(rndis_config_descriptor_t);
+            break;
+        case DTYPE_String:
+            switch (wValue & 0xff)
+            {
+                case 0x00: addr = (void *) &LanguageString; break;
+                case 0x01: addr = (void *) &ManufacturerString; break;
+                case 0x02: addr = (void *) &ProductString; break;
+            }
+            if (addr != NULL)
+            {
+                size = pgm_read_byte(&((USB_Descriptor_String_t *) addr)->Header.Size);
+            }
+            break;
+    }
+    *DescriptorAddress = addr;
+    return size;
+}
+
+/* EOF */
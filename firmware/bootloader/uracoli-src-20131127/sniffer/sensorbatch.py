@@ -0,0 +1,118 @@
+#   Copyright (c) 2013 Axel Wachtler
+#   All rights reserved.
+#
+#   Redistribution and use in source and binary forms, with or without
+#   modification, are permitted provided that the following conditions
+#   are met:
+#
+#   * Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+#   * Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#   * Neither the name of the authors nor the names of its contributors
+#     may be used to endorse or promote products derived from this software
+#     without specific prior written permission.
+#
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+#   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+#   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+#   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+#   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+#   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+#   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+#   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+#   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+#   POSSIBILITY OF SUCH DAMAGE.
+
+# $Id$
+##
+# @file
+# @brief decoder for P2P_SENSOR_BATCH frames
+#
+"""
+sensorbatch.py - decode the delta encoded P2P_SENSOR_BATCH frames
+
+Usage:
+ python sensorbatch.py [OPTIONS] [FILE]
+
+ Reads one frame per line as hex bytes (e.g. "62 0a 00 ..." or
+ "620a00..."), starting with the p2p command code, and prints one line
+ per sample row: time value value ... The format is described in
+ inc/sensor_batch.h.
+
+Options:
+ -H LEN  length of the p2p header in front of the command code,
+         i.e. skip LEN bytes of each line (default: 0)
+ -h      show this help
+"""
+import sys, getopt
+
+P2P_SENSOR_BATCH = 0x62
+
+def varint(data, pos):
+    """ returns (value, next position) """
+    v = shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("truncated varint at %d" % pos)
+        b = data[pos]
+        pos += 1
+        v |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, pos
+
+def to_s16(v):
+    v &= 0xffff
+    return v - 0x10000 if v & 0x8000 else v
+
+def decode(data):
+    """ payload after the command code: nchan, rows
+        returns a list of (time, [values]) """
+    data = bytearray(data)
+    nchan = data[0]
+    pos, rows = 1, []
+    t, last = 0, [0] * nchan
+    while pos < len(data):
+        dt, pos = varint(data, pos)
+        t = dt if not rows else (t + dt) & 0xffff
+        for i in range(nchan):
+            z, pos = varint(data, pos)
+            last[i] = to_s16(last[i] + ((z >> 1) ^ -(z & 1)))
+        rows.append((t, list(last)))
+    return rows
+
+def decode_frame(frm):
+    """ frame starting with the command code """
+    frm = bytearray(frm)
+    if frm[0] != P2P_SENSOR_BATCH:
+        raise ValueError("not a P2P_SENSOR_BATCH frame: 0x%02x" % frm[0])
+    return decode(frm[1:])
+
+if __name__ == "__main__":
+    hdrlen = 0
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "H:h")
+        for o, v in opts:
+            if o == "-H":
+                hdrlen = int(v, 0)
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+
+    f = open(args[0]) if args else sys.stdin
+    for ln in f:
+        ln = "".join(ln.split())
+        if not ln:
+            continue
+        try:
+            for t, values in decode_frame(bytearray.fromhex(ln)[hdrlen:]):
+                print t, " ".join(map(str, values))
+        except ValueError, e:
+            print "#", e
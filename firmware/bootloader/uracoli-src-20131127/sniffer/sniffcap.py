@@ -0,0 +1,497 @@
+#   Copyright (c) 2013 Axel Wachtler
+#   All rights reserved.
+#
+#   Redistribution and use in source and binary forms, with or without
+#   modification, are permitted provided that the following conditions
+#   are met:
+#
+#   * Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+#   * Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#   * Neither the name of the authors nor the names of its contributors
+#     may be used to endorse or promote products derived from this software
+#     without specific prior written permission.
+#
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+#   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+#   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+#   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+#   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+#   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+#   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+#   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+#   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+#   POSSIBILITY OF SUCH DAMAGE.
+
+# $Id$
+##
+# @file
+# @brief capture daemon for the framed sniffer records
+#
+"""
+sniffcap.py - write the frames of a uracoli sniffer to a PCAP-NG file
+
+Usage:
+ python sniffcap.py [OPTIONS]
+
+Options:
+ -h
+    show this help message
+ -p PORT
+    serial port of the sniffer, default /dev/ttyUSB0
+ -b BAUDRATE
+    baudrate, default 38400
+ -c CHANNEL
+    channel to be captured, default is the current channel of the sniffer
+ -o FILE
+    output file or named pipe, "-" for stdout, default "capture.pcapng"
+ -f "FIELD VALUE"
+    capture filter clause of the firmware, may be given more than once,
+    FIELD is one of pan, src, dst, type (bit mask of frame types) or cmd
+ -s SNAPLEN
+    capture only the first SNAPLEN bytes of each frame
+ -S PERIOD
+    statistics mode, prints the per node counters of the sniffer every
+    PERIOD ms instead of capturing frames
+ -E PERIOD
+    spectrum mode, the sniffer samples the ED of the channels of its
+    channel mask as fast as it can and prints min, average, 50/90/99
+    percentiles and max of each channel every PERIOD ms, in dBm with
+    an ED offset of -90 dBm (AT86RF231 -91, AT86RF212 -98); with -o,
+    the rows are appended to that file as CSV
+ -l LINKTYPE
+    "tap" (default) writes LINKTYPE_IEEE802_15_4_TAP with a channel tag
+    for each frame, "fcs" writes plain LINKTYPE_IEEE802_15_4_WITHFCS
+ -r CHANNELS:SECONDS
+    change the channel every SECONDS during the capture, e.g. -r 11,15,20:5;
+    the changes are sent as binary control records (SNIFF_REC_CTRL), the
+    capture is not interrupted
+ -C
+    capture to flash, for bursts faster than the serial line: the sniffer
+    writes the frames to its flash, from the first frame passing the -t
+    clauses on or at once without -t, and the script exits. Boards with
+    more than 64K flash and a bootloader with WIBO_FLAVOUR_APPSPM only
+ -t "FIELD VALUE"
+    trigger clause of -C, like -f, may be given more than once
+ -U
+    upload the frames captured with -C to the output file, they are
+    removed from the flash afterwards
+
+The sniffer is switched to the framed record format ("framed 1"), see
+SNIFF_REC_* in sniffer/sniffer.h. Corrupted records are skipped, lost
+records are detected by the sequence number, and the drop counters of
+the firmware are written as PCAP-NG interface statistics.
+
+Live capture with wireshark and p2p-wireshark-dissector.lua:
+ mkfifo /tmp/sniff
+ wireshark -X lua_script:p2p-wireshark-dissector.lua -k -i /tmp/sniff &
+ python sniffcap.py -p /dev/ttyUSB0 -c 17 -o /tmp/sniff
+"""
+
+import serial, sys, time, getopt, struct
+
+# record format, see sniffer.h
+REC_SOF = 0x01
+REC_EOF = 0x04
+REC_PACKET = 0x50
+REC_SNAP = 0x53
+REC_STATS = 0x4e
+STATS_HDR_FMT = "<BBH"
+STATS_ENTRY_FMT = "<HLLHB"
+STATS_REC_LAST = 0x01
+REC_SPECTRUM = 0x45
+SPEC_HDR_FMT = "<BBH"
+SPEC_ENTRY_FMT = "<BBBBBBB"
+SPEC_ED_BASE = -90
+REC_INFO = 0x49
+REC_CTRL = 0x43
+REC_ACK = 0x41
+CTRL_CHAN = 0x01
+CTRL_FILTER = 0x02
+CTRL_STATE = 0x03
+CTRL_CHKCRC = 0x04
+CTRL_CAPTURE = 0x05
+CTRL_STATUS = {0: "ok", 1: "invalid"}
+REC_HDR_LEN = 5
+REC_TAIL_LEN = 3
+REC_CRC_INIT = 0xffff
+REC_INFO_FMT = "<BBLHHH"
+REC_INFO_FMT_V2 = "<BBLHHHH"
+TSTAMP_LEN = 8
+MAX_FRAME_SIZE = 127
+
+# pcapng constants
+LINKTYPE_IEEE802_15_4_WITHFCS = 195
+LINKTYPE_IEEE802_15_4_TAP = 283
+TAP_TLV_FCS_TYPE = 0
+TAP_TLV_CHANNEL = 3
+TAP_FCS_16BIT = 1
+BT_SHB = 0x0A0D0D0A
+BT_IDB = 0x00000001
+BT_ISB = 0x00000005
+BT_EPB = 0x00000006
+OPT_ENDOFOPT = 0
+OPT_IF_NAME = 2
+OPT_IF_TSRESOL = 9
+OPT_ISB_IFRECV = 4
+OPT_ISB_IFDROP = 5
+
+def crc_ccitt_update(crc, data):
+    """ same as _crc_ccitt_update() of avr-libc """
+    data ^= crc & 0xff
+    data ^= (data << 4) & 0xff
+    return (((data << 8) | (crc >> 8)) ^ (data >> 4) ^ (data << 3)) & 0xffff
+
+def pad4(data):
+    return data + b"\0" * (-len(data) % 4)
+
+def option(code, value):
+    return struct.pack("<HH", code, len(value)) + pad4(value)
+
+class PcapNgWriter:
+    """ minimal PCAP-NG writer, one interface with microsecond stamps """
+
+    def __init__(self, fd, linktype, ifname):
+        self.fd = fd
+        self.linktype = linktype
+        opts = option(OPT_IF_NAME, ifname.encode("ascii")) + \
+               option(OPT_IF_TSRESOL, b"\x06") + \
+               option(OPT_ENDOFOPT, b"")
+        self.block(BT_SHB, struct.pack("<LHHq", 0x1A2B3C4D, 1, 0, -1))
+        self.block(BT_IDB, struct.pack("<HHL", linktype, 0, 0xffff) + opts)
+
+    def block(self, btype, body):
+        blen = 12 + len(pad4(body))
+        self.fd.write(struct.pack("<LL", btype, blen) + pad4(body) +
+                      struct.pack("<L", blen))
+        self.fd.flush()
+
+    def packet(self, tstamp, channel, frame, origlen=None):
+        if origlen is None:
+            origlen = len(frame)
+        if self.linktype == LINKTYPE_IEEE802_15_4_TAP:
+            tlvs = struct.pack("<HHB", TAP_TLV_FCS_TYPE, 1, TAP_FCS_16BIT)
+            tlvs = pad4(tlvs)
+            tlvs += pad4(struct.pack("<HHHB", TAP_TLV_CHANNEL, 3, channel, 0))
+            data = struct.pack("<BBH", 0, 0, 4 + len(tlvs)) + tlvs + frame
+        else:
+            data = frame
+        origlen += len(data) - len(frame)
+        thi, tlo = tstamp >> 32, tstamp & 0xffffffff
+        self.block(BT_EPB, struct.pack("<LLLLL", 0, thi, tlo, len(data),
+                                       origlen) + pad4(data))
+
+    def stats(self, tstamp, received, dropped):
+        thi, tlo = tstamp >> 32, tstamp & 0xffffffff
+        opts = option(OPT_ISB_IFRECV, struct.pack("<Q", received)) + \
+               option(OPT_ISB_IFDROP, struct.pack("<Q", dropped)) + \
+               option(OPT_ENDOFOPT, b"")
+        self.block(BT_ISB, struct.pack("<LLL", 0, thi, tlo) + opts)
+
+class RecordReader:
+    """ splits the serial byte stream into checked records """
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.seq = None
+        self.lost = 0
+        self.bad = 0
+
+    def feed(self, data):
+        self.buf += bytearray(data)
+
+    def records(self):
+        buf = self.buf
+        while True:
+            start = buf.find(bytearray([REC_SOF]))
+            if start < 0:
+                # text output of the sniffer
+                del buf[:]
+                return
+            del buf[:start]
+            if len(buf) < REC_HDR_LEN:
+                return
+            if buf[1] not in (REC_PACKET, REC_SNAP, REC_INFO, REC_STATS,
+                              REC_SPECTRUM, REC_ACK) or \
+               (buf[1] not in (REC_STATS, REC_SPECTRUM) and
+                buf[2] > TSTAMP_LEN + MAX_FRAME_SIZE + 2):
+                self.bad += 1
+                del buf[:1]
+                continue
+            rlen = REC_HDR_LEN + buf[2] + REC_TAIL_LEN
+            if len(buf) < rlen:
+                return
+            crc = REC_CRC_INIT
+            for b in buf[:rlen - REC_TAIL_LEN]:
+                crc = crc_ccitt_update(crc, b)
+            rcrc = buf[rlen - 3] | (buf[rlen - 2] << 8)
+            if buf[rlen - 1] != REC_EOF or crc != rcrc:
+                # no record, resynchronize on the next start byte
+                self.bad += 1
+                del buf[:1]
+                continue
+            rtype, seq, chan = buf[1], buf[3], buf[4]
+            payload = bytes(buf[REC_HDR_LEN:rlen - REC_TAIL_LEN])
+            del buf[:rlen]
+            if self.seq is not None:
+                self.lost += (seq - self.seq - 1) & 0xff
+            self.seq = seq
+            yield rtype, chan, payload
+
+class Control:
+    """ sends binary control records, see SNIFF_REC_CTRL in sniffer.h """
+
+    def __init__(self, port):
+        self.port = port
+        self.seq = 0
+
+    def send(self, op, args=b""):
+        payload = struct.pack("<B", op) + args
+        rec = struct.pack("<BBBBB", REC_SOF, REC_CTRL, len(payload),
+                          self.seq, 0) + payload
+        crc = REC_CRC_INIT
+        for b in bytearray(rec):
+            crc = crc_ccitt_update(crc, b)
+        self.port.write(rec + struct.pack("<HB", crc, REC_EOF))
+        self.seq = (self.seq + 1) & 0xff
+
+    def channel(self, chan):
+        self.send(CTRL_CHAN, struct.pack("<B", chan))
+
+def command(port, cmd):
+    port.write((cmd + "\n").encode("ascii"))
+    time.sleep(0.2)
+
+def capture(port, writer, hops=None, upload=False):
+    """ writes the packet records, with upload until the info record
+        which ends the upload from flash """
+    reader = RecordReader()
+    ctrl = Control(port)
+    npkt = 0
+    missed = 0
+    hopidx, hoptime = 0, time.time()
+    while True:
+        if hops and time.time() - hoptime >= hops[1]:
+            hopidx = (hopidx + 1) % len(hops[0])
+            hoptime = time.time()
+            ctrl.channel(hops[0][hopidx])
+        data = port.read(port.inWaiting() or 1)
+        if not data:
+            continue
+        reader.feed(data)
+        for rtype, chan, payload in reader.records():
+            if rtype == REC_PACKET and len(payload) > TSTAMP_LEN:
+                sec, usec = struct.unpack("<LL", payload[:TSTAMP_LEN])
+                writer.packet(sec * 1000000 + usec, chan, payload[TSTAMP_LEN:])
+                npkt += 1
+            elif rtype == REC_SNAP and len(payload) > TSTAMP_LEN + 2:
+                origlen = bytearray(payload)[0]
+                sec, usec = struct.unpack("<LL", payload[2:TSTAMP_LEN + 2])
+                writer.packet(sec * 1000000 + usec, chan,
+                              payload[TSTAMP_LEN + 2:], origlen)
+                npkt += 1
+            elif rtype == REC_INFO:
+                if len(payload) == struct.calcsize(REC_INFO_FMT):
+                    info = struct.unpack(REC_INFO_FMT, payload) + (0,)
+                else:
+                    info = struct.unpack(REC_INFO_FMT_V2, payload)
+                version, cpage, cmask, frames, missed, irq_ur, filtered = info
+                tstamp = int(time.time() * 1000000)
+                writer.stats(tstamp, frames, missed + reader.lost)
+                sys.stderr.write("info: v%d page=%d cmask=0x%08x frames=%d "
+                                 "missed=%d ur=%d filtered=%d lost=%d "
+                                 "bad=%d\n" %
+                                 (info + (reader.lost, reader.bad)))
+                if upload:
+                    sys.stderr.write("uploaded %d frames\n" % npkt)
+                    return
+            elif rtype == REC_ACK and len(payload) == 3:
+                seq, op, status = struct.unpack("<BBB", payload)
+                sys.stderr.write("ctrl: seq=%d op=%d channel=%d %s\n" %
+                                 (seq, op, chan,
+                                  CTRL_STATUS.get(status, status)))
+
+def statistics(port):
+    reader = RecordReader()
+    nodes = []
+    while True:
+        data = port.read(port.inWaiting() or 1)
+        if not data:
+            continue
+        reader.feed(data)
+        for rtype, chan, payload in reader.records():
+            if rtype != REC_STATS:
+                continue
+            hlen = struct.calcsize(STATS_HDR_FMT)
+            elen = struct.calcsize(STATS_ENTRY_FMT)
+            snap, flags, overflow = struct.unpack(STATS_HDR_FMT, payload[:hlen])
+            for i in range(hlen, len(payload) - elen + 1, elen):
+                nodes.append(struct.unpack(STATS_ENTRY_FMT,
+                                           payload[i:i + elen]))
+            if flags & STATS_REC_LAST:
+                sys.stdout.write("=== snapshot %d, channel %d, %d nodes, "
+                                 "overflow %d ===\n" %
+                                 (snap, chan, len(nodes), overflow))
+                sys.stdout.write(" addr    frames     bytes retries lqi\n")
+                for addr, frames, nbytes, retries, lqi in sorted(nodes):
+                    sys.stdout.write("0x%04x %9d %9d %7d %3d\n" %
+                                     (addr, frames, nbytes, retries, lqi))
+                sys.stdout.flush()
+                nodes = []
+
+def spectrum(port, csvname=None):
+    reader = RecordReader()
+    out = None
+    if csvname:
+        out = open(csvname, "a")
+    while True:
+        data = port.read(port.inWaiting() or 1)
+        if not data:
+            continue
+        reader.feed(data)
+        for rtype, chan, payload in reader.records():
+            if rtype != REC_SPECTRUM:
+                continue
+            hlen = struct.calcsize(SPEC_HDR_FMT)
+            elen = struct.calcsize(SPEC_ENTRY_FMT)
+            snap, nchan, sweeps = struct.unpack(SPEC_HDR_FMT, payload[:hlen])
+            tstamp = time.time()
+            sys.stdout.write("=== spectrum %d, %d sweeps, lost %d ===\n" %
+                             (snap, sweeps, reader.lost))
+            sys.stdout.write("chan  min  avg  p50  p90  p99  max dBm\n")
+            for i in range(hlen, hlen + nchan * elen, elen):
+                e = struct.unpack(SPEC_ENTRY_FMT, payload[i:i + elen])
+                dbm = [SPEC_ED_BASE + v for v in e[1:]]
+                sys.stdout.write("%4d %s\n" % (e[0],
+                                 " ".join(["%4d" % v for v in dbm])))
+                if out:
+                    out.write("%.3f,%d,%d,%s\n" % (tstamp, snap, e[0],
+                              ",".join(["%d" % v for v in dbm])))
+            sys.stdout.flush()
+            if out:
+                out.flush()
+
+def process_command_line():
+    global PORT, BAUDRATE, CHANNEL, OUTFILE, LINKTYPE, SNAPLEN, STATS, HOPS
+    global SPECTRUM, CAPTFLASH, UPLOAD
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "hp:b:c:o:l:f:s:S:E:r:t:CU")
+    except getopt.GetoptError as e:
+        sys.stderr.write("Error: %s\n" % e)
+        opts = (("-h", ""),)
+    for o, v in opts:
+        if o == "-h":
+            sys.stderr.write(__doc__)
+            return True
+        elif o == "-p":
+            PORT = v
+        elif o == "-b":
+            BAUDRATE = int(v)
+        elif o == "-c":
+            CHANNEL = int(v)
+        elif o == "-o":
+            OUTFILE = v
+        elif o == "-f":
+            FILTERS.append(v)
+        elif o == "-t":
+            TRIGGERS.append(v)
+        elif o == "-C":
+            CAPTFLASH = True
+        elif o == "-U":
+            UPLOAD = True
+        elif o == "-s":
+            SNAPLEN = int(v)
+        elif o == "-S":
+            STATS = int(v)
+        elif o == "-E":
+            SPECTRUM = int(v)
+        elif o == "-r":
+            chans, secs = v.split(":")
+            HOPS = ([int(c) for c in chans.split(",")], float(secs))
+        elif o == "-l":
+            if v == "fcs":
+                LINKTYPE = LINKTYPE_IEEE802_15_4_WITHFCS
+            elif v == "tap":
+                LINKTYPE = LINKTYPE_IEEE802_15_4_TAP
+            else:
+                sys.stderr.write("Error: unknown linktype %s\n" % v)
+                return True
+    return False
+
+PORT = "/dev/ttyUSB0"
+BAUDRATE = 38400
+CHANNEL = None
+OUTFILE = None
+LINKTYPE = LINKTYPE_IEEE802_15_4_TAP
+FILTERS = []
+TRIGGERS = []
+CAPTFLASH = False
+UPLOAD = False
+SNAPLEN = 0
+STATS = 0
+SPECTRUM = 0
+HOPS = None
+
+if __name__ == "__main__":
+    if process_command_line():
+        sys.exit(0)
+    port = serial.Serial(PORT, BAUDRATE, timeout=1)
+    if STATS:
+        command(port, "idle")
+        if CHANNEL is not None:
+            command(port, "chan %d" % CHANNEL)
+        port.flushInput()
+        command(port, "stats %d" % STATS)
+        try:
+            statistics(port)
+        except KeyboardInterrupt:
+            command(port, "idle")
+        sys.exit(0)
+    if SPECTRUM:
+        command(port, "idle")
+        port.flushInput()
+        command(port, "spectrum %d" % SPECTRUM)
+        try:
+            spectrum(port, OUTFILE)
+        except KeyboardInterrupt:
+            command(port, "idle")
+        sys.exit(0)
+    if not CAPTFLASH:
+        if OUTFILE == "-":
+            fd = getattr(sys.stdout, "buffer", sys.stdout)
+        else:
+            fd = open(OUTFILE or "capture.pcapng", "wb")
+        writer = PcapNgWriter(fd, LINKTYPE, PORT)
+    command(port, "idle")
+    command(port, "framed 1")
+    if UPLOAD:
+        port.flushInput()
+        command(port, "capture upload")
+        capture(port, writer, upload=True)
+        sys.exit(0)
+    if HOPS:
+        CHANNEL = HOPS[0][0]
+    if CHANNEL is not None:
+        command(port, "chan %d" % CHANNEL)
+    command(port, "filter clr")
+    for f in FILTERS:
+        command(port, "filter " + f)
+    command(port, "snap %d" % SNAPLEN)
+    command(port, "timeset %d" % int(time.time()))
+    if CAPTFLASH:
+        command(port, "trigger clr")
+        for t in TRIGGERS:
+            command(port, "trigger " + t)
+        port.flushInput()
+        command(port, "capture %s" % (TRIGGERS and "arm" or "start"))
+        sys.stderr.write(port.read(port.inWaiting() or 1).decode("ascii", "replace"))
+        sys.exit(0)
+    port.flushInput()
+    command(port, "sniff")
+    try:
+        capture(port, writer, HOPS)
+    except KeyboardInterrupt:
+        command(port, "idle")
@@ -45,6 +45,15 @@
 #include "sniffer.h"
 
 /* === macros ============================================ */
+/** little endian 16 bit field of a frame */
+#define FRM_U16(p) ((uint16_t)(p)[0] | ((uint16_t)(p)[1] << 8))
+
+#if HIF_TYPE_IS_UART
+/** the UART ISR streams the frames straight from the pcap pool */
+# define UPLOAD_BUSY() hif_put_sg_busy()
+#else
+# define UPLOAD_BUSY() (0)
+#endif
 
 /* === types ============================================= */
 
@@ -52,6 +61,21 @@
 sniffer_context_t ctx;
 pcap_pool_t PcapPool;
 
+static const uint8_t upload_start = 1;
+static const uint8_t upload_end = 4;
+/** start marker or record header, payload, end marker or record trailer */
+static hif_iov_t upload_iov[3] = {
+    {&upload_start, 1},
+    {NULL, 0},
+    {&upload_end, 1},
+};
+static sniff_rec_hdr_t rec_hdr;
+static sniff_rec_tail_t rec_tail;
+static sniff_rec_info_t rec_info;
+static sniff_rec_ack_t rec_ack;
+/** offset of the record reserved by pcap_reserve() */
+static uint16_t pcap_wpos;
+
 /* === prototypes ======================================== */
 void scan_update_status(void);
 
@@ -59,6 +83,453 @@ void scan_update_status(void);
 
 
 
+/**
+ * @brief Reserve a record for a frame of maximum length.
+ *
+ * Called from the receive ISR at the start of a frame. The record
+ * becomes visible to the upload only with pcap_commit(), so calling
+ * this function again for an aborted frame reuses the same space.
+ *
+ * @return pointer to the record, or NULL if the arena is full.
+ */
+static pcap_packet_t * pcap_reserve(void)
+{
+uint16_t r, w;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        r = PcapPool.ridx;
+    }
+    w = PcapPool.widx;
+
+    /* keep widx != ridx after the commit, widx == ridx means empty */
+    if (w >= r)
+    {
+        if (PCAP_ARENA_SIZE - w > sizeof(pcap_packet_t))
+        {
+            pcap_wpos = w;
+        }
+        else if (r > sizeof(pcap_packet_t))
+        {
+            pcap_wpos = 0;
+        }
+        else
+        {
+            return NULL;
+        }
+    }
+    else if (r - w > sizeof(pcap_packet_t))
+    {
+        pcap_wpos = w;
+    }
+    else
+    {
+        return NULL;
+    }
+    return (pcap_packet_t *)&PcapPool.arena[pcap_wpos];
+}
+
+/**
+ * @brief Pass a received frame to the upload, called from the receive ISR.
+ */
+static void pcap_commit(pcap_packet_t *ppcap)
+{
+    if (pcap_wpos == 0 && PcapPool.widx != 0)
+    {
+        /* wrap marker for the reader */
+        ((pcap_packet_t *)&PcapPool.arena[PcapPool.widx])->len = 0;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        PcapPool.widx = pcap_wpos + PCAP_REC_SIZE(ppcap);
+    }
+}
+
+/**
+ * @brief Parse the MAC header of a received frame.
+ *
+ * @param frm   frame buffer
+ * @param flen  frame length
+ * @param hdr   result, hdr->found has a SNIFF_FLT_* bit for each
+ *              field, that is present in the frame
+ * @return false, if the frame is too short for its header
+ */
+bool mac_hdr_parse(const uint8_t *frm, uint8_t flen, mac_hdr_t *hdr)
+{
+uint16_t fcf;
+uint8_t off;
+
+    hdr->found = 0;
+    if (flen < 3)
+    {
+        return false;
+    }
+    fcf = FRM_U16(frm);
+    hdr->found = SNIFF_FLT_FTYPE;
+
+    off = 3;
+    if ((fcf & FCTL_DST_MASK) >= FCTL_DST_SHORT)
+    {
+        if (off + 4 > flen)
+        {
+            return false;
+        }
+        hdr->pan = FRM_U16(&frm[off]);
+        hdr->found |= SNIFF_FLT_PAN;
+        off += 2;
+        if ((fcf & FCTL_DST_MASK) == FCTL_DST_SHORT)
+        {
+            hdr->dst = FRM_U16(&frm[off]);
+            hdr->found |= SNIFF_FLT_DST;
+            off += 2;
+        }
+        else
+        {
+            off += 8;
+        }
+    }
+    if ((fcf & FCTL_SRC_MASK) >= FCTL_SRC_SHORT)
+    {
+        if (!(fcf & FCTL_IPAN) || !(hdr->found & SNIFF_FLT_PAN))
+        {
+            if (off + 2 > flen)
+            {
+                return false;
+            }
+            if (!(hdr->found & SNIFF_FLT_PAN))
+            {
+                hdr->pan = FRM_U16(&frm[off]);
+                hdr->found |= SNIFF_FLT_PAN;
+            }
+            off += 2;
+        }
+        if ((fcf & FCTL_SRC_MASK) == FCTL_SRC_SHORT)
+        {
+            if (off + 2 > flen)
+            {
+                return false;
+            }
+            hdr->src = FRM_U16(&frm[off]);
+            hdr->found |= SNIFF_FLT_SRC;
+            off += 2;
+        }
+        else
+        {
+            off += 8;
+        }
+    }
+    if (off < flen)
+    {
+        hdr->found |= SNIFF_FLT_CMD;
+    }
+    hdr->off = off;
+    return true;
+}
+
+/**
+ * @brief Apply a filter, the capture filter or the trigger, to a
+ * received frame.
+ *
+ * A clause for a field, which is not present in the frame,
+ * does not match.
+ *
+ * @return true, if all clauses match
+ */
+static bool pcap_filter(const sniff_filter_t *flt, const uint8_t *frm,
+                        uint8_t flen)
+{
+mac_hdr_t hdr;
+
+    if (flt->flags == 0)
+    {
+        return true;
+    }
+    if (!mac_hdr_parse(frm, flen, &hdr) ||
+        (flt->flags & ~hdr.found) != 0)
+    {
+        return false;
+    }
+    return !(((flt->flags & SNIFF_FLT_FTYPE) &&
+              !(flt->ftypes & (1 << (frm[0] & 7)))) ||
+             ((flt->flags & SNIFF_FLT_PAN) && (hdr.pan != flt->pan)) ||
+             ((flt->flags & SNIFF_FLT_SRC) && (hdr.src != flt->src)) ||
+             ((flt->flags & SNIFF_FLT_DST) && (hdr.dst != flt->dst)) ||
+             ((flt->flags & SNIFF_FLT_CMD) && (frm[hdr.off] != flt->cmd)));
+}
+
+/**
+ * @brief Filter, cut and commit a received frame, called from the receive ISR.
+ */
+static void pcap_capture(pcap_packet_t *ppcap, uint8_t flen, bool crc_ok)
+{
+    if ((ctx.capt == CAPT_ARMED) && crc_ok &&
+        pcap_filter(&ctx.trigger, ppcap->frame, flen))
+    {
+        /* this frame is the first one in flash */
+        ctx.capt = CAPT_RUN;
+    }
+    if ((ctx.chkcrc && !crc_ok) || !pcap_filter(&ctx.filter, ppcap->frame, flen))
+    {
+        ctx.filtered++;
+        return;
+    }
+    ppcap->flen = flen;
+    if (ctx.filter.snaplen != 0 && flen > ctx.filter.snaplen)
+    {
+        flen = ctx.filter.snaplen;
+    }
+    ppcap->len = flen + sizeof(time_stamp_t);
+    pcap_commit(ppcap);
+}
+
+/**
+ * @brief Convert the raw SFD time stamp of a record, RFA1 only.
+ */
+static void pcap_tstamp(pcap_packet_t *ppcap)
+{
+#if defined(TRX_IF_RFA1)
+uint32_t sym = ppcap->ts.time_usec;
+
+    ppcap->ts.time_sec = sym / TRX_TSTAMP_SYMBOLS_PER_SEC;
+    ppcap->ts.time_usec = (sym % TRX_TSTAMP_SYMBOLS_PER_SEC) *
+                          TRX_TSTAMP_SYMBOL_US;
+#endif
+}
+
+/**
+ * @brief Get the next record to be uploaded, or NULL if there is none.
+ */
+static pcap_packet_t * pcap_next(void)
+{
+uint16_t w;
+pcap_packet_t *ppcap;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        w = PcapPool.widx;
+    }
+    if (PcapPool.ridx == w)
+    {
+        return NULL;
+    }
+    ppcap = (pcap_packet_t *)&PcapPool.arena[PcapPool.ridx];
+    if (ppcap->len == 0)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            PcapPool.ridx = 0;
+        }
+        if (w == 0)
+        {
+            return NULL;
+        }
+        ppcap = (pcap_packet_t *)&PcapPool.arena[0];
+    }
+    return ppcap;
+}
+
+/**
+ * @brief Release a pcap record after it was sent.
+ *
+ * With a UART HIF, this function is called from the UART ISR.
+ */
+static void upload_done(void *p)
+{
+uint16_t next;
+
+    next = (uint8_t *)p - PcapPool.arena + PCAP_REC_SIZE((pcap_packet_t *)p);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        PcapPool.ridx = next;
+    }
+}
+
+/**
+ * @brief Send the blocks of upload_iov.
+ *
+ * With a UART HIF the blocks are streamed by the UART ISR,
+ * otherwise they are written here and @p done is called at once.
+ */
+static void upload_send(hif_sg_done_t *done, void *p)
+{
+#if HIF_TYPE_IS_UART
+    hif_put_sg(upload_iov, 3, done, p);
+#else
+uint8_t i, tmp, len;
+const uint8_t *dp;
+
+    for (i = 0; i < 3; i++)
+    {
+        dp = upload_iov[i].data;
+        len = upload_iov[i].len;
+        while (len > 0)
+        {
+            tmp = hif_put_blk((uint8_t*)dp, len);
+            dp += tmp;
+            len -= tmp;
+        }
+    }
+    if (done != NULL)
+    {
+        done(p);
+    }
+#endif
+}
+
+/**
+ * @brief Set up upload_iov for a framed record.
+ */
+static void upload_frame(uint8_t type, uint8_t chan,
+                         const void *payload, uint8_t len)
+{
+uint16_t crc;
+const uint8_t *p;
+uint8_t i;
+
+    rec_hdr.sof = SNIFF_REC_SOF;
+    rec_hdr.type = type;
+    rec_hdr.len = len;
+    rec_hdr.seq = ctx.recseq++;
+    rec_hdr.chan = chan;
+
+    crc = SNIFF_REC_CRC_INIT;
+    p = (const uint8_t*)&rec_hdr;
+    for (i = 0; i < sizeof(rec_hdr); i++)
+    {
+        crc = _crc_ccitt_update(crc, p[i]);
+    }
+    p = payload;
+    for (i = 0; i < len; i++)
+    {
+        crc = _crc_ccitt_update(crc, p[i]);
+    }
+    rec_tail.crc = crc;
+    rec_tail.eof = SNIFF_REC_EOF;
+
+    upload_iov[0].data = (const uint8_t*)&rec_hdr;
+    upload_iov[0].len = sizeof(rec_hdr);
+    upload_iov[1].data = payload;
+    upload_iov[1].len = len;
+    upload_iov[2].data = (const uint8_t*)&rec_tail;
+    upload_iov[2].len = sizeof(rec_tail);
+}
+
+/**
+ * @brief Upload a pcap record, @p done is called once it is sent.
+ *
+ * A record of the pcap pool is released by upload_done(), the
+ * records uploaded from flash pass NULL.
+ */
+void upload_packet(pcap_packet_t *ppcap, hif_sg_done_t *done)
+{
+    if (ctx.framed)
+    {
+        if (ppcap->flen + sizeof(time_stamp_t) != ppcap->len)
+        {
+            upload_frame(SNIFF_REC_SNAP, ppcap->chan, &ppcap->flen,
+                         ppcap->len + 2);
+        }
+        else
+        {
+            upload_frame(SNIFF_REC_PACKET, ppcap->chan, &ppcap->ts,
+                         ppcap->len);
+        }
+        ctx.recs_since_info++;
+    }
+    else
+    {
+        upload_iov[0].data = &upload_start;
+        upload_iov[0].len = 1;
+        upload_iov[1].data = &ppcap->len;
+        upload_iov[1].len = ppcap->len+1;
+        upload_iov[2].data = &upload_end;
+        upload_iov[2].len = 1;
+    }
+    upload_send(done, ppcap);
+}
+
+/**
+ * @brief Check if an info record needs to be sent.
+ *
+ * Changed counters are reported when the pcap pool ran empty or
+ * after @ref SNIFF_REC_INFO_INTERVAL packet records at the latest.
+ */
+static bool upload_info_due(void)
+{
+bool changed;
+
+    if (ctx.info_due)
+    {
+        return true;
+    }
+    cli();
+    changed = (ctx.missed_frames != ctx.info_missed_frames) ||
+              (ctx.irq_ur != ctx.info_irq_ur);
+    sei();
+    return changed && ((pcap_next() == NULL) ||
+                       (ctx.recs_since_info >= SNIFF_REC_INFO_INTERVAL));
+}
+
+/**
+ * @brief Upload the capture parameters and counters.
+ */
+static void upload_info(void)
+{
+    rec_info.version = SNIFF_REC_VERSION;
+    rec_info.cpage = ctx.cpage;
+    rec_info.cmask = ctx.cmask;
+    cli();
+    rec_info.frames = ctx.frames;
+    rec_info.missed_frames = ctx.missed_frames;
+    rec_info.irq_ur = ctx.irq_ur;
+    rec_info.filtered = ctx.filtered;
+    sei();
+    ctx.info_missed_frames = rec_info.missed_frames;
+    ctx.info_irq_ur = rec_info.irq_ur;
+    ctx.info_due = false;
+    ctx.recs_since_info = 0;
+
+    upload_frame(SNIFF_REC_INFO, ctx.cchan, &rec_info, sizeof(rec_info));
+    upload_send(NULL, NULL);
+}
+
+/**
+ * @brief Upload the answer to a control record.
+ */
+static void upload_ack(void)
+{
+    rec_ack = ctx.ack;
+    ctx.ack_due = false;
+    upload_frame(SNIFF_REC_ACK, ctx.cchan, &rec_ack, sizeof(rec_ack));
+    upload_send(NULL, NULL);
+}
+
+/**
+ * @brief Check for an upload in flight.
+ */
+bool upload_busy(void)
+{
+    return UPLOAD_BUSY();
+}
+
+/**
+ * @brief Upload a framed record from a caller owned buffer.
+ *
+ * The buffer must not be changed, while upload_busy() returns true.
+ *
+ * @return false, if an upload is still in flight
+ */
+bool upload_record(uint8_t type, const void *payload, uint8_t len)
+{
+    if (UPLOAD_BUSY())
+    {
+        return false;
+    }
+    upload_frame(type, ctx.cchan, payload, len);
+    upload_send(NULL, NULL);
+    return true;
+}
+
 /**
  * @brief Initialisation of hardware ressources.
  *
@@ -84,6 +555,7 @@ uint8_t val;
     ctx.state = IDLE;
     ctx.cchan = TRX_MIN_CHANNEL;
     ctx.cmask = TRX_SUPPORTED_CHANNELS;
+    capt_init();
 
     LED_SET_VALUE(1);
 
@@ -96,6 +568,9 @@ uint8_t val;
     /* initialize transceiver */
     trx_io_init(DEFAULT_SPI_RATE);
     trx_init();
+#if defined(TRX_IF_RFA1)
+    trx_tstamp_init();
+#endif
 
 
     LED_SET_VALUE(2);
@@ -119,6 +594,8 @@ uint8_t val;
 #endif
 
     LED_SET_VALUE(3);
+    /* the commands, the hop timer and the frames wake the main loop */
+    pm_set_active(PM_HIF | PM_TIMER | PM_RADIO);
     sei();
 
     /* done with init */
@@ -142,9 +619,22 @@ void sniffer_start(sniffer_state_t state)
             ctx.state = SCAN;
             scan_init();
             break;
+        case STATS:
+            ctx.state = STATS;
+            stats_init();
+            break;
+        case SPECTRUM:
+            ctx.state = SPECTRUM;
+            spectrum_init();
+            break;
         case SNIFF:
             trx_reg_write(RG_TRX_STATE, CMD_RX_ON);
+            ctx.info_due = true;
             ctx.state = SNIFF;
+            if (ctx.hopdwell != 0)
+            {
+                hop_start();
+            }
             break;
 
         default:
@@ -172,6 +662,13 @@ sniffer_state_t curr_state;
             ctx.thdl = timer_stop(ctx.thdl);
             break;
         case SNIFF:
+            ctx.thdl = timer_stop(ctx.thdl);
+            ctx.hop_due = false;
+            break;
+        case STATS:
+        case SPECTRUM:
+            ctx.thdl = timer_stop(ctx.thdl);
+            break;
         case IDLE:
             break;
         default:
@@ -190,40 +687,63 @@ sniffer_state_t curr_state;
  */
 int main(void)
 {
+pcap_packet_t *ppcap;
 
     sniffer_init();
 
     while(1)
     {
+        timer_task();
         ctrl_process_input();
 
         if(ctx.state == SCAN_DONE)
         {
             scan_update_status();
         }
-        if ((ctx.state == SNIFF) && (PcapPool.widx != PcapPool.ridx))
+        if (ctx.state == STATS)
+        {
+            stats_continue();
+        }
+        if (ctx.state == SPECTRUM)
         {
-            uint8_t tmp, len, *p;
-            pcap_packet_t *ppcap = &PcapPool.packet[PcapPool.ridx];
-            hif_putc(1);
-            #if 0
-                hif_put_blk((uint8_t*)ppcap, ppcap->len+1);
-            #else
-                len = ppcap->len+1;
-                p = (uint8_t*)ppcap;
-                do
-                {
-                    tmp = hif_put_blk(p, len);
-                    p += tmp;
-                    len -= tmp;
-                }
-                while(len>0);
-            #endif
-            hif_putc(4);
-            /* mark buffer as processed */
-            ppcap->len = 0;
-            PcapPool.ridx++;
-            PcapPool.ridx &= (MAX_PACKET_BUFFERS-1);
+            spectrum_continue();
+        }
+        if ((ctx.state == SNIFF) && ctx.hop_due)
+        {
+            hop_next();
+        }
+        if (ctx.ack_due && !UPLOAD_BUSY())
+        {
+            upload_ack();
+        }
+        if ((ctx.state == SNIFF || ctx.info_due) && ctx.framed &&
+            !UPLOAD_BUSY() && upload_info_due())
+        {
+            /* after an upload from flash, the info record ends it */
+            upload_info();
+        }
+        if (ctx.capt == CAPT_UPLOAD)
+        {
+            capt_continue();
+        }
+        if ((ctx.state == SNIFF) && (ctx.capt == CAPT_RUN) &&
+            ((ppcap = pcap_next()) != NULL))
+        {
+            pcap_tstamp(ppcap);
+            capt_store(ppcap);
+            upload_done(ppcap);
+        }
+        else if ((ctx.state == SNIFF) && !UPLOAD_BUSY() &&
+            ((ppcap = pcap_next()) != NULL))
+        {
+            pcap_tstamp(ppcap);
+            upload_packet(ppcap, upload_done);
+        }
+        if (((ctx.state == IDLE) && (ctx.capt != CAPT_UPLOAD)) ||
+            (ctx.state == SNIFF) || (ctx.state == SCAN))
+        {
+            /* the other states have work in every pass */
+            pm_idle();
         }
     }
 }
@@ -248,13 +768,14 @@ static pcap_packet_t *ppcap;
 
     if (cause & TRX_IRQ_RX_START)
     {
-        ppcap = &PcapPool.packet[PcapPool.widx];
-        if (ppcap->len != 0)
+        ppcap = pcap_reserve();
+        if (ppcap == NULL)
         {
             /* drop packet, no free buffers*/
-            ppcap = NULL;
+            ctx.missed_frames++;
             return;
         }
+        ppcap->chan = ctx.cchan;
         ppcap->ts.time_usec = TRX_TSTAMP_REG;
         ppcap->ts.time_sec = systime;
     }
@@ -273,9 +794,11 @@ static pcap_packet_t *ppcap;
             }
             if (ctx.state == SNIFF)
             {
-                ppcap->len = flen + sizeof(time_stamp_t);
-                PcapPool.widx++;
-                PcapPool.widx &= (MAX_PACKET_BUFFERS-1);
+                pcap_capture(ppcap, flen, crc_ok);
+            }
+            if (ctx.state == STATS)
+            {
+                stats_update_frame(ppcap->frame, flen, crc_ok, lqi);
             }
         }
         ctx.frames++;
@@ -286,6 +809,12 @@ static pcap_packet_t *ppcap;
     {
         ctx.irq_ur ++;
     }
+    if (cause & TRX_IRQ_PLL_LOCK)
+    {
+        /* unmasked by radio_set_channel_fast() for a hop */
+        radio_chsw_irq();
+    }
+    PM_EVENT();
 
     cli();
     EI_TRX_IRQ();
@@ -298,16 +827,17 @@ pcap_packet_t *ppcap_trx24 = NULL;
 
 ISR(TRX24_RX_START_vect)
 {
-extern time_t systime;
-    ppcap_trx24 = &PcapPool.packet[PcapPool.widx];
-    if (ppcap_trx24->len != 0)
+    ppcap_trx24 = pcap_reserve();
+    if (ppcap_trx24 == NULL)
     {
         /* drop packet, no free buffers*/
-        ppcap_trx24 = NULL;
+        ctx.missed_frames++;
         return;
     }
-    ppcap_trx24->ts.time_usec = TRX_TSTAMP_REG;
-    ppcap_trx24->ts.time_sec = systime;
+    /* raw SFD capture, converted in the main loop */
+    ppcap_trx24->chan = ctx.cchan;
+    ppcap_trx24->ts.time_usec = trx_tstamp_sfd();
+    ppcap_trx24->ts.time_sec = 0;
 }
 
 ISR(TRX24_RX_END_vect)
@@ -326,13 +856,16 @@ bool crc_ok = 0;
         }
         if (ctx.state == SNIFF)
         {
-            ppcap_trx24->len = flen + sizeof(time_stamp_t);
-            PcapPool.widx++;
-            PcapPool.widx &= (MAX_PACKET_BUFFERS-1);
+            pcap_capture(ppcap_trx24, flen, crc_ok);
+        }
+        if (ctx.state == STATS)
+        {
+            stats_update_frame(ppcap_trx24->frame, flen, crc_ok, lqi);
         }
     }
     ctx.frames++;
     LED_SET_VALUE(ctx.frames);
+    PM_EVENT();
 }
 #endif  /* RFA1 */
 
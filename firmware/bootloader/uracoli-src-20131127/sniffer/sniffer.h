@@ -38,13 +38,16 @@
 /* === includes ============================================================ */
 #include <avr/pgmspace.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 
 #include <stdbool.h>
 #include <util/crc16.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include "transceiver.h"
+#include "radio.h"
 #include "ioutil.h"
 #include "timer.h"
 #ifndef SNIFFER_H
@@ -73,9 +76,177 @@
     while(0)
 
 
-#ifndef MAX_PACKET_BUFFERS
-# define MAX_PACKET_BUFFERS (8)
+/**
+ * Size of the packet arena in bytes.
+ *
+ * The arena holds the received frames as pcap_packet_t records,
+ * truncated to the frame length, so short frames take only a few
+ * bytes. By default, the arena takes a share of the SRAM of the MCU;
+ * a board, which defines MAX_PACKET_BUFFERS, gets room for that
+ * number of frames of maximum length.
+ */
+#ifndef PCAP_ARENA_SIZE
+# if defined(MAX_PACKET_BUFFERS)
+#  define PCAP_ARENA_SIZE ((MAX_PACKET_BUFFERS + 1) * sizeof(pcap_packet_t))
+# elif RAMEND >= 0x8000
+#  define PCAP_ARENA_SIZE (24576)
+# elif RAMEND >= 0x4000
+#  define PCAP_ARENA_SIZE (10240)
+# elif RAMEND >= 0x2000
+#  define PCAP_ARENA_SIZE (4096)
+# elif RAMEND >= 0x1000
+#  define PCAP_ARENA_SIZE (2048)
+# else
+#  define PCAP_ARENA_SIZE (1024)
+# endif
 #endif
+
+/**
+ * @name Framed record format
+ *
+ * With "framed 1", each upload is sent as
+ * @ref sniff_rec_hdr_t, payload, @ref sniff_rec_tail_t.
+ * The CRC covers header and payload, so the host can resynchronize
+ * on the next @ref SNIFF_REC_SOF after a corrupted record or text
+ * output.
+ * @{
+ */
+/** first byte of a record */
+#define SNIFF_REC_SOF (0x01)
+/** last byte of a record */
+#define SNIFF_REC_EOF (0x04)
+/** version of the record format, see @ref sniff_rec_info_t */
+#define SNIFF_REC_VERSION (2)
+/** record with a captured frame, payload is time_stamp_t and the frame */
+#define SNIFF_REC_PACKET (0x50)
+/** record with a part of a node statistics snapshot, see @ref stats_entry_t */
+#define SNIFF_REC_STATS (0x4e)
+/**
+ * record with a frame cut to the snap length, payload is the original
+ * frame length, the pcap length byte, time_stamp_t and the frame
+ */
+#define SNIFF_REC_SNAP (0x53)
+/** record with the capture parameters and counters */
+#define SNIFF_REC_INFO (0x49)
+/** record with the ED distribution of each channel, see @ref spec_rec_hdr_t */
+#define SNIFF_REC_SPECTRUM (0x45)
+/** start value of the CRC (CRC-16/CCITT, reflected) */
+#define SNIFF_REC_CRC_INIT (0xffff)
+/** number of packet records, after which changed counters are sent */
+#define SNIFF_REC_INFO_INTERVAL (64)
+/** @} */
+
+/**
+ * @name Binary control records
+ *
+ * The host may send records in the same format, interleaved with the
+ * text commands, of type @ref SNIFF_REC_CTRL; the channel byte of the
+ * header is ignored. The payload is an operation code and its
+ * arguments. Each valid request is answered by a @ref SNIFF_REC_ACK
+ * record in the upload stream, so the capture runs on while the
+ * sniffer is reconfigured. Requests with a bad CRC are dropped
+ * without an answer.
+ * @{
+ */
+/** record from the host, payload is SNIFF_CTRL_* and its arguments */
+#define SNIFF_REC_CTRL (0x43)
+/** answer to a control record, see @ref sniff_rec_ack_t */
+#define SNIFF_REC_ACK (0x41)
+/** largest payload of a control record */
+#define SNIFF_CTRL_MAX_LEN (16)
+/** set the channel, argument uint8_t channel */
+#define SNIFF_CTRL_CHAN (0x01)
+/** set the capture filter, argument @ref sniff_filter_t */
+#define SNIFF_CTRL_FILTER (0x02)
+/** change the state, argument uint8_t @ref sniffer_state_t
+ *  (IDLE, SCAN, SNIFF, STATS or SPECTRUM) */
+#define SNIFF_CTRL_STATE (0x03)
+/** set the CRC check, argument uint8_t 0 or 1 */
+#define SNIFF_CTRL_CHKCRC (0x04)
+/** capture to flash, argument uint8_t @ref capt_state_t: CAPT_OFF stops,
+ *  CAPT_ARMED and CAPT_RUN start sniffing, CAPT_UPLOAD uploads */
+#define SNIFF_CTRL_CAPTURE (0x05)
+/** sniff_rec_ack_t::status, the request was carried out */
+#define SNIFF_CTRL_OK (0)
+/** sniff_rec_ack_t::status, unknown operation or invalid argument */
+#define SNIFF_CTRL_EINVAL (1)
+/** @} */
+
+/**
+ * @name Capture filter clauses, see @ref sniff_filter_t
+ * @{
+ */
+/** match the PAN ID */
+#define SNIFF_FLT_PAN   (0x01)
+/** match the short source address */
+#define SNIFF_FLT_SRC   (0x02)
+/** match the short destination address */
+#define SNIFF_FLT_DST   (0x04)
+/** match the frame type */
+#define SNIFF_FLT_FTYPE (0x08)
+/** match the first payload byte, i.e. the p2p command code */
+#define SNIFF_FLT_CMD   (0x10)
+/** @} */
+
+/** default period of the statistics snapshots */
+#define STATS_PERIOD_MS (5000)
+
+/** number of nodes in the statistics table, a power of 2 */
+#ifndef STATS_MAX_NODES
+# define STATS_MAX_NODES (32)
+#endif
+
+/** number of @ref stats_entry_t in one @ref SNIFF_REC_STATS record */
+#define STATS_ENTRIES_PER_REC (16)
+
+/** flag of @ref stats_rec_hdr_t: last record of a snapshot */
+#define STATS_REC_LAST (0x01)
+
+/** default period of the spectrum records */
+#define SPEC_PERIOD_MS (1000)
+
+/**
+ * Time of an ED measurement in us, 8 symbols and the SPI access. The
+ * AT86RF212 has 8 symbols of BPSK 20 kb/s at the longest.
+ */
+#ifndef SPEC_ED_US
+# if RADIO_TYPE == RADIO_AT86RF212
+#  define SPEC_ED_US (420)
+# else
+#  define SPEC_ED_US (140)
+# endif
+#endif
+
+/** ED values per histogram bin are 1 << SPEC_BIN_SHIFT */
+#ifndef SPEC_BIN_SHIFT
+# if RAMEND >= 0x2000
+#  define SPEC_BIN_SHIFT (2)
+# else
+#  define SPEC_BIN_SHIFT (3)
+# endif
+#endif
+/** number of histogram bins per channel, PHY_ED_LEVEL is below 128 */
+#define SPEC_NBINS (128 >> SPEC_BIN_SHIFT)
+
+/**
+ * @name Capture to flash, see sniffer_capt.c
+ *
+ * The region takes the flash above the first 64K, which the sniffer
+ * does not reach, up to 16K below the end, where the bootloader is.
+ * A board may set its own page aligned region; MCUs with 64K flash
+ * or less have none and no capture to flash.
+ * @{
+ */
+#if !defined(CAPT_FLASH_START) && (FLASHEND > 0xFFFFUL)
+# define CAPT_FLASH_START (0x10000UL)
+#endif
+#ifndef CAPT_FLASH_END
+# define CAPT_FLASH_END ((uint32_t) FLASHEND + 1 - 0x4000UL)
+#endif
+/** pages of the region */
+#define CAPT_FLASH_PAGES \
+    ((uint16_t) ((CAPT_FLASH_END - CAPT_FLASH_START) / SPM_PAGESIZE))
+/** @} */
 /* === types =============================================================== */
 /**
  * @brief Appication States.
@@ -91,9 +262,29 @@ typedef enum
     /** Application is in scanning mode. */
     SCAN_DONE,
     /** Application is in sniffing mode. */
-    SNIFF
+    SNIFF,
+    /** Application collects per node statistics. */
+    STATS,
+    /** Application samples the ED of the channels. */
+    SPECTRUM
 } SHORTENUM sniffer_state_t;
 
+/**
+ * @brief States of the capture to flash.
+ */
+typedef enum
+{
+    /** frames are uploaded */
+    CAPT_OFF,
+    /** frames are uploaded, the first frame passing ctx.trigger
+     *  starts the capture */
+    CAPT_ARMED,
+    /** frames are written to flash */
+    CAPT_RUN,
+    /** the captured frames are uploaded, in state IDLE */
+    CAPT_UPLOAD
+} SHORTENUM capt_state_t;
+
 /**
  * @brief Data structure for scan results.
  */
@@ -108,6 +299,52 @@ typedef struct scan_result_tag
     uint16_t ftypes[8];
 } scan_result_t;
 
+/**
+ * @brief Capture filter, applied in the receive ISR.
+ *
+ * A frame is captured, if all clauses in flags match.
+ */
+typedef struct sniff_filter_tag
+{
+    /** enabled clauses, SNIFF_FLT_* */
+    uint8_t flags;
+    /** accepted frame types, bit n for frame type n */
+    uint8_t ftypes;
+    /** PAN ID */
+    uint16_t pan;
+    /** short source address */
+    uint16_t src;
+    /** short destination address */
+    uint16_t dst;
+    /** p2p command code */
+    uint8_t cmd;
+    /** number of frame bytes to capture, 0 for the whole frame */
+    uint8_t snaplen;
+} sniff_filter_t;
+
+/** Fields of a MAC header, see mac_hdr_parse(). */
+typedef struct mac_hdr_tag
+{
+    /** SNIFF_FLT_* bits of the fields present in the frame */
+    uint8_t found;
+    /** offset of the MAC payload */
+    uint8_t off;
+    uint16_t pan;
+    uint16_t src;
+    uint16_t dst;
+} mac_hdr_t;
+
+/** Payload of a @ref SNIFF_REC_ACK record. */
+typedef struct sniff_rec_ack_tag
+{
+    /** sequence number of the control record */
+    uint8_t seq;
+    /** its operation code */
+    uint8_t op;
+    /** SNIFF_CTRL_OK or SNIFF_CTRL_EINVAL */
+    uint8_t status;
+} sniff_rec_ack_t;
+
 /**
  * @brief Data structure for internal state variables of
  * the application.
@@ -136,10 +373,52 @@ typedef struct sniffer_context_tag
     uint16_t frames;
     uint16_t irq_ur;
     uint16_t missed_frames;
+    /** number of frames rejected by the filter or the CRC check */
+    uint16_t filtered;
+    /** capture filter */
+    sniff_filter_t filter;
+
+    /** upload framed records instead of the raw 1/pcap/4 format */
+    bool framed;
+    /** sequence number of the next record */
+    uint8_t recseq;
+    /** packet records since the last info record */
+    uint8_t recs_since_info;
+    /** an info record is due */
+    bool info_due;
+    /** counters, as reported by the last info record */
+    uint16_t info_irq_ur;
+    uint16_t info_missed_frames;
+
+    /** dwell time per channel in hopping mode, 0 if hopping is off */
+    time_t hopdwell;
+    /** set by the hop timer, the main loop changes the channel */
+    volatile bool hop_due;
+
+    /** period of the statistics snapshots */
+    time_t statsper;
+    /** period of the spectrum records */
+    time_t specper;
+
+    /** an answer to a control record is due */
+    bool ack_due;
+    /** the pending answer */
+    sniff_rec_ack_t ack;
+
+    /** capture to flash */
+    volatile capt_state_t capt;
+    /** filter of the frame, that starts the capture in CAPT_ARMED */
+    sniff_filter_t trigger;
+    /** frames written to flash since the capture started */
+    uint16_t capt_frames;
 } sniffer_context_t;
 
 typedef struct pcap_packet_tag
 {
+    /** channel, on which the frame was received */
+    uint8_t chan;
+    /** length of the frame on air, before the snap length cut */
+    uint8_t flen;
     /** length value (frame length + sizeof(time_stamp_t)) */
     uint8_t len;
     /** time stamp storage */
@@ -148,12 +427,125 @@ typedef struct pcap_packet_tag
     uint8_t frame[MAX_FRAME_SIZE];
 } pcap_packet_t;
 
+/** number of arena bytes taken by a record */
+#define PCAP_REC_SIZE(ppcap) (offsetof(pcap_packet_t, ts) + (ppcap)->len)
+
+
+/** Header of a framed record. */
+typedef struct sniff_rec_hdr_tag
+{
+    /** @ref SNIFF_REC_SOF */
+    uint8_t sof;
+    /** @ref SNIFF_REC_PACKET or @ref SNIFF_REC_INFO */
+    uint8_t type;
+    /** number of payload bytes */
+    uint8_t len;
+    /** sequence number, incremented for each record */
+    uint8_t seq;
+    /** channel, on which the frame was received */
+    uint8_t chan;
+} sniff_rec_hdr_t;
+
+/** Trailer of a framed record. */
+typedef struct sniff_rec_tail_tag
+{
+    /** CRC over header and payload, little endian */
+    uint16_t crc;
+    /** @ref SNIFF_REC_EOF */
+    uint8_t eof;
+} sniff_rec_tail_t;
+
+/** Payload of a @ref SNIFF_REC_INFO record. */
+typedef struct sniff_rec_info_tag
+{
+    /** @ref SNIFF_REC_VERSION */
+    uint8_t version;
+    /** channel page */
+    uint8_t cpage;
+    /** channel mask */
+    uint32_t cmask;
+    /** number of received frames */
+    uint16_t frames;
+    /** number of frames dropped for lack of a pcap buffer */
+    uint16_t missed_frames;
+    /** number of frame buffer underruns */
+    uint16_t irq_ur;
+    /** number of frames rejected by the filter, since version 2 */
+    uint16_t filtered;
+} sniff_rec_info_t;
+
+/** Payload header of a @ref SNIFF_REC_STATS record. */
+typedef struct stats_rec_hdr_tag
+{
+    /** snapshot number, the same for all records of a snapshot */
+    uint8_t snap;
+    /** STATS_REC_LAST */
+    uint8_t flags;
+    /** nodes, which did not fit into the table */
+    uint16_t overflow;
+} stats_rec_hdr_t;
+
+/**
+ * Counters of one node in a @ref SNIFF_REC_STATS record.
+ * The counters are running since the start of the statistics mode.
+ */
+typedef struct stats_entry_tag
+{
+    /** short source address */
+    uint16_t addr;
+    /** number of frames with valid CRC */
+    uint32_t frames;
+    /** number of frame bytes */
+    uint32_t bytes;
+    /** retransmissions, i.e. frames with the sequence number of the
+     *  previous frame */
+    uint16_t retries;
+    /** average LQI */
+    uint8_t lqi;
+} stats_entry_t;
+
+/** Payload header of a @ref SNIFF_REC_SPECTRUM record. */
+typedef struct spec_rec_hdr_tag
+{
+    /** record number */
+    uint8_t snap;
+    /** number of @ref spec_entry_t, one per channel of ctx.cmask */
+    uint8_t nchan;
+    /** sweeps over all channels in the period */
+    uint16_t sweeps;
+} spec_rec_hdr_t;
+
+/**
+ * ED distribution of a channel in a @ref SNIFF_REC_SPECTRUM record.
+ * The values are PHY_ED_LEVEL of the transceiver, the percentiles are
+ * the upper end of the histogram bin.
+ */
+typedef struct spec_entry_tag
+{
+    uint8_t chan;
+    uint8_t min;
+    uint8_t avg;
+    uint8_t p50;
+    uint8_t p90;
+    uint8_t p99;
+    uint8_t max;
+} spec_entry_t;
 
+/**
+ * Ring of variable length pcap_packet_t records.
+ *
+ * Each record is stored in one piece, so it can be uploaded straight
+ * from the arena. If a frame of maximum length does not fit in at the
+ * end, the writer leaves a length byte of 0, which tells the reader
+ * to go on at offset 0.
+ */
 typedef struct pcap_pool_tag
 {
-    volatile uint8_t ridx;
-    volatile uint8_t widx;
-    pcap_packet_t packet[MAX_PACKET_BUFFERS];
+    /** offset of the next record to upload */
+    volatile uint16_t ridx;
+    /** offset behind the last complete record */
+    volatile uint16_t widx;
+    uint8_t arena[PCAP_ARENA_SIZE];
 } pcap_pool_t;
 
 
@@ -204,6 +596,23 @@ void sniffer_stop(void);
 void ctrl_process_input(void);
 void scan_init(void);
 void scan_continue(void);
+void hop_start(void);
+void hop_next(void);
+bool mac_hdr_parse(const uint8_t *frm, uint8_t flen, mac_hdr_t *hdr);
+bool upload_busy(void);
+bool upload_record(uint8_t type, const void *payload, uint8_t len);
+void upload_packet(pcap_packet_t *ppcap, hif_sg_done_t *done);
+void stats_init(void);
+void stats_continue(void);
+void stats_update_frame(const uint8_t *frm, uint8_t flen, bool crc_ok,
+                        uint8_t lqi);
+void spectrum_init(void);
+void spectrum_continue(void);
+void capt_init(void);
+bool capt_set(capt_state_t next);
+void capt_store(pcap_packet_t *ppcap);
+void capt_continue(void);
+uint16_t capt_free_pages(void);
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
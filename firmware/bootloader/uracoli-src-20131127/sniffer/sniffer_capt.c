@@ -0,0 +1,210 @@
+/* Copyright (c) 2007 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Capture to flash of @ref grpAppSniffer
+ *
+ * A burst, e.g. the update of a troop, comes faster than the HIF takes
+ * it. With "capture start", or "capture arm" and the first frame which
+ * passes the trigger filter ctx.trigger, the main loop writes the
+ * records of the pcap pool to a @ref flash_log.h ring instead of
+ * uploading them. The filter and the snap length apply as for the
+ * upload. A page is written once it is full, in some ms with the
+ * interrupts off; the pcap pool takes the frames meanwhile. When the
+ * ring is full, the capture ends and the frames go to the HIF again.
+ *
+ * "capture upload" sends the frames as framed records, the same
+ * @ref SNIFF_REC_PACKET and @ref SNIFF_REC_SNAP records as a live
+ * capture, followed by a @ref SNIFF_REC_INFO record. Then the frames
+ * are given up. The ring survives a reset, it is written through the
+ * page service of the bootloader (WIBO_FLAVOUR_APPSPM).
+ *
+ * @ingroup grpAppSniffer
+ */
+
+/* === includes ============================================================ */
+#include "sniffer.h"
+#if defined(CAPT_FLASH_START)
+#include "flash_log.h"
+#include "wibosvc.h"
+
+/* === macros ============================================================== */
+
+/* === types =============================================================== */
+
+/* === globals ============================================================= */
+static flash_log_t capt_log;
+/** read position of the upload */
+static flash_log_pos_t capt_pos;
+/** record of the upload, it must not change while it is sent */
+static pcap_packet_t capt_pkt;
+
+/* === prototypes ========================================================== */
+
+/* === functions =========================================================== */
+
+/**
+ * @brief Set up the ring, it is read at the first access.
+ */
+void capt_init(void)
+{
+    flash_log_init(&capt_log, CAPT_FLASH_START, CAPT_FLASH_PAGES, 0);
+}
+
+/**
+ * @brief Change the state of the capture, the caller changes the
+ * state of the sniffer: SNIFF for CAPT_ARMED and CAPT_RUN, IDLE for
+ * CAPT_UPLOAD.
+ *
+ * @return false, if the bootloader has no page service or an upload
+ *         is running
+ */
+bool capt_set(capt_state_t next)
+{
+    if (!wibo_svc_available() ||
+        ((ctx.capt == CAPT_UPLOAD) && (next != CAPT_OFF)))
+    {
+        return false;
+    }
+    switch (next)
+    {
+        case CAPT_ARMED:
+        case CAPT_RUN:
+            ctx.capt_frames = 0;
+            break;
+        case CAPT_UPLOAD:
+            flash_log_rewind(&capt_log, &capt_pos);
+            /* the records and the end marker */
+            ctx.framed = true;
+            break;
+        case CAPT_OFF:
+        default:
+            break;
+    }
+    ctx.capt = next;
+    if (next != CAPT_UPLOAD)
+    {
+        /* keep the frames of the RAM page over a reset */
+        flash_log_flush(&capt_log);
+    }
+    return true;
+}
+
+/**
+ * @brief Write a record of the pcap pool to flash, called from the
+ * main loop in CAPT_RUN.
+ */
+void capt_store(pcap_packet_t *ppcap)
+{
+    if (flash_log_append(&capt_log, SNIFF_REC_PACKET, ppcap,
+                         PCAP_REC_SIZE(ppcap)) == FLASH_LOG_OK)
+    {
+        ctx.capt_frames++;
+    }
+    else
+    {
+        /* ring full, or the bootloader refused the page */
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            ctx.missed_frames++;
+        }
+        ctx.capt = CAPT_OFF;
+        flash_log_flush(&capt_log);
+    }
+}
+
+/**
+ * @brief Upload the next record from flash, called from the main loop
+ * in CAPT_UPLOAD.
+ */
+void capt_continue(void)
+{
+int16_t len;
+uint8_t tag;
+
+    if (upload_busy())
+    {
+        return;
+    }
+    len = flash_log_read(&capt_log, &capt_pos, &tag, &capt_pkt,
+                         sizeof(capt_pkt));
+    if (len < 0)
+    {
+        flash_log_consume(&capt_log, &capt_pos);
+        flash_log_flush(&capt_log);
+        ctx.capt = CAPT_OFF;
+        ctx.info_due = true;
+        return;
+    }
+    if ((tag == SNIFF_REC_PACKET) &&
+        (len == PCAP_REC_SIZE(&capt_pkt)))
+    {
+        upload_packet(&capt_pkt, NULL);
+    }
+}
+
+/**
+ * @brief Number of pages, which can still be written.
+ */
+uint16_t capt_free_pages(void)
+{
+    if (!wibo_svc_available())
+    {
+        return 0;
+    }
+    return flash_log_free_pages(&capt_log);
+}
+
+#else /* !defined(CAPT_FLASH_START) */
+
+void capt_init(void)
+{
+}
+
+bool capt_set(capt_state_t next)
+{
+    return (next == CAPT_OFF);
+}
+
+void capt_store(pcap_packet_t *ppcap)
+{
+}
+
+void capt_continue(void)
+{
+}
+
+uint16_t capt_free_pages(void)
+{
+    return 0;
+}
+
+#endif /* defined(CAPT_FLASH_START) */
+/* EOF */
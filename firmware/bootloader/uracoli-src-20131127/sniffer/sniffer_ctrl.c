@@ -35,6 +35,7 @@
  */
 /* === includes ============================================================ */
 #include "sniffer.h"
+#include "stack_watch.h"
 
 /* === macros ============================================================== */
 
@@ -46,6 +47,22 @@
  * Tools/cmdhash.py parms cmset cmclr cmask chan cpage ed scan sniff idle
  */
 typedef enum {
+     /** Hashvalue for command 'capture' */
+     CMD_CAPTURE = 0xe0,
+     /** Hashvalue for command 'trigger' */
+     CMD_TRIGGER = 0x13,
+     /** Hashvalue for command 'spectrum' */
+     CMD_SPECTRUM = 0xec,
+     /** Hashvalue for command 'stats' */
+     CMD_STATS = 0x71,
+     /** Hashvalue for command 'filter' */
+     CMD_FILTER = 0x94,
+     /** Hashvalue for command 'snap' */
+     CMD_SNAP = 0x56,
+     /** Hashvalue for command 'hop' */
+     CMD_HOP = 0xf3,
+     /** Hashvalue for command 'framed' */
+     CMD_FRAMED = 0x20,
      /** Hashvalue for command 'chkcrc' */
      CMD_CHKCRC = 0x23,
      /** Hashvalue for command 'timeset' */
@@ -78,12 +95,45 @@ typedef enum {
      CMD_EMPTY = 0x00,
 } SHORTENUM cmd_hash_t;
 
+/** field names of the 'filter' command */
+typedef enum {
+     /** Hashvalue for filter field 'pan' */
+     FLT_PAN = 0x2d,
+     /** Hashvalue for filter field 'src' */
+     FLT_SRC = 0x43,
+     /** Hashvalue for filter field 'dst' */
+     FLT_DST = 0x73,
+     /** Hashvalue for filter field 'type' */
+     FLT_TYPE = 0x84,
+     /** Hashvalue for filter field 'cmd' */
+     FLT_CMD = 0xa4,
+     /** Hashvalue for filter field 'clr' */
+     FLT_CLR = 0x92,
+} SHORTENUM flt_hash_t;
+
+/** actions of the 'capture' command */
+typedef enum {
+     /** Hashvalue for capture action 'start' */
+     CAPCMD_START = 0xb6,
+     /** Hashvalue for capture action 'arm' */
+     CAPCMD_ARM = 0x4f,
+     /** Hashvalue for capture action 'stop' */
+     CAPCMD_STOP = 0x94,
+     /** Hashvalue for capture action 'upload' */
+     CAPCMD_UPLOAD = 0x60,
+} SHORTENUM capt_hash_t;
+
 /* === globals ============================================================= */
 
 /* === prototypes ========================================================== */
 static bool process_hotkey(char cmdkey);
 static bool process_command(char * cmd);
+static bool process_filter(uint8_t argc, char **argv, sniff_filter_t *dst);
+static bool process_capture(uint8_t argc, char **argv,
+                            sniffer_state_t *next_state);
 static cmd_hash_t get_cmd_hash(char *cmd);
+static bool process_ctrl_byte(uint8_t b);
+static uint8_t process_ctrl(uint8_t op, const uint8_t *arg, uint8_t len);
 
 /* === functions =========================================================== */
 
@@ -91,12 +141,18 @@ void ctrl_process_input(void)
 {
 bool success;
 int inchar;
-static char  cmdline[16];
+static char  cmdline[32];
 static uint8_t  cmdidx = 0;
+static bool binary = false;
 
     /* command processing */
     inchar = hif_getc();
-    if(EOF != inchar)
+    if (EOF != inchar && (binary || (cmdidx == 0 && inchar == SNIFF_REC_SOF)))
+    {
+        /* control records start with a byte, that no text command has */
+        binary = process_ctrl_byte((uint8_t)inchar);
+    }
+    else if(EOF != inchar)
     {
         cmdline[cmdidx++] = (char) inchar;
         if (inchar == '\n' || inchar == '\r')
@@ -154,7 +210,7 @@ static bool process_hotkey(char cmdkey)
             break;
 
         case '+':
-            if (ctx.state != SCAN)
+            if (ctx.state != SCAN && ctx.state != SPECTRUM)
             {
                 ctx.cchan = (ctx.cchan >= TRX_MAX_CHANNEL) ? TRX_MIN_CHANNEL : ctx.cchan + 1;
                 trx_bit_write(SR_CHANNEL, ctx.cchan);
@@ -163,7 +219,7 @@ static bool process_hotkey(char cmdkey)
             break;
 
         case '-':
-            if (ctx.state != SCAN)
+            if (ctx.state != SCAN && ctx.state != SPECTRUM)
             {
                 ctx.cchan = (ctx.cchan <= TRX_MIN_CHANNEL) ? TRX_MAX_CHANNEL : ctx.cchan - 1;
                 trx_bit_write(SR_CHANNEL, ctx.cchan);
@@ -290,6 +346,40 @@ static bool process_command(char * cmd)
             PRINTF("TICK_NUMBER: %ld"NL, HWTIMER_TICK_NB);
             PRINTF("CHKCRC: %d"NL, ctx.chkcrc);
             PRINTF("MISSED_FRAMES: %d"NL,ctx.missed_frames);
+            PRINTF("FRAMED: %d"NL, ctx.framed);
+            PRINTF("HOP_DWELL: %ld"NL, ctx.hopdwell);
+            PRINTF("SPEC_PERIOD: %ld"NL, ctx.specper);
+            PRINTF("FILTER: 0x%02x pan=0x%04x src=0x%04x dst=0x%04x"
+                   " types=0x%02x cmd=0x%02x snap=%d"NL,
+                   ctx.filter.flags, ctx.filter.pan, ctx.filter.src,
+                   ctx.filter.dst, ctx.filter.ftypes, ctx.filter.cmd,
+                   ctx.filter.snaplen);
+            PRINTF("FILTERED: %d"NL, ctx.filtered);
+            PRINTF("TRIGGER: 0x%02x pan=0x%04x src=0x%04x dst=0x%04x"
+                   " types=0x%02x cmd=0x%02x"NL,
+                   ctx.trigger.flags, ctx.trigger.pan, ctx.trigger.src,
+                   ctx.trigger.dst, ctx.trigger.ftypes, ctx.trigger.cmd);
+            PRINTF("CAPTURE: %d frames=%u free_pages=%u"NL, ctx.capt,
+                   ctx.capt_frames, capt_free_pages());
+            {
+                radio_chsw_stats_t chs;
+
+                radio_chsw_stats(&chs, false);
+                PRINTF("CHSW: n=%u fails=%u min=%u avg=%u max=%u us"NL,
+                       chs.switches, chs.fails,
+                       chs.switches ? chs.min_us : 0,
+                       chs.switches ? (unsigned) (chs.sum_us / chs.switches) : 0,
+                       chs.max_us);
+            }
+#if defined(STACK_WATCH)
+            {
+                stack_watch_t st;
+
+                stack_watch_get(&st);
+                PRINTF("STACK: data=%u peak=%u unused=%u free=%u"NL,
+                       st.data, st.peak, st.unused, st.free);
+            }
+#endif
             break;
         case CMD_SCAN:
             next_state = SCAN;
@@ -297,6 +387,18 @@ static bool process_command(char * cmd)
         case CMD_SNIFF:
             next_state = SNIFF;
             break;
+        case CMD_STATS:
+            /* snapshot period in ms */
+            ctx.statsper = MSEC((argc < 2) ? STATS_PERIOD_MS :
+                                strtol(argv[1],NULL,10));
+            next_state = STATS;
+            break;
+        case CMD_SPECTRUM:
+            /* record period in ms */
+            ctx.specper = MSEC((argc < 2) ? SPEC_PERIOD_MS :
+                               strtol(argv[1],NULL,10));
+            next_state = SPECTRUM;
+            break;
         case CMD_IDLE:
             next_state = IDLE;
             break;
@@ -323,6 +425,41 @@ static bool process_command(char * cmd)
             }
             PRINTF("crc_ok=%d"NL,ctx.chkcrc );
             break;
+        case CMD_FRAMED:
+            if (argc < 2)
+            {
+                ctx.framed ^= 1;
+            }
+            else
+            {
+                ctx.framed = (atoi(argv[1]) != 0);
+            }
+            PRINTF("framed=%d"NL, ctx.framed);
+            break;
+        case CMD_FILTER:
+            cmdok = process_filter(argc, argv, &ctx.filter);
+            break;
+        case CMD_TRIGGER:
+            cmdok = process_filter(argc, argv, &ctx.trigger);
+            break;
+        case CMD_CAPTURE:
+            cmdok = process_capture(argc, argv, &next_state);
+            break;
+        case CMD_SNAP:
+            cli();
+            ctx.filter.snaplen = (argc < 2) ? 0 : atoi(argv[1]);
+            sei();
+            break;
+        case CMD_HOP:
+            /* dwell time in ms, 0 switches hopping off */
+            ctx.hopdwell = (argc < 2) ? 0 : MSEC(strtol(argv[1],NULL,10));
+            if (ctx.state == SNIFF)
+            {
+                /* restart sniffing with the new setting */
+                sniffer_stop();
+                sniffer_start(SNIFF);
+            }
+            break;
         case CMD_EMPTY:
             break;
         default:
@@ -349,6 +486,261 @@ static bool process_command(char * cmd)
     return false;
 }
 
+/**
+ * @brief Set a clause of the capture filter or of the trigger.
+ *
+ * Usage: "filter pan|src|dst|type|cmd VALUE" adds a clause,
+ * where VALUE is a bit mask of frame types for 'type';
+ * "filter clr" or "filter" removes all clauses. "trigger" takes
+ * the same arguments.
+ */
+static bool process_filter(uint8_t argc, char **argv, sniff_filter_t *dst)
+{
+sniff_filter_t flt;
+uint16_t val = 0;
+bool ret = true;
+
+    flt = *dst;
+    if (argc > 2)
+    {
+        val = strtol(argv[2], NULL, 0);
+    }
+    else if (argc == 2 && get_cmd_hash(argv[1]) != FLT_CLR)
+    {
+        return false;
+    }
+
+    switch ((argc < 2) ? FLT_CLR : get_cmd_hash(argv[1]))
+    {
+        case FLT_PAN:
+            flt.pan = val;
+            flt.flags |= SNIFF_FLT_PAN;
+            break;
+        case FLT_SRC:
+            flt.src = val;
+            flt.flags |= SNIFF_FLT_SRC;
+            break;
+        case FLT_DST:
+            flt.dst = val;
+            flt.flags |= SNIFF_FLT_DST;
+            break;
+        case FLT_TYPE:
+            flt.ftypes = val;
+            flt.flags |= SNIFF_FLT_FTYPE;
+            break;
+        case FLT_CMD:
+            flt.cmd = val;
+            flt.flags |= SNIFF_FLT_CMD;
+            break;
+        case FLT_CLR:
+            flt.flags = 0;
+            break;
+        default:
+            ret = false;
+            break;
+    }
+
+    cli();
+    *dst = flt;
+    sei();
+    return ret;
+}
+
+/**
+ * @brief Capture to flash, see sniffer_capt.c
+ *
+ * Usage: "capture start" writes the frames to flash from now on,
+ * "capture arm" from the first frame passing the trigger, both start
+ * sniffing; "capture stop" ends it, "capture upload" sends the frames
+ * in flash and goes to IDLE; "capture" shows the state.
+ */
+static bool process_capture(uint8_t argc, char **argv,
+                            sniffer_state_t *next_state)
+{
+bool ret = true;
+
+    if (argc < 2)
+    {
+        PRINTF("capture=%d frames=%u free_pages=%u"NL, ctx.capt,
+               ctx.capt_frames, capt_free_pages());
+        return true;
+    }
+    switch ((capt_hash_t)get_cmd_hash(argv[1]))
+    {
+        case CAPCMD_START:
+            ret = capt_set(CAPT_RUN);
+            *next_state = SNIFF;
+            break;
+        case CAPCMD_ARM:
+            ret = capt_set(CAPT_ARMED);
+            *next_state = SNIFF;
+            break;
+        case CAPCMD_STOP:
+            ret = capt_set(CAPT_OFF);
+            break;
+        case CAPCMD_UPLOAD:
+            *next_state = IDLE;
+            ret = capt_set(CAPT_UPLOAD);
+            break;
+        default:
+            ret = false;
+            break;
+    }
+    if (!ret)
+    {
+        *next_state = ctx.state;
+    }
+    return ret;
+}
+
+/**
+ * @brief Collect a control record from the host.
+ *
+ * @return true, while the record is not complete
+ */
+static bool process_ctrl_byte(uint8_t b)
+{
+static uint8_t rec[sizeof(sniff_rec_hdr_t) + SNIFF_CTRL_MAX_LEN +
+                   sizeof(sniff_rec_tail_t)];
+static uint8_t idx = 0;
+sniff_rec_hdr_t *hdr = (sniff_rec_hdr_t*)rec;
+uint16_t crc;
+uint8_t i, end;
+
+    rec[idx++] = b;
+    if (idx <= offsetof(sniff_rec_hdr_t, len))
+    {
+        return true;
+    }
+    if (hdr->type != SNIFF_REC_CTRL || hdr->len == 0 ||
+        hdr->len > SNIFF_CTRL_MAX_LEN)
+    {
+        idx = 0;
+        return false;
+    }
+    end = sizeof(sniff_rec_hdr_t) + hdr->len;
+    if (idx < end + sizeof(sniff_rec_tail_t))
+    {
+        return true;
+    }
+    idx = 0;
+
+    crc = SNIFF_REC_CRC_INIT;
+    for (i = 0; i < end; i++)
+    {
+        crc = _crc_ccitt_update(crc, rec[i]);
+    }
+    if (rec[end] != (crc & 0xff) || rec[end + 1] != (crc >> 8) ||
+        rec[end + 2] != SNIFF_REC_EOF)
+    {
+        return false;
+    }
+
+    /* a second request before the answer to the first was sent
+     * overwrites it, the host has to wait for the answers */
+    ctx.ack.seq = hdr->seq;
+    ctx.ack.op = rec[sizeof(sniff_rec_hdr_t)];
+    ctx.ack.status = process_ctrl(ctx.ack.op, &rec[sizeof(sniff_rec_hdr_t) + 1],
+                                  hdr->len - 1);
+    ctx.ack_due = true;
+    return false;
+}
+
+/**
+ * @brief Carry out a control request, without any text output.
+ *
+ * @return SNIFF_CTRL_OK or SNIFF_CTRL_EINVAL
+ */
+static uint8_t process_ctrl(uint8_t op, const uint8_t *arg, uint8_t len)
+{
+sniffer_state_t next_state;
+
+    switch (op)
+    {
+        case SNIFF_CTRL_CHAN:
+            if (len != 1 || ctx.state == SCAN || ctx.state == SPECTRUM ||
+                arg[0] < TRX_MIN_CHANNEL || arg[0] > TRX_MAX_CHANNEL)
+            {
+                return SNIFF_CTRL_EINVAL;
+            }
+            ctx.cchan = arg[0];
+            trx_bit_write(SR_CHANNEL, ctx.cchan);
+            break;
+        case SNIFF_CTRL_FILTER:
+            if (len != sizeof(sniff_filter_t))
+            {
+                return SNIFF_CTRL_EINVAL;
+            }
+            cli();
+            memcpy(&ctx.filter, arg, sizeof(sniff_filter_t));
+            sei();
+            break;
+        case SNIFF_CTRL_STATE:
+            if (len != 1)
+            {
+                return SNIFF_CTRL_EINVAL;
+            }
+            next_state = (sniffer_state_t)arg[0];
+            if (!(next_state == IDLE || next_state == SCAN ||
+                  next_state == SNIFF || next_state == STATS ||
+                  next_state == SPECTRUM))
+            {
+                return SNIFF_CTRL_EINVAL;
+            }
+            if (next_state == STATS && ctx.statsper == 0)
+            {
+                ctx.statsper = MSEC(STATS_PERIOD_MS);
+            }
+            if (next_state == SPECTRUM && ctx.specper == 0)
+            {
+                ctx.specper = MSEC(SPEC_PERIOD_MS);
+            }
+            if (next_state == SNIFF)
+            {
+                /* the answers are records, so are the packets */
+                ctx.framed = true;
+            }
+            if (next_state != ctx.state)
+            {
+                sniffer_stop();
+                sniffer_start(next_state);
+            }
+            break;
+        case SNIFF_CTRL_CHKCRC:
+            if (len != 1)
+            {
+                return SNIFF_CTRL_EINVAL;
+            }
+            ctx.chkcrc = (arg[0] != 0);
+            break;
+        case SNIFF_CTRL_CAPTURE:
+            if (len != 1 || arg[0] > CAPT_UPLOAD ||
+                !capt_set((capt_state_t)arg[0]))
+            {
+                return SNIFF_CTRL_EINVAL;
+            }
+            next_state = ctx.state;
+            if (arg[0] == CAPT_ARMED || arg[0] == CAPT_RUN)
+            {
+                ctx.framed = true;
+                next_state = SNIFF;
+            }
+            else if (arg[0] == CAPT_UPLOAD)
+            {
+                next_state = IDLE;
+            }
+            if (next_state != ctx.state)
+            {
+                sniffer_stop();
+                sniffer_start(next_state);
+            }
+            break;
+        default:
+            return SNIFF_CTRL_EINVAL;
+    }
+    return SNIFF_CTRL_OK;
+}
+
 static cmd_hash_t get_cmd_hash(char *cmd)
 {
 cmd_hash_t h, accu;
@@ -46,6 +46,7 @@
 /* === prototypes ========================================================== */
 static void show_status(channel_t choffs);
 time_t timer_scan(timer_arg_t t);
+time_t timer_hop(timer_arg_t t);
 
 /* === functions =========================================================== */
 
@@ -196,4 +197,62 @@ time_t timer_scan(timer_arg_t t)
     ctx.state = SCAN_DONE;
     return 0;
 }
+
+/**
+ * @brief Start channel hopping in sniff mode.
+ *
+ * The channels of ctx.cmask are captured in turn, each one for
+ * ctx.hopdwell timer ticks.
+ */
+void hop_start(void)
+{
+    if ((ctx.cmask & (1UL<<ctx.cchan)) == 0)
+    {
+        hop_next();
+    }
+    ctx.hop_due = false;
+    ctx.thdl = timer_start(timer_hop, ctx.hopdwell, 0);
+}
+
+/**
+ * @brief Switch to the next channel of ctx.cmask.
+ *
+ * Frames, which are received after the switch, are tagged with the
+ * new channel in the receive ISR.
+ */
+void hop_next(void)
+{
+channel_t chan;
+uint8_t i;
+
+    ctx.hop_due = false;
+    chan = ctx.cchan;
+    for (i = 0; i < TRX_NB_CHANNELS; i++)
+    {
+        CHANNEL_NEXT_CIRCULAR(chan);
+        if ((ctx.cmask & (1UL<<chan)) != 0)
+        {
+            break;
+        }
+    }
+    if (chan != ctx.cchan && (ctx.cmask & (1UL<<chan)) != 0)
+    {
+        /* returns when the PLL has locked on the new channel */
+        radio_set_channel_fast(chan);
+        cli();
+        ctx.cchan = chan;
+        sei();
+    }
+}
+
+/**
+ * @brief Timer routine called once for each dwell period.
+ *
+ * The SPI access for the channel switch is left to the main loop.
+ */
+time_t timer_hop(timer_arg_t t)
+{
+    ctx.hop_due = true;
+    return ctx.hopdwell;
+}
 /* EOF */
@@ -0,0 +1,229 @@
+/* Copyright (c) 2007 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Spectrum analyser mode of @ref grpAppSniffer
+ *
+ * In state SPECTRUM, the main loop steps through the channels of
+ * ctx.cmask and starts an ED measurement on each one, as fast as the
+ * PLL settles and the measurement completes (about 160 us per channel
+ * at 2.4 GHz). The values go into a histogram per channel. Once per
+ * period, one @ref SNIFF_REC_SPECTRUM record with minimum, average,
+ * 50/90/99 percentiles and maximum of each channel is sent and the
+ * histograms start again, so short bursts (Wi-Fi beacons, microwave
+ * ovens) show in the maximum and the upper percentiles.
+ *
+ * One sample is taken per call of spectrum_continue(), so that the
+ * HIF and the timers are served in between.
+ *
+ * @ingroup grpAppSniffer
+ */
+
+/* === includes ============================================================ */
+#include "sniffer.h"
+
+/* === macros ============================================================== */
+
+/* === types =============================================================== */
+typedef struct spec_chan_tag
+{
+    uint16_t n;
+    uint8_t min;
+    uint8_t max;
+    uint32_t sum;
+    uint16_t hist[SPEC_NBINS];
+} spec_chan_t;
+
+/* === globals ============================================================= */
+static spec_chan_t spec_tab[TRX_NB_CHANNELS];
+static uint16_t spec_sweeps;
+static volatile bool spec_due;
+static uint8_t spec_snap;
+static struct
+{
+    spec_rec_hdr_t hdr;
+    spec_entry_t entry[TRX_NB_CHANNELS];
+} spec_rec;
+
+/* === prototypes ========================================================== */
+time_t timer_spectrum(timer_arg_t t);
+
+/* === functions =========================================================== */
+
+static void spectrum_reset(void)
+{
+uint8_t i;
+
+    memset(spec_tab, 0, sizeof(spec_tab));
+    for (i = 0; i < TRX_NB_CHANNELS; i++)
+    {
+        spec_tab[i].min = 0xff;
+    }
+    spec_sweeps = 0;
+}
+
+/**
+ * @brief Initialize the spectrum mode.
+ */
+void spectrum_init(void)
+{
+    spectrum_reset();
+    spec_due = false;
+    if (ctx.specper == 0)
+    {
+        ctx.specper = MSEC(SPEC_PERIOD_MS);
+    }
+    if ((ctx.cmask & (1UL<<ctx.cchan)) == 0)
+    {
+        hop_next();
+    }
+    trx_reg_write(RG_TRX_STATE, CMD_RX_ON);
+    ctx.thdl = timer_start(timer_spectrum, ctx.specper, 0);
+}
+
+/**
+ * @brief ED value at the given share of the samples of a channel.
+ */
+static uint8_t spectrum_percentile(spec_chan_t *sc, uint8_t pct)
+{
+uint32_t lim, cnt;
+uint8_t bin;
+uint16_t val;
+
+    lim = ((uint32_t)sc->n * pct + 99) / 100;
+    cnt = 0;
+    for (bin = 0; bin < SPEC_NBINS - 1; bin++)
+    {
+        cnt += sc->hist[bin];
+        if (cnt >= lim)
+        {
+            break;
+        }
+    }
+    val = ((bin + 1) << SPEC_BIN_SHIFT) - 1;
+    return (val < sc->max) ? val : sc->max;
+}
+
+/**
+ * @brief Send the record of the period, while no upload is in flight.
+ */
+static void spectrum_upload(void)
+{
+spec_chan_t *sc;
+spec_entry_t *e;
+channel_t chan;
+uint8_t n;
+
+    n = 0;
+    for (chan = TRX_MIN_CHANNEL; chan <= TRX_MAX_CHANNEL; chan++)
+    {
+        sc = &spec_tab[chan - TRX_MIN_CHANNEL];
+        if ((ctx.cmask & (1UL<<chan)) == 0 || sc->n == 0)
+        {
+            continue;
+        }
+        e = &spec_rec.entry[n++];
+        e->chan = chan;
+        e->min = sc->min;
+        e->avg = sc->sum / sc->n;
+        e->p50 = spectrum_percentile(sc, 50);
+        e->p90 = spectrum_percentile(sc, 90);
+        e->p99 = spectrum_percentile(sc, 99);
+        e->max = sc->max;
+    }
+    spec_rec.hdr.snap = spec_snap++;
+    spec_rec.hdr.nchan = n;
+    spec_rec.hdr.sweeps = spec_sweeps;
+    spectrum_reset();
+    spec_due = false;
+    upload_record(SNIFF_REC_SPECTRUM, &spec_rec,
+                  sizeof(spec_rec_hdr_t) + n * sizeof(spec_entry_t));
+}
+
+/**
+ * @brief Take one ED sample and move to the next channel, called from
+ * the main loop.
+ */
+void spectrum_continue(void)
+{
+spec_chan_t *sc;
+channel_t chan;
+uint8_t ed, bin;
+
+    /* the record buffer must not change while it is sent */
+    if (spec_due && !upload_busy())
+    {
+        spectrum_upload();
+    }
+
+    /* a write starts the measurement */
+    trx_reg_write(RG_PHY_ED_LEVEL, 0);
+    DELAY_US(SPEC_ED_US);
+    ed = trx_reg_read(RG_PHY_ED_LEVEL);
+
+    sc = &spec_tab[CHANNEL_OFFSET(ctx.cchan)];
+    /* 0xff is a measurement which did not complete */
+    if ((ed < (SPEC_NBINS << SPEC_BIN_SHIFT)) && (sc->n < 0xffff))
+    {
+        sc->n++;
+        sc->sum += ed;
+        bin = ed >> SPEC_BIN_SHIFT;
+        if (sc->hist[bin] < 0xffff)
+        {
+            sc->hist[bin]++;
+        }
+        if (ed < sc->min)
+        {
+            sc->min = ed;
+        }
+        if (ed > sc->max)
+        {
+            sc->max = ed;
+        }
+    }
+
+    chan = ctx.cchan;
+    hop_next();
+    if (ctx.cchan <= chan)
+    {
+        /* wrapped around, or a single channel */
+        spec_sweeps++;
+    }
+}
+
+/**
+ * @brief Timer routine called once for each spectrum period.
+ */
+time_t timer_spectrum(timer_arg_t t)
+{
+    spec_due = true;
+    return ctx.specper;
+}
+/* EOF */
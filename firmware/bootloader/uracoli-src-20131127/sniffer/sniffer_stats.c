@@ -0,0 +1,241 @@
+/* Copyright (c) 2007 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Per node statistics of @ref grpAppSniffer
+ *
+ * In state STATS, the receive ISR counts frames, bytes, LQI and
+ * retransmissions for each short source address in a small hash
+ * table. Periodically, the main loop sends a snapshot of the table as
+ * a series of @ref SNIFF_REC_STATS records, so the network can be
+ * watched permanently without uploading each frame.
+ *
+ * @ingroup grpAppSniffer
+ */
+
+/* === includes ============================================================ */
+#include "sniffer.h"
+
+/* === macros ============================================================== */
+#if (STATS_MAX_NODES & (STATS_MAX_NODES - 1)) || (STATS_MAX_NODES > 128)
+# error "STATS_MAX_NODES must be a power of 2, up to 128"
+#endif
+
+/** address of an unused table slot, broadcast is never a source */
+#define STATS_ADDR_FREE (0xffff)
+
+/* === types =============================================================== */
+typedef struct stats_node_tag
+{
+    uint16_t addr;
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t lqisum;
+    uint16_t retries;
+    uint8_t lastseq;
+} stats_node_t;
+
+/* === globals ============================================================= */
+static stats_node_t stats_tab[STATS_MAX_NODES];
+static uint16_t stats_overflow;
+static volatile bool stats_due;
+/** table index of the next entry of a running snapshot */
+static uint8_t stats_next;
+static bool stats_running;
+static uint8_t stats_snap;
+static struct
+{
+    stats_rec_hdr_t hdr;
+    stats_entry_t entry[STATS_ENTRIES_PER_REC];
+} stats_rec;
+
+/* === prototypes ========================================================== */
+time_t timer_stats(timer_arg_t t);
+
+/* === functions =========================================================== */
+
+/**
+ * @brief Initialize the statistics mode.
+ */
+void stats_init(void)
+{
+uint8_t i;
+
+    cli();
+    for (i = 0; i < STATS_MAX_NODES; i++)
+    {
+        stats_tab[i].addr = STATS_ADDR_FREE;
+    }
+    stats_overflow = 0;
+    sei();
+    stats_running = false;
+    stats_due = false;
+
+    if (ctx.statsper == 0)
+    {
+        ctx.statsper = MSEC(STATS_PERIOD_MS);
+    }
+    trx_reg_write(RG_TRX_STATE, CMD_RX_ON);
+    ctx.thdl = timer_start(timer_stats, ctx.statsper, 0);
+}
+
+/**
+ * @brief Find or add the table entry of a node, called from the receive ISR.
+ * @return NULL, if the table is full.
+ */
+static stats_node_t * stats_lookup(uint16_t addr)
+{
+stats_node_t *node;
+uint8_t i, idx;
+
+    idx = (addr ^ (addr >> 8)) & (STATS_MAX_NODES - 1);
+    for (i = 0; i < STATS_MAX_NODES; i++)
+    {
+        node = &stats_tab[idx];
+        if (node->addr == addr)
+        {
+            return node;
+        }
+        if (node->addr == STATS_ADDR_FREE)
+        {
+            memset(node, 0, sizeof(stats_node_t));
+            node->addr = addr;
+            return node;
+        }
+        idx = (idx + 1) & (STATS_MAX_NODES - 1);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Count a received frame, called from the receive ISR.
+ */
+void stats_update_frame(const uint8_t *frm, uint8_t flen, bool crc_ok,
+                        uint8_t lqi)
+{
+mac_hdr_t hdr;
+stats_node_t *node;
+
+    if (!crc_ok || !mac_hdr_parse(frm, flen, &hdr) ||
+        !(hdr.found & SNIFF_FLT_SRC) || hdr.src == STATS_ADDR_FREE)
+    {
+        return;
+    }
+    node = stats_lookup(hdr.src);
+    if (node == NULL)
+    {
+        if (stats_overflow < 0xffff)
+        {
+            stats_overflow++;
+        }
+        return;
+    }
+    if (node->frames > 0 && node->lastseq == frm[2])
+    {
+        node->retries++;
+    }
+    node->lastseq = frm[2];
+    node->frames++;
+    node->bytes += flen;
+    node->lqisum += lqi;
+}
+
+/**
+ * @brief Send the next part of a snapshot, called from the main loop.
+ *
+ * A snapshot is started by the timer and sent in records of
+ * STATS_ENTRIES_PER_REC nodes, one record per call, whenever the
+ * previous upload is done.
+ */
+void stats_continue(void)
+{
+stats_node_t node;
+stats_entry_t *e;
+uint8_t n;
+
+    if (!stats_running)
+    {
+        if (!stats_due)
+        {
+            return;
+        }
+        stats_due = false;
+        stats_running = true;
+        stats_next = 0;
+        stats_snap++;
+    }
+
+    /* the buffer of the previous record must not change while it is sent */
+    if (upload_busy())
+    {
+        return;
+    }
+
+    stats_rec.hdr.snap = stats_snap;
+    stats_rec.hdr.flags = 0;
+    cli();
+    stats_rec.hdr.overflow = stats_overflow;
+    sei();
+    n = 0;
+    while (stats_next < STATS_MAX_NODES && n < STATS_ENTRIES_PER_REC)
+    {
+        cli();
+        node = stats_tab[stats_next];
+        sei();
+        stats_next++;
+        if (node.addr == STATS_ADDR_FREE)
+        {
+            continue;
+        }
+        e = &stats_rec.entry[n++];
+        e->addr = node.addr;
+        e->frames = node.frames;
+        e->bytes = node.bytes;
+        e->retries = node.retries;
+        e->lqi = (node.frames > 0) ? node.lqisum / node.frames : 0;
+    }
+    if (stats_next >= STATS_MAX_NODES)
+    {
+        stats_rec.hdr.flags = STATS_REC_LAST;
+        stats_running = false;
+    }
+    upload_record(SNIFF_REC_STATS, &stats_rec,
+                  sizeof(stats_rec_hdr_t) + n * sizeof(stats_entry_t));
+}
+
+/**
+ * @brief Timer routine called once for each snapshot period.
+ */
+time_t timer_stats(timer_arg_t t)
+{
+    stats_due = true;
+    return ctx.statsper;
+}
+/* EOF */
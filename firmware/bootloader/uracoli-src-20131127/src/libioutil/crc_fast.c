@@ -0,0 +1,167 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+/* $Id$ */
+/**
+ * @file
+ * @brief Block and flash range CRCs, see crc_fast.h
+ *
+ * @ingroup grpIoUtil
+ */
+
+/* === includes ========================================== */
+#include <avr/pgmspace.h>
+#include <util/crc16.h>
+#include "crc_fast.h"
+
+/* === macros ============================================ */
+#if !defined(__AVR__)
+/* host simulation, the tables are in the host memory, the image in the
+ * flash of the simulated node */
+# define CRC_FLASH_DWORD(a) pgm_read_dword_far(a)
+# define CRC_FLASH_BYTE(a) pgm_read_byte_far(a)
+# define CRC_TABLE_ADDR(t) ((uintptr_t)(t))
+# define CRC_TABLE_DWORD(a) pgm_read_dword(a)
+typedef uintptr_t crc_table_addr_t;
+#elif FLASHEND > 0xFFFFUL
+# define CRC_FLASH_DWORD(a) pgm_read_dword_far(a)
+# define CRC_FLASH_BYTE(a) pgm_read_byte_far(a)
+# define CRC_TABLE_ADDR(t) pgm_get_far_address(t)
+# define CRC_TABLE_DWORD(a) pgm_read_dword_far(a)
+typedef uint32_t crc_table_addr_t;
+#else
+# define CRC_FLASH_DWORD(a) pgm_read_dword((uint16_t)(a))
+# define CRC_FLASH_BYTE(a) pgm_read_byte((uint16_t)(a))
+# define CRC_TABLE_ADDR(t) ((uint16_t)(t))
+# define CRC_TABLE_DWORD(a) pgm_read_dword(a)
+typedef uint16_t crc_table_addr_t;
+#endif
+
+/* === globals =========================================== */
+/** CRC32 of the byte values 0x00 ... 0x0F */
+static const uint32_t crc32_lo[16] PROGMEM =
+{
+    0x00000000UL, 0x77073096UL, 0xEE0E612CUL, 0x990951BAUL,
+    0x076DC419UL, 0x706AF48FUL, 0xE963A535UL, 0x9E6495A3UL,
+    0x0EDB8832UL, 0x79DCB8A4UL, 0xE0D5E91EUL, 0x97D2D988UL,
+    0x09B64C2BUL, 0x7EB17CBDUL, 0xE7B82D07UL, 0x90BF1D91UL,
+};
+
+/** CRC32 of the byte values 0x00, 0x10 ... 0xF0 */
+static const uint32_t crc32_hi[16] PROGMEM =
+{
+    0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL,
+    0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+    0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL,
+    0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL,
+};
+
+/* === functions ========================================= */
+/*
+ * The CRC is linear, the table entry of a byte is the XOR of the entries
+ * of its two nibbles.
+ */
+static inline uint32_t crc32_step(uint32_t crc, uint8_t x,
+        crc_table_addr_t lo, crc_table_addr_t hi)
+{
+    x ^= (uint8_t)crc;
+    return (crc >> 8) ^ CRC_TABLE_DWORD(lo + ((x & 0x0F) << 2))
+                      ^ CRC_TABLE_DWORD(hi + ((x >> 4) << 2));
+}
+
+uint16_t crc_ccitt_block(uint16_t crc, const uint8_t *p, uint16_t len)
+{
+    while (len--)
+    {
+        crc = _crc_ccitt_update(crc, *p++);
+    }
+    return crc;
+}
+
+uint16_t crc_ccitt_flash(uint16_t crc, uint32_t addr, uint32_t len)
+{
+uint32_t d;
+uint8_t i;
+
+    while (len >= 4)
+    {
+        d = CRC_FLASH_DWORD(addr);
+        for (i = 0; i < 4; i++)
+        {
+            crc = _crc_ccitt_update(crc, (uint8_t)d);
+            d >>= 8;
+        }
+        addr += 4;
+        len -= 4;
+    }
+    while (len--)
+    {
+        crc = _crc_ccitt_update(crc, CRC_FLASH_BYTE(addr));
+        addr++;
+    }
+    return crc;
+}
+
+uint32_t crc32_block(uint32_t crc, const uint8_t *p, uint16_t len)
+{
+crc_table_addr_t lo = CRC_TABLE_ADDR(crc32_lo);
+crc_table_addr_t hi = CRC_TABLE_ADDR(crc32_hi);
+
+    crc = ~crc;
+    while (len--)
+    {
+        crc = crc32_step(crc, *p++, lo, hi);
+    }
+    return ~crc;
+}
+
+uint32_t crc32_flash(uint32_t crc, uint32_t addr, uint32_t len)
+{
+crc_table_addr_t lo = CRC_TABLE_ADDR(crc32_lo);
+crc_table_addr_t hi = CRC_TABLE_ADDR(crc32_hi);
+uint32_t d;
+uint8_t i;
+
+    crc = ~crc;
+    while (len >= 4)
+    {
+        d = CRC_FLASH_DWORD(addr);
+        for (i = 0; i < 4; i++)
+        {
+            crc = crc32_step(crc, (uint8_t)d, lo, hi);
+            d >>= 8;
+        }
+        addr += 4;
+        len -= 4;
+    }
+    while (len--)
+    {
+        crc = crc32_step(crc, CRC_FLASH_BYTE(addr), lo, hi);
+        addr++;
+    }
+    return ~crc;
+}
@@ -0,0 +1,186 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Wear levelled EEPROM journal, see ee_journal.h
+ *
+ * RAM index: the slot of the current record of each key, the highest
+ * sequence number and the slot after its record, where the search for
+ * a free slot starts.
+ *
+ * @ingroup grpIoUtil
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#include "ee_journal.h"
+
+/* === macros ============================================ */
+#define EJ_NONE (0xff)
+#define EJ_SLOT_ADDR(i) \
+    ((uint8_t *) (EE_JOURNAL_ADDR + (uint16_t) (i) * sizeof(ee_journal_rec_t)))
+
+#if EE_JOURNAL_SLOTS <= EE_JOURNAL_KEYS
+# error "EE_JOURNAL_SLOTS must be larger than EE_JOURNAL_KEYS"
+#endif
+
+/* === globals =========================================== */
+static bool ej_ready;
+static uint8_t ej_slot[EE_JOURNAL_KEYS];
+static uint32_t ej_seq;
+static uint8_t ej_next;
+
+/* === functions ========================================= */
+static uint8_t ej_crc(const ee_journal_rec_t *rec)
+{
+const uint8_t *p = (const uint8_t *) rec;
+uint8_t i, crc = 0;
+
+    for (i = 0; i < sizeof(ee_journal_rec_t) - 1; i++)
+    {
+        crc = _crc_ibutton_update(crc, p[i]);
+    }
+    return crc;
+}
+
+/**
+ * Read the record of slot i.
+ * @return false if the slot holds no valid record
+ */
+static bool ej_read_slot(uint8_t i, ee_journal_rec_t *rec)
+{
+    eeprom_read_block(rec, EJ_SLOT_ADDR(i), sizeof(ee_journal_rec_t));
+    return (rec->key < EE_JOURNAL_KEYS) &&
+           (rec->len > 0) && (rec->len <= EE_JOURNAL_DATA_MAX) &&
+           (rec->crc == ej_crc(rec));
+}
+
+void ee_journal_init(void)
+{
+ee_journal_rec_t rec;
+uint32_t seq[EE_JOURNAL_KEYS];
+uint8_t i;
+
+    memset(ej_slot, EJ_NONE, sizeof(ej_slot));
+    ej_seq = 0;
+    ej_next = 0;
+    for (i = 0; i < EE_JOURNAL_SLOTS; i++)
+    {
+        if (!ej_read_slot(i, &rec))
+        {
+            continue;
+        }
+        if ((ej_slot[rec.key] == EJ_NONE) || (rec.seq > seq[rec.key]))
+        {
+            ej_slot[rec.key] = i;
+            seq[rec.key] = rec.seq;
+        }
+        if (rec.seq >= ej_seq)
+        {
+            ej_seq = rec.seq;
+            ej_next = (i + 1) % EE_JOURNAL_SLOTS;
+        }
+    }
+    ej_ready = true;
+}
+
+uint8_t ee_journal_read(uint8_t key, void *buf, uint8_t max)
+{
+ee_journal_rec_t rec;
+
+    if (!ej_ready)
+    {
+        ee_journal_init();
+    }
+    if ((key >= EE_JOURNAL_KEYS) || (ej_slot[key] == EJ_NONE) ||
+        !ej_read_slot(ej_slot[key], &rec))
+    {
+        return 0;
+    }
+    memcpy(buf, rec.data, (rec.len < max) ? rec.len : max);
+    return rec.len;
+}
+
+uint8_t ee_journal_write(uint8_t key, const void *data, uint8_t len)
+{
+ee_journal_rec_t rec;
+uint8_t i, k, slot;
+
+    if ((key >= EE_JOURNAL_KEYS) || (len == 0) || (len > EE_JOURNAL_DATA_MAX))
+    {
+        return EE_JOURNAL_REJECTED;
+    }
+    if (!ej_ready)
+    {
+        ee_journal_init();
+    }
+    if ((ej_slot[key] != EJ_NONE) && ej_read_slot(ej_slot[key], &rec) &&
+        (rec.len == len) && (memcmp(rec.data, data, len) == 0))
+    {
+        /* unchanged, save the write cycles */
+        return EE_JOURNAL_OK;
+    }
+
+    /* the next slot in turn which is not a current record */
+    slot = ej_next;
+    for (i = 0; i < EE_JOURNAL_SLOTS; i++)
+    {
+        for (k = 0; (k < EE_JOURNAL_KEYS) && (ej_slot[k] != slot); k++)
+        {
+        }
+        if (k == EE_JOURNAL_KEYS)
+        {
+            break;
+        }
+        slot = (slot + 1) % EE_JOURNAL_SLOTS;
+    }
+
+    rec.key = key;
+    rec.seq = ej_seq + 1;
+    rec.len = len;
+    memset(rec.data, 0xff, sizeof(rec.data));
+    memcpy(rec.data, data, len);
+    rec.crc = ej_crc(&rec);
+    /* the CRC last, until then the slot is not valid */
+    eeprom_update_block(&rec, EJ_SLOT_ADDR(slot), sizeof(rec) - 1);
+    eeprom_update_byte(EJ_SLOT_ADDR(slot) + sizeof(rec) - 1, rec.crc);
+
+    ej_slot[key] = slot;
+    ej_seq = rec.seq;
+    ej_next = (slot + 1) % EE_JOURNAL_SLOTS;
+    return EE_JOURNAL_OK;
+}
+
+/* EOF */
@@ -0,0 +1,370 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Append-only record log in flash, see flash_log.h
+ *
+ * The head is the page after the valid page with the highest sequence
+ * number, the tail comes from the header of that page. A page of the
+ * ring holds sequence number head - npages until it is written again,
+ * so the oldest record that can still be read is in that page.
+ *
+ * @ingroup grpIoUtil
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+#include "flash_log.h"
+#include "crc_fast.h"
+#include "wibosvc.h"
+
+/* === macros ============================================ */
+#if FLASHEND > 0xFFFFUL
+# define FL_FLASH_BYTE(a) pgm_read_byte_far(a)
+#else
+# define FL_FLASH_BYTE(a) pgm_read_byte((uint16_t)(a))
+#endif
+
+/* flash address of the page of sequence number s */
+#define FL_PAGE_ADDR(fl, s) \
+    ((fl)->start + (uint32_t) ((s) % (fl)->npages) * SPM_PAGESIZE)
+
+/* === types ============================================= */
+typedef struct
+{
+    uint16_t magic;
+    uint32_t seq;
+    uint32_t tail_seq;
+    uint8_t  tail_off;
+    uint8_t  used;
+    uint16_t crc;
+} fl_hdr_t;
+
+typedef char fl_hdr_size_check[(sizeof(fl_hdr_t) == FLASH_LOG_HDR_SIZE) ? 1 : -1];
+
+typedef struct
+{
+    uint8_t  len;
+    uint8_t  tag;
+    uint16_t crc;
+} fl_rec_t;
+
+/* === functions ========================================= */
+static void fl_flash_read(void *dst, uint32_t addr, uint8_t len)
+{
+uint8_t *p = (uint8_t *) dst;
+
+    while (len--)
+    {
+        *p++ = FL_FLASH_BYTE(addr++);
+    }
+}
+
+/**
+ * Header of the page of sequence number seq.
+ * @return false if the page does not hold it
+ */
+static bool fl_read_hdr(flash_log_t *fl, uint32_t seq, fl_hdr_t *hdr)
+{
+    fl_flash_read(hdr, FL_PAGE_ADDR(fl, seq), sizeof(fl_hdr_t));
+    return (hdr->magic == FLASH_LOG_MAGIC) &&
+           (hdr->seq == seq) &&
+           (hdr->used <= FLASH_LOG_DATA_SIZE) &&
+           (hdr->crc == crc_ccitt_block(0, (uint8_t *) hdr,
+                                        sizeof(fl_hdr_t) - sizeof(hdr->crc)));
+}
+
+/**
+ * Oldest sequence number still in the ring.
+ */
+static uint32_t fl_oldest(flash_log_t *fl)
+{
+    return (fl->head > fl->npages) ? fl->head - fl->npages : 0;
+}
+
+static void fl_clear_buf(flash_log_t *fl)
+{
+    memset(fl->buf, 0xff, sizeof(fl->buf));
+    fl->used = 0;
+}
+
+/**
+ * Rebuild head and tail from the page headers.
+ */
+static void fl_mount(flash_log_t *fl)
+{
+fl_hdr_t hdr, last;
+uint16_t i;
+bool found = false;
+
+    if (fl->mounted)
+    {
+        return;
+    }
+    for (i = 0; i < fl->npages; i++)
+    {
+        fl_flash_read(&hdr, fl->start + (uint32_t) i * SPM_PAGESIZE, sizeof(hdr));
+        if ((hdr.magic != FLASH_LOG_MAGIC) || ((hdr.seq % fl->npages) != i) ||
+            (found && (hdr.seq <= last.seq)))
+        {
+            continue;
+        }
+        if (fl_read_hdr(fl, hdr.seq, &hdr))
+        {
+            last = hdr;
+            found = true;
+        }
+    }
+    fl->head = 0;
+    fl->tail.seq = 0;
+    fl->tail.off = 0;
+    if (found)
+    {
+        fl->head = last.seq + 1;
+        fl->tail.seq = last.tail_seq;
+        fl->tail.off = last.tail_off;
+        if (fl->tail.seq < fl_oldest(fl))
+        {
+            fl->tail.seq = fl_oldest(fl);
+            fl->tail.off = 0;
+        }
+    }
+    fl->tail_dirty = false;
+    fl_clear_buf(fl);
+    fl->mounted = true;
+}
+
+/**
+ * Write the RAM page with the current tail and start a new one.
+ */
+static uint8_t fl_write_page(flash_log_t *fl)
+{
+fl_hdr_t *hdr = (fl_hdr_t *) fl->buf;
+
+    if (!wibo_svc_available())
+    {
+        return FLASH_LOG_NOSVC;
+    }
+    /* the page written now still holds the sequence number head - npages */
+    if ((fl->head >= fl->npages) && (fl->tail.seq <= fl->head - fl->npages))
+    {
+        if (!(fl->flags & FLASH_LOG_OVERWRITE))
+        {
+            return FLASH_LOG_FULL;
+        }
+        fl->tail.seq = fl->head - fl->npages + 1;
+        fl->tail.off = 0;
+    }
+    hdr->magic = FLASH_LOG_MAGIC;
+    hdr->seq = fl->head;
+    hdr->tail_seq = fl->tail.seq;
+    hdr->tail_off = fl->tail.off;
+    hdr->used = fl->used;
+    hdr->crc = crc_ccitt_block(0, fl->buf, sizeof(fl_hdr_t) - sizeof(hdr->crc));
+    if (wibo_svc_page_write(FL_PAGE_ADDR(fl, fl->head), fl->buf) != WIBO_SVC_OK)
+    {
+        return FLASH_LOG_REJECTED;
+    }
+    fl->head++;
+    fl->tail_dirty = false;
+    fl_clear_buf(fl);
+    return FLASH_LOG_OK;
+}
+
+void flash_log_init(flash_log_t *fl, uint32_t start, uint16_t npages,
+                    uint8_t flags)
+{
+    fl->start = start;
+    fl->npages = npages;
+    fl->flags = flags;
+    fl->mounted = false;
+    fl->crc_errors = 0;
+}
+
+uint8_t flash_log_append(flash_log_t *fl, uint8_t tag,
+                         const void *data, uint8_t len)
+{
+fl_rec_t rec;
+uint8_t *p;
+uint8_t rv;
+
+    if (len > FLASH_LOG_MAX_LEN)
+    {
+        return FLASH_LOG_TOOBIG;
+    }
+    fl_mount(fl);
+    if (fl->used + sizeof(fl_rec_t) + len > FLASH_LOG_DATA_SIZE)
+    {
+        rv = fl_write_page(fl);
+        if (rv != FLASH_LOG_OK)
+        {
+            return rv;
+        }
+    }
+    rec.len = len;
+    rec.tag = tag;
+    rec.crc = crc_ccitt_block(crc_ccitt_block(0, &tag, 1), data, len);
+    p = &fl->buf[FLASH_LOG_HDR_SIZE + fl->used];
+    memcpy(p, &rec, sizeof(rec));
+    memcpy(p + sizeof(rec), data, len);
+    fl->used += sizeof(rec) + len;
+    return FLASH_LOG_OK;
+}
+
+uint8_t flash_log_flush(flash_log_t *fl)
+{
+    fl_mount(fl);
+    if ((fl->used == 0) && !fl->tail_dirty)
+    {
+        return FLASH_LOG_OK;
+    }
+    return fl_write_page(fl);
+}
+
+void flash_log_rewind(flash_log_t *fl, flash_log_pos_t *pos)
+{
+    fl_mount(fl);
+    *pos = fl->tail;
+}
+
+int16_t flash_log_read(flash_log_t *fl, flash_log_pos_t *pos,
+                       uint8_t *tag, void *buf, uint8_t max)
+{
+fl_hdr_t hdr;
+fl_rec_t rec;
+uint32_t addr = 0;
+uint16_t crc;
+uint8_t used;
+
+    fl_mount(fl);
+    if (pos->seq < fl_oldest(fl))
+    {
+        /* overwritten meanwhile */
+        pos->seq = fl_oldest(fl);
+        pos->off = 0;
+    }
+    while (pos->seq <= fl->head)
+    {
+        if (pos->seq == fl->head)
+        {
+            used = fl->used;
+        }
+        else if (fl_read_hdr(fl, pos->seq, &hdr))
+        {
+            used = hdr.used;
+            addr = FL_PAGE_ADDR(fl, pos->seq) + FLASH_LOG_HDR_SIZE;
+        }
+        else
+        {
+            used = 0;
+        }
+        if (pos->off + sizeof(fl_rec_t) > used)
+        {
+            if (pos->seq == fl->head)
+            {
+                break;
+            }
+            pos->seq++;
+            pos->off = 0;
+            continue;
+        }
+
+        if (pos->seq == fl->head)
+        {
+            memcpy(&rec, &fl->buf[FLASH_LOG_HDR_SIZE + pos->off], sizeof(rec));
+        }
+        else
+        {
+            fl_flash_read(&rec, addr + pos->off, sizeof(rec));
+        }
+        if (pos->off + sizeof(rec) + rec.len > used)
+        {
+            /* broken length, the rest of the page is lost */
+            fl->crc_errors++;
+            pos->off = used;
+            continue;
+        }
+        crc = crc_ccitt_block(0, &rec.tag, 1);
+        if (pos->seq == fl->head)
+        {
+            crc = crc_ccitt_block(crc, &fl->buf[FLASH_LOG_HDR_SIZE + pos->off + sizeof(rec)],
+                                  rec.len);
+            memcpy(buf, &fl->buf[FLASH_LOG_HDR_SIZE + pos->off + sizeof(rec)],
+                   (rec.len < max) ? rec.len : max);
+        }
+        else
+        {
+            crc = crc_ccitt_flash(crc, addr + pos->off + sizeof(rec), rec.len);
+            fl_flash_read(buf, addr + pos->off + sizeof(rec),
+                          (rec.len < max) ? rec.len : max);
+        }
+        pos->off += sizeof(rec) + rec.len;
+        if (crc != rec.crc)
+        {
+            fl->crc_errors++;
+            continue;
+        }
+        if ((pos->seq != fl->head) && (pos->off + sizeof(fl_rec_t) > used))
+        {
+            /* so that a consumed page does not hold the tail */
+            pos->seq++;
+            pos->off = 0;
+        }
+        *tag = rec.tag;
+        return rec.len;
+    }
+    return -1;
+}
+
+void flash_log_consume(flash_log_t *fl, const flash_log_pos_t *pos)
+{
+    fl_mount(fl);
+    if ((pos->seq > fl->tail.seq) ||
+        ((pos->seq == fl->tail.seq) && (pos->off > fl->tail.off)))
+    {
+        fl->tail = *pos;
+        fl->tail_dirty = true;
+    }
+}
+
+uint16_t flash_log_free_pages(flash_log_t *fl)
+{
+uint32_t live;
+
+    fl_mount(fl);
+    /* pages from the tail up to the one in RAM */
+    live = fl->head - fl->tail.seq + 1;
+    return (live < fl->npages) ? fl->npages - live : 0;
+}
+
+/* EOF */
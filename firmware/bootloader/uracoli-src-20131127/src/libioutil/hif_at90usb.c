@@ -77,6 +77,17 @@
 
 #define RXBUF_SIZE (sizeof(hif_rxbuf))
 #define RXBUF_MASK (RXBUF_SIZE-1)
+/** free bytes in the RX buffer */
+#define RXBUF_FREE() (RXBUF_MASK - ((rxhead - rxtail) & RXBUF_MASK))
+
+#define TXBUF_SIZE (sizeof(hif_txbuf))
+#define TXBUF_MASK (TXBUF_SIZE-1)
+/** bytes waiting in the TX buffer */
+#define TXBUF_USED() ((txhead - txtail) & TXBUF_MASK)
+/** free bytes in the TX buffer */
+#define TXBUF_FREE() (TXBUF_MASK - TXBUF_USED())
+
+#define DATA_EP_SIZE 64         /* size of the bulk endpoints, see ep_conf_table */
 
 #define CTRL_EP_SIZE 64         /* this is *not* easily customizable */
 
@@ -137,6 +148,8 @@ enum ep_num
 #if USB_DEBUG
 static int uart_putchar(char, FILE *);
 #endif
+static void hif_tx_kick(void);
+static void hif_rx_resume(void);
 
 /* === globals =========================================== */
 
@@ -145,7 +158,16 @@ static uint8_t hif_rxbuf[128];
 static volatile uint8_t rxhead;
 static volatile uint8_t rxtail;
 
-static volatile bool tx_data_pending;
+/*
+ * Transmit buffer, drained in full packets by the TX endpoint
+ * interrupt, and flushed as a short packet on each SOF.
+ */
+static uint8_t hif_txbuf[256];
+static volatile uint8_t txhead;
+static volatile uint8_t txtail;
+
+/* last packet was a full one, a ZLP ends the transfer */
+static bool tx_zlp;
 
 #if defined(LED_ACTIVITY)
 static volatile uint8_t led_active;
@@ -456,6 +478,7 @@ void hif_init(const uint32_t baudrate)
     }
 
     rxhead = rxtail = 0;
+    txhead = txtail = 0;
 }
 
 void hif_puts_p(const char *progmem_s)
@@ -488,44 +511,33 @@ void hif_puts(const char *s )
 /*
  * Transmit buffer
  */
-uint8_t hif_put_blk(unsigned char *data, uint8_t size)
+hif_blk_t hif_put_blk(unsigned char *data, hif_blk_t size)
 {
-    bool data_pending;
-    uint8_t s = size;
-
-    if (s == 0)
-        return 0;
+    uint8_t s = size, n, head;
 
-    while (configuration_no == 0)
-    {
-        return 0;
-    }
-
-    UENUM = TX_EP;
     while (s > 0)
     {
-        data_pending = true;
-
-        /* If the current bank is still busy, wait. */
-        while ((UEINTX & _BV(RWAL)) == 0)
-            { /* wait */ }
-        while (s > 0 && (UEINTX & _BV(RWAL)) != 0)
+        if (configuration_no == 0)
         {
-            UEDATX = (uint8_t)*data++;
-            s--;
+            break;
         }
-        /* If the current bank is full, start transmission. */
-        if ((UEINTX & _BV(RWAL)) == 0)
+        n = TXBUF_FREE();
+        if (n > s)
         {
-            UEINTX &= ~_BV(TXINI);
-            UEINTX &= ~_BV(FIFOCON);
-            data_pending = false;
+            n = s;
         }
+        head = txhead;
+        s -= n;
+        while (n--)
+        {
+            hif_txbuf[head] = (uint8_t)*data++;
+            head = ((head + 1) & TXBUF_MASK);
+        }
+        txhead = head;
+        hif_tx_kick();
     }
 
-    tx_data_pending = data_pending;
-
-    return size;
+    return size - s;
 }
 
 
@@ -534,19 +546,17 @@ int hif_putc(int c)
     while (configuration_no == 0)
         { /* wait until configured by host */ }
 
-    UENUM = TX_EP;
-    UEDATX = (uint8_t)c;
-    if ((UEINTX & _BV(RWAL)) == 0)
+    while (TXBUF_FREE() == 0)
     {
-        /* transmit this bank, switch to next one */
-        UEINTX &= ~_BV(TXINI);
-        UEINTX &= ~_BV(FIFOCON);
-        tx_data_pending = false;
-    }
-    else
-    {
-        tx_data_pending = true;
+        /* wait for the TX endpoint interrupt to drain the buffer */
+        if (configuration_no == 0)
+        {
+            return EOF;
+        }
     }
+    hif_txbuf[txhead] = (uint8_t)c;
+    txhead = ((txhead + 1) & TXBUF_MASK);
+    hif_tx_kick();
 	return c;
 }
 
@@ -558,6 +568,7 @@ int ret = EOF;
     {
         ret = hif_rxbuf[rxtail];
         rxtail = ((rxtail + 1) & RXBUF_MASK);
+        hif_rx_resume();
     }else{
         ret = EOF;
     }
@@ -565,7 +576,7 @@ int ret = EOF;
 }
 
 
-uint8_t hif_get_blk(unsigned char *data, uint8_t max_size)
+hif_blk_t hif_get_blk(unsigned char *data, hif_blk_t max_size)
 {
 
 uint8_t used_size, retsize;
@@ -614,6 +625,8 @@ uint8_t newtail, currtail, currhead, b1=0, b2=0;
         rxtail = (b2);
     }
 
+    hif_rx_resume();
+
     SREG = __sreg;
 
     return retsize;
@@ -628,6 +641,95 @@ static void led_activate(void)
 #endif  /* LED_ACTIVITY */
 
 
+/*
+ * Fill free banks of the TX endpoint from the transmit buffer.
+ *
+ * Without flush, only full packets are sent, and the endpoint
+ * interrupt stays enabled while there is another one in the buffer.
+ * With flush (on SOF), the rest goes out as short packet, or a ZLP
+ * follows a full packet, so that the host sees the end of the
+ * transfer. The caller has to restore UENUM.
+ */
+static void hif_tx_service(bool flush)
+{
+    uint8_t used, len;
+
+    UENUM = TX_EP;
+    while (UEINTX & _BV(TXINI))
+    {
+        used = TXBUF_USED();
+        if (used >= DATA_EP_SIZE)
+        {
+            len = DATA_EP_SIZE;
+        }
+        else if (flush && (used > 0 || tx_zlp))
+        {
+            len = used;
+            flush = false;
+        }
+        else
+        {
+            break;
+        }
+
+        tx_zlp = (len == DATA_EP_SIZE);
+        while (len--)
+        {
+            UEDATX = hif_txbuf[txtail];
+            txtail = ((txtail + 1) & TXBUF_MASK);
+        }
+        /* transmit this bank, switch to next one */
+        UEINTX &= ~_BV(TXINI);
+        UEINTX &= ~_BV(FIFOCON);
+
+        led_activate();
+    }
+
+    if (TXBUF_USED() < DATA_EP_SIZE)
+    {
+        UEIENX &= ~_BV(TXINE);
+    }
+}
+
+/*
+ * Let the TX endpoint interrupt pick up full packets,
+ * a partial one goes out with the next SOF.
+ */
+static void hif_tx_kick(void)
+{
+    uint8_t __sreg = SREG; cli();
+    uint8_t uenum = UENUM;
+
+    if (TXBUF_USED() >= DATA_EP_SIZE)
+    {
+        UENUM = TX_EP;
+        UEIENX |= _BV(TXINE);
+    }
+
+    UENUM = uenum;
+    SREG = __sreg;
+}
+
+/*
+ * The RX endpoint interrupt is disabled, while the receive buffer
+ * has no room for a full packet, so that the host is NAKed. Enable
+ * it again once there is room.
+ */
+static void hif_rx_resume(void)
+{
+    uint8_t __sreg = SREG; cli();
+    uint8_t uenum = UENUM;
+
+    if (RXBUF_FREE() >= DATA_EP_SIZE && configuration_no != 0)
+    {
+        UENUM = RX_EP;
+        UEIENX |= _BV(RXOUTE);
+    }
+
+    UENUM = uenum;
+    SREG = __sreg;
+}
+
 static bool configure_endpoint(uint8_t epnum)
 {
     struct ep_configuration p;
@@ -1209,7 +1311,6 @@ static bool process_setup_message(void)
 #if defined(DOXYGEN)
 void USB_GEN_vect();
 #else
-static volatile uint8_t rxovf;
 ISR(USB_GEN_vect)
 #endif
 {
@@ -1228,15 +1329,12 @@ ISR(USB_GEN_vect)
 #endif  /* LED_ACTIVITY */
         /* start-of-frame interrupt, triggers each 1 ms while attached */
         UDINT &= ~_BV(SOFI);
-        if (tx_data_pending)
+        if (configuration_no != 0)
         {
-            UENUM = TX_EP;
-            /* transmit this bank, switch to next one */
-            UEINTX &= ~_BV(TXINI);
-            UEINTX &= ~_BV(FIFOCON);
-            tx_data_pending = false;
-
-            led_activate();
+            /* may interrupt the control transfer handling in USB_COM_vect */
+            uint8_t uenum = UENUM;
+            hif_tx_service(true);
+            UENUM = uenum;
         }
     }
     if (USBINT & _BV(VBUSTI))
@@ -1319,6 +1417,11 @@ ISR(USB_COM_vect)
     bool ctrl_has_data = false, out_has_data = false;
     uint8_t ueienx_ctrl, ueienx_data;
 
+    if (UEINT & _BV(TX_EP))
+    {
+        /* In (TX) endpoint has a free bank, at most two packets to copy */
+        hif_tx_service(false);
+    }
     if (UEINT & _BV(CTRL_EP))
     {
         /* Control endpoint has data. */
@@ -1377,16 +1480,17 @@ ISR(USB_COM_vect)
 
         while (UEINTX & _BV(RXOUTI))
         {
+            if (UEBCLX > RXBUF_FREE())
+            {
+                /* no room, leave the bank to NAK the host until
+                 * hif_rx_resume() enables the interrupt again */
+                ueienx_data &= ~_BV(RXOUTE);
+                break;
+            }
             UEINTX &= ~_BV(RXOUTI);
 
             while (UEINTX & _BV(RWAL))
             {
-                /** todo handle other uart errors (usr register)*/
-                if (rxhead == rxtail)
-                {
-                    rxovf++;
-                }
-
                 hif_rxbuf[rxhead] = UEDATX;
                 rxhead = ((rxhead + 1) & RXBUF_MASK);
             }
@@ -38,6 +38,11 @@
 #if HIF_TYPE == HIF_FT245
 
 /* === macros ============================================ */
+#ifndef FT245_BURST
+/** Bytes per block run of HIF_USB_WRITE_BLK()/HIF_USB_READ_BLK(), bounds
+ *  the time the FT245 holds the shared xmem bus. */
+# define FT245_BURST (32)
+#endif
 
 /* === types ============================================= */
 
@@ -75,8 +80,23 @@ void hif_puts(const char *s)
     }
 }
 
-uint8_t hif_put_blk(unsigned char *data, uint8_t size)
+hif_blk_t hif_put_blk(unsigned char *data, hif_blk_t size)
 {
+#if defined(HIF_USB_WRITE_BLK)
+    hif_blk_t xfered = 0;
+    uint8_t n;
+
+    while (size != 0)
+    {
+        while(FT245_TX_IS_BLOCKED())
+            ;
+        n = HIF_USB_WRITE_BLK(data, (size < FT245_BURST) ? size : FT245_BURST);
+        data += n;
+        size -= n;
+        xfered += n;
+    }
+    return xfered;
+#else
     uint8_t xfered;
 
     for (xfered = 0; size != 0; xfered++, size--)
@@ -86,6 +106,7 @@ uint8_t hif_put_blk(unsigned char *data, uint8_t size)
 		HIF_USB_WRITE(*data++);
     }
     return xfered;
+#endif
 }
 
 int hif_getc()
@@ -103,15 +124,27 @@ int ret = EOF;
 }
 
 
-uint8_t hif_get_blk(unsigned char *data, uint8_t max_size)
+hif_blk_t hif_get_blk(unsigned char *data, hif_blk_t max_size)
 {
     uint8_t cnt = 0;
 
+#if defined(HIF_USB_READ_BLK)
+    uint8_t n;
+
+    do
+    {
+        n = HIF_USB_READ_BLK(data + cnt, ((max_size - cnt) < FT245_BURST) ?
+                             (max_size - cnt) : FT245_BURST);
+        cnt += n;
+    }
+    while (n != 0 && cnt < max_size);
+#else
     while(FT245_RX_HAS_DATA() && (cnt < max_size))
     {
         *data++ = (unsigned char)HIF_USB_READ();
         cnt++;
     }
+#endif
 
     return cnt;
 }
@@ -0,0 +1,334 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Channels multiplexed over the host interface, see hif_mux.h
+ *
+ * The rings run with free running 8 bit indices, the number of bytes
+ * in a ring is head - tail. A chunk which the HIF did not take at once
+ * stays in pend and goes out before the next one, so the tags and the
+ * DLE escapes are never split from their data.
+ *
+ * @ingroup grpHIF
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "board.h"
+#include "hif.h"
+#include "hif_mux.h"
+
+#if HIF_TYPE != HIF_NONE
+
+/* === macros ============================================ */
+#if (HIF_MUX_BUFSIZE & (HIF_MUX_BUFSIZE - 1)) || (HIF_MUX_BUFSIZE > 128)
+# error "HIF_MUX_BUFSIZE must be a power of 2, at most 128"
+#endif
+#if (HIF_MUX_NCHAN < 1) || (HIF_MUX_NCHAN > 10)
+# error "HIF_MUX_NCHAN must be 1 ... 10"
+#endif
+#if HIF_MUX_CHUNK > 126
+# error "HIF_MUX_CHUNK must be at most 126"
+#endif
+
+#define RING_MASK (HIF_MUX_BUFSIZE - 1)
+#define RING_USED(r) ((uint8_t) ((r)->head - (r)->tail))
+#define RING_FULL(r) (RING_USED(r) >= HIF_MUX_BUFSIZE)
+#define RING_EMPTY(r) ((r)->head == (r)->tail)
+
+/* === types ============================================= */
+typedef struct
+{
+    uint8_t buf[HIF_MUX_BUFSIZE];
+    uint8_t head;
+    uint8_t tail;
+} mux_ring_t;
+
+typedef struct
+{
+    mux_ring_t tx;
+    mux_ring_t rx;
+    uint8_t flags;
+    uint16_t drops;
+    FILE stream;
+} mux_chan_t;
+
+/* === globals =========================================== */
+static mux_chan_t chans[HIF_MUX_NCHAN];
+
+/* channel, which sends the next chunk */
+static uint8_t txnext;
+/* tag, data and escapes of a chunk, not yet taken by the HIF */
+static uint8_t pend[2 + 2 * HIF_MUX_CHUNK];
+static uint8_t npend, ipend;
+
+/* receive side: current channel, last byte was DLE */
+static uint8_t rxch;
+static bool rxdle;
+
+/* === prototypes ======================================== */
+static int mux_stream_put(char c, FILE *f);
+static int mux_stream_get(FILE *f);
+
+/* === functions ========================================= */
+static inline void ring_put(mux_ring_t *r, uint8_t c)
+{
+    r->buf[r->head & RING_MASK] = c;
+    r->head++;
+}
+
+static inline uint8_t ring_get(mux_ring_t *r)
+{
+    uint8_t c = r->buf[r->tail & RING_MASK];
+    r->tail++;
+    return c;
+}
+
+void hif_mux_init(void)
+{
+    uint8_t ch;
+
+    memset(chans, 0, sizeof(chans));
+    for (ch = 0; ch < HIF_MUX_NCHAN; ch++)
+    {
+        fdev_setup_stream(&chans[ch].stream, mux_stream_put, mux_stream_get,
+                          _FDEV_SETUP_RW);
+        fdev_set_udata(&chans[ch].stream, &chans[ch]);
+    }
+    txnext = 0;
+    npend = ipend = 0;
+    rxch = 0;
+    rxdle = false;
+}
+
+FILE * hif_mux_stream(uint8_t ch)
+{
+    return (ch < HIF_MUX_NCHAN) ? &chans[ch].stream : NULL;
+}
+
+void hif_mux_set_flags(uint8_t ch, uint8_t flags)
+{
+    if (ch < HIF_MUX_NCHAN)
+    {
+        chans[ch].flags = flags;
+    }
+}
+
+int hif_mux_putc(uint8_t ch, int c)
+{
+    mux_chan_t *mc;
+
+    if (ch >= HIF_MUX_NCHAN)
+    {
+        return EOF;
+    }
+    mc = &chans[ch];
+    while (RING_FULL(&mc->tx))
+    {
+        if (mc->flags & HIF_MUX_NONBLOCK)
+        {
+            mc->drops++;
+            return EOF;
+        }
+        hif_mux_task();
+        BUSY_WAIT();
+    }
+    ring_put(&mc->tx, (uint8_t) c);
+    return (uint8_t) c;
+}
+
+hif_blk_t hif_mux_write(uint8_t ch, const void *data, hif_blk_t size)
+{
+    const uint8_t *p = data;
+    mux_ring_t *r;
+    hif_blk_t n;
+
+    if (ch >= HIF_MUX_NCHAN)
+    {
+        return 0;
+    }
+    r = &chans[ch].tx;
+    for (n = 0; (n < size) && !RING_FULL(r); n++)
+    {
+        ring_put(r, p[n]);
+    }
+    return n;
+}
+
+int hif_mux_getc(uint8_t ch)
+{
+    if ((ch >= HIF_MUX_NCHAN) || RING_EMPTY(&chans[ch].rx))
+    {
+        return EOF;
+    }
+    return ring_get(&chans[ch].rx);
+}
+
+hif_blk_t hif_mux_read(uint8_t ch, void *data, hif_blk_t max_size)
+{
+    uint8_t *p = data;
+    mux_ring_t *r;
+    hif_blk_t n;
+
+    if (ch >= HIF_MUX_NCHAN)
+    {
+        return 0;
+    }
+    r = &chans[ch].rx;
+    for (n = 0; (n < max_size) && !RING_EMPTY(r); n++)
+    {
+        p[n] = ring_get(r);
+    }
+    return n;
+}
+
+uint16_t hif_mux_drops(uint8_t ch)
+{
+    return (ch < HIF_MUX_NCHAN) ? chans[ch].drops : 0;
+}
+
+/* pass the rest of the pending chunk to the HIF, true if it is gone */
+static bool mux_flush(void)
+{
+    hif_blk_t n;
+
+    while (ipend < npend)
+    {
+        n = hif_put_blk(&pend[ipend], npend - ipend);
+        if (n == 0)
+        {
+            return false;
+        }
+        ipend += n;
+    }
+    npend = ipend = 0;
+    return true;
+}
+
+/* store a received byte in the ring of the current channel */
+static void mux_deliver(uint8_t c)
+{
+    mux_chan_t *mc = &chans[rxch];
+
+    if (RING_FULL(&mc->rx))
+    {
+        mc->drops++;
+    }
+    else
+    {
+        ring_put(&mc->rx, c);
+    }
+}
+
+void hif_mux_task(void)
+{
+    uint8_t buf[16];
+    mux_ring_t *r;
+    hif_blk_t n, i;
+    uint8_t k, c, cnt;
+
+    /* transmit, one chunk per channel in turn */
+    for (k = 0; mux_flush() && (k < HIF_MUX_NCHAN); k++)
+    {
+        r = &chans[txnext].tx;
+        if (!RING_EMPTY(r))
+        {
+            pend[0] = HIF_MUX_DLE;
+            pend[1] = '0' + txnext;
+            npend = 2;
+            for (cnt = 0; (cnt < HIF_MUX_CHUNK) && !RING_EMPTY(r); cnt++)
+            {
+                c = ring_get(r);
+                pend[npend++] = c;
+                if (c == HIF_MUX_DLE)
+                {
+                    pend[npend++] = HIF_MUX_DLE;
+                }
+            }
+        }
+        txnext = (txnext + 1) % HIF_MUX_NCHAN;
+    }
+
+    /* receive */
+    do
+    {
+        n = hif_get_blk(buf, sizeof(buf));
+        for (i = 0; i < n; i++)
+        {
+            c = buf[i];
+            if (rxdle)
+            {
+                rxdle = false;
+                if (c == HIF_MUX_DLE)
+                {
+                    mux_deliver(c);
+                }
+                else if ((c >= '0') && (c < '0' + HIF_MUX_NCHAN))
+                {
+                    rxch = c - '0';
+                }
+                /* unknown tags are dropped */
+            }
+            else if (c == HIF_MUX_DLE)
+            {
+                rxdle = true;
+            }
+            else
+            {
+                mux_deliver(c);
+            }
+        }
+    }
+    while (n == sizeof(buf));
+}
+
+static int mux_stream_put(char c, FILE *f)
+{
+    mux_chan_t *mc = fdev_get_udata(f);
+
+    return (hif_mux_putc(mc - chans, (uint8_t) c) == EOF) ? -1 : 0;
+}
+
+static int mux_stream_get(FILE *f)
+{
+    mux_chan_t *mc = fdev_get_udata(f);
+    int c;
+
+    c = hif_mux_getc(mc - chans);
+    return (c == EOF) ? _FDEV_EOF : c;
+}
+
+#endif /* HIF_TYPE != HIF_NONE */
+/* EOF */
@@ -36,42 +36,83 @@
 #include "board.h"
 #include "ioutil.h"
 #include "hif_uart.h"
+#include "isr_prof.h"
+#include "energy_mark.h"
+#include "pm.h"
 
 #if HIF_TYPE_IS_UART
 
 /* === macros ============================================ */
-#ifndef UART_TXBUFSIZE
-#define UART_TXBUFSIZE (128)
-#endif
+/* UART_TXBUFSIZE and UART_RXBUFSIZE are set in hif.h or board_cfg.h */
+#define TXBUF_MASK (UART_TXBUFSIZE-1)
+
 
-#ifndef UART_RXBUFSIZE
-#define UART_RXBUFSIZE (128)
+#define RXBUF_MASK (UART_RXBUFSIZE-1)
+
+#if (UART_TXBUFSIZE & TXBUF_MASK) || (UART_RXBUFSIZE & RXBUF_MASK)
+# error "UART_TXBUFSIZE and UART_RXBUFSIZE need to be powers of 2"
 #endif
 
+/*
+ * Rings up to 256 bytes use 8 bit indices, larger ones 16 bit indices.
+ * These can not be read in a single instruction, so the accesses
+ * outside of the ISRs are made atomic then.
+ */
+#if (UART_TXBUFSIZE > 256)
+typedef uint16_t txidx_t;
+#else
+typedef uint8_t txidx_t;
+#endif
 
-#define TXBUF_MASK (UART_TXBUFSIZE-1)
+#if (UART_RXBUFSIZE > 256)
+typedef uint16_t rxidx_t;
+#else
+typedef uint8_t rxidx_t;
+#endif
 
+#if (UART_TXBUFSIZE > 256) || (UART_RXBUFSIZE > 256)
+# define HIF_IDX_LOCK()   uint8_t __sreg = SREG; cli()
+# define HIF_IDX_UNLOCK() SREG = __sreg
+#else
+# define HIF_IDX_LOCK()   do{}while(0)
+# define HIF_IDX_UNLOCK() do{}while(0)
+#endif
 
-#define RXBUF_MASK (UART_RXBUFSIZE-1)
+/** free bytes in the RX buffer */
+#define RXBUF_FREE() (RXBUF_MASK - ((rx.head - rx.tail) & RXBUF_MASK))
 
 
 /* === globals =========================================== */
 /* temporary uart buffers */
 static volatile struct{
     uint8_t buf[UART_RXBUFSIZE];
-    volatile uint8_t head;
-    volatile uint8_t tail;
+    volatile rxidx_t head;
+    volatile rxidx_t tail;
 }rx;
 
 static volatile struct{
     uint8_t buf[UART_TXBUFSIZE];
-    volatile uint8_t head;
-    volatile uint8_t tail;
+    volatile txidx_t head;
+    volatile txidx_t tail;
 }tx;
 
 static volatile uint8_t rxovf = 0;
 
+/* scatter/gather transmission, which is streamed after the tx buffer */
+static struct{
+    const hif_iov_t *iov;
+    const uint8_t *ptr;
+    /* bytes left in the current block */
+    uint16_t len;
+    /* blocks left after the current one */
+    uint8_t iovcnt;
+    hif_sg_done_t *done;
+    void *ctx;
+    volatile uint8_t active;
+}txsg;
+
 /* === prototypes ======================================== */
+static inline void hif_rts_update(void);
 
 /* === functions ========================================= */
 void hif_init(const uint32_t baudrate)
@@ -81,6 +122,25 @@ void hif_init(const uint32_t baudrate)
     HIF_IO_ENABLE();
     tx.head = tx.tail = 0;
     rx.head = rx.tail = 0;
+#if HIF_UART_FLOW_CONTROL
+    HIF_UART_FLOW_INIT();
+#endif
+}
+
+/**
+ * @brief Assert RTS again once the RX buffer has drained.
+ *
+ * Called after bytes were taken out of the RX buffer, the RX ISR
+ * deasserts RTS when the buffer runs full.
+ */
+static inline void hif_rts_update(void)
+{
+#if HIF_UART_FLOW_CONTROL
+    if (!HIF_UART_RTS_IS_ASSERTED() && (RXBUF_FREE() >= 2 * HIF_UART_RTS_MARGIN))
+    {
+        HIF_UART_RTS_ASSERT();
+    }
+#endif
 }
 
 void hif_puts_p(const char *progmem_s)
@@ -139,12 +199,18 @@ int c, rv;
 /*
  * Circular memcpy to HIF Buffer
  */
-uint8_t hif_put_blk(unsigned char *data, uint8_t size)
+hif_blk_t hif_put_blk(unsigned char *data, hif_blk_t size)
 {
-uint8_t free_size, retsize;
-uint8_t newhead, currtail, currhead, b1=0, b2=0;
+hif_blk_t free_size, retsize;
+txidx_t newhead, currtail, currhead, b1=0, b2=0;
 
     uint8_t __sreg = SREG; cli();
+    if (txsg.active)
+    {
+        /* keep the tx buffer empty until the s/g transmission is done */
+        SREG = __sreg;
+        return 0;
+    }
     /* compute space in uart_tx buffer */
     currtail = tx.tail;
     currhead = tx.head;
@@ -176,7 +242,7 @@ uint8_t newhead, currtail, currhead, b1=0, b2=0;
         memcpy((void*)&tx.buf[currhead], data, b1);
         data += b1;
         tx.head = ((currhead + b1) & TXBUF_MASK);
-        size = ((size - b1)  & TXBUF_MASK);
+        size -= b1;
     }
 
     /* handle block 2*/
@@ -195,48 +261,122 @@ uint8_t newhead, currtail, currhead, b1=0, b2=0;
 
 }
 
+uint8_t hif_put_sg(const hif_iov_t *iov, uint8_t iovcnt,
+                   hif_sg_done_t *done, void *ctx)
+{
+uint8_t ret = 0;
+
+    uint8_t __sreg = SREG; cli();
+    if (!txsg.active)
+    {
+        txsg.iov = iov;
+        txsg.iovcnt = iovcnt;
+        txsg.len = 0;
+        txsg.done = done;
+        txsg.ctx = ctx;
+        txsg.active = 1;
+        HIF_UART_TXIRQ_EI();
+        ret = 1;
+    }
+    SREG = __sreg;
+    return ret;
+}
+
+uint8_t hif_put_sg_busy(void)
+{
+    return txsg.active;
+}
+
+/**
+ * @brief Get the next block of the s/g transmission ready.
+ *
+ * Called from the TX ISR, once the tx buffer is empty.
+ * The done function of a finished transmission may start
+ * the next one.
+ *
+ * @return 1 if there is a byte to send at txsg.ptr, 0 otherwise.
+ */
+static inline uint8_t hif_sg_load(void)
+{
+    while (txsg.len == 0)
+    {
+        if (txsg.iovcnt != 0)
+        {
+            txsg.ptr = txsg.iov->data;
+            txsg.len = txsg.iov->len;
+            txsg.iov++;
+            txsg.iovcnt--;
+        }
+        else if (txsg.active)
+        {
+            txsg.active = 0;
+            if (txsg.done != NULL)
+            {
+                txsg.done(txsg.ctx);
+            }
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 
 int hif_putc(int c)
 {
-uint8_t newhead;
+txidx_t newhead;
+int ret;
+    HIF_IDX_LOCK();
     newhead = ((tx.head + 1) & TXBUF_MASK);
 
-    if (newhead != tx.tail)
+    if ((newhead != tx.tail) && !txsg.active)
     {
         tx.buf[tx.head] = (uint8_t)c;
         tx.head = newhead;
         HIF_UART_TXIRQ_EI();
-        return c;
+        ret = c;
     }
     else
     {
-        return EOF;
+        ret = EOF;
     }
+    HIF_IDX_UNLOCK();
+    return ret;
 }
 
 
 int hif_getc(void)
 {
 int ret = EOF;
+    HIF_IDX_LOCK();
     if (rx.tail != rx.head)
     {
         ret = rx.buf[rx.tail];
         rx.tail = ((rx.tail + 1) & RXBUF_MASK);
+        hif_rts_update();
+        if (rx.tail != rx.head)
+        {
+            /* more input, pm_idle() returns for the next call */
+            PM_EVENT();
+        }
     }else{
         ret=EOF;
     }
+    HIF_IDX_UNLOCK();
     return ret;
 }
 
 
-uint8_t hif_get_blk(unsigned char *data, uint8_t max_size)
+hif_blk_t hif_get_blk(unsigned char *data, hif_blk_t max_size)
 {
 
-uint8_t used_size, retsize;
+hif_blk_t used_size, retsize;
 /**** not used, please check and remove
 uint8_t newtail;
 ****/
-uint8_t currtail, currhead, b1=0, b2=0;
+rxidx_t currtail, currhead, b1=0, b2=0;
 
     uint8_t __sreg = SREG; cli();
     /* compute space in uart_tx buffer */
@@ -273,7 +413,7 @@ uint8_t currtail, currhead, b1=0, b2=0;
         memcpy(data, (void*)&rx.buf[currtail],  b1);
         data += b1;
         rx.tail = ((currtail + b1) & RXBUF_MASK);
-        max_size = ((max_size - b1)  & RXBUF_MASK);
+        max_size -= b1;
     }
 
     /* handle block 2*/
@@ -284,6 +424,12 @@ uint8_t currtail, currhead, b1=0, b2=0;
         rx.tail = (b2);
     }
 
+    hif_rts_update();
+    if (rx.tail != rx.head)
+    {
+        PM_EVENT();
+    }
+
     SREG = __sreg;
 
     return retsize;
@@ -296,6 +442,8 @@ void HIF_UART_RX_vect();
 ISR(HIF_UART_RX_vect)
 #endif
 {
+    ISR_PROF_ENTER(t0);
+    ENERGY_MARK_ON(ENERGY_ISR);
     /** todo handle other uart errors (usr register)*/
     if (rx.head == rx.tail)
     {
@@ -303,6 +451,16 @@ ISR(HIF_UART_RX_vect)
     }
     rx.buf[rx.head] = HIF_UART_DATA;
     rx.head = ((rx.head + 1) & RXBUF_MASK);
+#if HIF_UART_FLOW_CONTROL
+    if (RXBUF_FREE() <= HIF_UART_RTS_MARGIN)
+    {
+        /* hold the sender off, it may have a byte or two in flight */
+        HIF_UART_RTS_DEASSERT();
+    }
+#endif
+    PM_EVENT();
+    ENERGY_MARK_OFF(ENERGY_ISR);
+    ISR_PROF_EXIT(ISR_PROF_UART_RX, t0);
 }
 
 #if defined(DOXYGEN)
@@ -312,6 +470,23 @@ ISR(HIF_UART_TX_vect)
 #endif
 {
     /** @todo handle uart errors */
+    PM_EVENT();
+
+#if HIF_UART_FLOW_CONTROL
+    if (HIF_UART_CTS_BLOCKED())
+    {
+        /* park the transmitter until the CTS pin change interrupt,
+         * re-check after arming it so that an edge isn't missed */
+        HIF_UART_TXIRQ_DI();
+        HIF_UART_CTS_IRQ_EI();
+        if (HIF_UART_CTS_BLOCKED())
+        {
+            return;
+        }
+        HIF_UART_CTS_IRQ_DI();
+        HIF_UART_TXIRQ_EI();
+    }
+#endif
 
 #if 0
     if (tx.head != tx.tail)
@@ -325,10 +500,22 @@ ISR(HIF_UART_TX_vect)
         HIF_UART_TXIRQ_DI();
     }
 #else
-    HIF_UART_DATA = tx.buf[tx.tail];
-    tx.buf[tx.tail] = '#';
-    tx.tail = ((tx.tail + 1) & TXBUF_MASK);
-    if (tx.head == tx.tail) /*last byte was send, stop */
+    if (tx.head != tx.tail)
+    {
+        HIF_UART_DATA = tx.buf[tx.tail];
+        tx.buf[tx.tail] = '#';
+        tx.tail = ((tx.tail + 1) & TXBUF_MASK);
+        if ((tx.head == tx.tail) && !txsg.active) /*last byte was send, stop */
+        {
+            HIF_UART_TXIRQ_DI();
+        }
+    }
+    else if (hif_sg_load())
+    {
+        HIF_UART_DATA = *txsg.ptr++;
+        txsg.len--;
+    }
+    else
     {
         HIF_UART_TXIRQ_DI();
     }
@@ -336,4 +523,23 @@ ISR(HIF_UART_TX_vect)
 
 #endif
 }
+
+#if HIF_UART_FLOW_CONTROL
+#if defined(DOXYGEN)
+void HIF_UART_CTS_vect();
+#else
+ISR(HIF_UART_CTS_vect)
+#endif
+{
+    if (!HIF_UART_CTS_BLOCKED())
+    {
+        /* receiver is ready again, restart the transmitter */
+        HIF_UART_CTS_IRQ_DI();
+        if ((tx.head != tx.tail) || txsg.active)
+        {
+            HIF_UART_TXIRQ_EI();
+        }
+    }
+}
+#endif
 #endif
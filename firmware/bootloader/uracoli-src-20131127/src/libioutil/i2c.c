@@ -174,6 +174,13 @@ uint8_t i2c_master_writeread(uint8_t devaddr,
     uint8_t stat;
     uint8_t ret = 0;
     uint8_t cmd = 0;
+
+    /* let queued transactions of i2c_async.c finish first */
+    while (TWCR & (_BV(TWIE) | _BV(TWSTO)))
+    {
+        /* wait */
+    }
+
     if(0 < bytestowrite)
     {
         stat = i2c_startcondition();
@@ -0,0 +1,209 @@
+/* Copyright (c) 2011 ... 2013 Daniel Thiele, Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/**
+ * @file
+ * @brief Interrupt driven I2C master with a transaction queue.
+ *
+ * Transactions are described by caller owned @ref i2c_xfer_t
+ * structures, which are chained into a queue by i2c_submit(). The TWI
+ * interrupt runs one transaction after the other and calls the done
+ * function of each one, so the CPU is free while the bus is busy.
+ * The bus is set up with i2c_init() as for the blocking functions.
+ */
+
+/* avr-libc inclusions */
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+
+/* project inclusions */
+#include "board.h"
+#include "i2c.h"
+
+#ifdef TWSR
+
+/* === macros ============================================ */
+#define I2C_TWCR_START  (_BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE))
+#define I2C_TWCR_NEXT   (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define I2C_TWCR_STOP   (_BV(TWINT) | _BV(TWSTO) | _BV(TWEN))
+
+/* === globals =========================================== */
+static i2c_xfer_t *i2c_qhead;
+static i2c_xfer_t *i2c_qtail;
+
+/* progress of the transaction at the queue head */
+static uint8_t *i2c_wptr;
+static uint8_t *i2c_rptr;
+static uint8_t i2c_wcnt;
+static uint8_t i2c_rcnt;
+
+/* === functions ========================================= */
+static void i2c_load(i2c_xfer_t *xfer)
+{
+    i2c_wptr = xfer->writebuf;
+    i2c_wcnt = xfer->bytestowrite;
+    i2c_rptr = xfer->readbuf;
+    i2c_rcnt = xfer->bytestoread;
+}
+
+/*
+ * Complete the transaction at the queue head, and either stop the bus
+ * or go on with the next transaction through a repeated start.
+ */
+static void i2c_finish(uint8_t status)
+{
+i2c_xfer_t *xfer = i2c_qhead;
+
+    i2c_qhead = xfer->next;
+    if (i2c_qhead == NULL)
+    {
+        i2c_qtail = NULL;
+        TWCR = I2C_TWCR_STOP;
+    }
+    else
+    {
+        i2c_load(i2c_qhead);
+        /* STOP followed by START */
+        TWCR = I2C_TWCR_STOP | I2C_TWCR_START;
+    }
+
+    xfer->status = status;
+    if (xfer->done != NULL)
+    {
+        xfer->done(xfer);
+    }
+}
+
+void i2c_submit(i2c_xfer_t *xfer)
+{
+    xfer->status = I2C_XFER_PENDING;
+    xfer->next = NULL;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (i2c_qtail != NULL)
+        {
+            i2c_qtail->next = xfer;
+        }
+        else
+        {
+            i2c_qhead = xfer;
+            i2c_load(xfer);
+            /* a STOP of the blocking functions may still be pending */
+            while (TWCR & _BV(TWSTO))
+            {
+                /* wait */
+            }
+            TWCR = I2C_TWCR_START;
+        }
+        i2c_qtail = xfer;
+    }
+}
+
+uint8_t i2c_busy(void)
+{
+    return (i2c_qhead != NULL);
+}
+
+ISR(TWI_vect)
+{
+    switch (TW_STATUS)
+    {
+        case TW_START:
+        case TW_REP_START:
+            if ((i2c_wcnt > 0) || (i2c_rcnt == 0))
+            {
+                /* write phase, or address only (probe) */
+                TWDR = ((i2c_qhead->devaddr << 1) & 0xFE) | TW_WRITE;
+            }
+            else
+            {
+                TWDR = ((i2c_qhead->devaddr << 1) & 0xFE) | TW_READ;
+            }
+            TWCR = I2C_TWCR_NEXT;
+            break;
+
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (i2c_wcnt > 0)
+            {
+                TWDR = *i2c_wptr++;
+                i2c_wcnt--;
+                TWCR = I2C_TWCR_NEXT;
+            }
+            else if (i2c_rcnt > 0)
+            {
+                TWCR = I2C_TWCR_START;
+            }
+            else
+            {
+                i2c_finish(I2C_XFER_OK);
+            }
+            break;
+
+        case TW_MT_DATA_NACK:
+            /* the slave may refuse the byte after the last one */
+            i2c_finish(((i2c_wcnt == 0) && (i2c_rcnt == 0)) ?
+                       I2C_XFER_OK : I2C_XFER_ERROR);
+            break;
+
+        case TW_MR_DATA_ACK:
+            *i2c_rptr++ = TWDR;
+            i2c_rcnt--;
+            /* fall through */
+        case TW_MR_SLA_ACK:
+            /* NAK for the last byte, ACK else */
+            TWCR = (i2c_rcnt > 1) ? (I2C_TWCR_NEXT | _BV(TWEA)) : I2C_TWCR_NEXT;
+            break;
+
+        case TW_MR_DATA_NACK:
+            *i2c_rptr++ = TWDR;
+            i2c_rcnt--;
+            i2c_finish(I2C_XFER_OK);
+            break;
+
+        case TW_MT_ARB_LOST:
+            /* try again, once the bus is free */
+            i2c_load(i2c_qhead);
+            TWCR = I2C_TWCR_START;
+            break;
+
+        case TW_MT_SLA_NACK:
+        case TW_MR_SLA_NACK:
+        default:
+            i2c_finish(I2C_XFER_ERROR);
+            break;
+    }
+}
+
+#endif /* TWSR */
+
+/* EOF */
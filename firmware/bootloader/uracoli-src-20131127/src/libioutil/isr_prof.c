@@ -0,0 +1,102 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief ISR profiler, see isr_prof.h
+ *
+ * @ingroup grpIoUtil
+ */
+
+/* === includes ========================================== */
+#include <string.h>
+#include <util/atomic.h>
+#include "board.h"
+#include "isr_prof.h"
+
+#if defined(ISR_PROFILE)
+/* === globals ====================================== */
+static isr_prof_t isr_prof[ISR_PROF_NSLOTS];
+
+/* === functions ==================================== */
+void isr_prof_add(uint8_t slot, uint16_t t0, uint16_t late)
+{
+isr_prof_t *p = &isr_prof[slot];
+uint16_t d, x;
+uint8_t bin;
+
+    d = ISR_PROF_REG - t0;
+    if (p->count != 0xFFFF)
+    {
+        p->count++;
+        p->sum += d;
+    }
+    if ((p->count == 1) || (d < p->min))
+    {
+        p->min = d;
+    }
+    if (d > p->max)
+    {
+        p->max = d;
+    }
+    if (late > p->late_max)
+    {
+        p->late_max = late;
+    }
+    bin = 0;
+    x = d >> ISR_PROF_BIN0_SHIFT;
+    while (x && (bin < (ISR_PROF_NBINS - 1)))
+    {
+        x >>= 1;
+        bin++;
+    }
+    if (p->hist[bin] != 0xFFFF)
+    {
+        p->hist[bin]++;
+    }
+}
+
+void isr_prof_get(uint8_t slot, isr_prof_t *p)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(p, &isr_prof[slot], sizeof(isr_prof_t));
+    }
+}
+
+void isr_prof_reset(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(isr_prof, 0, sizeof(isr_prof));
+    }
+}
+#endif /* defined(ISR_PROFILE) */
+/* EOF */
@@ -0,0 +1,189 @@
+/* Copyright (c) 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Debounced key events from a timer callback.
+ *
+ * The sample timer runs in interrupt context. With a key interrupt,
+ * the interrupt is disabled in its handler (it may be level
+ * triggered) and starts the timer, the timer enables it again when
+ * all keys are released and stable.
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "board.h"
+#include "ioutil.h"
+#include "key_event.h"
+
+#if !defined(NO_KEYS) && !defined(NO_TIMER)
+
+/* === macros ============================================ */
+#define KE_QUEUE_MASK (KEY_EVENT_QUEUE_LEN - 1)
+
+#if (KEY_EVENT_QUEUE_LEN & KE_QUEUE_MASK)
+# error "KEY_EVENT_QUEUE_LEN must be a power of 2"
+#endif
+
+/* samples from the press until the long press event */
+#define KE_LONG_SAMPLES (KEY_EVENT_LONG_TICKS / KEY_EVENT_SAMPLE_TICKS)
+
+/* === globals =========================================== */
+static key_event_t ke_queue[KEY_EVENT_QUEUE_LEN];
+static volatile uint8_t ke_in;
+static volatile uint8_t ke_out;
+static volatile uint8_t ke_overrun_cnt;
+
+static timer_hdl_t ke_timer;
+static uint8_t ke_state;    /* debounced keys */
+static uint8_t ke_raw;      /* last sample */
+static uint8_t ke_stable;   /* number of equal samples */
+static uint16_t ke_held;    /* samples since the last press */
+
+/* === functions ========================================= */
+static void ke_put(uint8_t type, uint8_t keys)
+{
+    if ((uint8_t)(ke_in - ke_out) >= KEY_EVENT_QUEUE_LEN)
+    {
+        if (ke_overrun_cnt < 0xff)
+        {
+            ke_overrun_cnt++;
+        }
+        return;
+    }
+    ke_queue[ke_in & KE_QUEUE_MASK].type = type;
+    ke_queue[ke_in & KE_QUEUE_MASK].keys = keys;
+    ke_in++;
+}
+
+static time_t ke_sample(timer_arg_t p)
+{
+uint8_t keys;
+
+    keys = KEY_GET();
+    if (keys != ke_raw)
+    {
+        ke_raw = keys;
+        ke_stable = 0;
+    }
+    else if (ke_stable < KEY_EVENT_DEBOUNCE)
+    {
+        ke_stable++;
+        if (ke_stable == KEY_EVENT_DEBOUNCE && keys != ke_state)
+        {
+            if (keys & ~ke_state)
+            {
+                ke_put(KEY_EVENT_PRESS, keys & ~ke_state);
+                ke_held = 0;
+            }
+            if (ke_state & ~keys)
+            {
+                ke_put(KEY_EVENT_RELEASE, ke_state & ~keys);
+            }
+            ke_state = keys;
+        }
+    }
+
+    if (ke_state != 0 && ke_held <= KE_LONG_SAMPLES)
+    {
+        if (++ke_held == KE_LONG_SAMPLES)
+        {
+            ke_put(KEY_EVENT_LONG, ke_state);
+        }
+    }
+
+#if defined(KEY_IRQ_vect)
+    if (ke_state == 0 && ke_raw == 0 && ke_stable == KEY_EVENT_DEBOUNCE)
+    {
+        /* all released, wait for the next key interrupt */
+        ke_timer = NONE_TIMER;
+        KEY_IRQ_ENABLE();
+        return 0;
+    }
+#endif
+    return KEY_EVENT_SAMPLE_TICKS;
+}
+
+void key_event_init(void)
+{
+    KEY_INIT();
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ke_state = ke_raw = 0;
+        ke_stable = 0;
+        ke_in = ke_out = 0;
+        if (ke_timer == NONE_TIMER)
+        {
+#if defined(KEY_IRQ_vect)
+            KEY_IRQ_DISABLE();
+#endif
+            ke_timer = timer_start(ke_sample, KEY_EVENT_SAMPLE_TICKS, 0);
+        }
+    }
+}
+
+bool key_event_get(key_event_t *ev)
+{
+    if (ke_in == ke_out)
+    {
+        return false;
+    }
+    *ev = ke_queue[ke_out & KE_QUEUE_MASK];
+    ke_out++;
+    return true;
+}
+
+uint8_t key_event_overruns(void)
+{
+    return ke_overrun_cnt;
+}
+
+bool key_event_busy(void)
+{
+    return ke_timer != NONE_TIMER;
+}
+
+#if defined(KEY_IRQ_vect)
+ISR(KEY_IRQ_vect)
+{
+    KEY_IRQ_DISABLE();
+    if (ke_timer == NONE_TIMER)
+    {
+        ke_stable = 0;
+        ke_timer = timer_start(ke_sample, KEY_EVENT_SAMPLE_TICKS, 0);
+    }
+}
+#endif
+
+#endif /* !defined(NO_KEYS) && !defined(NO_TIMER) */
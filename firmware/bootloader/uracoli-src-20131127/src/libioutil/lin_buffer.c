@@ -37,6 +37,7 @@
 /* === includes ============================================================ */
 #include <string.h>
 #include <stdio.h>
+#include <util/atomic.h>
 #include "ioutil.h"
 /* === macros ============================================================== */
 
@@ -96,7 +97,7 @@ int buffer_get_char(buffer_t *b)
 int ret;
 
     ret = EOF;
-    if (b->istart <= b->iend)
+    if (b->istart < b->iend)
     {
         ret = (int) b->data[b->istart++];
     }
@@ -156,14 +157,24 @@ size_t bufsize, bufidx;
     p = (buffer_pool_t *) pmem;
     p->elsz = BUFFER_ELSZ(bsz);
     p->nb = 0;
+    p->free = NULL;
     bufidx = 0;
     while (bufsize >= (bufidx + p->elsz))
     {
         p->nb ++;
         pbuf = (buffer_t*) (&p->pool[bufidx]);
-        pbuf->next = NULL;
         pbuf->used = 0;
         pbuf->len = bsz;
+        /* first buffer of the pool is handed out first */
+        pbuf->next = NULL;
+        if (p->free == NULL)
+        {
+            p->free = pbuf;
+        }
+        else
+        {
+            ((buffer_t*)&p->pool[bufidx - p->elsz])->next = pbuf;
+        }
         bufidx += p->elsz;
     }
 
@@ -172,31 +183,90 @@ size_t bufsize, bufidx;
 
 buffer_t * buffer_alloc(buffer_pool_t *ppool, uint8_t istart)
 {
-buffer_t *pbuf, *ret = NULL;
-uint8_t i;
-size_t poolidx;
+buffer_t *pbuf;
 
-    poolidx = 0;
-    for(i=0;i<ppool->nb;i++)
+    pbuf = ppool->free;
+    if (pbuf != NULL)
     {
-        pbuf = (buffer_t*)&ppool->pool[poolidx];
-        if (pbuf->used == 0)
-        {
-            pbuf->used = 1;
-            pbuf->istart = pbuf->iend = istart;
-            ret = pbuf;
-
-            break;
-        }
-        poolidx += ppool->elsz;
+        ppool->free = pbuf->next;
+        pbuf->next = NULL;
+        pbuf->used = 1;
+        pbuf->istart = pbuf->iend = istart;
     }
-    return ret;
+    return pbuf;
 }
 
 
-void buffer_free(buffer_t * pbuf)
+void buffer_free(buffer_pool_t *ppool, buffer_t * pbuf)
 {
+    if (pbuf->used == 0)
+    {
+        /* already free, don't link it twice */
+        return;
+    }
     pbuf->istart = pbuf->iend = 0;
     pbuf->used = 0;
+    pbuf->next = ppool->free;
+    ppool->free = pbuf;
     return;
 }
+
+buffer_t * buffer_alloc_atomic(buffer_pool_t *ppool, uint8_t istart)
+{
+buffer_t *pbuf;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pbuf = buffer_alloc(ppool, istart);
+    }
+    return pbuf;
+}
+
+void buffer_free_atomic(buffer_pool_t *ppool, buffer_t * pbuf)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        buffer_free(ppool, pbuf);
+    }
+}
+
+void buffer_queue_init(buffer_queue_t *pq)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pq->head = pq->tail = NULL;
+    }
+}
+
+void buffer_queue_push(buffer_queue_t *pq, buffer_t *pbuf)
+{
+    pbuf->next = NULL;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (pq->head == NULL)
+        {
+            pq->head = pbuf;
+        }
+        else
+        {
+            pq->tail->next = pbuf;
+        }
+        pq->tail = pbuf;
+    }
+}
+
+buffer_t * buffer_queue_pop(buffer_queue_t *pq)
+{
+buffer_t *pbuf;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        pbuf = pq->head;
+        if (pbuf != NULL)
+        {
+            pq->head = pbuf->next;
+            pbuf->next = NULL;
+        }
+    }
+    return pbuf;
+}
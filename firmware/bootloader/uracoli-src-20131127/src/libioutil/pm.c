@@ -0,0 +1,112 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/* $Id$ */
+/**
+ * @file
+ * @brief Idle sleep of the main loop, see pm.h
+ *
+ * @ingroup grpIoUtil
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <avr/interrupt.h>
+
+#include "board.h"
+#include "pm.h"
+
+/* === globals =========================================== */
+static volatile uint8_t pm_active;
+
+/* === functions ========================================= */
+void pm_set_active(uint8_t mask)
+{
+    cli();
+    pm_active |= mask;
+    sei();
+}
+
+void pm_clr_active(uint8_t mask)
+{
+    cli();
+    pm_active &= ~mask;
+    sei();
+}
+
+uint8_t pm_sleep_mode(void)
+{
+    if (pm_active & (PM_HIF | PM_TIMER | PM_ADC))
+    {
+        return SLEEP_MODE_IDLE;
+    }
+    if (pm_active & PM_RADIO)
+    {
+#if defined(TRX_IF_RFA1) && defined(SLEEP_MODE_PWR_SAVE)
+        return SLEEP_MODE_PWR_SAVE;
+#else
+        return SLEEP_MODE_IDLE;
+#endif
+    }
+    return SLEEP_MODE_PWR_DOWN;
+}
+
+void pm_idle(void)
+{
+uint8_t mode;
+
+    mode = pm_sleep_mode();
+    cli();
+#if defined(PM_EVENT_REG)
+    if (PM_EVENT_REG != 0)
+    {
+        /* an ISR came after the main loop looked at its flags */
+        PM_EVENT_REG = 0;
+        sei();
+        return;
+    }
+#endif
+    set_sleep_mode(mode);
+    sleep_enable();
+    ENERGY_MARK_ON(ENERGY_SLEEP);
+    /* the instruction after SEI is executed before an interrupt,
+     * so a pending interrupt wakes the MCU at once */
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    ENERGY_MARK_OFF(ENERGY_SLEEP);
+#if defined(PM_EVENT_REG)
+    /* the ISR which woke the MCU is handled by the caller */
+    PM_EVENT_REG = 0;
+#endif
+}
+
+/* EOF */
@@ -0,0 +1,107 @@
+/* Copyright (c) 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Delta encoded batches of sensor samples.
+ *
+ * A row is encoded into a scratch buffer first and copied into the
+ * frame only if it fits, so a full frame is always complete and can
+ * be sent as is. See @ref sensor_batch.h for the format.
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <string.h>
+
+#include "sensor_batch.h"
+
+/* === macros ============================================ */
+/* a varint of 16 bit takes up to 3 bytes */
+#define BATCH_ROW_MAX_LEN (3 * (1 + SENSOR_BATCH_MAX_CHAN))
+
+/* === functions ========================================= */
+static uint8_t batch_varint(uint8_t *p, uint16_t v)
+{
+uint8_t n = 0;
+
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+uint8_t sensor_batch_init(sensor_batch_t *b, p2p_sensor_batch_t *frm,
+                          uint8_t maxlen, uint8_t nchan)
+{
+    if (nchan == 0 || nchan > SENSOR_BATCH_MAX_CHAN ||
+        maxlen <= sizeof(p2p_sensor_batch_t))
+    {
+        return 0;
+    }
+    b->frm = frm;
+    b->maxlen = maxlen;
+    b->len = sizeof(p2p_sensor_batch_t);
+    b->rows = 0;
+    b->time = 0;
+    memset(b->last, 0, sizeof(b->last));
+    frm->hdr.cmd = P2P_SENSOR_BATCH;
+    frm->nchan = nchan;
+    return 1;
+}
+
+uint8_t sensor_batch_add(sensor_batch_t *b, uint16_t time,
+                         const int16_t *values)
+{
+uint8_t row[BATCH_ROW_MAX_LEN];
+uint8_t i, n;
+int16_t d;
+
+    n = batch_varint(row, (b->rows == 0) ? time : (uint16_t)(time - b->time));
+    for (i = 0; i < b->frm->nchan; i++)
+    {
+        d = (int16_t)(values[i] - b->last[i]);
+        /* zigzag, small differences of either sign give small codes */
+        n += batch_varint(&row[n], ((uint16_t)d << 1) ^ (uint16_t)(d >> 15));
+    }
+    if ((uint16_t)b->len + n > b->maxlen)
+    {
+        return 0;
+    }
+
+    memcpy((uint8_t*)b->frm + b->len, row, n);
+    b->len += n;
+    b->rows++;
+    b->time = time;
+    memcpy(b->last, values, b->frm->nchan * sizeof(int16_t));
+    return 1;
+}
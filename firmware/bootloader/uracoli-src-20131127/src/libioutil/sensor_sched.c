@@ -0,0 +1,254 @@
+/* Copyright (c) 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Batched sampling of I2C sensors.
+ *
+ * Once per period, a timer queues the read transactions of all
+ * registered channels back to back with i2c_submit(), so the bus is
+ * busy for one burst and the CPU is woken only by the TWI interrupts.
+ * The completion of the last transaction turns the burst into one
+ * record of the sample ring, see @ref sensor_sched.h for the format.
+ */
+
+/* === includes ========================================== */
+#include <stdint.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "board.h"
+#include "sensor_sched.h"
+
+#if defined(TWSR) && !defined(NO_TIMER)
+
+/* === macros ============================================ */
+#define SCHED_RING_MASK (SENSOR_SCHED_RING_SIZE - 1)
+
+#if (SENSOR_SCHED_RING_SIZE & SCHED_RING_MASK) || (SENSOR_SCHED_RING_SIZE > 128)
+# error "SENSOR_SCHED_RING_SIZE must be a power of 2, up to 128"
+#endif
+
+/* type byte + sample time */
+#define SCHED_REC_HDR_LEN (3)
+
+/* === globals =========================================== */
+static sensor_chan_t *sched_chans;
+static sensor_chan_t *sched_last;
+static timer_hdl_t sched_timer;
+static time_t sched_period;
+static uint16_t sched_time;
+static volatile uint8_t sched_busy;
+static volatile uint8_t sched_overrun_cnt;
+
+/* ring of records, the indexes are free running */
+static uint8_t sched_ring[SENSOR_SCHED_RING_SIZE];
+static volatile uint8_t sched_in;
+static volatile uint8_t sched_out;
+
+/* === functions ========================================= */
+static inline void sched_put(uint8_t *idx, uint8_t b)
+{
+    sched_ring[*idx & SCHED_RING_MASK] = b;
+    (*idx)++;
+}
+
+/*
+ * Completion of the last transaction of a burst, called from
+ * the TWI interrupt. The transactions are run in the order they were
+ * queued, so all channels are done here.
+ */
+static void sched_done(i2c_xfer_t *xfer)
+{
+sensor_chan_t *ch;
+uint8_t len, idx;
+
+    len = SCHED_REC_HDR_LEN;
+    for (ch = sched_chans; ch != NULL; ch = ch->next)
+    {
+        if (ch->xfer.status == I2C_XFER_OK)
+        {
+            len += 1 + ch->xfer.bytestoread;
+        }
+    }
+
+    if ((uint8_t)(sched_in - sched_out) + len > SENSOR_SCHED_RING_SIZE)
+    {
+        if (sched_overrun_cnt < 0xff)
+        {
+            sched_overrun_cnt++;
+        }
+    }
+    else
+    {
+        idx = sched_in;
+        sched_put(&idx, len);
+        sched_put(&idx, sched_time & 0xff);
+        sched_put(&idx, sched_time >> 8);
+        for (ch = sched_chans; ch != NULL; ch = ch->next)
+        {
+            if (ch->xfer.status == I2C_XFER_OK)
+            {
+                uint8_t i;
+                sched_put(&idx, SENSOR_CHAN_HDR(ch->id, ch->xfer.bytestoread));
+                for (i = 0; i < ch->xfer.bytestoread; i++)
+                {
+                    sched_put(&idx, ch->value[i]);
+                }
+            }
+        }
+        /* publish the record only when it is complete */
+        sched_in = idx;
+    }
+    sched_busy = 0;
+}
+
+/* Periodic timer, queues one burst of reads. */
+static time_t sched_tick(timer_arg_t p)
+{
+sensor_chan_t *ch;
+
+    if (sched_busy == 0 && sched_chans != NULL)
+    {
+        sched_busy = 1;
+        sched_time = (uint16_t)timer_systime();
+        for (ch = sched_chans; ch != NULL; ch = ch->next)
+        {
+            i2c_submit(&ch->xfer);
+        }
+    }
+    return sched_period;
+}
+
+uint8_t sensor_sched_add(sensor_chan_t *ch, uint8_t id, uint8_t devaddr,
+                         uint8_t reg, uint8_t len)
+{
+    if (id > SENSOR_CHAN_MAX_ID || len == 0 || len > SENSOR_CHAN_MAX_LEN)
+    {
+        return 0;
+    }
+
+    ch->reg = reg;
+    ch->id = id;
+    ch->next = NULL;
+    ch->xfer.devaddr = devaddr;
+    ch->xfer.writebuf = &ch->reg;
+    ch->xfer.bytestowrite = 1;
+    ch->xfer.readbuf = ch->value;
+    ch->xfer.bytestoread = len;
+    ch->xfer.done = sched_done;
+    ch->xfer.ctx = NULL;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (sched_last == NULL)
+        {
+            sched_chans = ch;
+        }
+        else
+        {
+            /* only the last transaction of the burst completes it */
+            sched_last->xfer.done = NULL;
+            sched_last->next = ch;
+        }
+        sched_last = ch;
+    }
+    return 1;
+}
+
+uint8_t sensor_sched_start(time_t period)
+{
+    sensor_sched_stop();
+    sched_period = period;
+    sched_timer = timer_start(sched_tick, period, 0);
+    return (sched_timer != NONE_TIMER) ? 1 : 0;
+}
+
+void sensor_sched_stop(void)
+{
+    if (sched_timer != NONE_TIMER)
+    {
+        timer_stop(sched_timer);
+        sched_timer = NONE_TIMER;
+    }
+}
+
+uint8_t sensor_sched_available(void)
+{
+    return (uint8_t)(sched_in - sched_out);
+}
+
+uint8_t sensor_sched_overruns(void)
+{
+    return sched_overrun_cnt;
+}
+
+uint8_t sensor_sched_pack(uint8_t *buf, uint8_t maxlen)
+{
+uint8_t out, avail, reclen, i, n = 0;
+
+    out = sched_out;
+    avail = (uint8_t)(sched_in - out);
+    while (avail > 0)
+    {
+        reclen = sched_ring[out & SCHED_RING_MASK];
+        if ((uint16_t)n + reclen > maxlen)
+        {
+            break;
+        }
+        for (i = 0; i < reclen; i++)
+        {
+            buf[n++] = sched_ring[out & SCHED_RING_MASK];
+            out++;
+        }
+        avail -= reclen;
+    }
+    /* free the copied records for the writer */
+    sched_out = out;
+    return n;
+}
+
+uint8_t sensor_sched_frame(p2p_sensor_data_t *frm, uint8_t maxlen)
+{
+uint8_t n;
+
+    if (maxlen <= sizeof(p2p_hdr_t))
+    {
+        return 0;
+    }
+    n = sensor_sched_pack(frm->data, maxlen - sizeof(p2p_hdr_t));
+    if (n == 0)
+    {
+        return 0;
+    }
+    frm->hdr.cmd = P2P_SENSOR_DATA;
+    return sizeof(p2p_hdr_t) + n;
+}
+
+#endif /* defined(TWSR) && !defined(NO_TIMER) */
@@ -0,0 +1,77 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Stack high-water mark, see stack_watch.h
+ *
+ * @ingroup grpIoUtil
+ */
+
+/* === includes ========================================== */
+#include <avr/io.h>
+#include "stack_watch.h"
+
+/* === globals ====================================== */
+extern uint8_t __heap_start; /* end of .data, .bss and .noinit */
+
+/* === functions ==================================== */
+void stack_watch_paint(void) __attribute__((naked, used, section(".init3")));
+
+/*
+ * Runs after the stack pointer and __zero_reg__ are set up in .init2,
+ * the interrupts are still off.
+ */
+void stack_watch_paint(void)
+{
+uint8_t *p = &__heap_start;
+
+    while (p < (uint8_t *) STACK_WATCH_TOP)
+    {
+        *p++ = STACK_WATCH_PAINT;
+    }
+}
+
+void stack_watch_get(stack_watch_t *st)
+{
+uint8_t *p = &__heap_start;
+
+    while ((p < (uint8_t *) STACK_WATCH_TOP) && (*p == STACK_WATCH_PAINT))
+    {
+        p++;
+    }
+    st->data = (uint16_t) &__heap_start - RAMSTART;
+    st->unused = (uint16_t) p - (uint16_t) &__heap_start;
+    st->peak = RAMEND + 1 - (uint16_t) p;
+    st->free = SP - (uint16_t) &__heap_start;
+}
+
+/* EOF */
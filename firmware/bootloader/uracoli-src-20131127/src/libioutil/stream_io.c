@@ -55,6 +55,8 @@ FILE *f;
     pbs->pbufout = NULL;
     pbs->incb = incb;
     pbs->outcb = outcb;
+    pbs->outmark = 0;
+    pbs->flushchar = EOF;
     fdev_setup_stream ( f,
                         buffer_stream_putchar,
                         buffer_stream_getchar,
@@ -64,17 +66,78 @@ FILE *f;
     return 0;
 }
 
+void buffer_stream_set_watermark(buffer_stream_t *pbs, uint8_t outmark,
+                                 int flushchar)
+{
+    pbs->outmark = outmark;
+    pbs->flushchar = flushchar;
+}
+
+/* In block mode, check if the output buffer is due for outcb. */
+static inline int buffer_stream_due(buffer_stream_t *pbs)
+{
+buffer_t *b;
+    b = pbs->pbufout;
+    return (BUFFER_FREE_AT_END(b) == 0) || (BUFFER_SIZE(b) >= pbs->outmark);
+}
+
 int buffer_stream_putchar(char c, FILE *f)
 {
 buffer_stream_t *pbs;
+int rv;
 
     pbs = fdev_get_udata(f);
+    rv = (BUFFER_FREE_AT_END(pbs->pbufout) > 0) ? 0 : EOF;
     buffer_append_char(pbs->pbufout, c);
     if( pbs->outcb != NULL)
+    {
+        if (pbs->outmark == 0 || buffer_stream_due(pbs) ||
+            (uint8_t)c == pbs->flushchar)
+        {
+            pbs->outcb(pbs->pbufout);
+        }
+    }
+    return rv;
+}
+
+uint8_t buffer_stream_write(buffer_stream_t *pbs, const void *pdata,
+                            uint8_t size)
+{
+const uint8_t *p;
+uint8_t n, written = 0;
+
+    p = pdata;
+    while (size > 0)
+    {
+        n = buffer_append_block(pbs->pbufout, (void *)p, size);
+        p += n;
+        size -= n;
+        written += n;
+        if (size == 0 || pbs->outcb == NULL)
+        {
+            break;
+        }
+        /* buffer is full, pass it on and go on with the rest */
+        pbs->outcb(pbs->pbufout);
+        if (BUFFER_FREE_AT_END(pbs->pbufout) == 0)
+        {
+            break;
+        }
+    }
+    if (pbs->outcb != NULL && BUFFER_SIZE(pbs->pbufout) > 0 &&
+        (pbs->outmark == 0 || buffer_stream_due(pbs)))
+    {
+        pbs->outcb(pbs->pbufout);
+    }
+    return written;
+}
+
+void buffer_stream_flush(buffer_stream_t *pbs)
+{
+    if (pbs->outcb != NULL && BUFFER_SIZE(pbs->pbufout) > 0)
     {
         pbs->outcb(pbs->pbufout);
     }
-    return EOF;
 }
 
 
@@ -83,6 +146,15 @@ int buffer_stream_getchar(FILE *f)
 buffer_stream_t *pbs;
 int c;
     pbs = fdev_get_udata(f);
+    if (pbs->outmark != 0)
+    {
+        c = buffer_get_char(pbs->pbufin);
+        if (pbs->incb != NULL && BUFFER_SIZE(pbs->pbufin) == 0)
+        {
+            pbs->incb(pbs->pbufin);
+        }
+        return c;
+    }
     if( pbs->incb != NULL)
     {
         pbs->incb(pbs->pbufin);
@@ -91,3 +163,15 @@ int c;
     return c;
 }
 
+uint8_t buffer_stream_read(buffer_stream_t *pbs, void *pdata, uint8_t size)
+{
+uint8_t n;
+
+    n = buffer_get_block(pbs->pbufin, pdata, size);
+    if (pbs->incb != NULL && BUFFER_SIZE(pbs->pbufin) == 0)
+    {
+        pbs->incb(pbs->pbufin);
+    }
+    return n;
+}
+
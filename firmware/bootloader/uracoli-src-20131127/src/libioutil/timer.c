@@ -31,236 +31,363 @@
 /* === includes ========================================== */
 #include "board.h"
 #include "timer.h"
+#include "isr_prof.h"
+#include "energy_mark.h"
+#include "pm.h"
 #include <string.h>
+#include <util/atomic.h>
 
-/* === types ============================================= */
+/* === macros ============================================ */
 #ifndef NO_TIMER
-/**
- * Data type for timer entries.
+/*
+ * The timers are kept in a two level timer wheel. Level 0 has one slot
+ * per tick and holds the timers expiring within the next
+ * TIMER_WHEEL_SLOTS ticks, level 1 has one slot per TIMER_WHEEL_SLOTS
+ * ticks. Each time level 0 wraps, the next level 1 slot is cascaded
+ * down; timers further away than level 1 reaches are simply put back
+ * into level 1 until they come into range. Start, stop and expiry are
+ * O(1), and a tick never touches more than the timers of one slot per
+ * level.
+ */
+#ifndef TIMER_WHEEL_BITS
+/** log2 of the number of slots of each wheel level */
+# define TIMER_WHEEL_BITS (3)
+#endif
+#define TIMER_WHEEL_SLOTS  (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK   (TIMER_WHEEL_SLOTS - 1)
+
+/** number of low bits of a timer handle, which carry the pool index + 1 */
+#define TIMER_HDL_IDX_BITS (8)
+#define TIMER_HDL_IDX_MASK ((1 << TIMER_HDL_IDX_BITS) - 1)
+
+/*
+ * With TIMER_DEFERRED_CALLBACKS defined, the ISR only moves expired
+ * timers to the pending list, and the handler functions are run by
+ * timer_task() from the main loop, with interrupts enabled. Otherwise
+ * the handlers are run from within TIMER_IRQ_vect, as before.
  */
-typedef struct timer_tag
-{
-    /** reference number of the timer */
-    timer_hdl_t hdl;
-    /** value, when the timer expires in system ticks */
-    time_t expire;
-    /** pointer to a timer handler function */
-    timer_handler_t *func;
-    /** pointer to a argument, which is given to the
-     * timer handler function */
-    timer_arg_t arg;
-    /** pointer to the next timer in the timer queue.
-     */
-    struct timer_tag * next;
-} timer_t;
 
+/*
+ * With TIMER_TICKLESS defined, the hardware timer runs freely and is
+ * only programmed to interrupt when the wheel needs service next, that
+ * is for the next expiry or cascade. The elapsed ticks are counted from
+ * HWTIMER_REG on each interrupt, so systime stays exact while the CPU
+ * sleeps between events. The board header needs to provide
+ * HWTIMER_TICKLESS_COUNTS (hardware counts per system tick) and
+ * HWTIMER_TICKLESS_CMP (the compare register, which raises
+ * TIMER_IRQ_vect).
+ */
+#if defined(TIMER_TICKLESS)
+# if !defined(HWTIMER_TICKLESS_COUNTS) || !defined(HWTIMER_TICKLESS_CMP)
+#  error "TIMER_TICKLESS is not supported by this board"
+# endif
+# ifndef TIMER_TICKLESS_MAX_TICKS
+/** longest sleep between two timer interrupts, in system ticks,
+ *  which must stay below half the range of the hardware counter */
+#  define TIMER_TICKLESS_MAX_TICKS (0x8000U / HWTIMER_TICKLESS_COUNTS)
+# endif
+#endif
 
-/* === globals =========================================== */
-#if TIMER_POOL_SIZE != 0
-  timer_t timer_pool[TIMER_POOL_SIZE];
-#else
-# error "Malloc Timer not yet implemented"
+#if TIMER_POOL_MAX >= TIMER_HDL_IDX_MASK
+# error "TIMER_POOL_MAX too large for the timer handle encoding"
 #endif
 
-timer_t *tqhead;
+/* === types ============================================= */
+typedef timer_entry_t timer_t;
+
+
+/* === globals =========================================== */
+/*
+ * The pool is defined with TIMER_POOL_DEFINE(), either by the
+ * application or by the board default in timer_pool.c.
+ */
+extern timer_t timer_pool[];
+extern const uint8_t timer_pool_size;
+
+/** wheel slots, [0] = one tick per slot, [1] = TIMER_WHEEL_SLOTS ticks per slot */
+static timer_t *tmr_wheel[2][TIMER_WHEEL_SLOTS];
+/** list of unused timer pool entries */
+static timer_t *tmr_free;
+/** list of expired timers, whose handler needs to be run */
+static timer_t *tmr_pending;
+/** wheel time, unlike systime it is not changed by timer_set_systime() */
+static time_t tmr_now;
+#if defined(TIMER_TICKLESS)
+/** hardware counter value at tmr_now */
+static uint16_t tmr_hwlast;
+/** ticks from tmr_now, when the wheel needs service next */
+static time_t tmr_due;
+#endif
 volatile time_t   systime;
 volatile time_t   timebase;
 timer_hdl_t tmrhdl = 1;
 
 
 /* === internal functions ================================== */
+static inline void tmr_link(timer_t **head, timer_t *tmr)
+{
+    tmr->next = *head;
+    if (tmr->next != NULL)
+    {
+        tmr->next->pprev = &tmr->next;
+    }
+    tmr->pprev = head;
+    *head = tmr;
+}
+
+static inline void tmr_unlink(timer_t *tmr)
+{
+    *tmr->pprev = tmr->next;
+    if (tmr->next != NULL)
+    {
+        tmr->next->pprev = tmr->pprev;
+    }
+    tmr->next = NULL;
+    tmr->pprev = NULL;
+}
+
 timer_t * tmr_create(time_t expire,  timer_handler_t func)
 {
-timer_t *ret = NULL;
+timer_t *ret = tmr_free;
 
-#if ! defined(HAVE_MALLOC_TIMERS)
-uint8_t i;
-    for(i=0;i<TIMER_POOL_SIZE;i++)
+    if (ret != NULL)
     {
-        if(timer_pool[i].func == NULL)
-        {
-            timer_pool[i].func = func;
-            timer_pool[i].expire = expire;
-            ret = &timer_pool[i];
-            break;
-        }
+        tmr_free = ret->next;
+        ret->func = func;
+        ret->expire = expire;
+        ret->next = NULL;
+        ret->pprev = NULL;
     }
-#else
-# error "Malloc Timer not implemented"
-#endif
     return ret;
 }
 
+static void tmr_release(timer_t *tmr)
+{
+    tmr->hdl = NONE_TIMER;
+    tmr->func = NULL;
+    tmr->pprev = NULL;
+    tmr->next = tmr_free;
+    tmr_free = tmr;
+}
 
 void tmr_insert(timer_t *tmr)
 {
-timer_t *prev, *next;
-
-#if 1
-    /* believe it or not, this cost 12 byte less memory */
-    tmr->next = NULL;
-    if(tqhead == NULL)
+    if ((tmr->expire - tmr_now) < TIMER_WHEEL_SLOTS)
     {
-        tqhead = tmr;
+        tmr_link(&tmr_wheel[0][tmr->expire & TIMER_WHEEL_MASK], tmr);
     }
     else
     {
-        for(prev = NULL, next = tqhead;
-            next != NULL;
-            prev = next, next = next->next)
-        {
-            if(next->expire > tmr->expire)
-            {
-                tmr->next = next;
-                if (prev)
-                {
-                    prev->next = tmr;
-                }
-                else
-                {
-                    tqhead = tmr;
-                }
-                tmr = NULL;
-                break;
-            }
-        }
-        /* no insert, append tmr to tail */
-        if (tmr && prev)
+        tmr_link(&tmr_wheel[1][(tmr->expire >> TIMER_WHEEL_BITS) & TIMER_WHEEL_MASK], tmr);
+    }
+}
+
+static timer_t * tmr_find(timer_hdl_t th)
+{
+timer_t *ret = NULL;
+uint8_t idx;
+
+    idx = (th & TIMER_HDL_IDX_MASK) - 1;
+    if ((idx < timer_pool_size) &&
+        (timer_pool[idx].hdl == th) &&
+        (timer_pool[idx].pprev != NULL))
+    {
+        ret = &timer_pool[idx];
+    }
+    return ret;
+}
+
+/**
+ * Wheel time at which a timer of the given duration expires.
+ * A duration of 0 expires with the next tick.
+ */
+static inline time_t tmr_expiry(time_t duration)
+{
+    return tmr_now + ((duration != 0) ? duration : 1);
+}
+
+void tmr_process(void)
+{
+timer_t **slot;
+timer_t *tmr, *next;
+
+    tmr_now++;
+    if ((tmr_now & TIMER_WHEEL_MASK) == 0)
+    {
+        /* cascade the level 1 slot covering the next TIMER_WHEEL_SLOTS ticks */
+        slot = &tmr_wheel[1][(tmr_now >> TIMER_WHEEL_BITS) & TIMER_WHEEL_MASK];
+        tmr = *slot;
+        *slot = NULL;
+        while (tmr != NULL)
         {
-            prev->next = tmr;
+            next = tmr->next;
+            tmr_insert(tmr);
+            tmr = next;
         }
     }
 
-#else
-    for(prev = NULL, next = tqhead;
-        next != NULL;
-        prev = next, next = next->next)
+    /* every timer in the current level 0 slot expires now */
+    slot = &tmr_wheel[0][tmr_now & TIMER_WHEEL_MASK];
+    while ((tmr = *slot) != NULL)
+    {
+        tmr_unlink(tmr);
+        tmr_link(&tmr_pending, tmr);
+    }
+}
+
+#if defined(TIMER_TICKLESS)
+/**
+ * Ticks from now until the wheel needs service, i.e. until the next
+ * occupied level 0 slot or the next cascade of an occupied level 1
+ * slot, whichever comes first.
+ */
+static time_t tmr_next_service(void)
+{
+time_t ret = TIMER_TICKLESS_MAX_TICKS;
+time_t tcascade;
+uint8_t i;
+
+    for (i = 1; i < TIMER_WHEEL_SLOTS; i++)
     {
-        if(next->expire > tmr->expire)
+        if (tmr_wheel[0][(tmr_now + i) & TIMER_WHEEL_MASK] != NULL)
         {
-            tmr->next = next;
-            if (prev)
-            {
-                prev->next = tmr;
-            }
-            else
-            {
-                tqhead = tmr;
-            }
-            tmr = NULL;
+            ret = i;
             break;
         }
     }
-    /* no insert, append tmr to tail */
-    if (tmr)
+    for (i = 1; i <= TIMER_WHEEL_SLOTS; i++)
     {
-        if (prev)
-        {
-            prev->next = tmr;
-        }
-        else
+        if (tmr_wheel[1][((tmr_now >> TIMER_WHEEL_BITS) + i) & TIMER_WHEEL_MASK] != NULL)
         {
-            tqhead = tmr;
+            tcascade = (((tmr_now >> TIMER_WHEEL_BITS) + i) << TIMER_WHEEL_BITS) - tmr_now;
+            if (tcascade < ret)
+            {
+                ret = tcascade;
+            }
+            break;
         }
-        tmr->next = NULL;
     }
-#endif
+    return ret;
 }
 
-timer_t * tmr_queue_find_delete(timer_hdl_t th)
+/**
+ * Bring the wheel up to the hardware counter. Ticks in which the wheel
+ * needs no service are skipped in one step.
+ */
+static void tmr_advance(void)
 {
-timer_t *ret = NULL;
-timer_t *prev, *next;
-#if 1
-    if(tqhead)
+uint16_t elapsed;
+time_t skip;
+
+    elapsed = (uint16_t)(HWTIMER_REG - tmr_hwlast) / HWTIMER_TICKLESS_COUNTS;
+    tmr_hwlast += elapsed * HWTIMER_TICKLESS_COUNTS;
+    while (elapsed != 0)
     {
-        for(prev = NULL, next = tqhead;
-            next != NULL;
-            prev = next, next = next->next)
+        skip = (elapsed < tmr_due) ? elapsed : (tmr_due - 1);
+        tmr_now += skip;
+        systime += skip;
+        elapsed -= skip;
+        tmr_due -= skip;
+        if (elapsed != 0)
         {
-            if(next->hdl == th)
-            {
-                ret = next;
-                if(prev)
-                {
-                    prev->next = next->next;
-                }
-                else
-                {
-                    tqhead = next->next;
-                }
-
-            }
+            systime++;
+            tmr_process();
+            elapsed--;
+            tmr_due = tmr_next_service();
         }
     }
-#else
-    if(tqhead)
+}
+
+/**
+ * Program the compare register for the next wheel service.
+ */
+static void tmr_reschedule(void)
+{
+uint16_t cmp;
+
+    tmr_due = tmr_next_service();
+#if !defined(TIMER_DEFERRED_CALLBACKS)
+    if (tmr_pending != NULL)
     {
-        for(prev = tqhead, next = tqhead;
-            next != NULL && prev != NULL;
-            prev = next, next = next->next)
-        {
-            if(next->hdl == th)
-            {
-                ret = next;
-                prev->next = next->next;
-            }
-        }
+        /* expired during tmr_advance() outside of the ISR */
+        tmr_due = 1;
     }
 #endif
-
-    return ret;
+    cmp = tmr_hwlast + (uint16_t)tmr_due * HWTIMER_TICKLESS_COUNTS;
+    HWTIMER_TICKLESS_CMP = cmp;
+    if ((uint16_t)(HWTIMER_REG - tmr_hwlast) >= (uint16_t)(cmp - tmr_hwlast - 1))
+    {
+        /* the compare value is reached already or about to be */
+        HWTIMER_TICKLESS_CMP = HWTIMER_REG + 2;
+    }
 }
+#else
+# define tmr_advance()    do{}while(0)
+# define tmr_reschedule() do{}while(0)
+#endif
 
-void tmr_process(void)
+/**
+ * Run the handlers of the pending timers. A timer is taken off the
+ * pending list before its handler runs, so the handler may start, stop
+ * or restart any timer, and only the list updates are done atomically.
+ */
+static void tmr_run_pending(void)
 {
-timer_t *prev, *next;
+timer_t *tmr;
 time_t trestart;
-    for(prev = NULL, next = tqhead;
-        next != NULL;
-        prev = next, next = next->next)
+
+    do
     {
-        if(next->expire <= systime)
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
         {
-            if (prev)
-            {
-                prev->next = next->next;
-            }
-            else
-            {
-                tqhead = next->next;
-            }
-            trestart = next->func(next->arg);
-            if (trestart != 0)
-            {
-                next->expire = systime + trestart;
-                tmr_insert(next);
-            }
-            else
+            tmr = tmr_pending;
+            if (tmr != NULL)
             {
-                /* no restart needed, remove timer from queue*/
-#if ! defined(HAVE_MALLOC_TIMERS)
-                next->hdl = NONE_TIMER;
-                next->func = NULL;
-                next->next = NULL;
-#else
-# error "Malloc Timer not implemented"
-#endif
+                tmr_unlink(tmr);
             }
         }
-        else
+        if (tmr != NULL)
         {
-            break;
+            trestart = tmr->func(tmr->arg);
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                if (trestart != 0)
+                {
+                    tmr_advance();
+                    tmr->expire = tmr_now + trestart;
+                    tmr_insert(tmr);
+                    tmr_reschedule();
+                }
+                else
+                {
+                    /* no restart needed, return timer to the pool */
+                    tmr_release(tmr);
+                }
+            }
         }
     }
-
+    while (tmr != NULL);
 }
 
 
 ISR(TIMER_IRQ_vect)
 {
+    /* the counter restarted at the overflow, t0 is the latency */
+    ISR_PROF_ENTER(t0);
+    ENERGY_MARK_ON(ENERGY_ISR);
+#if defined(TIMER_TICKLESS)
+    tmr_advance();
+#else
     systime++;
     tmr_process();
+#endif
+#if !defined(TIMER_DEFERRED_CALLBACKS)
+    tmr_run_pending();
+#endif
+    tmr_reschedule();
+    PM_EVENT();
+    ENERGY_MARK_OFF(ENERGY_ISR);
+    ISR_PROF_EXIT_LATE(ISR_PROF_TIMER, t0, t0);
 }
 
 /* === interface functions ================================= */
@@ -270,13 +397,22 @@ ISR(TIMER_IRQ_vect)
 */
 void timer_init(void)
 {
+uint8_t i;
+
     TIMER_INIT();
-#   ifdef HAVE_MALLOC_TIMERS
-    memset(timer_pool, 0,
-           sizeof(timer_t)*TIMER_POOL_SIZE);
-#   endif
-    tqhead = NULL;
+    memset(tmr_wheel, 0, sizeof(tmr_wheel));
+    tmr_free = NULL;
+    tmr_pending = NULL;
+    for(i=0;i<timer_pool_size;i++)
+    {
+        tmr_release(&timer_pool[i]);
+    }
+    tmr_now = 0;
     systime = 0;
+#if defined(TIMER_TICKLESS)
+    tmr_hwlast = HWTIMER_REG;
+    tmr_reschedule();
+#endif
 }
 
 
@@ -285,28 +421,40 @@ timer_hdl_t timer_start(timer_handler_t *thfunc, time_t duration,
 {
 timer_t *tmr;
 timer_hdl_t ret = NONE_TIMER;
-   tmr = tmr_create(duration + systime,  thfunc);
-   if (tmr != NULL)
-   {
-       ret = tmr->hdl = tmrhdl ++;
-       tmr->arg = arg;
-       tmr_insert(tmr);
-   }
-   return ret;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tmr_advance();
+        tmr = tmr_create(tmr_expiry(duration),  thfunc);
+        if (tmr != NULL)
+        {
+            ret = tmr->hdl = (tmrhdl++ << TIMER_HDL_IDX_BITS) |
+                             ((tmr - timer_pool) + 1);
+            tmr->arg = arg;
+            tmr_insert(tmr);
+        }
+        tmr_reschedule();
+    }
+    return ret;
 }
 
 timer_hdl_t timer_restart(timer_hdl_t th, time_t duration)
 {
 timer_hdl_t ret = NONE_TIMER;
 timer_t * tmr;
-time_t tmr_exp;
-    tmr_exp = duration + systime;
-    tmr = tmr_queue_find_delete(th);
-    if(tmr)
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        tmr->expire = tmr_exp;
-        tmr_insert(tmr);
-        ret = tmr->hdl;
+        tmr_advance();
+        tmr = tmr_find(th);
+        if(tmr)
+        {
+            tmr_unlink(tmr);
+            tmr->expire = tmr_expiry(duration);
+            tmr_insert(tmr);
+            ret = tmr->hdl;
+        }
+        tmr_reschedule();
     }
     return ret;
 
@@ -317,27 +465,55 @@ timer_hdl_t timer_stop(timer_hdl_t th)
 timer_hdl_t ret = NONE_TIMER;
 timer_t * tmr;
 
-    tmr = tmr_queue_find_delete(th);
-    if(tmr)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        ret = tmr->hdl;
-        tmr->hdl = NONE_TIMER;
-        tmr->func = NULL;
-
+        tmr = tmr_find(th);
+        if(tmr)
+        {
+            ret = tmr->hdl;
+            tmr_unlink(tmr);
+            tmr_release(tmr);
+        }
     }
     return ret;
 }
 
+void timer_task(void)
+{
+    if (tmr_pending != NULL)
+    {
+        tmr_run_pending();
+    }
+}
+
 time_t timer_systime(void)
 {
+#if defined(TIMER_TICKLESS)
+time_t ret;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tmr_advance();
+        tmr_reschedule();
+        ret = systime;
+    }
+    return ret;
+#else
    return systime;
+#endif
 }
 
 
 void timer_set_systime(time_t sec)
 {
    cli();
+#if defined(TIMER_TICKLESS)
+   /* the counter runs freely, the wheel only needs to catch up */
+   tmr_advance();
+   tmr_reschedule();
+#else
    HWTIMER_REG = 0;
+#endif
    systime = 0;
    timebase = sec;
    sei();
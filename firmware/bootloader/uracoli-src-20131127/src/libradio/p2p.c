@@ -37,6 +37,7 @@
 /* === includes ============================================================ */
 
 /* === send flags =========================================================== */
+#include <string.h>
 #include "board.h"
 #include "transceiver.h"
 #include "radio.h"
@@ -58,6 +59,16 @@ const node_config_t PROGMEM nc_flash =
 	.channel = 17
 };
 static node_config_t NodeConfig;
+#if defined(RADIO_TXQUEUE)
+/** id of the next fragmented message */
+static uint8_t p2p_msgid;
+#endif
+/** sequence number of frames sent by p2p_send_buffer() */
+static uint8_t p2p_seq;
+#if defined(P2P_SECURITY)
+/** outgoing frame counter */
+static uint32_t p2p_fc;
+#endif
 
 /* === prototypes ========================================================== */
 
@@ -68,8 +79,18 @@ char p2p_init()
 	char cfg_location = '?';
 
 	/* === read node configuration data ===================================== */
+#if defined(NODE_CONFIG_HANDOFF)
+	/* record the bootloader read already */
+	if (get_node_config_handoff(&NodeConfig) == 0)
+	{
+		cfg_location = 'H';
+	}
+	/* 1st trial: read from EEPROM */
+	else if (get_node_config_eeprom(&NodeConfig, 0) == 0)
+#else
 	/* 1st trial: read from EEPROM */
 	if (get_node_config_eeprom(&NodeConfig, 0) == 0)
+#endif
 	{
 		/* using EEPROM config */;
 		cfg_location = 'E';
@@ -119,11 +140,368 @@ void p2p_send(uint16_t dst, uint8_t cmd, uint8_t flags,
 
     __FILL_P2P_HEADER__(hdr, ((flags & P2P_ACK) ? 0x8861 : 0x8841),
                     NodeConfig.pan_id, dst, NodeConfig.short_addr, cmd);
+#if defined(P2P_SECURITY)
+    if (flags & P2P_SECURE)
+    {
+        lendata = p2p_secure(data, lendata);
+    }
+#endif
     radio_set_state(STATE_TX);
     radio_set_state(STATE_TXAUTO);
     radio_send_frame(lendata + 2, data, 1); /* +2: add CRC bytes (FCF) */
 }
 
+uint8_t p2p_send_buffer(uint16_t dst, uint8_t cmd, uint8_t flags,
+                        buffer_t *pbuf)
+{
+p2p_hdr_t *hdr;
+
+    if (BUFFER_FREE_AT_START(pbuf) < sizeof(p2p_hdr_t))
+    {
+        return 0;
+    }
+    pbuf->istart -= sizeof(p2p_hdr_t);
+    hdr = (p2p_hdr_t*) BUFFER_PDATA(pbuf);
+    hdr->seq = p2p_seq;
+    __FILL_P2P_HEADER__(hdr, ((flags & P2P_ACK) ? 0x8861 : 0x8841),
+                    NodeConfig.pan_id, dst, NodeConfig.short_addr, cmd);
+    p2p_seq = hdr->seq;
+#if defined(P2P_SECURITY)
+    if ((flags & P2P_SECURE) && (p2p_secure_buffer(pbuf) == 0))
+    {
+        return 0;
+    }
+#endif
+    if ((BUFFER_SIZE(pbuf) + 2) > MAX_FRAME_SIZE)
+    {
+        return 0;
+    }
+    radio_set_state(STATE_TX);
+    radio_set_state(STATE_TXAUTO);
+    radio_send_frame(BUFFER_SIZE(pbuf) + 2, BUFFER_PDATA(pbuf), 1);
+    return 1;
+}
+
+
+#if defined(RADIO_TXQUEUE)
+/* tx queue class of a command, data streams yield to the control frames */
+static uint8_t p2p_txq_prio(uint8_t cmd)
+{
+    switch (cmd)
+    {
+        case P2P_WIBO_DATA:
+        case P2P_WIBO_DATA_SEQ:
+        case P2P_WIBO_FEC:
+        case P2P_FRAG:
+        case P2P_PHY_TEST:
+            return RADIO_TXQ_BULK;
+        case P2P_PING_REQ:
+        case P2P_PING_CNF:
+        case P2P_PING_SHORT_REQ:
+        case P2P_PING_SHORT_CNF:
+        case P2P_JUMP_BOOTL:
+        case P2P_TSYNC:
+        case P2P_WIBO_EXIT:
+        case P2P_WIBO_DEAF:
+        case P2P_WIBO_RESET:
+        case P2P_WIBO_WINDOW_REQ:
+        case P2P_WIBO_WINDOW_CNF:
+        case P2P_WIBO_FEC_REQ:
+        case P2P_WIBO_FEC_CNF:
+            return RADIO_TXQ_CONTROL;
+        default:
+            return RADIO_TXQ_NORMAL;
+    }
+}
+
+int16_t p2p_send_queued(uint16_t dst, uint8_t cmd, uint8_t flags,
+                        uint8_t *data, uint8_t lendata, uint8_t retries)
+{
+    p2p_hdr_t *hdr = (p2p_hdr_t*) data;
+
+    __FILL_P2P_HEADER__(hdr, ((flags & P2P_ACK) ? 0x8861 : 0x8841),
+                    NodeConfig.pan_id, dst, NodeConfig.short_addr, cmd);
+#if defined(P2P_SECURITY)
+    if (flags & P2P_SECURE)
+    {
+        lendata = p2p_secure(data, lendata);
+    }
+#endif
+    return radio_txq_put_prio(lendata + 2, data, STATE_TXAUTO, retries,
+                              p2p_txq_prio(cmd));
+}
+#endif
+
+#if defined(RADIO_TXQUEUE)
+uint8_t p2p_send_msg(uint16_t dst, uint8_t cmd, uint8_t flags,
+                     uint8_t *msg, uint16_t lenmsg, uint8_t retries)
+{
+uint8_t frm[MAX_FRAME_SIZE];
+p2p_frag_t *pfrag = (p2p_frag_t*)frm;
+uint8_t idx, cnt, dlen;
+
+    cnt = (lenmsg + P2P_FRAG_PAYLOAD - 1) / P2P_FRAG_PAYLOAD;
+    if ((cnt == 0) || (cnt > P2P_FRAG_MAX_CNT))
+    {
+        return 0;
+    }
+#if defined(P2P_SECURITY)
+    if (flags & P2P_SECURE)
+    {
+        /* no room for the security overhead in a full fragment */
+        return 0;
+    }
+#endif
+    p2p_msgid++;
+    for (idx = 0; idx < cnt; idx++)
+    {
+        dlen = (lenmsg > P2P_FRAG_PAYLOAD) ? P2P_FRAG_PAYLOAD : lenmsg;
+        pfrag->cmd = cmd;
+        pfrag->msgid = p2p_msgid;
+        pfrag->idx = idx;
+        pfrag->cnt = cnt;
+        memcpy(pfrag->data, msg, dlen);
+        msg += dlen;
+        lenmsg -= dlen;
+        while (p2p_send_queued(dst, P2P_FRAG, flags, frm,
+                               sizeof(p2p_frag_t) + dlen, retries) < 0)
+        {
+            /* wait for TX_END of the oldest fragment */
+        }
+    }
+    return cnt;
+}
+#endif
+
+void p2p_frag_init(p2p_reasm_t *ctx, uint8_t *buf, uint16_t bufsz)
+{
+    memset(ctx, 0, sizeof(p2p_reasm_t));
+    ctx->buf = buf;
+    ctx->bufsz = bufsz;
+}
+
+uint16_t p2p_frag_receive(p2p_reasm_t *ctx, uint8_t *frm, uint8_t len)
+{
+p2p_frag_t *pfrag = (p2p_frag_t*)frm;
+uint16_t offs;
+uint8_t dlen;
+
+    if ((len < sizeof(p2p_frag_t)) || (pfrag->hdr.cmd != P2P_FRAG) ||
+        (pfrag->cnt == 0) || (pfrag->cnt > P2P_FRAG_MAX_CNT) ||
+        (pfrag->idx >= pfrag->cnt))
+    {
+        return 0;
+    }
+    if ((ctx->rxmask == 0) || (ctx->src != pfrag->hdr.src) ||
+        (ctx->msgid != pfrag->msgid))
+    {
+        /* start of a new message */
+        ctx->src = pfrag->hdr.src;
+        ctx->msgid = pfrag->msgid;
+        ctx->cmd = pfrag->cmd;
+        ctx->cnt = pfrag->cnt;
+        ctx->rxmask = 0;
+        ctx->len = 0;
+    }
+    dlen = len - sizeof(p2p_frag_t);
+    offs = (uint16_t)pfrag->idx * P2P_FRAG_PAYLOAD;
+    if ((offs + dlen) > ctx->bufsz)
+    {
+        ctx->rxmask = 0;
+        return 0;
+    }
+    memcpy(ctx->buf + offs, pfrag->data, dlen);
+    ctx->rxmask |= (1 << pfrag->idx);
+    if (pfrag->idx == (ctx->cnt - 1))
+    {
+        ctx->len = offs + dlen;
+    }
+    if (ctx->rxmask == (uint16_t)((1UL << ctx->cnt) - 1))
+    {
+        ctx->rxmask = 0;
+        return ctx->len;
+    }
+    return 0;
+}
+
+#if defined(P2P_SECURITY)
+void p2p_set_key(const uint8_t *key)
+{
+    trx_aes_setkey(key);
+}
+
+/**
+ * @brief Fill a CCM* B0/Ai block.
+ *
+ * The nonce is built from PAN ID, source address, frame counter
+ * and security level.
+ */
+static void p2p_ccm_block(uint8_t *blk, uint8_t flags, p2p_hdr_t *hdr,
+                          uint32_t fc, uint16_t cnt)
+{
+    memset(blk, 0, TRX_AES_BLOCKSIZE);
+    blk[0] = flags;
+    blk[1] = hdr->pan & 0xff;
+    blk[2] = hdr->pan >> 8;
+    blk[3] = hdr->src & 0xff;
+    blk[4] = hdr->src >> 8;
+    blk[9] = fc >> 24;
+    blk[10] = fc >> 16;
+    blk[11] = fc >> 8;
+    blk[12] = fc;
+    blk[13] = P2P_SEC_LEVEL;
+    blk[14] = cnt >> 8;
+    blk[15] = cnt;
+}
+
+/**
+ * @brief Feed bytes into the CBC-MAC, a full block is encrypted.
+ */
+static uint8_t p2p_ccm_absorb(uint8_t *x, uint8_t pos,
+                              uint8_t *data, uint8_t len)
+{
+    while (len--)
+    {
+        x[pos++] ^= *data++;
+        if (pos == TRX_AES_BLOCKSIZE)
+        {
+            trx_aes_ecb_encrypt(x);
+            pos = 0;
+        }
+    }
+    return pos;
+}
+
+/**
+ * @brief Compute the MIC of a frame (header and frame counter are
+ *        authenticated, payload is the message) and encrypt it with S0.
+ */
+static void p2p_ccm_mic(uint8_t *mic, uint8_t *frm, uint8_t *m, uint8_t mlen,
+                        uint32_t fc)
+{
+uint8_t x[TRX_AES_BLOCKSIZE], s[TRX_AES_BLOCKSIZE], pos, alen[2];
+
+    /* B0: Adata, M=4, L=2 */
+    p2p_ccm_block(x, 0x40 | (((P2P_SEC_MICSIZE - 2)/2) << 3) | 1,
+                  (p2p_hdr_t*)frm, fc, mlen);
+    trx_aes_ecb_encrypt(x);
+    alen[0] = 0;
+    alen[1] = sizeof(p2p_hdr_t) + P2P_SEC_FCSIZE;
+    pos = p2p_ccm_absorb(x, 0, alen, 2);
+    pos = p2p_ccm_absorb(x, pos, frm, alen[1]);
+    if (pos)
+    {
+        trx_aes_ecb_encrypt(x);
+    }
+    pos = p2p_ccm_absorb(x, 0, m, mlen);
+    if (pos)
+    {
+        trx_aes_ecb_encrypt(x);
+    }
+    p2p_ccm_block(s, 1, (p2p_hdr_t*)frm, fc, 0);
+    trx_aes_ecb_encrypt(s);
+    for (pos = 0; pos < P2P_SEC_MICSIZE; pos++)
+    {
+        mic[pos] = x[pos] ^ s[pos];
+    }
+}
+
+/**
+ * @brief CCM* CTR mode en-/decryption of the payload.
+ */
+static void p2p_ccm_ctr(uint8_t *frm, uint8_t *m, uint8_t mlen, uint32_t fc)
+{
+uint8_t s[TRX_AES_BLOCKSIZE], i;
+uint16_t cnt = 1;
+
+    while (mlen)
+    {
+        p2p_ccm_block(s, 1, (p2p_hdr_t*)frm, fc, cnt++);
+        trx_aes_ecb_encrypt(s);
+        for (i = 0; (i < TRX_AES_BLOCKSIZE) && mlen; i++, mlen--)
+        {
+            *m++ ^= s[i];
+        }
+    }
+}
+
+/**
+ * @brief Encrypt and authenticate a frame, the frame counter goes to m,
+ *        the mlen bytes payload follow it, the MIC goes behind them.
+ */
+static void p2p_secure_payload(uint8_t *frm, uint8_t *m, uint8_t mlen)
+{
+uint32_t fc;
+
+    ((p2p_hdr_t*)frm)->fcf |= P2P_FCF_SECURITY;
+    fc = p2p_fc++;
+    memcpy(m, &fc, P2P_SEC_FCSIZE);
+    m += P2P_SEC_FCSIZE;
+    p2p_ccm_mic(m + mlen, frm, m, mlen, fc);
+    p2p_ccm_ctr(frm, m, mlen, fc);
+}
+
+uint8_t p2p_secure(uint8_t *frm, uint8_t len)
+{
+uint8_t *m, mlen;
+
+    m = frm + sizeof(p2p_hdr_t);
+    mlen = len - sizeof(p2p_hdr_t);
+    memmove(m + P2P_SEC_FCSIZE, m, mlen);
+    p2p_secure_payload(frm, m, mlen);
+    return len + P2P_SEC_OVERHEAD;
+}
+
+uint8_t p2p_secure_buffer(buffer_t *pbuf)
+{
+uint8_t mlen;
+
+    if ((BUFFER_SIZE(pbuf) < sizeof(p2p_hdr_t)) ||
+        (BUFFER_FREE_AT_START(pbuf) < P2P_SEC_FCSIZE) ||
+        (BUFFER_FREE_AT_END(pbuf) < P2P_SEC_MICSIZE))
+    {
+        return 0;
+    }
+    mlen = BUFFER_SIZE(pbuf) - sizeof(p2p_hdr_t);
+    /* move the header down, not the payload up */
+    memmove(BUFFER_PDATA(pbuf) - P2P_SEC_FCSIZE, BUFFER_PDATA(pbuf),
+            sizeof(p2p_hdr_t));
+    pbuf->istart -= P2P_SEC_FCSIZE;
+    pbuf->iend += P2P_SEC_MICSIZE;
+    p2p_secure_payload(BUFFER_PDATA(pbuf),
+                       BUFFER_PDATA(pbuf) + sizeof(p2p_hdr_t), mlen);
+    return BUFFER_SIZE(pbuf);
+}
+
+uint8_t p2p_unsecure(uint8_t *frm, uint8_t len, uint32_t *fc)
+{
+uint8_t *m, mlen, mic[P2P_SEC_MICSIZE];
+uint32_t rxfc;
+
+    if ((len < sizeof(p2p_hdr_t) + P2P_SEC_OVERHEAD) ||
+        !(((p2p_hdr_t*)frm)->fcf & P2P_FCF_SECURITY))
+    {
+        return 0;
+    }
+    m = frm + sizeof(p2p_hdr_t);
+    mlen = len - sizeof(p2p_hdr_t) - P2P_SEC_OVERHEAD;
+    memcpy(&rxfc, m, P2P_SEC_FCSIZE);
+    m += P2P_SEC_FCSIZE;
+    p2p_ccm_ctr(frm, m, mlen, rxfc);
+    p2p_ccm_mic(mic, frm, m, mlen, rxfc);
+    if (memcmp(mic, m + mlen, P2P_SEC_MICSIZE) != 0)
+    {
+        return 0;
+    }
+    memmove(m - P2P_SEC_FCSIZE, m, mlen);
+    ((p2p_hdr_t*)frm)->fcf &= ~P2P_FCF_SECURITY;
+    if (fc != NULL)
+    {
+        *fc = rxfc;
+    }
+    return len - P2P_SEC_OVERHEAD;
+}
+#endif
 
 #if 0
 /* will come soon */
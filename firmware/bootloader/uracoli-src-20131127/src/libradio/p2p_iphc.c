@@ -0,0 +1,588 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief IPv6/UDP header compression for p2p frames, IPHC of RFC 6282
+ *
+ * The 40 byte IPv6 header and the 8 byte UDP header shrink to 2 ... 7
+ * bytes in the common case, which leaves about 108 of the 115 payload
+ * bytes of a p2p frame for data, instead of 67.
+ *
+ * Addresses are elided against the short addresses of the p2p header:
+ * an interface identifier 0000:00ff:fe00:XXXX with XXXX the short
+ * source (destination) address costs no byte. The prefix is either
+ * the link local fe80::/64 or context 0, set with
+ * p2p_iphc_set_context(), e.g. the /64 of the PAN. Other interface
+ * identifiers of that form cost 2 bytes, others 8, addresses without
+ * a known prefix 16. ff02::XX costs 1 byte. UDP ports 0xF0Bx are
+ * compressed to a nibble each, 0xF0xx to a byte. The UDP length is
+ * always elided, the checksum is always kept.
+ *
+ * The encoder emits a subset of RFC 6282. The decoder takes that
+ * subset and the other inline forms of TF and multicast DAM, but no
+ * context other than 0 and no checksum elision.
+ *
+ * Datagrams that do not fit into one frame are sent as a
+ * @ref P2P_FRAG message with the command code @ref P2P_IPHC_DATA, the
+ * compressed header is in the first fragment then (as FRAG1 of RFC
+ * 4944). Build with -DP2P_IPHC.
+ *
+ * @ingroup grpRadio
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "p2p.h"
+
+#if defined(P2P_IPHC)
+/* === macros ============================================================== */
+#define IPHC_DISPATCH (0x60)    /* 011 of the first byte */
+#define IPHC_TF_SHIFT (3)
+#define IPHC_NH       (0x04)
+#define IPHC_CID      (0x80)    /* second byte */
+#define IPHC_SAC      (0x40)
+#define IPHC_SAM_SHIFT (4)
+#define IPHC_M        (0x08)
+#define IPHC_DAC      (0x04)
+
+#define NHC_UDP       (0xF0)    /* 11110CPP */
+#define NHC_UDP_MASK  (0xF8)
+#define NHC_UDP_C     (0x04)
+
+#define IP_NH_UDP     (17)
+
+/* offsets of the IPv6 header */
+#define IP_PLEN       (4)
+#define IP_NEXT       (6)
+#define IP_HLIM       (7)
+#define IP_SRC        (8)
+#define IP_DST        (24)
+
+/* === globals ============================================================= */
+static const uint8_t PROGMEM iphc_linklocal[8] =
+{
+    0xfe, 0x80, 0, 0, 0, 0, 0, 0
+};
+/** the IID of a short address, 0000:00ff:fe00:XXXX */
+static const uint8_t PROGMEM iphc_iid16[6] =
+{
+    0, 0, 0, 0xff, 0xfe, 0
+};
+/** prefix of context 0 */
+static uint8_t iphc_ctx[8];
+static bool iphc_ctx_valid;
+
+/* === functions =========================================================== */
+static bool iphc_zero(const uint8_t *p, uint8_t n)
+{
+    while (n--)
+    {
+        if (*p++ != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void p2p_iphc_set_context(const uint8_t *prefix)
+{
+    iphc_ctx_valid = (prefix != NULL);
+    if (iphc_ctx_valid)
+    {
+        memcpy(iphc_ctx, prefix, sizeof(iphc_ctx));
+    }
+}
+
+/**
+ * Address mode of a unicast address (SAM or DAM), 0 ... 3 and out the
+ * inline part. sac is set for a context prefix (and ::).
+ */
+static uint8_t iphc_addr(const uint8_t *addr, uint16_t l2addr,
+                         bool *sac, uint8_t *out, uint8_t *olen)
+{
+    *sac = false;
+    if (iphc_zero(addr, 16))
+    {
+        /* the unspecified address, stateful SAM 00 */
+        *sac = true;
+        *olen = 0;
+        return 0;
+    }
+    if (iphc_ctx_valid && (memcmp(addr, iphc_ctx, 8) == 0))
+    {
+        *sac = true;
+    }
+    else if (memcmp_P(addr, iphc_linklocal, 8) != 0)
+    {
+        memcpy(out, addr, 16);
+        *olen = 16;
+        return 0;
+    }
+    if (memcmp_P(addr + 8, iphc_iid16, 6) == 0)
+    {
+        if ((l2addr != 0xffff) &&
+            (addr[14] == (l2addr >> 8)) && (addr[15] == (l2addr & 0xff)))
+        {
+            *olen = 0;
+            return 3;
+        }
+        memcpy(out, addr + 14, 2);
+        *olen = 2;
+        return 2;
+    }
+    memcpy(out, addr + 8, 8);
+    *olen = 8;
+    return 1;
+}
+
+/**
+ * Inverse of iphc_addr(), returns the number of inline bytes taken,
+ * -1 for a mode that is not supported.
+ */
+static int8_t iphc_addr_expand(uint8_t mode, bool sac, const uint8_t *in,
+                               uint16_t l2addr, uint8_t *addr)
+{
+    if (mode == 0)
+    {
+        if (sac)
+        {
+            memset(addr, 0, 16);
+            return 0;
+        }
+        memcpy(addr, in, 16);
+        return 16;
+    }
+    if (sac)
+    {
+        if (!iphc_ctx_valid)
+        {
+            return -1;
+        }
+        memcpy(addr, iphc_ctx, 8);
+    }
+    else
+    {
+        memcpy_P(addr, iphc_linklocal, 8);
+    }
+    if (mode == 1)
+    {
+        memcpy(addr + 8, in, 8);
+        return 8;
+    }
+    memcpy_P(addr + 8, iphc_iid16, 6);
+    if (mode == 2)
+    {
+        memcpy(addr + 14, in, 2);
+        return 2;
+    }
+    addr[14] = l2addr >> 8;
+    addr[15] = l2addr & 0xff;
+    return 0;
+}
+
+int16_t p2p_iphc_compress(uint8_t *ip, uint16_t iplen,
+                          uint16_t l2src, uint16_t l2dst)
+{
+uint8_t hdr[P2P_IPHC_MAX_HDR];
+uint8_t *p = hdr + 2;
+uint8_t tc, mode, n, hlen;
+uint16_t sport, dport;
+bool sac, udp;
+
+    if ((iplen < P2P_IPHC_IPV6_HDR) || ((ip[0] & 0xf0) != 0x60) ||
+        ((((uint16_t)ip[IP_PLEN] << 8) | ip[IP_PLEN + 1]) !=
+         iplen - P2P_IPHC_IPV6_HDR))
+    {
+        return -1;
+    }
+    /* the UDP length is elided, so it has to match the IPv6 one */
+    udp = (ip[IP_NEXT] == IP_NH_UDP) &&
+          (iplen >= P2P_IPHC_IPV6_HDR + P2P_IPHC_UDP_HDR) &&
+          (ip[44] == ip[IP_PLEN]) && (ip[45] == ip[IP_PLEN + 1]);
+    hdr[0] = IPHC_DISPATCH;
+    hdr[1] = 0;
+
+    /* traffic class and flow label */
+    tc = (ip[0] << 4) | (ip[1] >> 4);
+    if ((tc == 0) && ((ip[1] & 0x0f) == 0) && (ip[2] == 0) && (ip[3] == 0))
+    {
+        hdr[0] |= 3 << IPHC_TF_SHIFT;
+    }
+    else
+    {
+        /* TF 00, ECN and DSCP swap places */
+        *p++ = (tc << 6) | (tc >> 2);
+        *p++ = ip[1] & 0x0f;
+        *p++ = ip[2];
+        *p++ = ip[3];
+    }
+
+    if (udp)
+    {
+        hdr[0] |= IPHC_NH;
+    }
+    else
+    {
+        *p++ = ip[IP_NEXT];
+    }
+
+    switch (ip[IP_HLIM])
+    {
+        case 1:   hdr[0] |= 1; break;
+        case 64:  hdr[0] |= 2; break;
+        case 255: hdr[0] |= 3; break;
+        default:  *p++ = ip[IP_HLIM]; break;
+    }
+
+    mode = iphc_addr(ip + IP_SRC, l2src, &sac, p, &n);
+    hdr[1] |= (sac ? IPHC_SAC : 0) | (mode << IPHC_SAM_SHIFT);
+    p += n;
+
+    if (ip[IP_DST] == 0xff)
+    {
+        hdr[1] |= IPHC_M;
+        if ((ip[IP_DST + 1] == 0x02) && iphc_zero(ip + IP_DST + 2, 13))
+        {
+            /* ff02::00XX */
+            hdr[1] |= 3;
+            *p++ = ip[IP_DST + 15];
+        }
+        else if (iphc_zero(ip + IP_DST + 2, 11))
+        {
+            /* ffXX::00XX:XXXX */
+            hdr[1] |= 2;
+            *p++ = ip[IP_DST + 1];
+            memcpy(p, ip + IP_DST + 13, 3);
+            p += 3;
+        }
+        else if (iphc_zero(ip + IP_DST + 2, 9))
+        {
+            /* ffXX::00XX:XXXX:XXXX */
+            hdr[1] |= 1;
+            *p++ = ip[IP_DST + 1];
+            memcpy(p, ip + IP_DST + 11, 5);
+            p += 5;
+        }
+        else
+        {
+            memcpy(p, ip + IP_DST, 16);
+            p += 16;
+        }
+    }
+    else
+    {
+        mode = iphc_addr(ip + IP_DST, l2dst, &sac, p, &n);
+        if (sac && (mode == 0))
+        {
+            /* DAC 1 with DAM 00 is reserved, :: goes inline */
+            memset(p, 0, 16);
+            sac = false;
+            n = 16;
+        }
+        hdr[1] |= (sac ? IPHC_DAC : 0) | mode;
+        p += n;
+    }
+
+    if (udp)
+    {
+        sport = ((uint16_t)ip[40] << 8) | ip[41];
+        dport = ((uint16_t)ip[42] << 8) | ip[43];
+        if (((sport & 0xfff0) == 0xf0b0) && ((dport & 0xfff0) == 0xf0b0))
+        {
+            *p++ = NHC_UDP | 3;
+            *p++ = (sport << 4) | (dport & 0x0f);
+        }
+        else if ((dport & 0xff00) == 0xf000)
+        {
+            *p++ = NHC_UDP | 1;
+            *p++ = sport >> 8;
+            *p++ = sport;
+            *p++ = dport;
+        }
+        else if ((sport & 0xff00) == 0xf000)
+        {
+            *p++ = NHC_UDP | 2;
+            *p++ = sport;
+            *p++ = dport >> 8;
+            *p++ = dport;
+        }
+        else
+        {
+            *p++ = NHC_UDP;
+            memcpy(p, ip + 40, 4);
+            p += 4;
+        }
+        /* the checksum stays */
+        *p++ = ip[46];
+        *p++ = ip[47];
+    }
+
+    /* the compressed header is never longer than the one it replaces */
+    hlen = p - hdr;
+    n = udp ? P2P_IPHC_IPV6_HDR + P2P_IPHC_UDP_HDR : P2P_IPHC_IPV6_HDR;
+    memcpy(ip, hdr, hlen);
+    memmove(ip + hlen, ip + n, iplen - n);
+    return iplen - n + hlen;
+}
+
+/** inline bytes of SAM/DAM, the stateful SAM 00 (::) has none */
+static const uint8_t PROGMEM iphc_addr_len[4] = {16, 8, 2, 0};
+
+int16_t p2p_iphc_decompress(const uint8_t *in, uint16_t inlen,
+                            uint16_t l2src, uint16_t l2dst,
+                            uint8_t *ip, uint16_t ipsz)
+{
+const uint8_t *p = in + 2, *end = in + inlen;
+uint8_t tf, tc = 0, mode, hlen, nhc;
+int8_t n;
+uint32_t fl = 0;
+uint16_t plen, sport = 0, dport = 0;
+bool sac;
+
+    if ((inlen < 2) || ((in[0] & 0xe0) != IPHC_DISPATCH) ||
+        (in[1] & IPHC_CID))
+    {
+        return -1;
+    }
+    if (ipsz < P2P_IPHC_IPV6_HDR +
+               ((in[0] & IPHC_NH) ? P2P_IPHC_UDP_HDR : 0))
+    {
+        return -1;
+    }
+    memset(ip, 0, P2P_IPHC_IPV6_HDR);
+
+    /* traffic class and flow label, inline as ECN|DSCP */
+    tf = (in[0] >> IPHC_TF_SHIFT) & 3;
+    if (end - p < ((tf == 0) ? 4 : ((tf == 1) ? 3 : ((tf == 2) ? 1 : 0))))
+    {
+        return -1;
+    }
+    switch (tf)
+    {
+        case 0:
+            tc = (p[0] >> 6) | (p[0] << 2);
+            fl = ((uint32_t)(p[1] & 0x0f) << 16) | ((uint16_t)p[2] << 8) | p[3];
+            p += 4;
+            break;
+        case 1:
+            tc = p[0] >> 6;
+            fl = ((uint32_t)(p[0] & 0x0f) << 16) | ((uint16_t)p[1] << 8) | p[2];
+            p += 3;
+            break;
+        case 2:
+            tc = (p[0] >> 6) | (p[0] << 2);
+            p += 1;
+            break;
+    }
+    ip[0] = 0x60 | (tc >> 4);
+    ip[1] = (tc << 4) | ((fl >> 16) & 0x0f);
+    ip[2] = fl >> 8;
+    ip[3] = fl;
+
+    if (!(in[0] & IPHC_NH))
+    {
+        if (end - p < 1)
+        {
+            return -1;
+        }
+        ip[IP_NEXT] = *p++;
+    }
+
+    switch (in[0] & 3)
+    {
+        case 0:
+            if (end - p < 1)
+            {
+                return -1;
+            }
+            ip[IP_HLIM] = *p++;
+            break;
+        case 1: ip[IP_HLIM] = 1; break;
+        case 2: ip[IP_HLIM] = 64; break;
+        case 3: ip[IP_HLIM] = 255; break;
+    }
+
+    mode = (in[1] >> IPHC_SAM_SHIFT) & 3;
+    sac = (in[1] & IPHC_SAC) != 0;
+    if (end - p < ((sac && (mode == 0)) ? 0 : pgm_read_byte(&iphc_addr_len[mode])))
+    {
+        return -1;
+    }
+    n = iphc_addr_expand(mode, sac, p, l2src, ip + IP_SRC);
+    if (n < 0)
+    {
+        return -1;
+    }
+    p += n;
+
+    mode = in[1] & 3;
+    sac = (in[1] & IPHC_DAC) != 0;
+    if (in[1] & IPHC_M)
+    {
+        static const uint8_t PROGMEM mlen[4] = {16, 6, 4, 1};
+
+        if (sac || (end - p < pgm_read_byte(&mlen[mode])))
+        {
+            return -1;
+        }
+        ip[IP_DST] = 0xff;
+        switch (mode)
+        {
+            case 0: memcpy(ip + IP_DST, p, 16); break;
+            case 1: ip[IP_DST + 1] = p[0]; memcpy(ip + IP_DST + 11, p + 1, 5); break;
+            case 2: ip[IP_DST + 1] = p[0]; memcpy(ip + IP_DST + 13, p + 1, 3); break;
+            case 3: ip[IP_DST + 1] = 0x02; ip[IP_DST + 15] = p[0]; break;
+        }
+        p += pgm_read_byte(&mlen[mode]);
+    }
+    else
+    {
+        if ((sac && (mode == 0)) ||
+            (end - p < pgm_read_byte(&iphc_addr_len[mode])))
+        {
+            return -1;
+        }
+        n = iphc_addr_expand(mode, sac, p, l2dst, ip + IP_DST);
+        if (n < 0)
+        {
+            return -1;
+        }
+        p += n;
+    }
+
+    hlen = P2P_IPHC_IPV6_HDR;
+    if (in[0] & IPHC_NH)
+    {
+        if ((end - p < 1) || ((*p & NHC_UDP_MASK) != NHC_UDP) ||
+            (*p & NHC_UDP_C))
+        {
+            /* only UDP, with its checksum */
+            return -1;
+        }
+        nhc = *p++ & 3;
+        if (end - p < ((nhc == 0) ? 6 : ((nhc == 3) ? 3 : 5)))
+        {
+            return -1;
+        }
+        switch (nhc)
+        {
+            case 0:
+                sport = ((uint16_t)p[0] << 8) | p[1];
+                dport = ((uint16_t)p[2] << 8) | p[3];
+                p += 4;
+                break;
+            case 1:
+                sport = ((uint16_t)p[0] << 8) | p[1];
+                dport = 0xf000 | p[2];
+                p += 3;
+                break;
+            case 2:
+                sport = 0xf000 | p[0];
+                dport = ((uint16_t)p[1] << 8) | p[2];
+                p += 3;
+                break;
+            case 3:
+                sport = 0xf0b0 | (p[0] >> 4);
+                dport = 0xf0b0 | (p[0] & 0x0f);
+                p += 1;
+                break;
+        }
+        ip[IP_NEXT] = IP_NH_UDP;
+        ip[40] = sport >> 8;
+        ip[41] = sport;
+        ip[42] = dport >> 8;
+        ip[43] = dport;
+        ip[46] = p[0];
+        ip[47] = p[1];
+        p += 2;
+        hlen += P2P_IPHC_UDP_HDR;
+    }
+
+    plen = (end - p) + hlen - P2P_IPHC_IPV6_HDR;
+    if ((uint32_t)P2P_IPHC_IPV6_HDR + plen > ipsz)
+    {
+        return -1;
+    }
+    ip[IP_PLEN] = plen >> 8;
+    ip[IP_PLEN + 1] = plen;
+    if (in[0] & IPHC_NH)
+    {
+        ip[44] = plen >> 8;
+        ip[45] = plen;
+    }
+    memcpy(ip + hlen, p, end - p);
+    return P2P_IPHC_IPV6_HDR + plen;
+}
+
+uint8_t p2p_iphc_send(uint16_t dst, uint8_t flags, uint8_t *ip,
+                      uint16_t iplen, uint8_t retries)
+{
+uint8_t frm[MAX_FRAME_SIZE];
+int16_t len;
+
+    len = p2p_iphc_compress(ip, iplen, p2p_get_config()->short_addr, dst);
+    if (len < 0)
+    {
+        return 0;
+    }
+    if (len <= (int16_t)(MAX_FRAME_SIZE - 2 - sizeof(p2p_hdr_t)))
+    {
+        memcpy(frm + sizeof(p2p_hdr_t), ip, len);
+        p2p_send(dst, P2P_IPHC_DATA, flags, frm, sizeof(p2p_hdr_t) + len);
+        return 1;
+    }
+#if defined(RADIO_TXQUEUE)
+    return p2p_send_msg(dst, P2P_IPHC_DATA, flags, ip, len, retries);
+#else
+    (void) retries;
+    return 0;
+#endif
+}
+
+int16_t p2p_iphc_receive(const uint8_t *frm, uint8_t len,
+                         uint8_t *ip, uint16_t ipsz)
+{
+const p2p_hdr_t *hdr = (const p2p_hdr_t *) frm;
+
+    if ((len < sizeof(p2p_hdr_t)) || (hdr->cmd != P2P_IPHC_DATA))
+    {
+        return -1;
+    }
+    return p2p_iphc_decompress(frm + sizeof(p2p_hdr_t),
+                               len - sizeof(p2p_hdr_t),
+                               hdr->src, hdr->dst, ip, ipsz);
+}
+#endif /* #if defined(P2P_IPHC) */
+
+/* EOF */
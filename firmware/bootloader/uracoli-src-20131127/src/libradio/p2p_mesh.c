@@ -0,0 +1,398 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Multi-hop forwarding of p2p frames
+ *
+ * Routes are found on demand: the originator floods a
+ * @ref P2P_MESH_RREQ, every node remembers the neighbour it first heard
+ * it from as the way back and passes it on, the target answers with a
+ * @ref P2P_MESH_RREP along that way. Nodes learn the forward route from
+ * the reply. Frames for nodes further away than one hop go as
+ * @ref P2P_MESH_DATA from hop to hop, each hop with its own ACK and
+ * retries, so a stream is pipelined along the route.
+ *
+ * A route that is not used for P2P_MESH_ROUTE_AGE ticks is dropped.
+ * Build with -DP2P_MESH.
+ *
+ * @ingroup grpRadio
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "p2p.h"
+
+#if defined(P2P_MESH)
+/* === macros ============================================================== */
+#ifndef P2P_MESH_ROUTES
+# define P2P_MESH_ROUTES (8)
+#endif
+#ifndef P2P_MESH_ROUTE_AGE
+# define P2P_MESH_ROUTE_AGE (120)
+#endif
+/** remembered route requests of other nodes */
+#define P2P_MESH_SEEN (4)
+
+#define P2P_FCF_ACK   (0x8861)
+#define P2P_FCF_NOACK (0x8841)
+
+/* === types =============================================================== */
+typedef struct
+{
+    uint16_t dst;   /**< P2P_MESH_NOROUTE for a free entry */
+    uint16_t next;
+    uint8_t hops;
+    uint8_t age;
+} p2p_mesh_entry_t;
+
+/* === globals ============================================================= */
+static p2p_mesh_entry_t routes[P2P_MESH_ROUTES];
+static struct
+{
+    uint16_t orig;
+    uint8_t rseq;
+} seen[P2P_MESH_SEEN];
+static uint8_t seen_idx;
+static uint16_t mesh_pan;
+static uint16_t mesh_addr;
+static uint8_t mesh_rseq;
+static uint8_t mesh_seq;
+static uint8_t mesh_frm[MAX_FRAME_SIZE];
+
+/* === functions =========================================================== */
+
+static p2p_mesh_entry_t * p2p_mesh_find(uint16_t dst)
+{
+uint8_t i;
+
+    for (i = 0; i < P2P_MESH_ROUTES; i++)
+    {
+        if (routes[i].dst == dst)
+        {
+            return &routes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Take a route if it is new or not longer than the known one.
+ */
+static void p2p_mesh_learn(uint16_t dst, uint16_t next, uint8_t hops)
+{
+p2p_mesh_entry_t *r;
+uint8_t i;
+
+    if ((dst == mesh_addr) || (dst == P2P_MESH_NOROUTE))
+    {
+        return;
+    }
+    r = p2p_mesh_find(dst);
+    if (r == NULL)
+    {
+        /* free entry or the oldest one */
+        r = &routes[0];
+        for (i = 1; i < P2P_MESH_ROUTES; i++)
+        {
+            if ((r->dst != P2P_MESH_NOROUTE) &&
+                ((routes[i].dst == P2P_MESH_NOROUTE) ||
+                 (routes[i].age > r->age)))
+            {
+                r = &routes[i];
+            }
+        }
+    }
+    else if ((hops > r->hops) && (r->age < P2P_MESH_ROUTE_AGE / 2))
+    {
+        /* keep the shorter route while it is fresh */
+        return;
+    }
+    r->dst = dst;
+    r->next = next;
+    r->hops = hops;
+    r->age = 0;
+}
+
+static void p2p_mesh_tx(uint16_t dst, uint8_t cmd, uint8_t *frm, uint8_t len)
+{
+p2p_hdr_t *hdr = (p2p_hdr_t*) frm;
+
+    hdr->seq = mesh_seq;
+    __FILL_P2P_HEADER__(hdr, (dst == 0xFFFF) ? P2P_FCF_NOACK : P2P_FCF_ACK,
+                        mesh_pan, dst, mesh_addr, cmd);
+    mesh_seq = hdr->seq;
+    radio_set_state(STATE_TX);
+    radio_set_state(STATE_TXAUTO);
+    radio_send_frame(len + 2, frm, 1); /* +2: add CRC bytes (FCF) */
+}
+
+/**
+ * @return 1 if the request was handled before, else it is remembered
+ */
+static uint8_t p2p_mesh_seen(uint16_t orig, uint8_t rseq)
+{
+uint8_t i;
+
+    for (i = 0; i < P2P_MESH_SEEN; i++)
+    {
+        if ((seen[i].orig == orig) && (seen[i].rseq == rseq))
+        {
+            return 1;
+        }
+    }
+    seen[seen_idx].orig = orig;
+    seen[seen_idx].rseq = rseq;
+    seen_idx = (seen_idx + 1) % P2P_MESH_SEEN;
+    return 0;
+}
+
+void p2p_mesh_init(uint16_t pan_id, uint16_t short_addr)
+{
+    mesh_pan = pan_id;
+    mesh_addr = short_addr;
+    memset(routes, 0xFF, sizeof(routes));
+    memset(seen, 0xFF, sizeof(seen));
+    seen_idx = 0;
+}
+
+uint16_t p2p_mesh_nexthop(uint16_t dst, uint8_t *hops)
+{
+p2p_mesh_entry_t *r = p2p_mesh_find(dst);
+
+    if (r == NULL)
+    {
+        return P2P_MESH_NOROUTE;
+    }
+    if (hops != NULL)
+    {
+        *hops = r->hops;
+    }
+    return r->next;
+}
+
+void p2p_mesh_tick(void)
+{
+uint8_t i;
+
+    for (i = 0; i < P2P_MESH_ROUTES; i++)
+    {
+        if ((routes[i].dst != P2P_MESH_NOROUTE) &&
+            (++routes[i].age > P2P_MESH_ROUTE_AGE))
+        {
+            routes[i].dst = P2P_MESH_NOROUTE;
+        }
+    }
+}
+
+void p2p_mesh_discover(uint16_t dst)
+{
+p2p_mesh_route_t *rr = (p2p_mesh_route_t*) mesh_frm;
+
+    rr->orig = mesh_addr;
+    rr->target = dst;
+    rr->rseq = ++mesh_rseq;
+    rr->hops = 0;
+    p2p_mesh_seen(mesh_addr, rr->rseq);
+    p2p_mesh_tx(0xFFFF, P2P_MESH_RREQ, mesh_frm, sizeof(p2p_mesh_route_t));
+}
+
+uint8_t p2p_mesh_send(uint16_t dst, uint8_t cmd, uint8_t *data,
+                      uint8_t lendata)
+{
+p2p_mesh_entry_t *r;
+p2p_mesh_data_t *md = (p2p_mesh_data_t*) data;
+
+    if (dst == 0xFFFF)
+    {
+        p2p_mesh_tx(dst, cmd, data, lendata);
+        return 1;
+    }
+    r = p2p_mesh_find(dst);
+    if (r == NULL)
+    {
+        p2p_mesh_discover(dst);
+        return 0;
+    }
+    r->age = 0;
+    if (r->hops <= 1)
+    {
+        p2p_mesh_tx(dst, cmd, data, lendata);
+        return 1;
+    }
+    if ((lendata + P2P_MESH_OVERHEAD) > (MAX_FRAME_SIZE - 2))
+    {
+        return 0;
+    }
+    memmove(md->data, data + sizeof(p2p_hdr_t), lendata - sizeof(p2p_hdr_t));
+    md->orig = mesh_addr;
+    md->final = dst;
+    md->ttl = P2P_MESH_MAXHOPS;
+    md->cmd = cmd;
+    p2p_mesh_tx(r->next, P2P_MESH_DATA, data, lendata + P2P_MESH_OVERHEAD);
+    return 1;
+}
+
+uint8_t p2p_mesh_send_buffer(uint16_t dst, uint8_t cmd, buffer_t *pbuf)
+{
+p2p_mesh_entry_t *r = NULL;
+p2p_mesh_data_t *md;
+
+    if (dst != 0xFFFF)
+    {
+        r = p2p_mesh_find(dst);
+        if (r == NULL)
+        {
+            p2p_mesh_discover(dst);
+            return 0;
+        }
+        r->age = 0;
+    }
+    if ((r == NULL) || (r->hops <= 1))
+    {
+        if (BUFFER_FREE_AT_START(pbuf) < sizeof(p2p_hdr_t))
+        {
+            return 0;
+        }
+        pbuf->istart -= sizeof(p2p_hdr_t);
+        p2p_mesh_tx(dst, cmd, BUFFER_PDATA(pbuf), BUFFER_SIZE(pbuf));
+        return 1;
+    }
+    if ((BUFFER_FREE_AT_START(pbuf) < sizeof(p2p_mesh_data_t)) ||
+        ((BUFFER_SIZE(pbuf) + sizeof(p2p_mesh_data_t)) > (MAX_FRAME_SIZE - 2)))
+    {
+        return 0;
+    }
+    pbuf->istart -= sizeof(p2p_mesh_data_t);
+    md = (p2p_mesh_data_t*) BUFFER_PDATA(pbuf);
+    md->orig = mesh_addr;
+    md->final = dst;
+    md->ttl = P2P_MESH_MAXHOPS;
+    md->cmd = cmd;
+    p2p_mesh_tx(r->next, P2P_MESH_DATA, BUFFER_PDATA(pbuf), BUFFER_SIZE(pbuf));
+    return 1;
+}
+
+uint8_t p2p_mesh_receive(uint8_t *frm, uint8_t len)
+{
+p2p_hdr_t *hdr = (p2p_hdr_t*) frm;
+p2p_mesh_route_t *rr = (p2p_mesh_route_t*) frm;
+p2p_mesh_data_t *md = (p2p_mesh_data_t*) frm;
+uint16_t next;
+
+    if (len < sizeof(p2p_hdr_t))
+    {
+        return len;
+    }
+    /* whoever we hear is a neighbour */
+    p2p_mesh_learn(hdr->src, hdr->src, 1);
+
+    switch (hdr->cmd)
+    {
+    case P2P_MESH_RREQ:
+        if ((len < sizeof(p2p_mesh_route_t)) || (rr->orig == mesh_addr) ||
+            p2p_mesh_seen(rr->orig, rr->rseq))
+        {
+            return 0;
+        }
+        rr->hops++;
+        p2p_mesh_learn(rr->orig, hdr->src, rr->hops);
+        if (rr->target == mesh_addr)
+        {
+            next = hdr->src;
+            rr->hops = 0;
+            memcpy(mesh_frm, frm, sizeof(p2p_mesh_route_t));
+            p2p_mesh_tx(next, P2P_MESH_RREP, mesh_frm,
+                        sizeof(p2p_mesh_route_t));
+        }
+        else if (rr->hops < P2P_MESH_MAXHOPS)
+        {
+            memcpy(mesh_frm, frm, sizeof(p2p_mesh_route_t));
+            p2p_mesh_tx(0xFFFF, P2P_MESH_RREQ, mesh_frm,
+                        sizeof(p2p_mesh_route_t));
+        }
+        return 0;
+
+    case P2P_MESH_RREP:
+        if (len < sizeof(p2p_mesh_route_t))
+        {
+            return 0;
+        }
+        rr->hops++;
+        p2p_mesh_learn(rr->target, hdr->src, rr->hops);
+        if (rr->orig != mesh_addr)
+        {
+            next = p2p_mesh_nexthop(rr->orig, NULL);
+            if (next != P2P_MESH_NOROUTE)
+            {
+                memcpy(mesh_frm, frm, sizeof(p2p_mesh_route_t));
+                p2p_mesh_tx(next, P2P_MESH_RREP, mesh_frm,
+                            sizeof(p2p_mesh_route_t));
+            }
+        }
+        return 0;
+
+    case P2P_MESH_DATA:
+        if ((len < sizeof(p2p_mesh_data_t)) || (hdr->dst != mesh_addr))
+        {
+            return 0;
+        }
+        /* the way back, unless a better one is known */
+        p2p_mesh_learn(md->orig, hdr->src, P2P_MESH_MAXHOPS - md->ttl + 1);
+        if (md->final == mesh_addr)
+        {
+            hdr->src = md->orig;
+            hdr->dst = md->final;
+            hdr->cmd = md->cmd;
+            len -= P2P_MESH_OVERHEAD;
+            memmove(frm + sizeof(p2p_hdr_t), md->data,
+                    len - sizeof(p2p_hdr_t));
+            return len;
+        }
+        next = p2p_mesh_nexthop(md->final, NULL);
+        if ((md->ttl > 1) && (next != P2P_MESH_NOROUTE) &&
+            (next != hdr->src))
+        {
+            md->ttl--;
+            memcpy(mesh_frm, frm, len);
+            p2p_mesh_tx(next, P2P_MESH_DATA, mesh_frm, len);
+            p2p_mesh_find(md->final)->age = 0;
+        }
+        return 0;
+
+    default:
+        return len;
+    }
+}
+#endif /* defined(P2P_MESH) */
+
+/* EOF */
@@ -0,0 +1,154 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Fast channel switch, see radio_set_channel_fast().
+ *
+ * After the channel write the PLL re-locks in the current state, the
+ * time to the PLL_LOCK flag is counted in steps of 1 us and goes into
+ * the statistics.
+ *
+ * @ingroup grpRadio
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include <util/atomic.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+
+/* === macros ============================================================== */
+#if RADIO_CHSW_TIMEOUT_US > 255
+# error "RADIO_CHSW_TIMEOUT_US is counted in 8 bit"
+#endif
+
+/* === globals ============================================================= */
+static radio_chsw_stats_t chsw = { .min_us = 0xff };
+#if !defined(TRX_IF_RFA1)
+/** PLL_LOCK IRQs seen by the transceiver ISR */
+static volatile uint8_t chsw_locks;
+#endif
+
+/* === functions =========================================================== */
+
+void radio_chsw_irq(void)
+{
+#if !defined(TRX_IF_RFA1)
+    chsw_locks++;
+#endif
+}
+
+uint8_t radio_set_channel_fast(channel_t ch)
+{
+uint8_t us, status;
+#if !defined(TRX_IF_RFA1)
+uint8_t mask, locks;
+#endif
+
+    if ((ch < TRX_MIN_CHANNEL) || (ch > TRX_MAX_CHANNEL))
+    {
+        return 0;
+    }
+    status = trx_bit_read(SR_TRX_STATUS);
+    if (status == TRX_OFF)
+    {
+        trx_bit_write(SR_CHANNEL, ch);
+        return 1;
+    }
+
+#if defined(TRX_IF_RFA1)
+    /* the flag is set even with the IRQ masked, writing 1 clears it */
+    trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_PLL_LOCK);
+    trx_bit_write(SR_CHANNEL, ch);
+    for (us = 0; us < RADIO_CHSW_TIMEOUT_US; us++)
+    {
+        if (trx_reg_read(RG_IRQ_STATUS) & TRX_IRQ_PLL_LOCK)
+        {
+            break;
+        }
+        DELAY_US(1);
+    }
+    trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_PLL_LOCK);
+#else
+    mask = trx_reg_read(RG_IRQ_MASK);
+    trx_reg_write(RG_IRQ_MASK, mask | TRX_IRQ_PLL_LOCK);
+    locks = chsw_locks;
+    trx_bit_write(SR_CHANNEL, ch);
+    for (us = 0; us < RADIO_CHSW_TIMEOUT_US; us++)
+    {
+        if (chsw_locks != locks)
+        {
+            break;
+        }
+        DELAY_US(1);
+        BUSY_WAIT();
+    }
+    trx_reg_write(RG_IRQ_MASK, mask);
+#endif
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (us >= RADIO_CHSW_TIMEOUT_US)
+        {
+            chsw.fails++;
+        }
+        else
+        {
+            chsw.switches++;
+            chsw.last_us = us;
+            chsw.sum_us += us;
+            if (us < chsw.min_us)
+            {
+                chsw.min_us = us;
+            }
+            if (us > chsw.max_us)
+            {
+                chsw.max_us = us;
+            }
+        }
+    }
+    return (us < RADIO_CHSW_TIMEOUT_US) ? 1 : 0;
+}
+
+void radio_chsw_stats(radio_chsw_stats_t *st, bool clear)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *st = chsw;
+        if (clear)
+        {
+            memset(&chsw, 0, sizeof(chsw));
+            chsw.min_us = 0xff;
+        }
+    }
+}
+/* EOF */
@@ -0,0 +1,272 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief CSMA statistics and CSMA-CA without busy waiting.
+ *
+ * The statistics count the CCA results of radio_do_cca() and of
+ * radio_csma_send() with the ED level measured along, and the outcome of
+ * the frames sent in TX_ARET. On the RFR2 the CSMA and frame retries of
+ * each TX_ARET frame are read back from XAH_CTRL_2, which the hardware
+ * CSMA otherwise keeps to itself.
+ *
+ * radio_csma_send() (RFA1/RFR2 only) does unslotted CSMA-CA as in
+ * IEEE 802.15.4 with the MIN_BE, MAX_BE and MAX_CSMA_RETRES of the
+ * transceiver, but in interrupt context: the backoff runs on compare
+ * unit 1 of the MAC symbol counter and the CCA result comes with the
+ * CCA_ED_DONE interrupt. The CPU is free in between, the frame goes out
+ * in STATE_TX. The timer module with its ticks of 4ms is too coarse
+ * for backoff periods of 320us, so it is not used here.
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+
+#if defined(RADIO_CSMA)
+/* === macros ============================================================== */
+/** aUnitBackoffPeriod in symbols */
+#define CSMA_UNIT_SYMBOLS (20)
+/** MAX_CSMA_RETRES value which disables CSMA-CA */
+#define CSMA_NONE         (7)
+
+/* === globals ============================================================= */
+static radio_csma_stats_t csma_stats;
+
+#if defined(TRX_IF_RFA1)
+static struct
+{
+    uint8_t *frm;
+    uint8_t len;
+    uint8_t nb;     /**< backoffs done, NB */
+    uint8_t be;     /**< backoff exponent, BE */
+    uint8_t maxbe;
+    uint8_t maxnb;  /**< macMaxCSMABackoffs */
+    volatile bool busy;
+} csma;
+#endif
+
+/* === functions =========================================================== */
+
+void radio_csma_cca_done(radio_cca_t cca, uint8_t ed)
+{
+    switch (cca)
+    {
+        case RADIO_CCA_FREE:
+            csma_stats.cca_free++;
+            break;
+        case RADIO_CCA_BUSY:
+            csma_stats.cca_busy++;
+            break;
+        default:
+            csma_stats.cca_fail++;
+            return;
+    }
+    csma_stats.ed_count++;
+    csma_stats.ed_sum += ed;
+    if (ed > csma_stats.ed_max)
+    {
+        csma_stats.ed_max = ed;
+    }
+}
+
+void radio_csma_aret_done(uint8_t trac)
+{
+    csma_stats.aret_frames++;
+    if (TRAC_CHANNEL_ACCESS_FAILURE == trac)
+    {
+        csma_stats.aret_cca_fail++;
+    }
+    else if (TRAC_NO_ACK == trac)
+    {
+        csma_stats.aret_no_ack++;
+    }
+#if defined(SR_ARET_CSMA_RETRIES)
+    csma_stats.aret_csma_retries += trx_bit_read(SR_ARET_CSMA_RETRIES);
+    csma_stats.aret_frame_retries += trx_bit_read(SR_ARET_FRAME_RETRIES);
+#endif
+}
+
+void radio_csma_stats(radio_csma_stats_t *st, bool clear)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memcpy(st, &csma_stats, sizeof(csma_stats));
+        if (clear)
+        {
+            memset(&csma_stats, 0, sizeof(csma_stats));
+        }
+    }
+}
+
+#if defined(TRX_IF_RFA1)
+/** 8 random bits, RND_VALUE gives 2 new bits per microsecond in RX_ON */
+static uint8_t csma_random(void)
+{
+uint8_t i, r = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        r = (r << 2) | trx_bit_read(SR_RND_VALUE);
+        DELAY_US(1);
+    }
+    return r;
+}
+
+static void csma_cca_start(void)
+{
+    trx_reg_write(RG_IRQ_STATUS, TRX_IRQ_CCA_ED);
+    trx_bit_write(SR_MASK_CCA_ED_READY, 1);
+    trx_bit_write(SR_CCA_REQUEST, 1);
+}
+
+/** wait random(2^BE - 1) unit backoff periods, then CCA */
+static void csma_backoff(void)
+{
+uint8_t units;
+uint32_t t;
+
+    units = csma_random() & ((1U << csma.be) - 1);
+    csma_stats.csma_backoffs += units;
+    if (0 == units)
+    {
+        csma_cca_start();
+        return;
+    }
+    t = trx_tstamp_now() + (uint32_t)units * CSMA_UNIT_SYMBOLS;
+    /* the compare value is taken over with the write of the low byte */
+    SCOCR1HH = (uint8_t)(t >> 24);
+    SCOCR1HL = (uint8_t)(t >> 16);
+    SCOCR1LH = (uint8_t)(t >> 8);
+    SCOCR1LL = (uint8_t)t;
+    SCIRQS = _BV(IRQSCP1);
+    SCIRQM |= _BV(IRQMCP1);
+}
+
+static void csma_transmit(void)
+{
+    csma.busy = false;
+    radio_set_state(STATE_TX);
+    radio_send_frame(csma.len, csma.frm, 1);
+}
+
+int8_t radio_csma_send(uint8_t len, uint8_t *frm)
+{
+    if (csma.busy)
+    {
+        return -1;
+    }
+    if (0 == (SCCR0 & _BV(SCEN)))
+    {
+        trx_tstamp_init();
+    }
+    csma.frm = frm;
+    csma.len = len;
+    csma.nb = 0;
+    csma.be = trx_bit_read(SR_MIN_BE);
+    csma.maxbe = trx_bit_read(SR_MAX_BE);
+    csma.maxnb = trx_bit_read(SR_MAX_CSMA_RETRES);
+    csma.busy = true;
+    csma_stats.csma_frames++;
+    radio_set_state(STATE_RX);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (CSMA_NONE == csma.maxnb)
+        {
+            csma_transmit();
+        }
+        else
+        {
+            csma_backoff();
+        }
+    }
+    return 0;
+}
+
+bool radio_csma_busy(void)
+{
+    return csma.busy;
+}
+
+ISR(SCNT_CMP1_vect)
+{
+    SCIRQM &= ~_BV(IRQMCP1);
+    csma_cca_start();
+}
+
+ISR(TRX24_CCA_ED_DONE_vect)
+{
+uint8_t status;
+radio_cca_t cca;
+
+    trx_bit_write(SR_MASK_CCA_ED_READY, 0);
+    if (!csma.busy)
+    {
+        /* radio_do_cca() polls for itself */
+        return;
+    }
+    /* CCA_DONE and CCA_STATUS are valid for one read only */
+    status = trx_reg_read(RG_TRX_STATUS);
+    if (0 == (status & 0x80))
+    {
+        cca = RADIO_CCA_FAIL;
+    }
+    else
+    {
+        cca = (status & 0x40) ? RADIO_CCA_FREE : RADIO_CCA_BUSY;
+    }
+    radio_csma_cca_done(cca, trx_reg_read(RG_PHY_ED_LEVEL));
+    if (RADIO_CCA_FREE == cca)
+    {
+        csma_transmit();
+        return;
+    }
+    csma.nb++;
+    if (csma.be < csma.maxbe)
+    {
+        csma.be++;
+    }
+    if (csma.nb > csma.maxnb)
+    {
+        csma.busy = false;
+        csma_stats.csma_fail++;
+        usr_radio_tx_done(TX_CCA_FAIL);
+        return;
+    }
+    csma_backoff();
+}
+#endif /* defined(TRX_IF_RFA1) */
+#endif /* defined(RADIO_CSMA) */
+/* EOF */
@@ -0,0 +1,104 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/**
+ * @file
+ * @brief Duplicate detection of retransmitted frames.
+ *
+ * A frame with ACK request is sent again when its ACK got lost, the
+ * receiver gets the same frame twice. The last sequence number of each
+ * sender is kept in a small table, indexed by a hash of the short source
+ * address, so a lookup costs the same for every frame. Two senders with
+ * the same hash share an entry and evict each other, a duplicate of the
+ * one evicted is not detected then.
+ *
+ * Frames without ACK request are never retransmitted by the MAC and
+ * always pass.
+ */
+
+/* === includes ============================================================ */
+#include "board.h"
+#include "radio.h"
+
+#if defined(RADIO_DUPCHECK)
+/* === macros ============================================================== */
+#if (RADIO_DUP_ENTRIES & (RADIO_DUP_ENTRIES - 1)) != 0
+# error "RADIO_DUP_ENTRIES must be a power of 2"
+#endif
+#define DUP_HASH(a) (((a) ^ ((a) >> 8)) & (RADIO_DUP_ENTRIES - 1))
+
+/* === globals ============================================================= */
+static struct
+{
+    uint16_t src;
+    uint8_t seq;
+    bool used;
+} dup[RADIO_DUP_ENTRIES];
+
+/* === functions =========================================================== */
+
+void radio_dup_reset(void)
+{
+uint8_t i;
+
+    for (i = 0; i < RADIO_DUP_ENTRIES; i++)
+    {
+        dup[i].used = false;
+    }
+}
+
+bool radio_dup_check(uint8_t len, uint8_t *frm)
+{
+uint16_t fcf, src;
+uint8_t i;
+
+    /* FCF, seq, PAN, dst, src, FCS */
+    if (len < 11)
+    {
+        return false;
+    }
+    fcf = frm[0] | (frm[1] << 8);
+    /* ACK request, short addresses, PAN ID compression */
+    if ((fcf & 0xcc60) != 0x8860)
+    {
+        return false;
+    }
+    src = frm[7] | (frm[8] << 8);
+    i = DUP_HASH(src);
+    if (dup[i].used && (dup[i].src == src) && (dup[i].seq == frm[2]))
+    {
+        return true;
+    }
+    dup[i].used = true;
+    dup[i].src = src;
+    dup[i].seq = frm[2];
+    return false;
+}
+#endif /* defined(RADIO_DUPCHECK) */
+/* EOF */
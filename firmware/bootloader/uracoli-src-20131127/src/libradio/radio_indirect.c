@@ -0,0 +1,204 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Indirect transmission to sleeping children (data polling).
+ *
+ * A sleeping child can not receive frames sent at any time. The parent
+ * keeps them until the child polls with a MAC data request command
+ * (IEEE 802.15.4, 7.5.6.3). The transceiver acknowledges the request
+ * automatically, with AACK_SET_PD the ACK carries the frame pending
+ * bit, so the child knows whether to stay awake. The bit is set while
+ * any frame is queued, a child without frames only listens shortly.
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include <util/atomic.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "timer.h"
+
+#if defined(RADIO_INDIRECT)
+/* === macros ============================================================== */
+/** FCF of a data request: MAC command, ACK request, PAN ID compression,
+ *  short addresses */
+#define IND_FCF_REQUEST   (0x8863)
+/** MAC command identifier of the data request */
+#define IND_CMD_REQUEST   (0x04)
+/** frame retries of the tx queue for a polled frame */
+#define IND_RETRIES       (2)
+
+/* === globals ============================================================= */
+#if defined(RADIO_TXQUEUE)
+static struct
+{
+    uint8_t len;             /**< 0: slot is free */
+    volatile bool polled;    /**< data request seen, send it */
+    uint16_t dst;
+    time_t expire;           /**< timer_systime() in seconds */
+    uint8_t frm[MAX_FRAME_SIZE];
+} indq[RADIO_INDIRECT_SLOTS];
+static uint8_t indq_cnt;
+#endif
+
+/* === functions =========================================================== */
+
+uint8_t radio_indirect_request(uint8_t *frm, uint8_t seq, uint16_t pan_id,
+                               uint16_t parent, uint16_t src)
+{
+    frm[0] = IND_FCF_REQUEST & 0xff;
+    frm[1] = IND_FCF_REQUEST >> 8;
+    frm[2] = seq;
+    frm[3] = pan_id & 0xff;
+    frm[4] = pan_id >> 8;
+    frm[5] = parent & 0xff;
+    frm[6] = parent >> 8;
+    frm[7] = src & 0xff;
+    frm[8] = src >> 8;
+    frm[9] = IND_CMD_REQUEST;
+    /* frm[10..11] FCS, generated by the transceiver */
+    return RADIO_DATA_REQUEST_SIZE;
+}
+
+#if defined(RADIO_TXQUEUE)
+/** frame pending bit of the ACKs follows the queue */
+static void indq_update_pd(void)
+{
+    trx_bit_write(SR_AACK_SET_PD, (indq_cnt > 0) ? 1 : 0);
+}
+
+uint8_t radio_indirect_put(uint16_t dst, uint8_t len, uint8_t *frm)
+{
+uint8_t i;
+
+    if ((len < 3) || (len > MAX_FRAME_SIZE))
+    {
+        return 0;
+    }
+    for (i = 0; i < RADIO_INDIRECT_SLOTS; i++)
+    {
+        if (indq[i].len == 0)
+        {
+            memcpy(indq[i].frm, frm, len - 2);
+            indq[i].dst = dst;
+            indq[i].expire = timer_systime() + RADIO_INDIRECT_TTL;
+            indq[i].polled = false;
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                /* the slot is seen by radio_indirect_rx() from now on */
+                indq[i].len = len;
+                indq_cnt++;
+                indq_update_pd();
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+uint8_t radio_indirect_pending(uint16_t dst)
+{
+uint8_t i, n = 0;
+
+    for (i = 0; i < RADIO_INDIRECT_SLOTS; i++)
+    {
+        if (indq[i].len && indq[i].dst == dst)
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+void radio_indirect_task(void)
+{
+uint8_t i;
+time_t now;
+
+    if (indq_cnt == 0)
+    {
+        return;
+    }
+    now = timer_systime();
+    for (i = 0; i < RADIO_INDIRECT_SLOTS; i++)
+    {
+        if (indq[i].len == 0)
+        {
+            continue;
+        }
+        if (indq[i].polled)
+        {
+            if (radio_txq_put(indq[i].len, indq[i].frm, STATE_TXAUTO,
+                              IND_RETRIES) < 0)
+            {
+                /* queue full, try again next time */
+                continue;
+            }
+        }
+        else if ((int32_t)(now - indq[i].expire) < 0)
+        {
+            continue;
+        }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            indq[i].len = 0;
+            indq_cnt--;
+            indq_update_pd();
+        }
+    }
+}
+
+void radio_indirect_rx(uint8_t len, uint8_t *frm)
+{
+uint16_t src;
+uint8_t i;
+
+    if ((indq_cnt == 0) || (len < RADIO_DATA_REQUEST_SIZE) ||
+        (frm[0] != (IND_FCF_REQUEST & 0xff)) ||
+        ((frm[1] & 0xcc) != (IND_FCF_REQUEST >> 8)) ||
+        (frm[9] != IND_CMD_REQUEST))
+    {
+        return;
+    }
+    src = frm[7] | (frm[8] << 8);
+    for (i = 0; i < RADIO_INDIRECT_SLOTS; i++)
+    {
+        if (indq[i].len && indq[i].dst == src)
+        {
+            indq[i].polled = true;
+        }
+    }
+}
+#endif /* defined(RADIO_TXQUEUE) */
+#endif /* defined(RADIO_INDIRECT) */
+/* EOF */
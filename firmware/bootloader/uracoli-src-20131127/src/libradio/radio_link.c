@@ -0,0 +1,232 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Adaptive link parameters per destination.
+ *
+ * For each known peer the averaged LQI/ED of received frames and the
+ * outcome of transmissions are tracked. Before a frame is sent to a
+ * peer, TX power, frame retries, CSMA retries and MAX_BE are set
+ * from this record:
+ *  - a failed transmission (no ACK) increases the TX power and the
+ *    number of frame retries,
+ *  - a channel access failure increases MAX_BE and the CSMA retries,
+ *  - a run of successful transmissions on a link with good LQI
+ *    steps the TX power and the retries down again.
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+
+#if defined(RADIO_LINK)
+/* === macros ============================================================== */
+/** register value of the highest TX power */
+#define LINK_PWR_MAX      (0)
+/** register value of the lowest TX power (-16.5dBm on RFA1/RFR2) */
+#define LINK_PWR_MIN      (15)
+/** start value for a new peer, 0dBm */
+#define LINK_PWR_DEFAULT  (6)
+/** successful frames before the power is stepped down */
+#define LINK_GOOD_RUN     (8)
+/** average LQI above which the link is considered good */
+#define LINK_LQI_GOOD     (230)
+
+#define LINK_FRETRIES_MIN (1)
+#define LINK_FRETRIES_MAX (7)
+#define LINK_CRETRIES_MIN (2)
+#define LINK_CRETRIES_MAX (5)
+#define LINK_BE_MIN       (5)
+#define LINK_BE_MAX       (8)
+
+/* === globals ============================================================= */
+static radio_link_t links[RADIO_LINK_PEERS];
+/** parameters currently set in the transceiver, avoids redundant writes */
+static radio_link_t *link_applied;
+
+/* === functions =========================================================== */
+
+radio_link_t * radio_link_get(uint16_t addr)
+{
+uint8_t i, oldest = 0;
+bool havefree = false;
+
+    for (i = 0; i < RADIO_LINK_PEERS; i++)
+    {
+        if (!links[i].used)
+        {
+            if (!havefree)
+            {
+                oldest = i;
+                havefree = true;
+            }
+        }
+        else if (links[i].addr == addr)
+        {
+            links[i].age = 0;
+            return &links[i];
+        }
+        else if (!havefree && (links[i].age > links[oldest].age))
+        {
+            oldest = i;
+        }
+    }
+    for (i = 0; i < RADIO_LINK_PEERS; i++)
+    {
+        if (links[i].age < 0xff)
+        {
+            links[i].age++;
+        }
+    }
+    /* replace the least recently used entry */
+    if (link_applied == &links[oldest])
+    {
+        link_applied = NULL;
+    }
+    memset(&links[oldest], 0, sizeof(radio_link_t));
+    links[oldest].used = 1;
+    links[oldest].addr = addr;
+    links[oldest].lqi = 0xff;
+    links[oldest].txpwr = LINK_PWR_DEFAULT;
+    links[oldest].fretries = 3;
+    links[oldest].cretries = 4;
+    links[oldest].max_be = LINK_BE_MIN;
+    return &links[oldest];
+}
+
+void radio_link_rx(uint16_t src, uint8_t lqi, int8_t ed)
+{
+radio_link_t *pl = radio_link_get(src);
+
+    pl->lqi = (uint8_t)(((uint16_t)pl->lqi * 3 + lqi) / 4);
+    pl->ed = (int8_t)(((int16_t)pl->ed * 3 + ed) / 4);
+}
+
+void radio_link_tx_done(uint16_t dst, radio_tx_done_t status)
+{
+radio_link_t *pl = radio_link_get(dst);
+
+    switch (status)
+    {
+        case TX_OK:
+            if (++pl->goodrun < LINK_GOOD_RUN)
+            {
+                break;
+            }
+            pl->goodrun = 0;
+            if (pl->lqi >= LINK_LQI_GOOD && pl->txpwr < LINK_PWR_MIN)
+            {
+                pl->txpwr++;
+            }
+            if (pl->fretries > LINK_FRETRIES_MIN)
+            {
+                pl->fretries--;
+            }
+            if (pl->cretries > LINK_CRETRIES_MIN)
+            {
+                pl->cretries--;
+            }
+            if (pl->max_be > LINK_BE_MIN)
+            {
+                pl->max_be--;
+            }
+            break;
+
+        case TX_CCA_FAIL:
+            pl->goodrun = 0;
+            if (pl->max_be < LINK_BE_MAX)
+            {
+                pl->max_be++;
+            }
+            if (pl->cretries < LINK_CRETRIES_MAX)
+            {
+                pl->cretries++;
+            }
+            break;
+
+        default:
+            pl->goodrun = 0;
+            pl->txpwr = (pl->txpwr > LINK_PWR_MAX + 2) ?
+                        pl->txpwr - 2 : LINK_PWR_MAX;
+            if (pl->fretries < LINK_FRETRIES_MAX)
+            {
+                pl->fretries++;
+            }
+            break;
+    }
+    if (link_applied == pl)
+    {
+        /* force rewrite with the next frame */
+        link_applied = NULL;
+    }
+}
+
+void radio_link_apply(uint16_t dst)
+{
+radio_link_t *pl = radio_link_get(dst);
+
+    if (pl == link_applied)
+    {
+        return;
+    }
+    trx_bit_write(SR_TX_PWR, pl->txpwr);
+    trx_bit_write(SR_MAX_FRAME_RETRES, pl->fretries);
+    trx_bit_write(SR_MAX_CSMA_RETRES, pl->cretries);
+    trx_bit_write(SR_MAX_BE, pl->max_be);
+    link_applied = pl;
+}
+
+uint8_t radio_link_frame_addr(uint8_t *frm, uint8_t src, uint16_t *addr)
+{
+uint16_t fcf = frm[0] | (frm[1] << 8);
+uint8_t offs;
+
+    /* short destination address, PAN ID compression */
+    if ((fcf & 0x0c40) != 0x0840)
+    {
+        return 0;
+    }
+    offs = 5;
+    if (src)
+    {
+        if ((fcf & 0xc000) != 0x8000)
+        {
+            return 0;
+        }
+        offs = 7;
+    }
+    *addr = frm[offs] | (frm[offs + 1] << 8);
+    return (*addr != 0xffff);
+}
+#endif /* defined(RADIO_LINK) */
+/* EOF */
@@ -0,0 +1,238 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Low power listening (LPL).
+ *
+ * The receiver sleeps and wakes up once per wake interval for a short
+ * receive window. Senders repeat a frame back to back for a whole wake
+ * interval (strobes), so one copy falls into the next window of the
+ * receiver:
+ *  - a frame with ACK request is retried by the tx queue until the
+ *    receiver acknowledges it,
+ *  - a broadcast is sent for the whole interval, receivers pass the
+ *    first copy on and drop the others by source address and sequence
+ *    number.
+ * Every frame received or sent keeps the radio on for RADIO_LPL_HOLD_MS,
+ * so a conversation only pays the wake up latency for its first frame.
+ */
+
+/* === includes ============================================================ */
+#include <util/atomic.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "timer.h"
+
+#if defined(RADIO_LPL) && defined(TRX_IF_RFA1)
+/* === macros ============================================================== */
+#if defined(CMD_PREP_DEEP_SLEEP)
+# define LPL_SLEEP_STATE (STATE_DEEPSLEEP)
+#else
+# define LPL_SLEEP_STATE (STATE_SLEEP)
+#endif
+/** gap between two copies without ACK (TX_END, restart) */
+#define LPL_GAP_US  (300)
+/** CSMA backoff and ACK wait of one attempt in TX_ARET */
+#define LPL_ACK_US  (1900)
+/** air time of a frame with len PSDU bytes, 32us per byte */
+#define LPL_AIR_US(len) (((len) + 6) * 32UL)
+
+/* === globals ============================================================= */
+static struct
+{
+    timer_hdl_t tmr;
+    time_t wake;             /**< wake interval in timer ticks */
+    uint16_t wake_ms;
+    uint8_t fretries;        /**< MAX_FRAME_RETRIES, read while awake */
+    bool asleep;
+    volatile bool activity;
+    bool bcast_valid;        /**< last broadcast, to drop its copies */
+    uint8_t bcast_seq;
+    uint16_t bcast_src;
+} lpl = { NONE_TIMER, 0, RADIO_LPL_WAKE_MS };
+
+/* === functions =========================================================== */
+
+static time_t lpl_timer(timer_arg_t t)
+{
+time_t next;
+uint8_t trxstatus;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (radio_txq_pending())
+        {
+            /* the queue wakes the radio up and returns it to the idle
+             * state, keep out of its way */
+            lpl.asleep = false;
+            next = MSEC(RADIO_LPL_LISTEN_MS);
+        }
+        else if (lpl.asleep)
+        {
+            radio_set_state(STATE_RXAUTO);
+            lpl.asleep = false;
+            next = MSEC(RADIO_LPL_LISTEN_MS);
+        }
+        else if (lpl.activity)
+        {
+            lpl.activity = false;
+            next = MSEC(RADIO_LPL_HOLD_MS);
+        }
+        else
+        {
+            trxstatus = trx_bit_read(SR_TRX_STATUS);
+            if ((trxstatus != RX_AACK_ON) && (trxstatus != RX_ON))
+            {
+                /* a frame is being received */
+                next = MSEC(RADIO_LPL_LISTEN_MS);
+            }
+            else
+            {
+                radio_set_state(LPL_SLEEP_STATE);
+                lpl.asleep = true;
+                /* strobes are over when the hold time expired */
+                lpl.bcast_valid = false;
+                next = lpl.wake;
+            }
+        }
+    }
+    return next;
+}
+
+uint8_t radio_lpl_start(uint16_t wake_ms)
+{
+    radio_lpl_stop();
+    if (wake_ms == 0)
+    {
+        return 0;
+    }
+    lpl.wake_ms = wake_ms;
+    /* MSEC() is float math, only use it with constants */
+    lpl.wake = (MSEC(1000) * (uint32_t)wake_ms) / 1000;
+    if (lpl.wake == 0)
+    {
+        lpl.wake = 1;
+    }
+    radio_set_state(STATE_RXAUTO);
+    lpl.fretries = trx_bit_read(SR_MAX_FRAME_RETRES);
+    lpl.activity = false;
+    lpl.tmr = timer_start(lpl_timer, MSEC(RADIO_LPL_HOLD_MS), 0);
+    return (lpl.tmr != NONE_TIMER);
+}
+
+void radio_lpl_stop(void)
+{
+    if (lpl.tmr == NONE_TIMER)
+    {
+        return;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        timer_stop(lpl.tmr);
+        lpl.tmr = NONE_TIMER;
+        if (lpl.asleep && !radio_txq_pending())
+        {
+            radio_set_state(STATE_RXAUTO);
+        }
+        lpl.asleep = false;
+    }
+}
+
+int16_t radio_lpl_send(uint8_t len, uint8_t *frm)
+{
+uint32_t per_us, n;
+radio_state_t state;
+
+    if (len < 3)
+    {
+        return -1;
+    }
+    if (frm[0] & 0x20)
+    {
+        /* ACK request, each retry of the queue runs the retries of
+         * the transceiver */
+        if (lpl.tmr == NONE_TIMER)
+        {
+            lpl.fretries = trx_bit_read(SR_MAX_FRAME_RETRES);
+        }
+        per_us = (lpl.fretries + 1) * (LPL_AIR_US(len) + LPL_ACK_US);
+        state = STATE_TXAUTO;
+    }
+    else
+    {
+        per_us = LPL_AIR_US(len) + LPL_GAP_US;
+        state = STATE_TX;
+    }
+    n = (lpl.wake_ms * 1000UL) / per_us + 1;
+    if (n > 255)
+    {
+        n = 255;
+    }
+    return radio_txq_strobe(len, frm, state, n);
+}
+
+void radio_lpl_activity(void)
+{
+    lpl.activity = true;
+}
+
+bool radio_lpl_duplicate(uint8_t len, uint8_t *frm)
+{
+uint16_t fcf, dst, src;
+
+    if (len < 11)
+    {
+        return false;
+    }
+    fcf = frm[0] | (frm[1] << 8);
+    /* short addresses, PAN ID compression */
+    if ((fcf & 0xcc40) != 0x8840)
+    {
+        return false;
+    }
+    dst = frm[5] | (frm[6] << 8);
+    src = frm[7] | (frm[8] << 8);
+    if (dst != 0xffff)
+    {
+        return false;
+    }
+    if (lpl.bcast_valid && (lpl.bcast_src == src) && (lpl.bcast_seq == frm[2]))
+    {
+        return true;
+    }
+    lpl.bcast_valid = true;
+    lpl.bcast_src = src;
+    lpl.bcast_seq = frm[2];
+    return false;
+}
+#endif /* defined(RADIO_LPL) */
+/* EOF */
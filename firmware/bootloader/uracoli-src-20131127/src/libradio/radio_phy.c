@@ -0,0 +1,144 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/**
+ * @file
+ * @brief Named PHY profiles.
+ *
+ * A profile bundles data rate, transmit power, CCA and retry settings,
+ * so nodes and host can switch between settings of proven combinations
+ * at runtime instead of picking a data rate at compile time. The index
+ * of a profile is what goes over the air (P2P_PHY_SET) and into the
+ * EEPROM, profile 0 is the default of the radio after reset.
+ *
+ * With RADIO_LINK the per peer settings of the link manager override
+ * transmit power and frame retries of the profile.
+ */
+
+/* === includes ============================================================ */
+#include <avr/pgmspace.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+
+/* === globals ============================================================= */
+typedef struct
+{
+    char name[RADIO_PHY_NAME_LEN];
+    radio_phy_profile_t p;
+} phy_entry_t;
+
+/*
+ * CCA mode 1 (energy above threshold) and ED threshold 7 are the reset
+ * values of the transceivers, 3 frame and 4 CSMA retries the defaults
+ * of 802.15.4.
+ */
+static const phy_entry_t PROGMEM phy_profiles[] =
+{
+#if RADIO_TYPE == RADIO_AT86RF212
+    { "bpsk40",    { BPSK40,    RADIO_PHY_KEEP, 1, 7, 3, 4 } },
+    { "robust",    { BPSK20,    RADIO_PHY_KEEP, 1, 7, 7, 5 } },
+    { "oqpsk100",  { OQPSK100,  RADIO_PHY_KEEP, 1, 7, 3, 4 } },
+    { "oqpsk250",  { OQPSK250,  RADIO_PHY_KEEP, 1, 7, 3, 4 } },
+    { "oqpsk1000", { OQPSK1000, RADIO_PHY_KEEP, 1, 7, 3, 4 } },
+#elif RADIO_TYPE == RADIO_AT86RF231 || defined(TRX_IF_RFA1)
+    { "std",       { OQPSK250,  0x00, 1, 7, 3, 4 } },
+    { "robust",    { OQPSK250,  0x00, 1, 7, 7, 5 } },
+    { "lowpwr",    { OQPSK250,  0x0F, 1, 7, 3, 4 } },
+    { "oqpsk500",  { OQPSK500,  0x00, 1, 7, 3, 4 } },
+    { "oqpsk1000", { OQPSK1000, 0x00, 1, 7, 3, 4 } },
+    { "oqpsk2000", { OQPSK2000, 0x00, 1, 7, 3, 4 } },
+#else
+    { "std",       { OQPSK250,  RADIO_PHY_KEEP, 1, 7, 3, 4 } },
+    { "robust",    { OQPSK250,  RADIO_PHY_KEEP, 1, 7, 7, 5 } },
+#endif
+};
+
+#define PHY_NB_PROFILES (sizeof(phy_profiles) / sizeof(phy_profiles[0]))
+
+static uint8_t phy_current = RADIO_PHY_NONE;
+
+/* === functions =========================================================== */
+
+uint8_t radio_phy_count(void)
+{
+    return PHY_NB_PROFILES;
+}
+
+uint8_t radio_phy_get(void)
+{
+    return phy_current;
+}
+
+const char * radio_phy_name_p(uint8_t idx)
+{
+    if (idx >= PHY_NB_PROFILES)
+    {
+        return NULL;
+    }
+    return phy_profiles[idx].name;
+}
+
+uint8_t radio_phy_read(uint8_t idx, radio_phy_profile_t *prof)
+{
+    if (idx >= PHY_NB_PROFILES)
+    {
+        return 0;
+    }
+    memcpy_P(prof, &phy_profiles[idx].p, sizeof(radio_phy_profile_t));
+    return 1;
+}
+
+uint8_t radio_phy_set(uint8_t idx)
+{
+radio_phy_profile_t p;
+
+    if (!radio_phy_read(idx, &p))
+    {
+        return 0;
+    }
+    /* forces TRX_OFF */
+    if (RATE_NONE == trx_set_datarate(p.rate))
+    {
+        return 0;
+    }
+    if (p.txpwr != RADIO_PHY_KEEP)
+    {
+        trx_bit_write(SR_TX_PWR, p.txpwr);
+    }
+    trx_bit_write(SR_CCA_MODE, p.ccamode);
+    trx_bit_write(SR_CCA_ED_THRES, p.edthres);
+#if defined(SR_MAX_FRAME_RETRES)
+    trx_bit_write(SR_MAX_FRAME_RETRES, p.fretries);
+    trx_bit_write(SR_MAX_CSMA_RETRES, p.cretries);
+#endif
+    phy_current = idx;
+    return 1;
+}
+/* EOF */
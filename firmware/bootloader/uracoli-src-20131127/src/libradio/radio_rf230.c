@@ -39,11 +39,20 @@
 #include <avr/pgmspace.h>
 #include "radio.h"
 #include "transceiver.h"
+#include "energy_mark.h"
+#include "pm.h"
 /* === globals ============================================================= */
 #if ! defined(TRX_IF_RFA1)
 static radio_status_t radiostatus;
 //trx_param_t PROGMEM radio_cfg_flash = RADIO_CFG_DATA;
 
+/** registers set at the end of radio_init(), in TRX_OFF */
+static const trx_regseq_t PROGMEM radio_init_seq[] =
+{
+    TRX_REGSEQ_SR(SR_TX_AUTO_CRC_ON, 1),
+    TRX_REGSEQ_REG(RG_IRQ_MASK, TRX_IRQ_TRX_END),
+};
+
 /* === prototypes ========================================================== */
 void radio_irq_handler(uint8_t cause);
 
@@ -75,6 +84,18 @@ int8_t ed;
 
     /* @todo add RSSI_BASE_VALUE to get a dBm value */
     ed = (int8_t)trx_reg_read(RG_PHY_ED_LEVEL);
+#if defined(RADIO_RX_FILTER)
+    {
+        uint8_t hdr[RADIO_RX_HDRLEN];
+
+        len = trx_frame_read_head(hdr, RADIO_RX_HDRLEN);
+        if (!usr_radio_rx_filter(len, hdr,
+                                 len < RADIO_RX_HDRLEN ? len : RADIO_RX_HDRLEN))
+        {
+            return;
+        }
+    }
+#endif
     len = trx_frame_read(radiostatus.rxframe, radiostatus.rxframesz, &lqi);
     len &= ~0x80;
 
@@ -95,6 +116,52 @@ int8_t ed;
                                                   lqi, ed, crc_fail);
 }
 
+/**
+ * @brief Return to the idle state after TX_END, from the ISR
+ *
+ * After a frame is sent the transceiver is in PLL_ON (STATE_TX) or
+ * TX_ARET_ON (STATE_TXAUTO) with the PLL locked. From there RX_ON,
+ * RX_AACK_ON and TRX_OFF are reached within about 1us, so the command is
+ * written with a single register write and not polled over SPI. The TRAC
+ * bits of RG_TRX_STATE are read only and TRX_CMD is the rest of the
+ * register, so there is no read-modify-write either. Other transitions
+ * go through radio_set_state().
+ */
+static void radio_tx_done_idle(void)
+{
+radio_state_t idle = radiostatus.idle_state;
+trx_regval_t cmd;
+
+    if (STATE_OFF == idle)
+    {
+        #ifdef TRX_RX_LNA_EI
+            TRX_RX_LNA_DI();
+        #endif
+        cmd = CMD_TRX_OFF;
+    }
+    else if ((STATE_RX == idle) && (STATE_TX == radiostatus.state))
+    {
+        cmd = CMD_RX_ON;
+    }
+    else if ((STATE_RXAUTO == idle) && (STATE_TXAUTO == radiostatus.state))
+    {
+        cmd = CMD_RX_AACK_ON;
+    }
+    else
+    {
+        radio_set_state(idle);
+        return;
+    }
+    #ifdef TRX_RX_LNA_EI
+    if ((STATE_OFF != idle) && radiostatus.rx_lna)
+    {
+        TRX_RX_LNA_EI();
+    }
+    #endif
+    trx_reg_write(RG_TRX_STATE, cmd);
+    radiostatus.state = idle;
+}
+
 /**
  * @brief IRQ handler for radio functions.
  *
@@ -107,23 +174,28 @@ int8_t ed;
  */
 void radio_irq_handler(uint8_t cause)
 {
+    PM_EVENT();
     if (cause & TRX_IRQ_TRX_END)
     {
         if (STATE_RX == radiostatus.state ||
             STATE_RXAUTO == radiostatus.state)
         {
+            ENERGY_MARK_ON(ENERGY_RX);
             radio_receive_frame();
+            ENERGY_MARK_OFF(ENERGY_RX);
         }
         else if (STATE_TX == radiostatus.state)
         {
+            ENERGY_MARK_OFF(ENERGY_TX);
             #ifdef TRX_TX_PA_EI
                 TRX_TX_PA_DI();
             #endif
             usr_radio_tx_done(TX_OK);
-            radio_set_state(radiostatus.idle_state);
+            radio_tx_done_idle();
         }
         else if (STATE_TXAUTO == radiostatus.state)
         {
+            ENERGY_MARK_OFF(ENERGY_TX);
             #ifdef TRX_TX_PA_EI
                 TRX_TX_PA_DI();
             #endif
@@ -152,10 +224,23 @@ void radio_irq_handler(uint8_t cause)
             default:
                 result = TX_FAIL;
             }
+#if defined(RADIO_CSMA)
+            radio_csma_aret_done(trac_status);
+#endif
+#if defined(RADIO_INDIRECT) && defined(TRAC_SUCCESS_DATA_PENDING)
+            if (TRAC_SUCCESS_DATA_PENDING == trac_status)
+            {
+                result = TX_DATA_PENDING;
+            }
+#endif
             usr_radio_tx_done(result);
-            radio_set_state(radiostatus.idle_state);
+            radio_tx_done_idle();
         }
     }
+    if (cause & TRX_IRQ_PLL_LOCK)
+    {
+        radio_chsw_irq();
+    }
     usr_radio_irq(cause);
 }
 
@@ -170,6 +255,7 @@ trx_regval_t status;
     radiostatus.rxframesz = rxbufsz;
     trx_io_init(DEFAULT_SPI_RATE);
     trx_set_irq_handler(radio_irq_handler);
+    ENERGY_MARK_INIT();
     /* transceiver initialization */
 
     TRX_RESET_LOW();
@@ -198,8 +284,7 @@ trx_regval_t status;
     }
     while (status != TRX_OFF);
 
-    trx_bit_write(SR_TX_AUTO_CRC_ON, 1);
-    trx_reg_write(RG_IRQ_MASK, TRX_IRQ_TRX_END);
+    trx_reg_seq(radio_init_seq, sizeof(radio_init_seq)/sizeof(trx_regseq_t));
 
     radiostatus.state = STATE_OFF;
     radiostatus.idle_state = STATE_OFF;
@@ -359,6 +444,41 @@ bool do_sleep = false;
     radiostatus.state = state;
 }
 
+#if defined(SR_ANT_DIV_EN)
+/**
+ * Set up the antenna switch at DIG1/DIG2, see @ref phyAntDiv.
+ * The preamble detector needs PDT_THRES 3 for antenna diversity.
+ */
+static bool radio_set_antdiv(uint8_t mode)
+{
+    switch (mode)
+    {
+        case RADIO_ANT_OFF:
+            trx_bit_write(SR_ANT_DIV_EN, 0);
+            trx_bit_write(SR_ANT_EXT_SW_EN, 0);
+            trx_bit_write(SR_PDT_THRES, 7);
+            break;
+        case RADIO_ANT_0:
+        case RADIO_ANT_1:
+            trx_bit_write(SR_ANT_DIV_EN, 0);
+            trx_bit_write(SR_ANT_CTRL, mode);
+            trx_bit_write(SR_ANT_EXT_SW_EN, 1);
+            trx_bit_write(SR_PDT_THRES, 7);
+            break;
+        case RADIO_ANT_DIVERSITY:
+            trx_bit_write(SR_ANT_CTRL, 1);
+            trx_bit_write(SR_ANT_EXT_SW_EN, 1);
+            trx_bit_write(SR_PDT_THRES, 3);
+            trx_bit_write(SR_ANT_DIV_EN, 1);
+            break;
+        default:
+            return false;
+    }
+    radiostatus.ant_div = mode;
+    return true;
+}
+#endif
+
 void radio_set_param(radio_attribute_t attr, radio_param_t parm)
 {
     switch (attr)
@@ -398,7 +518,7 @@ void radio_set_param(radio_attribute_t attr, radio_param_t parm)
                 };
                 radiostatus.tx_pwr = parm.tx_pwr;
                 uint8_t idx = parm.tx_pwr + 17;
-                uint8_t pwrval = pgm_read_byte(pwrtable[idx]);
+                uint8_t pwrval = pgm_read_byte(&pwrtable[idx]);
                 trx_bit_write(SR_TX_PWR, pwrval);
             }
             else
@@ -460,12 +580,44 @@ void radio_set_param(radio_attribute_t attr, radio_param_t parm)
             break;
 #endif
 
+#if defined(SR_ANT_DIV_EN)
+        case phyAntDiv:
+            if (!radio_set_antdiv(parm.ant_div))
+            {
+                radio_error(SET_PARM_FAILED);
+            }
+            break;
+#endif
+#if defined(SR_RX_SAFE_MODE)
+        case phyRxProtect:
+            /* released by the frame buffer read of radio_receive_frame() */
+            radiostatus.rx_protect = parm.rx_protect ? 1 : 0;
+            trx_bit_write(SR_RX_SAFE_MODE, radiostatus.rx_protect);
+            break;
+#endif
+#if defined(RG_TRX_RPC)
+        case phyRpc:
+            /* smart receiving timing 3 as recommended, bit 0 is reserved 1 */
+            radiostatus.rpc = parm.rpc & RADIO_RPC_ALL;
+            trx_reg_write(RG_TRX_RPC, 0xc1 | radiostatus.rpc);
+            break;
+#endif
+
         default:
             radio_error(SET_PARM_FAILED);
             break;
     }
 }
 
+uint8_t radio_get_antenna(void)
+{
+#if defined(SR_ANT_DIV_EN)
+    return trx_bit_read(SR_ANT_SEL);
+#else
+    return 0;
+#endif
+}
+
 
 void radio_send_frame(uint8_t len, uint8_t *frm, uint8_t compcrc)
 {
@@ -480,6 +632,7 @@ void radio_send_frame(uint8_t len, uint8_t *frm, uint8_t compcrc)
     TRX_SLPTR_LOW();
     trx_frame_write(len, frm);
     /***********************************/
+    ENERGY_MARK_ON(ENERGY_TX);
 }
 
 radio_cca_t radio_do_cca(void)
@@ -524,6 +677,9 @@ radio_cca_t ret = RADIO_CCA_FREE;
     {
         ret = RADIO_CCA_BUSY;
     }
+#if defined(RADIO_CSMA)
+    radio_csma_cca_done(ret, trx_reg_read(RG_PHY_ED_LEVEL));
+#endif
 
     trx_reg_write(RG_TRX_STATE, trxcmd);
 
@@ -38,13 +38,88 @@
 #include <stdbool.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <string.h>
+#if defined(RADIO_RXPOOL) || defined(RADIO_TXQUEUE)
+#include <util/atomic.h>
+#endif
 #include "radio.h"
 #include "transceiver.h"
+#include "isr_prof.h"
+#include "energy_mark.h"
+#include "pm.h"
 
 #if defined(TRX_IF_RFA1)
 /* === globals ============================================================= */
 static radio_status_t radiostatus;
 //trx_param_t PROGMEM radio_cfg_flash = RADIO_CFG_DATA;
+#if defined(RADIO_RXPOOL)
+/** rx buffer pool and fifo of filled buffers */
+static struct
+{
+    buffer_pool_t *pool;
+    buffer_queue_t fifo;
+} rxpool;
+/** a frame waits in the protected frame buffer for a pool buffer */
+static volatile bool rx_held;
+#endif
+#if defined(RADIO_RX_ONTHEFLY)
+# ifndef RADIO_RX_BYTE_US
+/** time of one PSDU byte, 32us at 250kbit/s (conservative for higher rates) */
+#  define RADIO_RX_BYTE_US (32)
+# endif
+/** number of bytes already copied at RX_START, 0 = not streamed */
+static uint8_t rxotf_cnt;
+#endif
+#if defined(CMD_PREP_DEEP_SLEEP)
+/** registers which are lost in DEEP_SLEEP, besides trx_param_t */
+static const uint8_t PROGMEM radio_wake_regs[] =
+{
+    RG_TRX_CTRL_1, RG_TRX_CTRL_2, RG_IRQ_MASK, RG_XAH_CTRL_1,
+    RG_SHORT_ADDR_0, RG_SHORT_ADDR_1, RG_PAN_ID_0, RG_PAN_ID_1,
+    RG_IEEE_ADDR_0 + 0, RG_IEEE_ADDR_0 + 1, RG_IEEE_ADDR_0 + 2,
+    RG_IEEE_ADDR_0 + 3, RG_IEEE_ADDR_0 + 4, RG_IEEE_ADDR_0 + 5,
+    RG_IEEE_ADDR_0 + 6, RG_IEEE_ADDR_0 + 7,
+    RG_XAH_CTRL_0, RG_CSMA_SEED_0, RG_CSMA_SEED_1, RG_CSMA_BE,
+#if defined(SR_ANT_DIV_EN)
+    RG_ANT_DIV, RG_RX_CTRL,
+#endif
+#if defined(RG_TRX_RPC)
+    RG_TRX_RPC,
+#endif
+};
+/** register values cached at entry of STATE_DEEPSLEEP */
+static struct
+{
+    trx_param_t parms;
+    uint8_t regs[sizeof(radio_wake_regs)];
+} radio_wake_cache;
+#endif
+#if defined(RADIO_TXQUEUE)
+#if RADIO_TXQ_RESERVE >= RADIO_TXQ_SLOTS
+# error "RADIO_TXQ_RESERVE leaves no slot for bulk frames"
+#endif
+/** tx queue, pre-allocated frame slots, head is the one in the air */
+static struct
+{
+    uint8_t head;
+    uint8_t cnt;
+    uint8_t seq;
+    volatile bool busy;
+    radio_txq_cb_t cb;
+    struct
+    {
+        bool used;
+        uint8_t prio;
+        uint8_t len;
+        uint8_t handle;  /**< also the order of arrival */
+        radio_state_t state;
+        uint8_t maxretries;
+        uint8_t retries;
+        uint8_t repeat;  /**< unconditional repetitions left, STATE_TX */
+        uint8_t frm[MAX_FRAME_SIZE];
+    } slot[RADIO_TXQ_SLOTS];
+} txq;
+#endif
 
 /* === prototypes ========================================================== */
 void radio_irq_handler(uint8_t cause);
@@ -65,6 +140,23 @@ void radio_error(radio_error_t err)
     usr_radio_error(err);
 }
 
+/**
+ * @brief Give the frame buffer free for the next frame, phyRxProtect.
+ *
+ * Clearing RX_SAFE_MODE releases the protection, setting it again
+ * protects the next frame.
+ */
+static void radio_rx_release(void)
+{
+#if defined(SR_RX_SAFE_MODE)
+    if (radiostatus.rx_protect)
+    {
+        trx_bit_write(SR_RX_SAFE_MODE, 0);
+        trx_bit_write(SR_RX_SAFE_MODE, 1);
+    }
+#endif
+}
+
 /**
  * @brief Frame reception
  *
@@ -74,12 +166,185 @@ void radio_receive_frame(void)
 
 uint8_t len, lqi, crc_fail;
 int8_t ed;
+bool crc_ok;
+#if defined(RADIO_RXPOOL)
+buffer_t *pbuf;
+radio_rxmeta_t *pmeta;
+#endif
+#if defined(RADIO_LINK)
+uint16_t src;
+#endif
 
+#if defined(RADIO_LPL)
+    radio_lpl_activity();
+#endif
     /* @todo add RSSI_BASE_VALUE to get a dBm value */
     ed = (int8_t)trx_reg_read(RG_PHY_ED_LEVEL);
-    crc_fail = trx_bit_read(SR_RX_CRC_VALID) ? 0 : 1;
-    len = trx_frame_read(radiostatus.rxframe, radiostatus.rxframesz, &lqi);
+#if defined(RADIO_RX_FILTER)
+    {
+        uint8_t hdr[RADIO_RX_HDRLEN];
+
+        len = trx_frame_read_head(hdr, RADIO_RX_HDRLEN);
+        if (!usr_radio_rx_filter(len, hdr,
+                                 len < RADIO_RX_HDRLEN ? len : RADIO_RX_HDRLEN))
+        {
+#if defined(RADIO_RX_ONTHEFLY)
+            rxotf_cnt = 0;
+#endif
+            radio_rx_release();
+            return;
+        }
+    }
+#endif
+#if defined(RADIO_RXPOOL)
+    if (rxpool.pool != NULL)
+    {
+        pbuf = buffer_alloc(rxpool.pool, sizeof(radio_rxmeta_t));
+        if (pbuf == NULL)
+        {
+            if (radiostatus.rx_protect)
+            {
+                /* keep it in the frame buffer, see radio_rx_held() */
+                rx_held = true;
+                return;
+            }
+            radio_error(RXPOOL_EMPTY);
+            return;
+        }
+        pmeta = RADIO_RXMETA(pbuf);
+        pmeta->ed = ed;
+        pmeta->tstamp = trx_tstamp_sfd();
+        pmeta->ant = radio_get_antenna();
+        {
+            ISR_PROF_ENTER(tread);
+            len = trx_frame_read_data_crc(BUFFER_PDATA(pbuf),
+                                          pbuf->len - sizeof(radio_rxmeta_t),
+                                          &pmeta->lqi, &crc_ok);
+            ISR_PROF_EXIT(ISR_PROF_FRAME_READ, tread);
+        }
+        radio_rx_release();
+        crc_fail = crc_ok ? 0 : 1;
+        pmeta->crc_fail = crc_fail;
+        pbuf->iend = pbuf->istart + (len & ~0x80);
+#if defined(RADIO_SCAN)
+        radio_scan_frame(crc_fail, pmeta->lqi);
+#endif
+#if defined(RADIO_TSYNC)
+        if (!crc_fail &&
+            radio_tsync_rx(pbuf->iend - pbuf->istart, BUFFER_PDATA(pbuf),
+                           pmeta->tstamp))
+        {
+            buffer_free(rxpool.pool, pbuf);
+            return;
+        }
+#endif
+#if defined(RADIO_TDMA)
+        if (!crc_fail &&
+            radio_tdma_rx(pbuf->iend - pbuf->istart, BUFFER_PDATA(pbuf),
+                          pmeta->tstamp))
+        {
+            buffer_free(rxpool.pool, pbuf);
+            return;
+        }
+#endif
+#if defined(RADIO_INDIRECT) && defined(RADIO_TXQUEUE)
+        if (!crc_fail)
+        {
+            radio_indirect_rx(pbuf->iend - pbuf->istart, BUFFER_PDATA(pbuf));
+        }
+#endif
+#if defined(RADIO_LPL)
+        if (!crc_fail &&
+            radio_lpl_duplicate(pbuf->iend - pbuf->istart, BUFFER_PDATA(pbuf)))
+        {
+            buffer_free(rxpool.pool, pbuf);
+            return;
+        }
+#endif
+#if defined(RADIO_DUPCHECK)
+        if (!crc_fail &&
+            radio_dup_check(pbuf->iend - pbuf->istart, BUFFER_PDATA(pbuf)))
+        {
+            buffer_free(rxpool.pool, pbuf);
+            return;
+        }
+#endif
+#if defined(RADIO_LINK)
+        if (!crc_fail && radio_link_frame_addr(BUFFER_PDATA(pbuf), 1, &src))
+        {
+            radio_link_rx(src, pmeta->lqi, ed);
+        }
+#endif
+        buffer_queue_push(&rxpool.fifo, pbuf);
+        return;
+    }
+#endif
+#if defined(RADIO_RX_ONTHEFLY)
+    if (rxotf_cnt != 0)
+    {
+        /* the payload is already there, only fetch FCS and LQI */
+        len = TST_RX_LENGTH;
+        memcpy(radiostatus.rxframe + rxotf_cnt, (void*)(&TRXFBST + rxotf_cnt),
+               len - rxotf_cnt);
+        lqi = *(&TRXFBST + len);
+        crc_fail = trx_bit_read(SR_RX_CRC_VALID) ? 0 : 1;
+        rxotf_cnt = 0;
+        radio_rx_release();
+    }
+    else
+#endif
+    {
+        /* frame, LQI and the CRC flag of the transceiver in one go */
+        ISR_PROF_ENTER(tread);
+        len = trx_frame_read_data_crc(radiostatus.rxframe,
+                                      radiostatus.rxframesz, &lqi, &crc_ok);
+        ISR_PROF_EXIT(ISR_PROF_FRAME_READ, tread);
+        crc_fail = crc_ok ? 0 : 1;
+        radio_rx_release();
+    }
     len &= ~0x80;
+#if defined(RADIO_SCAN)
+    radio_scan_frame(crc_fail, lqi);
+#endif
+#if defined(RADIO_TSYNC)
+    if (!crc_fail && radio_tsync_rx(len, radiostatus.rxframe, trx_tstamp_sfd()))
+    {
+        /* time sync beacon, taken by the library */
+        return;
+    }
+#endif
+#if defined(RADIO_TDMA)
+    if (!crc_fail && radio_tdma_rx(len, radiostatus.rxframe, trx_tstamp_sfd()))
+    {
+        return;
+    }
+#endif
+#if defined(RADIO_INDIRECT) && defined(RADIO_TXQUEUE)
+    if (!crc_fail)
+    {
+        radio_indirect_rx(len, radiostatus.rxframe);
+    }
+#endif
+#if defined(RADIO_LPL)
+    if (!crc_fail && radio_lpl_duplicate(len, radiostatus.rxframe))
+    {
+        /* one more copy of a strobed broadcast */
+        return;
+    }
+#endif
+#if defined(RADIO_DUPCHECK)
+    if (!crc_fail && radio_dup_check(len, radiostatus.rxframe))
+    {
+        /* retransmission, the ACK of the first copy was lost */
+        return;
+    }
+#endif
+#if defined(RADIO_LINK)
+    if (!crc_fail && radio_link_frame_addr(radiostatus.rxframe, 1, &src))
+    {
+        radio_link_rx(src, lqi, ed);
+    }
+#endif
     radiostatus.rxframe = usr_radio_receive_frame(len, radiostatus.rxframe,
                                                   lqi, ed, crc_fail);
 }
@@ -96,26 +361,169 @@ int8_t ed;
  */
 ISR(TRX24_RX_END_vect)
 {
+    ISR_PROF_ENTER(t0);
+    ENERGY_MARK_ON(ENERGY_ISR);
     radio_receive_frame();
+    PM_EVENT();
+    ENERGY_MARK_OFF(ENERGY_RX);
+    ENERGY_MARK_OFF(ENERGY_ISR);
+    ISR_PROF_EXIT(ISR_PROF_RADIO, t0);
 }
 
 ISR(TRX24_RX_START_vect)
 {
+    ENERGY_MARK_ON(ENERGY_RX);
+#if defined(RADIO_RX_ONTHEFLY)
+uint8_t len, i;
+
+    /*
+     * Follow the incoming frame in the frame buffer and copy each byte
+     * as soon as it got received. The transfer stops before the FCS,
+     * so RX_END fires shortly after and radio_receive_frame() only has
+     * to copy the trailing bytes. This keeps the CPU busy for one
+     * frame time, but the frame is complete right after RX_END.
+     */
+    rxotf_cnt = 0;
+#if defined(RADIO_RXPOOL)
+    if (rxpool.pool != NULL)
+    {
+        return;
+    }
+#endif
+    len = TST_RX_LENGTH;
+    if ((len > radiostatus.rxframesz) || (len < 3))
+    {
+        /* normal read at RX_END */
+        return;
+    }
+    len -= 2;
+    for (i = 0; i < len; i++)
+    {
+        DELAY_US(RADIO_RX_BYTE_US);
+        radiostatus.rxframe[i] = *(&TRXFBST + i);
+    }
+    rxotf_cnt = len;
+#else
     static volatile int x;
     x++;
+#endif
 }
 
+#if defined(RADIO_TXQUEUE)
+/**
+ * @brief Slot which is sent next, the oldest of the highest class.
+ */
+static uint8_t radio_txq_select(void)
+{
+uint8_t i, best = txq.head, age, best_age = 0;
+bool found = false;
+
+    for (i = 0; i < RADIO_TXQ_SLOTS; i++)
+    {
+        if (!txq.slot[i].used)
+        {
+            continue;
+        }
+        age = txq.seq - txq.slot[i].handle;
+        if (!found || (txq.slot[i].prio > txq.slot[best].prio) ||
+            ((txq.slot[i].prio == txq.slot[best].prio) && (age > best_age)))
+        {
+            best = i;
+            best_age = age;
+            found = true;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Start the transmission of the frame at txq.head.
+ */
+static void radio_txq_kick(void)
+{
+    if (radiostatus.state != txq.slot[txq.head].state)
+    {
+        radio_set_state(txq.slot[txq.head].state);
+    }
+    radio_send_frame(txq.slot[txq.head].len, txq.slot[txq.head].frm, 1);
+}
 
+/**
+ * @brief Complete the frame at the queue head in TX_END context.
+ *
+ * @return true if a retry or the next frame was started, so the
+ *         radio must stay in TX state.
+ */
+static bool radio_txq_done(uint8_t result, uint8_t trac)
+{
+    if (!txq.busy)
+    {
+        return false;
+    }
+    if ((result != TX_OK) &&
+        (txq.slot[txq.head].retries < txq.slot[txq.head].maxretries))
+    {
+        txq.slot[txq.head].retries++;
+        /* a frame of a higher class goes before the repetition */
+        txq.head = radio_txq_select();
+        radio_txq_kick();
+        return true;
+    }
+    if ((result == TX_OK) && txq.slot[txq.head].repeat)
+    {
+        txq.slot[txq.head].repeat--;
+        radio_txq_kick();
+        return true;
+    }
+    if (txq.cb != NULL)
+    {
+        txq.cb(txq.slot[txq.head].handle, result, trac,
+               txq.slot[txq.head].retries);
+    }
+    txq.slot[txq.head].used = false;
+    txq.cnt--;
+    if (txq.cnt == 0)
+    {
+        txq.busy = false;
+        return false;
+    }
+    txq.head = radio_txq_select();
+    radio_txq_kick();
+    return true;
+}
+#endif
 
 ISR(TRX24_TX_END_vect)
 {
+    ENERGY_MARK_OFF(ENERGY_TX);
+    PM_EVENT();
 
 #ifdef TRX_TX_PA_EI
     TRX_TX_PA_DI();
 #endif
+#if defined(RADIO_LPL)
+    radio_lpl_activity();
+#endif
 
     if (STATE_TX == radiostatus.state)
     {
+#if defined(RADIO_TSYNC)
+        radio_tsync_tx_done((uint8_t*)&TRXFBST + 1);
+#endif
+#if defined(RADIO_TDMA)
+        if (radio_tdma_tx_done())
+        {
+            radio_set_state(radiostatus.idle_state);
+            return;
+        }
+#endif
+#if defined(RADIO_TXQUEUE)
+        if (radio_txq_done(TX_OK, TRAC_SUCCESS))
+        {
+            return;
+        }
+        if (txq.cb == NULL)
+#endif
         usr_radio_tx_done(TX_OK);
         radio_set_state(radiostatus.idle_state);
     }
@@ -142,6 +550,42 @@ ISR(TRX24_TX_END_vect)
         default:
             result = TX_FAIL;
         }
+#if defined(RADIO_CSMA)
+        radio_csma_aret_done(trac_status);
+#endif
+#if defined(RADIO_TSYNC)
+        if (TX_OK == result)
+        {
+            radio_tsync_tx_done((uint8_t*)&TRXFBST + 1);
+        }
+#endif
+#if defined(RADIO_LINK)
+        {
+            uint16_t dst;
+            /* the frame buffer still holds the transmitted frame */
+            if (radio_link_frame_addr((uint8_t*)&TRXFBST + 1, 0, &dst))
+            {
+                radio_link_tx_done(dst, result);
+            }
+        }
+#endif
+#if defined(RADIO_TXQUEUE)
+        if (radio_txq_done(result, trac_status))
+        {
+            return;
+        }
+#endif
+#if defined(RADIO_INDIRECT)
+        /* TX_OK for the queue and the link statistics, only the
+         * application cares about the pending bit */
+        if (TRAC_SUCCESS_DATA_PENDING == trac_status)
+        {
+            result = TX_DATA_PENDING;
+        }
+#endif
+#if defined(RADIO_TXQUEUE)
+        if (txq.cb == NULL)
+#endif
         usr_radio_tx_done(result);
         radio_set_state(radiostatus.idle_state);
     }
@@ -152,39 +596,120 @@ ISR(TRX24_TX_END_vect)
 void radio_init(uint8_t * rxbuf, uint8_t rxbufsz)
 {
 trx_regval_t status;
+#if defined(RADIO_HANDOFF)
+radio_handoff_t rh;
+#endif
     /* init cpu peripherals and global IRQ enable */
     radiostatus.rxframe = rxbuf;
     radiostatus.rxframesz = rxbufsz;
     //trx_set_irq_handler(radio_irq_handler);
+    ENERGY_MARK_INIT();
 
     /* transceiver initialization */
     trx_io_init(0);
 
-    TRX_RESET_LOW();
-    TRX_SLPTR_LOW();
-    DELAY_US(TRX_RESET_TIME_US);
-    #if defined(CUSTOM_RESET_TIME_MS)
-        DELAY_MS(CUSTOM_RESET_TIME_MS);
-    #endif
-    TRX_RESET_HIGH();
-
-    /* disable IRQ and clear any pending IRQs */
-    trx_reg_write(RG_IRQ_MASK, 0);
-    trx_reg_read(RG_IRQ_STATUS);
-    trx_bit_write(SR_TRX_CMD, CMD_TRX_OFF);
-    DELAY_US(510);
-    status = trx_bit_read(SR_TRX_STATUS);
-    if (status != TRX_OFF)
+#if defined(RADIO_HANDOFF)
+    /* the bootloader left it set up in TRX_OFF, no reset needed */
+    if ((0 == get_radio_handoff(&rh)) && (TRX_OFF == trx_bit_read(SR_TRX_STATUS)))
     {
-        radio_error(STATE_SET_FAILED);
+        trx_reg_write(RG_IRQ_MASK, 0);
+        trx_reg_read(RG_IRQ_STATUS);
+    }
+    else
+#endif
+    {
+        TRX_RESET_LOW();
+        TRX_SLPTR_LOW();
+        DELAY_US(TRX_RESET_TIME_US);
+        #if defined(CUSTOM_RESET_TIME_MS)
+            DELAY_MS(CUSTOM_RESET_TIME_MS);
+        #endif
+        TRX_RESET_HIGH();
+
+        /* disable IRQ and clear any pending IRQs */
+        trx_reg_write(RG_IRQ_MASK, 0);
+        trx_reg_read(RG_IRQ_STATUS);
+        trx_bit_write(SR_TRX_CMD, CMD_TRX_OFF);
+        DELAY_US(510);
+        status = trx_bit_read(SR_TRX_STATUS);
+        if (status != TRX_OFF)
+        {
+            radio_error(STATE_SET_FAILED);
+        }
     }
     trx_bit_write(SR_TX_AUTO_CRC_ON, 1);
+#if defined(RADIO_RX_ONTHEFLY)
+    trx_reg_write(RG_IRQ_MASK, TRX_IRQ_RX_START | TRX_IRQ_RX_END | TRX_IRQ_TX_END);
+#else
     trx_reg_write(RG_IRQ_MASK, TRX_IRQ_RX_END | TRX_IRQ_TX_END);
+#endif
 
     radiostatus.state = STATE_OFF;
     radiostatus.idle_state = STATE_OFF;
+#if defined(RADIO_RXPOOL)
+    /* SFD time stamps for radio_rxmeta_t */
+    trx_tstamp_init();
+#endif
+}
+
+
+#if defined(RADIO_RXPOOL)
+void radio_rxpool_init(uint8_t *pmem, size_t memsz)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        rxpool.pool = buffer_pool_init(pmem, memsz,
+                                       sizeof(radio_rxmeta_t) + MAX_FRAME_SIZE);
+        buffer_queue_init(&rxpool.fifo);
+    }
+}
+
+buffer_t * radio_rxpool_get(void)
+{
+    return buffer_queue_pop(&rxpool.fifo);
+}
+
+void radio_rxpool_release(buffer_t *pbuf)
+{
+    buffer_free_atomic(rxpool.pool, pbuf);
+    radio_rx_drain();
+}
+
+bool radio_rx_held(void)
+{
+    return rx_held;
+}
+
+void radio_rx_drain(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (rx_held)
+        {
+            /* sets rx_held again if there is still no buffer */
+            rx_held = false;
+            radio_receive_frame();
+        }
+    }
 }
 
+/**
+ * Take or drop a held frame before the frame buffer is used otherwise.
+ */
+static void radio_rx_settle(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        radio_rx_drain();
+        if (rx_held)
+        {
+            rx_held = false;
+            radio_rx_release();
+            radio_error(RXPOOL_EMPTY);
+        }
+    }
+}
+#endif
 
 void radio_force_state(radio_state_t state)
 {
@@ -192,12 +717,86 @@ void radio_force_state(radio_state_t state)
     radio_set_state(state);
 }
 
+/**
+ * @brief Wait until the transceiver reached TRX_OFF after SLPTR went low.
+ *
+ * The oscillator typically needs 215us, polling it avoids
+ * a fixed worst case delay.
+ */
+static void radio_wake_wait(void)
+{
+uint8_t retries = 125;
+
+    while ((trx_bit_read(SR_TRX_STATUS) != TRX_OFF) && --retries)
+    {
+        DELAY_US(8);
+    }
+}
+
+#if defined(CMD_PREP_DEEP_SLEEP)
+static void radio_wake_save(void)
+{
+uint8_t i;
+
+    trx_parms_get(&radio_wake_cache.parms);
+    for (i = 0; i < sizeof(radio_wake_regs); i++)
+    {
+        radio_wake_cache.regs[i] =
+            trx_reg_read(pgm_read_byte(&radio_wake_regs[i]));
+    }
+}
+
+static void radio_wake_restore(void)
+{
+uint8_t i;
+
+    for (i = 0; i < sizeof(radio_wake_regs); i++)
+    {
+        trx_reg_write(pgm_read_byte(&radio_wake_regs[i]),
+                      radio_wake_cache.regs[i]);
+    }
+    trx_parms_set(&radio_wake_cache.parms);
+}
+#endif
+
 void radio_set_state(radio_state_t state)
 {
 volatile trx_regval_t cmd, expstatus, currstatus;
-uint8_t retries;
+uint16_t retries;
 bool do_sleep = false;
 
+#if defined(RADIO_RXPOOL)
+    radio_rx_settle();
+#endif
+    /* a frame in reception is given up */
+    ENERGY_MARK_OFF(ENERGY_RX);
+#if defined(CMD_PREP_DEEP_SLEEP)
+    if (STATE_DEEPSLEEP == state)
+    {
+        if (STATE_DEEPSLEEP == radiostatus.state)
+        {
+            return;
+        }
+        if (STATE_SLEEP == radiostatus.state)
+        {
+            TRX_SLPTR_LOW();
+            radio_wake_wait();
+        }
+        #ifdef TRX_TX_PA_EI
+            TRX_TX_PA_DI();
+        #endif
+        #ifdef TRX_RX_LNA_EI
+            TRX_RX_LNA_DI();
+        #endif
+        radio_wake_save();
+        trx_bit_write(SR_TRX_CMD, CMD_FORCE_TRX_OFF);
+        trx_bit_write(SR_TRX_CMD, CMD_PREP_DEEP_SLEEP);
+        TRX_SLPTR_HIGH();
+        radiostatus.state = state;
+        return;
+    }
+#endif
+
     switch(state)
     {
         case STATE_OFF:
@@ -271,18 +870,28 @@ bool do_sleep = false;
         }
         TRX_SLPTR_LOW();
         /*
-         * Give the xosc some time to start up.  Once it started, the
-         * SPI interface is operational, and the transceiver state can
-         * be polled.  The state reads as 0b0011111 ("state transition
-         * in progress") while the transceiver is still in its startup
-         * phase, which does not match any of the "expstatus" values,
-         * so polling just continues.
+         * Give the xosc some time to start up. The state reads as
+         * 0b0011111 ("state transition in progress") while the
+         * transceiver is still in its startup phase, so TRX_OFF
+         * is awaited instead of a fixed 500us delay.
          */
-        DELAY_US(500);
+        radio_wake_wait();
+    }
+#if defined(CMD_PREP_DEEP_SLEEP)
+    else if (STATE_DEEPSLEEP == radiostatus.state)
+    {
+        TRX_SLPTR_LOW();
+        radio_wake_wait();
+        radio_wake_restore();
     }
+#endif
     trx_bit_write(SR_TRX_CMD, cmd);
 
-    retries = 140;              /* enough to await an ongoing frame
+    /*
+     * Poll in short steps, the PLL locks within 110us (TRX_OFF to RX_ON),
+     * a coarse step would add up to one step of wake-up latency.
+     */
+    retries = 560;              /* enough to await an ongoing frame
                                  * reception */
     do
     {
@@ -292,7 +901,7 @@ bool do_sleep = false;
             break;
         }
         /** @todo must wait longer for 790/868/900 MHz radios */
-        DELAY_US(32);
+        DELAY_US(8);
     }
     while (--retries);
 
@@ -309,6 +918,41 @@ bool do_sleep = false;
     radiostatus.state = state;
 }
 
+#if defined(SR_ANT_DIV_EN)
+/**
+ * Set up the antenna switch at DIG1/DIG2, see @ref phyAntDiv.
+ * The preamble detector needs PDT_THRES 3 for antenna diversity.
+ */
+static bool radio_set_antdiv(uint8_t mode)
+{
+    switch (mode)
+    {
+        case RADIO_ANT_OFF:
+            trx_bit_write(SR_ANT_DIV_EN, 0);
+            trx_bit_write(SR_ANT_EXT_SW_EN, 0);
+            trx_bit_write(SR_PDT_THRES, 7);
+            break;
+        case RADIO_ANT_0:
+        case RADIO_ANT_1:
+            trx_bit_write(SR_ANT_DIV_EN, 0);
+            trx_bit_write(SR_ANT_CTRL, mode);
+            trx_bit_write(SR_ANT_EXT_SW_EN, 1);
+            trx_bit_write(SR_PDT_THRES, 7);
+            break;
+        case RADIO_ANT_DIVERSITY:
+            trx_bit_write(SR_ANT_CTRL, 1);
+            trx_bit_write(SR_ANT_EXT_SW_EN, 1);
+            trx_bit_write(SR_PDT_THRES, 3);
+            trx_bit_write(SR_ANT_DIV_EN, 1);
+            break;
+        default:
+            return false;
+    }
+    radiostatus.ant_div = mode;
+    return true;
+}
+#endif
+
 void radio_set_param(radio_attribute_t attr, radio_param_t parm)
 {
     switch (attr)
@@ -409,22 +1053,157 @@ void radio_set_param(radio_attribute_t attr, radio_param_t parm)
             break;
 #endif
 
+#if defined(SR_ANT_DIV_EN)
+        case phyAntDiv:
+            if (!radio_set_antdiv(parm.ant_div))
+            {
+                radio_error(SET_PARM_FAILED);
+            }
+            break;
+#endif
+#if defined(SR_RX_SAFE_MODE)
+        case phyRxProtect:
+            radiostatus.rx_protect = parm.rx_protect ? 1 : 0;
+            trx_bit_write(SR_RX_SAFE_MODE, radiostatus.rx_protect);
+            break;
+#endif
+#if defined(RG_TRX_RPC)
+        case phyRpc:
+            /* smart receiving timing 3 as recommended, bit 0 is reserved 1 */
+            radiostatus.rpc = parm.rpc & RADIO_RPC_ALL;
+            trx_reg_write(RG_TRX_RPC, 0xc1 | radiostatus.rpc);
+            break;
+#endif
+
         default:
             radio_error(SET_PARM_FAILED);
             break;
     }
 }
 
+uint8_t radio_get_antenna(void)
+{
+#if defined(SR_ANT_DIV_EN)
+    return trx_bit_read(SR_ANT_SEL);
+#else
+    return 0;
+#endif
+}
+
 
 void radio_send_frame(uint8_t len, uint8_t *frm, uint8_t compcrc)
 {
+#if defined(RADIO_LINK)
+uint16_t dst;
+
+    if (radio_link_frame_addr(frm, 0, &dst))
+    {
+        radio_link_apply(dst);
+    }
+#endif
+#if defined(RADIO_RXPOOL)
+    radio_rx_settle();
+#endif
     /* this block should be made atomic */
     trx_frame_write(len, frm);
     TRX_SLPTR_HIGH();
     TRX_SLPTR_LOW();
     /***********************************/
+    ENERGY_MARK_ON(ENERGY_TX);
 }
 
+#if defined(RADIO_TXQUEUE)
+void radio_txq_init(radio_txq_cb_t cb)
+{
+uint8_t idx;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        txq.cb = cb;
+        txq.head = txq.cnt = 0;
+        txq.busy = false;
+        for (idx = 0; idx < RADIO_TXQ_SLOTS; idx++)
+        {
+            txq.slot[idx].used = false;
+        }
+    }
+}
+
+static int16_t radio_txq_add(uint8_t len, uint8_t *frm, radio_state_t state,
+                             uint8_t retries, uint8_t repeat, uint8_t prio)
+{
+uint8_t idx, handle;
+bool kick = false;
+
+    if ((len < 2) || (len > MAX_FRAME_SIZE))
+    {
+        return -1;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if ((txq.cnt >= RADIO_TXQ_SLOTS) ||
+            ((prio == RADIO_TXQ_BULK) &&
+             (txq.cnt >= RADIO_TXQ_SLOTS - RADIO_TXQ_RESERVE)))
+        {
+            return -1;
+        }
+        for (idx = 0; txq.slot[idx].used; idx++)
+        {
+            /* there is a free one, cnt < RADIO_TXQ_SLOTS */
+        }
+        handle = txq.seq++;
+        txq.slot[idx].used = true;
+        txq.slot[idx].prio = prio;
+        txq.slot[idx].len = len;
+        txq.slot[idx].handle = handle;
+        txq.slot[idx].state = state;
+        txq.slot[idx].maxretries = retries;
+        txq.slot[idx].retries = 0;
+        txq.slot[idx].repeat = repeat;
+        /* the last 2 bytes are the FCS, generated by the transceiver */
+        memcpy(txq.slot[idx].frm, frm, len - 2);
+        txq.cnt++;
+        if (!txq.busy)
+        {
+            txq.head = idx;
+            txq.busy = kick = true;
+        }
+    }
+    if (kick)
+    {
+        /* TX_END can not occur while the queue was idle */
+        radio_txq_kick();
+    }
+    return handle;
+}
+
+int16_t radio_txq_put(uint8_t len, uint8_t *frm, radio_state_t state,
+                      uint8_t retries)
+{
+    return radio_txq_add(len, frm, state, retries, 0, RADIO_TXQ_NORMAL);
+}
+
+int16_t radio_txq_put_prio(uint8_t len, uint8_t *frm, radio_state_t state,
+                           uint8_t retries, uint8_t prio)
+{
+    return radio_txq_add(len, frm, state, retries, 0, prio);
+}
+
+int16_t radio_txq_strobe(uint8_t len, uint8_t *frm, radio_state_t state,
+                         uint8_t n)
+{
+    /* without ACK a frame only fails on a busy channel, the repeats
+     * count the copies that went out */
+    return radio_txq_add(len, frm, state, n, (STATE_TX == state) ? n : 0,
+                         RADIO_TXQ_NORMAL);
+}
+
+uint8_t radio_txq_pending(void)
+{
+    return txq.cnt;
+}
+#endif
+
 radio_cca_t radio_do_cca(void)
 {
 uint8_t tmp, trxcmd, trxstatus;
@@ -467,6 +1246,9 @@ radio_cca_t ret = RADIO_CCA_FREE;
     {
         ret = RADIO_CCA_BUSY;
     }
+#if defined(RADIO_CSMA)
+    radio_csma_cca_done(ret, trx_reg_read(RG_PHY_ED_LEVEL));
+#endif
 
     trx_reg_write(RG_TRX_STATE, trxcmd);
 
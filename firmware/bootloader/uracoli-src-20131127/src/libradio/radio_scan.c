@@ -0,0 +1,218 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Channel quality scan service.
+ *
+ * The channels of a mask are visited one after the other, driven by
+ * a timer. On each channel the energy is sampled (manual ED
+ * measurement) every @ref RADIO_SCAN_SAMPLE_MS, and received frames
+ * are counted by radio_scan_frame(), which is called from the RX_END
+ * handler. After the last channel the channels are ranked, the best
+ * (lowest score) first.
+ */
+
+/* === includes ============================================================ */
+#include <string.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "timer.h"
+
+#if defined(RADIO_SCAN)
+/* === macros ============================================================== */
+/** ED register value while a measurement is running */
+#define ED_INVALID (0xff)
+
+/* === globals ============================================================= */
+static struct
+{
+    radio_scan_result_t *res;
+    uint8_t nres;
+    uint8_t cur;
+    uint8_t nbsamples;
+    uint8_t sample;
+    channel_t orig_channel;
+    radio_scan_done_t *done;
+    volatile bool busy;
+} scan;
+
+/* === functions =========================================================== */
+
+/**
+ * @brief Score of a channel, lower is better.
+ *
+ * ED average and peak count in equally, each frame seen on the
+ * channel adds 2 points (foreign traffic is a collision risk too).
+ */
+static uint16_t scan_score(radio_scan_result_t *r)
+{
+uint16_t score;
+
+    score = (r->nbed ? (r->edsum / r->nbed) : 0) + r->edmax;
+    score += (r->frames > 127) ? 254 : 2 * r->frames;
+    return score;
+}
+
+static void scan_rank(void)
+{
+uint8_t i, j;
+radio_scan_result_t tmp;
+
+    for (i = 0; i < scan.nres; i++)
+    {
+        scan.res[i].score = scan_score(&scan.res[i]);
+    }
+    /* insertion sort, at most 16 channels */
+    for (i = 1; i < scan.nres; i++)
+    {
+        tmp = scan.res[i];
+        j = i;
+        while (j > 0 && scan.res[j - 1].score > tmp.score)
+        {
+            scan.res[j] = scan.res[j - 1];
+            j--;
+        }
+        scan.res[j] = tmp;
+    }
+}
+
+static time_t scan_timer(timer_arg_t t)
+{
+radio_scan_result_t *r = &scan.res[scan.cur];
+uint8_t ed;
+
+    ed = trx_reg_read(RG_PHY_ED_LEVEL);
+    if (ed != ED_INVALID)
+    {
+        r->edsum += ed;
+        r->nbed++;
+        if (ed > r->edmax)
+        {
+            r->edmax = ed;
+        }
+    }
+    if (++scan.sample >= scan.nbsamples)
+    {
+        scan.sample = 0;
+        if (++scan.cur >= scan.nres)
+        {
+            trx_bit_write(SR_CHANNEL, scan.orig_channel);
+            scan_rank();
+            scan.busy = false;
+            if (scan.done != NULL)
+            {
+                scan.done(scan.res, scan.nres);
+            }
+            return 0;
+        }
+        trx_bit_write(SR_CHANNEL, scan.res[scan.cur].channel);
+    }
+    /* start the next manual ED measurement */
+    trx_reg_write(RG_PHY_ED_LEVEL, 0);
+    return t;
+}
+
+uint8_t radio_scan_start(uint32_t chmask, uint16_t dwell_ms,
+                         radio_scan_result_t *res, radio_scan_done_t *done)
+{
+channel_t ch;
+uint8_t n = 0;
+
+    if (scan.busy)
+    {
+        return 0;
+    }
+    chmask &= TRX_SUPPORTED_CHANNELS;
+    for (ch = TRX_MIN_CHANNEL; ch <= TRX_MAX_CHANNEL; ch++)
+    {
+        if (chmask & (1UL << ch))
+        {
+            memset(&res[n], 0, sizeof(radio_scan_result_t));
+            res[n].channel = ch;
+            n++;
+        }
+    }
+    if (n == 0)
+    {
+        return 0;
+    }
+    scan.res = res;
+    scan.nres = n;
+    scan.cur = 0;
+    scan.sample = 0;
+    scan.nbsamples = (dwell_ms < RADIO_SCAN_SAMPLE_MS) ?
+                     1 : dwell_ms / RADIO_SCAN_SAMPLE_MS;
+    scan.done = done;
+    scan.orig_channel = trx_bit_read(SR_CHANNEL);
+    trx_bit_write(SR_CHANNEL, res[0].channel);
+    radio_set_state(STATE_RX);
+    trx_reg_write(RG_PHY_ED_LEVEL, 0);
+    scan.busy = true;
+    if (NONE_TIMER == timer_start(scan_timer, MSEC(RADIO_SCAN_SAMPLE_MS),
+                                  MSEC(RADIO_SCAN_SAMPLE_MS)))
+    {
+        trx_bit_write(SR_CHANNEL, scan.orig_channel);
+        scan.busy = false;
+        return 0;
+    }
+    return n;
+}
+
+bool radio_scan_busy(void)
+{
+    return scan.busy;
+}
+
+void radio_scan_frame(uint8_t crc_fail, uint8_t lqi)
+{
+radio_scan_result_t *r;
+
+    if (!scan.busy)
+    {
+        return;
+    }
+    r = &scan.res[scan.cur];
+    if (r->frames < 0xff)
+    {
+        r->frames++;
+    }
+    if (!crc_fail)
+    {
+        r->lqisum += lqi;
+        if (r->crc_ok < 0xff)
+        {
+            r->crc_ok++;
+        }
+    }
+}
+#endif /* defined(RADIO_SCAN) */
+/* EOF */
@@ -0,0 +1,381 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+/**
+ * @file
+ * @brief TDMA slots on the synchronised network time.
+ *
+ * Slot n of the superframe starts at a global time which is a multiple
+ * of @ref RADIO_TDMA_SLOT_TICKS, with n = (global / RADIO_TDMA_SLOT_TICKS)
+ * % @ref RADIO_TDMA_SLOTS. Both are powers of 2, so the slots stay
+ * aligned across the wrap of the 32 bit time. Compare unit 2 of the
+ * symbol counter fires @ref RADIO_TDMA_GUARD ticks after each slot
+ * boundary, converted to local time by radio_tsync_local(). The local
+ * counter never jumps, a compare value stays valid while the global
+ * time is corrected.
+ *
+ * The coordinator sends the schedule in slot 0, takes the requests and
+ * watches the SFD times of the received frames: a slot in which its
+ * owner sent nothing for @ref RADIO_TDMA_IDLE superframes is free again.
+ */
+
+/* === includes ============================================================ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "p2p_protocol.h"
+
+#if defined(RADIO_TDMA)
+/* === macros ============================================================== */
+#if (RADIO_TDMA_SLOTS & (RADIO_TDMA_SLOTS - 1)) || (RADIO_TDMA_SLOTS > 32)
+# error "RADIO_TDMA_SLOTS must be a power of 2 up to 32"
+#endif
+#if (RADIO_TDMA_SLOT_TICKS & (RADIO_TDMA_SLOT_TICKS - 1)) != 0
+# error "RADIO_TDMA_SLOT_TICKS must be a power of 2"
+#endif
+#define TDMA_FREE (0xffff)
+#define TDMA_CONTENTION (RADIO_TDMA_SLOTS - 1)
+#define TDMA_SLOT(g) (((g) / RADIO_TDMA_SLOT_TICKS) % RADIO_TDMA_SLOTS)
+/** p2p_tdma_sched_t and FCS */
+#define TDMA_SCHED_SIZE (sizeof(p2p_tdma_sched_t) + 2 * RADIO_TDMA_SLOTS + 2)
+
+/* === globals ============================================================= */
+static struct
+{
+    uint16_t pan;
+    uint16_t addr;
+    uint16_t coord;
+    uint16_t owner[RADIO_TDMA_SLOTS];
+    uint8_t age[RADIO_TDMA_SLOTS];  /* coordinator: superframes unused */
+    uint32_t mine;                  /* bit n: slot n is ours */
+    uint8_t sched_age;              /* superframes without schedule */
+    uint8_t seq;
+    uint8_t *frm;
+    uint8_t len;
+    volatile bool busy;
+    bool sched_tx;
+    bool running;
+} tdma;
+
+static uint8_t sched_frm[TDMA_SCHED_SIZE];
+
+/* === functions =========================================================== */
+
+/** compare unit 2 to the next slot boundary */
+static void tdma_next(void)
+{
+uint32_t g, t;
+
+    g = radio_tsync_global(trx_tstamp_now());
+    g = (g / RADIO_TDMA_SLOT_TICKS + 1) * RADIO_TDMA_SLOT_TICKS;
+    t = radio_tsync_local(g + RADIO_TDMA_GUARD);
+    if ((int32_t)(t - trx_tstamp_now()) < RADIO_TDMA_GUARD)
+    {
+        t += RADIO_TDMA_SLOT_TICKS;
+    }
+    /* the compare value is taken over with the write of the low byte */
+    SCOCR2HH = (uint8_t)(t >> 24);
+    SCOCR2HL = (uint8_t)(t >> 16);
+    SCOCR2LH = (uint8_t)(t >> 8);
+    SCOCR2LL = (uint8_t)t;
+    SCIRQS = _BV(IRQSCP2);
+    SCIRQM |= _BV(IRQMCP2);
+}
+
+/** the pending frame lost its slot */
+static void tdma_drop(void)
+{
+    if (tdma.busy && (tdma.mine == 0))
+    {
+        tdma.busy = false;
+        usr_radio_tx_done(TX_FAIL);
+    }
+}
+
+static void tdma_set_mine(void)
+{
+uint8_t i;
+
+    tdma.mine = 0;
+    for (i = 1; i < TDMA_CONTENTION; i++)
+    {
+        if (tdma.owner[i] == tdma.addr)
+        {
+            tdma.mine |= 1UL << i;
+        }
+    }
+    tdma_drop();
+}
+
+static void tdma_clear(void)
+{
+uint8_t i;
+
+    for (i = 0; i < RADIO_TDMA_SLOTS; i++)
+    {
+        tdma.owner[i] = TDMA_FREE;
+        tdma.age[i] = 0;
+    }
+    tdma.mine = 0;
+}
+
+/** coordinator: age the slots and send the schedule */
+static void tdma_schedule(void)
+{
+p2p_tdma_sched_t *s = (p2p_tdma_sched_t *)sched_frm;
+uint8_t i;
+
+    for (i = 1; i < TDMA_CONTENTION; i++)
+    {
+        if ((tdma.owner[i] != TDMA_FREE) && (++tdma.age[i] > RADIO_TDMA_IDLE))
+        {
+            tdma.owner[i] = TDMA_FREE;
+        }
+    }
+    s->hdr.fcf = 0x8841;
+    s->hdr.seq = tdma.seq++;
+    s->hdr.pan = tdma.pan;
+    s->hdr.dst = 0xffff;
+    s->hdr.src = tdma.addr;
+    s->hdr.cmd = P2P_TDMA_SCHED;
+    s->slots = RADIO_TDMA_SLOTS;
+    for (i = 0; i < RADIO_TDMA_SLOTS; i++)
+    {
+        s->owner[i] = tdma.owner[i];
+    }
+    tdma.sched_tx = true;
+    radio_set_state(STATE_TX);
+    radio_send_frame(TDMA_SCHED_SIZE, sched_frm, 1);
+}
+
+/** coordinator: grant or take back slots */
+static void tdma_assign(uint16_t src, uint8_t nslots)
+{
+uint8_t i, n = 0;
+
+    for (i = 1; i < TDMA_CONTENTION; i++)
+    {
+        if (tdma.owner[i] == src)
+        {
+            if (n < nslots)
+            {
+                n++;
+            }
+            else
+            {
+                tdma.owner[i] = TDMA_FREE;
+            }
+        }
+    }
+    for (i = 1; (i < TDMA_CONTENTION) && (n < nslots); i++)
+    {
+        if (tdma.owner[i] == TDMA_FREE)
+        {
+            tdma.owner[i] = src;
+            tdma.age[i] = 0;
+            n++;
+        }
+    }
+}
+
+void radio_tdma_init(uint16_t pan_id, uint16_t short_addr, uint16_t coord)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tdma_clear();
+        tdma.pan = pan_id;
+        tdma.addr = short_addr;
+        tdma.coord = coord;
+        tdma.sched_age = RADIO_TDMA_IDLE;
+        tdma.busy = false;
+        tdma.sched_tx = false;
+        tdma.running = true;
+        tdma_next();
+    }
+}
+
+uint8_t radio_tdma_request(uint8_t *frm, uint8_t nslots)
+{
+p2p_tdma_req_t *r = (p2p_tdma_req_t *)frm;
+
+    r->hdr.fcf = 0x8861;
+    r->hdr.seq = tdma.seq++;
+    r->hdr.pan = tdma.pan;
+    r->hdr.dst = tdma.coord;
+    r->hdr.src = tdma.addr;
+    r->hdr.cmd = P2P_TDMA_REQ;
+    r->nslots = nslots;
+    return RADIO_TDMA_REQUEST_SIZE;
+}
+
+int8_t radio_tdma_send(uint8_t len, uint8_t *frm)
+{
+int8_t ret = -1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!tdma.busy && (tdma.mine != 0))
+        {
+            tdma.frm = frm;
+            tdma.len = len;
+            tdma.busy = true;
+            ret = 0;
+        }
+    }
+    return ret;
+}
+
+bool radio_tdma_busy(void)
+{
+    return tdma.busy;
+}
+
+uint8_t radio_tdma_slots(void)
+{
+uint8_t i, n = 0;
+uint32_t m;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        m = tdma.mine;
+    }
+    for (i = 0; i < RADIO_TDMA_SLOTS; i++)
+    {
+        if (m & (1UL << i))
+        {
+            n++;
+        }
+    }
+    return n;
+}
+
+bool radio_tdma_contention(void)
+{
+    if (!tdma.running || (tdma.sched_age >= RADIO_TDMA_IDLE))
+    {
+        return true;
+    }
+    return TDMA_SLOT(radio_tsync_global(trx_tstamp_now())) == TDMA_CONTENTION;
+}
+
+bool radio_tdma_rx(uint8_t len, uint8_t *frm, uint32_t sfd)
+{
+p2p_hdr_t *hdr = (p2p_hdr_t *)frm;
+uint8_t i;
+
+    if (!tdma.running || (len < sizeof(p2p_hdr_t) + 2))
+    {
+        return false;
+    }
+    /* short addresses with PAN ID compression */
+    if ((hdr->fcf & 0xcc40) != 0x8840)
+    {
+        return false;
+    }
+    if (tdma.coord == tdma.addr)
+    {
+        if ((hdr->cmd == P2P_TDMA_REQ) && (hdr->dst == tdma.addr) &&
+            (len >= RADIO_TDMA_REQUEST_SIZE))
+        {
+            tdma_assign(hdr->src, ((p2p_tdma_req_t *)frm)->nslots);
+            return true;
+        }
+        i = TDMA_SLOT(radio_tsync_global(sfd));
+        if (tdma.owner[i] == hdr->src)
+        {
+            tdma.age[i] = 0;
+        }
+        return false;
+    }
+    if ((hdr->cmd == P2P_TDMA_SCHED) && (hdr->src == tdma.coord) &&
+        (hdr->pan == tdma.pan) &&
+        (((p2p_tdma_sched_t *)frm)->slots == RADIO_TDMA_SLOTS) &&
+        (len >= TDMA_SCHED_SIZE))
+    {
+        for (i = 0; i < RADIO_TDMA_SLOTS; i++)
+        {
+            tdma.owner[i] = ((p2p_tdma_sched_t *)frm)->owner[i];
+        }
+        tdma_set_mine();
+        tdma.sched_age = 0;
+        return true;
+    }
+    return false;
+}
+
+bool radio_tdma_tx_done(void)
+{
+    if (tdma.sched_tx)
+    {
+        tdma.sched_tx = false;
+        return true;
+    }
+    return false;
+}
+
+ISR(SCNT_CMP2_vect)
+{
+uint8_t slot;
+
+    slot = TDMA_SLOT(radio_tsync_global(trx_tstamp_now()));
+    tdma_next();
+    if (!radio_tsync_synced())
+    {
+        return;
+    }
+    if (0 == slot)
+    {
+        if (tdma.coord == tdma.addr)
+        {
+            tdma_schedule();
+        }
+        else if (tdma.sched_age < RADIO_TDMA_IDLE)
+        {
+            tdma.sched_age++;
+        }
+        else
+        {
+            /* no schedule, the coordinator may have given our slots away */
+            tdma.mine = 0;
+            tdma_drop();
+        }
+    }
+    else if (tdma.busy && (tdma.mine & (1UL << slot)))
+    {
+        tdma.busy = false;
+        radio_set_state(STATE_TX);
+        radio_send_frame(tdma.len, tdma.frm, 1);
+    }
+}
+#endif /* defined(RADIO_TDMA) */
+/* EOF */
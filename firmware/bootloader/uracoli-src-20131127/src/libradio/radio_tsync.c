@@ -0,0 +1,384 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+
+/**
+ * @file
+ * @brief Network time synchronisation with flooded beacons.
+ *
+ * The scheme follows FTSP: the node with the lowest short address is
+ * root, its clock is the global time. Synchronised nodes broadcast
+ * @ref P2P_TSYNC beacons, each with the global time at the SFD of the
+ * previous beacon of the sender (the transceiver stamps the SFD only
+ * while the frame goes out). A receiver pairs it with its own SFD stamp
+ * of that beacon, which gives one reference point (local, global).
+ *
+ * The last @ref RADIO_TSYNC_ENTRIES points feed a linear regression,
+ * the offset at the mean local time and the skew of the two clocks.
+ * The skew is kept as Q24 fraction, 0.06ppm resolution.
+ *
+ * The root counts its beacons in rootseq, a point is only taken if it
+ * derives from a newer round than the last one, so that old time can't
+ * travel in a loop through the network.
+ */
+
+/* === includes ============================================================ */
+#include <util/atomic.h>
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "p2p_protocol.h"
+
+#if defined(RADIO_TSYNC)
+/* === macros ============================================================== */
+#if !defined(TRX_IF_RFA1)
+# error "RADIO_TSYNC needs the symbol counter of the RFA1/RFR2"
+#endif
+#define TSYNC_NOROOT (0xffff)
+/** outliers in a row after which the reference points are dropped */
+#define TSYNC_MAX_ERRORS (3)
+
+/* === globals ============================================================= */
+static struct
+{
+    uint16_t src;
+    uint16_t root;
+    uint8_t rootseq;
+    uint8_t txseq;
+    uint32_t sfd;
+    bool used;
+} peers[RADIO_TSYNC_PEERS];
+static uint8_t peer_next;
+
+static struct
+{
+    uint32_t local[RADIO_TSYNC_ENTRIES];
+    uint32_t offset[RADIO_TSYNC_ENTRIES]; /* global - local */
+    uint8_t cnt;
+    uint8_t next;
+    uint8_t errors;
+    /* regression: global = local + offset + skew * (local - base) */
+    uint32_t base;
+    uint32_t base_offset;
+    int32_t skew;
+} reg;
+
+static struct
+{
+    uint16_t pan;
+    uint16_t addr;
+    uint16_t root;
+    uint8_t rootseq;
+    bool seqvalid;     /* rootseq is of an accepted point */
+    uint8_t heartbeats;
+    uint8_t seq;       /* MAC sequence number and txseq of the beacons */
+    uint8_t prevseq;
+    uint32_t prevtime;
+    bool prevvalid;
+    bool running;
+} ts;
+
+/* === functions =========================================================== */
+
+static void tsync_clear(void)
+{
+uint8_t i;
+
+    reg.cnt = 0;
+    reg.next = 0;
+    reg.errors = 0;
+    for (i = 0; i < RADIO_TSYNC_PEERS; i++)
+    {
+        peers[i].used = false;
+    }
+}
+
+static uint32_t tsync_global(uint32_t local)
+{
+int32_t dt;
+
+    dt = (int32_t)(local - reg.base);
+    return local + reg.base_offset + (int32_t)(((int64_t)reg.skew * dt) >> 24);
+}
+
+/** regression over the reference points, differences to the first one
+ * keep the sums small */
+static void tsync_regression(void)
+{
+uint8_t i, n;
+int32_t dl, doff;
+int64_t sl, so, num, den;
+
+    n = reg.cnt;
+    sl = 0;
+    so = 0;
+    for (i = 0; i < n; i++)
+    {
+        sl += (int32_t)(reg.local[i] - reg.local[0]);
+        so += (int32_t)(reg.offset[i] - reg.offset[0]);
+    }
+    sl /= n;
+    so /= n;
+    num = 0;
+    den = 0;
+    for (i = 0; i < n; i++)
+    {
+        dl = (int32_t)(reg.local[i] - reg.local[0]) - (int32_t)sl;
+        doff = (int32_t)(reg.offset[i] - reg.offset[0]) - (int32_t)so;
+        num += (int64_t)dl * doff;
+        den += (int64_t)dl * dl;
+    }
+    reg.base = reg.local[0] + (int32_t)sl;
+    reg.base_offset = reg.offset[0] + (int32_t)so;
+    reg.skew = 0;
+    /* |num| beyond 2^38 means a skew far off any crystal */
+    if ((den != 0) && (num < (1LL << 38)) && (num > -(1LL << 38)))
+    {
+        reg.skew = (int32_t)((num * (1LL << 24)) / den);
+    }
+}
+
+static void tsync_add_point(uint32_t local, uint32_t global)
+{
+int32_t err;
+
+    if (reg.cnt >= RADIO_TSYNC_MIN_ENTRIES)
+    {
+        err = (int32_t)(global - tsync_global(local));
+        if ((err > RADIO_TSYNC_ERROR_LIMIT) || (err < -RADIO_TSYNC_ERROR_LIMIT))
+        {
+            if (++reg.errors > TSYNC_MAX_ERRORS)
+            {
+                /* the root has changed its time, start over */
+                tsync_clear();
+            }
+            return;
+        }
+    }
+    reg.errors = 0;
+    reg.local[reg.next] = local;
+    reg.offset[reg.next] = global - local;
+    reg.next = (reg.next + 1) % RADIO_TSYNC_ENTRIES;
+    if (reg.cnt < RADIO_TSYNC_ENTRIES)
+    {
+        reg.cnt++;
+    }
+    tsync_regression();
+}
+
+void radio_tsync_init(uint16_t pan_id, uint16_t short_addr)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        tsync_clear();
+        peer_next = 0;
+        /* no points yet, the global time is the local time */
+        reg.base = 0;
+        reg.base_offset = 0;
+        reg.skew = 0;
+        ts.pan = pan_id;
+        ts.addr = short_addr;
+        ts.root = TSYNC_NOROOT;
+        ts.seqvalid = false;
+        ts.heartbeats = 0;
+        ts.prevvalid = false;
+        ts.running = true;
+    }
+}
+
+bool radio_tsync_rx(uint8_t len, uint8_t *frm, uint32_t sfd)
+{
+p2p_tsync_t *b = (p2p_tsync_t *)frm;
+uint8_t i;
+
+    if (!ts.running || (len < RADIO_TSYNC_BEACON_SIZE) ||
+        (b->hdr.cmd != P2P_TSYNC) || (b->hdr.fcf != 0x8841) ||
+        (b->hdr.pan != ts.pan))
+    {
+        return false;
+    }
+    if ((b->root < ts.root) &&
+        ((ts.root != ts.addr) || (ts.heartbeats > RADIO_TSYNC_ROOT_TIMEOUT)))
+    {
+        /* a node with lower address is root, its time counts from now */
+        ts.root = b->root;
+        ts.seqvalid = false;
+        ts.heartbeats = 0;
+        tsync_clear();
+    }
+    else if (b->root != ts.root)
+    {
+        /* a higher root follows our beacons soon, and a new root
+         * ignores the lower one for a while: its beacons may still
+         * circulate after it went away */
+        return true;
+    }
+    for (i = 0; i < RADIO_TSYNC_PEERS; i++)
+    {
+        if (peers[i].used && peers[i].src == b->hdr.src)
+        {
+            break;
+        }
+    }
+    if (i == RADIO_TSYNC_PEERS)
+    {
+        i = peer_next;
+        peer_next = (peer_next + 1) % RADIO_TSYNC_PEERS;
+    }
+    else if (peers[i].txseq == b->txseq)
+    {
+        /* one more copy, the first one was stamped */
+        return true;
+    }
+    else if ((ts.root != ts.addr) && (peers[i].root == b->root) &&
+             (b->prevseq == peers[i].txseq) && (b->prevseq != b->txseq) &&
+             (!ts.seqvalid || (int8_t)(peers[i].rootseq - ts.rootseq) > 0))
+    {
+        tsync_add_point(peers[i].sfd, b->prevtime);
+        ts.rootseq = peers[i].rootseq;
+        ts.seqvalid = true;
+        ts.heartbeats = 0;
+    }
+    peers[i].used = true;
+    peers[i].src = b->hdr.src;
+    peers[i].root = b->root;
+    peers[i].rootseq = b->rootseq;
+    peers[i].txseq = b->txseq;
+    peers[i].sfd = sfd;
+    return true;
+}
+
+uint8_t radio_tsync_beacon(uint8_t *frm)
+{
+p2p_tsync_t *b = (p2p_tsync_t *)frm;
+uint8_t ret = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (ts.heartbeats < 0xff)
+        {
+            ts.heartbeats++;
+        }
+        if ((ts.root != ts.addr) && (ts.heartbeats > RADIO_TSYNC_ROOT_TIMEOUT))
+        {
+            /* the root is gone, keep on with the own estimate */
+            ts.root = ts.addr;
+            ts.seqvalid = true;
+            ts.heartbeats = 0;
+        }
+        if (ts.root == ts.addr)
+        {
+            ts.rootseq++;
+        }
+        if (ts.running &&
+            ((ts.root == ts.addr) || (reg.cnt >= RADIO_TSYNC_MIN_ENTRIES)))
+        {
+            b->hdr.fcf = 0x8841;
+            b->hdr.seq = ts.seq;
+            b->hdr.pan = ts.pan;
+            b->hdr.dst = 0xffff;
+            b->hdr.src = ts.addr;
+            b->hdr.cmd = P2P_TSYNC;
+            b->root = ts.root;
+            b->rootseq = ts.rootseq;
+            b->txseq = ts.seq;
+            b->prevseq = ts.prevvalid ? ts.prevseq : ts.seq;
+            b->prevtime = ts.prevtime;
+            ts.seq++;
+            ret = RADIO_TSYNC_BEACON_SIZE;
+        }
+    }
+    return ret;
+}
+
+void radio_tsync_tx_done(uint8_t *frm)
+{
+p2p_tsync_t *b = (p2p_tsync_t *)frm;
+
+    if (ts.running && (b->hdr.cmd == P2P_TSYNC) && (b->hdr.src == ts.addr) &&
+        (b->hdr.pan == ts.pan) && (!ts.prevvalid || ts.prevseq != b->txseq))
+    {
+        ts.prevtime = tsync_global(trx_tstamp_sfd());
+        ts.prevseq = b->txseq;
+        ts.prevvalid = true;
+    }
+}
+
+uint32_t radio_tsync_global(uint32_t local)
+{
+uint32_t ret;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = tsync_global(local);
+    }
+    return ret;
+}
+
+uint32_t radio_tsync_local(uint32_t global)
+{
+uint32_t ret;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        /* the skew is tiny, one step with the first guess is enough */
+        ret = global - reg.base_offset;
+        ret = global - (tsync_global(ret) - ret);
+    }
+    return ret;
+}
+
+uint32_t radio_tsync_now_us(void)
+{
+    return radio_tsync_global(trx_tstamp_now()) * TRX_TSTAMP_SYMBOL_US;
+}
+
+bool radio_tsync_synced(void)
+{
+bool ret;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = (ts.root == ts.addr) || (reg.cnt >= RADIO_TSYNC_MIN_ENTRIES);
+    }
+    return ret;
+}
+
+uint16_t radio_tsync_root(void)
+{
+uint16_t ret;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ts.root;
+    }
+    return ret;
+}
+#endif /* defined(RADIO_TSYNC) */
+/* EOF */
@@ -0,0 +1,168 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Driver for the AES security module of ATmega128RFA1/ATmega256RFR2.
+ *
+ * The engine needs about 24us for one 128 bit block. The encryption
+ * key is loaded into AES_KEY, for decryption the last round key is
+ * needed, which is read back from AES_KEY after one encryption run.
+ */
+
+/* === includes ========================================== */
+#include <string.h>
+#include <avr/io.h>
+#include "board.h"
+#include "transceiver.h"
+
+#if defined(TRX_IF_RFA1)
+
+/* === macros ============================================ */
+#define AES_DIR_ENC  (0)
+#define AES_DIR_DEC  _BV(AES_DIR)
+#define AES_MODE_ECB (0)
+#define AES_MODE_CBC _BV(AES_MODE)
+
+/* === globals =========================================== */
+static uint8_t aes_key[TRX_AES_BLOCKSIZE];
+static uint8_t aes_deckey[TRX_AES_BLOCKSIZE];
+/** direction the key currently loaded in AES_KEY was made for */
+static uint8_t aes_keydir;
+
+/* === functions ========================================= */
+
+static void aes_load_key(uint8_t dir)
+{
+uint8_t i, *pkey;
+
+    pkey = (dir == AES_DIR_ENC) ? aes_key : aes_deckey;
+    for (i = 0; i < TRX_AES_BLOCKSIZE; i++)
+    {
+        AES_KEY = pkey[i];
+    }
+    aes_keydir = dir;
+}
+
+static uint8_t aes_run(uint8_t ctrl, uint8_t *blk)
+{
+uint8_t i;
+
+    if (aes_keydir != (ctrl & AES_DIR_DEC))
+    {
+        aes_load_key(ctrl & AES_DIR_DEC);
+    }
+    AES_CTRL = ctrl;
+    for (i = 0; i < TRX_AES_BLOCKSIZE; i++)
+    {
+        AES_STATE = blk[i];
+    }
+    AES_CTRL = ctrl | _BV(AES_REQUEST);
+    while ((AES_STATUS & (_BV(AES_DONE) | _BV(AES_ER))) == 0)
+    {
+        /* about 24us */
+    }
+    if (AES_STATUS & _BV(AES_ER))
+    {
+        return 1;
+    }
+    for (i = 0; i < TRX_AES_BLOCKSIZE; i++)
+    {
+        blk[i] = AES_STATE;
+    }
+    return 0;
+}
+
+void trx_aes_setkey(const uint8_t *key)
+{
+uint8_t i, dummy[TRX_AES_BLOCKSIZE];
+
+    memcpy(aes_key, key, TRX_AES_BLOCKSIZE);
+    aes_load_key(AES_DIR_ENC);
+    /* one encryption run leaves the decryption key in AES_KEY */
+    memset(dummy, 0, sizeof(dummy));
+    aes_run(AES_MODE_ECB | AES_DIR_ENC, dummy);
+    for (i = 0; i < TRX_AES_BLOCKSIZE; i++)
+    {
+        aes_deckey[i] = AES_KEY;
+    }
+    aes_load_key(AES_DIR_ENC);
+}
+
+uint8_t trx_aes_ecb_encrypt(uint8_t *blk)
+{
+    return aes_run(AES_MODE_ECB | AES_DIR_ENC, blk);
+}
+
+uint8_t trx_aes_ecb_decrypt(uint8_t *blk)
+{
+    return aes_run(AES_MODE_ECB | AES_DIR_DEC, blk);
+}
+
+uint8_t trx_aes_cbc_encrypt(uint8_t *data, uint8_t nblocks, uint8_t *iv)
+{
+uint8_t i, ret = 0;
+
+    for (i = 0; i < TRX_AES_BLOCKSIZE; i++)
+    {
+        data[i] ^= iv[i];
+    }
+    /* the first block is done in ECB mode, all further blocks are
+     * XORed by hardware with the previous result in AES_STATE */
+    ret |= aes_run(AES_MODE_ECB | AES_DIR_ENC, data);
+    while (--nblocks)
+    {
+        data += TRX_AES_BLOCKSIZE;
+        ret |= aes_run(AES_MODE_CBC | AES_DIR_ENC, data);
+    }
+    memcpy(iv, data, TRX_AES_BLOCKSIZE);
+    return ret;
+}
+
+uint8_t trx_aes_cbc_decrypt(uint8_t *data, uint8_t nblocks, uint8_t *iv)
+{
+uint8_t i, ret = 0;
+uint8_t cblk[TRX_AES_BLOCKSIZE];
+
+    /* no CBC decryption in hardware, XOR is done here */
+    while (nblocks--)
+    {
+        memcpy(cblk, data, TRX_AES_BLOCKSIZE);
+        ret |= aes_run(AES_MODE_ECB | AES_DIR_DEC, data);
+        for (i = 0; i < TRX_AES_BLOCKSIZE; i++)
+        {
+            data[i] ^= iv[i];
+        }
+        memcpy(iv, cblk, TRX_AES_BLOCKSIZE);
+        data += TRX_AES_BLOCKSIZE;
+    }
+    return ret;
+}
+#endif /* if defined(TRX_IF_RFA1) */
+/* EOF */
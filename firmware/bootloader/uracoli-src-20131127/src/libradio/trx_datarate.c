@@ -102,7 +102,7 @@ uint8_t rate_type, rate_code;
     return rate_type;
 }
 
-#elif RADIO_TYPE == RADIO_AT86RF231
+#elif RADIO_TYPE == RADIO_AT86RF231 || defined(TRX_IF_RFA1)
 
 uint8_t trx_set_datarate(uint8_t rate_type)
 {
@@ -195,6 +195,15 @@ uint8_t trx_get_number_datarates(void)
     return sizeof(rate_hshtable)/sizeof(uint8_t);
 }
 
+uint8_t trx_get_datarate_hash(uint8_t idx)
+{
+    if (idx < sizeof(rate_hshtable)/sizeof(uint8_t))
+    {
+        return pgm_read_byte(rate_hshtable+idx);
+    }
+    return RATE_NONE;
+}
+
 
 void *  trx_get_datarate_str_p(uint8_t idx)
 {
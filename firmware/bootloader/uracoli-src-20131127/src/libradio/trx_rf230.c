@@ -76,6 +76,7 @@
 #include <stdlib.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #if !defined(TRX_IF_RFA1)
 
@@ -133,5 +134,40 @@ trx_regval_t trx_reg_read(uint8_t addr)
     return (trx_regval_t)val;
 }
 
+void trx_reg_seq(const trx_regseq_t *seq, uint8_t n)
+{
+uint8_t sreg_save, addr, mask, val;
+
+    sreg_save = SREG;
+    cli();
+    while (n--)
+    {
+        addr = pgm_read_byte(&seq->addr) & TRX_CMD_RADDR_MASK;
+        mask = pgm_read_byte(&seq->mask);
+        val = pgm_read_byte(&seq->value);
+        seq++;
+        if (mask != 0xff)
+        {
+            /* read-modify-write, expanded trx_reg_read() */
+            SPI_SELN_LOW();
+            SPI_DATA_REG = TRX_CMD_RR | addr;
+            SPI_WAITFOR();
+            SPI_DATA_REG = addr;
+            SPI_WAITFOR();
+            val = (SPI_DATA_REG & ~mask) | (val & mask);
+            SPI_SELN_HIGH();
+        }
+        {
+            SPI_SELN_LOW();
+            SPI_DATA_REG = TRX_CMD_RW | addr;
+            SPI_WAITFOR();
+            SPI_DATA_REG = val;
+            SPI_WAITFOR();
+            SPI_SELN_HIGH();
+        }
+    }
+    SREG = sreg_save;
+}
+
 #endif /* if !defined(TRX_IF_RFA1) */
 /* EOF */
@@ -107,5 +107,30 @@ uint8_t length = 0;
     return length;
 }
 
+uint8_t trx_frame_read_head(uint8_t *data, uint8_t n)
+{
+uint8_t length, i;
+
+    SPI_SELN_LOW();
+    SPI_DATA_REG = TRX_CMD_FR;
+    SPI_WAITFOR();
+    SPI_DATA_REG = 0;
+    SPI_WAITFOR();
+    length = SPI_DATA_REG;
+    if (n > length)
+    {
+        n = length;
+    }
+    for (i = 0; i < n; i++)
+    {
+        SPI_DATA_REG = 0;
+        SPI_WAITFOR();
+        *data++ = SPI_DATA_REG;
+    }
+    /* /SEL high ends the frame buffer access, the rest is not clocked out */
+    SPI_SELN_HIGH();
+    return length;
+}
+
 #endif /* #if !defined(TRX_IF_RFA1) */
 /* EOF */
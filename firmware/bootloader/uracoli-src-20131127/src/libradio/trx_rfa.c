@@ -42,6 +42,7 @@
 #include <string.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
 
 #if defined(TRX_IF_RFA1)
 
@@ -65,29 +66,56 @@ void trx_io_init (uint8_t spirate)
 void trx_set_irq_handler(trx_irq_handler_t irqhandler)
 {}
 
-void trx_reg_write(trx_regaddr_t addr, trx_regval_t val)
+void trx_reg_seq(const trx_regseq_t *seq, uint8_t n)
 {
-    *(uint8_t*)(TRX_REGISTER_BASEADDR + addr) = val;
+uint8_t mask, val;
+volatile uint8_t *preg;
+
+    while (n--)
+    {
+        preg = (volatile uint8_t*)(TRX_REGISTER_BASEADDR +
+                                   pgm_read_byte(&seq->addr));
+        mask = pgm_read_byte(&seq->mask);
+        val = pgm_read_byte(&seq->value);
+        seq++;
+        if (mask != 0xff)
+        {
+            val = (*preg & ~mask) | (val & mask);
+        }
+        *preg = val;
+    }
 }
 
-uint8_t trx_reg_read(trx_regaddr_t addr)
+void trx_tstamp_init(void)
 {
-    return *(uint8_t*)(TRX_REGISTER_BASEADDR + addr);
+    /* clock from the 16MHz xtal, automatic SFD time stamps */
+    SCCR0 = _BV(SCEN) | _BV(SCTSE);
 }
 
-trx_regval_t trx_bit_read(trx_regaddr_t addr, trx_regval_t mask, uint8_t pos)
+uint32_t trx_tstamp_now(void)
 {
-    return (*(uint8_t*)(TRX_REGISTER_BASEADDR + addr) & mask) >> pos;
+uint32_t ret;
+
+    /* reading the low byte latches the upper bytes */
+    ret = SCCNTLL;
+    ret |= (uint32_t)SCCNTLH << 8;
+    ret |= (uint32_t)SCCNTHL << 16;
+    ret |= (uint32_t)SCCNTHH << 24;
+    return ret;
 }
 
-void trx_bit_write(trx_regaddr_t addr, trx_regval_t mask, uint8_t pos, trx_regval_t value)
+uint32_t trx_tstamp_sfd(void)
 {
-    trx_regval_t tmp;
-    tmp = (*(uint8_t*)(TRX_REGISTER_BASEADDR + addr) & ~mask);
-    tmp = tmp | ((value << pos) & mask );
-    *(uint8_t*)(TRX_REGISTER_BASEADDR + addr) = tmp;
+uint32_t ret;
+
+    ret = SCTSRLL;
+    ret |= (uint32_t)SCTSRLH << 8;
+    ret |= (uint32_t)SCTSRHL << 16;
+    ret |= (uint32_t)SCTSRHH << 24;
+    return ret;
 }
 
+
 void trx_frame_write(uint8_t length, uint8_t *data)
 {
    if (length > 127)
@@ -108,7 +136,10 @@ uint8_t trx_frame_read(uint8_t *data, uint8_t datasz, uint8_t *lqi)
         datasz = length;
     }
     memcpy( data, (void*)&TRXFBST, datasz);
-    *lqi = *(&TRXFBST+datasz);
+    if (lqi != NULL)
+    {
+        *lqi = *(&TRXFBST+datasz);
+    }
     return length;
 }
 
@@ -135,6 +166,19 @@ uint8_t trx_frame_get_length(void)
     return TST_RX_LENGTH;
 }
 
+uint8_t trx_frame_read_head(uint8_t *data, uint8_t n)
+{
+uint8_t length;
+
+    length = TST_RX_LENGTH;
+    if (n > length)
+    {
+        n = length;
+    }
+    memcpy(data, (void*)&TRXFBST, n);
+    return length;
+}
+
 void trx_sram_write(trx_ramaddr_t addr, uint8_t length, uint8_t *data)
 {
     if ((addr + length) > 127)
@@ -50,22 +50,75 @@
 
 #include <board.h>
 #include <hif.h>
+#include <timer.h>
 #include <transceiver.h>
 #include <radio.h>
+#include <crc_fast.h>
 #include <p2p_protocol.h>
 
 #include "cmdif.h"
 #include "wibohost.h"
 #include "hexparse.h"
+#include "isr_prof.h"
+#include "stack_watch.h"
 
 #define EOL "\n"
-#define MAXLINELEN (80)
+#define MAXLINELEN (160) /* feedhex with up to 64 data bytes per record */
+#define MAXPARAMS (10) /* command and its arguments */
+
+/* Binary frames, used instead of hex text lines to feed image data
+ *
+ *  SOF | type | dst_lo | dst_hi | len | data[len] | crc_lo | crc_hi
+ *
+ * crc: _crc_ccitt_update() over type .. data, start value 0xFFFF
+ * SOF is not a printable character, so it can only start a frame
+ * when received at the beginning of a line
+ */
+#define BINFRAME_SOF (0x02)
+#define BINFRAME_HDRLEN (4) /* type, dst, len */
+#define BINFRAME_MAXDATA (8 + P2P_WIBO_FEC_SYMBOL)
+
+#define BINFRAME_TYPE_FEED ('F')  /* data: image data */
+#define BINFRAME_TYPE_FEEDSEQ ('S')  /* data: seqno_lo, seqno_hi, image data */
+#define BINFRAME_TYPE_QFEED ('Q')  /* data: image data, to the feed queue */
+#define BINFRAME_TYPE_FEC ('C')  /* data: block, nblocks, mask (all LE), symbol */
+
+/* Batched replies of discover and pingshort ("batch 1"), one block
+ * instead of one NODE line per node
+ *
+ *  SOF | 'N' | cnt | reclen | discovered[cnt] | crc_lo | crc_hi
+ *
+ * crc as for the binary frames above, over 'N' .. records. The records
+ * are the raw entries of discovered[], little endian, the "OK n" line
+ * follows as without batching.
+ */
+#define BINFRAME_TYPE_NODES ('N')
+/* microseconds per timer tick, for the arrival times */
+#define TICK_US ((uint32_t) (TIMER_TICK * 1.0e6))
 
 /* variable for function cmd_feedhex()
  * placed here (global) to store in SRAM at compile time
  */
 static hexrec_t hexrec;
 static uint8_t lnbuf[MAXLINELEN + 1];
+static uint8_t binbuf[BINFRAME_HDRLEN + BINFRAME_MAXDATA + 2];
+
+/* Image data of feedhex, qfeed, feedhexfile and of binary feed frames
+ * is packed into frames of WIBOHOST_FEED_MAXDATA bytes, instead of one
+ * frame per hex line. Extended address records and jumps of the record
+ * address are turned into an addr command.
+ */
+
+static struct
+{
+	uint32_t base;   /* upper address bits from extended address records */
+	uint32_t next;   /* flash address of the node after the collected data */
+	uint16_t short_addr;
+	uint8_t queued;  /* collected by qfeed, sent through the feed queue */
+	uint8_t txfail;  /* a direct frame was not acknowledged */
+	uint8_t len;
+	uint8_t data[WIBOHOST_FEED_MAXDATA];
+} hexfeed;
 
 /* following flags must be not zero to allow first run of "wait_previous_command" */
 static volatile uint8_t tx_done = 1;
@@ -73,24 +126,86 @@ static volatile uint8_t flashcycle_done = 1;
 
 static volatile radio_tx_done_t last_tx_status;
 
+/* nodes collected by a discovery */
+static struct
+{
+	uint16_t short_addr;
+	uint8_t lqi;
+	int8_t ed;
+	uint16_t t_ms;   /* arrival of the reply since the request */
+	uint8_t version;
+	uint8_t errno;
+	uint8_t flags;   /* short ping only */
+	uint16_t crc;
+	char boardname[16];
+} discovered[WIBOHOST_DISCOVER_MAX];
+static volatile uint8_t discover_cnt = 0;
+static volatile uint8_t discover_done = 1;
+static time_t discover_start;
+/* replies of discover and pingshort as one binary block */
+static uint8_t batch = 0;
+/* period of the PROG lines during an update in ms, 0: off */
+static uint32_t prog_period = 0;
+static time_t prog_last;
+
+#if defined(P2P_MESH)
+static volatile uint8_t route_done = 1;
+#endif
+
 /*
- * \brief Wait for complete line, no character echoing
+ * \brief Wait for complete line or binary frame, no character echoing
+ *
+ * A line longer than MAXLINELEN is dropped with an error, empty lines
+ * are skipped.
  *
- * @return 1 for line completed, 0 else
+ * @return 1 for line completed, 2 for binary frame completed, 0 else
  */
 static inline uint8_t getline()
 {
 	int16_t inchar;
 	static uint8_t idx = 0;
+	static uint8_t binidx = 0;
+	static uint8_t binmode = 0;
+	static uint8_t overflow = 0;
 
 	inchar = hif_getc();
-	if (inchar != EOF)
+	if ((inchar != EOF) && binmode)
+	{
+		binbuf[binidx++] = inchar;
+		if ((BINFRAME_HDRLEN == binidx)
+				&& (binbuf[BINFRAME_HDRLEN - 1] > BINFRAME_MAXDATA))
+		{
+			binmode = 0; /* invalid length, back to line mode */
+			PRINT("ERR frame length"EOL);
+		}
+		else if ((binidx > BINFRAME_HDRLEN)
+				&& (binidx == BINFRAME_HDRLEN + binbuf[BINFRAME_HDRLEN - 1] + 2))
+		{
+			binmode = 0;
+			return 2;
+		}
+	}
+	else if ((inchar == BINFRAME_SOF) && (0 == idx))
+	{
+		binmode = 1;
+		binidx = 0;
+	}
+	else if (inchar != EOF)
 	{
 		lnbuf[idx] = 0x00; /* NULL terminated string */
 		if ((inchar == '\n') || (inchar == '\r'))
 		{
+			if (overflow)
+			{
+				overflow = 0;
+				PRINT("ERR line too long"EOL);
+			}
+			else if (idx > 0)
+			{
+				idx = 0;
+				return 1;
+			}
 			idx = 0;
-			return 1;
 		}
 		else if (idx < MAXLINELEN)
 		{
@@ -98,7 +213,7 @@ static inline uint8_t getline()
 		}
 		else
 		{
-			/* TODO: catch line length overflow */
+			overflow = 1;
 		}
 	}
 
@@ -123,10 +238,14 @@ static void wait_previous_command(void)
 	/* Pipelining:
 	 * wait for the previous cycle to be finished
 	 *
-	 * both flags have to be set to continue
+	 * both flags have to be set to continue, and the
+	 * feed queue has to be empty
 	 */
-	while ((0 == tx_done) || (0 == flashcycle_done))
-		;
+	while ((0 == tx_done) || (0 == flashcycle_done) || wibohost_queue_pending())
+	{
+		wibohost_task();
+		BUSY_WAIT();
+	}
 
 	tx_done = 0; /* for each command */
 }
@@ -137,8 +256,96 @@ static void wait_previous_command(void)
 void cb_wibohost_pingreply(p2p_ping_cnf_t *pr)
 {
 	PRINTF(
-			"OK {'short_addr':0x%04X, 'appname': '%s'," " 'boardname':'%s', 'version':0x%02X, " "'crc':0x%04X}"EOL,
-			pr->hdr.src, pr->appname, pr->boardname, pr->version, pr->crc);
+			"OK {'short_addr':0x%04X, 'appname': '%s'," " 'boardname':'%s', 'version':0x%02X, " "'crc':0x%04X, 'errno':%d, 'appstatus':%d, 'pagesize':%u}"EOL,
+			pr->hdr.src, pr->appname, pr->boardname, pr->version, pr->crc,
+			pr->errno, pr->status, wibohost_pagesize(pr->hdr.src));
+}
+
+/*
+ * \brief Called asynchronous when resume reply frame is received
+ */
+void cb_wibohost_resumereply(p2p_wibo_resume_t *rr)
+{
+	PRINTF("OK {'short_addr':0x%04X, 'page':0x%04X, 'crc':0x%04X}"EOL,
+			rr->hdr.src, rr->page, rr->crc);
+}
+
+/*
+ * \brief Timeout for resume request
+ */
+void cb_wibohost_resumetimeout(void)
+{
+	PRINT("ERR resume timeout"EOL);
+}
+
+/*
+ * \brief Called asynchronous for each ping reply of a discovery
+ * Nodes already in the list are not added twice.
+ */
+void cb_wibohost_discoverreply(p2p_ping_cnf_t *pr, uint8_t lqi, int8_t ed)
+{
+	uint8_t i;
+
+	for (i = 0; i < discover_cnt; i++)
+	{
+		if (discovered[i].short_addr == pr->hdr.src)
+		{
+			return;
+		}
+	}
+	if (discover_cnt < WIBOHOST_DISCOVER_MAX)
+	{
+		discovered[i].short_addr = pr->hdr.src;
+		discovered[i].lqi = lqi;
+		discovered[i].ed = ed;
+		discovered[i].t_ms = ((timer_systime() - discover_start) * TICK_US) / 1000;
+		discovered[i].version = pr->version;
+		discovered[i].errno = pr->errno;
+		discovered[i].flags = 0;
+		discovered[i].crc = pr->crc;
+		strncpy(discovered[i].boardname, pr->boardname,
+				sizeof(discovered[i].boardname) - 1);
+		discovered[i].boardname[sizeof(discovered[i].boardname) - 1] = 0;
+		discover_cnt++;
+	}
+}
+
+/*
+ * \brief Called asynchronous for each reply of a short ping
+ */
+void cb_wibohost_pingshortreply(p2p_ping_short_cnf_t *pr, uint8_t lqi,
+		int8_t ed)
+{
+	uint8_t i;
+
+	for (i = 0; i < discover_cnt; i++)
+	{
+		if (discovered[i].short_addr == pr->hdr.src)
+		{
+			return;
+		}
+	}
+	if (discover_cnt < WIBOHOST_DISCOVER_MAX)
+	{
+		discovered[i].short_addr = pr->hdr.src;
+		discovered[i].lqi = lqi;
+		discovered[i].ed = ed;
+		discovered[i].t_ms = ((timer_systime() - discover_start) * TICK_US) / 1000;
+		discovered[i].version = pr->version;
+		discovered[i].errno = P2P_PING_SHORT_ERRNO(pr->flags);
+		discovered[i].flags = pr->flags;
+		discovered[i].crc = pr->crc;
+		discovered[i].boardname[0] = 0;
+		discover_cnt++;
+	}
+}
+
+/*
+ * \brief Called at the end of the reply window of a discovery
+ */
+void cb_wibohost_discoverdone(void)
+{
+	discover_done = 1;
 }
 
 /*
@@ -149,6 +356,122 @@ void cb_wibohost_pingtimeout(void)
 	PRINT("ERR ping timeout"EOL);
 }
 
+/*
+ * \brief Print the update progress, a PROG line per node and a PROGSUM line
+ *
+ * goodput is in bytes per second, the pages written by the node over
+ * the time from wibohost_reset() to its last reply.
+ */
+static void put_progress(void)
+{
+	wibohost_prog_t p;
+	uint16_t frames, retx;
+	uint32_t ms, goodput;
+	uint8_t i;
+
+	for (i = 0; wibohost_prog_get(i, &p); i++)
+	{
+		goodput = 0;
+		if (p.t_ms && (0xFFFF != p.pages))
+		{
+			goodput = (uint32_t) p.pages * wibohost_pagesize(p.short_addr)
+					* 1000UL / p.t_ms;
+		}
+		PRINTF("PROG {'short_addr':0x%04X, 'base':%u, 'pages':%u, 'lost':%u, "
+				"'nacks':%u, 'timeouts':%u, 't_ms':%lu, 'goodput':%lu}"EOL,
+				p.short_addr, p.base, p.pages, p.lost, p.nacks, p.timeouts,
+				p.t_ms, goodput);
+	}
+	ms = wibohost_prog_summary(&frames, &retx);
+	PRINTF("PROGSUM {'nodes':%d, 'frames':%u, 'retx':%u, 't_ms':%lu}"EOL,
+			i, frames, retx, ms);
+}
+
+/*
+ * \brief Print the progress once per period, in front of the reply of a
+ * window or mcpoll command, so the PC always reads them
+ */
+static void stream_progress(void)
+{
+	time_t now;
+
+	if (0 == prog_period)
+	{
+		return;
+	}
+	now = timer_systime();
+	if (((now - prog_last) * TICK_US) / 1000 < prog_period)
+	{
+		return;
+	}
+	prog_last = now;
+	put_progress();
+}
+
+/*
+ * \brief Called asynchronous when window reply frame is received
+ */
+void cb_wibohost_windowreply(p2p_wibo_window_cnf_t *wr)
+{
+	stream_progress();
+	PRINTF(
+			"OK {'short_addr':0x%04X, 'base':0x%04X, 'received':0x%04X, " "'crc':0x%04X, "
+			"'pages':%u, 'lost':%u}"EOL,
+			wr->hdr.src, wr->base, wr->received, wr->crc, wr->pages, wr->lost);
+}
+
+/*
+ * \brief Timeout for window request
+ */
+void cb_wibohost_windowtimeout(void)
+{
+	PRINT("ERR window timeout"EOL);
+}
+
+/*
+ * \brief Called asynchronous when FEC reply frame is received
+ * The blocks done are printed as hex string, block 0 in the lowest bit
+ * of the first byte, only the bytes of nblocks.
+ */
+void cb_wibohost_fecreply(p2p_wibo_fec_cnf_t *fr)
+{
+	uint8_t i;
+
+	PRINTF("OK {'short_addr':0x%04X, 'nblocks':%d, 'crc':0x%04X, 'done':'",
+			fr->hdr.src, fr->nblocks, fr->crc);
+	for (i = 0; (i < (fr->nblocks + 7) / 8) && (i < sizeof(fr->done)); i++)
+	{
+		PRINTF("%02X", fr->done[i]);
+	}
+	PRINT("'}"EOL);
+}
+
+/*
+ * \brief Timeout for FEC request
+ */
+void cb_wibohost_fectimeout(void)
+{
+	PRINT("ERR fec timeout"EOL);
+}
+
+/*
+ * \brief Called asynchronous when PHY stats reply frame is received
+ */
+void cb_wibohost_phystatsreply(p2p_phy_stats_cnf_t *sr)
+{
+	PRINTF(
+			"OK {'short_addr':0x%04X, 'profile':%d, 'stored':%d, " "'received':%u, 'bytes':%lu}"EOL,
+			sr->hdr.src, sr->profile, sr->stored, sr->received, sr->bytes);
+}
+
+/*
+ * \brief Timeout for PHY stats request
+ */
+void cb_wibohost_phystatstimeout(void)
+{
+	PRINT("ERR phystats timeout"EOL);
+}
+
 /*
  *\brief Timeout for flash write cycle
  */
@@ -174,6 +497,43 @@ void cb_wibohost_tx_done(radio_tx_done_t status)
 	last_tx_status = status;
 }
 
+/*
+ * \brief Write a block to the HIF, as far as it takes it at a time
+ */
+static void put_blk(const uint8_t *p, uint16_t len)
+{
+	hif_blk_t n;
+
+	while (len > 0)
+	{
+		n = hif_put_blk((uint8_t*) p, (len > 255) ? 255 : len);
+		p += n;
+		len -= n;
+	}
+}
+
+/*
+ * \brief Send the nodes of discover or pingshort as one block
+ */
+static void put_discovered(void)
+{
+	uint8_t hdr[4];
+	uint16_t crc, len;
+
+	len = discover_cnt * sizeof(discovered[0]);
+	hdr[0] = BINFRAME_SOF;
+	hdr[1] = BINFRAME_TYPE_NODES;
+	hdr[2] = discover_cnt;
+	hdr[3] = sizeof(discovered[0]);
+	crc = crc_ccitt_block(0xFFFF, &hdr[1], 3);
+	crc = crc_ccitt_block(crc, (uint8_t*) discovered, len);
+	put_blk(hdr, sizeof(hdr));
+	put_blk((uint8_t*) discovered, len);
+	hdr[0] = crc & 0xff;
+	hdr[1] = crc >> 8;
+	put_blk(hdr, 2);
+}
+
 /*
  * \brief Command to execute wibohost_ping() functions
  *
@@ -191,331 +551,1526 @@ static inline void cmd_ping(char **params)
 }
 
 /*
- * \brief Command to execute wibohost_deaf() function
+ * \brief Command to execute wibohost_discover() function
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Blocks for the reply window, then prints one line per node in the
+ * format of a ping reply, and the number of nodes found.
+ *
+ * Expected parameters
+ *  (1) number of reply slots
+ *  (2) round
  *
  */
-static inline void cmd_deaf(char **params)
+static inline void cmd_discover(char **params)
 {
-	uint16_t short_addr;
+	uint8_t i;
 
-	short_addr = strtol(params[0], NULL, 16);
 	wait_previous_command();
-	wibohost_deaf(short_addr);
-	printok();
+	discover_cnt = 0;
+	discover_done = 0;
+	discover_start = timer_systime();
+	wibohost_discover(strtol(params[0], NULL, 16),
+			strtol(params[1], NULL, 16));
+	while (0 == discover_done)
+		BUSY_WAIT();
+
+	if (batch)
+	{
+		put_discovered();
+	}
+	else
+	{
+		for (i = 0; i < discover_cnt; i++)
+		{
+			PRINTF(
+					"NODE {'short_addr':0x%04X, 'appname': 'wibo'," " 'boardname':'%s', 'version':0x%02X, " "'crc':0x%04X, 'errno':%d}"EOL,
+					discovered[i].short_addr, discovered[i].boardname,
+					discovered[i].version, discovered[i].crc, discovered[i].errno);
+		}
+	}
+	PRINTF("OK %d"EOL, discover_cnt);
 }
 
 /*
- * \brief Command to execute wibohost_finish() functions
+ * \brief Command to execute wibohost_pingshort() function
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Blocks for the reply window, then prints one line per node and the
+ * number of nodes that replied.
+ *
+ * Expected parameters
+ *  (1) short address, FFFF for all nodes
+ *  (2) number of reply slots
  *
  */
-static inline void cmd_finish(char **params)
+static inline void cmd_pingshort(char **params)
 {
-	uint16_t short_addr;
+	uint8_t i;
 
-	short_addr = strtol(params[0], NULL, 16);
 	wait_previous_command();
-	wibohost_finish(short_addr);
+	discover_cnt = 0;
+	discover_done = 0;
+	discover_start = timer_systime();
+	wibohost_pingshort(strtol(params[0], NULL, 16),
+			strtol(params[1], NULL, 16));
+	while (0 == discover_done)
+		BUSY_WAIT();
+
+	if (batch)
+	{
+		put_discovered();
+	}
+	else
+	{
+		for (i = 0; i < discover_cnt; i++)
+		{
+			PRINTF(
+					"NODE {'short_addr':0x%04X, 'version':0x%02X, " "'crc':0x%04X, 'errno':%d, 'flags':0x%02X}"EOL,
+					discovered[i].short_addr, discovered[i].version,
+					discovered[i].crc, discovered[i].errno, discovered[i].flags);
+		}
+	}
+	PRINTF("OK %d"EOL, discover_cnt);
+}
+
+/*
+ * \brief Command to switch the batched replies of discover and pingshort
+ *
+ * Expected parameters
+ *  (1) 1 for one binary block, 0 for the NODE lines
+ *
+ */
+static inline void cmd_batch(char **params)
+{
+	batch = (0 != strtol(params[0], NULL, 16));
 	printok();
 }
 
 /*
- * \brief Command to execute wibohost_feed() functions
+ * \brief Command to print and stream the update progress of the nodes
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Prints the progress from the window replies since the last reset
+ * at once, see put_progress(). With a period, the same lines come
+ * during the update in front of the window and mcpoll replies, at
+ * most once per period.
  *
  * Expected parameters
- *  (1) short_addr
- *  (2) line from intel hex-file
+ *  (1) period in ms, 0: no streaming
+ */
+static inline void cmd_progress(char **params)
+{
+	prog_period = strtol(params[0], NULL, 16);
+	prog_last = timer_systime();
+	put_progress();
+	printok();
+}
+
+#if defined(RADIO_SCAN)
+static radio_scan_result_t scanres[TRX_NB_CHANNELS];
+static volatile uint8_t scan_nres;
+
+static void cb_chscan_done(radio_scan_result_t *res, uint8_t n)
+{
+	scan_nres = n;
+}
+
+/*
+ * \brief Rank channels by energy and traffic
+ *
+ * Blocks for the scan, then prints one line per channel, best first.
+ *
+ * Expected parameters
+ *  (1) channel mask
+ *  (2) dwell time per channel [ms]
  *
  */
-static inline void cmd_feedhexline(char **params)
+static inline void cmd_chscan(char **params)
 {
-	uint16_t short_addr;
-	short_addr = strtol(params[0], NULL, 16);
+	uint8_t i, n;
 
-	if (!parsehexline((uint8_t*) params[1], &hexrec))
+	wait_previous_command();
+	scan_nres = 0;
+	n = radio_scan_start(strtoul(params[0], NULL, 16),
+			strtol(params[1], NULL, 16), scanres, cb_chscan_done);
+	if (0 == n)
 	{
-		PRINT("ERR parsing hexline"EOL);
+		PRINT("ERR scan not started"EOL);
+		return;
 	}
-	else
-	{
-		if (HEX_RECTYPE_DATA == hexrec.type)
-		{ /* only feed data type lines */
-
-			wait_previous_command();
+	while (radio_scan_busy())
+		BUSY_WAIT();
+	radio_set_state(STATE_RXAUTO);
 
-			flashcycle_done = 0; /* set explicitely */
-			wibohost_feed(short_addr, hexrec.data, hexrec.len);
-			if (TX_OK == last_tx_status)
-			{
-				printok();
-			}
-			else
-			{
-				PRINT("ERR Tx fail"EOL);
-			}
-		}
-		else
-		{
-			PRINTF("WARN ignoring rec type 0x%02X"EOL, hexrec.type);
-		}
+	for (i = 0; i < scan_nres; i++)
+	{
+		PRINTF(
+				"CHAN {'channel':%d, 'score':%u, 'ed':%u, 'edmax':%u, " "'frames':%u, 'crc_ok':%u}"EOL,
+				scanres[i].channel, scanres[i].score,
+				scanres[i].nbed ? scanres[i].edsum / scanres[i].nbed : 0,
+				scanres[i].edmax, scanres[i].frames, scanres[i].crc_ok);
 	}
+	PRINTF("OK %d"EOL, scan_nres);
 }
+#endif
 
 /*
- * \brief Command to receive a complete hex-file
- *
- * This is intended to use from a serial terminal instead of a python command interface
+ * \brief Query the checkpoint of a broken update
  *
  * Expected parameters
  *  (1) short_addr
  *
  */
-static inline void cmd_feedhexfile(char **params)
+static inline void cmd_resume(char **params)
 {
-	uint8_t error = 0;
 	uint16_t short_addr;
 
 	short_addr = strtol(params[0], NULL, 16);
-	PRINT("OK upload hex-file now..."EOL);
+	wait_previous_command();
+	wibohost_resume(short_addr, 0xFFFF, 0);
+}
 
-	do
-	{
-		/* fetch line */
-		do
-		{
-		} while (0 == getline());
+/*
+ * \brief Continue a broken update at the checkpoint of the node
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) checkpoint page
+ *  (3) data CRC up to that page
+ *
+ */
+static inline void cmd_resumeat(char **params)
+{
+	uint16_t short_addr;
 
-		if (!parsehexline((uint8_t*) lnbuf, &hexrec))
-		{
-			PRINT("ERR parsing hexline");
-			error = 1;
-		}
+	short_addr = strtol(params[0], NULL, 16);
+	wait_previous_command();
+	wibohost_resume(short_addr, strtol(params[1], NULL, 16),
+			strtol(params[2], NULL, 16));
+}
 
+/*
+ * \brief Command to execute wibohost_deaf() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_deaf(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	wait_previous_command();
+	wibohost_deaf(short_addr);
+	printok();
+}
+
+/*
+ * \brief Command to execute wibohost_finish() functions
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_finish(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	wait_previous_command();
+	wibohost_finish(short_addr);
+	printok();
+}
+
+/*
+ * \brief Put a frame into the feed queue, blocks while the queue is full
+ */
+static void queue_frame(uint16_t short_addr, uint8_t *data, uint8_t len)
+{
+	uint8_t credits;
+
+	/* a direct command may still be in the air */
+	while ((0 == tx_done) || (0 == flashcycle_done))
+		BUSY_WAIT();
+
+	do
+	{
+		credits = wibohost_queue_feed(short_addr, data, len);
+		wibohost_task();
+		BUSY_WAIT();
+	} while (0xFF == credits);
+}
+
+/*
+ * \brief Send the collected hex data to the node
+ *
+ * Called before every command other than feedhex and qfeed, the data
+ * CRC of the host only covers data that is sent.
+ */
+static void hexfeed_flush(void)
+{
+	uint8_t len = hexfeed.len;
+
+	if (0 == len)
+	{
+		return;
+	}
+	hexfeed.len = 0;
+
+	if (hexfeed.queued)
+	{
+		queue_frame(hexfeed.short_addr, hexfeed.data, len);
+	}
+	else
+	{
 		wait_previous_command();
 
-		/* TODO: handling address jump records */
+		/* the pause only follows a frame which completes a page */
+		flashcycle_done = 0; /* set explicitely */
+		if (0 == wibohost_feed(hexfeed.short_addr, hexfeed.data, len))
+		{
+			flashcycle_done = 1;
+		}
+		if (TX_OK != last_tx_status)
+		{
+			hexfeed.txfail = 1;
+		}
+	}
+}
+
+/*
+ * \brief Start collecting hex records of a new file
+ *
+ * @param flash_addr Flash address of the node
+ */
+static void hexfeed_reset(uint32_t flash_addr)
+{
+	hexfeed.len = 0;
+	hexfeed.base = 0;
+	hexfeed.next = flash_addr;
+}
 
-		if (HEX_RECTYPE_DATA == hexrec.type)
-		{ /* only feed data type lines */
-			flashcycle_done = 0; /* set explicitely */
-			wibohost_feed(short_addr, hexrec.data, hexrec.len);
+/*
+ * \brief Collect image data, a frame is sent when it is full
+ *
+ * @param data Image data, NULL to pad with 0xFF
+ * @param len Number of bytes
+ */
+static void hexfeed_put(uint8_t *data, uint16_t len)
+{
+	while (len--)
+	{
+		hexfeed.data[hexfeed.len++] = data ? *data++ : 0xFF;
+		hexfeed.next++;
+		if (WIBOHOST_FEED_MAXDATA == hexfeed.len)
+		{
+			hexfeed_flush();
 		}
-		else if (HEX_RECTYPE_EOF == hexrec.type)
+	}
+}
+
+/*
+ * \brief Select node and path of the collected data
+ *
+ * @param short_addr Address of node to feed
+ * @param queued 1 to send through the feed queue
+ */
+static void hexfeed_select(uint16_t short_addr, uint8_t queued)
+{
+	if ((short_addr != hexfeed.short_addr) || (queued != hexfeed.queued))
+	{
+		hexfeed_flush();
+		hexfeed.short_addr = short_addr;
+		hexfeed.queued = queued;
+	}
+}
+
+/*
+ * \brief Reply to a direct feed
+ *
+ * The reply of data that is only collected is OK, a failed frame is
+ * reported with the reply of the next feed.
+ */
+static void feed_reply(void)
+{
+	if (hexfeed.txfail)
+	{
+		hexfeed.txfail = 0;
+		PRINT("ERR Tx fail"EOL);
+	}
+	else
+	{
+		printok();
+	}
+}
+
+/*
+ * \brief Reply to a queued feed
+ *
+ * Other than feedhex it does not wait for the previous frame, it only
+ * blocks while the queue is full. The reply carries the number of free
+ * queue entries, so the host knows how many frames it may send ahead.
+ */
+static void qfeed_reply(void)
+{
+	uint8_t pending = wibohost_queue_pending();
+
+	PRINTF("OK %d"EOL, (pending < WIBOHOST_TXQ_LEN) ? WIBOHOST_TXQ_LEN - pending : 0);
+}
+
+/*
+ * \brief Collect a parsed hex record for a node
+ *
+ * A gap within the current page is padded with 0xFF. For other jumps
+ * the current page is padded up to its end, since the node drops a
+ * partly filled page buffer on addr, and the node is moved to the page
+ * of the record.
+ *
+ * @return 0 if the record was taken, 1 if it was ignored
+ */
+static uint8_t hexfeed_record(uint16_t short_addr, uint8_t queued, hexrec_t *rec)
+{
+	uint32_t addr;
+	uint16_t ps = wibohost_pagesize(short_addr);
+
+	hexfeed_select(short_addr, queued);
+	if (hexrec_base(rec, &hexfeed.base))
+	{
+		return 0;
+	}
+	if (HEX_RECTYPE_DATA != rec->type)
+	{
+		return 1;
+	}
+
+	addr = hexfeed.base + rec->addr;
+	if ((addr < hexfeed.next) || (addr / ps != hexfeed.next / ps))
+	{
+		if (hexfeed.next % ps)
 		{
-			PRINT("OK end of file"EOL);
-			error = 1;
+			hexfeed_put(NULL, ps - hexfeed.next % ps);
 		}
-		else
+		if (addr / ps != hexfeed.next / ps)
 		{
-			PRINTF("WARN ignoring rec type %d"EOL, hexrec.type);
+			hexfeed_flush();
+			hexfeed.next = addr - addr % ps;
+			wait_previous_command();
+			wibohost_addr(short_addr, hexfeed.next);
 		}
-	} while (0 == error);
+	}
+	hexfeed_put(NULL, addr - hexfeed.next);
+	hexfeed_put(rec->data, rec->len);
+	return 0;
+}
+
+/*
+ * \brief Command to execute wibohost_feed() functions
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) line from intel hex-file
+ *
+ */
+static inline void cmd_feedhexline(char **params)
+{
+	uint16_t short_addr;
+	short_addr = strtol(params[0], NULL, 16);
+
+	if (!parsehexline((uint8_t*) params[1], &hexrec))
+	{
+		PRINT("ERR parsing hexline"EOL);
+	}
+	else if (hexfeed_record(short_addr, 0, &hexrec))
+	{
+		PRINTF("WARN ignoring rec type 0x%02X"EOL, hexrec.type);
+	}
+	else
+	{
+		feed_reply();
+	}
+}
+
+/*
+ * \brief Command to execute wibohost_queue_feed() function
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) line from intel hex-file
+ *
+ */
+static inline void cmd_qfeedhexline(char **params)
+{
+	uint16_t short_addr;
+	short_addr = strtol(params[0], NULL, 16);
+
+	if (!parsehexline((uint8_t*) params[1], &hexrec))
+	{
+		PRINT("ERR parsing hexline"EOL);
+	}
+	else if (hexfeed_record(short_addr, 1, &hexrec))
+	{
+		PRINTF("WARN ignoring rec type 0x%02X"EOL, hexrec.type);
+	}
+	else
+	{
+		qfeed_reply();
+	}
+}
+
+/*
+ * \brief Queue a frame for a session
+ *
+ * Blocks while the queue of the session is full, the reply carries
+ * the number of free queue entries as for qfeed.
+ */
+#define SESS_QUEUE(call) \
+	do { \
+		uint8_t credits; \
+		while ((0 == tx_done) || (0 == flashcycle_done)) \
+			BUSY_WAIT(); \
+		while (0xFF == (credits = (call))) \
+		{ \
+			wibohost_task(); \
+			BUSY_WAIT(); \
+		} \
+		PRINTF("OK %d"EOL, credits); \
+	} while (0)
+
+/*
+ * \brief Parse the session number parameter
+ *
+ * @return 1 if the session is open, 0 else (error printed)
+ */
+static uint8_t sess_param(char *param, uint8_t *s)
+{
+	*s = strtol(param, NULL, 16);
+	if (!wibohost_sess_isopen(*s))
+	{
+		PRINT("ERR no such session"EOL);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * \brief Open a session for a troop on another channel/PAN
+ *
+ * Expected parameters
+ *  (1) channel
+ *  (2) pan_id
+ *
+ */
+static inline void cmd_sopen(char **params)
+{
+	uint8_t s;
+
+	s = wibohost_sess_open(strtol(params[0], NULL, 16),
+			strtol(params[1], NULL, 16));
+	if (0xFF == s)
+	{
+		PRINT("ERR no session available"EOL);
+	}
+	else
+	{
+		PRINTF("OK %d"EOL, s);
+	}
+}
+
+/*
+ * \brief Close a session
+ *
+ * Expected parameters
+ *  (1) session
+ *
+ */
+static inline void cmd_sclose(char **params)
+{
+	uint8_t s;
+
+	if (sess_param(params[0], &s))
+	{
+		while (!wibohost_sess_close(s))
+		{
+			wibohost_task();
+			BUSY_WAIT();
+		}
+		printok();
+	}
+}
+
+/*
+ * \brief Queue a reset of all nodes of a session
+ *
+ * Expected parameters
+ *  (1) session
+ *
+ */
+static inline void cmd_sreset(char **params)
+{
+	uint8_t s;
+
+	if (sess_param(params[0], &s))
+	{
+		SESS_QUEUE(wibohost_sess_reset(s));
+	}
+}
+
+/*
+ * \brief Queue the flash target address for a node of a session
+ *
+ * Expected parameters
+ *  (1) session
+ *  (2) short_addr
+ *  (3) address
+ *
+ */
+static inline void cmd_saddr(char **params)
+{
+	uint8_t s;
+	uint16_t short_addr;
+	uint32_t flash_addr;
+
+	if (sess_param(params[0], &s))
+	{
+		short_addr = strtol(params[1], NULL, 16);
+		flash_addr = strtoul(params[2], NULL, 16);
+		SESS_QUEUE(wibohost_sess_addr(s, short_addr, flash_addr));
+	}
+}
+
+/*
+ * \brief Queue a line of hex file for a node of a session
+ *
+ * Expected parameters
+ *  (1) session
+ *  (2) short_addr
+ *  (3) line from intel hex-file
+ *
+ */
+static inline void cmd_sfeed(char **params)
+{
+	uint8_t s;
+	uint16_t short_addr;
+
+	if (!sess_param(params[0], &s))
+	{
+		return;
+	}
+	short_addr = strtol(params[1], NULL, 16);
+
+	if (!parsehexline((uint8_t*) params[2], &hexrec))
+	{
+		PRINT("ERR parsing hexline"EOL);
+	}
+	else if (HEX_RECTYPE_DATA != hexrec.type)
+	{
+		PRINTF("WARN ignoring rec type 0x%02X"EOL, hexrec.type);
+	}
+	else
+	{
+		SESS_QUEUE(wibohost_sess_feed(s, short_addr, hexrec.data, hexrec.len));
+	}
+}
+
+/*
+ * \brief Queue a finish for a node of a session
+ *
+ * Expected parameters
+ *  (1) session
+ *  (2) short_addr
+ *
+ */
+static inline void cmd_sfinish(char **params)
+{
+	uint8_t s;
+	uint16_t short_addr;
+
+	if (sess_param(params[0], &s))
+	{
+		short_addr = strtol(params[1], NULL, 16);
+		SESS_QUEUE(wibohost_sess_finish(s, short_addr));
+	}
+}
+
+/*
+ * \brief Queue an exit for a node of a session
+ *
+ * Expected parameters
+ *  (1) session
+ *  (2) short_addr
+ *
+ */
+static inline void cmd_sexit(char **params)
+{
+	uint8_t s;
+	uint16_t short_addr;
+
+	if (sess_param(params[0], &s))
+	{
+		short_addr = strtol(params[1], NULL, 16);
+		SESS_QUEUE(wibohost_sess_exit(s, short_addr));
+	}
+}
+
+/*
+ * \brief Get the data CRC of a session
+ *
+ * Expected parameters
+ *  (1) session
+ *
+ */
+static inline void cmd_scrc(char **params)
+{
+	uint8_t s;
+
+	if (sess_param(params[0], &s))
+	{
+		PRINTF("OK 0x%04X"EOL, wibohost_sess_getcrc(s));
+	}
+}
+
+/*
+ * \brief Wait until the frames of all sessions are sent
+ * The radio is back on the channel of the host afterwards.
+ */
+static inline void cmd_sflush(char **params)
+{
+	while (wibohost_queue_pending())
+	{
+		wibohost_task();
+		BUSY_WAIT();
+	}
+	printok();
+}
+
+/*
+ * \brief Command to execute wibohost_feedseq() functions
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) frame number
+ *  (3) line from intel hex-file
+ *
+ */
+static inline void cmd_feedseq(char **params)
+{
+	uint16_t short_addr;
+	uint16_t seqno;
+	short_addr = strtol(params[0], NULL, 16);
+	seqno = strtol(params[1], NULL, 16);
+
+	if (!parsehexline((uint8_t*) params[2], &hexrec))
+	{
+		PRINT("ERR parsing hexline"EOL);
+	}
+	else if (HEX_RECTYPE_DATA != hexrec.type)
+	{
+		PRINTF("WARN ignoring rec type 0x%02X"EOL, hexrec.type);
+	}
+	else
+	{
+		wait_previous_command();
+
+		flashcycle_done = 0; /* set explicitely */
+		if (0 == wibohost_feedseq(short_addr, seqno, hexrec.data, hexrec.len))
+		{
+			flashcycle_done = 1;
+		}
+		printok();
+	}
+}
+
+/*
+ * \brief Command to execute wibohost_window() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_window(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	wait_previous_command();
+	wibohost_window(short_addr);
+}
+
+/*
+ * \brief Command to execute wibohost_fecquery() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_fecstat(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	wait_previous_command();
+	wibohost_fecquery(short_addr);
+}
+
+/*
+ * \brief Command to show the round trip estimate of a node
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_rtt(char **params)
+{
+	uint16_t short_addr;
+	uint32_t srtt, rttvar, rto;
+	uint8_t known;
+
+	short_addr = strtol(params[0], NULL, 16);
+	known = wibohost_rtt(short_addr, &srtt, &rttvar, &rto);
+	PRINTF("OK {'short_addr':0x%04X, 'known':%d, 'srtt':%lu, 'rttvar':%lu, 'rto':%lu}"EOL,
+			short_addr, known, srtt, rttvar, rto);
+}
+
+/*
+ * \brief Command to execute wibohost_mcast_clear() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_mcclear(char **params)
+{
+	wibohost_mcast_clear();
+	printok();
+}
+
+/*
+ * \brief Command to execute wibohost_mcast_add() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_mcadd(char **params)
+{
+	uint16_t short_addr;
+	uint8_t cnt;
+
+	short_addr = strtol(params[0], NULL, 16);
+	cnt = wibohost_mcast_add(short_addr);
+	if (cnt)
+	{
+		PRINTF("OK %d"EOL, cnt);
+	}
+	else
+	{
+		PRINT("ERR session full"EOL);
+	}
+}
+
+/*
+ * \brief Command to execute wibohost_mcast_poll() function
+ *
+ * Prints the merged gaps of all session nodes and the completion bitmap
+ * as hex string, node 0 in the lowest bit of the first byte.
+ *
+ * Expected parameters
+ *  (1) number of frames of the image
+ *
+ */
+static inline void cmd_mcpoll(char **params)
+{
+	uint16_t nframes, base, missing;
+	uint8_t pending, lost, cnt, i;
+	uint8_t *done;
+
+	nframes = strtol(params[0], NULL, 16);
+
+	wait_previous_command();
+	pending = wibohost_mcast_poll(nframes, &base, &missing, &lost);
+
+	done = wibohost_mcast_done(&cnt);
+	stream_progress();
+	PRINTF("OK {'base':0x%04X, 'missing':0x%04X, 'pending':%d, 'lost':%d, 'done':'",
+			base, missing, pending, lost);
+	for (i = 0; i < (cnt + 7) / 8; i++)
+	{
+		PRINTF("%02X", done[i]);
+	}
+	PRINT("'}"EOL);
+}
+
+/*
+ * \brief Command to receive a complete hex-file
+ *
+ * This is intended to use from a serial terminal instead of a python command interface
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *
+ */
+static inline void cmd_feedhexfile(char **params)
+{
+	uint8_t error = 0;
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	hexfeed.base = 0;
+	PRINT("OK upload hex-file now..."EOL);
+
+	do
+	{
+		/* fetch line */
+		do
+		{
+		} while (0 == getline());
+
+		if (!parsehexline((uint8_t*) lnbuf, &hexrec))
+		{
+			PRINT("ERR parsing hexline");
+			error = 1;
+		}
+		else if (HEX_RECTYPE_EOF == hexrec.type)
+		{
+			hexfeed_flush();
+			PRINT("OK end of file"EOL);
+			error = 1;
+		}
+		else if (hexfeed_record(short_addr, 0, &hexrec))
+		{
+			PRINTF("WARN ignoring rec type %d"EOL, hexrec.type);
+		}
+	} while (0 == error);
+}
+
+static inline void cmd_setchannel(char **params)
+{
+	uint8_t channel;
+	channel = strtol(params[0], NULL, 16);
+	if (wibohost_setchannel(channel))
+	{
+		printok();
+	}
+	else
+	{
+		PRINT("ERR channel out of range"EOL);
+	}
+}
+
+/*
+ * \brief Command to execute wibohost_rendezvous() function
+ *
+ * Returns when the frame is out and the radio is back on the channel
+ * of the host.
+ *
+ * Expected parameters
+ *  (1) rendezvous channel
+ *
+ */
+static inline void cmd_rendezvous(char **params)
+{
+	wait_previous_command();
+	if (0 == wibohost_rendezvous(strtol(params[0], NULL, 16)))
+	{
+		tx_done = 1;
+		PRINT("ERR channel out of range"EOL);
+		return;
+	}
+	while (0 == tx_done)
+		BUSY_WAIT();
+	printok();
+}
+
+static inline void cmd_setpanid(char **params)
+{
+	uint16_t pan_id;
+	pan_id = strtol(params[0], NULL, 16);
+
+	if (wibohost_setpanid(pan_id))
+	{
+		printok();
+	}
+	else
+	{
+		PRINT("ERR setting PAN_ID"EOL);
+	}
+}
+
+/*
+ * \brief Command to execute wibohost_reset() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_reset(char **params)
+{
+	wait_previous_command();
+	wibohost_reset(); /* always reset all nodes */
+	hexfeed_reset(0);
+	printok();
+}
+
+/*
+ * \brief Command to execute wibohost_addr() function
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_addr(char **params)
+{
+	uint16_t short_addr;
+	uint32_t flash_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	flash_addr = strtol(params[1], NULL, 16); /* TODO: possibly 16-bit only ?? */
+
+	wait_previous_command();
+	wibohost_addr(short_addr, flash_addr);
+	hexfeed_reset(flash_addr);
+	printok();
+}
+
+/*
+ * \brief Command to execute wibohost_exit() functions
+ *-       PRINTF("OK panid=0x%04X shortaddr=0x%04X"EOL, cfg->pan_id,
+
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *
+ */
+static inline void cmd_exit(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+
+	wait_previous_command();
+
+	wibohost_exit(short_addr);
+	printok();
+}
+
+/*
+ * \brief Command to execute wibohost_getcrc() functions
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_checkcrc(char **params)
+{
+	PRINTF("OK 0x%04X"EOL, wibohost_getcrc());
+}
+
+/*
+ * \brief Command to echo a string
+ * This is intended to check the UART connection
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_echo(char **params)
+{
+	PRINTF("OK %s"EOL, params[0]);
+}
+
+/*
+ * \brief Command to echo a string
+ * This is intended to check the UART connection
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ */
+static inline void cmd_info(char **params)
+{
+	node_config_t *cfg = wibohost_getnodecfg();
+	PRINTF("OK CHANNEL=0x%02X, PAN_ID=0x%04X, SHORT_ADDR=0x%04X"EOL,
+			cfg->channel, cfg->pan_id, cfg->short_addr);
+}
+
+/*
+ * \brief Set target memory
+ * All calls of feedhex.. work on this target.
+ * Valid values are:
+ *  F : Flash memory
+ *  E : EEPROM
+ *  L : Lock bits
+ *  X : No memory, dry run
+ *
+ */
+static inline void cmd_target(char **params)
+{
+	uint8_t targ = toupper(params[0][0]);
+	if ((targ == 'F') || (targ == 'E') || (targ == 'L') || (targ == 'X'))
+	{
+		wait_previous_command();
+		wibohost_target(0xFFFF, targ);
+		PRINTF("OK memory target set to %c"EOL, targ);
+	}
+	else
+	{
+		PRINTF("ERR memory target unknown: %c"EOL, targ);
+	}
+}
+
+/*
+ * \brief Set target memory of one node
+ * Same as target, e.g. to let all nodes but a few do a dry run
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) target memory
+ *
+ */
+static inline void cmd_ntarget(char **params)
+{
+	uint16_t short_addr;
+	uint8_t targ = toupper(params[1][0]);
+
+	short_addr = strtol(params[0], NULL, 16);
+	if ((targ == 'F') || (targ == 'E') || (targ == 'L') || (targ == 'X'))
+	{
+		wait_previous_command();
+		wibohost_target(short_addr, targ);
+		PRINTF("OK memory target of 0x%04X set to %c"EOL, short_addr, targ);
+	}
+	else
+	{
+		PRINTF("ERR memory target unknown: %c"EOL, targ);
+	}
+}
+
+/*
+ * \brief Command to jump into bootloader
+ * This is used to support an example application where the host does handle the bootloader itself and
+ * an example application residing in the application section of the remote node
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *
+ */
+static inline void cmd_jbootl(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+
+	wait_previous_command();
+	wibohost_jbootl(short_addr);
+	printok();
+}
+
+/*
+ * \brief Update bootloader from start of application section
+ *
+ * @param params Pointer to list of strings containing the arguments
+ *               checking for valid number of arguments is done outside this function
+ *
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *
+ */
+static inline void cmd_bootlup(char **params)
+{
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+
+	wait_previous_command();
+	wibohost_bootlup(short_addr);
+	printok();
+}
+
+/*
+ * \brief Switch data rate of a node and of the host
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) data rate hash code, e.g. 34 for OQPSK1000
+ *
+ */
+static inline void cmd_rate(char **params)
+{
+	uint16_t short_addr;
+	uint8_t rate;
+
+	short_addr = strtol(params[0], NULL, 16);
+	rate = strtol(params[1], NULL, 16);
+
+	wait_previous_command();
+	wibohost_rate(short_addr, rate);
+	while (0 == tx_done)
+		BUSY_WAIT(); /* frame has to go out at the old rate */
+	if (wibohost_setrate(rate))
+	{
+		printok();
+	}
+	else
+	{
+		PRINT("ERR rate not supported"EOL);
+	}
+}
+
+/*
+ * \brief List the PHY profiles of the host radio, one line each
+ */
+static inline void cmd_phylist(char **params)
+{
+	radio_phy_profile_t p;
+	uint8_t i;
+
+	for (i = 0; radio_phy_read(i, &p); i++)
+	{
+		PRINTF(
+				"PHY {'profile':%d, 'name':'%S', 'rate':0x%02X, 'txpwr':%d, " "'ccamode':%d, 'edthres':%d, 'fretries':%d, 'cretries':%d}"EOL,
+				i, radio_phy_name_p(i), p.rate, p.txpwr, p.ccamode, p.edthres,
+				p.fretries, p.cretries);
+	}
+	PRINTF("OK %d"EOL, i);
+}
+
+/*
+ * \brief Switch PHY profile of a node and of the host
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) profile index
+ *  (3) flags, 1: the node keeps the profile after reset
+ *
+ */
+static inline void cmd_physet(char **params)
+{
+	uint16_t short_addr;
+	uint8_t profile;
+
+	short_addr = strtol(params[0], NULL, 16);
+	profile = strtol(params[1], NULL, 16);
+	if (profile >= radio_phy_count())
+	{
+		PRINT("ERR profile not supported"EOL);
+		return;
+	}
+
+	wait_previous_command();
+	wibohost_physet(short_addr, profile, strtol(params[2], NULL, 16));
+	while (0 == tx_done)
+		BUSY_WAIT(); /* frame has to go out with the old profile */
+	wibohost_setphy(profile);
+	printok();
 }
 
-static inline void cmd_setchannel(char **params)
+/*
+ * \brief Query the test frame counters of a node
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) 1: clear the counters after the reply
+ *
+ */
+static inline void cmd_phystats(char **params)
 {
-	uint8_t channel;
-	channel = strtol(params[0], NULL, 16);
-	if (wibohost_setchannel(channel))
-	{
-		printok();
-	}
-	else
-	{
-		PRINT("ERR channel out of range"EOL);
-	}
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
+	wait_previous_command();
+	wibohost_phystats(short_addr, strtol(params[1], NULL, 16));
 }
 
-static inline void cmd_setpanid(char **params)
+/*
+ * \brief Send a burst of test frames back to back
+ *
+ * Prints the number of frames sent and how many of them failed the
+ * channel access.
+ *
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) number of frames
+ *  (3) filler bytes per frame
+ *
+ */
+static inline void cmd_phytest(char **params)
 {
-	uint16_t pan_id;
-	pan_id = strtol(params[0], NULL, 16);
+	uint16_t short_addr, nframes, i, ccafail = 0;
+	uint8_t len;
 
-	if (wibohost_setpanid(pan_id))
-	{
-		printok();
-	}
-	else
+	short_addr = strtol(params[0], NULL, 16);
+	nframes = strtol(params[1], NULL, 16);
+	len = strtol(params[2], NULL, 16);
+
+	for (i = 0; i < nframes; i++)
 	{
-		PRINT("ERR setting PAN_ID"EOL);
+		wait_previous_command();
+		wibohost_phytest(short_addr, i, len);
+		while (0 == tx_done)
+			BUSY_WAIT();
+		if (TX_OK != last_tx_status)
+		{
+			ccafail++;
+		}
 	}
+	PRINTF("OK {'sent':%u, 'ccafail':%u}"EOL, nframes, ccafail);
 }
 
 /*
- * \brief Command to execute wibohost_reset() function
+ * \brief Erase a range of pages without sending data
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) page aligned start address
+ *  (3) number of pages
  *
  */
-static inline void cmd_reset(char **params)
+static inline void cmd_erase(char **params)
 {
+	uint16_t short_addr;
+
+	short_addr = strtol(params[0], NULL, 16);
 	wait_previous_command();
-	wibohost_reset(); /* always reset all nodes */
+	wibohost_erase(short_addr, strtoul(params[1], NULL, 16),
+			strtol(params[2], NULL, 16));
 	printok();
 }
 
 /*
- * \brief Command to execute wibohost_addr() function
+ * \brief Select encoding of the data stream of a node
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) mode, 0: raw, 1: LZSS
  *
  */
-static inline void cmd_addr(char **params)
+static inline void cmd_zmode(char **params)
 {
 	uint16_t short_addr;
-	uint32_t flash_addr;
 
 	short_addr = strtol(params[0], NULL, 16);
-	flash_addr = strtol(params[1], NULL, 16); /* TODO: possibly 16-bit only ?? */
-
 	wait_previous_command();
-	wibohost_addr(short_addr, flash_addr);
+	wibohost_zmode(short_addr, strtol(params[1], NULL, 16), 0, 0);
 	printok();
 }
 
 /*
- * \brief Command to execute wibohost_exit() functions
- *-       PRINTF("OK panid=0x%04X shortaddr=0x%04X"EOL, cfg->pan_id,
-
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
- *
+ * \brief Switch a node to patch mode
  *
  * Expected parameters
  *  (1) short_addr
+ *  (2) length of the installed image the patch was made against
+ *  (3) CRC of the installed image, the node checks it
  *
  */
-static inline void cmd_exit(char **params)
+static inline void cmd_zdelta(char **params)
 {
 	uint16_t short_addr;
 
 	short_addr = strtol(params[0], NULL, 16);
-
 	wait_previous_command();
-
-	wibohost_exit(short_addr);
+	wibohost_zmode(short_addr, P2P_WIBO_ZMODE_DELTA,
+			strtoul(params[1], NULL, 16), strtoul(params[2], NULL, 16));
 	printok();
 }
 
 /*
- * \brief Command to execute wibohost_getcrc() functions
+ * \brief Install the staged image of a node, replies like ping
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Expected parameters
+ *  (1) short_addr
+ *  (2) image length
+ *  (3) image CRC
+ *  (4) image MAC, 32 hex digits
  *
  */
-static inline void cmd_checkcrc(char **params)
+static inline void cmd_commit(char **params)
 {
-	PRINTF("OK 0x%04X"EOL, wibohost_getcrc());
+	uint16_t short_addr;
+	uint8_t mac[16];
+	char hx[3];
+	uint8_t i;
+
+	short_addr = strtol(params[0], NULL, 16);
+	if (strlen(params[3]) != 2 * sizeof(mac))
+	{
+		PRINT("ERR Parameter"EOL);
+		return;
+	}
+	hx[2] = 0;
+	for (i = 0; i < sizeof(mac); i++)
+	{
+		hx[0] = params[3][2 * i];
+		hx[1] = params[3][2 * i + 1];
+		mac[i] = strtoul(hx, NULL, 16);
+	}
+	wait_previous_command();
+	wibohost_commit(short_addr, strtoul(params[1], NULL, 16),
+			strtoul(params[2], NULL, 16), mac);
 }
 
 /*
- * \brief Command to echo a string
- * This is intended to check the UART connection
+ * \brief Let a node pass its committed image on to another one
+ * The relay works on its own, ping it for the result.
  *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * Expected parameters
+ *  (1) short_addr of the relay
+ *  (2) short_addr of the target
+ *  (3) image length
+ *  (4) image CRC
  *
  */
-static inline void cmd_echo(char **params)
+static inline void cmd_relay(char **params)
 {
-	PRINTF("OK %s"EOL, params[0]);
+	wait_previous_command();
+	wibohost_relay(strtol(params[0], NULL, 16), strtol(params[1], NULL, 16),
+			strtoul(params[2], NULL, 16), strtoul(params[3], NULL, 16));
+	printok();
 }
 
 /*
- * \brief Command to echo a string
- * This is intended to check the UART connection
- *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
- *
+ * \brief Switch PHY profile of the host only, used to fall back
  */
-static inline void cmd_info(char **params)
+static inline void cmd_hostphy(char **params)
 {
-	node_config_t *cfg = wibohost_getnodecfg();
-	PRINTF("OK CHANNEL=0x%02X, PAN_ID=0x%04X, SHORT_ADDR=0x%04X"EOL,
-			cfg->channel, cfg->pan_id, cfg->short_addr);
+	/* nothing is sent, so only wait without claiming tx_done */
+	while ((0 == tx_done) || (0 == flashcycle_done))
+		BUSY_WAIT();
+	if (wibohost_setphy(strtol(params[0], NULL, 16)))
+	{
+		printok();
+	}
+	else
+	{
+		PRINT("ERR profile not supported"EOL);
+	}
 }
 
 /*
- * \brief Set target memory
- * All calls of feedhex.. work on this target.
- * Valid values are:
- *  F : Flash memory
- *  E : EEPROM
- *  L : Lock bits
- *  X : No memory, dry run
- *
+ * \brief Switch data rate of the host only, used to fall back
  */
-static inline void cmd_target(char **params)
+static inline void cmd_hostrate(char **params)
 {
-	uint8_t targ = toupper(params[0][0]);
-	if ((targ == 'F') || (targ == 'E') || (targ == 'L') || (targ == 'X'))
+	/* nothing is sent, so only wait without claiming tx_done */
+	while ((0 == tx_done) || (0 == flashcycle_done))
+		BUSY_WAIT();
+	if (wibohost_setrate(strtol(params[0], NULL, 16)))
 	{
-		wibohost_target(0xFFFF, targ);
-		PRINTF("OK memory target set to %c"EOL, targ);
+		printok();
 	}
 	else
 	{
-		PRINTF("ERR memory target unknown: %c"EOL, targ);
+		PRINT("ERR rate not supported"EOL);
 	}
 }
 
+#if defined(ISR_PROFILE)
 /*
- * \brief Command to jump into bootloader
- * This is used to support an example application where the host does handle the bootloader itself and
- * an example application residing in the application section of the remote node
- *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
- *
+ * \brief Print the ISR profile of the host, one line per slot
  *
  * Expected parameters
- *  (1) short_addr
+ *  (1) 1: clear the slots after printing
  *
+ * Times are CPU cycles, hist are the counts of < 64, < 128 ... < 4096
+ * and >= 4096 cycles. late is the maximum latency of the timer ISR.
  */
-static inline void cmd_jbootl(char **params)
+static inline void cmd_isrprof(char **params)
 {
-	uint16_t short_addr;
+	static const char n0[] PROGMEM = "radio";
+	static const char n1[] PROGMEM = "frame_read";
+	static const char n2[] PROGMEM = "timer";
+	static const char n3[] PROGMEM = "uart_rx";
+	static PGM_P const names[ISR_PROF_NSLOTS] PROGMEM = { n0, n1, n2, n3 };
+	isr_prof_t p;
+	uint8_t i, j;
+
+	for (i = 0; i < ISR_PROF_NSLOTS; i++)
+	{
+		isr_prof_get(i, &p);
+		PRINTF("ISR {'slot':%d, 'name':'%S', 'n':%u, 'min':%u, 'max':%u, "
+				"'avg':%lu, 'late':%u, 'hist':[", i,
+				(PGM_P)pgm_read_word(&names[i]), p.count, p.min, p.max,
+				p.count ? p.sum / p.count : 0UL, p.late_max);
+		for (j = 0; j < ISR_PROF_NBINS; j++)
+		{
+			PRINTF("%s%u", j ? "," : "", p.hist[j]);
+		}
+		PRINT("]}"EOL);
+	}
+	if (strtol(params[0], NULL, 16) & 1)
+	{
+		isr_prof_reset();
+	}
+	PRINTF("OK %d"EOL, ISR_PROF_NSLOTS);
+}
+#endif
 
-	short_addr = strtol(params[0], NULL, 16);
+#if defined(STACK_WATCH)
+/*
+ * \brief Print the SRAM use of the host, see stack_watch.h
+ *
+ * Sizes in bytes: data is .data and .bss, peak the deepest stack since
+ * reset, unused the SRAM the stack never reached, free the SRAM between
+ * .bss and the stack now.
+ */
+static inline void cmd_stack(char **params)
+{
+	stack_watch_t st;
 
-	wait_previous_command();
-	wibohost_jbootl(short_addr);
-	printok();
+	stack_watch_get(&st);
+	PRINTF("OK {'data':%u, 'peak':%u, 'unused':%u, 'free':%u, 'ramsize':%u}"EOL,
+			st.data, st.peak, st.unused, st.free, RAMEND + 1 - RAMSTART);
 }
+#endif
 
+#if defined(P2P_MESH)
 /*
- * \brief Update bootloader from start of application section
- *
- * @param params Pointer to list of strings containing the arguments
- *               checking for valid number of arguments is done outside this function
+ * \brief Called when the route request of cmd_route() ends
+ */
+void cb_wibohost_routedone(uint16_t short_addr, uint16_t next, uint8_t hops)
+{
+	if (0xFFFF == next)
+	{
+		PRINTF("ERR no route to 0x%04X"EOL, short_addr);
+	}
+	else
+	{
+		PRINTF("OK {'short_addr':0x%04X, 'next':0x%04X, 'hops':%d}"EOL,
+				short_addr, next, hops);
+	}
+	route_done = 1;
+}
+
+/*
+ * \brief Command to find a route to a node through the mesh
  *
+ * Blocks until the route request ends.
  *
  * Expected parameters
- *  (1) short_addr
- *
+ *  (1) short address of the node
  */
-static inline void cmd_bootlup(char **params)
+static inline void cmd_route(char **params)
 {
-	uint16_t short_addr;
-
-	short_addr = strtol(params[0], NULL, 16);
-
 	wait_previous_command();
-	wibohost_bootlup(short_addr);
-	printok();
+	route_done = 0;
+	wibohost_route(strtol(params[0], NULL, 16));
+	while (0 == route_done)
+		BUSY_WAIT();
 }
+#endif
 
 static inline void cmd_xmplled(char **params)
 {
@@ -545,20 +2100,69 @@ const struct
 {
 { "addr", cmd_addr, 2, "Set flash target address of node" },
 { "ping", cmd_ping, 1, "Ping a node" },
+{ "discover", cmd_discover, 2, "Collect ping replies of all nodes" },
+{ "pingshort", cmd_pingshort, 2, "Poll version, CRC and status of nodes" },
+{ "batch", cmd_batch, 1, "Send discover and pingshort replies as one block" },
+{ "progress", cmd_progress, 1, "Print (and stream every n ms) the update progress" },
+#if defined(P2P_MESH)
+{ "route", cmd_route, 1, "Find a route to a node through the mesh" },
+#endif
+#if defined(ISR_PROFILE)
+{ "isrprof", cmd_isrprof, 1, "Print (1: and clear) the ISR profile" },
+#endif
+#if defined(STACK_WATCH)
+{ "stack", cmd_stack, 0, "Print stack peak and free SRAM" },
+#endif
+#if defined(RADIO_SCAN)
+{ "chscan", cmd_chscan, 2, "Rank channels by energy and traffic" },
+#endif
+{ "resume", cmd_resume, 1, "Query checkpoint of broken update" },
+{ "resumeat", cmd_resumeat, 3, "Continue broken update at checkpoint" },
 { "deaf", cmd_deaf, 1, "Set a node to deaf" },
 { "finish", cmd_finish, 1, "Finish a node (force write)" },
 { "feedhex", cmd_feedhexline, 2, "Feed a line of hex file to a node" },
 { "feedhexfile", cmd_feedhexfile, 1, "Feed hex file to a node" },
+{ "qfeed", cmd_qfeedhexline, 2, "Queue a line of hex file for a node" },
+{ "sopen", cmd_sopen, 2, "Open a session on channel and PAN_ID" },
+{ "sclose", cmd_sclose, 1, "Close a session" },
+{ "sreset", cmd_sreset, 1, "Queue reset of session nodes" },
+{ "saddr", cmd_saddr, 3, "Queue flash target address for session node" },
+{ "sfeed", cmd_sfeed, 3, "Queue a line of hex file for session node" },
+{ "sfinish", cmd_sfinish, 2, "Queue finish of session node" },
+{ "sexit", cmd_sexit, 2, "Queue exit of session node" },
+{ "scrc", cmd_scrc, 1, "Get data CRC of session" },
+{ "sflush", cmd_sflush, 0, "Wait for all session frames" },
+{ "feedseq", cmd_feedseq, 3, "Feed a numbered line of hex file" },
+{ "window", cmd_window, 1, "Query received frames of a node" },
+{ "fecstat", cmd_fecstat, 1, "Query decoded blocks of a node" },
+{ "rtt", cmd_rtt, 1, "Show round trip time and timeout of a node (us)" },
+{ "mcclear", cmd_mcclear, 0, "Clear multicast session" },
+{ "mcadd", cmd_mcadd, 1, "Add a node to multicast session" },
+{ "mcpoll", cmd_mcpoll, 1, "Merge missing frames of session nodes" },
 { "reset", cmd_reset, 0, "Reset a node" },
 { "exit", cmd_exit, 1, "Exit node bootloader" },
 { "crc", cmd_checkcrc, 0, "Get data CRC" },
 { "echo", cmd_echo, 1, "Echo a string" },
 { "info", cmd_info, 0, "Information about myself" },
 { "target", cmd_target, 1, "Set target memory" },
+{ "ntarget", cmd_ntarget, 2, "Set target memory of a node" },
 { "jbootl", cmd_jbootl, 1, "Jump into bootloader" },
 { "bootlup", cmd_bootlup, 1, "Update Bootloader" },
 { "channel", cmd_setchannel, 1, "Set radio channel" },
+{ "rendezvous", cmd_rendezvous, 1, "Call nodes on a rendezvous channel to ours" },
 { "panid", cmd_setpanid, 1, "Set radio PAN_ID" },
+{ "rate", cmd_rate, 2, "Switch data rate of node and host" },
+{ "hostrate", cmd_hostrate, 1, "Switch data rate of host" },
+{ "phylist", cmd_phylist, 0, "List PHY profiles" },
+{ "physet", cmd_physet, 3, "Switch PHY profile of node and host" },
+{ "hostphy", cmd_hostphy, 1, "Switch PHY profile of host" },
+{ "phystats", cmd_phystats, 2, "Query test frame counters of node" },
+{ "phytest", cmd_phytest, 3, "Send a burst of test frames" },
+{ "erase", cmd_erase, 3, "Erase pages of node" },
+{ "commit", cmd_commit, 4, "Verify and install the staged image" },
+{ "relay", cmd_relay, 4, "Let a node pass its image on to another" },
+{ "zmode", cmd_zmode, 2, "Select data stream encoding of node" },
+{ "zdelta", cmd_zdelta, 3, "Select patch stream for node" },
 { "xmplled", cmd_xmplled, 3, "Example of application: Set LED" },
 { "?", cmd_help, 0, "Help on commands" }, };
 
@@ -572,22 +2176,111 @@ static inline void cmd_help(char **params)
 	}
 }
 
+#define NB_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+/* hashes of the command names, filled at the first command */
+static uint8_t cmdhash[NB_COMMANDS];
+static uint8_t cmdhash_valid = 0;
+
+/*
+ * \brief Hash of a command name, not case sensitive
+ * Same function as get_cmd_hash() of the sniffer
+ */
+static uint8_t cmd_hash(const char *cmd)
+{
+	uint8_t h = 0;
+
+	while (*cmd)
+	{
+		h = ((h << 5) | (h >> 3)) ^ tolower(*cmd++);
+	}
+	return h;
+}
+
+/*
+ * \brief Split a command line in place into tokens
+ *
+ * The spaces after the tokens are replaced by terminating zeros, the
+ * line is NULL terminated and at most MAXLINELEN long.
+ *
+ * @param ln Command line
+ * @param params Pointers to the tokens, MAXPARAMS entries
+ * @return Number of tokens, MAXPARAMS + 1 if there are more
+ */
+static uint8_t split_cmdline(char *ln, char **params)
+{
+	uint8_t n = 0;
+
+	for (;;)
+	{
+		while (' ' == *ln)
+		{
+			ln++;
+		}
+		if (0 == *ln)
+		{
+			return n;
+		}
+		if (MAXPARAMS == n)
+		{
+			return MAXPARAMS + 1;
+		}
+		params[n++] = ln;
+		while ((0 != *ln) && (' ' != *ln))
+		{
+			ln++;
+		}
+		if (0 != *ln)
+		{
+			*ln++ = 0;
+		}
+	}
+}
+
 /*
  * \brief Parsing a shell input line
  *
+ * The command is looked up by the hash of its name, the name is only
+ * compared for a matching hash.
+ *
  * @param *ln String containing the command line to parse
  */
 static inline void process_cmdline(char *ln)
 {
-	char *params[10];
+	char *params[MAXPARAMS];
 	uint8_t nbparams;
-	uint8_t i;
+	uint8_t i, h;
 
-	nbparams = hif_split_args(ln, 10, params);
-	for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+	if (!cmdhash_valid)
+	{
+		for (i = 0; i < NB_COMMANDS; i++)
+		{
+			cmdhash[i] = cmd_hash(commands[i].name);
+		}
+		cmdhash_valid = 1;
+	}
+
+	nbparams = split_cmdline(ln, params);
+	if (0 == nbparams)
+	{
+		return;
+	}
+	if (nbparams > MAXPARAMS)
 	{
-		if (!strcasecmp(params[0], commands[i].name))
+		PRINT("ERR Parameter"EOL);
+		return;
+	}
+
+	h = cmd_hash(params[0]);
+	for (i = 0; i < NB_COMMANDS; i++)
+	{
+		if ((cmdhash[i] == h) && !strcasecmp(params[0], commands[i].name))
 		{
+			if ((cmd_feedhexline != commands[i].execfunc)
+					&& (cmd_qfeedhexline != commands[i].execfunc))
+			{
+				hexfeed_flush();
+			}
 			if (commands[i].nbparams < nbparams)
 			{ /* comparison including the command itself */
 				commands[i].execfunc(&params[1]);
@@ -601,17 +2294,90 @@ static inline void process_cmdline(char *ln)
 	}
 
 	/* i > than size of list: did not find anything */
-	if ((sizeof(commands) / sizeof(commands[0])) == i)
+	if (NB_COMMANDS == i)
 	{
 		PRINT("ERR Unknown command"EOL);
 	}
 }
 
+/*
+ * \brief Process a binary frame
+ *
+ * Image data are taken raw, without parsing hex text
+ */
+static inline void process_binframe(void)
+{
+	uint8_t i, len;
+	uint16_t crc;
+	uint16_t short_addr;
+
+	len = binbuf[BINFRAME_HDRLEN - 1];
+	i = BINFRAME_HDRLEN + len;
+	crc = crc_ccitt_block(0xFFFF, binbuf, i);
+	if (crc != (binbuf[i] | (binbuf[i + 1] << 8)))
+	{
+		PRINT("ERR frame crc"EOL);
+		return;
+	}
+
+	short_addr = binbuf[1] | (binbuf[2] << 8);
+	if ((BINFRAME_TYPE_FEED == binbuf[0]) && (len > 0))
+	{
+		hexfeed_select(short_addr, 0);
+		hexfeed_put(&binbuf[BINFRAME_HDRLEN], len);
+		feed_reply();
+	}
+	else if ((BINFRAME_TYPE_QFEED == binbuf[0]) && (len > 0))
+	{
+		hexfeed_select(short_addr, 1);
+		hexfeed_put(&binbuf[BINFRAME_HDRLEN], len);
+		qfeed_reply();
+	}
+	else if ((BINFRAME_TYPE_FEEDSEQ == binbuf[0]) && (len > 2))
+	{
+		hexfeed_flush();
+		wait_previous_command();
+
+		flashcycle_done = 0; /* set explicitely */
+		if (0 == wibohost_feedseq(short_addr,
+				binbuf[BINFRAME_HDRLEN] | (binbuf[BINFRAME_HDRLEN + 1] << 8),
+				&binbuf[BINFRAME_HDRLEN + 2], len - 2))
+		{
+			flashcycle_done = 1;
+		}
+		printok();
+	}
+	else if ((BINFRAME_TYPE_FEC == binbuf[0]) && (len == BINFRAME_MAXDATA))
+	{
+		uint8_t *p = &binbuf[BINFRAME_HDRLEN];
+
+		hexfeed_flush();
+		wait_previous_command();
+
+		wibohost_fec(short_addr, p[0] | (p[1] << 8), p[2] | (p[3] << 8),
+				(uint32_t) p[4] | ((uint32_t) p[5] << 8)
+				| ((uint32_t) p[6] << 16) | ((uint32_t) p[7] << 24),
+				&p[8]);
+		printok();
+	}
+	else
+	{
+		PRINTF("ERR frame type 0x%02X"EOL, binbuf[0]);
+	}
+}
+
 void cmdif_task(void)
 {
-	if (getline())
+	switch (getline())
 	{
+	case 1:
 		process_cmdline((char*) lnbuf);
+		break;
+	case 2:
+		process_binframe();
+		break;
+	default:
+		break;
 	}
 }
 
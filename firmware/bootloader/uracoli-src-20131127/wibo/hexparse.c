@@ -87,16 +87,22 @@ static inline uint16_t hto16Bit(char c3, char c2, char c1, char c0)
 
 /*
  * \brief Parse a line from intel hex file
+ *
+ * @return 1 for a complete record with valid checksum, 0 else
  */
 uint8_t parsehexline(uint8_t *ln, hexrec_t *rec)
 {
 	uint8_t i = 0;
 	hexparse_state_t state = PIVOT;
 	uint8_t cnt = 0;
+	uint8_t sum;
 	uint8_t tmp[4]; /* maximum number of digits for 16-bit integer */
 
 	while( (cnt < 4) && (0 != (tmp[cnt] = *ln++)) && (INVALID != state) && (VALID != state)){
 		cnt++;
+		if((PIVOT != state) && !isxdigit(tmp[cnt - 1])){
+			state = INVALID;
+		}
 		switch(state){
 		case PIVOT:
 			if((1 == cnt) && (tmp[0] == ':')){
@@ -109,7 +115,11 @@ uint8_t parsehexline(uint8_t *ln, hexrec_t *rec)
 		case LENGTH:
 			if(2 == cnt){
 				rec->len = hto8Bit(tmp[0], tmp[1]);
-				state = ADDRESS;
+				if(rec->len > sizeof(rec->data)){
+					state = INVALID;
+				}else{
+					state = ADDRESS;
+				}
 				cnt = 0;
 			}
 			break;
@@ -141,7 +151,7 @@ uint8_t parsehexline(uint8_t *ln, hexrec_t *rec)
 			}
 			break;
 		case CHECKSUM:
-			if(1 == cnt){
+			if(2 == cnt){
 				rec->checksum = hto8Bit(tmp[0], tmp[1]);
 				state = VALID;
 			}
@@ -152,9 +162,40 @@ uint8_t parsehexline(uint8_t *ln, hexrec_t *rec)
 		}
 	}
 
-	/* TODO: validate checksum */
+	if(VALID != state){
+		return 0;
+	}
 
-	return (VALID == state);
+	/* all bytes of the record including the checksum add up to 0 */
+	sum = rec->len + (rec->addr >> 8) + rec->addr + rec->type + rec->checksum;
+	for(i = 0; i < rec->len; i++){
+		sum += rec->data[i];
+	}
+	return (0 == sum);
+}
+
+/*
+ * \brief Track the upper address bits of a hex file
+ *
+ * @param rec Parsed record
+ * @param base Upper address bits, to be set to 0 at the start of a file
+ * @return 1 if rec is an extended segment or linear address record,
+ *         *base is updated then, 0 for any other record
+ *
+ * A data record starts at *base + rec->addr
+ */
+uint8_t hexrec_base(hexrec_t *rec, uint32_t *base)
+{
+	uint32_t upper = ((uint16_t)rec->data[0] << 8) | rec->data[1];
+
+	if ((HEX_RECTYPE_EXTSEGMENT_ADDR == rec->type) && (2 == rec->len)){
+		*base = upper << 4;
+	}else if ((HEX_RECTYPE_EXTLINEAR_ADDR == rec->type) && (2 == rec->len)){
+		*base = upper << 16;
+	}else{
+		return 0;
+	}
+	return 1;
 }
 
 /* EOF */
@@ -59,5 +59,6 @@ typedef struct{
 }hexrec_t;
 
 uint8_t parsehexline(uint8_t *ln, hexrec_t *rec);
+uint8_t hexrec_base(hexrec_t *rec, uint32_t *base);
 
 #endif /* HEXPARSE_H */
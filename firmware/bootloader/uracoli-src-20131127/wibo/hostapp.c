@@ -57,6 +57,7 @@ int main()
 	timer_init();
 
 	wibohost_init();
+	pm_set_active(PM_HIF | PM_TIMER | PM_RADIO);
 
 	sei();
 
@@ -68,7 +69,14 @@ int main()
 			);
 
 	for (;;) {
+		timer_task();
 		cmdif_task();
+		wibohost_task();
+		if (wibohost_queue_pending() == 0)
+		{
+			/* queued frames go out pass by pass */
+			pm_idle();
+		}
 	}
 }
 
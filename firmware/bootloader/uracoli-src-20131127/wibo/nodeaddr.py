@@ -40,10 +40,25 @@ Dumps a intel hex file for a node config structure.
      -b BOOTLOADER
         Name of IHEX file to be used as bootloader, e.g. wibo_<board>.hex
         where <board> is replaced by the current value.
+        Both can also be image containers (see wiboimage.py).
      -o NEWHEXFILE
         Name of the outputfile, if '-' stdout is used.
         e.g. "foo_<board>_<saddr>.hex", where <board> and <saddr> are replaced
-        by the current values.
+        by the current values. A name ending in .wimg is written as image
+        container for wibohost.py and stkflash.py.
+     -e EEPHEXFILE
+        Also write the Pinoccio EEPROM map (8130-8191: HQ token, security
+        key, tx power, channel, pan id, short and ieee address) as IHEX
+        file, the name is expanded like with -o.
+
+     -X CSVFILE
+        Batch mode, create the files for all nodes listed in CSVFILE.
+        The first line names the columns, short_addr is needed, optional
+        are pan_id, channel, ieee_addr, board, firmware, bootloader,
+        txpower, token and key. Empty or missing columns are taken from
+        the command line or the config file. -o (and -e) must contain <saddr>.
+     -j JOBS
+        Number of worker processes in batch mode (default: number of CPUs).
 
      -h
         Display help and exit.
@@ -75,13 +90,19 @@ Example:
   - Flash the record w/o erasing
     python nodeaddr.py -a 1 | avrdude -P usb -p m1281 -c jtag2 -V -D -U fl:w:-:i
 
+  - Flash and EEPROM images for all boards of a production lot.
+     python nodeaddr.py -B pinoccio -f app.hex -b boot.hex -X lot42.csv \\
+            -o out/node_<saddr>.hex -e out/eep_<saddr>.hex
+
 
    Writes source address 1 into the device via a pipe to avrdude.
 
 """
 
 # === import ==================================================================
-import struct, getopt, sys, ConfigParser, os
+import struct, getopt, sys, ConfigParser, os, csv
+from wiboimage import is_image, read_image, write_image, image_hexlines, \
+     hex_mem, mem_pages
 try:
     import Tkinter
 except:
@@ -89,12 +110,16 @@ except:
 
 # === globals =================================================================
 VERSION = "20131127"
+IMAGE_SUFFIX = ".wimg"
 
 
 # I/O file parameters
 INFILE = None
 BOOTLOADER = None
 OUTFILE = None
+EEPFILE = None
+BATCHFILE = None
+JOBS = None
 
 # contents of the config records
 PANID = None
@@ -114,7 +139,8 @@ DEFAULTS = {
     "ieee_addr":  0xffffffffffffffffL,
     "channel":    0xff,
     "board": None,
-    "offset": None
+    "offset": None,
+    "txpower": 0
 }
 
 # Tables
@@ -266,6 +292,19 @@ outfile = /tmp/node_<saddr>.hex
 [bootloader]
 default = install/bin/wibo_<board>.hex
 
+# Pinoccio EEPROM map (option -e), token and key are optional.
+[txpower]
+default = 0
+
+[token]
+#1 = 0123456789abcdef0123456789abcdef
+
+[key]
+#default = 000102030405060708090a0b0c0d0e0f
+
+#[eeprom]
+#outfile = /tmp/eep_<saddr>.hex
+
 #[offset]
 #ravengang=0x00
 """
@@ -273,6 +312,13 @@ default = install/bin/wibo_<board>.hex
 # payload of record w/o crc
 NODE_CONFIG_FMT ="<HHQB2x"
 
+# Pinoccio EEPROM map, see bootloader/src/nodecfg.h and main.c
+EEPROM_MAP_START = 8130
+EEPROM_TOKEN_SIZE = 32
+EEPROM_KEY_SIZE = 16
+# tx power, channel, pan_id, short_addr, ieee_addr
+EEPROM_NODECFG_FMT = "<BBHHQ"
+
 
 # === functions ===============================================================
 ##
@@ -442,7 +488,10 @@ def get_flashend_offset_for_node_config(mmcu):
 #           address, where to locate the record
 #           Per default memaddr=None and the location FLASHEND is
 #           used.
-def generate_nodecfg_record(memaddr):
+def generate_nodecfg_record(memaddr, node = None):
+    if node == None:
+        node = dict(short_addr = SADDR, pan_id = PANID, ieee_addr = LADDR,
+                    channel = CHANNEL)
     ret = []
     # payload of record w/o crc
     extaddr = (memaddr >> 16)
@@ -452,33 +501,237 @@ def generate_nodecfg_record(memaddr):
         # :02 0000 02 1000 EC
         data = map(ord, struct.pack("<H",extaddr<<4))
         ret.append(ihex_record(2, 0, data))
-    data = map(ord,struct.pack(NODE_CONFIG_FMT, SADDR, PANID, LADDR, CHANNEL))
+    data = map(ord,struct.pack(NODE_CONFIG_FMT, node["short_addr"],
+                node["pan_id"], node["ieee_addr"], node["channel"]))
     crc8 = ibutton_crc( data )
     data.append(crc8)
     ret.append(ihex_record(0, memaddr, data))
     return ret
 
+##
+# The lines of an IHEX file, of an image container its records.
+#
+def read_hexfile_lines(fname):
+    if is_image(fname):
+        return [l + "\n" for l in image_hexlines(read_image(fname)["segs"])]
+    fi = open(fname, "r")
+    lines = fi.readlines()
+    fi.close()
+    return lines
+
+##
+# Write IHEX records as image container, see wiboimage.py.
+#
+def write_image_file(fname, lines, board):
+    name = os.path.splitext(os.path.basename(fname))[0]
+    write_image(fname, mem_pages(hex_mem(lines)), name, board or "")
+
 ##
 # add a node cofg structure at the end of the flash.
 #
 def patch_hexfile(appfiles, fo, offset):
     END_RECORD = ":00000001FF"
+    lines = []
     for ifile in appfiles:
         if ifile != None:
-            fi = open(ifile,"r")
-            for l in fi.xreadlines():
+            for l in read_hexfile_lines(ifile):
                 if l.find(END_RECORD) == 0:
                     # end record found
                     break
-                # write regular record
-                fo.write(l)
-            fi.close()
+                # regular record
+                lines.append(l)
     nodecfg = generate_nodecfg_record(offset)
-    fo.write("\n".join(nodecfg)+"\n")
-    fo.write(END_RECORD)
+    lines.append("\n".join(nodecfg)+"\n")
+    lines.append(END_RECORD)
+    if fo != sys.stdout and fo.name.endswith(IMAGE_SUFFIX):
+        fo.close()
+        write_image_file(fo.name, "".join(lines).split("\n"), BOARD)
+        return
+    fo.write("".join(lines))
+    if fo != sys.stdout:
+        fo.close()
+
+##
+# The Pinoccio EEPROM map of a node as IHEX records.
+#
+# @param node
+#           dict with short_addr, pan_id, ieee_addr, channel, txpower,
+#           token (string, up to 32 chars) and key (32 hex digits),
+#           token and key may be None and are left erased then.
+#
+def generate_eeprom_records(node):
+    token = node.get("token") or ""
+    if len(token) > EEPROM_TOKEN_SIZE:
+        raise ValueError("token longer than %d chars" % EEPROM_TOKEN_SIZE)
+    data = map(ord, token) + [0xff] * (EEPROM_TOKEN_SIZE - len(token))
+    key = node.get("key")
+    if key:
+        key = key.replace(":", "").replace(" ", "")
+        if len(key) != 2 * EEPROM_KEY_SIZE:
+            raise ValueError("key needs %d hex digits" % (2 * EEPROM_KEY_SIZE))
+        data += [int(key[i:i + 2], 16) for i in range(0, len(key), 2)]
+    else:
+        data += [0xff] * EEPROM_KEY_SIZE
+    data += map(ord, struct.pack(EEPROM_NODECFG_FMT, node["txpower"],
+                node["channel"], node["pan_id"], node["short_addr"],
+                node["ieee_addr"]))
+    ret = []
+    for i in range(0, len(data), 16):
+        ret.append(ihex_record(0, EEPROM_MAP_START + i, data[i:i + 16]))
+    ret.append(":00000001FF")
+    return ret
+
+def write_eeprom_hexfile(node, fname):
+    fo = sys.stdout if fname == "-" else open(fname, "w")
+    fo.write("\n".join(generate_eeprom_records(node)) + "\n")
     if fo != sys.stdout:
         fo.close()
 
+# === batch mode ==============================================================
+# Records of the firmware and bootloader files w/o end record, each file is
+# read once per process. The pool workers are forked after the parent has
+# filled the cache, so usually they find everything here.
+HEXCACHE = {}
+
+def get_hexfile_body(fname):
+    if fname == None:
+        return ""
+    body = HEXCACHE.get(fname)
+    if body == None:
+        lines = []
+        for l in read_hexfile_lines(fname):
+            if l.find(":00000001FF") == 0:
+                break
+            lines.append(l)
+        body = HEXCACHE[fname] = "".join(lines)
+    return body
+
+def parse_value(v):
+    """numbers as in the config file, ieee addresses also as 12:34:..:f0"""
+    v = v.strip()
+    if ":" in v:
+        return int(v.replace(":", ""), 16)
+    return eval(v)
+
+def expand_name(pattern, node):
+    return pattern.replace("<saddr>", "0x%04X" % node["short_addr"]).\
+                   replace("<board>", str(node["board"]))
+
+##
+# Resolve the parameters of one node of the batch file, the columns
+# of the CSV row take precedence over the command line, the command
+# line over the config file.
+#
+def resolve_batch_node(cfg, group_keys, row):
+    saddr = parse_value(row["short_addr"])
+    addr_key = "%d" % saddr
+    group_key = group_keys.get(addr_key)
+    def value(sect, cmdline, raw = False):
+        v = (row.get(sect) or "").strip()
+        if v:
+            return v if raw else parse_value(v)
+        if cmdline != None:
+            return cmdline
+        if raw:
+            curr_sect = cfg.get(sect, {})
+            return curr_sect.get(addr_key, curr_sect.get(group_key,
+                                 curr_sect.get("default")))
+        return resolve_value(cfg, sect, addr_key, group_key)
+    node = dict(short_addr = saddr, addr_key = addr_key)
+    node["pan_id"] = value("pan_id", PANID)
+    node["ieee_addr"] = value("ieee_addr", LADDR)
+    if isinstance(node["ieee_addr"], str):
+        node["ieee_addr"] = parse_value(node["ieee_addr"])
+    node["channel"] = value("channel", CHANNEL)
+    node["board"] = value("board", BOARD, raw = True)
+    node["txpower"] = value("txpower", None)
+    node["token"] = value("token", None, raw = True)
+    node["key"] = value("key", None, raw = True)
+    node["offset"] = OFFSET
+    if node["offset"] == None:
+        node["offset"] = resolve_value(cfg, "offset", addr_key, group_key)
+    if node["offset"] == None:
+        mmcu = MMCU_TABLE.get(node["board"], MMCU if node["board"] == "??" else None)
+        if mmcu not in FLASHEND:
+            raise ValueError("can not determine offset for board %s" % node["board"])
+        node["offset"] = get_flashend_offset_for_node_config(mmcu)
+    for sect, cmdline in (("firmware", INFILE), ("bootloader", BOOTLOADER)):
+        fname = value(sect, cmdline, raw = True)
+        if fname != None:
+            fname = fname.replace("<board>", str(node["board"]))
+            if not os.path.exists(fname):
+                raise ValueError("%s file '%s' not found" % (sect, fname))
+        node[sect] = fname
+    return node
+
+def batch_worker(node):
+    """create the files of one node, runs in a pool process"""
+    body = get_hexfile_body(node["firmware"]) + \
+           get_hexfile_body(node["bootloader"]) + \
+           "\n".join(generate_nodecfg_record(node["offset"], node)) + "\n" + \
+           ":00000001FF"
+    if node["outfile"].endswith(IMAGE_SUFFIX):
+        write_image_file(node["outfile"], body.split("\n"), node["board"])
+    else:
+        fo = open(node["outfile"], "w")
+        fo.write(body)
+        fo.close()
+    if node.get("eepfile"):
+        write_eeprom_hexfile(node, node["eepfile"])
+    return node["outfile"]
+
+def run_batch(csvfile, outfile, eepfile, jobs):
+    cfg = dict([(s,dict(CFGP.items(s))) for s in CFGP.sections()])
+    group_keys = resolve_groups(cfg)
+    if outfile == None:
+        outfile = cfg.get("firmware", {}).get("outfile")
+    if eepfile == None:
+        eepfile = cfg.get("eeprom", {}).get("outfile")
+    for pattern in (outfile, eepfile):
+        if pattern != None and pattern.find("<saddr>") < 0:
+            print "Failure: output name '%s' needs <saddr> in batch mode" % pattern
+            sys.exit(2)
+    if outfile == None:
+        print "Failure: no output name, use -o or [firmware] outfile"
+        sys.exit(2)
+    # resolve and check every node before the first file is written
+    nodes = []
+    f = open(csvfile, "rb")
+    for lineno, row in enumerate(csv.DictReader(f)):
+        if not (row.get("short_addr") or "").strip():
+            continue
+        try:
+            node = resolve_batch_node(cfg, group_keys, row)
+            if eepfile != None:
+                generate_eeprom_records(node)
+        except Exception, e:
+            print "Failure: %s line %d: %s" % (csvfile, lineno + 2, e)
+            sys.exit(3)
+        node["outfile"] = expand_name(outfile, node)
+        if eepfile != None:
+            node["eepfile"] = expand_name(eepfile, node)
+        nodes.append(node)
+    f.close()
+    # the images shared by all nodes are parsed here, before the fork
+    for node in nodes:
+        get_hexfile_body(node["firmware"])
+        get_hexfile_body(node["bootloader"])
+    try:
+        import multiprocessing
+        if jobs == None:
+            jobs = multiprocessing.cpu_count()
+    except (ImportError, NotImplementedError):
+        multiprocessing = None
+        jobs = 1
+    if jobs > 1 and len(nodes) > 1:
+        pool = multiprocessing.Pool(jobs)
+        done = pool.map(batch_worker, nodes, chunksize = 16)
+        pool.close()
+        pool.join()
+    else:
+        done = map(batch_worker, nodes)
+    sys.stderr.write("created %d node images (%d jobs)\n" % (len(done), jobs))
+
 def list_boards():
     bl = MMCU_TABLE.keys()
     bl.sort()
@@ -562,7 +815,7 @@ except:
 
 if __name__ == "__main__":
     try:
-        opts,args = getopt.getopt(sys.argv[1:],"a:p:A:f:b:hvo:c:O:B:lLM:C:G")
+        opts,args = getopt.getopt(sys.argv[1:],"a:p:A:f:b:hvo:c:O:B:lLM:C:Ge:X:j:")
     except:
         msg = "=" * 80 +\
               "\nInvalid arguments. Please try python %s -h.\n" +\
@@ -628,6 +881,12 @@ if __name__ == "__main__":
             doexit = True
         elif o == "-o":
             OUTFILE = v
+        elif o == "-e":
+            EEPFILE = v
+        elif o == "-X":
+            BATCHFILE = v
+        elif o == "-j":
+            JOBS = int(v)
         elif o == "-O":
             OFFSET = eval(v)
 
@@ -637,8 +896,23 @@ if __name__ == "__main__":
     if os.path.isfile(CFGFILE):
         CFGP.read(CFGFILE)
 
+    if BATCHFILE != None:
+        run_batch(BATCHFILE, OUTFILE, EEPFILE, JOBS)
+        sys.exit(0)
+
     resolve_parameters()
     patch_hexfile([INFILE, BOOTLOADER], OUTFILE, OFFSET)
+    if EEPFILE != None:
+        TXPOWER = resolve_value(dict([(s,dict(CFGP.items(s))) for s in CFGP.sections()]),
+                                "txpower", "%d" % SADDR)
+        write_eeprom_hexfile(dict(short_addr = SADDR, pan_id = PANID,
+                    ieee_addr = LADDR, channel = CHANNEL, txpower = TXPOWER,
+                    token = CFGP.has_option("token", "%d" % SADDR) and \
+                            CFGP.get("token", "%d" % SADDR) or None,
+                    key = CFGP.has_option("key", "%d" % SADDR) and \
+                          CFGP.get("key", "%d" % SADDR) or None,
+                    board = BOARD),
+                    expand_name(EEPFILE, dict(short_addr = SADDR, board = BOARD)))
 
     try:
         import readline, rlcompleter
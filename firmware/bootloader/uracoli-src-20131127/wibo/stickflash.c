@@ -0,0 +1,850 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Standalone field flasher, multicasts an image container from a
+ * USB stick to the nodes in range
+ *
+ * Runs on an AVR with USB host (rzusb, AT90USB1287), no PC needed. When
+ * a stick is plugged in, the first file with the short name extension
+ * WIM (APP.WIMG from wiboimage.py, copied to the root directory of a
+ * FAT16 or FAT32 stick) is opened. The nodes get a jump to the
+ * bootloader, are discovered and those of the image's board are flashed
+ * in one multicast session, as "wibohost.py -U FILE -w" does. The image
+ * is read from the stick while the previous frame is in the air and the
+ * nodes flash. A cache of STICKFLASH_CACHE_BLOCKS blocks is filled with
+ * one READ(10) per run of contiguous clusters, so a window of frames and
+ * its retransmissions are served from SRAM. The CRC of the staged image in the header is
+ * checked before the nodes are told to finish and start the application.
+ *
+ * Containers with IMG_FLAG_ZLIB or IMG_FLAG_DELTA are refused, a
+ * signature is not used. The yellow LED is on while the stick is read
+ * and the nodes are flashed, then green tells all nodes were flashed,
+ * red that the stick, the image or a node failed. Pull the stick to
+ * start over.
+ *
+ * @ingroup grpAppWiBo
+ */
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+#include <LUFA/Drivers/USB/USB.h>
+#include <LUFA/Drivers/USB/Class/MassStorage.h>
+
+#include <board.h>
+#include <ioutil.h>
+#include <timer.h>
+#include <radio.h>
+#include <crc_fast.h>
+#include <p2p_protocol.h>
+
+#include "wibohost.h"
+
+/* size of a block of the stick, others are refused */
+#define BLOCKSIZE (512)
+
+/* blocks read ahead, one window of frames with the default size */
+#ifndef STICKFLASH_CACHE_BLOCKS
+#define STICKFLASH_CACHE_BLOCKS (4)
+#endif
+
+/* image data per frame, a divider of the page size */
+#ifndef STICKFLASH_FRAME
+#define STICKFLASH_FRAME (64)
+#endif
+
+/* segments of the page map */
+#ifndef STICKFLASH_MAXSEGS
+#define STICKFLASH_MAXSEGS (16)
+#endif
+
+/* discovery: rounds, reply slots per round */
+#ifndef STICKFLASH_ROUNDS
+#define STICKFLASH_ROUNDS (3)
+#endif
+#ifndef STICKFLASH_SLOTS
+#define STICKFLASH_SLOTS (16)
+#endif
+
+/* start of the bootloader after the jump command */
+#ifndef STICKFLASH_JBOOTL_MS
+#define STICKFLASH_JBOOTL_MS (500)
+#endif
+
+/* polls without progress before the session is given up */
+#ifndef STICKFLASH_RETRIES
+#define STICKFLASH_RETRIES (10)
+#endif
+
+#ifndef STICKFLASH_LED_FAIL
+#define STICKFLASH_LED_FAIL (0)
+#endif
+#ifndef STICKFLASH_LED_OK
+#define STICKFLASH_LED_OK (1)
+#endif
+#ifndef STICKFLASH_LED_BUSY
+#define STICKFLASH_LED_BUSY (2)
+#endif
+
+/* frames asked for by a window reply */
+#define WINDOW (16)
+
+#define IMG_FORMAT (1)
+#define IMG_FLAG_ZLIB (0x01)
+#define IMG_FLAG_DELTA (0x02)
+
+/* container header, see wiboimage.py */
+typedef struct
+{
+	char magic[4];
+	uint8_t format;
+	uint8_t flags;
+	uint16_t pagesize;
+	uint16_t nsegs;
+	char name[16];
+	char board[16];
+	uint16_t version;
+	uint32_t length; /* staged image, gaps 0xFF up to the last page */
+	uint16_t crc;
+	uint32_t crc32;
+	uint32_t base_length;
+	uint16_t base_crc;
+	uint32_t size; /* bytes of pages */
+	uint16_t hdrcrc;
+} img_hdr_t;
+
+typedef struct
+{
+	uint32_t addr;
+	uint16_t npages;
+} img_seg_t;
+
+static USB_ClassInfo_MS_Host_t msd =
+{
+	.Config =
+	{
+		.DataINPipeNumber = 1,
+		.DataINPipeDoubleBank = false,
+		.DataOUTPipeNumber = 2,
+		.DataOUTPipeDoubleBank = false,
+	},
+};
+
+/* FAT volume */
+static struct
+{
+	uint8_t fat32;
+	uint8_t spc; /* blocks per cluster */
+	uint32_t fat_lba;
+	uint32_t root_lba; /* FAT16 root directory */
+	uint16_t root_blocks;
+	uint32_t root_clus; /* FAT32 root directory */
+	uint32_t data_lba; /* cluster 2 */
+} vol;
+
+/* file read through its cluster chain */
+static struct
+{
+	uint32_t clus0;
+	uint32_t size;
+	uint32_t clus; /* cluster clus_idx of the chain */
+	uint16_t clus_idx;
+} file;
+
+/* block for the FAT and the directory */
+static uint8_t sect[BLOCKSIZE];
+static uint32_t sect_lba;
+
+/* file blocks cache_fb ... cache_fb + cache_n - 1 */
+static uint8_t cache[STICKFLASH_CACHE_BLOCKS * BLOCKSIZE];
+static uint32_t cache_fb;
+static uint8_t cache_n;
+
+static img_hdr_t hdr;
+static img_seg_t segs[STICKFLASH_MAXSEGS];
+static uint32_t body_off; /* first page in the file */
+
+/* nodes of the image's board which answered the discovery */
+static uint16_t found[WIBOHOST_DISCOVER_MAX];
+static uint8_t found_cnt;
+
+static volatile uint8_t discover_done;
+static volatile uint8_t tx_done = 1;
+static volatile uint8_t flashcycle_done = 1;
+
+static inline uint16_t rd16(const uint8_t *p)
+{
+	return p[0] | ((uint16_t) p[1] << 8);
+}
+
+static inline uint32_t rd32(const uint8_t *p)
+{
+	return rd16(p) | ((uint32_t) rd16(p + 2) << 16);
+}
+
+/*
+ * \brief Wait for the previous frame to be sent and the flash cycle of
+ * the nodes, as wait_previous_command() of cmdif.c
+ */
+static void wait_previous(void)
+{
+	while ((0 == tx_done) || (0 == flashcycle_done))
+	{
+		wibohost_task();
+		BUSY_WAIT();
+	}
+	tx_done = 0;
+}
+
+/* === stick ============================================================== */
+
+/*
+ * \brief Bind the mass storage interface of the stick (HOST_STATE_Addressed)
+ */
+static uint8_t stick_configure(void)
+{
+	uint16_t size;
+	uint8_t desc[512];
+
+	if (USB_Host_GetDeviceConfigDescriptor(1, &size, desc, sizeof(desc))
+			!= HOST_GETCONFIG_Successful)
+	{
+		return 0;
+	}
+	if (MS_Host_ConfigurePipes(&msd, size, desc) != MS_ENUMERROR_NoError)
+	{
+		return 0;
+	}
+	return (USB_Host_SetDeviceConfiguration(1) == HOST_SENDCONTROL_Successful);
+}
+
+/*
+ * \brief Read a block into sect, unless it is there already
+ */
+static uint8_t sect_read(uint32_t lba)
+{
+	if (lba == sect_lba)
+	{
+		return 1;
+	}
+	sect_lba = 0xFFFFFFFF;
+	if (MS_Host_ReadDeviceBlocks(&msd, 0, lba, 1, BLOCKSIZE, sect))
+	{
+		return 0;
+	}
+	sect_lba = lba;
+	return 1;
+}
+
+/*
+ * \brief Wait until the stick is ready and check its block size
+ */
+static uint8_t stick_open(void)
+{
+	SCSI_Request_Sense_Response_t sense;
+	SCSI_Capacity_t cap;
+	uint8_t maxlun, i;
+
+	if (MS_Host_GetMaxLUN(&msd, &maxlun))
+	{
+		return 0;
+	}
+	for (i = 0; MS_Host_TestUnitReady(&msd, 0); i++)
+	{
+		/* slow sticks spin up for a second, the sense clears the error */
+		if ((i >= 50) || MS_Host_RequestSense(&msd, 0, &sense))
+		{
+			return 0;
+		}
+		_delay_ms(20);
+	}
+	if (MS_Host_ReadDeviceCapacity(&msd, 0, &cap) || (cap.BlockSize != BLOCKSIZE))
+	{
+		return 0;
+	}
+	sect_lba = 0xFFFFFFFF;
+	cache_n = 0;
+	return 1;
+}
+
+/* === FAT ================================================================ */
+
+/*
+ * \brief Find the FAT16/FAT32 volume, the first partition or a stick
+ * without partition table
+ */
+static uint8_t vol_mount(void)
+{
+	uint32_t lba = 0, totsec, fatsz, clusters;
+	uint16_t rootents;
+
+	if (!sect_read(0))
+	{
+		return 0;
+	}
+	if ((0xEB != sect[0]) && (0xE9 != sect[0]) && sect[0x1C2])
+	{
+		lba = rd32(&sect[0x1C6]);
+		if (!sect_read(lba))
+		{
+			return 0;
+		}
+	}
+	if ((0x55 != sect[510]) || (0xAA != sect[511])
+			|| (rd16(&sect[11]) != BLOCKSIZE) || (0 == sect[13]))
+	{
+		return 0;
+	}
+	vol.spc = sect[13];
+	rootents = rd16(&sect[17]);
+	totsec = rd16(&sect[19]) ? rd16(&sect[19]) : rd32(&sect[32]);
+	fatsz = rd16(&sect[22]) ? rd16(&sect[22]) : rd32(&sect[36]);
+	vol.fat_lba = lba + rd16(&sect[14]);
+	vol.root_lba = vol.fat_lba + sect[16] * fatsz;
+	vol.root_blocks = (rootents * 32UL + BLOCKSIZE - 1) / BLOCKSIZE;
+	vol.data_lba = vol.root_lba + vol.root_blocks;
+	clusters = (totsec - (vol.data_lba - lba)) / vol.spc;
+	if (clusters < 4085)
+	{
+		return 0; /* FAT12 */
+	}
+	vol.fat32 = (clusters >= 65525);
+	vol.root_clus = rd32(&sect[44]);
+	return 1;
+}
+
+/*
+ * \brief Next cluster of a chain, 0 at its end or for a bad entry
+ */
+static uint32_t fat_next(uint32_t clus)
+{
+	uint32_t next;
+	uint16_t off;
+
+	if (vol.fat32)
+	{
+		if (!sect_read(vol.fat_lba + clus / (BLOCKSIZE / 4)))
+		{
+			return 0;
+		}
+		off = (clus % (BLOCKSIZE / 4)) * 4;
+		next = rd32(&sect[off]) & 0x0FFFFFFF;
+		return (next >= 2 && next < 0x0FFFFFF7) ? next : 0;
+	}
+	if (!sect_read(vol.fat_lba + clus / (BLOCKSIZE / 2)))
+	{
+		return 0;
+	}
+	off = (clus % (BLOCKSIZE / 2)) * 2;
+	next = rd16(&sect[off]);
+	return (next >= 2 && next < 0xFFF7) ? next : 0;
+}
+
+/*
+ * \brief Block of the stick for block fb of the file, 0 beyond its chain
+ *
+ * The chain is followed from the cluster of the last call, frames are
+ * read forward, so a walk from the start is rare.
+ */
+static uint32_t file_lba(uint32_t fb)
+{
+	uint16_t idx = fb / vol.spc;
+
+	if (idx < file.clus_idx)
+	{
+		file.clus = file.clus0;
+		file.clus_idx = 0;
+	}
+	while (file.clus_idx < idx)
+	{
+		file.clus = fat_next(file.clus);
+		if (0 == file.clus)
+		{
+			file.clus_idx = 0xFFFF; /* start over next time */
+			return 0;
+		}
+		file.clus_idx++;
+	}
+	return vol.data_lba + (file.clus - 2) * vol.spc + fb % vol.spc;
+}
+
+/*
+ * \brief Find the first file *.WIM in the root directory
+ */
+static uint8_t file_find(void)
+{
+	uint32_t fb, lba;
+	uint8_t i, *e;
+
+	file.clus0 = file.clus = vol.root_clus;
+	file.clus_idx = 0;
+	for (fb = 0;; fb++)
+	{
+		if (vol.fat32)
+		{
+			lba = file_lba(fb);
+		}
+		else
+		{
+			lba = (fb < vol.root_blocks) ? vol.root_lba + fb : 0;
+		}
+		if ((0 == lba) || !sect_read(lba))
+		{
+			return 0;
+		}
+		for (i = 0; i < BLOCKSIZE / 32; i++)
+		{
+			e = &sect[i * 32];
+			if (0 == e[0])
+			{
+				return 0; /* end of the directory */
+			}
+			if ((0xE5 == e[0]) || (0x0F == (e[11] & 0x0F)) || (e[11] & 0x18))
+			{
+				continue; /* deleted, long name, volume label or directory */
+			}
+			if (0 == memcmp(&e[8], "WIM", 3))
+			{
+				file.clus0 = file.clus = ((uint32_t) rd16(&e[20]) << 16) | rd16(&e[26]);
+				file.clus_idx = 0;
+				file.size = rd32(&e[28]);
+				return (file.clus0 >= 2);
+			}
+		}
+	}
+}
+
+/*
+ * \brief Fill the cache from file block fb on, one READ(10) per run of
+ * contiguous blocks
+ */
+static uint8_t cache_fill(uint32_t fb)
+{
+	uint32_t nblocks, lba;
+	uint8_t n, got, run;
+
+	cache_n = 0;
+	nblocks = (file.size + BLOCKSIZE - 1) / BLOCKSIZE;
+	if (fb >= nblocks)
+	{
+		return 0;
+	}
+	n = (nblocks - fb < STICKFLASH_CACHE_BLOCKS) ? nblocks - fb
+			: STICKFLASH_CACHE_BLOCKS;
+	for (got = 0; got < n; got += run)
+	{
+		lba = file_lba(fb + got);
+		if (0 == lba)
+		{
+			return 0;
+		}
+		/* one command as long as the clusters are contiguous */
+		for (run = 1; (got + run < n) && (file_lba(fb + got + run) == lba + run);
+				run++)
+			;
+		if (MS_Host_ReadDeviceBlocks(&msd, 0, lba, run, BLOCKSIZE,
+				&cache[got * BLOCKSIZE]))
+		{
+			return 0;
+		}
+	}
+	cache_fb = fb;
+	cache_n = n;
+	return 1;
+}
+
+/*
+ * \brief Read len bytes of the file at off
+ */
+static uint8_t file_read(uint32_t off, void *dst, uint16_t len)
+{
+	uint8_t *p = dst;
+	uint32_t fb;
+	uint16_t pos, n;
+
+	if (off + len > file.size)
+	{
+		return 0;
+	}
+	while (len)
+	{
+		fb = off / BLOCKSIZE;
+		if ((0 == cache_n) || (fb < cache_fb) || (fb >= cache_fb + cache_n))
+		{
+			if (!cache_fill(fb))
+			{
+				return 0;
+			}
+		}
+		pos = off - cache_fb * BLOCKSIZE;
+		n = cache_n * BLOCKSIZE - pos;
+		if (n > len)
+		{
+			n = len;
+		}
+		memcpy(p, &cache[pos], n);
+		p += n;
+		off += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/* === image ============================================================== */
+
+/*
+ * \brief Read and check header and page map of the container
+ */
+static uint8_t img_open(void)
+{
+	uint16_t i, npages = 0;
+
+	if (!file_read(0, &hdr, sizeof(hdr)))
+	{
+		return 0;
+	}
+	if (memcmp(hdr.magic, "WIMG", 4) || (IMG_FORMAT != hdr.format)
+			|| (crc_ccitt_block(0, (uint8_t*) &hdr, sizeof(hdr) - 2) != hdr.hdrcrc))
+	{
+		return 0;
+	}
+	if ((hdr.flags & (IMG_FLAG_ZLIB | IMG_FLAG_DELTA))
+			|| (0 == hdr.pagesize) || (hdr.pagesize % STICKFLASH_FRAME)
+			|| (hdr.nsegs > STICKFLASH_MAXSEGS) || (0 == hdr.length))
+	{
+		return 0;
+	}
+	if (!file_read(sizeof(hdr), segs, hdr.nsegs * sizeof(img_seg_t)))
+	{
+		return 0;
+	}
+	for (i = 0; i < hdr.nsegs; i++)
+	{
+		npages += segs[i].npages;
+	}
+	body_off = sizeof(hdr) + hdr.nsegs * sizeof(img_seg_t) + 2UL * npages;
+	return (body_off + (uint32_t) npages * hdr.pagesize <= file.size);
+}
+
+/*
+ * \brief Data of frame seq of the staged image, the gaps between the
+ * segments are 0xFF
+ */
+static uint8_t img_frame(uint16_t seq, uint8_t *buf)
+{
+	uint32_t off = (uint32_t) seq * STICKFLASH_FRAME;
+	uint32_t page = off - off % hdr.pagesize;
+	uint32_t idx = 0, end;
+	uint8_t i;
+
+	for (i = 0; i < hdr.nsegs; i++)
+	{
+		end = segs[i].addr + (uint32_t) segs[i].npages * hdr.pagesize;
+		if ((page >= segs[i].addr) && (page < end))
+		{
+			idx += (page - segs[i].addr) / hdr.pagesize;
+			return file_read(body_off + idx * hdr.pagesize + off % hdr.pagesize,
+					buf, STICKFLASH_FRAME);
+		}
+		idx += segs[i].npages;
+	}
+	memset(buf, 0xFF, STICKFLASH_FRAME);
+	return 1;
+}
+
+/* === nodes ============================================================== */
+
+/*
+ * \brief Jump into the bootloader and collect the nodes of the image's
+ * board
+ */
+static uint8_t nodes_find(void)
+{
+	uint8_t r;
+
+	found_cnt = 0;
+	wait_previous();
+	wibohost_jbootl(0xFFFF);
+	_delay_ms(STICKFLASH_JBOOTL_MS);
+	for (r = 0; r < STICKFLASH_ROUNDS; r++)
+	{
+		wait_previous();
+		discover_done = 0;
+		wibohost_discover(STICKFLASH_SLOTS, r);
+		while (0 == discover_done)
+			BUSY_WAIT();
+	}
+	return found_cnt;
+}
+
+/*
+ * \brief Multicast the image to the nodes found, as flashhex_multicast()
+ * of wibohost.py
+ *
+ * The data of a frame is read before waiting for the previous one, the
+ * stick is read while the radio sends and the nodes flash.
+ */
+static uint8_t nodes_flash(void)
+{
+	uint8_t buf[STICKFLASH_FRAME];
+	uint16_t nframes, seq, base = 0, missing = 0xFFFF, nbase, nmissing;
+	uint8_t i, lost, fails = 0;
+
+	nframes = hdr.length / STICKFLASH_FRAME;
+	wibohost_mcast_clear();
+	for (i = 0; i < found_cnt; i++)
+	{
+		if (0 == wibohost_mcast_add(found[i]))
+		{
+			return 0;
+		}
+	}
+	wait_previous();
+	wibohost_reset();
+
+	for (;;)
+	{
+		for (i = 0; i < WINDOW; i++)
+		{
+			seq = base + i;
+			if ((seq >= nframes) || !(missing & (1 << i)))
+			{
+				continue;
+			}
+			if (!img_frame(seq, buf))
+			{
+				return 0;
+			}
+			wait_previous();
+			flashcycle_done = 0; /* set explicitely */
+			if (0 == wibohost_feedseq(0xFFFF, seq, buf, STICKFLASH_FRAME))
+			{
+				flashcycle_done = 1;
+			}
+		}
+		wait_previous();
+		tx_done = 1; /* the poll waits for the replies, it may send nothing */
+		if (0 == wibohost_mcast_poll(nframes, &nbase, &nmissing, &lost))
+		{
+			break;
+		}
+		if ((nbase == base) && (nmissing == missing))
+		{
+			if (++fails > STICKFLASH_RETRIES)
+			{
+				return 0;
+			}
+		}
+		else
+		{
+			fails = 0;
+		}
+		base = nbase;
+		missing = nmissing;
+		if (lost && (0 == missing))
+		{
+			missing = 0xFFFF; /* unknown state, resend all */
+		}
+		LED_TOGGLE(STICKFLASH_LED_BUSY);
+	}
+
+	/* all frames went out once in order, a bad read of the stick shows here */
+	if (wibohost_getcrc() != hdr.crc)
+	{
+		return 0;
+	}
+	wait_previous();
+	wibohost_finish(0xFFFF);
+	wait_previous();
+	wibohost_exit(0xFFFF);
+	return 1;
+}
+
+/* === wibohost callbacks ================================================= */
+
+void cb_wibohost_discoverreply(p2p_ping_cnf_t *pr, uint8_t lqi, int8_t ed)
+{
+	uint8_t i;
+
+	if (strncmp(pr->appname, "wibo", sizeof(pr->appname)))
+	{
+		return; /* an application, not the bootloader */
+	}
+	if (hdr.board[0] && strncmp(pr->boardname, hdr.board, sizeof(hdr.board)))
+	{
+		return; /* other board */
+	}
+	for (i = 0; i < found_cnt; i++)
+	{
+		if (found[i] == pr->hdr.src)
+		{
+			return;
+		}
+	}
+	if (found_cnt < WIBOHOST_DISCOVER_MAX)
+	{
+		found[found_cnt++] = pr->hdr.src;
+	}
+}
+
+void cb_wibohost_discoverdone(void)
+{
+	discover_done = 1;
+}
+
+void cb_wibohost_flashcycletimeout(void)
+{
+	flashcycle_done = 1;
+}
+
+void cb_wibohost_tx_done(radio_tx_done_t status)
+{
+	tx_done = 1;
+}
+
+void cb_wibohost_radio_error(radio_error_t err)
+{
+}
+
+void cb_wibohost_pingreply(p2p_ping_cnf_t *pr)
+{
+}
+
+void cb_wibohost_pingtimeout(void)
+{
+}
+
+void cb_wibohost_pingshortreply(p2p_ping_short_cnf_t *pr, uint8_t lqi,
+		int8_t ed)
+{
+}
+
+void cb_wibohost_resumereply(p2p_wibo_resume_t *rr)
+{
+}
+
+void cb_wibohost_resumetimeout(void)
+{
+}
+
+void cb_wibohost_windowreply(p2p_wibo_window_cnf_t *wr)
+{
+}
+
+void cb_wibohost_windowtimeout(void)
+{
+}
+
+void cb_wibohost_fecreply(p2p_wibo_fec_cnf_t *fr)
+{
+}
+
+void cb_wibohost_fectimeout(void)
+{
+}
+
+void cb_wibohost_phystatsreply(p2p_phy_stats_cnf_t *sr)
+{
+}
+
+void cb_wibohost_phystatstimeout(void)
+{
+}
+
+/* === USB events ========================================================= */
+
+void EVENT_USB_Host_DeviceAttached(void)
+{
+	LED_CLR(STICKFLASH_LED_OK);
+	LED_CLR(STICKFLASH_LED_FAIL);
+}
+
+void EVENT_USB_Host_DeviceEnumerationFailed(const uint8_t ErrorCode,
+		const uint8_t SubErrorCode)
+{
+	LED_SET(STICKFLASH_LED_FAIL);
+}
+
+void EVENT_USB_Host_HostError(const uint8_t ErrorCode)
+{
+	USB_ShutDown();
+	LED_SET(STICKFLASH_LED_FAIL);
+	for (;;)
+		;
+}
+
+int main(void)
+{
+	uint8_t ok;
+
+	LED_INIT();
+	timer_init();
+	wibohost_init();
+	USB_Init();
+
+	sei();
+
+	for (;;)
+	{
+		switch (USB_HostState)
+		{
+		case HOST_STATE_Addressed:
+			if (!stick_configure())
+			{
+				LED_SET(STICKFLASH_LED_FAIL);
+				USB_HostState = HOST_STATE_WaitForDeviceRemoval;
+				break;
+			}
+			USB_HostState = HOST_STATE_Configured;
+			break;
+
+		case HOST_STATE_Configured:
+			LED_SET(STICKFLASH_LED_BUSY);
+			ok = stick_open() && vol_mount() && file_find() && img_open()
+					&& nodes_find() && nodes_flash();
+			LED_CLR(STICKFLASH_LED_BUSY);
+			LED_SET(ok ? STICKFLASH_LED_OK : STICKFLASH_LED_FAIL);
+			USB_HostState = HOST_STATE_WaitForDeviceRemoval;
+			break;
+
+		default:
+			break;
+		}
+		USB_USBTask();
+		timer_task();
+		wibohost_task();
+	}
+}
+
+/* EOF */
@@ -0,0 +1,143 @@
+#   Copyright (c) 2011 - 2013  Axel Wachtler
+#   All rights reserved.
+#
+#   Redistribution and use in source and binary forms, with or without
+#   modification, are permitted provided that the following conditions
+#   are met:
+#
+#   * Redistributions of source code must retain the above copyright
+#     notice, this list of conditions and the following disclaimer.
+#   * Redistributions in binary form must reproduce the above copyright
+#     notice, this list of conditions and the following disclaimer in the
+#     documentation and/or other materials provided with the distribution.
+#   * Neither the name of the authors nor the names of its contributors
+#     may be used to endorse or promote products derived from this software
+#     without specific prior written permission.
+#
+#   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+#   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+#   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+#   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+#   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+#   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+#   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+#   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+#   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+#   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+#   POSSIBILITY OF SUCH DAMAGE.
+
+# $Id$
+
+# === main parameters of the project =========================================
+URACOLIDIR = ..
+PROJECT = stickflash
+CURRENT_MAKEFILE = stickflash.mk
+BOARD = UNDEFINED
+PART = UNDEFINED
+OBJDIR = ./obj
+
+BINDIR = $(URACOLIDIR)/bin
+LIBDIR = $(URACOLIDIR)/lib
+
+# guessing the OS for a working (g)mkdir
+ifndef MKDIR
+    ifdef SystemRoot
+        MKDIR=gmkdir -p
+    else
+        MKDIR=mkdir -p
+    endif
+endif
+
+# === autogenerated board rules ========================================
+help:
+	@echo
+	@echo "========================================================="
+	@echo "Enter a board name or "all" for building the libraries.  "
+	@echo "Have a look in the docu for what board you want to build."
+	@echo "========================================================="
+	@echo
+
+all: rzusb
+
+list:
+	 @echo '  rzusb            : Atmel Raven USB Stick with AT86RF230 Rev. B'
+
+
+rzusb:
+	$(MAKE) -f $(CURRENT_MAKEFILE) BOARD=rzusb MCU=at90usb1287 F_CPU=8000000UL BOOTOFFSET=0x1e000 $(TARGETS)
+
+
+clean:
+	rm -rf $(OBJDIR)/*.o $(OBJDIR)/*.lst $(BINDIR)/*.elf $(BINDIR)/*.hex
+
+# === internal rules ===================================================
+
+# temporary output directory
+$(OBJDIR):
+	$(MKDIR) $@
+
+$(BINDIR):
+	$(MKDIR) $@
+
+TARGETS=$(OBJDIR) $(BINDIR) __stickflash__
+SOURCES = $(PROJECT).c
+INCDIRS = . $(URACOLIDIR)/inc
+LIBDIRS = $(URACOLIDIR)/lib
+# DBGFMT=stabs for Linux
+# DBGFMT=dwarf-2 for Windows
+DBGFMT=
+# automatically derived parameters
+OBJECTS = $(SOURCES:%.c=$(OBJDIR)/%_$(BOARD).o)
+TARGET = $(BINDIR)/$(PROJECT)_$(BOARD)
+
+# === tool parameters ======================================================
+
+CC = avr-gcc
+CCFLAGS = -Wall -Wundef -Os -g$(DBGFMT) -mmcu=$(MCU)
+# the LUFA sources are found through vpath, the listing goes to OBJDIR
+CCFLAGS += -Wa,-adhlns=$(OBJDIR)/$(notdir $(<:%.c=%))_$(BOARD).lst
+CCFLAGS += -D$(BOARD) -DF_CPU=$(F_CPU)
+ifneq ($(isrprof),)
+    CCFLAGS += -DISR_PROFILE
+endif
+ifneq ($(stackwatch),)
+    CCFLAGS += -DSTACK_WATCH
+endif
+CCFLAGS += -I$(URACOLIDIR)/inc -I.
+LDFLAGS = $(patsubst %,-L%,$(LIBDIRS)) -luracoli_$(BOARD)
+
+# === custom settings ======================================================
+# LUFA host mode and mass storage class driver, LUFA_PATH=... for another copy
+LUFA_PATH = ../../../atmega16u2/lufa-100807
+LUFA_SRC = $(LUFA_PATH)/LUFA/Drivers/USB/LowLevel/Host.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/LowLevel/Pipe.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/LowLevel/USBController.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/LowLevel/USBInterrupt.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/HighLevel/ConfigDescriptor.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/HighLevel/Events.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/HighLevel/HostStandardReq.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/HighLevel/USBTask.c \
+           $(LUFA_PATH)/LUFA/Drivers/USB/Class/Host/MassStorage.c
+vpath %.c $(sort $(dir $(LUFA_SRC)))
+SOURCES += wibohost.c $(notdir $(LUFA_SRC))
+CCFLAGS += -DAPP_NAME=\"stickflash\" -Os -fpack-struct -fshort-enums -funsigned-char -funsigned-bitfields -std=gnu99
+CCFLAGS += -I$(LUFA_PATH) -DF_CLOCK=$(F_CPU) -DUSB_HOST_ONLY -DNO_STREAM_CALLBACKS
+CCFLAGS += -DUSE_STATIC_OPTIONS="(USB_OPT_REG_ENABLED | USB_OPT_AUTO_PLL)"
+
+
+
+OC=avr-objcopy
+OCFLAGS=-O ihex
+
+# === build rules ============================================================
+__stickflash__: $(TARGET).hex
+
+$(TARGET).hex: $(TARGET).elf
+	$(OC) $(OCFLAGS) $< $@
+
+$(TARGET).elf: $(OBJECTS)
+	$(CC) -o $@ $(CCFLAGS) $^ $(LDFLAGS)
+
+$(OBJDIR)/%_$(BOARD).o: %.c
+	$(CC) $(CCFLAGS) -c -o $@ $<
+
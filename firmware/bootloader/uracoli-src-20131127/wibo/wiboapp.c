@@ -0,0 +1,819 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Background update receiver for applications
+ *
+ * Frames are taken from the radio callback into a mailbox, they are
+ * handled by wiboapp_task() in the main loop. Only raw data streams are
+ * supported (no LZSS or patches), the image is written as it comes.
+ *
+ * Interrupts are off while a page is programmed (about 13ms), the
+ * application section can not be read meanwhile. The host paces the
+ * data frames with FLASHTIMEOUT_MS after a page anyway.
+ *
+ * Built with WIBOAPP_RELAY a node that committed an image can pass it on
+ * to a neighbour, see @ref P2P_WIBO_RELAY. It plays the host for the
+ * target, the frames are read back from the staging slot. The host only
+ * sends the image once, the updated nodes spread it as a tree.
+ *
+ * @ingroup grpAppWiBo
+ */
+
+/* avr-libc inclusions */
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
+#include <string.h>
+
+/* uracoli inclusions */
+#include <board.h>
+#include <transceiver.h>
+#include <radio.h>
+#include <crc_fast.h>
+#include <p2p_protocol.h>
+#if defined(P2P_MESH)
+#include <p2p.h>
+#endif
+#include <wibosvc.h>
+#if defined(WIBOAPP_RELAY) || defined(WIBOAPP_PHY)
+#include <timer.h>
+#endif
+
+/* project inclusions */
+#include "wiboapp.h"
+
+#ifndef APP_NAME
+# define APP_NAME "wiboapp"
+#endif
+#define APP_VERSION (0x01)
+
+/* mailbox, filled from the radio callback */
+static uint8_t mbox[MAX_FRAME_SIZE];
+static volatile uint8_t mbox_len = 0;
+
+/* frame in work, the mailbox is free again while a page is programmed */
+static uint8_t work[MAX_FRAME_SIZE];
+
+static uint8_t pagebuf[SPM_PAGESIZE];
+static uint16_t pagebufidx;
+static uint32_t addr;
+static uint16_t datacrc;
+static uint8_t active = 0; /* between P2P_WIBO_RESET and P2P_WIBO_EXIT */
+static uint8_t committed = 0;
+
+static p2p_ping_cnf_t pingrep;
+#if defined(P2P_MESH)
+/* room to wrap the reply into a P2P_MESH_DATA frame */
+static char pingbuf[sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME) + 2 + P2P_MESH_OVERHEAD];
+#else
+static char pingbuf[sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME) + 2];
+#endif
+
+#if defined(WIBOAPP_RELAY)
+/* data bytes per frame sent to the target */
+#ifndef WIBOAPP_RELAY_CHUNK
+# define WIBOAPP_RELAY_CHUNK (64)
+#endif
+/* pause after a page, same as FLASHTIMEOUT_MS of the host */
+#define WIBOAPP_RELAY_FLASH_MS (20)
+/* wait for the commit reply of the target */
+#define WIBOAPP_RELAY_COMMIT_MS (500)
+/* pause before a frame is tried again, time for a route lookup */
+#define WIBOAPP_RELAY_RETRY_MS (300)
+#define WIBOAPP_RELAY_RETRIES (3)
+
+enum {
+	RELAY_IDLE = 0,
+	RELAY_RESET,
+	RELAY_DATA,
+	RELAY_FINISH,
+	RELAY_COMMIT,
+	RELAY_WAIT  /* commit sent, waiting for the ping reply */
+};
+
+/* image of the last good P2P_WIBO_COMMIT */
+static uint32_t img_len;
+static uint16_t img_crc;
+static uint8_t img_mac[16];
+
+static uint8_t relay_state = RELAY_IDLE;
+static uint8_t relay_next;
+static uint16_t relay_target;
+static uint32_t relay_pos;
+static uint8_t relay_n;       /* data bytes of the frame in the air */
+static time_t relay_pause;    /* pause after the frame in the air */
+static uint8_t relay_retries;
+static uint8_t relay_sent;    /* result of the frame in the air is due */
+static volatile uint8_t relay_txbusy;
+static volatile uint8_t relay_txok;
+static volatile uint8_t relay_hold;
+static timer_hdl_t relay_thdl = NONE_TIMER;
+#if defined(P2P_MESH)
+static uint8_t relay_frm[sizeof(p2p_wibo_data_t) + WIBOAPP_RELAY_CHUNK + P2P_MESH_OVERHEAD];
+#else
+static uint8_t relay_frm[sizeof(p2p_wibo_data_t) + WIBOAPP_RELAY_CHUNK];
+#endif
+#endif
+
+#if defined(WIBOAPP_PHY)
+static uint8_t phy_stored; /* profile applied after reset */
+static volatile uint16_t phy_received;
+static volatile uint32_t phy_bytes;
+static volatile uint8_t phy_heard; /* P2P_PHY_* frame in the revert period */
+static volatile uint8_t phy_revert;
+static timer_hdl_t phy_thdl = NONE_TIMER;
+#endif
+
+/*
+ * \brief Let the bootloader program a page of the staging slot
+ *
+ * @param a Address in the image
+ * @param *buf Page content
+ * @return 0 on success, else the address is out of the staging slot
+ */
+static uint8_t wiboapp_spm(uint32_t a, uint8_t *buf)
+{
+	if (a >= WIBOAPP_SLOT_SIZE)
+	{
+		return WIBO_SVC_REJECTED;
+	}
+	return wibo_svc_spm_slot(a + WIBOAPP_SLOT_SIZE, buf);
+}
+
+/*
+ * \brief Send a frame, the header is filled in
+ *
+ * @return 0 if there is no route to the destination (yet)
+ */
+static uint8_t wiboapp_send(uint8_t len, uint8_t *frm)
+{
+#if defined(P2P_MESH)
+	p2p_hdr_t *hdr = (p2p_hdr_t*) frm;
+
+	/* straight back to a neighbour, else along the learned route */
+	return p2p_mesh_send(hdr->dst, hdr->cmd, frm, len);
+#else
+	radio_set_state(STATE_TXAUTO);
+	radio_send_frame(len + 2, frm, 1); /* +2: add CRC bytes (FCF) */
+	return 1;
+#endif
+}
+
+static void wiboapp_pingreply(uint16_t dst, uint16_t crc)
+{
+	pingrep.hdr.dst = dst;
+	pingrep.hdr.seq++;
+	pingrep.crc = crc;
+	memcpy(pingbuf, &pingrep, sizeof(p2p_ping_cnf_t));
+	wiboapp_send(sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME), (uint8_t*) pingbuf);
+}
+
+/*
+ * \brief Reply to a short ping in a random slot of the window
+ *
+ * The application is blocked for up to nslots * P2P_PING_SHORT_SLOT_MS.
+ */
+static void wiboapp_shortreply(uint16_t dst, uint8_t nslots)
+{
+	p2p_ping_short_cnf_t *rp = (p2p_ping_short_cnf_t*) pingbuf;
+	uint16_t h;
+	uint8_t slot, i;
+
+	/* RND_VALUE gives 2 random bits in receive state, the address keeps
+	 * nodes apart that read the same bits
+	 */
+	h = _crc_ccitt_update(0, pingrep.hdr.src & 0xFF);
+	h = _crc_ccitt_update(h, pingrep.hdr.src >> 8);
+	for (i = 0; i < 4; i++)
+	{
+		h = _crc_ccitt_update(h, trx_bit_read(SR_RND_VALUE));
+	}
+	slot = nslots ? (h % nslots) : 0;
+	while (slot--)
+	{
+		DELAY_MS(P2P_PING_SHORT_SLOT_MS);
+	}
+	pingrep.hdr.seq++;
+	memcpy(&rp->hdr, &pingrep.hdr, sizeof(p2p_hdr_t));
+	rp->hdr.cmd = P2P_PING_SHORT_CNF;
+	rp->hdr.dst = dst;
+	rp->flags = P2P_PING_SHORT_FLAGS(pingrep.status, pingrep.errno);
+	rp->version = pingrep.version;
+	rp->crc = datacrc;
+	wiboapp_send(sizeof(p2p_ping_short_cnf_t), (uint8_t*) pingbuf);
+}
+
+#if defined(WIBOAPP_PHY)
+/*
+ * \brief Switch the radio to a profile, profile 0 if it does not exist
+ */
+static void wiboapp_phyapply(uint8_t idx)
+{
+	if (!radio_phy_set(idx))
+	{
+		radio_phy_set(0);
+	}
+	radio_set_state(STATE_RXAUTO); /* left in TRX_OFF */
+}
+
+/*
+ * \brief No P2P_PHY_* frame for a revert period, the host lost the node
+ */
+static time_t wiboapp_phytimeout(timer_arg_t t)
+{
+	if (phy_heard)
+	{
+		phy_heard = 0;
+		return MSEC(P2P_PHY_REVERT_S * 1000UL);
+	}
+	phy_revert = 1;
+	phy_thdl = NONE_TIMER;
+	return 0; /* stop timer */
+}
+
+static void wiboapp_phyreply(uint16_t dst, uint8_t clear)
+{
+	p2p_phy_stats_cnf_t *rp = (p2p_phy_stats_cnf_t*) pingbuf;
+
+	pingrep.hdr.seq++;
+	memcpy(&rp->hdr, &pingrep.hdr, sizeof(p2p_hdr_t));
+	rp->hdr.cmd = P2P_PHY_STATS_CNF;
+	rp->hdr.dst = dst;
+	rp->profile = radio_phy_get();
+	rp->stored = phy_stored;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		rp->received = phy_received;
+		rp->bytes = phy_bytes;
+		if (clear)
+		{
+			phy_received = 0;
+			phy_bytes = 0;
+		}
+	}
+	wiboapp_send(sizeof(p2p_phy_stats_cnf_t), (uint8_t*) pingbuf);
+}
+
+/*
+ * \brief Apply the profile stored in the EEPROM, call this after
+ *        radio_init() and timer_init()
+ */
+void wiboapp_phy_init(void)
+{
+	phy_stored = eeprom_read_byte((uint8_t *) WIBOAPP_PHY_EEADDR);
+	if (phy_stored >= radio_phy_count())
+	{
+		phy_stored = 0;
+	}
+	wiboapp_phyapply(phy_stored);
+}
+#endif
+
+static void wiboapp_put(uint8_t b)
+{
+	pagebuf[pagebufidx++] = b;
+	if (pagebufidx >= SPM_PAGESIZE)
+	{
+		wiboapp_spm(addr, pagebuf);
+		memset(pagebuf, 0xFF, sizeof(pagebuf));
+		addr += SPM_PAGESIZE;
+		pagebufidx = 0;
+	}
+}
+
+/*
+ * \brief Check the staged image and set the boot pointer
+ *
+ * @param len Image length
+ * @param crc Image CRC from the host
+ * The bootloader checks the image again with WIBO_SVC_COMMIT (since 1.1),
+ * the pointer written here is for older ones.
+ *
+ * @param *pc Returns the CRC of the staged image
+ * @return P2P_ERROR_SUCCESS or P2P_ERROR_COMMIT
+ */
+static p2p_error_t wiboapp_commit(uint32_t len, uint16_t crc, uint16_t *pc)
+{
+	uint16_t c;
+
+	if (len > WIBOAPP_SLOT_SIZE)
+	{
+		return P2P_ERROR_COMMIT;
+	}
+	c = crc_ccitt_flash(0, WIBOAPP_SLOT_SIZE, len);
+	*pc = c;
+	if (c != crc)
+	{
+		return P2P_ERROR_COMMIT;
+	}
+	eeprom_update_dword((uint32_t *) (WIBOAPP_SLOT_EEADDR + 1), len);
+	eeprom_update_word((uint16_t *) (WIBOAPP_SLOT_EEADDR + 5), crc);
+	/* the single byte write is the atomic flip */
+	eeprom_update_byte((uint8_t *) WIBOAPP_SLOT_EEADDR, WIBOAPP_SLOT_PENDING);
+	return P2P_ERROR_SUCCESS;
+}
+
+#if defined(WIBOAPP_RELAY)
+static time_t wiboapp_relaytimeout(timer_arg_t t)
+{
+	relay_hold = 0;
+	relay_thdl = NONE_TIMER;
+	return 0; /* stop timer */
+}
+
+static void wiboapp_relayhold(time_t t)
+{
+	relay_hold = 1;
+	relay_thdl = timer_start(wiboapp_relaytimeout, t, 0);
+}
+
+/*
+ * \brief End the relay job, the host reads the result with a ping
+ */
+static void wiboapp_relaydone(p2p_error_t err)
+{
+	relay_state = RELAY_IDLE;
+	pingrep.status = P2P_STATUS_IDLE;
+	pingrep.errno = err;
+}
+
+/*
+ * \brief Send the next frame to the target
+ *
+ * One frame is in the air at a time, each with ACK request. A frame
+ * that is not acknowledged is built and sent again, the mesh layer
+ * reuses the buffer.
+ */
+static void wiboapp_relaystep(void)
+{
+	p2p_hdr_t *hdr = (p2p_hdr_t*) relay_frm;
+	uint8_t len, i;
+
+	if ((RELAY_IDLE == relay_state) || relay_hold)
+	{
+		return;
+	}
+	if (relay_sent)
+	{
+		relay_sent = 0;
+		if (!relay_txok)
+		{
+			if (++relay_retries > WIBOAPP_RELAY_RETRIES)
+			{
+				wiboapp_relaydone(P2P_ERROR_RELAY);
+			}
+			else
+			{
+				wiboapp_relayhold(MSEC(WIBOAPP_RELAY_RETRY_MS));
+			}
+			return;
+		}
+		relay_retries = 0;
+		relay_pos += relay_n;
+		relay_state = relay_next;
+		if (relay_pause)
+		{
+			wiboapp_relayhold(relay_pause);
+			return;
+		}
+	}
+
+	relay_n = 0;
+	relay_pause = 0;
+	switch (relay_state)
+	{
+	case RELAY_RESET:
+		hdr->cmd = P2P_WIBO_RESET;
+		len = sizeof(p2p_wibo_reset_t);
+		relay_next = RELAY_DATA;
+		relay_pause = MSEC(WIBOAPP_RELAY_FLASH_MS);
+		break;
+
+	case RELAY_DATA:
+		{
+			p2p_wibo_data_t *dat = (p2p_wibo_data_t*) relay_frm;
+
+			relay_n = WIBOAPP_RELAY_CHUNK;
+			if ((img_len - relay_pos) < relay_n)
+			{
+				relay_n = img_len - relay_pos;
+			}
+			for (i = 0; i < relay_n; i++)
+			{
+				dat->data[i] = pgm_read_byte_far(WIBOAPP_SLOT_SIZE + relay_pos + i);
+			}
+			dat->dsize = relay_n;
+			hdr->cmd = P2P_WIBO_DATA;
+			len = sizeof(p2p_wibo_data_t) + relay_n;
+			relay_next = ((relay_pos + relay_n) < img_len) ? RELAY_DATA : RELAY_FINISH;
+			if (((relay_pos + relay_n) % SPM_PAGESIZE) < relay_n)
+			{
+				/* the target programs a page */
+				relay_pause = MSEC(WIBOAPP_RELAY_FLASH_MS);
+			}
+		}
+		break;
+
+	case RELAY_FINISH:
+		hdr->cmd = P2P_WIBO_FINISH;
+		len = sizeof(p2p_wibo_finish_t);
+		relay_next = RELAY_COMMIT;
+		relay_pause = MSEC(WIBOAPP_RELAY_FLASH_MS);
+		break;
+
+	case RELAY_COMMIT:
+		{
+			p2p_wibo_commit_t *com = (p2p_wibo_commit_t*) relay_frm;
+
+			com->len = img_len;
+			com->crc = img_crc;
+			memcpy(com->mac, img_mac, sizeof(com->mac));
+			hdr->cmd = P2P_WIBO_COMMIT;
+			len = sizeof(p2p_wibo_commit_t);
+			relay_next = RELAY_WAIT;
+			relay_pause = MSEC(WIBOAPP_RELAY_COMMIT_MS);
+		}
+		break;
+
+	default:
+		/* RELAY_WAIT: the target did not reply in time */
+		wiboapp_relaydone(P2P_ERROR_RELAY);
+		return;
+	}
+
+	FILL_P2P_HEADER_ACK(hdr, pingrep.hdr.pan, relay_target, pingrep.hdr.src,
+			hdr->cmd);
+	relay_sent = 1;
+	relay_txok = 0;
+	relay_txbusy = 1;
+	if (0 == wiboapp_send(len, relay_frm))
+	{
+		/* no route, counts as a lost frame */
+		relay_txbusy = 0;
+	}
+}
+
+/*
+ * \brief Take the result of a frame sent by the relay, call this from
+ *        usr_radio_tx_done()
+ */
+void wiboapp_tx_done(radio_tx_done_t status)
+{
+	if (relay_txbusy)
+	{
+		relay_txok = (TX_OK == status);
+		relay_txbusy = 0;
+	}
+}
+#endif
+
+/*
+ * \brief Initialize the receiver
+ *
+ * @param pan_id PAN the node is in, for the replies
+ * @param short_addr Address of the node
+ */
+void wiboapp_init(uint16_t pan_id, uint16_t short_addr)
+{
+	p2p_hdr_t *hdr = &pingrep.hdr;
+
+	memset(&pingrep, 0, sizeof(pingrep));
+	FILL_P2P_HEADER_NOACK(hdr, pan_id, 0, short_addr, P2P_PING_CNF);
+	pingrep.status = P2P_STATUS_IDLE;
+	pingrep.version = APP_VERSION;
+	strncpy(pingrep.appname, APP_NAME, sizeof(pingrep.appname));
+	strcpy(pingbuf + sizeof(p2p_ping_cnf_t), BOARD_NAME);
+	memset(pagebuf, 0xFF, sizeof(pagebuf));
+#if defined(P2P_MESH)
+	p2p_mesh_init(pan_id, short_addr);
+#endif
+}
+
+/*
+ * \brief Take a frame from usr_radio_receive_frame()
+ *
+ * @return 1 if the frame is for the receiver, 0 if the application
+ *         handles it
+ */
+uint8_t wiboapp_receive_frame(uint8_t len, uint8_t *frm)
+{
+	switch (((p2p_hdr_t*) frm)->cmd)
+	{
+	case P2P_PING_REQ:
+	case P2P_PING_SHORT_REQ:
+	case P2P_WIBO_TARGET:
+	case P2P_WIBO_RESET:
+	case P2P_WIBO_ADDR:
+	case P2P_WIBO_DATA:
+	case P2P_WIBO_FINISH:
+	case P2P_WIBO_COMMIT:
+	case P2P_WIBO_EXIT:
+#if defined(WIBOAPP_RELAY)
+	case P2P_WIBO_RELAY:
+	case P2P_PING_CNF:
+#endif
+#if defined(WIBOAPP_PHY)
+	case P2P_PHY_SET:
+	case P2P_PHY_STATS_REQ:
+#endif
+#if defined(P2P_MESH)
+	case P2P_MESH_RREQ:
+	case P2P_MESH_RREP:
+	case P2P_MESH_DATA:
+#endif
+		if ((0 == mbox_len) && (len <= sizeof(mbox)))
+		{
+			memcpy(mbox, frm, len);
+			mbox_len = len;
+		}
+		/* else lost, the host sees it in the CRC */
+		return 1;
+#if defined(WIBOAPP_PHY)
+	case P2P_PHY_TEST:
+		/* counted right here, the mailbox would drop most of a burst */
+		phy_received++;
+		phy_bytes += len;
+		phy_heard = 1;
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/*
+ * \brief Handle the received frame, call this from the main loop
+ */
+void wiboapp_task(void)
+{
+	p2p_hdr_t *hdr = (p2p_hdr_t*) work;
+	uint8_t i;
+
+#if defined(WIBOAPP_RELAY)
+	/* frames of the mailbox wait while a relay frame is in the air,
+	 * a ping reply would get in its way */
+	if (relay_txbusy)
+	{
+		return;
+	}
+	wiboapp_relaystep();
+	if (relay_txbusy)
+	{
+		return;
+	}
+#endif
+#if defined(WIBOAPP_PHY)
+	if (phy_revert)
+	{
+		phy_revert = 0;
+		wiboapp_phyapply(phy_stored);
+	}
+#endif
+	if (0 == mbox_len)
+	{
+		return;
+	}
+	memcpy(work, mbox, mbox_len);
+#if defined(P2P_MESH)
+	/* forwarded or consumed by the mesh layer, len without FCS */
+	i = p2p_mesh_receive(work, mbox_len - 2);
+	mbox_len = 0;
+	if (0 == i)
+	{
+		return;
+	}
+#else
+	mbox_len = 0;
+#endif
+
+	switch (hdr->cmd)
+	{
+	case P2P_PING_REQ:
+		wiboapp_pingreply(hdr->src, datacrc);
+		break;
+
+	case P2P_PING_SHORT_REQ:
+		wiboapp_shortreply(hdr->src,
+				((p2p_ping_short_req_t*) work)->nslots);
+		break;
+
+	case P2P_WIBO_RESET:
+		if (!wibo_svc_available())
+		{
+			/* the bootloader can not write for us */
+			pingrep.status = P2P_STATUS_ERROR;
+			break;
+		}
+		memset(pagebuf, 0xFF, sizeof(pagebuf));
+		pagebufidx = 0;
+		addr = 0;
+		datacrc = 0;
+		active = 1;
+		committed = 0;
+		pingrep.status = P2P_STATUS_RECEIVINGDATA;
+		pingrep.errno = P2P_ERROR_NONE;
+#if defined(WIBOAPP_RELAY)
+		/* the image to pass on is overwritten */
+		relay_state = RELAY_IDLE;
+#endif
+		/* a committed image is overwritten from now on */
+		eeprom_update_byte((uint8_t *) WIBOAPP_SLOT_EEADDR, 0xFF);
+		break;
+
+	case P2P_WIBO_ADDR:
+		addr = ((p2p_wibo_addr_t*) work)->address;
+		pagebufidx = 0;
+		break;
+
+	case P2P_WIBO_DATA:
+		if (active)
+		{
+			p2p_wibo_data_t *dat = (p2p_wibo_data_t*) work;
+
+			datacrc = crc_ccitt_block(datacrc, dat->data, dat->dsize);
+			for (i = 0; i < dat->dsize; i++)
+			{
+				wiboapp_put(dat->data[i]);
+			}
+		}
+		break;
+
+	case P2P_WIBO_FINISH:
+		if (active && pagebufidx)
+		{
+			wiboapp_spm(addr, pagebuf);
+			memset(pagebuf, 0xFF, sizeof(pagebuf));
+			addr += SPM_PAGESIZE;
+			pagebufidx = 0;
+		}
+		break;
+
+	case P2P_WIBO_COMMIT:
+		{
+			p2p_wibo_commit_t *com = (p2p_wibo_commit_t*) work;
+			uint16_t crc = 0;
+
+			pingrep.errno = wiboapp_commit(com->len, com->crc, &crc);
+			if ((P2P_ERROR_SUCCESS == pingrep.errno)
+					&& (wibo_svc_version() >= 0x0101))
+			{
+				/* the bootloader sets the pointer itself, a signed one
+				 * only installs images with a valid MAC */
+				switch (wibo_svc_commit(com->len, com->crc, com->mac))
+				{
+				case WIBO_SVC_OK:
+					break;
+				case WIBO_SVC_BAD_MAC:
+					pingrep.errno = P2P_ERROR_SIGNATURE;
+					break;
+				default:
+					pingrep.errno = P2P_ERROR_COMMIT;
+					break;
+				}
+			}
+			committed = (P2P_ERROR_SUCCESS == pingrep.errno);
+#if defined(WIBOAPP_RELAY)
+			if (committed)
+			{
+				img_len = com->len;
+				img_crc = com->crc;
+				memcpy(img_mac, com->mac, sizeof(img_mac));
+			}
+#endif
+			pingrep.status = committed ? P2P_STATUS_IDLE : P2P_STATUS_ERROR;
+			/* the reply carries the CRC of the staged image */
+			wiboapp_pingreply(hdr->src, crc);
+		}
+		break;
+
+#if defined(WIBOAPP_RELAY)
+	case P2P_WIBO_RELAY:
+		{
+			p2p_wibo_relay_t *rel = (p2p_wibo_relay_t*) work;
+
+			if (!committed || (RELAY_IDLE != relay_state)
+					|| (rel->len != img_len) || (rel->crc != img_crc)
+					|| (rel->target == pingrep.hdr.src))
+			{
+				pingrep.errno = P2P_ERROR_RELAY;
+				break;
+			}
+			relay_target = rel->target;
+			relay_pos = 0;
+			relay_retries = 0;
+			relay_sent = 0;
+			relay_state = RELAY_RESET;
+			pingrep.status = P2P_STATUS_RELAYING;
+			pingrep.errno = P2P_ERROR_NONE;
+		}
+		break;
+
+	case P2P_PING_CNF:
+		if ((RELAY_WAIT == relay_state) && (hdr->src == relay_target))
+		{
+			/* commit reply of the target */
+			timer_stop(relay_thdl);
+			relay_thdl = NONE_TIMER;
+			relay_hold = 0;
+			wiboapp_relaydone(((p2p_ping_cnf_t*) work)->errno);
+		}
+		break;
+#endif
+
+#if defined(WIBOAPP_PHY)
+	case P2P_PHY_SET:
+		{
+			p2p_phy_set_t *ps = (p2p_phy_set_t*) work;
+
+			if (ps->profile >= radio_phy_count())
+			{
+				break;
+			}
+			if (NONE_TIMER != phy_thdl)
+			{
+				timer_stop(phy_thdl);
+				phy_thdl = NONE_TIMER;
+			}
+			phy_revert = 0;
+			wiboapp_phyapply(ps->profile);
+			if (ps->flags & P2P_PHY_PERSIST)
+			{
+				phy_stored = ps->profile;
+				eeprom_update_byte((uint8_t *) WIBOAPP_PHY_EEADDR, phy_stored);
+			}
+			else if (ps->profile != phy_stored)
+			{
+				/* on trial, back to the stored one if the host is gone */
+				phy_heard = 0;
+				phy_thdl = timer_start(wiboapp_phytimeout,
+						MSEC(P2P_PHY_REVERT_S * 1000UL), 0);
+			}
+		}
+		break;
+
+	case P2P_PHY_STATS_REQ:
+		phy_heard = 1;
+		wiboapp_phyreply(hdr->src, ((p2p_phy_stats_req_t*) work)->clear);
+		break;
+#endif
+
+	case P2P_WIBO_EXIT:
+		active = 0;
+		pingrep.status = P2P_STATUS_IDLE;
+		if (committed)
+		{
+			/* the bootloader installs the image on the way back */
+			cli();
+			wdt_enable(WDTO_15MS);
+			for(;;);
+		}
+		break;
+
+	default:
+		/* target memory is always the staging slot */
+		break;
+	}
+}
+
+/*
+ * \brief Tell the application an update is in progress
+ *
+ * @return 1 between P2P_WIBO_RESET and P2P_WIBO_EXIT
+ */
+uint8_t wiboapp_busy(void)
+{
+	return active;
+}
+
+/* EOF */
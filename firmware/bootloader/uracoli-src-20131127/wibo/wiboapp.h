@@ -0,0 +1,101 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+/* $Id$ */
+/**
+ * @file
+ * @brief Background update receiver for applications
+ *
+ * The application keeps running while the image is downloaded. The
+ * receiver writes it into the staging slot of a bootloader built with
+ * WIBO_FLAVOUR_SLOTS and WIBO_FLAVOUR_APPSPM, the pages are programmed
+ * through the service table of the bootloader, see wibosvc.h.
+ * After P2P_WIBO_COMMIT and P2P_WIBO_EXIT the node resets once, the
+ * bootloader swaps the image in before the new application starts.
+ *
+ * The host side is the same as for the bootloader, see wibohost.py -B.
+ *
+ * Built with P2P_MESH the receiver also relays frames for nodes out of
+ * radio range of the host and can be updated through other nodes, see
+ * p2p_mesh_receive(). Call p2p_mesh_tick() about once a second then.
+ *
+ * Built with WIBOAPP_RELAY a node passes its committed image on to other
+ * nodes (wibohost.py -F), call wiboapp_tx_done() from usr_radio_tx_done()
+ * and timer_init() before.
+ *
+ * Built with WIBOAPP_PHY the node switches PHY profiles on P2P_PHY_SET
+ * and counts the test frames of a benchmark (wibohost.py -Y), see
+ * radio_phy_set(). Call wiboapp_phy_init() after radio_init() and
+ * timer_init(), it applies the profile stored in the EEPROM.
+ *
+ * @ingroup grpAppWiBo
+ */
+#ifndef WIBOAPP_H_
+#define WIBOAPP_H_
+
+#include <stdint.h>
+#include <radio.h>
+
+/* the staging slot is the upper half of the application section,
+ * BOOTLOADER_ADDRESS is a word address, same as WIBO_SLOT_SIZE
+ */
+#ifndef WIBOAPP_SLOT_SIZE
+# define WIBOAPP_SLOT_SIZE ((uint32_t) BOOTLOADER_ADDRESS & ~(uint32_t) (SPM_PAGESIZE - 1))
+#endif
+
+/* boot pointer, length and CRC, same as WIBO_SLOT_EEADDR of the bootloader */
+#ifndef WIBOAPP_SLOT_EEADDR
+# define WIBOAPP_SLOT_EEADDR (8112)
+#endif
+#define WIBOAPP_SLOT_PENDING (0xA5)
+
+/* index of the PHY profile applied after reset, 0xFF: profile 0 */
+#ifndef WIBOAPP_PHY_EEADDR
+# define WIBOAPP_PHY_EEADDR (8161)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wiboapp_init(uint16_t pan_id, uint16_t short_addr);
+uint8_t wiboapp_receive_frame(uint8_t len, uint8_t *frm);
+void wiboapp_task(void);
+uint8_t wiboapp_busy(void);
+#if defined(WIBOAPP_RELAY)
+void wiboapp_tx_done(radio_tx_done_t status);
+#endif
+#if defined(WIBOAPP_PHY)
+void wiboapp_phy_init(void);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* WIBOAPP_H_ */
@@ -0,0 +1,226 @@
+# $Id$
+"""
+wibo host library with overlapping commands
+
+WIBOHost of wibohost.py sends a command and blocks until its reply is
+read, so the serial line and the host node idle in turns. AsyncWIBOHost
+writes a command and returns a Future at once, a reader thread takes the
+replies off the serial line. The host node answers its commands in
+order, so the reader hands each reply to the oldest open request; every
+request gets an id for the log and for matching in the caller.
+
+Feed commands are kept in flight as long as the host feed queue has
+credits (qfeed reply) and the receive buffer of the host serial line
+(HOST_RXBUF) has room for them.
+
+Example:
+
+    from wiboasync import AsyncWIBOHost
+    h = AsyncWIBOHost("/dev/ttyUSB0", 38400)
+    print h.call('echo', 'HalloWibo')
+    f = h.submit('ping', hex(1))          # returns at once
+    ret = h.flashhex(1, "app.hex")       # pipelined qfeed/Q frames
+    print f.result(), ret
+    h.close()
+
+The port can be anything serial.serial_for_url() opens (e.g.
+socket://host:port), or an opened object with write, readline and close.
+"""
+import threading, re, struct, time, collections
+import serial
+from wibohost import crc_ccitt_block, hexline_data, read_hex_lines, \
+        BINFRAME_SOF, BINFRAME_TYPE_QFEED
+
+HOST_RXBUF = 128 # receive buffer of the host serial line in bytes
+TXQ_LEN = 4 # WIBOHOST_TXQ_LEN, frames of the host feed queue
+REPLY_TIMEOUT = 2.0 # seconds, longer than any blocking host command
+
+# reply lines that are followed by more lines of the same reply
+LIST_CODES = ('NODE', 'PHY', 'ISR')
+
+class Future(object):
+    """ Reply of one command, set by the reader thread """
+
+    def __init__(self, reqid, cmd, size):
+        self.reqid = reqid
+        self.cmd = cmd
+        self.size = size # bytes written to the host
+        self.items = [] # lines of a list reply (discover, pingshort, ...)
+        self.deadline = time.time() + REPLY_TIMEOUT
+        self._event = threading.Event()
+        self._reply = None
+        self._callbacks = []
+
+    def done(self):
+        return self._event.isSet()
+
+    def result(self, timeout = None):
+        """ The reply as dict(code, data), code "NO RESPONSE" if the host
+            did not answer in time
+        """
+        if timeout == None:
+            timeout = max(self.deadline - time.time(), 0) + 0.5
+        self._event.wait(timeout)
+        if not self.done():
+            return dict(code = "NO RESPONSE", data = self.cmd)
+        return self._reply
+
+    def add_done_callback(self, fn):
+        """ fn(future) is called from the reader thread, or at once if done """
+        if self.done():
+            fn(self)
+        else:
+            self._callbacks.append(fn)
+
+    def _set(self, reply):
+        self._reply = reply
+        self._event.set()
+        for fn in self._callbacks:
+            fn(self)
+
+class AsyncWIBOHost(object):
+    """ Command interface of a wibo host node, several commands in flight """
+
+    def __init__(self, port, baudrate = 38400, verbose = 0):
+        if isinstance(port, basestring):
+            port = serial.serial_for_url(port, baudrate, timeout = 0.1)
+        self.ser = port
+        self.VERBOSE = verbose
+        self.flt = re.compile("(?P<code>[A-Z]+)([ ]?)(?P<data>.*)")
+        self.lock = threading.Condition()
+        self.pending = collections.deque()
+        self.reqid = 0
+        self.inflight = 0 # bytes written but not yet answered
+        self.running = True
+        self.reader = threading.Thread(target = self._reader)
+        self.reader.daemon = True
+        self.reader.start()
+
+    def close(self):
+        self.running = False
+        self.reader.join()
+        self.ser.close()
+
+    def _submit(self, cmd, raw):
+        self.lock.acquire()
+        self.reqid += 1
+        f = Future(self.reqid, cmd, len(raw))
+        self.pending.append(f)
+        self.inflight += len(raw)
+        self.lock.release()
+        if self.VERBOSE > 2:
+            print "TX[%d]: %s" % (f.reqid, cmd)
+        self.ser.write(raw)
+        return f
+
+    def submit(self, cmd, *args):
+        """ Send a text command, returns its Future """
+        cmd = " ".join(map(str, [cmd] + list(args)))
+        return self._submit(cmd, cmd + '\n')
+
+    def submit_bin(self, typ, nodeid, data):
+        """ Send a binary frame (see cmdif.c), returns its Future """
+        frm = struct.pack('<cHB', typ, nodeid, len(data)) + data
+        crc = crc_ccitt_block(0xffff, frm)
+        return self._submit("bin %s 0x%04x %d" % (typ, nodeid, len(data)),
+                chr(BINFRAME_SOF) + frm + struct.pack('<H', crc))
+
+    def call(self, cmd, *args):
+        """ Send a text command and wait for its reply """
+        return self.submit(cmd, *args).result()
+
+    def _complete(self, reply):
+        self.lock.acquire()
+        f = self.pending.popleft()
+        self.inflight -= f.size
+        self.lock.notifyAll()
+        self.lock.release()
+        if reply != None:
+            reply['items'] = f.items
+        if self.VERBOSE > 2:
+            print "RX[%d]: %s" % (f.reqid, reply)
+        f._set(reply or dict(code = "NO RESPONSE", data = f.cmd))
+
+    def _reader(self):
+        """ Reader thread, hands each reply line to the oldest request """
+        buf = ""
+        while self.running:
+            s = self.ser.readline()
+            if s and not s.endswith('\n'):
+                buf += s # timeout within a line
+                continue
+            s, buf = (buf + s).strip(), ""
+            if not s:
+                if self.pending and self.pending[0].deadline < time.time():
+                    self._complete(None)
+                continue
+            m = self.flt.match(s)
+            if m == None or not self.pending:
+                if self.VERBOSE > 1:
+                    print "RX[-]: %s" % s
+                continue
+            reply = m.groupdict()
+            if reply['code'] in LIST_CODES:
+                self.pending[0].items.append(reply['data'])
+                self.pending[0].deadline = time.time() + REPLY_TIMEOUT
+                continue
+            self._complete(reply)
+
+    def wait_room(self, nbytes, depth = TXQ_LEN):
+        """ Block until fewer than depth requests are open and nbytes more
+            fit the receive buffer of the host
+        """
+        self.lock.acquire()
+        while self.pending and (len(self.pending) >= depth
+                or self.inflight + nbytes > HOST_RXBUF):
+            self.lock.wait(0.1)
+        self.lock.release()
+
+    def drain(self):
+        """ Wait for the replies of all open requests """
+        while self.pending:
+            self.pending[-1].result()
+
+    def ping(self, nodeid):
+        ret = self.call('ping', hex(nodeid))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def flashhex(self, nodeid, fname, binary = True):
+        """ Feed a hex-file or image container through the host feed queue,
+            with as many frames in flight as the credits of the host allow.
+            Returns dict(ok, crc, frames, seconds), crc of the host
+        """
+        t = time.time()
+        lines = [ln for ln in read_hex_lines(fname) if ln]
+        state = dict(credits = TXQ_LEN, ok = True)
+        def done(f):
+            r = f.result(0)
+            if r['code'] == 'OK' and r['data']:
+                state['credits'] = int(r['data'])
+            elif r['code'] != 'WARN':
+                state['ok'] = False
+                if self.VERBOSE > 0:
+                    print "ERR", f.cmd, r['data']
+        self.call('reset')
+        nframes = 0
+        for ln in lines:
+            if binary:
+                if ln[7:9] != '00':
+                    continue
+                data = hexline_data(ln)
+                self.wait_room(len(data) + 7, max(state['credits'], 1))
+                f = self.submit_bin(BINFRAME_TYPE_QFEED, nodeid, data)
+            else:
+                cmd = "qfeed %s %s" % (hex(nodeid), ln)
+                self.wait_room(len(cmd) + 1, max(state['credits'], 1))
+                f = self._submit(cmd, cmd + '\n')
+            f.add_done_callback(done)
+            nframes += 1
+            if not state['ok']:
+                break
+        self.drain()
+        self.call('finish', hex(nodeid))
+        crc = self.call('crc')
+        return dict(ok = state['ok'], crc = crc['data'], frames = nframes,
+                seconds = time.time() - t)
@@ -51,14 +51,20 @@
  */
 
 /* avr-libc inclusions */
-#include <util/crc16.h>
+#include <string.h>
+#include <util/atomic.h>
 
 /* uracoli inclusions */
 #include <board.h>
+#include <ioutil.h>
 #include <timer.h>
 #include <transceiver.h>
 #include <radio.h>
+#include <crc_fast.h>
 #include <p2p_protocol.h>
+#if defined(P2P_MESH)
+#include <p2p.h>
+#endif
 
 /* project inclusions */
 #include "wibohost.h"
@@ -73,8 +79,21 @@
  */
 static uint16_t datacrc = 0x0000;
 
-/* collect data to send here */
-static uint8_t txbuf[MAX_FRAME_SIZE];
+/* next frame number for sequenced data (via feedseq()), frames with a lower
+ * number are retransmissions and are not added to datacrc again
+ */
+static uint16_t txseq = 0;
+
+#if defined(P2P_MESH)
+/* room in front of txbuf for the P2P_MESH_DATA header */
+# define TXHEADROOM (P2P_MESH_OVERHEAD)
+#else
+# define TXHEADROOM (0)
+#endif
+/* collect data to send here, txbuf is the frame in txframe */
+static uint8_t txmem[BUFFER_ELSZ(TXHEADROOM + MAX_FRAME_SIZE)];
+static buffer_t *txframe;
+static uint8_t *txbuf;
 
 /* frame receive buffer */
 static uint8_t rxbuf[MAX_FRAME_SIZE];
@@ -83,12 +102,349 @@ static node_config_t nodeconfig;
 static volatile timer_hdl_t thdl_ping;
 static volatile timer_hdl_t thdl_flashcycle;
 static volatile uint8_t last_feed = 0; /* flag if last command was "_feed" */
+static uint16_t last_feed_addr; /* node of the last feed */
 static volatile uint8_t wait_cmd_ping_cnf = 0;
+static volatile uint8_t wait_cmd_window_cnf = 0;
+static volatile uint8_t wait_cmd_discover = 0;
+static volatile uint8_t wait_cmd_pingshort = 0;
+static volatile uint8_t wait_cmd_resume = 0;
+static volatile uint8_t wait_cmd_fec = 0;
+static volatile uint8_t wait_cmd_phystats = 0;
+
+/* queued feed: data frames sent back-to-back from usr_radio_tx_done() */
+typedef struct
+{
+	uint8_t len;
+	uint8_t frm[MAX_FRAME_SIZE];
+	uint8_t flash; /* frame completes a page at the node */
+} txq_entry_t;
+
+static txq_entry_t txq[WIBOHOST_TXQ_LEN];
+static uint8_t txq_head = 0;
+static volatile uint8_t txq_tail = 0;
+static volatile uint8_t txq_cnt = 0;
+static volatile uint8_t txq_busy = 0;
+static volatile uint8_t txq_flashwait = 0;
+static uint16_t txq_bytes = 0; /* data bytes since reset/addr, modulo page */
+static timer_hdl_t thdl_txq;
+
+/* parallel sessions: one queue per channel/PAN, served in bursts by turn */
+static struct
+{
+	uint8_t used;
+	uint8_t channel;
+	uint16_t pan_id;
+	uint16_t datacrc;
+	uint16_t bytes; /* data bytes since reset/addr, modulo page */
+	uint8_t head;
+	volatile uint8_t tail;
+	volatile uint8_t cnt;
+	volatile uint8_t flashwait;
+	time_t flashend; /* systime the node is done with the page */
+	txq_entry_t q[WIBOHOST_SESS_QLEN];
+} sess[WIBOHOST_SESS_MAX];
+static volatile uint8_t sess_busy = 0xFF; /* session of the frame in the air */
+static uint8_t sess_rr = 0; /* session being served */
+static uint8_t sess_burst = 0; /* frames sent for it in a row */
+
+/* channel and PAN the radio is tuned to */
+static uint8_t tuned_channel;
+static uint16_t tuned_pan_id;
+/* a P2P_WIBO_CHANNEL frame is sent on the rendezvous channel */
+static volatile uint8_t rendezvous_busy = 0;
+
+static void wibohost_tune(uint8_t channel, uint16_t pan_id);
+
+/* multicast session: nodes that take part in a broadcast update */
+static uint16_t mcast_nodes[WIBOHOST_MCAST_MAX];
+static uint8_t mcast_cnt = 0;
+static uint8_t mcast_done[(WIBOHOST_MCAST_MAX + 7) / 8]; /* completion bitmap */
+static volatile uint8_t mcast_polling = 0;
+
+#if defined(P2P_MESH)
+static uint16_t route_addr; /* node of the pending route request */
+#endif
+static volatile uint8_t mcast_replied = 0;
+static p2p_wibo_window_cnf_t mcast_reply;
+
+/* update progress of the nodes, filled from the window replies */
+static wibohost_prog_t prog[WIBOHOST_PROG_NODES];
+static uint8_t prog_cnt = 0;
+static uint8_t prog_next = 0; /* entry replaced when the table is full */
+static uint16_t prog_addr; /* node of the pending window request */
+static uint32_t prog_t0; /* wibohost_usec() of wibohost_reset() */
+static uint16_t prog_retx; /* frames fed again with a number below txseq */
+
+/* round trip times in microseconds, the last entry is over all nodes and
+ * serves for nodes without own samples (e.g. during a scan) */
+static struct
+{
+	uint16_t addr;
+	uint8_t backoff; /* timeouts in a row, the RTO is doubled for each */
+	uint32_t srtt; /* 0: no sample yet */
+	uint32_t rttvar;
+	uint16_t pagesize; /* from its ping reply, 0 if unknown */
+} rtt[WIBOHOST_RTT_NODES + 1];
+static uint8_t rtt_next = 0;
+static uint16_t rtt_addr; /* node of the pending request */
+static uint32_t rtt_t0;
+static volatile uint8_t rtt_pending = 0;
+
+#define RTT_ALL (WIBOHOST_RTT_NODES)
+#define RTT_TICK_US ((uint32_t)(1.0e6 * TIMER_TICK))
+/* us per count of the hardware timer in 1/256, constant folded */
+#define RTT_HWTMR_US256 ((uint32_t)(256.0e6 * HWTIMER_TICK + 0.5))
 
 static const p2p_ping_cnf_t PROGMEM PingReply =
 { .hdr.cmd = P2P_PING_CNF, .hdr.fcf = 0x8841, /* short addressing, frame type: data, no ACK requested */
 .version = APP_VERSION, .appname = APP_NAME, .boardname = BOARD_NAME, };
 
+/******************* round trip times ***************/
+
+/* timer_get_tstamp() gives the ticks of the timer and the counts of the
+ * hardware timer since the last tick, not seconds and microseconds */
+static uint32_t wibohost_usec(void)
+{
+	time_stamp_t ts;
+
+	timer_get_tstamp(&ts);
+	return ts.time_sec * RTT_TICK_US
+			+ (((uint32_t) ts.time_usec * RTT_HWTMR_US256) >> 8);
+}
+
+static uint8_t wibohost_rtt_find(uint16_t short_addr)
+{
+	uint8_t i;
+
+	for (i = 0; i < WIBOHOST_RTT_NODES; i++)
+	{
+		if (rtt[i].srtt != 0 && rtt[i].addr == short_addr)
+		{
+			return i;
+		}
+	}
+	return RTT_ALL;
+}
+
+/*
+ * \brief Note the send time of a request
+ */
+static void wibohost_rtt_start(uint16_t short_addr)
+{
+	rtt_addr = short_addr;
+	rtt_t0 = wibohost_usec();
+	rtt_pending = 1;
+}
+
+static void wibohost_rtt_update(uint8_t i, uint32_t r)
+{
+	int32_t err;
+
+	if (0 == rtt[i].srtt)
+	{
+		rtt[i].srtt = r;
+		rtt[i].rttvar = r / 2;
+	}
+	else
+	{
+		err = (int32_t) (r - rtt[i].srtt);
+		rtt[i].srtt += err / 8;
+		if (err < 0)
+		{
+			err = -err;
+		}
+		rtt[i].rttvar += (err - (int32_t) rtt[i].rttvar) / 4;
+	}
+	rtt[i].backoff = 0;
+}
+
+/*
+ * \brief Take the round trip of the reply to the pending request
+ */
+static void wibohost_rtt_sample(void)
+{
+	uint32_t r;
+	uint8_t i;
+
+	if (!rtt_pending)
+	{
+		return;
+	}
+	rtt_pending = 0;
+	r = wibohost_usec() - rtt_t0;
+	if (0 == r)
+	{
+		r = 1;
+	}
+	i = wibohost_rtt_find(rtt_addr);
+	if (RTT_ALL == i)
+	{
+		i = rtt_next;
+		rtt_next = (rtt_next + 1) % WIBOHOST_RTT_NODES;
+		rtt[i].addr = rtt_addr;
+		rtt[i].srtt = 0;
+		rtt[i].pagesize = 0;
+	}
+	wibohost_rtt_update(i, r);
+	wibohost_rtt_update(RTT_ALL, r);
+}
+
+/******************* update progress ***************/
+
+static wibohost_prog_t *wibohost_prog_find(uint16_t short_addr)
+{
+	wibohost_prog_t *p;
+	uint8_t i;
+
+	for (i = 0; i < prog_cnt; i++)
+	{
+		if (prog[i].short_addr == short_addr)
+		{
+			return &prog[i];
+		}
+	}
+	if (prog_cnt < WIBOHOST_PROG_NODES)
+	{
+		p = &prog[prog_cnt++];
+	}
+	else
+	{
+		p = &prog[prog_next];
+		prog_next = (prog_next + 1) % WIBOHOST_PROG_NODES;
+	}
+	memset(p, 0, sizeof(wibohost_prog_t));
+	p->short_addr = short_addr;
+	p->pages = 0xFFFF;
+	p->lost = 0xFFFF;
+	return p;
+}
+
+/*
+ * \brief Account a window reply of len bytes (without CRC)
+ *
+ * Replies of older nodes end before pages, both are set to 0xFFFF in
+ * the frame then.
+ */
+static void wibohost_prog_reply(p2p_wibo_window_cnf_t *wr, uint8_t len)
+{
+	wibohost_prog_t *p = wibohost_prog_find(wr->hdr.src);
+	uint16_t m;
+
+	if (len < sizeof(p2p_wibo_window_cnf_t))
+	{
+		wr->pages = 0xFFFF;
+		wr->lost = 0xFFFF;
+	}
+	p->base = wr->base;
+	p->pages = wr->pages;
+	p->lost = wr->lost;
+	/* holes below the last frame it holds */
+	for (m = wr->received; m; m >>= 1)
+	{
+		p->nacks += !(m & 1);
+	}
+	p->t_ms = (wibohost_usec() - prog_t0) / 1000;
+}
+
+/*
+ * \brief Copy the progress of a node, entries in the order the nodes replied first
+ *
+ * @param i Entry number
+ * @param *p Progress of the node
+ * @return 1 if the entry exists, 0 after the last one
+ */
+uint8_t wibohost_prog_get(uint8_t i, wibohost_prog_t *p)
+{
+	if (i >= prog_cnt)
+	{
+		return 0;
+	}
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		memcpy(p, &prog[i], sizeof(wibohost_prog_t));
+	}
+	return 1;
+}
+
+/*
+ * \brief Frames fed since wibohost_reset()
+ *
+ * @param *frames Frame numbers used so far (next number of feedseq)
+ * @param *retx Frames fed again that carried an older number
+ * @return Milliseconds since wibohost_reset()
+ */
+uint32_t wibohost_prog_summary(uint16_t *frames, uint16_t *retx)
+{
+	*frames = txseq;
+	*retx = prog_retx;
+	return (wibohost_usec() - prog_t0) / 1000;
+}
+
+/*
+ * \brief The pending request timed out, back off
+ */
+static void wibohost_rtt_timeout(void)
+{
+	uint8_t i;
+
+	if (!rtt_pending)
+	{
+		return;
+	}
+	rtt_pending = 0;
+	i = wibohost_rtt_find(rtt_addr);
+	if ((RTT_ALL != i) && (rtt[i].backoff < 4))
+	{
+		rtt[i].backoff++;
+	}
+}
+
+/*
+ * \brief Note the page size of a node, 0 and odd values are ignored
+ */
+static void wibohost_pagesize_set(uint16_t short_addr, uint16_t pagesize)
+{
+	uint8_t i;
+
+	i = wibohost_rtt_find(short_addr);
+	if ((RTT_ALL != i) && (pagesize >= 64) && (pagesize <= 1024)
+			&& (0 == (pagesize & (pagesize - 1))))
+	{
+		rtt[i].pagesize = pagesize;
+	}
+}
+
+/*
+ * \brief Page size of a node, from its ping reply
+ *
+ * @return WIBOHOST_PAGESIZE if the node is unknown
+ */
+uint16_t wibohost_pagesize(uint16_t short_addr)
+{
+	uint8_t i;
+
+	i = wibohost_rtt_find(short_addr);
+	if ((RTT_ALL == i) || (0 == rtt[i].pagesize))
+	{
+		return WIBOHOST_PAGESIZE;
+	}
+	return rtt[i].pagesize;
+}
+
+/*
+ * \brief Count the data of a direct feed at the page buffer of the node
+ *
+ * @return 1 if the data fills the page, the node writes it then
+ */
+static uint8_t wibohost_page_account(uint16_t short_addr, uint8_t lendata)
+{
+	uint16_t pagesize = wibohost_pagesize(short_addr);
+	uint16_t bytes = txq_bytes + lendata;
+
+	txq_bytes = bytes % pagesize;
+	return (bytes >= pagesize) ? 1 : 0;
+}
+
 /******************* uracoli callback functions ***************/
 
 /*
@@ -96,10 +452,79 @@ static const p2p_ping_cnf_t PROGMEM PingReply =
  */
 time_t wibohost_pingtimeout(timer_arg_t t)
 {
+	wibohost_rtt_timeout();
 	cb_wibohost_pingtimeout();
 	return 0; /* stop timer */
 }
 
+/*
+ * \brief Timeout for resume request
+ */
+time_t wibohost_resumetimeout(timer_arg_t t)
+{
+	wait_cmd_resume = 0;
+	wibohost_rtt_timeout();
+	cb_wibohost_resumetimeout();
+	return 0; /* stop timer */
+}
+
+/*
+ * \brief Timeout for FEC request
+ */
+time_t wibohost_fectimeout(timer_arg_t t)
+{
+	wait_cmd_fec = 0;
+	wibohost_rtt_timeout();
+	cb_wibohost_fectimeout();
+	return 0; /* stop timer */
+}
+
+/*
+ * \brief End of the reply window of a discovery or a short ping
+ */
+time_t wibohost_discovertimeout(timer_arg_t t)
+{
+	wait_cmd_discover = 0;
+	wait_cmd_pingshort = 0;
+	cb_wibohost_discoverdone();
+	return 0; /* stop timer */
+}
+
+/*
+ * \brief Timeout for PHY stats request
+ */
+time_t wibohost_phystatstimeout(timer_arg_t t)
+{
+	wait_cmd_phystats = 0;
+	wibohost_rtt_timeout();
+	cb_wibohost_phystatstimeout();
+	return 0; /* stop timer */
+}
+
+/*
+ * \brief Timeout for window request
+ */
+time_t wibohost_windowtimeout(timer_arg_t t)
+{
+	wibohost_prog_find(prog_addr)->timeouts++;
+	wait_cmd_window_cnf = 0;
+	wibohost_rtt_timeout();
+	if (!mcast_polling)
+	{
+		cb_wibohost_windowtimeout();
+	}
+	return 0; /* stop timer */
+}
+
+/*
+ * \brief Timeout for flash cycle of queued frames
+ */
+time_t wibohost_queueflashtimeout(timer_arg_t t)
+{
+	txq_flashwait = 0;
+	return 0; /* stop timer */
+}
+
 /*
  * \brief Timeout for flash cycle timer
  */
@@ -109,6 +534,92 @@ time_t wibohost_flashcycletimeout(timer_arg_t t)
 	return 0; /* stop timer */
 }
 
+#if defined(P2P_MESH)
+/*
+ * \brief End of a route request, report what is known now
+ */
+time_t wibohost_routetimeout(timer_arg_t t)
+{
+	uint8_t hops = 0;
+	uint16_t next;
+
+	next = p2p_mesh_nexthop(route_addr, &hops);
+	cb_wibohost_routedone(route_addr, next, hops);
+	return 0; /* stop timer */
+}
+
+/*
+ * \brief Age the mesh routes
+ */
+time_t wibohost_meshtick(timer_arg_t t)
+{
+	p2p_mesh_tick();
+	return MSEC(1000);
+}
+
+/*
+ * \brief Reply timeout for a node, the round trip grows with the hops
+ */
+static time_t wibohost_hoptimeout(uint16_t short_addr, time_t t)
+{
+	uint8_t hops = 1;
+
+	p2p_mesh_nexthop(short_addr, &hops);
+	return t * hops;
+}
+#else
+# define wibohost_hoptimeout(short_addr, t) (t)
+#endif
+
+/*
+ * \brief Reply timeout for a node from its round trip time
+ * Nodes without samples get the estimate over all nodes, scaled with
+ * the hops, and PINGTIMEOUT_MS as long as there is none at all.
+ */
+static time_t wibohost_rto(uint16_t short_addr)
+{
+	uint32_t us;
+	uint8_t i;
+
+	i = wibohost_rtt_find(short_addr);
+	if (0 == rtt[i].srtt)
+	{
+		return wibohost_hoptimeout(short_addr, PINGTIMEOUT_MS);
+	}
+	us = rtt[i].srtt + 4 * rtt[i].rttvar;
+	if (us < RTO_MIN_US)
+	{
+		us = RTO_MIN_US;
+	}
+	us <<= rtt[i].backoff;
+	if (us > RTO_MAX_US)
+	{
+		us = RTO_MAX_US;
+	}
+	/* +1: the first tick of a timer may be short */
+	us = us / RTT_TICK_US + 1;
+	if (RTT_ALL == i)
+	{
+		return wibohost_hoptimeout(short_addr, (time_t) us);
+	}
+	return (time_t) us;
+}
+
+/*
+ * \brief Pause after a page: the flash cycle plus the way to the node
+ */
+static time_t wibohost_flashtimeout(uint16_t short_addr)
+{
+	uint8_t i;
+
+	i = wibohost_rtt_find(short_addr);
+	if (RTT_ALL == i)
+	{
+		return FLASHTIMEOUT_MS;
+	}
+	return FLASHCYCLE_MS + (rtt[i].srtt / 2) / RTT_TICK_US + 1;
+}
+
 /*
  * \brief Callback of uracoli radio-layer
  */
@@ -133,142 +644,887 @@ uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi,
 {
 	p2p_ping_cnf_t *pr = (p2p_ping_cnf_t*) frm;
 
+#if defined(P2P_MESH)
+	/* routes are learned and frames for other nodes are forwarded here,
+	 * a frame for the host comes back unwrapped
+	 */
+	if (crc_fail || (len < 2))
+	{
+		return frm;
+	}
+	len = p2p_mesh_receive(frm, len - 2) + 2;
+	if (2 == len)
+	{
+		return frm;
+	}
+#else
+	if (crc_fail)
+	{
+		return frm;
+	}
+#endif
+
 	/* decode command code */
-	if ( P2P_PING_CNF == pr->hdr.cmd && wait_cmd_ping_cnf)
+	if ( P2P_PING_CNF == pr->hdr.cmd && wait_cmd_discover)
+	{ /* collect all replies until the window ends */
+		cb_wibohost_discoverreply(pr, lqi, ed);
+	}
+	else if ( P2P_PING_SHORT_CNF == pr->hdr.cmd && wait_cmd_pingshort)
+	{ /* same for short pings */
+		cb_wibohost_pingshortreply((p2p_ping_short_cnf_t*) frm, lqi, ed);
+	}
+	else if ( P2P_PING_CNF == pr->hdr.cmd && wait_cmd_ping_cnf)
 	{ /* this command is sync */
 		timer_stop(thdl_ping);
+		wibohost_rtt_sample();
+		wibohost_pagesize_set(pr->hdr.src, p2p_ping_cnf_pagesize(pr, len - 2));
 		cb_wibohost_pingreply(pr);
 	}
+	else if ( P2P_WIBO_WINDOW_CNF == pr->hdr.cmd && wait_cmd_window_cnf)
+	{ /* this command is sync */
+		timer_stop(thdl_ping);
+		wibohost_rtt_sample();
+		wibohost_prog_reply((p2p_wibo_window_cnf_t*) frm, len - 2);
+		if (mcast_polling)
+		{
+			memcpy(&mcast_reply, frm, sizeof(p2p_wibo_window_cnf_t));
+			mcast_replied = 1;
+		}
+		else
+		{
+			cb_wibohost_windowreply((p2p_wibo_window_cnf_t*) frm);
+		}
+		wait_cmd_window_cnf = 0;
+	}
+	else if ( P2P_WIBO_RESUME == pr->hdr.cmd && wait_cmd_resume)
+	{ /* this command is sync */
+		timer_stop(thdl_ping);
+		wibohost_rtt_sample();
+		wait_cmd_resume = 0;
+		cb_wibohost_resumereply((p2p_wibo_resume_t*) frm);
+	}
+	else if ( P2P_WIBO_FEC_CNF == pr->hdr.cmd && wait_cmd_fec)
+	{ /* this command is sync */
+		timer_stop(thdl_ping);
+		wibohost_rtt_sample();
+		wait_cmd_fec = 0;
+		cb_wibohost_fecreply((p2p_wibo_fec_cnf_t*) frm);
+	}
+	else if ( P2P_PHY_STATS_CNF == pr->hdr.cmd && wait_cmd_phystats)
+	{ /* this command is sync */
+		timer_stop(thdl_ping);
+		wibohost_rtt_sample();
+		wait_cmd_phystats = 0;
+		cb_wibohost_phystatsreply((p2p_phy_stats_cnf_t*) frm);
+	}
 	else if (P2P_PING_REQ == pr->hdr.cmd) /* this command is async */
 	{
 		wibohost_ping_reply(pr->hdr.src);
 	}
 	else if (P2P_JUMP_BOOTL == pr->hdr.cmd)
 	{
-		timer_stop(thdl_ping);
-		timer_stop(thdl_flashcycle);
-		cli();
-#if defined(SR_RX_SAFE_MODE)
-		trx_bit_write(SR_RX_SAFE_MODE, 1);
-#endif
-		jump_to_bootloader();
+		timer_stop(thdl_ping);
+		timer_stop(thdl_flashcycle);
+		cli();
+#if defined(SR_RX_SAFE_MODE)
+		trx_bit_write(SR_RX_SAFE_MODE, 1);
+#endif
+		jump_to_bootloader();
+	}
+	else
+	{
+		/* unknown command, skip the frame */
+	}
+
+#if defined(SR_RX_SAFE_MODE)
+	trx_bit_write(SR_RX_SAFE_MODE, 1);
+#endif
+
+	return frm;
+}
+
+/*
+ * \brief Callback of uracoli radio-layer
+ */
+void usr_radio_tx_done(radio_tx_done_t status)
+{
+	if (txq_busy)
+	{
+		txq_busy = 0;
+		if (txq[txq_tail].flash)
+		{
+			/* node is busy writing the page, wait before next frame */
+			txq_flashwait = 1;
+			thdl_txq = timer_start(wibohost_queueflashtimeout,
+					wibohost_flashtimeout(
+						((p2p_hdr_t*) txq[txq_tail].frm)->dst), 0);
+		}
+		txq_tail = (txq_tail + 1) % WIBOHOST_TXQ_LEN;
+		txq_cnt--;
+		/* next frame is started by wibohost_task(), the radio layer
+		 * switches back to idle state after this callback
+		 */
+	}
+	else if (sess_busy != 0xFF)
+	{
+		if (sess[sess_busy].q[sess[sess_busy].tail].flash)
+		{
+			sess[sess_busy].flashwait = 1;
+			sess[sess_busy].flashend = timer_systime()
+					+ wibohost_flashtimeout(((p2p_hdr_t*)
+						sess[sess_busy].q[sess[sess_busy].tail].frm)->dst);
+		}
+		sess[sess_busy].tail = (sess[sess_busy].tail + 1) % WIBOHOST_SESS_QLEN;
+		sess[sess_busy].cnt--;
+		sess_busy = 0xFF;
+	}
+
+	if (rendezvous_busy)
+	{
+		rendezvous_busy = 0;
+		wibohost_tune(nodeconfig.channel, nodeconfig.pan_id);
+	}
+
+	if (last_feed == 1)
+	{
+		/* start flash timer */
+		thdl_flashcycle = timer_start(wibohost_flashcycletimeout,
+				wibohost_flashtimeout(last_feed_addr), 0);
+		last_feed = 0;
+	}
+
+	cb_wibohost_tx_done(status);
+}
+
+/*
+ * \brief Initialize communication layer
+ * - Read node configuration from NVRAM
+ * - Initialize uracoli radio-layer
+ */
+void wibohost_init(void)
+{
+#if defined(NODECONFIG_STATIC)
+	/* for development purposes */
+	nodeconfig.channel = 11;
+	nodeconfig.pan_id = 0x01;
+	nodeconfig.short_addr = 0x05;
+#elif BOARD_TYPE == BOARD_PINOCCIO
+	if (get_node_config_handoff(&nodeconfig) != 0)
+	{
+		/* bootloader without the record, read the EEPROM map */
+		nodeconfig.channel = eeprom_read_byte((uint8_t *)8179);
+		nodeconfig.pan_id = eeprom_read_word((uint16_t *)8180);
+		nodeconfig.short_addr = eeprom_read_word((uint16_t *)8182);
+		nodeconfig.ieee_addr = 0;
+	}
+#elif BOARD_TYPE == BOARD_SIM
+	/* the addresses given to sim_node_add() */
+	sim_node_cfg(&nodeconfig.channel, &nodeconfig.pan_id,
+			&nodeconfig.short_addr, &nodeconfig.ieee_addr);
+#else
+	get_node_config(&nodeconfig);
+#endif
+	txframe = buffer_init(txmem, sizeof(txmem), TXHEADROOM);
+	txbuf = BUFFER_PDATA(txframe);
+	radio_init(rxbuf, MAX_FRAME_SIZE);
+	radio_set_param(RP_CHANNEL(nodeconfig.channel));
+	radio_set_param(RP_PANID(nodeconfig.pan_id));
+	radio_set_param(RP_SHORTADDR(nodeconfig.short_addr));
+	radio_set_param(RP_IDLESTATE(STATE_RXAUTO));
+	tuned_channel = nodeconfig.channel;
+	tuned_pan_id = nodeconfig.pan_id;
+#if defined(P2P_MESH)
+	p2p_mesh_init(nodeconfig.pan_id, nodeconfig.short_addr);
+	timer_start(wibohost_meshtick, MSEC(1000), 0);
+#endif
+
+#if defined(SR_RX_SAFE_MODE)
+	trx_bit_write(SR_RX_SAFE_MODE, 1);
+#endif
+}
+
+/*
+ * \brief Send a command over the air
+ *
+ * Construct the header that is the same for all commands and
+ * pack into IEEE802.15.4 MPDU
+ *
+ * @param short_addr IEEE short address
+ * @param cmdcode Command code as defined in p2p_protocol.h
+ * @param *data Pointer to buffer of Tx frame (header is mapped onto it here)
+ * @param lendata Overall length of Tx frame
+ */
+void wibohost_sendcommand(uint16_t dst_addr, uint8_t cmdcode, uint8_t *data,
+		uint8_t lendata)
+{
+	p2p_hdr_t *hdr = (p2p_hdr_t*) data;
+#if defined(P2P_MESH)
+	uint8_t hops = 1;
+
+	p2p_mesh_nexthop(dst_addr, &hops);
+	if ((0xFFFF != dst_addr) && (hops > 1))
+	{
+		/* out of radio range, through the mesh; the P2P_MESH_DATA
+		 * header goes into the room in front of txbuf */
+		if (data != txbuf)
+		{
+			memcpy(txbuf, data, lendata);
+		}
+		txframe->istart = TXHEADROOM + sizeof(p2p_hdr_t);
+		txframe->iend = TXHEADROOM + lendata;
+		p2p_mesh_send_buffer(dst_addr, cmdcode, txframe);
+		return;
+	}
+#endif
+
+	FILL_P2P_HEADER_NOACK(hdr, nodeconfig.pan_id, dst_addr,
+			nodeconfig.short_addr, cmdcode);
+	radio_set_state(STATE_TXAUTO);
+
+	radio_send_frame(lendata + 2, data, 1); /* +2: add CRC bytes (FCF) */
+}
+
+void wibohost_ping_reply(uint16_t pingaddr)
+{
+	memcpy_P(txbuf, &PingReply, sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME));
+	wibohost_sendcommand(pingaddr, P2P_PING_CNF, txbuf,
+			sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME));
+}
+
+/*
+ * \brief Feed data to a node
+ * This data is part of the flash image that shall be programmed to
+ * the target device. It can be sliced to any size from outside. The
+ * target device collects it and programs its pages as soon as one page
+ * size of data is reached.
+ *
+ * @param short_addr Address of node to feed (or broadcast 0xFFFF)
+ * @param *data Pointer to buffer where data is stored
+ * @param lendata Length of buffer
+ * @return 1 if the frame fills a page of the node, the flash cycle
+ *         timer runs then, 0 if the next frame may follow at once
+ */
+uint8_t wibohost_feed(uint16_t short_addr, uint8_t *data, uint8_t lendata)
+{
+	p2p_wibo_data_t *dat = (p2p_wibo_data_t*) txbuf;
+
+	datacrc = crc_ccitt_block(datacrc, data, lendata);
+	memcpy(dat->data, data, lendata);
+	dat->dsize = lendata;
+
+	wibohost_sendcommand(short_addr, P2P_WIBO_DATA, (uint8_t*) dat,
+			sizeof(p2p_wibo_data_t) + lendata);
+
+	last_feed_addr = short_addr;
+	last_feed = wibohost_page_account(short_addr, lendata);
+	return last_feed;
+}
+
+/*
+ * \brief Queue data for a node
+ * Same as wibohost_feed(), but the frame is only put into the transmit
+ * queue. Queued frames are sent back-to-back, a flash cycle pause
+ * is inserted only after a frame that fills a page of the node.
+ *
+ * @param short_addr Address of node to feed (or broadcast 0xFFFF)
+ * @param *data Pointer to buffer where data is stored
+ * @param lendata Length of buffer
+ * @return Number of free queue entries (credits) afterwards,
+ *         0xFF if the queue was full and nothing was queued
+ */
+uint8_t wibohost_queue_feed(uint16_t short_addr, uint8_t *data, uint8_t lendata)
+{
+	p2p_wibo_data_t *dat = (p2p_wibo_data_t*) txq[txq_head].frm;
+	p2p_hdr_t *hdr = (p2p_hdr_t*) dat;
+	uint8_t credits, sreg;
+
+	if (txq_cnt >= WIBOHOST_TXQ_LEN)
+	{
+		return 0xFF;
+	}
+
+	FILL_P2P_HEADER_NOACK(hdr, nodeconfig.pan_id, short_addr,
+			nodeconfig.short_addr, P2P_WIBO_DATA);
+	datacrc = crc_ccitt_block(datacrc, data, lendata);
+	memcpy(dat->data, data, lendata);
+	dat->dsize = lendata;
+	txq[txq_head].len = sizeof(p2p_wibo_data_t) + lendata;
+
+	txq[txq_head].flash = wibohost_page_account(short_addr, lendata);
+
+	txq_head = (txq_head + 1) % WIBOHOST_TXQ_LEN;
+
+	sreg = SREG;
+	cli();
+	txq_cnt++;
+	credits = WIBOHOST_TXQ_LEN - txq_cnt;
+	SREG = sreg;
+
+	wibohost_task();
+	return credits;
+}
+
+/*
+ * \brief Tune the radio to a channel and PAN, if not done yet
+ */
+static void wibohost_tune(uint8_t channel, uint16_t pan_id)
+{
+	if (tuned_channel != channel)
+	{
+		radio_set_param(RP_CHANNEL(channel));
+		tuned_channel = channel;
+	}
+	if (tuned_pan_id != pan_id)
+	{
+		radio_set_param(RP_PANID(pan_id));
+		tuned_pan_id = pan_id;
+	}
+}
+
+/*
+ * \brief Start transmission of the next session frame
+ * A session keeps the radio for WIBOHOST_SESS_BURST frames, or until
+ * its node is busy with a page, then the next session is served.
+ * The radio returns to the channel of the host when all are done.
+ */
+static void wibohost_sess_task(void)
+{
+	uint8_t i, pending = 0;
+
+	for (i = 0; i < WIBOHOST_SESS_MAX; i++)
+	{
+		if (sess_burst >= WIBOHOST_SESS_BURST)
+		{
+			sess_rr = (sess_rr + 1) % WIBOHOST_SESS_MAX;
+			sess_burst = 0;
+		}
+		if (sess[sess_rr].flashwait
+				&& ((int32_t) (timer_systime() - sess[sess_rr].flashend) >= 0))
+		{
+			sess[sess_rr].flashwait = 0;
+		}
+		pending |= sess[sess_rr].cnt | sess[sess_rr].flashwait;
+		if (sess[sess_rr].cnt && !sess[sess_rr].flashwait)
+		{
+			wibohost_tune(sess[sess_rr].channel, sess[sess_rr].pan_id);
+			sess_busy = sess_rr;
+			sess_burst++;
+			radio_set_state(STATE_TXAUTO);
+			radio_send_frame(sess[sess_rr].q[sess[sess_rr].tail].len + 2,
+					sess[sess_rr].q[sess[sess_rr].tail].frm, 1);
+			return;
+		}
+		sess_rr = (sess_rr + 1) % WIBOHOST_SESS_MAX;
+		sess_burst = 0;
+	}
+
+	if (!pending)
+	{
+		wibohost_tune(nodeconfig.channel, nodeconfig.pan_id);
+	}
+}
+
+/*
+ * \brief Start transmission of the oldest queued frame
+ * To be called from the main loop and from busy waits
+ */
+void wibohost_task(void)
+{
+	if (txq_busy || (sess_busy != 0xFF))
+	{
+		return;
+	}
+	if (!txq_flashwait && txq_cnt)
+	{
+		wibohost_tune(nodeconfig.channel, nodeconfig.pan_id);
+		txq_busy = 1;
+		radio_set_state(STATE_TXAUTO);
+		radio_send_frame(txq[txq_tail].len + 2, txq[txq_tail].frm, 1);
+	}
+	else
+	{
+		wibohost_sess_task();
+	}
+}
+
+/*
+ * \brief Number of frames queued and not yet sent
+ * Frames of all sessions are included, the radio is back on the
+ * channel of the host when this is 0.
+ */
+uint8_t wibohost_queue_pending(void)
+{
+	uint8_t i, pending = txq_cnt + txq_flashwait;
+
+	for (i = 0; i < WIBOHOST_SESS_MAX; i++)
+	{
+		pending += sess[i].cnt + sess[i].flashwait;
+	}
+	return pending;
+}
+
+/*
+ * \brief Open a session on a channel and PAN
+ * Frames queued for a session are sent on its channel and PAN, the
+ * sessions take turns, so several troops are updated at the same time.
+ *
+ * @param channel Radio channel of the troop
+ * @param pan_id PAN of the troop
+ * @return Session number, 0xFF if the channel is out of range or
+ *         all sessions are in use
+ */
+uint8_t wibohost_sess_open(uint8_t channel, uint16_t pan_id)
+{
+	uint8_t i;
+
+	if ((TRX_MIN_CHANNEL > channel) || (TRX_MAX_CHANNEL < channel))
+	{
+		return 0xFF;
+	}
+	for (i = 0; i < WIBOHOST_SESS_MAX; i++)
+	{
+		if (!sess[i].used)
+		{
+			memset(&sess[i], 0, sizeof(sess[i]));
+			sess[i].used = 1;
+			sess[i].channel = channel;
+			sess[i].pan_id = pan_id;
+			return i;
+		}
+	}
+	return 0xFF;
+}
+
+/*
+ * \brief Close a session
+ *
+ * @param s Session number
+ * @return 1 if closed, 0 if it still has frames to send
+ */
+uint8_t wibohost_sess_close(uint8_t s)
+{
+	if (sess[s].cnt || (sess_busy == s))
+	{
+		return 0;
+	}
+	sess[s].used = 0;
+	return 1;
+}
+
+/*
+ * \brief Check for an open session
+ *
+ * @param s Session number
+ * @return 1 if the session is open
+ */
+uint8_t wibohost_sess_isopen(uint8_t s)
+{
+	return (s < WIBOHOST_SESS_MAX) && sess[s].used;
+}
+
+/*
+ * \brief Reserve the next queue entry of a session and fill the header
+ *
+ * @return Pointer to the frame, NULL if the queue is full
+ */
+static uint8_t* wibohost_sess_frame(uint8_t s, uint16_t short_addr,
+		uint8_t cmdcode, uint8_t lendata, uint8_t flash)
+{
+	p2p_hdr_t *hdr = (p2p_hdr_t*) sess[s].q[sess[s].head].frm;
+
+	if (sess[s].cnt >= WIBOHOST_SESS_QLEN)
+	{
+		return NULL;
+	}
+	FILL_P2P_HEADER_NOACK(hdr, sess[s].pan_id, short_addr,
+			nodeconfig.short_addr, cmdcode);
+	sess[s].q[sess[s].head].len = lendata;
+	sess[s].q[sess[s].head].flash = flash;
+	return (uint8_t*) hdr;
+}
+
+/*
+ * \brief Hand the reserved entry to the scheduler
+ *
+ * @return Number of free queue entries of the session
+ */
+static uint8_t wibohost_sess_commit(uint8_t s)
+{
+	uint8_t credits, sreg;
+
+	sess[s].head = (sess[s].head + 1) % WIBOHOST_SESS_QLEN;
+
+	sreg = SREG;
+	cli();
+	sess[s].cnt++;
+	credits = WIBOHOST_SESS_QLEN - sess[s].cnt;
+	SREG = sreg;
+
+	wibohost_task();
+	return credits;
+}
+
+/*
+ * \brief Queue a reset for all nodes of a session, see wibohost_reset()
+ *
+ * @param s Session number
+ * @return Free queue entries, 0xFF if the queue was full
+ */
+uint8_t wibohost_sess_reset(uint8_t s)
+{
+	if (NULL == wibohost_sess_frame(s, 0xFFFF, P2P_WIBO_RESET,
+			sizeof(p2p_wibo_reset_t), 0))
+	{
+		return 0xFF;
+	}
+	sess[s].datacrc = 0x0000;
+	sess[s].bytes = 0;
+	return wibohost_sess_commit(s);
+}
+
+/*
+ * \brief Queue the flash target address for a node of a session
+ *
+ * @param s Session number
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @param flash_addr Address in flash memory
+ * @return Free queue entries, 0xFF if the queue was full
+ */
+uint8_t wibohost_sess_addr(uint8_t s, uint16_t short_addr, uint32_t flash_addr)
+{
+	p2p_wibo_addr_t *dat = (p2p_wibo_addr_t*) wibohost_sess_frame(s,
+			short_addr, P2P_WIBO_ADDR, sizeof(p2p_wibo_addr_t), 0);
+
+	if (NULL == dat)
+	{
+		return 0xFF;
+	}
+	dat->address = flash_addr;
+	sess[s].bytes = 0; /* node restarts its page buffer */
+	return wibohost_sess_commit(s);
+}
+
+/*
+ * \brief Queue data for a node of a session, see wibohost_queue_feed()
+ *
+ * @param s Session number
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @param *data Pointer to buffer where data is stored
+ * @param lendata Length of buffer
+ * @return Free queue entries, 0xFF if the queue was full
+ */
+uint8_t wibohost_sess_feed(uint8_t s, uint16_t short_addr, uint8_t *data,
+		uint8_t lendata)
+{
+	p2p_wibo_data_t *dat;
+	uint16_t pagesize = wibohost_pagesize(short_addr);
+	uint16_t bytes = sess[s].bytes + lendata;
+
+	dat = (p2p_wibo_data_t*) wibohost_sess_frame(s, short_addr, P2P_WIBO_DATA,
+			sizeof(p2p_wibo_data_t) + lendata, (bytes >= pagesize));
+	if (NULL == dat)
+	{
+		return 0xFF;
+	}
+	sess[s].datacrc = crc_ccitt_block(sess[s].datacrc, data, lendata);
+	memcpy(dat->data, data, lendata);
+	dat->dsize = lendata;
+	sess[s].bytes = bytes % pagesize;
+	return wibohost_sess_commit(s);
+}
+
+/*
+ * \brief Queue a finish for a node of a session, see wibohost_finish()
+ *
+ * @param s Session number
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @return Free queue entries, 0xFF if the queue was full
+ */
+uint8_t wibohost_sess_finish(uint8_t s, uint16_t short_addr)
+{
+	if (NULL == wibohost_sess_frame(s, short_addr, P2P_WIBO_FINISH,
+			sizeof(p2p_wibo_finish_t), 1))
+	{
+		return 0xFF;
+	}
+	sess[s].bytes = 0;
+	return wibohost_sess_commit(s);
+}
+
+/*
+ * \brief Queue an exit for a node of a session, see wibohost_exit()
+ *
+ * @param s Session number
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @return Free queue entries, 0xFF if the queue was full
+ */
+uint8_t wibohost_sess_exit(uint8_t s, uint16_t short_addr)
+{
+	if (NULL == wibohost_sess_frame(s, short_addr, P2P_WIBO_EXIT,
+			sizeof(p2p_wibo_exit_t), 0))
+	{
+		return 0xFF;
+	}
+	return wibohost_sess_commit(s);
+}
+
+/*
+ * \brief Deliver the checksum of the data queued for a session
+ *
+ * @param s Session number
+ * @return CRC-16 checksum
+ */
+uint16_t wibohost_sess_getcrc(uint8_t s)
+{
+	return sess[s].datacrc;
+}
+
+/*
+ * \brief Feed numbered data to a node
+ * Same as wibohost_feed(), but the frame carries a sequence number. The
+ * node buffers frames that arrive out of order and reports the missing
+ * ones on wibohost_window(), so only these have to be sent again.
+ * The checksum is only updated for the next new frame, retransmissions
+ * of lower numbers leave it untouched.
+ *
+ * @param short_addr Address of node to feed (or broadcast 0xFFFF)
+ * @param seqno Frame number, counting from 0 after wibohost_reset()
+ * @param *data Pointer to buffer where data is stored
+ * @param lendata Length of buffer
+ * @return 1 if the flash cycle timer runs after the frame, see wibohost_feed()
+ */
+uint8_t wibohost_feedseq(uint16_t short_addr, uint16_t seqno, uint8_t *data,
+		uint8_t lendata)
+{
+	p2p_wibo_data_seq_t *dat = (p2p_wibo_data_seq_t*) txbuf;
+	uint8_t flash = 1;
+
+	/* retransmissions are in datacrc already, one of them may fill a
+	 * gap and complete a page, so they always get the pause */
+	if (seqno == txseq)
+	{
+		datacrc = crc_ccitt_block(datacrc, data, lendata);
+		txseq++;
+		flash = wibohost_page_account(short_addr, lendata);
 	}
-	else
+	else if (seqno < txseq)
 	{
-		/* unknown command, skip the frame */
+		prog_retx++;
 	}
+	memcpy(dat->data, data, lendata);
+	dat->seqno = seqno;
+	dat->dsize = lendata;
 
-#if defined(SR_RX_SAFE_MODE)
-	trx_bit_write(SR_RX_SAFE_MODE, 1);
-#endif
+	wibohost_sendcommand(short_addr, P2P_WIBO_DATA_SEQ, (uint8_t*) dat,
+			sizeof(p2p_wibo_data_seq_t) + lendata);
 
-	return frm;
+	last_feed_addr = short_addr;
+	last_feed = flash;
+	return flash;
 }
 
 /*
- * \brief Callback of uracoli radio-layer
+ * \brief Ask a node which numbered frames it holds
+ * The reply is delivered with cb_wibohost_windowreply(), or
+ * cb_wibohost_windowtimeout() is called if there was none.
+ *
+ * @param short_addr The node addressed (no broadcast)
  */
-void usr_radio_tx_done(radio_tx_done_t status)
+void wibohost_window(uint16_t short_addr)
 {
-	if (last_feed == 1)
-	{
-		/* start flash timer */
-		thdl_flashcycle = timer_start(wibohost_flashcycletimeout,
-				FLASHTIMEOUT_MS, 0);
-		last_feed = 0;
-	}
+	wibohost_rtt_start(short_addr);
+	prog_addr = short_addr;
+	wibohost_sendcommand(short_addr, P2P_WIBO_WINDOW_REQ, txbuf,
+			sizeof(p2p_wibo_window_req_t));
 
-	cb_wibohost_tx_done(status);
+	/* start timeout timer */
+	thdl_ping = timer_start(wibohost_windowtimeout,
+			wibohost_rto(short_addr), 0);
+	wait_cmd_window_cnf = 1;
 }
 
 /*
- * \brief Initialize communication layer
- * - Read node configuration from NVRAM
- * - Initialize uracoli radio-layer
+ * \brief Send a coded symbol of a block, see p2p_wibo_fec_t
+ * The symbols are made by the caller, the node decodes a block from any
+ * P2P_WIBO_FEC_K independent ones and programs it at once, so the next
+ * symbol after the last one of a block may be sent a flash cycle later.
+ *
+ * @param short_addr Address of node to feed (or broadcast 0xFFFF)
+ * @param block Block number
+ * @param nblocks Blocks of the image
+ * @param mask Source symbols XORed into data
+ * @param *data P2P_WIBO_FEC_SYMBOL bytes
  */
-void wibohost_init(void)
+void wibohost_fec(uint16_t short_addr, uint16_t block, uint16_t nblocks,
+		uint32_t mask, uint8_t *data)
 {
-#if defined(NODECONFIG_STATIC)
-	/* for development purposes */
-	nodeconfig.channel = 11;
-	nodeconfig.pan_id = 0x01;
-	nodeconfig.short_addr = 0x05;
-#elif BOARD_TYPE == BOARD_PINOCCIO
-	nodeconfig.channel = eeprom_read_byte((uint8_t *)8179);
-	nodeconfig.pan_id = eeprom_read_word((uint16_t *)8180);
-	nodeconfig.short_addr = eeprom_read_word((uint16_t *)8182);
-	nodeconfig.ieee_addr = 0;
-#else
-	get_node_config(&nodeconfig);
-#endif
-	radio_init(rxbuf, MAX_FRAME_SIZE);
-	radio_set_param(RP_CHANNEL(nodeconfig.channel));
-	radio_set_param(RP_PANID(nodeconfig.pan_id));
-	radio_set_param(RP_SHORTADDR(nodeconfig.short_addr));
-	radio_set_param(RP_IDLESTATE(STATE_RXAUTO));
+	p2p_wibo_fec_t *dat = (p2p_wibo_fec_t*) txbuf;
 
-#if defined(SR_RX_SAFE_MODE)
-	trx_bit_write(SR_RX_SAFE_MODE, 1);
-#endif
+	dat->block = block;
+	dat->nblocks = nblocks;
+	dat->mask = mask;
+	memcpy(dat->data, data, P2P_WIBO_FEC_SYMBOL);
+
+	wibohost_sendcommand(short_addr, P2P_WIBO_FEC, (uint8_t*) dat,
+			sizeof(p2p_wibo_fec_t));
 }
 
 /*
- * \brief Send a command over the air
- *
- * Construct the header that is the same for all commands and
- * pack into IEEE802.15.4 MPDU
+ * \brief Ask a node which blocks of a coded transfer it has programmed
+ * The reply is delivered with cb_wibohost_fecreply(), or
+ * cb_wibohost_fectimeout() is called if there was none.
  *
- * @param short_addr IEEE short address
- * @param cmdcode Command code as defined in p2p_protocol.h
- * @param *data Pointer to buffer of Tx frame (header is mapped onto it here)
- * @param lendata Overall length of Tx frame
+ * @param short_addr The node addressed (no broadcast)
  */
-void wibohost_sendcommand(uint16_t dst_addr, uint8_t cmdcode, uint8_t *data,
-		uint8_t lendata)
+void wibohost_fecquery(uint16_t short_addr)
 {
-	p2p_hdr_t *hdr = (p2p_hdr_t*) data;
-
-	FILL_P2P_HEADER_NOACK(hdr, nodeconfig.pan_id, dst_addr,
-			nodeconfig.short_addr, cmdcode);
-	radio_set_state(STATE_TXAUTO);
+	wibohost_rtt_start(short_addr);
+	wibohost_sendcommand(short_addr, P2P_WIBO_FEC_REQ, txbuf,
+			sizeof(p2p_wibo_fec_req_t));
 
-	radio_send_frame(lendata + 2, data, 1); /* +2: add CRC bytes (FCF) */
+	/* start timeout timer */
+	thdl_ping = timer_start(wibohost_fectimeout,
+			wibohost_rto(short_addr), 0);
+	wait_cmd_fec = 1;
 }
 
-void wibohost_ping_reply(uint16_t pingaddr)
+/*
+ * \brief Clear the list of nodes taking part in a multicast session
+ */
+void wibohost_mcast_clear(void)
 {
-	memcpy_P(txbuf, &PingReply, sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME));
-	wibohost_sendcommand(pingaddr, P2P_PING_CNF, txbuf,
-			sizeof(p2p_ping_cnf_t) + sizeof(BOARD_NAME));
+	mcast_cnt = 0;
+	memset(mcast_done, 0, sizeof(mcast_done));
 }
 
 /*
- * \brief Feed data to a node
- * This data is part of the flash image that shall be programmed to
- * the target device. It can be sliced to any size from outside. The
- * target device collects it and programs its pages as soon as one page
- * size of data is reached.
+ * \brief Add a node to the multicast session
  *
- * @param short_addr Address of node to feed (or broadcast 0xFFFF)
- * @param *data Pointer to buffer where data is stored
- * @param lendata Length of buffer
+ * @param short_addr The node to add, nodes already in the list are not added twice
+ * @return Number of nodes in the session, 0 if the list is full
  */
-void wibohost_feed(uint16_t short_addr, uint8_t *data, uint8_t lendata)
+uint8_t wibohost_mcast_add(uint16_t short_addr)
 {
-	p2p_wibo_data_t *dat = (p2p_wibo_data_t*) txbuf;
 	uint8_t i;
 
-	for (i = 0; i < lendata; i++)
+	for (i = 0; i < mcast_cnt; i++)
 	{
-		datacrc = _crc_ccitt_update(datacrc, data[i]);
-		dat->data[i] = data[i]; /* no use for memcpy() */
+		if (mcast_nodes[i] == short_addr)
+		{
+			return mcast_cnt;
+		}
 	}
-	dat->dsize = lendata;
+	if (mcast_cnt >= WIBOHOST_MCAST_MAX)
+	{
+		return 0;
+	}
+	mcast_nodes[mcast_cnt++] = short_addr;
+	return mcast_cnt;
+}
 
-	wibohost_sendcommand(short_addr, P2P_WIBO_DATA, (uint8_t*) dat,
-			sizeof(p2p_wibo_data_t) + lendata);
+/*
+ * \brief Deliver the completion bitmap of the multicast session
+ *
+ * Bit i (byte i/8, bit i%8) is set when node number i of the session
+ * has received all frames in the last wibohost_mcast_poll().
+ *
+ * @param *cnt Number of nodes in the session
+ * @return Pointer to bitmap
+ */
+uint8_t* wibohost_mcast_done(uint8_t *cnt)
+{
+	*cnt = mcast_cnt;
+	return mcast_done;
+}
+
+/*
+ * \brief Query the window of all session nodes and merge their gaps
+ *
+ * Each node that is not complete yet is asked with a window request
+ * for its next expected frame and the frames it holds already. The
+ * gaps of all nodes are merged into one bitmap, starting at the lowest
+ * frame number any node is waiting for. The host then broadcasts only
+ * the frames in this bitmap; nodes that are ahead drop them as duplicates.
+ *
+ * Blocks until all nodes have replied or timed out.
+ *
+ * @param nframes Number of frames of the image
+ * @param *base Lowest frame number still missing at some node
+ * @param *missing Bit i set: frame base+i is missing at one node at least
+ * @param *lost Number of nodes that did not reply
+ * @return Number of nodes that are not complete (including lost ones)
+ */
+uint8_t wibohost_mcast_poll(uint16_t nframes, uint16_t *base, uint16_t *missing,
+		uint8_t *lost)
+{
+	uint8_t i, pending = 0, any = 0;
+	uint16_t gaps, d;
+
+	*base = 0;
+	*missing = 0;
+	*lost = 0;
+
+	mcast_polling = 1;
+	for (i = 0; i < mcast_cnt; i++)
+	{
+		if (mcast_done[i >> 3] & (1 << (i & 7)))
+		{
+			continue;
+		}
+
+		mcast_replied = 0;
+		wibohost_window(mcast_nodes[i]);
+		while (wait_cmd_window_cnf)
+			BUSY_WAIT();
+
+		if (!mcast_replied)
+		{
+			(*lost)++;
+			pending++;
+			continue;
+		}
+		if (mcast_reply.base >= nframes)
+		{
+			mcast_done[i >> 3] |= (1 << (i & 7));
+			continue;
+		}
+		pending++;
+
+		/* gaps relative to this node's base, move them to the common base */
+		gaps = ~mcast_reply.received;
+		if (!any)
+		{
+			*base = mcast_reply.base;
+			*missing = gaps;
+			any = 1;
+		}
+		else if (mcast_reply.base < *base)
+		{
+			d = *base - mcast_reply.base;
+			*missing = (d < 16) ? ((*missing << d) | gaps) : gaps;
+			*base = mcast_reply.base;
+		}
+		else
+		{
+			d = mcast_reply.base - *base;
+			if (d < 16)
+			{
+				*missing |= gaps << d;
+			}
+		}
+	}
+	mcast_polling = 0;
+
+	/* nothing to send beyond the end of the image */
+	for (i = 0; i < 16; i++)
+	{
+		if ((uint32_t) *base + i >= nframes)
+		{
+			*missing &= ~(1 << i);
+		}
+	}
 
-	last_feed = 1;
+	return pending;
 }
 
 /*
@@ -294,13 +1550,125 @@ void wibohost_target(uint16_t short_addr, uint8_t targmem)
  */
 void wibohost_ping(uint16_t short_addr)
 {
+	wibohost_rtt_start(short_addr);
 	wibohost_sendcommand(short_addr, P2P_PING_REQ, txbuf, sizeof(p2p_hdr_t));
 
 	/* start timeout timer */
-	thdl_ping = timer_start(wibohost_pingtimeout, PINGTIMEOUT_MS, 0);
+	thdl_ping = timer_start(wibohost_pingtimeout,
+			wibohost_rto(short_addr), 0);
 	wait_cmd_ping_cnf = 1;
 }
 
+/*
+ * \brief Query or continue a broken update of a node
+ * The node replies with its checkpoint, delivered with
+ * cb_wibohost_resumereply(), or cb_wibohost_resumetimeout() is called.
+ * When page and crc are the checkpoint of the node, the node continues
+ * at this page, the host takes over the checksum, so the image data
+ * from that page on is fed next.
+ *
+ * @param short_addr The node addressed (no broadcast)
+ * @param page Checkpoint page to continue with, 0xFFFF for query only
+ * @param crc Data CRC up to that page
+ */
+void wibohost_resume(uint16_t short_addr, uint16_t page, uint16_t crc)
+{
+	p2p_wibo_resume_t *dat = (p2p_wibo_resume_t*) txbuf;
+
+	dat->page = page;
+	dat->crc = crc;
+	if (0xFFFF != page)
+	{
+		datacrc = crc;
+		txq_bytes = 0;
+	}
+	wibohost_rtt_start(short_addr);
+	wibohost_sendcommand(short_addr, P2P_WIBO_RESUME, (uint8_t*) dat,
+			sizeof(p2p_wibo_resume_t));
+
+	/* start timeout timer */
+	thdl_ping = timer_start(wibohost_resumetimeout,
+			wibohost_rto(short_addr), 0);
+	wait_cmd_resume = 1;
+}
+
+/*
+ * \brief Discover all nodes in range with one broadcast
+ * Each node replies in one of nslots slots, chosen by its short address
+ * and the round. All replies up to the end of the window are delivered
+ * with cb_wibohost_discoverreply(), then cb_wibohost_discoverdone() is
+ * called. Nodes that collided are found in a later round.
+ *
+ * @param nslots Number of reply slots
+ * @param round Round number
+ */
+void wibohost_discover(uint8_t nslots, uint8_t round)
+{
+	p2p_wibo_discover_t *dat = (p2p_wibo_discover_t*) txbuf;
+
+	dat->nslots = nslots;
+	dat->round = round;
+	wibohost_sendcommand(0xFFFF, P2P_WIBO_DISCOVER, (uint8_t*) dat,
+			sizeof(p2p_wibo_discover_t));
+
+	/* start timer for the reply window */
+	wait_cmd_discover = 1;
+	thdl_ping = timer_start(wibohost_discovertimeout,
+			MSEC(P2P_WIBO_DISCOVER_SLOT_MS) * nslots + wibohost_rto(0xFFFF), 0);
+}
+
+/*
+ * \brief Call nodes on the rendezvous channel to the channel of the host
+ * A broadcast P2P_WIBO_CHANNEL with PAN 0xFFFF is sent on rvchannel,
+ * the radio returns to the host channel when it is out. Bootloaders
+ * built with WIBO_FLAVOUR_RENDEZVOUS listen there right after reset.
+ *
+ * @param rvchannel Rendezvous channel of the nodes
+ * @return 0 if rvchannel is out of range
+ */
+uint8_t wibohost_rendezvous(uint8_t rvchannel)
+{
+	p2p_wibo_channel_t *dat = (p2p_wibo_channel_t*) txbuf;
+	p2p_hdr_t *hdr = &dat->hdr;
+
+	if ((TRX_MIN_CHANNEL > rvchannel) || (TRX_MAX_CHANNEL < rvchannel))
+	{
+		return 0;
+	}
+	dat->channel = nodeconfig.channel;
+	FILL_P2P_HEADER_NOACK(hdr, 0xFFFF, 0xFFFF, nodeconfig.short_addr,
+			P2P_WIBO_CHANNEL);
+	rendezvous_busy = 1;
+	wibohost_tune(rvchannel, nodeconfig.pan_id);
+	radio_set_state(STATE_TXAUTO);
+	radio_send_frame(sizeof(p2p_wibo_channel_t) + 2, txbuf, 1);
+	return 1;
+}
+
+/*
+ * \brief Poll version, CRC and status of one or all nodes
+ * Nodes reply with a P2P_PING_SHORT_CNF in a random one of nslots slots.
+ * All replies up to the end of the window are delivered with
+ * cb_wibohost_pingshortreply(), then cb_wibohost_discoverdone() is
+ * called.
+ *
+ * @param short_addr The node addressed (0xFFFF for broadcast)
+ * @param nslots Number of reply slots
+ */
+void wibohost_pingshort(uint16_t short_addr, uint8_t nslots)
+{
+	p2p_ping_short_req_t *dat = (p2p_ping_short_req_t*) txbuf;
+
+	dat->nslots = nslots;
+	wibohost_sendcommand(short_addr, P2P_PING_SHORT_REQ, (uint8_t*) dat,
+			sizeof(p2p_ping_short_req_t));
+
+	/* start timer for the reply window */
+	wait_cmd_pingshort = 1;
+	thdl_ping = timer_start(wibohost_discovertimeout,
+			MSEC(P2P_PING_SHORT_SLOT_MS) * nslots + wibohost_rto(0xFFFF), 0);
+}
+
 /*
  * \brief Issue command to set flash address of a node
  *
@@ -311,6 +1679,7 @@ void wibohost_addr(uint16_t short_addr, uint32_t flash_addr)
 {
 	p2p_wibo_addr_t *addr = (p2p_wibo_addr_t*) txbuf;
 	addr->address = flash_addr;
+	txq_bytes = 0; /* node restarts its page buffer */
 	wibohost_sendcommand(short_addr, P2P_WIBO_ADDR, (uint8_t*) addr,
 			sizeof(p2p_wibo_addr_t));
 }
@@ -356,6 +1725,14 @@ void wibohost_reset(void)
 
 	/* reset checksum */
 	datacrc = 0x0000;
+	txseq = 0;
+	txq_bytes = 0;
+
+	/* new update, new progress */
+	prog_cnt = 0;
+	prog_next = 0;
+	prog_retx = 0;
+	prog_t0 = wibohost_usec();
 }
 
 /*
@@ -403,6 +1780,25 @@ void wibohost_jbootl(uint16_t short_addr)
 			sizeof(p2p_jump_bootl_t));
 }
 
+#if defined(P2P_MESH)
+/*
+ * \brief Look for a route to a node out of radio range
+ * Floods a route request, the route known after ROUTETIMEOUT_MS is
+ * delivered with cb_wibohost_routedone(). Later commands to the node
+ * go through the mesh if it is more than one hop away.
+ *
+ * @param short_addr The node addressed (no broadcast)
+ */
+void wibohost_route(uint16_t short_addr)
+{
+	route_addr = short_addr;
+	p2p_mesh_discover(short_addr);
+
+	/* start timeout timer */
+	thdl_ping = timer_start(wibohost_routetimeout, ROUTETIMEOUT_MS, 0);
+}
+#endif
+
 /*
  * \brief Update bootloader
  *
@@ -416,6 +1812,236 @@ void wibohost_bootlup(uint16_t short_addr)
 			sizeof(p2p_wibo_bootlup_t));
 }
 
+/*
+ * \brief Issue command to switch the data rate of a node
+ * The node switches after reception, the host has to follow with
+ * wibohost_setrate() as soon as the frame is sent. A node at high rate
+ * falls back to 250kbps by itself when it does not receive anything.
+ *
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @param rate Data rate hash code, e.g. OQPSK1000
+ */
+void wibohost_rate(uint16_t short_addr, uint8_t rate)
+{
+	p2p_wibo_rate_t *dat = (p2p_wibo_rate_t*) txbuf;
+
+	dat->rate = rate;
+	wibohost_sendcommand(short_addr, P2P_WIBO_RATE, (uint8_t*) dat,
+			sizeof(p2p_wibo_rate_t));
+}
+
+/*
+ * \brief Issue command to switch the PHY profile of a node
+ * Same as wibohost_rate(), the host follows with wibohost_setphy() as
+ * soon as the frame is sent. Without P2P_PHY_PERSIST the node returns
+ * to its stored profile after P2P_PHY_REVERT_S seconds without any
+ * P2P_PHY_* frame.
+ *
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @param profile Profile index, see radio_phy_set()
+ * @param flags P2P_PHY_PERSIST or 0
+ */
+void wibohost_physet(uint16_t short_addr, uint8_t profile, uint8_t flags)
+{
+	p2p_phy_set_t *dat = (p2p_phy_set_t*) txbuf;
+
+	dat->profile = profile;
+	dat->flags = flags;
+	wibohost_sendcommand(short_addr, P2P_PHY_SET, (uint8_t*) dat,
+			sizeof(p2p_phy_set_t));
+}
+
+/*
+ * \brief Ask a node for its test frame counters
+ * The reply is delivered with cb_wibohost_phystatsreply(), or
+ * cb_wibohost_phystatstimeout() is called if there was none.
+ *
+ * @param short_addr The node addressed (no broadcast)
+ * @param clear Clear the counters of the node after the reply
+ */
+void wibohost_phystats(uint16_t short_addr, uint8_t clear)
+{
+	p2p_phy_stats_req_t *dat = (p2p_phy_stats_req_t*) txbuf;
+
+	dat->clear = clear;
+	wibohost_rtt_start(short_addr);
+	wibohost_sendcommand(short_addr, P2P_PHY_STATS_REQ, (uint8_t*) dat,
+			sizeof(p2p_phy_stats_req_t));
+
+	/* start timeout timer */
+	thdl_ping = timer_start(wibohost_phystatstimeout,
+			wibohost_rto(short_addr), 0);
+	wait_cmd_phystats = 1;
+}
+
+/*
+ * \brief Round trip estimate of a node
+ *
+ * @param short_addr The node, 0xFFFF for the estimate over all nodes
+ * @param srtt Smoothed round trip time in microseconds
+ * @param rttvar Its variation in microseconds
+ * @param rto Reply timeout in microseconds, with backoff
+ * @return 0 if there are no samples of the node yet, else 1
+ */
+uint8_t wibohost_rtt(uint16_t short_addr, uint32_t *srtt, uint32_t *rttvar,
+		uint32_t *rto)
+{
+	uint8_t i, sreg;
+
+	sreg = SREG;
+	cli();
+	i = (0xFFFF == short_addr) ? RTT_ALL : wibohost_rtt_find(short_addr);
+	*srtt = rtt[i].srtt;
+	*rttvar = rtt[i].rttvar;
+	SREG = sreg;
+	*rto = wibohost_rto(short_addr) * RTT_TICK_US;
+	return (*srtt != 0) ? 1 : 0;
+}
+
+/*
+ * \brief Send one test frame of a PHY benchmark
+ *
+ * @param short_addr The node addressed
+ * @param seqno Frame number within the burst
+ * @param lendata Filler bytes, the frame has
+ *        sizeof(p2p_phy_test_t) + lendata + 2 bytes
+ */
+void wibohost_phytest(uint16_t short_addr, uint16_t seqno, uint8_t lendata)
+{
+	p2p_phy_test_t *dat = (p2p_phy_test_t*) txbuf;
+
+	if (lendata > MAX_FRAME_SIZE - sizeof(p2p_phy_test_t) - 2)
+	{
+		lendata = MAX_FRAME_SIZE - sizeof(p2p_phy_test_t) - 2;
+	}
+	dat->seqno = seqno;
+	memset(dat->data, (uint8_t) seqno, lendata);
+	wibohost_sendcommand(short_addr, P2P_PHY_TEST, (uint8_t*) dat,
+			sizeof(p2p_phy_test_t) + lendata);
+}
+
+/*
+ * \brief Issue command to erase a range of pages
+ * The node is busy for about npages flash erase cycles afterwards.
+ *
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @param address Page aligned start address
+ * @param npages Number of pages to erase
+ */
+void wibohost_erase(uint16_t short_addr, uint32_t address, uint16_t npages)
+{
+	p2p_wibo_erase_t *dat = (p2p_wibo_erase_t*) txbuf;
+
+	dat->address = address;
+	dat->npages = npages;
+	wibohost_sendcommand(short_addr, P2P_WIBO_ERASE, (uint8_t*) dat,
+			sizeof(p2p_wibo_erase_t));
+}
+
+/*
+ * \brief Issue command to install the image staged by the update
+ * The node checks length and CRC of the staged image and answers with a
+ * ping reply, errno is P2P_ERROR_SUCCESS when the image is installed at
+ * the next boot, crc is the checksum the node computed.
+ *
+ * @param short_addr The node addressed (no broadcast)
+ * @param len Image length from address 0
+ * @param crc CRC CCITT of the image, gaps filled with 0xFF
+ * @param *mac AES-CMAC of the image, checked by WIBO_FLAVOUR_SIGNED
+ */
+void wibohost_commit(uint16_t short_addr, uint32_t len, uint16_t crc,
+		const uint8_t *mac)
+{
+	p2p_wibo_commit_t *dat = (p2p_wibo_commit_t*) txbuf;
+
+	dat->len = len;
+	dat->crc = crc;
+	memcpy(dat->mac, mac, sizeof(dat->mac));
+	wibohost_sendcommand(short_addr, P2P_WIBO_COMMIT, (uint8_t*) dat,
+			sizeof(p2p_wibo_commit_t));
+
+	/* start timeout timer */
+	thdl_ping = timer_start(wibohost_pingtimeout,
+			wibohost_hoptimeout(short_addr, COMMITTIMEOUT_MS), 0);
+	wait_cmd_ping_cnf = 1;
+}
+
+/*
+ * \brief Let a node pass its committed image on to another node
+ * The relay feeds the target on its own, there is no reply. Its ping
+ * reply shows P2P_STATUS_RELAYING until the job is done, then errno is
+ * P2P_ERROR_SUCCESS or P2P_ERROR_RELAY.
+ *
+ * @param short_addr The relay, it committed the image before
+ * @param target The node to update
+ * @param len Image length, same as for wibohost_commit()
+ * @param crc Image CRC, same as for wibohost_commit()
+ */
+void wibohost_relay(uint16_t short_addr, uint16_t target, uint32_t len,
+		uint16_t crc)
+{
+	p2p_wibo_relay_t *dat = (p2p_wibo_relay_t*) txbuf;
+
+	dat->target = target;
+	dat->len = len;
+	dat->crc = crc;
+	wibohost_sendcommand(short_addr, P2P_WIBO_RELAY, (uint8_t*) dat,
+			sizeof(p2p_wibo_relay_t));
+}
+
+/*
+ * \brief Issue command to select the encoding of the data stream
+ *
+ * @param short_addr The node addressed (or broadcast 0xFFFF)
+ * @param mode P2P_WIBO_ZMODE_RAW, P2P_WIBO_ZMODE_LZSS or P2P_WIBO_ZMODE_DELTA
+ * @param baselen DELTA: length of the image the patch was made against,
+ *                0 to skip the check when resuming
+ * @param basecrc DELTA: CRC of that image
+ */
+void wibohost_zmode(uint16_t short_addr, uint8_t mode, uint32_t baselen,
+		uint16_t basecrc)
+{
+	p2p_wibo_zmode_t *dat = (p2p_wibo_zmode_t*) txbuf;
+
+	dat->mode = mode;
+	dat->baselen = baselen;
+	dat->basecrc = basecrc;
+	wibohost_sendcommand(short_addr, P2P_WIBO_ZMODE, (uint8_t*) dat,
+			sizeof(p2p_wibo_zmode_t));
+}
+
+/*
+ * \brief Switch the data rate of the host radio
+ *
+ * @param rate Data rate hash code, e.g. OQPSK1000
+ * @return 1 if the rate is supported, 0 else
+ */
+uint8_t wibohost_setrate(uint8_t rate)
+{
+	if (RATE_NONE == trx_set_datarate(rate))
+	{
+		return 0;
+	}
+	radio_set_state(STATE_RXAUTO); /* left in TRX_OFF */
+	return 1;
+}
+
+/*
+ * \brief Switch the host radio to a PHY profile
+ *
+ * @param profile Profile index, see radio_phy_set()
+ * @return 1 if the profile exists, 0 else
+ */
+uint8_t wibohost_setphy(uint8_t profile)
+{
+	if (!radio_phy_set(profile))
+	{
+		return 0;
+	}
+	radio_set_state(STATE_RXAUTO); /* left in TRX_OFF */
+	return 1;
+}
+
 /*
  * \brief Deliver node configuration, IEEE802.15.4 parameters
  *
@@ -432,6 +2058,7 @@ uint8_t wibohost_setchannel(uint8_t channel)
 	{
 		nodeconfig.channel = channel;
 		radio_set_param(RP_CHANNEL(channel));
+		tuned_channel = channel;
 		return 1;
 	}
 	else
@@ -446,6 +2073,7 @@ uint8_t wibohost_setpanid(uint16_t pan_id)
 	/* every value allowed */
 	nodeconfig.pan_id = pan_id;
 	radio_set_param(RP_PANID(pan_id));
+	tuned_pan_id = pan_id;
 	return 1;
 }
 
@@ -47,6 +47,12 @@
 
 #define PINGTIMEOUT_MS MSEC(50)
 
+/* the node checksums the whole staged image before it replies */
+#define COMMITTIMEOUT_MS MSEC(500)
+
+/* route requests and replies travel hop by hop (P2P_MESH) */
+#define ROUTETIMEOUT_MS MSEC(300)
+
 /* 
  * Cycle time for page write operations
  *
@@ -56,29 +62,172 @@
  */
 #define FLASHTIMEOUT_MS MSEC(20)
 
+/* erase and write of a page at most, the pause after a page is this
+ * plus the one way delay to a node with known round trip time */
+#define FLASHCYCLE_MS MSEC(14)
+
+/*
+ * Reply timeouts follow the round trip time of each node, as in TCP
+ * (RFC 6298): RTO = SRTT + 4 * RTTVAR, doubled after each timeout.
+ * PINGTIMEOUT_MS is left for the first request, when nothing is known.
+ */
+#ifndef WIBOHOST_RTT_NODES
+#define WIBOHOST_RTT_NODES (8)
+#endif
+#define RTO_MIN_US (8000UL)
+#define RTO_MAX_US (500000UL)
+
+/* number of data frames the host buffers in queued feed mode */
+#ifndef WIBOHOST_TXQ_LEN
+#define WIBOHOST_TXQ_LEN (4)
+#endif
+
+/* page size of nodes which did not tell theirs in a ping reply, a flash
+ * cycle pause is inserted only after a frame which completes a page
+ */
+#ifndef WIBOHOST_PAGESIZE
+#define WIBOHOST_PAGESIZE (256)
+#endif
+
+/* image data of a P2P_WIBO_DATA frame, room is left to forward
+ * the frame through the mesh
+ */
+#ifndef WIBOHOST_FEED_MAXDATA
+#define WIBOHOST_FEED_MAXDATA (MAX_FRAME_SIZE - 2 - sizeof(p2p_wibo_data_t) \
+		- (sizeof(p2p_mesh_data_t) - sizeof(p2p_hdr_t)))
+#endif
+
+/* maximum number of nodes collected by a discovery */
+#ifndef WIBOHOST_DISCOVER_MAX
+#define WIBOHOST_DISCOVER_MAX (128)
+#endif
+
+/* maximum number of nodes in a multicast session */
+#ifndef WIBOHOST_MCAST_MAX
+#define WIBOHOST_MCAST_MAX (200)
+#endif
+
+/* nodes whose update progress is kept, see wibohost_prog_get() */
+#ifndef WIBOHOST_PROG_NODES
+#define WIBOHOST_PROG_NODES (16)
+#endif
+
+/* number of channel/PAN sessions served in parallel */
+#ifndef WIBOHOST_SESS_MAX
+#define WIBOHOST_SESS_MAX (4)
+#endif
+
+/* frames the host buffers per session */
+#ifndef WIBOHOST_SESS_QLEN
+#define WIBOHOST_SESS_QLEN (4)
+#endif
+
+/* frames a session may send in a row before the next one is served */
+#ifndef WIBOHOST_SESS_BURST
+#define WIBOHOST_SESS_BURST (4)
+#endif
+
+/* progress of a node since wibohost_reset(), from its window replies */
+typedef struct
+{
+	uint16_t short_addr;
+	uint16_t base; /* next frame it waits for */
+	uint16_t pages; /* pages it has written, 0xFFFF: not reported */
+	uint16_t lost; /* frames it dropped for a bad CRC, 0xFFFF: not reported */
+	uint16_t nacks; /* frames it reported missing, summed over all replies */
+	uint16_t timeouts; /* window requests it did not answer */
+	uint32_t t_ms; /* time of its last reply since wibohost_reset() */
+} wibohost_prog_t;
+
 void wibohost_init(void);
 
 void cb_wibohost_radio_error(radio_error_t err);
 void cb_wibohost_pingreply(p2p_ping_cnf_t *rp);
 void cb_wibohost_flashcycletimeout(void);
 void cb_wibohost_pingtimeout();
+void cb_wibohost_resumereply(p2p_wibo_resume_t *rr);
+void cb_wibohost_resumetimeout(void);
+void cb_wibohost_discoverreply(p2p_ping_cnf_t *rp, uint8_t lqi, int8_t ed);
+void cb_wibohost_discoverdone(void);
+void cb_wibohost_pingshortreply(p2p_ping_short_cnf_t *rp, uint8_t lqi,
+		int8_t ed);
+void cb_wibohost_windowreply(p2p_wibo_window_cnf_t *wr);
+void cb_wibohost_windowtimeout(void);
+void cb_wibohost_fecreply(p2p_wibo_fec_cnf_t *fr);
+void cb_wibohost_fectimeout(void);
+void cb_wibohost_phystatsreply(p2p_phy_stats_cnf_t *sr);
+void cb_wibohost_phystatstimeout(void);
 void cb_wibohost_tx_done(radio_tx_done_t status);
+#if defined(P2P_MESH)
+void cb_wibohost_routedone(uint16_t short_addr, uint16_t next, uint8_t hops);
+#endif
 
 void wibohost_sendcommand(uint16_t dst_addr, uint8_t cmdcode,
 		uint8_t *data, uint8_t lendata);
 void wibohost_ping(uint16_t short_addr);
+void wibohost_discover(uint8_t nslots, uint8_t round);
+void wibohost_pingshort(uint16_t short_addr, uint8_t nslots);
+uint8_t wibohost_rendezvous(uint8_t rvchannel);
+void wibohost_resume(uint16_t short_addr, uint16_t page, uint16_t crc);
 void wibohost_addr(uint16_t short_addr, uint32_t flash_addr);
 void wibohost_deaf(uint16_t short_addr);
 void wibohost_ping_reply(uint16_t pingaddr);
 uint8_t wibohost_pingreplied(void);
 void wibohost_target(uint16_t short_addr, uint8_t targmem);
-void wibohost_feed(uint16_t short_addr, uint8_t *data, uint8_t lendata);
+uint8_t wibohost_feed(uint16_t short_addr, uint8_t *data, uint8_t lendata);
+uint8_t wibohost_queue_feed(uint16_t short_addr, uint8_t *data, uint8_t lendata);
+uint8_t wibohost_queue_pending(void);
+void wibohost_task(void);
+uint8_t wibohost_sess_open(uint8_t channel, uint16_t pan_id);
+uint8_t wibohost_sess_close(uint8_t s);
+uint8_t wibohost_sess_isopen(uint8_t s);
+uint8_t wibohost_sess_reset(uint8_t s);
+uint8_t wibohost_sess_addr(uint8_t s, uint16_t short_addr, uint32_t flash_addr);
+uint8_t wibohost_sess_feed(uint8_t s, uint16_t short_addr, uint8_t *data,
+		uint8_t lendata);
+uint8_t wibohost_sess_finish(uint8_t s, uint16_t short_addr);
+uint8_t wibohost_sess_exit(uint8_t s, uint16_t short_addr);
+uint16_t wibohost_sess_getcrc(uint8_t s);
+uint8_t wibohost_feedseq(uint16_t short_addr, uint16_t seqno, uint8_t *data,
+		uint8_t lendata);
+void wibohost_window(uint16_t short_addr);
+void wibohost_fec(uint16_t short_addr, uint16_t block, uint16_t nblocks,
+		uint32_t mask, uint8_t *data);
+void wibohost_fecquery(uint16_t short_addr);
+void wibohost_mcast_clear(void);
+uint8_t wibohost_mcast_add(uint16_t short_addr);
+uint8_t* wibohost_mcast_done(uint8_t *cnt);
+uint8_t wibohost_mcast_poll(uint16_t nframes, uint16_t *base, uint16_t *missing,
+		uint8_t *lost);
 void wibohost_finish(uint16_t short_addr);
 void wibohost_reset(void);
 void wibohost_bootlup(uint16_t short_addr);
+void wibohost_rate(uint16_t short_addr, uint8_t rate);
+void wibohost_erase(uint16_t short_addr, uint32_t address, uint16_t npages);
+void wibohost_commit(uint16_t short_addr, uint32_t len, uint16_t crc,
+		const uint8_t *mac);
+void wibohost_relay(uint16_t short_addr, uint16_t target, uint32_t len,
+		uint16_t crc);
+void wibohost_zmode(uint16_t short_addr, uint8_t mode, uint32_t baselen,
+		uint16_t basecrc);
+uint8_t wibohost_setrate(uint8_t rate);
+uint8_t wibohost_setchannel(uint8_t channel);
+uint8_t wibohost_setpanid(uint16_t pan_id);
+void wibohost_physet(uint16_t short_addr, uint8_t profile, uint8_t flags);
+void wibohost_phystats(uint16_t short_addr, uint8_t clear);
+uint16_t wibohost_pagesize(uint16_t short_addr);
+uint8_t wibohost_prog_get(uint8_t i, wibohost_prog_t *p);
+uint32_t wibohost_prog_summary(uint16_t *frames, uint16_t *retx);
+uint8_t wibohost_rtt(uint16_t short_addr, uint32_t *srtt, uint32_t *rttvar,
+		uint32_t *rto);
+void wibohost_phytest(uint16_t short_addr, uint16_t seqno, uint8_t lendata);
+uint8_t wibohost_setphy(uint8_t profile);
 void wibohost_exit(uint16_t short_addr);
 uint16_t wibohost_getcrc(void);
 void wibohost_jbootl(uint16_t short_addr);
+#if defined(P2P_MESH)
+void wibohost_route(uint16_t short_addr);
+#endif
 node_config_t *wibohost_getnodecfg(void);
 
 #endif /* WIBOHOST_H_ */
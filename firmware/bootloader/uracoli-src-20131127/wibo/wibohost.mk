@@ -311,6 +311,15 @@ CCFLAGS += -D$(BOARD) -DF_CPU=$(F_CPU)
 ifneq ($(baudrate),)
     CCFLAGS += -DHIF_DEFAULT_BAUDRATE=$(baudrate)
 endif
+ifneq ($(mesh),)
+    CCFLAGS += -DP2P_MESH
+endif
+ifneq ($(isrprof),)
+    CCFLAGS += -DISR_PROFILE
+endif
+ifneq ($(stackwatch),)
+    CCFLAGS += -DSTACK_WATCH
+endif
 CCFLAGS += -I$(URACOLIDIR)/inc -I.
 LDFLAGS = $(patsubst %,-L%,$(LIBDIRS)) -luracoli_$(BOARD)
 
@@ -14,18 +14,541 @@ Usage:
                 [default 1:8]
       -u FILE : selectively update nodes selected by ADDR with FILE
       -U FILE : broadcast update nodes with FILE
+      -b      : feed image data as binary frames instead of hex text
+      -s      : sparse -u, send page aligned runs only, erase pages that
+                are all 0xFF instead of sending them
+      -z      : compress the image (LZSS) for -u, implies -s
+      -D FILE : send -u as patch against FILE, the image installed on the node
+      -r      : negotiate a high data rate for -u, fall back to 250kbps
+      -R      : continue a broken -u update at the checkpoint of the node
+      -A      : commit the -u image, the node verifies the staged image
+                and installs it at the next boot (WIBO_FLAVOUR_SLOTS)
+      -B      : background -u, the nodes keep running their application
+                with the wiboapp receiver, implies -A
+      -e FILE : write the EEPROM hex-file FILE (.eep) to the nodes selected
+                by ADDR, only the bytes in the file (WIBO_FLAVOUR_EEPROM)
+      -L FILE : update the bootloader of the nodes selected by ADDR with FILE,
+                the bootloader hex-file, it is staged behind a header page
+                and copied by the node if its CRC matches (WIBO_FLAVOUR_BOOTLUP)
+      -K KEY  : AES key for the MAC of -A as 32 hex digits, the security
+                key in the EEPROM of the nodes, default: erased (all FF)
+      -M      : reach the -u nodes through the mesh, a route to each node
+                is looked up first (host built with P2P_MESH, nodes and
+                relays run the wiboapp receiver, implies -B)
+      -F      : fan out -u, the host updates the first node of ADDR only,
+                each updated node passes the image on to the next ones
+                (wiboapp built with WIBOAPP_RELAY, implies -B)
+      -G RVCH : before anything else, call nodes that listen on the rendezvous
+                channel RVCH after reset (WIBO_FLAVOUR_RENDEZVOUS) to the
+                channel of the host, for RENDEZVOUS_TIME seconds
+      -q      : queued feeding, send ahead as long as the host has credits
+      -w      : use windowed transfer with selective retransmit for -u,
+                multicast session with merged retransmits for -U
+      -f      : coded multicast for -U, blocks of 2 KB sent as XOR
+                combinations, a node programs a block once it can solve
+                it, repairs for the blocks still missing (WIBO_FLAVOUR_FEC)
+      -Y      : benchmark the PHY profiles (wiboapp phy=1) with the nodes
+                selected by ADDR, prints goodput and frame error rate
       -S      : scan for nodes in range min(ADDR):max(ADDR),
+      -N FILE : node database, the nodes found are kept in FILE (JSON) with
+                their ping reply, last CRC and link metrics. -U pings the
+                nodes known on the PAN of the host instead of scanning,
+                -S scans and refreshes the database
       -J      : send jump_to_bootloader frame to nodes selected by ADDR
       -E      : send exit_from_bootloader frame to nodes selected by ADDR
+      -T MS   : with -w, print the progress the host collects from the
+                window replies every MS milliseconds: per node the frame
+                it waits for, pages written, frames lost and asked again,
+                missed replies and goodput, and the frames resent
+      -I      : print and clear the ISR profile of the host, cycles per
+                radio, timer and UART ISR (host built with isrprof=1)
       -c CHANS: issue jump bootloader over the given channels, default: [11]
+      -p      : with -U and several CHANS, update the troops of all channels
+                in parallel, the host serves them by turns
+      -m FILE : update a fleet as described by the manifest FILE (JSON):
+                board name -> image and nodes, the bridges (hosts) to use
+                in parallel, one multicast session per image and bridge,
+                unicast retries of failing nodes and a report, see Fleet
+      -W HEX[:BOARD[:VERSION]]
+              : pack the hex-file HEX into the image container HEX.wimg
+                with page map and page CRCs (see wiboimage.py), compressed
+                with -z, as delta against -D FILE, signed with -K KEY.
+                All options taking a hex-file take such a container too,
+                -u refuses a container for another board
       -v      : increase verbose level
 
       Examples:
 
 """
-import serial, string, re, time, sys, getopt
+import serial, string, re, time, sys, os, getopt, struct, threading, zlib, random
+from wiboimage import is_image, read_image, read_header, write_image, \
+        image_hexlines, hex_mem, mem_pages, ImageError, IMG_FLAG_DELTA, \
+        IMG_FLAG_SIGNED
+try:
+    from Crypto.Cipher import AES
+except ImportError:
+    AES = None
 HISTORY = "wibohost.hist"
 VERSION = 0.01
+WINDOW_SIZE = 16 # P2P_WIBO_WINDOW_SIZE
+
+# discovery, see P2P_WIBO_DISCOVER
+DISCOVER_SLOTS = 32 # reply slots of the first round
+DISCOVER_QUIET = 2 # rounds without a new node to end the discovery
+
+# short ping, see P2P_PING_SHORT_REQ
+PINGSHORT_SLOTS = 32 # reply slots of a broadcast
+PINGSHORT_BOOTL = 0x01 # flags of the reply
+PINGSHORT_RECEIVING = 0x02
+PINGSHORT_RELAYING = 0x04
+PINGSHORT_FAILED = 0x08
+
+# rendezvous, see P2P_WIBO_CHANNEL
+RENDEZVOUS_TIME = 12.0 # seconds, longer than WIBO_TIMEOUT of the node
+RENDEZVOUS_PERIOD = 0.1 # the node listens WIBO_RENDEZVOUS_MS = 250ms
+
+# data rate hash codes, see transceiver.h
+OQPSK250 = 0x33
+OQPSK500 = 0x94
+OQPSK1000 = 0x34
+OQPSK2000 = 0x54
+HIGH_RATES = [OQPSK2000, OQPSK1000, OQPSK500]
+RATE_TIMEOUT = 1.0 # WIBO_RATE_TIMEOUT of the node in seconds
+
+# PHY profiles of applications, see radio_phy.c
+PHY_PERSIST = 0x01 # P2P_PHY_PERSIST
+PHY_REVERT_TIME = 3.0 # P2P_PHY_REVERT_S, trial profile falls back
+PHY_BENCH_FRAMES = 200
+PHY_BENCH_LENGTH = 100 # filler bytes per test frame
+
+# binary frames of the command interface, see cmdif.c
+BINFRAME_SOF = 0x02
+BINFRAME_TYPE_FEED = 'F'
+BINFRAME_TYPE_FEEDSEQ = 'S'
+BINFRAME_TYPE_QFEED = 'Q'
+BINFRAME_TYPE_FEC = 'C'
+BINFRAME_TYPE_NODES = 'N' # host to PC, replies of discover and pingshort
+# one record of the 'N' block: short_addr, lqi, ed, t_ms, version,
+# errno, flags, crc, boardname
+NODEREC_FMT = '<HBbHBBBH16s'
+
+# commands sent ahead in queued mode, limited by the 128 byte
+# receive buffer of the host serial line
+MAX_AHEAD = 2
+
+def crc_ccitt_update(crc, data):
+    """ same as _crc_ccitt_update() of avr-libc """
+    data ^= crc & 0xff
+    data ^= (data << 4) & 0xff
+    return (((data << 8) | (crc >> 8)) ^ (data >> 4) ^ (data << 3)) & 0xffff
+
+def _crc_ccitt_entry(i):
+    for b in range(8):
+        i = (i >> 1) ^ 0x8408 if i & 1 else i >> 1
+    return i
+
+CRC_CCITT_TABLE = [_crc_ccitt_entry(i) for i in range(256)]
+
+def crc_ccitt_block(crc, data):
+    """ crc_ccitt_update() over a string or bytes, as crc_ccitt_block() of
+        crc_fast.h, with a byte table
+    """
+    tbl = CRC_CCITT_TABLE
+    for c in bytearray(data):
+        crc = (crc >> 8) ^ tbl[(crc ^ c) & 0xff]
+    return crc
+
+# LZSS stream, see P2P_WIBO_ZMODE_LZSS
+ZMODE_RAW = 0
+ZMODE_LZSS = 1
+ZMODE_DELTA = 2
+P2P_ERROR_DELTA_BASE = 3
+P2P_ERROR_DELTA_RESUME = 4
+P2P_ERROR_COMMIT = 6
+P2P_ERROR_SIGNATURE = 7
+P2P_ERROR_BOOTLUP = 8
+P2P_ERROR_RELAY = 9
+P2P_STATUS_RELAYING = 2
+RELAY_POLL = 0.5 # seconds between pings of a busy relay
+RELAY_TIMEOUT = 120.0 # seconds for one round of relay jobs
+LZ_MINMATCH = 3
+LZ_MAXMATCH = LZ_MINMATCH + 15
+LZ_WINDOW = 4095
+PAGESIZE = 256 # SPM_PAGESIZE of the nodes
+BOOTLOADER_START = 0x3E000 # byte address of the bootloader section
+BOOTLUP_MAGIC = 0x4C42 # "BL", WIBO_BOOTLUP_MAGIC
+ERASE_TIME = 0.01 # seconds per page erase, node is deaf meanwhile
+EE_WRITE_TIME = 0.0034 # seconds per EEPROM byte, erase and write
+FLEET_RETRIES = 3 # unicast retries of a node that failed the multicast
+
+# coded multicast, see P2P_WIBO_FEC
+FEC_SYMBOL = 64 # P2P_WIBO_FEC_SYMBOL
+FEC_K = 32 # P2P_WIBO_FEC_K, symbols of a block
+FEC_BLOCK = FEC_K * FEC_SYMBOL
+FEC_MAXBLOCKS = 128 # P2P_WIBO_FEC_MAXBLOCKS
+FEC_OVERHEAD = 0.25 # coded symbols per block beyond FEC_K, fraction of FEC_K
+FEC_BLOCK_TIME = 0.12 # seconds, the node solves and programs a block
+FEC_PASSES = 6 # rounds of repair symbols for the blocks still missing
+
+def lzss_compress(data):
+    """ Compress data (bytearray) for P2P_WIBO_ZMODE_LZSS, greedy
+        matching over a hash chain of 3 byte prefixes """
+    out = bytearray()
+    chains = {}
+    i, n = 0, len(data)
+    while i < n:
+        flagpos = len(out)
+        out.append(0)
+        for bit in range(8):
+            if i >= n:
+                break
+            best, bestoff = 0, 0
+            key = bytes(data[i:i+LZ_MINMATCH])
+            if len(key) == LZ_MINMATCH:
+                for j in reversed(chains.get(key, [])[-32:]):
+                    if i - j > LZ_WINDOW:
+                        break
+                    l = 0
+                    while l < LZ_MAXMATCH and i + l < n and data[j+l] == data[i+l]:
+                        l += 1
+                    if l > best:
+                        best, bestoff = l, i - j
+                        if l == LZ_MAXMATCH:
+                            break
+            if best >= LZ_MINMATCH:
+                out.append(bestoff & 0xff)
+                out.append(((bestoff >> 4) & 0xf0) | (best - LZ_MINMATCH))
+                step = best
+            else:
+                out[flagpos] |= 1 << bit
+                out.append(data[i])
+                step = 1
+            for k in range(i, i + step):
+                chains.setdefault(bytes(data[k:k+LZ_MINMATCH]), []).append(k)
+            i += step
+    return out
+
+class DeltaEncoder(object):
+    """ Patch encoder for P2P_WIBO_ZMODE_DELTA
+
+        Mirrors what the node sees while it decodes: pages from the current
+        output page on still hold the old image, the page before is kept
+        in RAM (oldbuf) after the first page of a range, all others are
+        already patched. A torn page of a broken update is never referenced.
+    """
+    def __init__(self, old, size, torn=None):
+        self.flash = bytearray([0xff] * size)
+        for address, data in old:
+            self.flash[address:address+len(data)] = data
+        self.torn = torn # page address whose content is unknown
+        self.index = {}
+        for i in range(len(self.flash) - LZ_MINMATCH + 1):
+            self.index.setdefault(bytes(self.flash[i:i+LZ_MINMATCH]), []).append(i)
+
+    def _view(self, frm, out):
+        page = out - out % PAGESIZE
+        if frm < 0 or frm >= len(self.flash):
+            return None
+        if self.torn != None and self.torn <= frm < self.torn + PAGESIZE:
+            return None
+        if frm >= page:
+            return self.flash[frm]
+        if self.oldvalid and frm >= page - PAGESIZE:
+            return self.oldpage[frm - (page - PAGESIZE)]
+        return self.flash[frm]
+
+    def _complete(self, page, data):
+        self.oldpage = self.flash[page:page+PAGESIZE]
+        self.oldvalid = True
+        self.flash[page:page+PAGESIZE] = data
+        if self.torn == page:
+            self.torn = None
+        for i in range(page, page + PAGESIZE):
+            self.index.setdefault(bytes(self.flash[i:i+LZ_MINMATCH]), []).append(i)
+
+    def encode(self, start, new):
+        """ Encode one page aligned range """
+        import bisect
+        self.oldvalid, self.oldpage = False, None
+        out = bytearray()
+        k, n, last = 0, len(new), 0
+        while k < n:
+            flagpos = len(out)
+            out.append(0)
+            for bit in range(8):
+                if k >= n:
+                    break
+                i = start + k
+                cands = [i + last, i]
+                lst = self.index.get(bytes(new[k:k+LZ_MINMATCH]), [])
+                lo = bisect.bisect_left(lst, i - 2048)
+                hi = bisect.bisect_right(lst, i + 2047)
+                cands += lst[lo:hi][-16:]
+                best, bestd = 0, 0
+                for frm in cands:
+                    d = frm - i
+                    if d < -2048 or d > 2047:
+                        continue
+                    l = 0
+                    while l < LZ_MAXMATCH and k + l < n and \
+                            self._view(frm + l, i + l) == new[k + l]:
+                        l += 1
+                        # the view changes with the next page, end here
+                        if (i + l) % PAGESIZE == 0:
+                            break
+                    if l > best:
+                        best, bestd = l, d
+                if best >= LZ_MINMATCH:
+                    d = bestd & 0xfff
+                    out.append(d & 0xff)
+                    out.append(((d >> 4) & 0xf0) | (best - LZ_MINMATCH))
+                    last = bestd
+                    step = best
+                else:
+                    out[flagpos] |= 1 << bit
+                    out.append(new[k])
+                    step = 1
+                for j in range(k, k + step):
+                    if (start + j + 1) % PAGESIZE == 0:
+                        page = start + j + 1 - PAGESIZE
+                        self._complete(page, new[page-start:page-start+PAGESIZE])
+                k += step
+        return out
+
+def read_hex_mem(fname):
+    """ Read an intel hex-file or an image container into a dict
+        address -> byte
+    """
+    if is_image(fname):
+        mem = {}
+        for a, d in read_image(fname)['segs']:
+            mem.update(zip(range(a, a + len(d)), d))
+        return mem
+    return hex_mem(open(fname))
+
+def read_hex_lines(fname):
+    """ The stripped lines of an intel hex-file, for an image container
+        the hex records of its pages
+    """
+    if is_image(fname):
+        return image_hexlines(read_image(fname)['segs'])
+    f = open(fname)
+    lines = [ln.strip() for ln in f]
+    f.close()
+    return lines
+
+def read_hex_runs(fname):
+    """ Contiguous runs of the bytes in a hex-file, no padding. Returns a
+        list of (address, bytearray).
+    """
+    runs = []
+    for a, b in sorted(read_hex_mem(fname).items()):
+        if runs and runs[-1][0] + len(runs[-1][1]) == a:
+            runs[-1][1].append(b)
+        else:
+            runs.append((a, bytearray([b])))
+    return runs
+
+def read_hex_pages(fname, sparse=False):
+    """ Read an intel hex-file into page aligned segments, gaps inside a
+        page are padded with 0xFF. Returns a list of (address, bytearray).
+        With sparse, pages that are all 0xFF are left out.
+    """
+    if is_image(fname):
+        segs = read_image(fname)['segs']
+    else:
+        segs = mem_pages(read_hex_mem(fname), PAGESIZE)
+    if not sparse:
+        return segs
+    erased = bytearray([0xff] * PAGESIZE)
+    ret = []
+    for a, d in segs:
+        for p in range(a, a + len(d), PAGESIZE):
+            page = d[p - a:p - a + PAGESIZE]
+            if page == erased:
+                continue
+            if ret and ret[-1][0] + len(ret[-1][1]) == p:
+                ret[-1][1].extend(page)
+            else:
+                ret.append((p, page))
+    return ret
+
+def read_page_crcs(fname):
+    """ data_crc() of each page of the image as dict page -> crc, from
+        the page map of an image container, computed for a hex-file
+    """
+    if is_image(fname):
+        img = read_header(fname)
+        if not img['flags'] & IMG_FLAG_DELTA:
+            return img['crcs']
+    crcs = {}
+    for a, d in read_hex_pages(fname):
+        for p in range(a, a + len(d), PAGESIZE):
+            crcs[p] = data_crc(d[p - a:p - a + PAGESIZE])
+    return crcs
+
+def pack_image(fname, outname, board = "", version = 0, compress = False,
+               key = None, basefname = None):
+    """ Pack the hex-file fname into the image container outname, signed
+        with key (see image_cmac) if pycrypto is there, as delta against
+        the image basefname with basefname. Returns the header as dict.
+    """
+    segs = read_hex_pages(fname)
+    mac = None
+    if key != None:
+        mac = data_cmac(image_data(fname), key)
+        if mac != None:
+            mac = mac.decode('hex')
+    base = basefname and read_hex_pages(basefname) or None
+    name = re.sub(r'\.[^.]*$', '', fname.split('/')[-1])
+    return write_image(outname, segs, name, board, version, PAGESIZE,
+                       compress, mac, base)
+
+def image_data(fname):
+    """ Content of a hex-file as the node sees it staged, gaps filled
+        with 0xFF
+    """
+    data, pos = [], 0
+    for a, d in read_hex_pages(fname):
+        data.extend([0xff] * (a - pos) + list(d))
+        pos = a + len(d)
+    return data
+
+def image_crc(fname):
+    """ Length and CRC of a hex-file as the node sees it staged """
+    if is_image(fname):
+        img = read_header(fname)
+        return img['length'], img['crc']
+    data = image_data(fname)
+    return len(data), data_crc(data)
+
+def image_cmac(fname, key):
+    """ AES-CMAC (RFC 4493) of the staged image as 32 hex digits, see
+        WIBO_FLAVOUR_SIGNED, None without pycrypto. A signed image
+        container has it already, key is not used then.
+    """
+    if is_image(fname):
+        img = read_image(fname)
+        if img['mac'] != None:
+            return img['mac'].encode('hex')
+    return data_cmac(image_data(fname), key)
+
+def data_cmac(data, key):
+    """ AES-CMAC of raw bytes as 32 hex digits, None without pycrypto """
+    if AES == None:
+        return None
+    enc = AES.new(string.join(map(chr, key), ''), AES.MODE_ECB).encrypt
+    def blk(b):
+        return map(ord, enc(string.join(map(chr, b), '')))
+    def dbl(k):
+        r = [((k[i] << 1) | (k[i + 1] >> 7)) & 0xff for i in range(15)]
+        r.append((k[15] << 1) & 0xff)
+        if k[0] & 0x80:
+            r[15] ^= 0x87
+        return r
+    data = list(data)
+    sub = dbl(blk([0] * 16))
+    n = len(data) % 16
+    if n or not data:
+        data = data + [0x80] + [0] * (15 - n)
+        sub = dbl(sub)
+    x = [0] * 16
+    for i in range(0, len(data), 16):
+        b = data[i:i + 16]
+        if i + 16 == len(data):
+            b = [c ^ k for c, k in zip(b, sub)]
+        x = blk([c ^ k for c, k in zip(x, b)])
+    return string.join(["%02x" % c for c in x], '')
+
+def bootlup_hex(fname, outname):
+    """ Write the staged image for P2P_WIBO_BOOTLUP: a header page with
+        magic, length and CRC, the bootloader image of fname behind it
+    """
+    data, pos = [], BOOTLOADER_START
+    for a, d in read_hex_pages(fname):
+        if a < BOOTLOADER_START:
+            raise Exception("not a bootloader image", fname)
+        data.extend([0xff] * (a - pos) + list(d))
+        pos = a + len(d)
+    crc = crc_ccitt_block(0, data)
+    hdr = struct.pack('<HHH', BOOTLUP_MAGIC, len(data), crc)
+    img = hdr + '\xff' * (PAGESIZE - len(hdr)) + \
+          string.join(map(chr, data), '')
+    f = open(outname, 'w')
+    for a in range(0, len(img), 16):
+        f.write(hexline(a, img[a:a + 16]) + '\n')
+    f.write(':00000001FF\n')
+    f.close()
+    return len(data), crc
+
+def erase_runs(segs):
+    """ Page ranges between the segments, as (address, npages) """
+    runs = []
+    for (a, d), (b, e) in zip(segs[:-1], segs[1:]):
+        if b > a + len(d):
+            runs.append((a + len(d), (b - a - len(d)) / PAGESIZE))
+    return runs
+
+def data_crc(data):
+    """ CRC of raw bytes as the nodes compute it, start value 0 """
+    return crc_ccitt_block(0, data)
+
+def data_crc32(data):
+    """ CRC32 of raw bytes as crc32_flash() of the nodes computes it """
+    return zlib.crc32(str(data)) & 0xffffffff
+
+def fec_blocks(data):
+    """ Source symbols of an image padded with 0xFF to whole blocks,
+        as one list of FEC_K longs per block
+    """
+    data = str(bytearray(data)) + '\xff' * (-len(data) % FEC_BLOCK)
+    return [[long(data[a:a + FEC_SYMBOL].encode('hex'), 16)
+             for a in range(b, b + FEC_BLOCK, FEC_SYMBOL)]
+            for b in range(0, len(data), FEC_BLOCK)]
+
+def fec_symbol(syms, mask):
+    """ XOR of the source symbols selected by mask, as string """
+    v = 0L
+    for i in range(FEC_K):
+        if mask & (1 << i):
+            v ^= syms[i]
+    return ('%0*x' % (2 * FEC_SYMBOL, v)).decode('hex')
+
+def changed_runs(segs, crcs, own = None):
+    """ Pages of the page aligned segments which differ from the device,
+        crcs maps page addresses to the data_crc() the device reports for
+        them, pages without one count as changed. own are the CRCs of the
+        image pages if known (read_page_crcs), the others are computed.
+        Adjacent changed pages are merged into one run. Returns a list of
+        (address, bytearray).
+    """
+    runs = []
+    own = own or {}
+    for a, d in segs:
+        for p in range(a, a + len(d), PAGESIZE):
+            page = d[p - a:p - a + PAGESIZE]
+            crc = own.get(p)
+            if crc == None:
+                crc = data_crc(page)
+            if crcs.get(p) == crc:
+                continue
+            if runs and runs[-1][0] + len(runs[-1][1]) == p:
+                runs[-1][1].extend(page)
+            else:
+                runs.append((p, bytearray(page)))
+    return runs
+
+def hexline_data(ln):
+    """ raw data bytes of an intel hex line """
+    n = int(ln[1:3], 16)
+    return ''.join([chr(int(ln[9+2*i:11+2*i], 16)) for i in range(n)])
+
+
+def hexline(address, data):
+    """ intel hex data record of raw bytes """
+    rec = struct.pack('>BHB', len(data), address & 0xffff, 0) + data
+    cs = (-sum([ord(c) for c in rec])) & 0xff
+    return ':' + ''.join(['%02X' % ord(c) for c in rec]) + '%02X' % cs
 
 
 class WIBOHostBase(object):
@@ -36,6 +559,33 @@ class WIBOHostBase(object):
         """ Ping a dedicated node and evaluate reply """
         raise Exception("not implemented")
 
+    def discover(self, nslots, rnd):
+        """ Collect ping replies of all nodes in one broadcast """
+        raise Exception("not implemented")
+
+    def pingshort(self, nodeid, nslots):
+        """ Poll version, CRC and status of one or all nodes """
+        raise Exception("not implemented")
+
+    def rendezvous(self, rvchannel):
+        """ Call nodes on the rendezvous channel to the host channel """
+        raise Exception("not implemented")
+
+    def route(self, nodeid):
+        """ Find a route to a node through the mesh """
+        raise Exception("not implemented")
+
+    def resume(self, nodeid):
+        """ Query the checkpoint of a broken update """
+        raise Exception("not implemented")
+
+    def chscan(self, chmask, dwell):
+        """ Rank channels by energy and traffic """
+        raise Exception("not implemented")
+
+    def resumeat(self, nodeid, page, crc):
+        raise Exception("not implemented")
+
     def deaf(self, nodeid):
         """ Set node to deaf """
         raise Exception("not implemented")
@@ -46,6 +596,101 @@ class WIBOHostBase(object):
     def feedhex(self, nodeid, ln):
         raise Exception("not implemented")
 
+    def feedseq(self, nodeid, seqno, ln):
+        raise Exception("not implemented")
+
+    def window(self, nodeid):
+        """ Query frames received by a node """
+        raise Exception("not implemented")
+
+    def mcclear(self):
+        """ Clear multicast session """
+        raise Exception("not implemented")
+
+    def mcadd(self, nodeid):
+        """ Add node to multicast session """
+        raise Exception("not implemented")
+
+    def mcpoll(self, nframes):
+        """ Query missing frames of all session nodes """
+        raise Exception("not implemented")
+
+    def progress(self, period_ms = 0):
+        """ Progress of the nodes in the update, streamed every period_ms """
+        raise Exception("not implemented")
+
+    def feedbin(self, nodeid, data, seqno=None):
+        """ Feed raw image data, optionally with a frame number """
+        raise Exception("not implemented")
+
+    def fecbin(self, nodeid, block, nblocks, mask, data):
+        """ Send a coded symbol of a block """
+        raise Exception("not implemented")
+
+    def fecstat(self, nodeid):
+        """ Query the blocks a node has decoded """
+        raise Exception("not implemented")
+
+    def rtt(self, nodeid):
+        """ Round trip estimate and reply timeout of a node """
+        raise Exception("not implemented")
+
+    def zdelta(self, nodeid, baselen, basecrc):
+        """ Select patch stream against installed image """
+        raise Exception("not implemented")
+
+    def rate(self, nodeid, rate):
+        """ Switch data rate of node and host """
+        raise Exception("not implemented")
+
+    def hostrate(self, rate):
+        """ Switch data rate of host """
+        raise Exception("not implemented")
+
+    def phylist(self):
+        """ List PHY profiles of host """
+        raise Exception("not implemented")
+
+    def isrprof(self, clear):
+        """ ISR profile of host """
+        raise Exception("not implemented")
+
+    def physet(self, nodeid, profile, flags):
+        """ Switch PHY profile of node and host """
+        raise Exception("not implemented")
+
+    def hostphy(self, profile):
+        """ Switch PHY profile of host """
+        raise Exception("not implemented")
+
+    def phystats(self, nodeid, clear):
+        """ Query test frame counters of node """
+        raise Exception("not implemented")
+
+    def phytest(self, nodeid, nframes, length):
+        """ Send a burst of test frames """
+        raise Exception("not implemented")
+
+    def addr(self, nodeid, address):
+        """ Set flash address of node """
+        raise Exception("not implemented")
+
+    def erase(self, nodeid, address, npages):
+        """ Erase pages without sending data """
+        raise Exception("not implemented")
+
+    def commit(self, nodeid, length, crc, mac):
+        """ Install the staged image at the next boot of the node """
+        raise Exception("not implemented")
+
+    def relay(self, nodeid, target, length, crc):
+        """ Let a node pass its committed image on to another one """
+        raise Exception("not implemented")
+
+    def zmode(self, nodeid, mode):
+        """ Select encoding of the data stream """
+        raise Exception("not implemented")
+
     def reset(self):
         raise Exception("not implemented")
 
@@ -61,8 +706,8 @@ class WIBOHostBase(object):
     def info(self, nodeid):
         raise Exception("not implemented")
 
-    def target(self, targ):
-        """ Set memory target
+    def target(self, targ, nodeid=None):
+        """ Set memory target of all nodes, or of nodeid only
             'E' : EEPROM
             'F' : Flash memory
             'X' : No memory, dry run
@@ -77,6 +722,31 @@ class WIBOHostBase(object):
         """ Initiate Bootloader update """
         raise Exception("not implemented")
 
+    def sopen(self, channel, pan_id):
+        """ Open a session on another channel/PAN """
+        raise Exception("not implemented")
+
+    def sclose(self, sess):
+        raise Exception("not implemented")
+
+    def sreset(self, sess):
+        raise Exception("not implemented")
+
+    def sfeed(self, sess, nodeid, ln):
+        raise Exception("not implemented")
+
+    def sfinish(self, sess, nodeid):
+        raise Exception("not implemented")
+
+    def sexit(self, sess, nodeid):
+        raise Exception("not implemented")
+
+    def scrc(self, sess):
+        raise Exception("not implemented")
+
+    def sflush(self):
+        raise Exception("not implemented")
+
     def channel(self, channel):
         """ Set channel """
         raise Exception("not implemented")
@@ -92,6 +762,13 @@ class WIBOHost(WIBOHostBase, serial.Serial):
         serial.Serial.__init__(self, *args, **kwargs)
         self.flt = re.compile("(?P<code>[A-Z]+)([ ]?)(?P<data>.*)")
         self.cmdcnt = 0
+        self.binary = False
+        self.queued = False
+        self.batch = None # None until the firmware was asked
+        self.progress_nodes = {} # short_addr -> last PROG record
+        self.progress_sum = None # last PROGSUM record
+        self.onprogress = None # f(nodes, summary), False stops the update
+        self.stopped = False
 
     def _flush(self):
         """
@@ -100,10 +777,10 @@ class WIBOHost(WIBOHostBase, serial.Serial):
         """
         self.read(self.inWaiting())
 
-    def _sendcommand(self, cmd, *args):
+    def _writecommand(self, cmd, *args):
         """
             Internal function
-            Send command to device, wait response and evaluate it
+            Send command to device, returns the command line
         """
         self.cmdcnt += 1
         self._flush()
@@ -111,8 +788,39 @@ class WIBOHost(WIBOHostBase, serial.Serial):
         if self.VERBOSE > 2:
             print "TX[%d]: %s" % (self.cmdcnt, cmd)
         self.write(cmd + '\n')
+        return cmd
+
+    def _readline(self):
+        """
+            Internal function
+            Read a response line, the PROG and PROGSUM lines the firmware
+            streams in front of it are taken into progress_nodes and
+            progress_sum, onprogress is called after each PROGSUM
+        """
+        while True:
+            s = self.readline().strip()
+            m = self.flt.match(s)
+            if m == None or m.group('code') not in ('PROG', 'PROGSUM'):
+                return s
+            if self.VERBOSE > 2:
+                print "RX[%d]: %s" % (self.cmdcnt, s)
+            d = eval(m.group('data'))
+            if m.group('code') == 'PROG':
+                self.progress_nodes[d['short_addr']] = d
+                continue
+            self.progress_sum = d
+            if self.onprogress and \
+                    self.onprogress(self.progress_nodes, d) == False:
+                self.stopped = True
+
+    def _sendcommand(self, cmd, *args):
+        """
+            Internal function
+            Send command to device, wait response and evaluate it
+        """
+        cmd = self._writecommand(cmd, *args)
         # TODO evaluate returning line and parse for parameters
-        s = self.readline().strip()
+        s = self._readline()
         if self.VERBOSE > 2:
             print "RX[%d]: %s" % (self.cmdcnt, s)
         m = self.flt.match(s)
@@ -127,6 +835,126 @@ class WIBOHost(WIBOHostBase, serial.Serial):
         if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
         return ret
 
+    def _usebatch(self):
+        """
+            Internal function
+            Switch the node replies to one binary block, if the
+            firmware knows it
+        """
+        if self.batch is None:
+            self.batch = self._sendcommand('batch', 1)['code'] == 'OK'
+        return self.batch
+
+    def _readnodes(self, cmd, *args):
+        """
+            Internal function
+            Send discover or pingshort and read the block of node
+            records and the "OK n" line
+        """
+        cmd = self._writecommand(cmd, *args)
+        c = self.read(1)
+        if c != chr(BINFRAME_SOF):
+            # an error line instead of the block
+            m = self.flt.match((c + self.readline()).strip())
+            if m == None:
+                return dict(code = "NO RESPONSE", data = cmd)
+            return m.groupdict()
+        hdr = self.read(3)
+        if len(hdr) < 3 or hdr[0] != BINFRAME_TYPE_NODES:
+            return dict(code = "NO RESPONSE", data = cmd)
+        cnt, reclen = struct.unpack('<BB', hdr[1:])
+        data = self.read(cnt * reclen + 2)
+        if len(data) < cnt * reclen + 2 or \
+                crc_ccitt_block(0xffff, hdr + data[:-2]) != \
+                struct.unpack('<H', data[-2:])[0]:
+            self._flush()
+            return dict(code = "ERR", data = "node block crc")
+        nodes = []
+        reclen0 = struct.calcsize(NODEREC_FMT)
+        for i in range(cnt):
+            # newer firmware may append fields to the record
+            rec = data[i * reclen:(i + 1) * reclen][:reclen0]
+            addr, lqi, ed, t_ms, version, errno, flags, crc, board = \
+                struct.unpack(NODEREC_FMT, rec)
+            nodes.append(dict(short_addr = addr, lqi = lqi, ed = ed,
+                              t_ms = t_ms, version = version, errno = errno,
+                              flags = flags, crc = crc,
+                              boardname = board.split('\0')[0]))
+        ret = self._readresponse(cmd)
+        if self.VERBOSE > 2:
+            print "RX[%d]: %d node records" % (self.cmdcnt, cnt)
+        if ret['code'] == 'OK': ret['data'] = nodes
+        return ret
+
+    def discover(self, nslots, rnd):
+        """ Collect ping replies of all nodes in one broadcast, data is
+            the list of replies
+        """
+        if self._usebatch():
+            ret = self._readnodes('discover', hex(nslots), hex(rnd & 0xff))
+            if ret['code'] == 'OK':
+                for n in ret['data']:
+                    n['appname'] = 'wibo'
+                    del n['flags']
+            return ret
+        ret = self._sendcommand('discover', hex(nslots), hex(rnd & 0xff))
+        nodes = []
+        while ret['code'] == 'NODE':
+            nodes.append(eval(ret['data']))
+            ret = self._readresponse('discover')
+        if ret['code'] == 'OK': ret['data'] = nodes
+        return ret
+
+    def pingshort(self, nodeid, nslots):
+        """ Poll version, CRC and status of one node or all (0xffff),
+            data is the list of replies
+        """
+        if self._usebatch():
+            ret = self._readnodes('pingshort', hex(nodeid), hex(nslots))
+            if ret['code'] == 'OK':
+                for n in ret['data']:
+                    del n['boardname']
+            return ret
+        ret = self._sendcommand('pingshort', hex(nodeid), hex(nslots))
+        nodes = []
+        while ret['code'] == 'NODE':
+            nodes.append(eval(ret['data']))
+            ret = self._readresponse('pingshort')
+        if ret['code'] == 'OK': ret['data'] = nodes
+        return ret
+
+    def route(self, nodeid):
+        """ Find a route to a node through the mesh, data is the route
+            with next hop and number of hops
+        """
+        ret = self._sendcommand('route', hex(nodeid))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def chscan(self, chmask = 0x7fff800, dwell = 200):
+        """ Scan the channels of chmask for dwell ms each, data is the
+            list of channel results, the cleanest channel first
+        """
+        ret = self._sendcommand('chscan', hex(chmask), hex(dwell))
+        chans = []
+        while ret['code'] == 'CHAN':
+            chans.append(eval(ret['data']))
+            ret = self._readresponse('chscan')
+        if ret['code'] == 'OK': ret['data'] = chans
+        return ret
+
+    def resume(self, nodeid):
+        """ Query the checkpoint of a broken update """
+        ret = self._sendcommand('resume', hex(nodeid))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def resumeat(self, nodeid, page, crc):
+        """ Continue a broken update at the checkpoint of the node """
+        ret = self._sendcommand('resumeat', hex(nodeid), hex(page), hex(crc))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
     def deaf(self, nodeid):
         """ Set node to deaf """
         return self._sendcommand('deaf', hex(nodeid))
@@ -137,9 +965,231 @@ class WIBOHost(WIBOHostBase, serial.Serial):
     def feedhex(self, nodeid, ln):
         return self._sendcommand('feedhex', hex(nodeid), ln)
 
+    def feedseq(self, nodeid, seqno, ln):
+        return self._sendcommand('feedseq', hex(nodeid), hex(seqno), ln)
+
+    def window(self, nodeid):
+        """ Query frames received by a node """
+        ret = self._sendcommand('window', hex(nodeid))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def _writebin(self, typ, nodeid, data):
+        """
+            Internal function
+            Write a binary frame to the device
+        """
+        frm = struct.pack('<cHB', typ, nodeid, len(data)) + data
+        crc = crc_ccitt_block(0xffff, frm)
+        self.cmdcnt += 1
+        self.write(chr(BINFRAME_SOF) + frm + struct.pack('<H', crc))
+
+    def _readresponse(self, cmd):
+        """
+            Internal function
+            Read and evaluate one response line
+        """
+        s = self._readline()
+        if self.VERBOSE > 2:
+            print "RX[%d]: %s" % (self.cmdcnt, s)
+        m = self.flt.match(s)
+        if m == None:
+            return dict(code = "NO RESPONSE", data = cmd)
+        else:
+            return m.groupdict()
+
+    def feedbin(self, nodeid, data, seqno=None):
+        """ Feed raw image data, optionally with a frame number """
+        if seqno == None:
+            typ = BINFRAME_TYPE_FEED
+        else:
+            typ = BINFRAME_TYPE_FEEDSEQ
+            data = struct.pack('<H', seqno) + data
+        self._flush()
+        self._writebin(typ, nodeid, data)
+        return self._readresponse(typ)
+
+    def fecbin(self, nodeid, block, nblocks, mask, data):
+        """ Send a coded symbol of a block """
+        self._flush()
+        self._writebin(BINFRAME_TYPE_FEC, nodeid,
+                struct.pack('<HHL', block, nblocks, mask) + data)
+        return self._readresponse(BINFRAME_TYPE_FEC)
+
+    def fecstat(self, nodeid):
+        """ Query the blocks a node has decoded, 'done' as list of
+            block numbers
+        """
+        ret = self._sendcommand('fecstat', hex(nodeid))
+        if ret['code'] == 'OK':
+            ret['data'] = eval(ret['data'])
+            d = ret['data']['done'].decode('hex')
+            ret['data']['done'] = [b for b in range(ret['data']['nblocks'])
+                                   if ord(d[b / 8]) & (1 << (b % 8))]
+        return ret
+
+    def rtt(self, nodeid):
+        """ Round trip estimate of a node in microseconds, nodeid
+            0xffff for the estimate over all nodes
+        """
+        ret = self._sendcommand('rtt', hex(nodeid))
+        if ret['code'] == 'OK':
+            ret['data'] = eval(ret['data'])
+        return ret
+
+    def flashhex_queued(self, nodeid, lines):
+        """ Feed hex lines through the host feed queue, without waiting
+            for the reply of a line before the next one is sent
+        """
+        ahead, credits = 0, 1
+        self._flush()
+        for i, ln in enumerate(lines + [None]):
+            while ahead and (ln == None or ahead >= min(max(credits, 1), MAX_AHEAD)):
+                ret = self._readresponse('qfeed')
+                ahead -= 1
+                if ret['code'] == 'OK':
+                    credits = int(ret['data'])
+                elif ret['code'] == 'WARN':
+                    if self.VERBOSE > 0: print 'WARN', ret['data']
+                else:
+                    print 'ERR', ret['data']
+                    return False
+            if ln == None:
+                break
+            if self.binary:
+                if ln[7:9] != '00':
+                    continue
+                self._writebin(BINFRAME_TYPE_QFEED, nodeid, hexline_data(ln))
+            else:
+                self.cmdcnt += 1
+                self.write("qfeed %s %s\n" % (hex(nodeid), ln))
+            ahead += 1
+            if self.VERBOSE >= 1:
+                print "line %-4d\r" % i,
+                sys.stdout.flush()
+        return True
+
+    def addr(self, nodeid, address):
+        """ Set flash address of node """
+        return self._sendcommand('addr', hex(nodeid), "%x" % address)
+
+    def erase(self, nodeid, address, npages):
+        """ Erase pages without sending data """
+        ret = self._sendcommand('erase', hex(nodeid), "%x" % address,
+                hex(npages))
+        time.sleep(npages * ERASE_TIME)
+        return ret
+
+    def commit(self, nodeid, length, crc, mac):
+        """ Install the staged image at the next boot of the node, data
+            is the ping reply, errno 0 if the node accepted the image
+        """
+        ret = self._sendcommand('commit', hex(nodeid), "%x" % length,
+                hex(crc), mac)
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def relay(self, nodeid, target, length, crc):
+        """ Let a node pass its committed image on to another one, the
+            relay works on its own, ping it for the result
+        """
+        return self._sendcommand('relay', hex(nodeid), hex(target),
+                "%x" % length, hex(crc))
+
+    def zmode(self, nodeid, mode):
+        """ Select encoding of the data stream """
+        return self._sendcommand('zmode', hex(nodeid), hex(mode))
+
+    def zdelta(self, nodeid, baselen, basecrc):
+        """ Select patch stream against installed image """
+        return self._sendcommand('zdelta', hex(nodeid), "%x" % baselen,
+                hex(basecrc))
+
+    def rate(self, nodeid, rate):
+        """ Switch data rate of node and host """
+        return self._sendcommand('rate', hex(nodeid), hex(rate))
+
+    def hostrate(self, rate):
+        """ Switch data rate of host """
+        return self._sendcommand('hostrate', hex(rate))
+
+    def phylist(self):
+        """ List PHY profiles of host, data is the list of profiles """
+        ret = self._sendcommand('phylist')
+        profiles = []
+        while ret['code'] == 'PHY':
+            profiles.append(eval(ret['data']))
+            ret = self._readresponse('phylist')
+        if ret['code'] == 'OK': ret['data'] = profiles
+        return ret
+
+    def isrprof(self, clear = 0):
+        """ ISR profile of host, data is the list of slots (see isr_prof.h),
+            times in CPU cycles
+        """
+        ret = self._sendcommand('isrprof', hex(clear))
+        slots = []
+        while ret['code'] == 'ISR':
+            slots.append(eval(ret['data']))
+            ret = self._readresponse('isrprof')
+        if ret['code'] == 'OK': ret['data'] = slots
+        return ret
+
+    def physet(self, nodeid, profile, flags = 0):
+        """ Switch PHY profile of node and host """
+        return self._sendcommand('physet', hex(nodeid), hex(profile),
+                hex(flags))
+
+    def hostphy(self, profile):
+        """ Switch PHY profile of host """
+        return self._sendcommand('hostphy', hex(profile))
+
+    def phystats(self, nodeid, clear = 0):
+        """ Query test frame counters of node """
+        ret = self._sendcommand('phystats', hex(nodeid), hex(clear))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def phytest(self, nodeid, nframes, length):
+        """ Send a burst of test frames, data is the number of frames
+            sent and of channel access failures
+        """
+        ret = self._sendcommand('phytest', hex(nodeid), hex(nframes),
+                hex(length))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
+    def mcclear(self):
+        """ Clear multicast session """
+        return self._sendcommand('mcclear')
+
+    def mcadd(self, nodeid):
+        """ Add node to multicast session """
+        return self._sendcommand('mcadd', hex(nodeid))
+
+    def mcpoll(self, nframes):
+        """ Query missing frames of all session nodes """
+        ret = self._sendcommand('mcpoll', hex(nframes))
+        if ret['code'] == 'OK': ret['data'] = eval(ret['data'])
+        return ret
+
     def reset(self):
+        self.progress_nodes = {}
+        self.progress_sum = None
+        self.stopped = False
         return self._sendcommand('reset')
 
+    def progress(self, period_ms = 0):
+        """ Progress of the nodes since the last reset, from their window
+            replies, as dict short_addr -> pages, lost, nacks, timeouts,
+            goodput ... With period_ms the host streams it in front of the
+            window and mcpoll replies during the update, see onprogress
+        """
+        ret = self._sendcommand('progress', hex(period_ms))
+        if ret['code'] == 'OK':
+            ret['data'] = dict(self.progress_nodes)
+        return ret
+
     def exit(self, nodeid):
         return self._sendcommand('exit', hex(nodeid))
 
@@ -152,13 +1202,15 @@ class WIBOHost(WIBOHostBase, serial.Serial):
     def info(self, nodeid):
         return self._sendcommand('info', hex(nodeid))
 
-    def target(self, targ):
-        """ Set memory target
+    def target(self, targ, nodeid=None):
+        """ Set memory target of all nodes, or of nodeid only
             'E' : EEPROM
             'F' : Flash memory
             'X' : No memory, dry run
         """
-        return self._sendcommand('target', targ)
+        if nodeid == None:
+            return self._sendcommand('target', targ)
+        return self._sendcommand('ntarget', hex(nodeid), targ)
 
     def jbootl(self, nodeid):
         """ Jump to bootloader """
@@ -172,10 +1224,46 @@ class WIBOHost(WIBOHostBase, serial.Serial):
         """ Set channel """
         return self._sendcommand('channel', hex(channel))
 
+    def rendezvous(self, rvchannel):
+        """ Send one P2P_WIBO_CHANNEL broadcast on rvchannel """
+        return self._sendcommand('rendezvous', hex(rvchannel))
+
     def panid(self, pan_id):
         """ Set channel """
         return self._sendcommand('panid', hex(pan_id))
 
+    def sopen(self, channel, pan_id):
+        """ Open a session on another channel/PAN, data is the session """
+        ret = self._sendcommand('sopen', hex(channel), hex(pan_id))
+        if ret['code'] == 'OK': ret['data'] = int(ret['data'])
+        return ret
+
+    def sclose(self, sess):
+        """ Close a session when its frames are sent """
+        return self._sendcommand('sclose', hex(sess))
+
+    def sreset(self, sess):
+        """ Queue a reset for all nodes of a session """
+        return self._sendcommand('sreset', hex(sess))
+
+    def sfeed(self, sess, nodeid, ln):
+        """ Queue a hex line for a node of a session """
+        return self._sendcommand('sfeed', hex(sess), hex(nodeid), ln)
+
+    def sfinish(self, sess, nodeid):
+        return self._sendcommand('sfinish', hex(sess), hex(nodeid))
+
+    def sexit(self, sess, nodeid):
+        return self._sendcommand('sexit', hex(sess), hex(nodeid))
+
+    def scrc(self, sess):
+        """ Data CRC of a session """
+        return self._sendcommand('scrc', hex(sess))
+
+    def sflush(self):
+        """ Wait until the frames of all sessions are sent """
+        return self._sendcommand('sflush')
+
 class NodeList(list):
     """ Little helper class to pretty print a list of nodes in ascii """
     def __init__(self, *args, **kwargs):
@@ -217,6 +1305,74 @@ class NodeList(list):
                 ret += '\n'
         return ret
 
+class NodeDB(object):
+    """ Nodes seen by earlier sessions, a JSON file of records keyed by
+        "PAN:ADDR" (hex). A record holds the fields of the last ping
+        reply (see p2p_ping_cnf_t), the time it was seen, the last CRC
+        and the link metrics known: round trip of the last ping, the
+        rtt estimate of the host and the pings missed in a row.
+    """
+
+    def __init__(self, fname):
+        self.fname = fname
+        self.records = {}
+        self.dirty = False
+        if os.path.exists(fname):
+            import json
+            try:
+                self.records = json.load(open(fname))
+            except ValueError:
+                print "WARN node database %s is broken, starting over" % fname
+
+    def _key(self, pan_id, addr):
+        return "0x%04x:0x%04x" % (pan_id, addr)
+
+    def nodes(self, pan_id, maxage = None):
+        """ Records of a PAN, seen within maxage seconds """
+        tmin = maxage != None and time.time() - maxage or 0
+        pfx = "0x%04x:" % pan_id
+        return [r for k, r in sorted(self.records.items())
+                if k.startswith(pfx) and r.get('last_seen', 0) >= tmin]
+
+    def seen(self, pan_id, data, **metrics):
+        """ A node replied, data is the ping or short ping reply """
+        key = self._key(pan_id, data['short_addr'])
+        r = self.records.setdefault(key, {})
+        r.update([(k, v) for k, v in data.items()
+                  if k not in ('status', 'target')])
+        r.update(metrics)
+        r['pan_id'] = pan_id
+        r['last_seen'] = time.time()
+        r['missed'] = 0
+        self.dirty = True
+
+    def missed(self, pan_id, addr):
+        """ A known node did not reply """
+        r = self.records.get(self._key(pan_id, addr))
+        if r != None:
+            r['missed'] = r.get('missed', 0) + 1
+            self.dirty = True
+
+    def update(self, pan_id, addr, **metrics):
+        """ Metrics of a known node, e.g. the rtt estimate """
+        r = self.records.get(self._key(pan_id, addr))
+        if r != None:
+            r.update(metrics)
+            self.dirty = True
+
+    def save(self):
+        """ Write the file if anything changed, via a temporary file
+            so that a broken session does not lose it """
+        if not self.dirty:
+            return
+        import json
+        tmp = self.fname + ".tmp"
+        json.dump(self.records, open(tmp, 'w'), indent = 1, sort_keys = True)
+        if os.path.exists(self.fname):
+            os.remove(self.fname) # rename does not replace on windows
+        os.rename(tmp, self.fname)
+        self.dirty = False
+
 class WIBONetwork(WIBOHost):
     """ Class to represent a list of WIBO nodes """
 
@@ -224,12 +1380,40 @@ class WIBONetwork(WIBOHost):
         """ Constructor """
         WIBOHost.__init__(self, *args, **kwargs)
         self.nodes = NodeList()
+        self.nodedb = None
+        self.pan_id = None
+
+    def pan(self):
+        """ PAN id of the host, read once """
+        if self.pan_id == None:
+            info = self._sendcommand('info')
+            m = re.search("PAN_ID=(0x[0-9A-Fa-f]+)", str(info['data']))
+            self.pan_id = m and int(m.group(1), 16) or 0
+        return self.pan_id
+
+    def _nodeseen(self, data, **metrics):
+        if self.nodedb != None and data['short_addr'] != 0xffff:
+            self.nodedb.seen(self.pan(), data, **metrics)
+
+    def _feedline(self, nodeid, ln, seqno=None):
+        """ Feed a hex line, as text or as binary frame """
+        if not self.binary:
+            if seqno == None:
+                return self.feedhex(nodeid, ln)
+            return self.feedseq(nodeid, seqno, ln)
+        if ln[7:9] != '00':
+            return dict(code = "WARN", data = "ignoring rec type 0x%s" % ln[7:9])
+        return self.feedbin(nodeid, hexline_data(ln), seqno)
 
     def ping(self, nodeid):
         defaults = {'status':None, 'target':'F'}
+        t = time.time()
         ret = WIBOHost.ping(self, nodeid) # yes, use this one
+        if ret['code'] != 'OK' and self.nodedb != None and nodeid != 0xffff:
+            self.nodedb.missed(self.pan(), nodeid)
         if ret['code'] == 'OK':
             data=ret['data']
+            self._nodeseen(data, ping_ms = round((time.time() - t) * 1e3, 1))
             if data['short_addr'] not in [i['short_addr'] for i in self.nodes]:
                 data.update(defaults)
                 self.nodes.append(data)
@@ -237,8 +1421,39 @@ class WIBONetwork(WIBOHost):
                 [n.update(data) for n in self.nodes if n['short_addr']==data['short_addr']]
         return ret
 
-    def scan(self, scanrange=None):
-        """ Scan a range of nodes by pinging them """
+    def rtt(self, nodeid):
+        ret = WIBOHost.rtt(self, nodeid)
+        if ret['code'] == 'OK' and ret['data']['known'] and \
+                self.nodedb != None and nodeid != 0xffff:
+            d = ret['data']
+            self.nodedb.update(self.pan(), nodeid, srtt = d['srtt'],
+                               rttvar = d['rttvar'], rto = d['rto'])
+        return ret
+
+    def refresh(self, scanrange=None):
+        """ Ping the nodes of the node database known on this PAN (and in
+            scanrange), returns False if none of them replies
+        """
+        known = [r['short_addr'] for r in self.nodedb.nodes(self.pan())]
+        if scanrange != None:
+            known = [a for a in known if a in scanrange]
+        if self.VERBOSE >= 1:
+            print "refresh %d known nodes" % len(known),
+        found = 0
+        for a in known:
+            if self.ping(a)['code'] == 'OK':
+                found += 1
+        return found > 0
+
+    def scan(self, scanrange=None, cached=False):
+        """ Scan a range of nodes by pinging them. With cached and a node
+            database only the nodes known from earlier sessions are
+            pinged, the full scan follows if none of them replies.
+        """
+        if cached and self.nodedb != None and self.refresh(scanrange):
+            if self.VERBOSE >= 1:
+                print "\nFound %d known devices\n" % len(self.nodes)
+            return
         if self.VERBOSE >= 1:
             print "scan nodes", scanrange,
 
@@ -251,6 +1466,8 @@ class WIBONetwork(WIBOHost):
                         print "\n        ",
                 else:
                     if self.VERBOSE >= 2: print "Already in list"
+        elif self.discover_all():
+            pass
         else:
             lst=[]
             self.reset()
@@ -269,10 +1486,14 @@ class WIBONetwork(WIBOHost):
 
     def flashhex(self, nodeid=0xFFFF, fname=None):
         """ Flash hex-file to nodeid (single node or broadcast) """
-        f=open(fname)
+        lines = read_hex_lines(fname)
         self.reset()
-        for i, ln in enumerate(f):
-            ret=self.feedhex(nodeid, ln.strip())
+        if self.queued:
+            self.flashhex_queued(nodeid, lines)
+            self.finish(nodeid)
+            return
+        for i, ln in enumerate(lines):
+            ret=self._feedline(nodeid, ln)
             if ret['code'] == 'ERR':
                 print 'ERR', ret['data']
                 break
@@ -282,15 +1503,570 @@ class WIBONetwork(WIBOHost):
                 print "line %-4d crc: 0x%04x\r" % (i, int(self.crc()['data'], 16)),
                 sys.stdout.flush()
             elif self.VERBOSE > 1:
-                print i, ln.strip(), self.crc()['data']
+                print i, ln, self.crc()['data']
 
         self.finish(nodeid)
-        f.close()
+
+    def flashhex_resume(self, nodeid, fname, chunk=16):
+        """ Continue a broken flashhex() at the checkpoint of the node. The
+            image data before the checkpoint is checked against the CRC
+            of the node, on mismatch the update starts over.
+        """
+        ret = self.resume(nodeid)
+        data = ''.join([hexline_data(ln) for ln in read_hex_lines(fname) if ln[7:9] == '00'])
+        if ret['code'] != 'OK' or ret['data']['page'] == 0xFFFF:
+            return self.flashhex(nodeid, fname)
+        start = ret['data']['page'] * PAGESIZE
+        crc = crc_ccitt_block(0, data[:start])
+        if start > len(data) or crc != ret['data']['crc']:
+            print "checkpoint does not match %s, starting over" % fname
+            return self.flashhex(nodeid, fname)
+        ret = self.resumeat(nodeid, ret['data']['page'], crc)
+        if ret['code'] != 'OK':
+            print 'ERR', ret['data']
+            return
+        if self.VERBOSE >= 1:
+            print "resume at 0x%05x" % start
+        for a in range(start, len(data), chunk):
+            ret = self._feedline(nodeid, hexline(a, data[a:a+chunk]))
+            if ret['code'] == 'ERR':
+                print 'ERR', ret['data']
+                break
+            if self.VERBOSE >= 1:
+                print "0x%05x\r" % a,
+                sys.stdout.flush()
+        self.finish(nodeid)
+
+    def flashhex_windowed(self, nodeid, fname, retries=10):
+        """ Flash hex-file to a single node in bursts of WINDOW_SIZE frames,
+            after each burst only the frames the node is missing are sent again
+        """
+        # data records only, the node numbers these frames
+        lines = [ln for ln in read_hex_lines(fname) if ln[7:9] == '00']
+        self.reset()
+        base, received, fails = 0, 0, 0
+        while base < len(lines):
+            for i in range(WINDOW_SIZE):
+                seq = base + i
+                if seq >= len(lines):
+                    break
+                if not (received & (1 << i)):
+                    ret = self._feedline(nodeid, lines[seq], seq)
+                    if ret['code'] == 'ERR':
+                        print 'ERR', ret['data']
+                        return False
+            ret = self.window(nodeid)
+            if ret['code'] != 'OK':
+                fails += 1
+                if fails > retries:
+                    print 'ERR', ret['data']
+                    return False
+                continue
+            if ret['data']['base'] == base and ret['data']['received'] == received:
+                fails += 1 # no progress, burst was lost
+                if fails > retries:
+                    print 'ERR no progress at frame', base
+                    return False
+            else:
+                fails = 0
+            base, received = ret['data']['base'], ret['data']['received']
+            if self.stopped:
+                print 'ERR stopped at frame', base
+                return False
+            if self.VERBOSE >= 1:
+                print "frame %-4d of %d\r" % (base, len(lines)),
+                sys.stdout.flush()
+
+        self.finish(nodeid)
+        return True
+
+    def flashhex_multicast(self, nodeids, fname, retries=10):
+        """ Broadcast hex-file to the nodes in nodeids, after each burst the
+            missing frames of all nodes are merged and only these are broadcast
+            again. Sets 'status' of the nodes in self.nodes to 'OK' or 'FAIL'.
+        """
+        lines = [ln for ln in read_hex_lines(fname) if ln[7:9] == '00']
+        self.mcclear()
+        for n in nodeids:
+            ret = self.mcadd(n)
+            if ret['code'] != 'OK':
+                print 'ERR', ret['data']
+                return False
+        self.reset()
+        base, missing, fails = 0, (1 << WINDOW_SIZE) - 1, 0
+        done = ''
+        while True:
+            for i in range(WINDOW_SIZE):
+                seq = base + i
+                if seq < len(lines) and (missing & (1 << i)):
+                    ret = self._feedline(0xFFFF, lines[seq], seq)
+                    if ret['code'] == 'ERR':
+                        print 'ERR', ret['data']
+                        return False
+            ret = self.mcpoll(len(lines))
+            if ret['code'] != 'OK':
+                print 'ERR', ret['data']
+                return False
+            p = ret['data']
+            done = p['done']
+            if p['pending'] == 0:
+                break
+            if p['base'] == base and p['missing'] == missing:
+                fails += 1
+                if fails > retries:
+                    print 'ERR no progress at frame', base
+                    break
+            else:
+                fails = 0
+            base, missing = p['base'], p['missing']
+            if self.stopped:
+                print 'ERR stopped at frame', base
+                break
+            if p['lost'] and missing == 0:
+                missing = (1 << WINDOW_SIZE) - 1 # unknown state, resend all
+            if self.VERBOSE >= 1:
+                print "frame %-4d of %d, pending nodes %d\r" % \
+                    (base, len(lines), p['pending']),
+                sys.stdout.flush()
+
+        self.finish(0xFFFF)
+        for i, n in enumerate(nodeids):
+            ok = (int(done[2*(i/8):2*(i/8)+2], 16) >> (i%8)) & 1
+            [m.update({'status': ok and 'OK' or 'FAIL'}) \
+                for m in self.nodes if m['short_addr'] == n]
+        return p['pending'] == 0
+
+    def flashhex_fountain(self, nodeids, fname, overhead=FEC_OVERHEAD,
+            passes=FEC_PASSES):
+        """ Broadcast hex-file to the nodes in nodeids (WIBO_FLAVOUR_FEC)
+            as coded symbols, the first pass sends each block plain and
+            overhead * FEC_K random XOR combinations behind it. Any FEC_K
+            independent symbols decode a block, so nodes that lost
+            different frames complete with the same ones. The blocks still
+            missing at any node are sent once more with fresh symbols,
+            overhead grows with each pass. Sets 'status' of
+            the nodes in self.nodes to 'OK' or 'FAIL'.
+        """
+        data = image_data(fname)
+        data += [0xff] * (-len(data) % FEC_BLOCK)
+        crc = data_crc(data) # what the nodes take once all blocks are done
+        blocks = fec_blocks(data)
+        nblocks = len(blocks)
+        if nblocks > FEC_MAXBLOCKS:
+            print 'ERR image of %d blocks, at most %d' % (nblocks, FEC_MAXBLOCKS)
+            return False
+        self.reset()
+        missing = dict([(n, range(nblocks)) for n in nodeids])
+        extra = int(FEC_K * overhead + 0.5)
+        for p in range(passes):
+            want = set()
+            for n in missing:
+                want.update(missing[n])
+            for b in sorted(want):
+                if p == 0:
+                    masks = [1 << i for i in range(FEC_K)]
+                else:
+                    masks = [] # the nodes dropped what they had of it
+                masks += [random.getrandbits(FEC_K) or 1
+                          for i in range(FEC_K + extra * (p + 1) - len(masks))]
+                for m in masks:
+                    ret = self.fecbin(0xFFFF, b, nblocks, m,
+                                      fec_symbol(blocks[b], m))
+                    if ret['code'] != 'OK':
+                        print 'ERR', ret['data']
+                        return False
+                time.sleep(FEC_BLOCK_TIME)
+                if self.VERBOSE >= 1:
+                    print "pass %d block %-3d of %d\r" % (p, b, nblocks),
+                    sys.stdout.flush()
+            for n in missing.keys():
+                ret = self.fecstat(n)
+                if ret['code'] != 'OK':
+                    continue # keep what it lacked before
+                if len(ret['data']['done']) == nblocks:
+                    del missing[n]
+                else:
+                    missing[n] = [b for b in range(nblocks)
+                                  if b not in ret['data']['done']]
+            if not missing:
+                break
+
+        for n in nodeids:
+            ret = self.fecstat(n)
+            ok = n not in missing and ret['code'] == 'OK' and \
+                    ret['data']['crc'] == crc
+            [m.update({'status': ok and 'OK' or 'FAIL'}) \
+                for m in self.nodes if m['short_addr'] == n]
+        return not missing
+
+    def flashhex_sparse(self, nodeid, fname, chunk=64):
+        """ Flash page aligned runs of the hex-file, pages that are all 0xFF
+            are erased by the node instead of being sent
+        """
+        segs = read_hex_pages(fname, True)
+        self.reset()
+        for address, npages in erase_runs(segs):
+            self.erase(nodeid, address, npages)
+        for address, data in segs:
+            self.addr(nodeid, address)
+            for i in range(0, len(data), chunk):
+                ret = self.feedbin(nodeid, str(data[i:i+chunk]))
+                if ret['code'] == 'ERR':
+                    print 'ERR', ret['data']
+                    return False
+                if self.VERBOSE >= 1:
+                    print "0x%05x\r" % (address + i),
+                    sys.stdout.flush()
+        # runs end on page boundaries, nothing left to finish
+        return True
+
+    def flasheep(self, nodeid, fname, chunk=64):
+        """ Write the bytes of an EEPROM hex-file (.eep) to a node with
+            WIBO_FLAVOUR_EEPROM. The node writes whenever its buffer of
+            PAGESIZE bytes is full, the data is paced by the worst case
+            write time meanwhile. Returns True if the EEPROM CRC of the
+            node matches.
+        """
+        if self.target('E', nodeid)['code'] != 'OK':
+            return False
+        crc = 0
+        for address, data in read_hex_runs(fname):
+            self.addr(nodeid, address)
+            for i in range(0, len(data), chunk):
+                ret = self.feedbin(nodeid, str(data[i:i+chunk]))
+                if ret['code'] == 'ERR':
+                    print 'ERR', ret['data']
+                    self.target('F', nodeid)
+                    return False
+                if (i + chunk) % PAGESIZE == 0:
+                    time.sleep(PAGESIZE * EE_WRITE_TIME)
+            self.finish(nodeid) # writes the rest of the buffer
+            time.sleep((len(data) % PAGESIZE) * EE_WRITE_TIME)
+            crc = crc_ccitt_block(crc, data)
+        ret = WIBOHost.ping(self, nodeid)
+        self.target('F', nodeid)
+        return ret['code'] == 'OK' and ret['data']['crc'] == crc
+
+    def flashhex_compressed(self, nodeid, fname, chunk=64):
+        """ Flash hex-file LZSS compressed, each page aligned address range
+            is compressed on its own. Returns the compression ratio.
+        """
+        segs = read_hex_pages(fname, True)
+        self.reset()
+        for address, npages in erase_runs(segs):
+            self.erase(nodeid, address, npages)
+        ret = self.zmode(nodeid, ZMODE_LZSS)
+        if ret['code'] != 'OK':
+            print 'ERR', ret['data']
+            return None
+        raw, sent = 0, 0
+        for address, data in segs:
+            z = lzss_compress(data)
+            raw += len(data)
+            sent += len(z)
+            self.addr(nodeid, address)
+            for i in range(0, len(z), chunk):
+                ret = self.feedbin(nodeid, str(z[i:i+chunk]))
+                if ret['code'] == 'ERR':
+                    print 'ERR', ret['data']
+                    return None
+                if self.VERBOSE >= 1:
+                    print "0x%05x: %d of %d\r" % (address, i, len(z)),
+                    sys.stdout.flush()
+        # segments end on page boundaries, nothing left to finish
+        if self.VERBOSE >= 1:
+            print "\nsent %d of %d bytes" % (sent, raw)
+        return float(sent) / max(raw, 1)
+
+    def flashhex_delta(self, nodeid, fname, oldfname, chunk=64):
+        """ Flash hex-file as patch against oldfname, which has to be the
+            image installed on the node. A delta update broken by power loss
+            is resumed at the page the node reports.
+        """
+        new = read_hex_pages(fname)
+        old = read_hex_pages(oldfname)
+        baselen = max([a + len(d) for a, d in old])
+        size = max(baselen, max([a + len(d) for a, d in new]))
+
+        ret = WIBOHost.ping(self, nodeid)
+        if ret['code'] != 'OK':
+            print 'ERR', ret['data']
+            return False
+        resume = None
+        if ret['data'].get('errno') == P2P_ERROR_DELTA_RESUME:
+            resume = ret['data']['crc'] * PAGESIZE
+            print "resume delta update at 0x%05x" % resume
+
+        enc = DeltaEncoder(old, size, resume)
+        if resume != None:
+            # pages below were patched already
+            for a, d in new:
+                for p in range(a, min(a + len(d), resume), PAGESIZE):
+                    enc.flash[p:p+PAGESIZE] = d[p-a:p-a+PAGESIZE]
+        self.reset()
+        if resume == None:
+            crc = crc_ccitt_block(0, enc.flash[:baselen])
+            self.zdelta(nodeid, baselen, crc)
+        else:
+            self.zdelta(nodeid, 0, 0)
+        ret = WIBOHost.ping(self, nodeid)
+        if ret['code'] != 'OK' or ret['data'].get('errno') == P2P_ERROR_DELTA_BASE:
+            print 'ERR installed image does not match', oldfname
+            return False
+
+        raw, sent = 0, 0
+        for address, data in new:
+            if resume != None:
+                if address + len(data) <= resume:
+                    continue
+                if address < resume:
+                    data = data[resume-address:]
+                    address = resume
+            z = enc.encode(address, data)
+            raw += len(data)
+            sent += len(z)
+            self.addr(nodeid, address)
+            for i in range(0, len(z), chunk):
+                ret = self.feedbin(nodeid, str(z[i:i+chunk]))
+                if ret['code'] == 'ERR':
+                    print 'ERR', ret['data']
+                    return False
+                if self.VERBOSE >= 1:
+                    print "0x%05x: %d of %d\r" % (address, i, len(z)),
+                    sys.stdout.flush()
+        if self.VERBOSE >= 1:
+            print "\npatch %d bytes for %d bytes" % (sent, raw)
+        return True
+
+    def flashhex_parallel(self, troops, fname):
+        """ Broadcast hex-file to several troops at once, troops is a list
+            of (channel, pan_id, nodeids). Each troop gets a session, the
+            host sends their frames by turns. Returns a dict of the node
+            states after the CRC check, the host is left on the channel and
+            PAN of the last troop.
+        """
+        lines = [ln for ln in read_hex_lines(fname) if ln[7:9] == '00']
+        sessions = []
+        for channel, pan_id, nodeids in troops:
+            ret = self.sopen(channel, pan_id)
+            if ret['code'] != 'OK':
+                print 'ERR', ret['data']
+                break
+            sessions.append(ret['data'])
+            self.sreset(ret['data'])
+        # the host blocks while one queue is full and sends the others
+        for i, ln in enumerate(lines):
+            for sess in sessions:
+                ret = self.sfeed(sess, 0xFFFF, ln)
+                if ret['code'] == 'ERR':
+                    print 'ERR', ret['data']
+                    return {}
+            if self.VERBOSE >= 1:
+                print "line %-4d\r" % i,
+                sys.stdout.flush()
+        for sess in sessions:
+            self.sfinish(sess, 0xFFFF)
+        self.sflush()
+
+        states = {}
+        for sess, (channel, pan_id, nodeids) in zip(sessions, troops):
+            crc = int(self.scrc(sess)['data'], 16)
+            self.channel(channel)
+            self.panid(pan_id)
+            for n in nodeids:
+                p = self.ping(n)
+                if p['code'] != 'OK':
+                    states[n] = 'DISCONNECT'
+                elif p['data']['crc'] == crc:
+                    states[n] = 'OK'
+                    self.sexit(sess, n)
+                else:
+                    states[n] = 'FAIL'
+        self.sflush()
+        for sess in sessions:
+            self.sclose(sess)
+        return states
+
+    def flashhex_fanout(self, nodeids, fname, key):
+        """ Update the first node of nodeids from the host, then let each
+            updated node pass the image on to one more node per round, so
+            the number of updated nodes doubles each round. A node counts as
+            updated when it committed the image and its ping CRC matches.
+            All updated nodes exit at the end, until then the relays keep
+            the image staged. Returns the list of updated nodes.
+        """
+        length, crc = image_crc(fname)
+        mac = image_cmac(fname, key)
+        if mac == None:
+            print "WARN no pycrypto, a signed node rejects the image"
+            mac = "0" * 32
+        pending = list(nodeids)
+        done = []
+        while pending and not done:
+            n = pending.pop(0)
+            if self.ping(n)['code'] != 'OK':
+                print "node %d is not responding" % n
+                continue
+            self.flashhex(n, fname)
+            tmp = self.commit(n, length, crc, mac)
+            if tmp['code'] == 'OK' and tmp['data']['errno'] not in \
+                    (P2P_ERROR_COMMIT, P2P_ERROR_SIGNATURE):
+                print "COMMIT node %d" % n
+                done.append(n)
+            else:
+                print "COMMIT failed on node %d" % n, tmp
+        while pending and done:
+            jobs = []
+            for r in done:
+                if not pending:
+                    break
+                t = pending.pop(0)
+                self.relay(r, t, length, crc)
+                jobs.append((r, t))
+            if self.VERBOSE > 0:
+                print "relay round", jobs
+            tend = time.time() + RELAY_TIMEOUT
+            while jobs and time.time() < tend:
+                time.sleep(RELAY_POLL)
+                for r, t in list(jobs):
+                    tmp = WIBOHost.ping(self, r)
+                    if tmp['code'] != 'OK' or \
+                            tmp['data']['appstatus'] == P2P_STATUS_RELAYING:
+                        continue
+                    jobs.remove((r, t))
+                    tmp = WIBOHost.ping(self, t)
+                    if tmp['code'] == 'OK' and tmp['data']['crc'] == crc:
+                        print "RELAY node %d -> %d" % (r, t)
+                        done.append(t)
+                    else:
+                        print "RELAY failed node %d -> %d" % (r, t), tmp
+            for r, t in jobs:
+                print "RELAY timeout node %d -> %d" % (r, t)
+        for n in pending:
+            print "node %d not updated, no relay left" % n
+        for n in done:
+            print "EXIT", self.exit(n)
+        return done
+
+    def negotiate_rate(self, nodeid, pings=3):
+        """ Try the high data rates in turn, keep the first one where all
+            pings are answered. Returns the rate in use afterwards.
+        """
+        for rate in HIGH_RATES:
+            ret = self.rate(nodeid, rate)
+            if ret['code'] != 'OK':
+                continue
+            ok = [self.ping(nodeid)['code'] for i in range(pings)].count('OK')
+            if ok == pings:
+                if self.VERBOSE >= 1:
+                    print "data rate 0x%02x" % rate
+                return rate
+            # weak link, node falls back to 250kbps by itself
+            self.hostrate(OQPSK250)
+            time.sleep(RATE_TIMEOUT * 1.5)
+        return OQPSK250
+
+    def bench_phy(self, nodeid, nframes = PHY_BENCH_FRAMES,
+            length = PHY_BENCH_LENGTH):
+        """ Run a burst of test frames with each PHY profile of the host.
+            Goodput is taken from the bytes the node counted over the
+            time of the burst. The node stays at profile 0 afterwards.
+            Returns the list of results, None if not supported.
+        """
+        ret = self.phylist()
+        if ret['code'] != 'OK':
+            return None
+        results = []
+        for p in ret['data']:
+            res = dict(profile = p['profile'], name = p['name'],
+                    goodput = 0.0, per = 1.0)
+            results.append(res)
+            if self.physet(nodeid, p['profile'])['code'] != 'OK':
+                continue
+            if self.phystats(nodeid, 1)['code'] != 'OK':
+                # node can not hear us, it reverts by itself
+                self.hostphy(0)
+                time.sleep(PHY_REVERT_TIME * 1.5)
+                continue
+            t = time.time()
+            sent = self.phytest(nodeid, nframes, length)
+            t = time.time() - t
+            stats = self.phystats(nodeid, 1)
+            if sent['code'] != 'OK' or stats['code'] != 'OK':
+                self.hostphy(0)
+                time.sleep(PHY_REVERT_TIME * 1.5)
+                continue
+            nsent = sent['data']['sent']
+            res['per'] = 1.0 - float(stats['data']['received']) / nsent
+            res['goodput'] = stats['data']['bytes'] * 8 / t / 1000
+            if self.VERBOSE >= 1:
+                print "%-10s %7.1f kbit/s  PER %5.1f%%  ccafail %d" % \
+                    (res['name'], res['goodput'], res['per'] * 100,
+                     sent['data']['ccafail'])
+        self.physet(nodeid, 0)
+        return results
+
+    def discover_all(self):
+        """ Discover the nodes in range by rounds of slotted broadcast pings,
+            until DISCOVER_QUIET rounds in a row bring no new node. The
+            slots are doubled when a round gets crowded.
+            Returns False if nodes or host do not support it.
+        """
+        nslots, quiet, rnd = DISCOVER_SLOTS, 0, 0
+        self.reset()
+        self.nodes = NodeList()
+        while quiet < DISCOVER_QUIET:
+            ret = self.discover(nslots, rnd)
+            if ret['code'] != 'OK':
+                return False
+            known = [n['short_addr'] for n in self.nodes]
+            new = [n for n in ret['data'] if n['short_addr'] not in known]
+            for n in new:
+                self._nodeseen(n)
+                n.update({'status':None, 'target':'F'})
+                self.nodes.append(n)
+            quiet = 0 if len(new) else quiet + 1
+            if 2 * len(ret['data']) > nslots:
+                nslots = min(2 * nslots, 255)
+            rnd += 1
+            if self.VERBOSE >= 2:
+                print "round %d: %d replies, %d nodes" % (rnd, len(ret['data']), len(self.nodes))
+        return len(self.nodes) > 0
+
+    def rendezvous_all(self, rvchannel, duration = RENDEZVOUS_TIME):
+        """ Repeat the rendezvous call, so every node that resets
+            meanwhile catches one in its listen window.
+            Returns False if the host does not support it.
+        """
+        tend = time.time() + duration
+        while time.time() < tend:
+            if self.rendezvous(rvchannel)['code'] != 'OK':
+                return False
+            time.sleep(RENDEZVOUS_PERIOD)
+        return True
+
+    def poll_all(self, nslots = PINGSHORT_SLOTS):
+        """ Short ping of all nodes with one broadcast, returns a dict
+            short address -> reply, None if the host does not support it
+        """
+        ret = self.pingshort(0xffff, nslots)
+        if ret['code'] != 'OK':
+            return None
+        return dict([(r['short_addr'], r) for r in ret['data']])
 
     def checkcrc(self):
-        """ Check CRC of node list and compare to the local CRC of host    """
+        """ Check CRC of node list and compare to the local CRC of host.
+            One short ping broadcast covers most nodes, the others are
+            pinged one by one.
+        """
         hostcrc = self.crc()['data']
+        polled = self.poll_all() or {}
         for n in self.nodes:
+            r = polled.get(n['short_addr'])
+            if r is not None:
+                self._nodeseen(r)
+                n['status'] = 'OK' if r['crc'] == hostcrc else 'FAIL'
+                continue
             p = self.ping(n['short_addr'])
             if p['code'] == 'OK':
                 if (hostcrc == p['data']):
@@ -308,9 +2084,247 @@ class WIBONetwork(WIBOHost):
             else: targ='X'
 
             n['target']=targ # local list
-            ret=self.target(n['short_addr'], 'F') # write to device
+            ret=self.target(targ, n['short_addr']) # write to device
             if ret['code'] != 'OK': raise Exception("Could not set target")
 
+def print_progress(nodes, summary):
+    """ onprogress of -T, a line per node and one for the host """
+    for a in sorted(nodes):
+        d = nodes[a]
+        unknown = lambda v: v == 0xffff and "?" or str(v)
+        print "node 0x%04x: frame %d, pages %s, lost %s, nacks %d, " \
+            "timeouts %d, %d B/s" % (a, d['base'], unknown(d['pages']),
+            unknown(d['lost']), d['nacks'], d['timeouts'], d['goodput'])
+    print "host: %d frames, %d resent, %.1f s" % (summary['frames'],
+        summary['retx'], summary['t_ms'] / 1000.0)
+
+def open_host(wnwk, port, baudrate):
+    """ Open the serial line of a host and check that it answers """
+    wnwk.close()
+    wnwk.setTimeout(1.0)
+    wnwk.setPort(port)
+    wnwk.setBaudrate(baudrate)
+    wnwk.open()
+    time.sleep(0.1) # some time for boot printout
+    for i in range(10):
+        x = wnwk.echo("HalloWibo")
+        if x["code"] == "OK":
+            break
+        else:
+            time.sleep(.1)
+    if i == 9:
+        raise Exception("FATAL", "unable to connect wibo host %s" % x)
+
+def read_manifest(fname):
+    """ Read a fleet manifest (JSON), see class Fleet """
+    import json
+    m = json.load(open(fname))
+    boards = {}
+    for name, b in m['boards'].items():
+        nodes = b.get('nodes')
+        if isinstance(nodes, basestring):
+            nodes = param_evaluate_list(nodes)
+        boards[str(name)] = dict(image = str(b['image']), nodes = nodes)
+    bridges = []
+    for b in m.get('bridges', []):
+        if isinstance(b, basestring):
+            b = dict(port = b)
+        bridges.append(dict(port = str(b['port']),
+                baudrate = b.get('baudrate', 38400),
+                channel = b.get('channel')))
+    return dict(boards = boards, bridges = bridges,
+            retries = m.get('retries', FLEET_RETRIES),
+            report = m.get('report'))
+
+class Fleet(object):
+    """ Update a fleet of nodes through one or more hosts (bridges)
+
+        The manifest maps board names to an image and, optionally, the
+        nodes to update; without nodes all nodes of the board that are
+        found are updated:
+
+        {"bridges": [{"port": "/dev/ttyUSB0", "baudrate": 38400, "channel": 11},
+                     {"port": "/dev/ttyUSB1", "channel": 17}],
+         "boards": {"pinoccio": {"image": "app.hex", "nodes": "1:16"},
+                    "rbbrfa1": {"image": "app.hex"}},
+         "retries": 3, "report": "fleet.json"}
+
+        Each bridge updates the nodes it finds on its channel, a node seen
+        by several bridges belongs to the first one. The bridges work in
+        parallel. A bridge sends each image once as multicast session to
+        all its nodes of that image, the others do a dry run (target X).
+        Nodes that fail the CRC check get up to "retries" unicast updates.
+    """
+
+    def __init__(self, manifest, make_host = WIBONetwork):
+        self.manifest = manifest
+        self.make_host = make_host
+        self.lock = threading.Lock()
+        self.report = []
+
+    def log(self, bridge, msg):
+        self.lock.acquire()
+        print "%s: %s" % (bridge['port'], msg)
+        sys.stdout.flush()
+        self.lock.release()
+
+    def _open(self, bridge):
+        wnwk = self.make_host()
+        open_host(wnwk, bridge['port'], bridge['baudrate'])
+        if bridge['channel'] != None:
+            wnwk.channel(bridge['channel'])
+        return wnwk
+
+    def _find(self, bridge, wnwk, found):
+        """ Collect the nodes in range of a bridge, short address -> ping data """
+        wanted = set()
+        for b in self.manifest['boards'].values():
+            wanted.update(b['nodes'] or [])
+        everyone = [b for b in self.manifest['boards'].values() if b['nodes'] == None]
+        if everyone:
+            wnwk.scan() # discovery, falls back to broadcast pings
+            if wanted:
+                wnwk.scan(sorted(wanted))
+        else:
+            wnwk.scan(sorted(wanted))
+        found[bridge['port']] = dict((n['short_addr'], n) for n in wnwk.nodes)
+        self.log(bridge, "found %d nodes" % len(wnwk.nodes))
+
+    def _verify(self, wnwk, nodeids):
+        """ CRC check of the nodes after a transfer, -> dict node -> state """
+        hostcrc = int(wnwk.crc()['data'], 16)
+        polled = wnwk.poll_all() or {}
+        states = {}
+        for n in nodeids:
+            r = polled.get(n)
+            if r == None:
+                p = wnwk.ping(n)
+                r = p['code'] == 'OK' and p['data'] or None
+            if r == None:
+                states[n] = 'DISCONNECT'
+            else:
+                states[n] = r['crc'] == hostcrc and 'OK' or 'FAIL'
+        return states
+
+    def _group(self, bridge, wnwk, image, entries):
+        """ One multicast session for all nodes of an image, then unicast retries """
+        t0 = time.time()
+        nodeids = [e['short_addr'] for e in entries]
+        wnwk.target('X')
+        for n in nodeids:
+            wnwk.target('F', n)
+        self.log(bridge, "%s to %s" % (image, nodeids))
+        if len(nodeids) > 1:
+            wnwk.flashhex_multicast(nodeids, image)
+            via = 'multicast'
+        else:
+            wnwk.flashhex_windowed(nodeids[0], image)
+            via = 'unicast'
+        states = self._verify(wnwk, nodeids)
+        for e in entries:
+            e.update(via = via, attempts = 1)
+        for retry in range(self.manifest['retries']):
+            failed = [e for e in entries if states[e['short_addr']] != 'OK']
+            if not failed:
+                break
+            for e in failed:
+                n = e['short_addr']
+                self.log(bridge, "retry 0x%04x (%s)" % (n, states[n]))
+                wnwk.flashhex_windowed(n, image)
+                states.update(self._verify(wnwk, [n]))
+                e.update(via = 'retry', attempts = e['attempts'] + 1)
+        wnwk.target('F')
+        for e in entries:
+            e['status'] = states[e['short_addr']]
+            if e['status'] == 'OK':
+                wnwk.exit(e['short_addr'])
+            e['seconds'] = round(time.time() - t0, 1)
+        self.log(bridge, "%s: %d of %d OK in %.1f s" % (image,
+            len([e for e in entries if e['status'] == 'OK']), len(entries),
+            time.time() - t0))
+
+    def _update(self, bridge, wnwk, entries):
+        """ Updates of one bridge, the nodes are grouped by image """
+        try:
+            # nodes running an application are asked to jump into the bootloader
+            apps = [e['short_addr'] for e in entries if e['appname'] != 'wibo']
+            for n in apps:
+                wnwk.jbootl(n)
+            if apps:
+                time.sleep(1.0)
+            for e in entries:
+                if e['short_addr'] in apps:
+                    p = wnwk.ping(e['short_addr'])
+                    if p['code'] != 'OK' or p['data']['appname'] != 'wibo':
+                        e['status'] = 'NOBOOTL'
+            images = {}
+            for e in entries:
+                if e['status'] == None:
+                    images.setdefault(e['image'], []).append(e)
+            for image in sorted(images):
+                self._group(bridge, wnwk, image, images[image])
+        except Exception, ex:
+            self.log(bridge, "ERR %s" % ex)
+            for e in entries:
+                if e['status'] == None:
+                    e['status'] = 'ERROR'
+
+    def _parallel(self, func, args):
+        threads = [threading.Thread(target = func, args = a) for a in args]
+        [t.start() for t in threads]
+        [t.join() for t in threads]
+
+    def run(self):
+        """ Update the fleet, returns the report, a list of dicts per node """
+        bridges = self.manifest['bridges']
+        hosts = [self._open(b) for b in bridges]
+        found = {}
+        self._parallel(self._find, [(b, h, found) for b, h in zip(bridges, hosts)])
+
+        owner = {}
+        for b in bridges:
+            for n, p in found.get(b['port'], {}).items():
+                owner.setdefault(n, (b, p))
+        work = dict((b['port'], []) for b in bridges)
+        for board, cfg in sorted(self.manifest['boards'].items()):
+            if cfg['nodes'] == None:
+                nodes = [n for n, (b, p) in owner.items() if p['boardname'] == board]
+            else:
+                nodes = cfg['nodes']
+            for n in sorted(nodes):
+                e = dict(short_addr = n, board = board, image = cfg['image'],
+                        bridge = None, appname = None, status = None,
+                        via = None, attempts = 0, seconds = 0)
+                self.report.append(e)
+                if n not in owner:
+                    e['status'] = 'NOTFOUND'
+                    continue
+                b, p = owner[n]
+                e.update(bridge = b['port'], appname = p['appname'])
+                if p['boardname'] != board:
+                    e['status'] = 'BOARD %s' % p['boardname']
+                    continue
+                work[b['port']].append(e)
+
+        self._parallel(self._update,
+                [(b, h, work[b['port']]) for b, h in zip(bridges, hosts) if work[b['port']]])
+        for h in hosts:
+            h.close()
+        return self.report
+
+    def print_report(self):
+        keys = ['short_addr', 'board', 'bridge', 'status', 'via', 'attempts', 'seconds', 'image']
+        print "  ".join(["%-10s" % k.upper() for k in keys])
+        for e in self.report:
+            print "  ".join(["%-10s" % (k == 'short_addr' and "0x%04x" % e[k] or e[k]) \
+                    for k in keys])
+        ok = len([e for e in self.report if e['status'] == 'OK'])
+        print "%d of %d nodes updated" % (ok, len(self.report))
+
+    def save_report(self, fname):
+        import json
+        json.dump(self.report, open(fname, 'w'), indent = 1)
+
 def init_prompt():
     global HISTORY
     try:
@@ -343,10 +2357,28 @@ def process_command_line():
     CHANNELS = None
     PORT = None
     BAUDRATE = None
+    WINDOWED = False
+    FOUNTAIN = False
+    HIGHRATE = False
+    COMPRESS = False
+    DELTABASE = None
+    SPARSE = False
+    PARALLEL = False
+    RESUME = False
+    COMMIT = False
+    BACKGROUND = False
+    MESH = False
+    FANOUT = False
+    RVCHANNEL = None
+    MANIFEST = None
+    NODEDB = None
+    PACK = []
+    KEY = [0xff] * 16
+    PROGRESS = 0
     ret = False
 
     try:
-        opts,args = getopt.getopt(sys.argv[1:],"c:P:a:U:u:hVSJvEd:")
+        opts,args = getopt.getopt(sys.argv[1:],"c:P:a:U:u:L:e:hVSJvEwfbqrRzspABMFYIK:D:d:G:m:W:N:T:")
     except getopt.GetoptError,e:
         print "="*80
         print "Error:", e
@@ -365,6 +2397,55 @@ def process_command_line():
             break
         elif o == "-v":
             VERBOSE+=1
+        elif o == "-w":
+            WINDOWED = True
+        elif o == "-f":
+            FOUNTAIN = True
+        elif o == "-b":
+            wnwk.binary = True
+        elif o == "-q":
+            wnwk.queued = True
+        elif o == "-r":
+            HIGHRATE = True
+        elif o == "-z":
+            COMPRESS = True
+        elif o == "-D":
+            DELTABASE = v
+        elif o == "-s":
+            SPARSE = True
+        elif o == "-p":
+            PARALLEL = True
+        elif o == "-R":
+            RESUME = True
+        elif o == "-A":
+            COMMIT = True
+        elif o == "-B":
+            BACKGROUND = True
+            COMMIT = True
+        elif o == "-M":
+            MESH = True
+            BACKGROUND = True
+            COMMIT = True
+        elif o == "-G":
+            RVCHANNEL = int(v, 0)
+        elif o == "-m":
+            MANIFEST = v
+        elif o == "-N":
+            NODEDB = v
+        elif o == "-T":
+            PROGRESS = int(v)
+        elif o == "-W":
+            PACK.append(v)
+        elif o == "-F":
+            FANOUT = True
+            BACKGROUND = True
+            COMMIT = True
+        elif o == "-K":
+            if len(v) != 32:
+                print "Error: -K needs 32 hex digits"
+                ret = True
+                break
+            KEY = [int(v[i:i + 2], 16) for i in range(0, 32, 2)]
         elif o == "-P":
             try:
                 p,b = v.split(":")
@@ -378,48 +2459,175 @@ def process_command_line():
         elif o == "-c":
             CHANNELS = param_evaluate_list(v)
 
+    if ret == False and PACK:
+        for v in PACK:
+            v = v.split(":")
+            outname = re.sub(r'\.hex$', '', v[0]) + '.wimg'
+            try:
+                img = pack_image(v[0], outname, (v[1:] or [""])[0],
+                                 int((v[2:] or ["0"])[0], 0), COMPRESS, KEY,
+                                 DELTABASE)
+            except (ImageError, IOError, ValueError), e:
+                print "Error:", e
+                ret = True
+                break
+            print "IMAGE %s: %d bytes, crc: 0x%04x, %d pages, %d bytes stored%s" % \
+                (outname, img['length'], img['crc'], len(img['crcs']),
+                 img['size'], not img['flags'] & IMG_FLAG_SIGNED and ", unsigned" or "")
+        # packing needs no host
+        if not [o for o, v in opts if o not in ("-W", "-z", "-D", "-K", "-v")]:
+            ret = True
+
+    if ret == False and MANIFEST != None:
+        manifest = read_manifest(MANIFEST)
+        if not manifest['bridges']:
+            manifest['bridges'] = [dict(port = PORT, baudrate = BAUDRATE,
+                channel = CHANNELS and CHANNELS[0])]
+        def make_host():
+            h = WIBONetwork()
+            h.binary, h.queued = wnwk.binary, wnwk.queued
+            return h
+        fleet = Fleet(manifest, make_host)
+        fleet.run()
+        fleet.print_report()
+        if manifest['report']:
+            fleet.save_report(manifest['report'])
+        return ret
+
     if ret == False:
         wnwk.VERBOSE = VERBOSE
-        wnwk.close()
-        wnwk.setTimeout(1.0)
-        wnwk.setPort(PORT)
-        wnwk.setBaudrate(BAUDRATE)
-        wnwk.open()
-        time.sleep(0.1) # some time for boot printout
-        for i in range(10):
-            x = wnwk.echo("HalloWibo")
-            if x["code"] == "OK":
-                break
+        open_host(wnwk, PORT, BAUDRATE)
+        if NODEDB != None:
+            wnwk.nodedb = NodeDB(NODEDB)
+        if PROGRESS:
+            if wnwk.progress(PROGRESS)['code'] == 'OK':
+                wnwk.onprogress = print_progress
             else:
-                time.sleep(.1)
-        if i == 9:
-            raise Exception("FATAL", "unable to connect wibo host %s" % x)
+                print "WARN host does not stream the progress"
+
+        if RVCHANNEL != None:
+            print "rendezvous on channel", RVCHANNEL
+            if not wnwk.rendezvous_all(RVCHANNEL):
+                print "WARN host does not support rendezvous"
 
         for o,v in opts:
-            if o == "-u":
+            if o == "-u" and FANOUT:
+                print "fan out flashing nodes", ADDRESSES
+                done = wnwk.flashhex_fanout(ADDRESSES, v, KEY)
+                print "updated %d of %d nodes" % (len(done), len(ADDRESSES))
+            elif o == "-u":
                 print "selective flashing nodes", ADDRESSES
                 for n in ADDRESSES:
                     print "flash node", n
+                    if MESH:
+                        tmp = wnwk.route(n)
+                        if tmp['code'] != 'OK':
+                            print "no route to node %d" % n
+                            continue
+                        print "route", tmp['data']
                     tmp = wnwk.ping(n)
-                    if tmp['code'] == 'OK' and tmp['data']['appname'] == "wibo":
-                            wnwk.flashhex(n,v)
+                    if tmp['code'] == 'OK' and is_image(v) and \
+                            read_header(v)['board'] not in \
+                            ("", tmp['data']['boardname']):
+                        print "image %s is for board %s, node %d is %s" % \
+                            (v, read_header(v)['board'], n, tmp['data']['boardname'])
+                        continue
+                    if tmp['code'] == 'OK' and \
+                            (BACKGROUND or tmp['data']['appname'] == "wibo"):
+                            if HIGHRATE:
+                                wnwk.negotiate_rate(n)
+                            if DELTABASE:
+                                wnwk.flashhex_delta(n,v,DELTABASE)
+                            elif COMPRESS:
+                                wnwk.flashhex_compressed(n,v)
+                            elif SPARSE:
+                                wnwk.flashhex_sparse(n,v)
+                            elif WINDOWED:
+                                wnwk.flashhex_windowed(n,v)
+                            elif RESUME:
+                                wnwk.flashhex_resume(n,v)
+                            else:
+                                wnwk.flashhex(n,v)
+                            if HIGHRATE:
+                                wnwk.rate(n, OQPSK250)
                             print "                      \r"\
                                 "file: %s, node: 0x%04x, crc: 0x%04x" % \
                                 (v, n, int(wnwk.crc()['data'], 16))
                             print "CRC", wnwk.checkcrc() # TODO: rework
+                            if COMMIT:
+                                length, crc = image_crc(v)
+                                mac = image_cmac(v, KEY)
+                                if mac == None:
+                                    print "WARN no pycrypto, a signed node rejects the image"
+                                    mac = "0" * 32
+                                tmp = wnwk.commit(n, length, crc, mac)
+                                if tmp['code'] != 'OK' or \
+                                        tmp['data']['errno'] in \
+                                        (P2P_ERROR_COMMIT, P2P_ERROR_SIGNATURE):
+                                    print "COMMIT failed, image stays staged", tmp
+                                else:
+                                    print "COMMIT", length, "bytes, crc: 0x%04x" % crc
                             print "EXIT", wnwk.exit(n)
                     else:
                         print "node %d is not responding" % n
 
+            elif o == "-e":
+                for n in ADDRESSES:
+                    tmp = wnwk.ping(n)
+                    if tmp['code'] != 'OK' or tmp['data']['appname'] != "wibo":
+                        print "node %d is not responding" % n
+                        continue
+                    print "EEPROM node %d" % n, \
+                            wnwk.flasheep(n, v) and "OK" or "FAIL"
+
+            elif o == "-L":
+                staged = re.sub(r'\.hex$', '', v) + '_bootlup.hex'
+                length, crc = bootlup_hex(v, staged)
+                print "bootloader", v, length, "bytes, crc: 0x%04x" % crc
+                for n in ADDRESSES:
+                    tmp = wnwk.ping(n)
+                    if tmp['code'] != 'OK' or tmp['data']['appname'] != "wibo":
+                        print "node %d is not responding" % n
+                        continue
+                    wnwk.flashhex(n, staged)
+                    print "CRC", wnwk.checkcrc()
+                    wnwk.bootlup(n)
+                    time.sleep(1.0) # copy and restart of the node
+                    tmp = wnwk.ping(n)
+                    if tmp['code'] != 'OK':
+                        print "BOOTLUP node %d is not responding" % n
+                    elif tmp['data']['errno'] == P2P_ERROR_BOOTLUP:
+                        print "BOOTLUP rejected by node %d, header or CRC" % n
+                    else:
+                        print "BOOTLUP node %d" % n, tmp['data']['version']
+
+            elif o == "-U" and PARALLEL and CHANNELS != None:
+                info = wnwk._sendcommand('info')
+                pan_id = int(re.search("PAN_ID=(0x[0-9A-Fa-f]+)", info['data']).group(1), 16)
+                troops = []
+                for c in CHANNELS:
+                    wnwk.channel(c)
+                    wnwk.nodes = NodeList()
+                    wnwk.scan(ADDRESSES, cached = True)
+                    listeners = [n['short_addr'] for n in wnwk.nodes if n['appname'] == "wibo"]
+                    if len(listeners):
+                        troops.append((c, pan_id, listeners))
+                if len(troops) == 0:
+                    print "skip flashing, no listeners"
+                else:
+                    print "parallel flashing troops:", troops
+                    states = wnwk.flashhex_parallel(troops, v)
+                    for n in sorted(states):
+                        print "CRC:", n, states[n]
             elif o == "-U":
                 if CHANNELS == None:
-                    wnwk.scan(ADDRESSES)
+                    wnwk.scan(ADDRESSES, cached = True)
                 else:
                     for c in CHANNELS:
                         if VERBOSE:
                             print "\nchan %d:" % c,
                         wnwk.channel(c)
-                        wnwk.scan(ADDRESSES)
+                        wnwk.scan(ADDRESSES, cached = True)
                 ADDRESSES = [n['short_addr'] for n in wnwk.nodes]
                 listeners = []
                 for n in ADDRESSES:
@@ -430,7 +2638,14 @@ def process_command_line():
                     print "skip flashing, no listeners"
                 else:
                     print "broadcast flashing nodes:", listeners
-                    wnwk.flashhex(0xffff,v)
+                    if FOUNTAIN:
+                        wnwk.flashhex_fountain(listeners,v)
+                        print wnwk.nodes
+                    elif WINDOWED:
+                        wnwk.flashhex_multicast(listeners,v)
+                        print wnwk.nodes
+                    else:
+                        wnwk.flashhex(0xffff,v)
                     print "                      \r"\
                         "file: %s, node: 0x%04x, crc: 0x%04x" % \
                         (v, n, int(wnwk.crc()['data'], 16))
@@ -479,10 +2694,32 @@ def process_command_line():
                         if res.get("appname") == "wibo":
                             listeners.append(n)
                 print "Wibo listeners:", listeners
+            elif o == "-Y":
+                for n in ADDRESSES:
+                    res = wnwk.bench_phy(n)
+                    if res == None:
+                        print "WARN host does not support PHY profiles"
+                        break
+                    best = max(res, key = lambda r: r['goodput'])
+                    for r in res:
+                        print "PHY: 0x%04x %-10s %7.1f kbit/s  PER %5.1f%%" % \
+                            (n, r['name'], r['goodput'], r['per'] * 100)
+                    print "BEST: 0x%04x" % n, best['name']
             elif o == "-E":
                 for n in ADDRESSES:
                     wnwk.exit(n)
                     print "EXIT:",n, wnwk.exit(n)
+            elif o == "-I":
+                res = wnwk.isrprof(1)
+                if res['code'] != 'OK':
+                    print "WARN host has no ISR profile", res['data']
+                    continue
+                for s in res['data']:
+                    print "ISR: %-10s n %5d min %5d avg %5d max %5d late %5d" % \
+                        (s['name'], s['n'], s['min'], s['avg'], s['max'],
+                         s['late']), s['hist']
+    if wnwk.nodedb != None:
+        wnwk.nodedb.save()
     wnwk.close()
     return ret
 
@@ -0,0 +1,334 @@
+# $Id$
+"""
+wibo image container
+
+A container holds an image prepared once on the host, so the tools don't
+parse the intel hex text, fill the gaps and compute the CRCs again on
+each run. All numbers are little endian:
+
+    header      IMG_HDR_FMT, see below, IMG_HDR_SIZE bytes
+    page map    nsegs * (address:u32, npages:u16), page aligned segments
+    page CRCs   u16 per page of the map, data_crc() as the node reports it
+    pages       the page data of the map, zlib stream with IMG_FLAG_ZLIB
+    signature   16 bytes AES-CMAC of the staged image with IMG_FLAG_SIGNED
+
+The header has the image name, the boardname and version of the target,
+the flags, the page size, length, CRC and CRC32 of the staged image (gaps
+between the segments are 0xFF up to the last page) and a CRC of itself.
+With IMG_FLAG_DELTA the map has only the pages which differ from the base
+image, base_length and base_crc name the staged base image.
+
+Usage:
+    python wiboimage.py [OPTIONS] FILE
+
+    Options:
+      -o OUT  : pack the intel hex-file FILE into the container OUT,
+                '-' writes OUT as intel hex-file from the container FILE
+      -n NAME : image name, default: basename of FILE
+      -B BOARD: boardname of the target
+      -V VER  : version of the image (16 bit)
+      -P SIZE : page size, default 256
+      -z      : zlib compress the pages
+      -D BASE : store the pages which differ from the image BASE only
+      -h      : show help and exit
+
+    Without -o the header and page map of FILE are shown.
+"""
+import struct, zlib, os, sys, getopt
+
+PAGESIZE = 256 # SPM_PAGESIZE of the nodes
+
+IMG_MAGIC = "WIMG"
+IMG_FORMAT = 1
+# magic, format, flags, pagesize, nsegs, name, board, version,
+# length, crc, crc32, base_length, base_crc, size, hdrcrc
+IMG_HDR_FMT = "<4sBBHH16s16sHLHLLHLH"
+IMG_HDR_SIZE = struct.calcsize(IMG_HDR_FMT)
+IMG_SEG_FMT = "<LH"
+IMG_MAC_SIZE = 16
+
+IMG_FLAG_ZLIB = 0x01 # pages are a zlib stream of size bytes
+IMG_FLAG_DELTA = 0x02 # pages differing from the base image only
+IMG_FLAG_SIGNED = 0x04 # AES-CMAC at the end
+
+class ImageError(Exception):
+    pass
+
+def page_crc(data):
+    """ CRC-CCITT of raw bytes, start value 0, as data_crc() of wibohost """
+    crc = 0
+    for c in bytearray(data):
+        c ^= crc & 0xff
+        c ^= (c << 4) & 0xff
+        crc = ((c << 8) | (crc >> 8)) ^ (c >> 4) ^ (c << 3)
+        crc &= 0xffff
+    return crc
+
+def hex_mem(lines):
+    """ Parse intel hex lines into a dict address -> byte """
+    mem = {}
+    base = 0
+    for ln in lines:
+        ln = ln.strip()
+        if not ln.startswith(':'):
+            continue
+        n, a, typ = int(ln[1:3], 16), int(ln[3:7], 16), int(ln[7:9], 16)
+        if typ == 0:
+            for i in range(n):
+                mem[base + a + i] = int(ln[9+2*i:11+2*i], 16)
+        elif typ == 2:
+            base = int(ln[9:13], 16) << 4
+        elif typ == 4:
+            base = int(ln[9:13], 16) << 16
+        elif typ == 1:
+            break
+    return mem
+
+def mem_pages(mem, pagesize = PAGESIZE):
+    """ Page aligned segments of a dict address -> byte, gaps inside a
+        page are padded with 0xFF. Returns a list of (address, bytearray).
+    """
+    segs = []
+    for p in sorted(set([a - a % pagesize for a in mem])):
+        page = bytearray([mem.get(a, 0xff) for a in range(p, p + pagesize)])
+        if segs and segs[-1][0] + len(segs[-1][1]) == p:
+            segs[-1][1].extend(page)
+        else:
+            segs.append((p, page))
+    return segs
+
+def staged_data(segs):
+    """ The segments as the node stages them, gaps filled with 0xFF """
+    data, pos = bytearray(), 0
+    for a, d in segs:
+        data.extend('\xff' * (a - pos))
+        data.extend(d)
+        pos = a + len(d)
+    return data
+
+def seg_pages(segs, pagesize = PAGESIZE):
+    """ The pages of page aligned segments as (address, bytearray) """
+    return [(p, d[p - a:p - a + pagesize])
+            for a, d in segs for p in range(a, a + len(d), pagesize)]
+
+def pages_segs(pages):
+    """ Merge (address, page) pairs in order into segments """
+    segs = []
+    for p, d in pages:
+        if segs and segs[-1][0] + len(segs[-1][1]) == p:
+            segs[-1][1].extend(d)
+        else:
+            segs.append((p, bytearray(d)))
+    return segs
+
+def is_image(fname):
+    """ True if fname is a container, not an intel hex-file """
+    f = open(fname, 'rb')
+    magic = f.read(len(IMG_MAGIC))
+    f.close()
+    return magic == IMG_MAGIC
+
+def write_image(fname, segs, name = "", board = "", version = 0,
+                pagesize = PAGESIZE, compress = False, mac = None, base = None):
+    """ Write the page aligned segments segs as container. With base, the
+        segments of the image installed on the node, only the pages which
+        differ are stored. mac is the AES-CMAC of the staged image (16
+        bytes string) or None. Returns the header as dict.
+    """
+    data = staged_data(segs)
+    flags = 0
+    base_length, base_crc = 0, 0
+    pages = sorted(seg_pages(segs, pagesize))
+    if base != None:
+        old = dict(seg_pages(base, pagesize))
+        new = dict(pages)
+        # base pages the new image does not have are erased
+        erased = bytearray('\xff' * pagesize)
+        for p, d in old.items():
+            if p not in new and p < len(data) and d != erased:
+                pages.append((p, erased))
+        pages = sorted([(p, d) for p, d in pages if old.get(p) != d])
+        based = staged_data(base)
+        base_length, base_crc = len(based), page_crc(based)
+        flags |= IMG_FLAG_DELTA
+    segs = pages_segs(pages)
+    body = str(bytearray().join([d for p, d in pages]))
+    if compress:
+        body = zlib.compress(body, 9)
+        flags |= IMG_FLAG_ZLIB
+    if mac != None:
+        if len(mac) != IMG_MAC_SIZE:
+            raise ImageError("signature needs %d bytes" % IMG_MAC_SIZE)
+        flags |= IMG_FLAG_SIGNED
+    hdr = [IMG_MAGIC, IMG_FORMAT, flags, pagesize, len(segs), name[:16],
+           board[:16], version, len(data), page_crc(data),
+           zlib.crc32(str(data)) & 0xffffffff, base_length, base_crc,
+           len(body)]
+    raw = struct.pack(IMG_HDR_FMT[:-1], *hdr)
+    f = open(fname, 'wb')
+    f.write(raw + struct.pack('<H', page_crc(raw)))
+    for a, d in segs:
+        f.write(struct.pack(IMG_SEG_FMT, a, len(d) / pagesize))
+    f.write(struct.pack('<%dH' % len(pages), *[page_crc(d) for p, d in pages]))
+    f.write(body)
+    if mac != None:
+        f.write(mac)
+    f.close()
+    return read_header(fname)
+
+def read_header(fname):
+    """ Header, page map and page CRCs of a container as dict, the pages
+        are not read. crcs maps page addresses to data_crc().
+    """
+    f = open(fname, 'rb')
+    raw = f.read(IMG_HDR_SIZE)
+    if len(raw) != IMG_HDR_SIZE or not raw.startswith(IMG_MAGIC):
+        raise ImageError("not an image container: %s" % fname)
+    v = struct.unpack(IMG_HDR_FMT, raw)
+    if page_crc(raw[:-2]) != v[-1]:
+        raise ImageError("header CRC mismatch: %s" % fname)
+    if v[1] != IMG_FORMAT:
+        raise ImageError("container format %d not supported: %s" % (v[1], fname))
+    img = dict(zip(("flags", "pagesize", "nsegs", "name", "board", "version",
+                    "length", "crc", "crc32", "base_length", "base_crc",
+                    "size"), v[2:-1]))
+    img["name"] = img["name"].rstrip('\0')
+    img["board"] = img["board"].rstrip('\0')
+    segsize = struct.calcsize(IMG_SEG_FMT)
+    raw = f.read(img["nsegs"] * segsize)
+    img["map"] = [struct.unpack(IMG_SEG_FMT, raw[i:i + segsize])
+                  for i in range(0, len(raw), segsize)]
+    addrs = [a + i * img["pagesize"] for a, n in img["map"] for i in range(n)]
+    raw = f.read(2 * len(addrs))
+    img["crcs"] = dict(zip(addrs, struct.unpack('<%dH' % len(addrs), raw)))
+    img["offset"] = f.tell()
+    f.close()
+    return img
+
+def read_image(fname, base = None):
+    """ Read a container, returns the header dict with the page aligned
+        segments in "segs" and the signature in "mac" (None if unsigned).
+        A delta container is merged onto base, the segments of the base
+        image; without base "segs" are the changed pages only. Page,
+        image and base CRCs are checked, raises ImageError.
+    """
+    img = read_header(fname)
+    f = open(fname, 'rb')
+    f.seek(img["offset"])
+    body = f.read(img["size"])
+    mac = f.read(IMG_MAC_SIZE)
+    f.close()
+    if img["flags"] & IMG_FLAG_ZLIB:
+        body = zlib.decompress(body)
+    ps = img["pagesize"]
+    pages = []
+    for i, p in enumerate(sorted(img["crcs"])):
+        d = bytearray(body[i * ps:(i + 1) * ps])
+        if len(d) != ps or page_crc(d) != img["crcs"][p]:
+            raise ImageError("page 0x%05x damaged: %s" % (p, fname))
+        pages.append((p, d))
+    img["mac"] = (img["flags"] & IMG_FLAG_SIGNED) and mac or None
+    if img["flags"] & IMG_FLAG_DELTA:
+        if base == None:
+            img["segs"] = pages_segs(pages)
+            return img
+        based = staged_data(base)
+        if (len(based), page_crc(based)) != (img["base_length"], img["base_crc"]):
+            raise ImageError("base image does not match: %s" % fname)
+        new = dict(seg_pages(base, ps))
+        new.update(dict(pages))
+        # base pages beyond the end of the new image are left out
+        pages = [(p, d) for p, d in sorted(new.items()) if p < img["length"]]
+    img["segs"] = pages_segs(pages)
+    data = staged_data(img["segs"])
+    if (len(data), page_crc(data)) != (img["length"], img["crc"]):
+        raise ImageError("image CRC mismatch: %s" % fname)
+    return img
+
+def image_hexlines(segs, chunk = 16):
+    """ Intel hex lines of page aligned segments, with extended linear
+        address records where the upper 16 bits change, ends with the
+        end record
+    """
+    lines, upper = [], 0
+    for a, d in segs:
+        for i in range(0, len(d), chunk):
+            addr = a + i
+            if addr >> 16 != upper:
+                upper = addr >> 16
+                lines.append(hex_record(4, 0, struct.pack('>H', upper)))
+            lines.append(hex_record(0, addr & 0xffff, str(d[i:i + chunk])))
+    lines.append(":00000001FF")
+    return lines
+
+def hex_record(rtype, addr, data):
+    rec = struct.pack('>BHB', len(data), addr, rtype) + data
+    cs = (-sum(bytearray(rec))) & 0xff
+    return ':' + rec.encode('hex').upper() + '%02X' % cs
+
+def print_header(img):
+    print "name:     %s" % img["name"]
+    print "board:    %s" % img["board"]
+    print "version:  %d" % img["version"]
+    print "flags:    0x%02x%s%s%s" % (img["flags"],
+        img["flags"] & IMG_FLAG_ZLIB and " zlib" or "",
+        img["flags"] & IMG_FLAG_DELTA and " delta" or "",
+        img["flags"] & IMG_FLAG_SIGNED and " signed" or "")
+    print "image:    %d bytes, crc: 0x%04x, crc32: 0x%08x" % \
+        (img["length"], img["crc"], img["crc32"])
+    if img["flags"] & IMG_FLAG_DELTA:
+        print "base:     %d bytes, crc: 0x%04x" % (img["base_length"], img["base_crc"])
+    print "pages:    %d of %d bytes, %d bytes stored" % \
+        (len(img["crcs"]), img["pagesize"], img["size"])
+    for a, n in img["map"]:
+        print "  0x%05x..0x%05x %d pages" % (a, a + n * img["pagesize"], n)
+
+if __name__ == "__main__":
+    out, name, board, version, pagesize = None, None, "", 0, PAGESIZE
+    compress, base = False, None
+    try:
+        opts, args = getopt.getopt(sys.argv[1:], "o:n:B:V:P:zD:h")
+        for o, v in opts:
+            if o == "-o":
+                out = v
+            elif o == "-n":
+                name = v
+            elif o == "-B":
+                board = v
+            elif o == "-V":
+                version = int(v, 0)
+            elif o == "-P":
+                pagesize = int(v, 0)
+            elif o == "-z":
+                compress = True
+            elif o == "-D":
+                base = v
+            elif o == "-h":
+                print __doc__
+                sys.exit(0)
+        if len(args) != 1:
+            raise getopt.GetoptError("need one FILE")
+    except (getopt.GetoptError, ValueError), e:
+        print e
+        print __doc__
+        sys.exit(1)
+    fname = args[0]
+    try:
+        if out == None:
+            print_header(read_header(fname))
+        elif out == "-":
+            print "\n".join(image_hexlines(read_image(fname)["segs"]))
+        else:
+            segs = mem_pages(hex_mem(open(fname)), pagesize)
+            if base != None:
+                if is_image(base):
+                    base = read_image(base)["segs"]
+                else:
+                    base = mem_pages(hex_mem(open(base)), pagesize)
+            if name == None:
+                name = os.path.splitext(os.path.basename(fname))[0]
+            print_header(write_image(out, segs, name, board, version,
+                                     pagesize, compress, None, base))
+    except (ImageError, IOError), e:
+        print "ERROR:", e
+        sys.exit(1)
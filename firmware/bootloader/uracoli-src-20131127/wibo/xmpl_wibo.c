@@ -33,6 +33,8 @@
  * It blinks a LED so that you can see the success of your
  * wireless bootloading process. Additionally it receives the
  * command to jump back into bootloader.
+ * Built with WIBOAPP, updates are received in the background,
+ * see wiboapp.h.
  *
  * @author Daniel Thiele
  *         Dietzsch und Thiele PartG
@@ -52,6 +54,10 @@
 #include <radio.h>
 #include <timer.h>
 #include <p2p_protocol.h>
+#include <p2p.h>
+#if defined(WIBOAPP)
+#include "wiboapp.h"
+#endif
 
 
 #define _SW_VERSION_ (0x10)
@@ -83,6 +89,12 @@ void usr_radio_irq(uint8_t cause)
 uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi,
         int8_t ed, uint8_t crc_fail)
 {
+#if defined(WIBOAPP)
+    if (crc_fail || wiboapp_receive_frame(len, frm))
+    {
+        return frm;
+    }
+#endif
     switch( ((p2p_hdr_t*)frm)->cmd)
     {
 
@@ -118,6 +130,9 @@ uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi,
 
 void usr_radio_tx_done(radio_tx_done_t status)
 {
+#if defined(WIBOAPP_RELAY)
+    wiboapp_tx_done(status);
+#endif
     if (TX_OK == status) {
     } else {
         /* TODO handle error */
@@ -133,6 +148,14 @@ time_t led_toggle(timer_arg_t t)
 	return MSEC(BLINKPERIOD_MS);
 }
 
+#if defined(WIBOAPP) && defined(P2P_MESH)
+time_t mesh_tick(timer_arg_t t)
+{
+	p2p_mesh_tick();
+	return MSEC(1000);
+}
+#endif
+
 int main()
 {
 #if defined(NODECONFIG_STATIC)
@@ -141,10 +164,14 @@ int main()
 	nodeconfig.pan_id = 0x01;
 	nodeconfig.short_addr = 0x05;
 #elif BOARD_TYPE == BOARD_PINOCCIO
-	nodeconfig.channel = eeprom_read_byte((uint8_t *)8179);
-	nodeconfig.pan_id = eeprom_read_word((uint16_t *)8180);
-	nodeconfig.short_addr = eeprom_read_word((uint16_t *)8182);
-	nodeconfig.ieee_addr = 0;
+	if (get_node_config_handoff(&nodeconfig) != 0)
+	{
+		/* bootloader without the record, read the EEPROM map */
+		nodeconfig.channel = eeprom_read_byte((uint8_t *)8179);
+		nodeconfig.pan_id = eeprom_read_word((uint16_t *)8180);
+		nodeconfig.short_addr = eeprom_read_word((uint16_t *)8182);
+		nodeconfig.ieee_addr = 0;
+	}
 #else
 	get_node_config(&nodeconfig);
 #endif
@@ -154,6 +181,9 @@ int main()
 
     pingrep.hdr.pan = nodeconfig.pan_id;
     pingrep.hdr.src = nodeconfig.short_addr;
+#if defined(WIBOAPP)
+    wiboapp_init(nodeconfig.pan_id, nodeconfig.short_addr);
+#endif
 
     radio_init(rxbuf, 128);
 
@@ -167,10 +197,19 @@ int main()
 
     timer_init();
     thdl = timer_start(led_toggle, MSEC(BLINKPERIOD_MS), 0);
+#if defined(WIBOAPP) && defined(P2P_MESH)
+    timer_start(mesh_tick, MSEC(1000), 0);
+#endif
+#if defined(WIBOAPP) && defined(WIBOAPP_PHY)
+    wiboapp_phy_init();
+#endif
 
     set_sleep_mode(SLEEP_MODE_IDLE);
     for(;;)
     {
+#if defined(WIBOAPP)
+        wiboapp_task();
+#endif
         sleep_mode();
     }
 }
@@ -337,6 +337,9 @@ $(BINDIR):
 
 TARGETS=$(OBJDIR) $(BINDIR) __xmpl_wibo__
 SOURCES = $(PROJECT).c
+ifneq ($(wiboapp),)
+    SOURCES += wiboapp.c
+endif
 INCDIRS = . $(URACOLIDIR)/inc
 LIBDIRS = $(URACOLIDIR)/lib
 # DBGFMT=stabs for Linux
@@ -355,6 +358,18 @@ CCFLAGS += -D$(BOARD) -DF_CPU=$(F_CPU)
 ifneq ($(baudrate),)
     CCFLAGS += -DHIF_DEFAULT_BAUDRATE=$(baudrate)
 endif
+ifneq ($(wiboapp),)
+    CCFLAGS += -DWIBOAPP
+endif
+ifneq ($(mesh),)
+    CCFLAGS += -DP2P_MESH
+endif
+ifneq ($(relay),)
+    CCFLAGS += -DWIBOAPP_RELAY
+endif
+ifneq ($(phy),)
+    CCFLAGS += -DWIBOAPP_PHY
+endif
 CCFLAGS += -I$(URACOLIDIR)/inc -I.
 LDFLAGS = $(patsubst %,-L%,$(LIBDIRS)) -luracoli_$(BOARD)
 
@@ -37,6 +37,7 @@ sterm.py - uracoli serial terminal application
 
 Usage:
  python sterm.py [OPTIONS]
+ python sterm.py -n [-p PORT [-p PORT2]] [HEADLESS OPTIONS]
 
 Options:
  -h, --help
@@ -47,6 +48,29 @@ Options:
     load config file, default value "sterm.cfg"
     if FILE is not existing, an annotated version
     is generated and the tool is exited.
+
+Headless Options:
+ -n, --nogui
+    run without GUI, the received data is written to stdout
+    unless -L or -T is given. Stop with Ctrl-C.
+ -p PORT, --port PORT
+    serial port, the first one sends, a second one receives
+    (the other end of a wuart link). Without -p the serial devices
+    of the config file are used.
+ -b BAUD, --baudrate BAUD
+    baudrate for the ports given with -p, default 38400
+ -L FILE, --log FILE
+    write the received data to FILE, each block with a timestamp
+ -R FILE, --replay FILE
+    send the received data of a log FILE with its original timing
+ -T SEC, --test SEC
+    send test blocks for SEC seconds and report throughput, latency
+    and lost blocks every second. With one port the far end needs
+    to loop the data back.
+ -s SIZE, --size SIZE
+    size of a test block in bytes, default 64
+ -r RATE, --rate RATE
+    limit the test send rate to RATE bytes/s, default: line speed
 """
 CFG_TEMPLATE = """
 [CONFIG]
@@ -85,11 +109,19 @@ function = usr_func
 """
 
 # === Imports ==================================================================
-from Tkinter import *
-from ScrolledText import ScrolledText
-from FileDialog import FileDialog
+try:
+    from Tkinter import *
+    from ScrolledText import ScrolledText
+    from FileDialog import FileDialog
+except ImportError:
+    # headless mode works without Tk
+    Frame = object
 from ConfigParser import ConfigParser
-import sys, threading, time, Queue, pprint, serial, re, getopt, os, traceback
+import sys, threading, time, Queue, pprint, re, getopt, os, traceback, struct
+try:
+    import serial
+except ImportError:
+    serial = None
 
 # === some debug helpers =======================================================
 import pprint
@@ -104,7 +136,14 @@ except:
 # === Globals ==================================================================
 FRAMEBORDER = {"relief":"groove", 'border':1}
 FRAMEBORDER1 = {"relief":"ridge", 'border':3}
-VERSION = "0.1"
+VERSION = "0.2"
+
+# binary log: file header, then per block (time, port, length) and the data
+LOG_MAGIC = "STERMLOG\x01"
+LOG_REC = struct.Struct("<dBH")
+# test block: marker, sequence number, send time, block length
+TEST_MARKER = 0xa5
+TEST_HDR = struct.Struct("<BIdH")
 
 # === Classes ==================================================================
 
@@ -198,9 +237,123 @@ class SerialIo(FifoIo):
             x = ""
         return x
 
+    def read_nb(self, maxlen = 4096):
+        """ non blocking bulk read of everything, that is waiting """
+        n = self.sport.inWaiting()
+        if n == 0:
+            return ""
+        return self.sport.read(min(n, maxlen))
+
     def __str__(self):
         return "%s@%s:%s" % (self.name, self.sport.port, self.sport.baudrate)
 
+##
+# @brief Throughput and latency measurement over a serial link
+#
+# The sender writes numbered blocks with a send timestamp, the
+# receiver checks their payload and computes the latency against
+# the same host clock.
+#
+class LinkTest:
+    def __init__(self, size = 64, rate = None):
+        self.size = max(size, TEST_HDR.size + 1)
+        self.rate = rate
+        self.seq = 0
+        self.rxbuf = ""
+        self.nextseq = 0
+        self.tstart = time.time()
+        self.reset_interval()
+        self.total = {"tx" : 0, "rx" : 0, "lost" : 0, "bad" : 0, "blocks" : 0}
+        self.lat_all = [None, None, 0.0]
+        self.tlastrx = self.tstart
+
+    def reset_interval(self):
+        self.txbytes = 0
+        self.rxbytes = 0
+        self.lost = 0
+        self.bad = 0
+        self.latency = []
+
+    def payload(self, seq, n):
+        return "".join([chr((seq + i) & 0xff) for i in range(n)])
+
+    def next_block(self, now):
+        if self.rate:
+            if self.total["tx"] > self.rate * (now - self.tstart):
+                return ""
+        plen = self.size - TEST_HDR.size
+        blk = TEST_HDR.pack(TEST_MARKER, self.seq, now, self.size)
+        blk += self.payload(self.seq, plen)
+        self.seq += 1
+        self.txbytes += len(blk)
+        self.total["tx"] += len(blk)
+        return blk
+
+    def receive(self, data, now):
+        self.rxbytes += len(data)
+        self.total["rx"] += len(data)
+        self.rxbuf += data
+        while len(self.rxbuf) >= TEST_HDR.size:
+            if ord(self.rxbuf[0]) != TEST_MARKER:
+                # resync on the next marker
+                i = self.rxbuf.find(chr(TEST_MARKER), 1)
+                self.bad += 1
+                self.rxbuf = self.rxbuf[i:] if i > 0 else ""
+                continue
+            mark, seq, tsend, blen = TEST_HDR.unpack(self.rxbuf[:TEST_HDR.size])
+            if blen != self.size:
+                self.bad += 1
+                self.rxbuf = self.rxbuf[1:]
+                continue
+            if len(self.rxbuf) < blen:
+                break
+            plen = blen - TEST_HDR.size
+            if self.rxbuf[TEST_HDR.size:blen] != self.payload(seq, plen):
+                self.bad += 1
+                self.rxbuf = self.rxbuf[1:]
+                continue
+            self.rxbuf = self.rxbuf[blen:]
+            if seq > self.nextseq:
+                self.lost += seq - self.nextseq
+            self.nextseq = seq + 1
+            self.latency.append(now - tsend)
+            self.total["blocks"] += 1
+            self.tlastrx = now
+
+    def done(self):
+        return self.nextseq == self.seq
+
+    def report(self, dt, final = False):
+        for k in ("lost", "bad"):
+            self.total[k] += getattr(self, k)
+        lat = self.latency
+        if len(lat):
+            lmin, lmax, lavg = min(lat), max(lat), sum(lat) / len(lat)
+            if self.lat_all[0] is None or lmin < self.lat_all[0]:
+                self.lat_all[0] = lmin
+            if self.lat_all[1] is None or lmax > self.lat_all[1]:
+                self.lat_all[1] = lmax
+            self.lat_all[2] += sum(lat)
+            latstr = "lat min/avg/max %.1f/%.1f/%.1f ms" % \
+                    (lmin * 1e3, lavg * 1e3, lmax * 1e3)
+        else:
+            latstr = "lat -"
+        print "tx %7.0f B/s rx %7.0f B/s lost %d bad %d %s" % \
+                (self.txbytes / dt, self.rxbytes / dt, self.lost, self.bad, latstr)
+        self.reset_interval()
+
+    def summary(self):
+        t = self.total
+        dt = max(self.tlastrx - self.tstart, 1e-3)
+        print "=== %.1f s: sent %d B (%d blocks), received %d B (%d blocks)" % \
+                (dt, t["tx"], self.seq, t["rx"], t["blocks"])
+        print "=== throughput %.0f B/s, lost %d, bad %d" % \
+                (t["rx"] / dt, t["lost"], t["bad"])
+        if t["blocks"]:
+            print "=== latency min/avg/max %.1f/%.1f/%.1f ms" % \
+                    (self.lat_all[0] * 1e3, self.lat_all[2] / t["blocks"] * 1e3,
+                     self.lat_all[1] * 1e3)
+
 ##
 # terminal windows class
 #
@@ -593,6 +746,107 @@ def configure_devices(cfg):
             exec("global %s; %s = dev" % (dev_varname,dev_varname))
     return ret
 
+def headless_log_write(logf, port, data, now):
+    logf.write(LOG_REC.pack(now, port, len(data)))
+    logf.write(data)
+
+def headless_log_read(fname):
+    """ generator for the (time, port, data) records of a log file """
+    f = open(fname, "rb")
+    if f.read(len(LOG_MAGIC)) != LOG_MAGIC:
+        raise Exception("%s is not a sterm log file" % fname)
+    while 1:
+        h = f.read(LOG_REC.size)
+        if len(h) < LOG_REC.size:
+            break
+        t, port, n = LOG_REC.unpack(h)
+        yield t, port, f.read(n)
+    f.close()
+
+##
+# run without GUI: dump, log, replay or test the link
+#
+def headless_run(devs, logname = None, replay = None, testtime = None,
+                 size = 64, rate = None):
+    for d in devs:
+        d.sport.timeout = 0
+        d.connect()
+    txdev, rxdevs = devs[0], devs[-1:]
+    if len(devs) > 1 and testtime is None:
+        # without test, all ports are received
+        rxdevs = devs
+    logf = None
+    if logname:
+        logf = open(logname, "wb")
+        logf.write(LOG_MAGIC)
+    test = LinkTest(size, rate) if testtime else None
+    records = headless_log_read(replay) if replay else None
+    t0 = tlast = time.time()
+    tdelta = None
+    tnext = None
+    tend = None
+    try:
+        while 1:
+            idle = True
+            now = time.time()
+            if test:
+                if now - t0 < testtime:
+                    # keep the OS buffer short, so that latency is not
+                    # dominated by the local send queue
+                    if txdev.sport.outWaiting() < test.size:
+                        blk = test.next_block(now)
+                        if blk:
+                            txdev.write(blk)
+                            idle = False
+                elif test.done() or now - t0 > testtime + 2:
+                    # wait up to 2 s for the blocks on the way
+                    break
+            if records:
+                if tnext is None:
+                    try:
+                        trec, port, tnext = records.next()
+                    except StopIteration:
+                        records = None
+                        print "=== replay done"
+                        if not test:
+                            # collect the answers for one more second
+                            tend = now + 1.0
+                    else:
+                        if tdelta is None:
+                            tdelta = now - trec
+                        tsend = trec + tdelta
+                if tnext is not None and now >= tsend:
+                    txdev.write(tnext)
+                    tnext = None
+                    idle = False
+            for i, d in enumerate(rxdevs):
+                x = d.read_nb()
+                if not x:
+                    continue
+                idle = False
+                if logf:
+                    headless_log_write(logf, i, x, now)
+                if test:
+                    test.receive(x, now)
+                elif not logf:
+                    sys.stdout.write(x)
+                    sys.stdout.flush()
+            if test and now - tlast >= 1.0:
+                test.report(now - tlast)
+                tlast = now
+            if tend and now > tend:
+                break
+            if idle:
+                time.sleep(0.001)
+    except KeyboardInterrupt:
+        pass
+    if test:
+        test.summary()
+    if logf:
+        logf.close()
+    for d in devs:
+        d.disconnect()
+
 # example user function that can be assigned with a macro
 # the tuple args contains the device dictionary
 def usr_func(*args):
@@ -601,9 +855,16 @@ def usr_func(*args):
         d.write("Hello, my name is %s [%s]" % (k, d) )
 
 if __name__ == "__main__":
-    opts, args = getopt.getopt(sys.argv[1:],"hvc:",["help","version", "config="])
+    opts, args = getopt.getopt(sys.argv[1:],"hvc:np:b:L:R:T:s:r:",
+                               ["help","version", "config=", "nogui", "port=",
+                                "baudrate=", "log=", "replay=", "test=",
+                                "size=", "rate="])
     do_exit = False
     CFGFILE = "sterm.cfg"
+    NOGUI = False
+    PORTS = []
+    BAUDRATE = 38400
+    HLARGS = {}
     for o,v in opts:
         if o in ('-h','--help'):
             print __doc__
@@ -611,8 +872,33 @@ if __name__ == "__main__":
         elif o in ('-v','--version'):
             print "sterm V%s" % VERSION
             do_exit = True
-        elif o in ('-c',):
+        elif o in ('-c', '--config'):
             CFGFILE = v
+        elif o in ('-n', '--nogui'):
+            NOGUI = True
+        elif o in ('-p', '--port'):
+            PORTS.append(v)
+        elif o in ('-b', '--baudrate'):
+            BAUDRATE = int(v)
+        elif o in ('-L', '--log'):
+            HLARGS['logname'] = v
+        elif o in ('-R', '--replay'):
+            HLARGS['replay'] = v
+        elif o in ('-T', '--test'):
+            HLARGS['testtime'] = float(v)
+        elif o in ('-s', '--size'):
+            HLARGS['size'] = int(v)
+        elif o in ('-r', '--rate'):
+            HLARGS['rate'] = float(v)
+
+    if NOGUI and PORTS and not do_exit:
+        devs = []
+        for i, p in enumerate(PORTS):
+            d = SerialIo("port%d" % i)
+            d.configure({'port' : p, 'baudrate' : BAUDRATE})
+            devs.append(d)
+        headless_run(devs, **HLARGS)
+        sys.exit(0)
 
     if not os.path.exists(CFGFILE):
         print "create file %s" % os.path.abspath(CFGFILE)
@@ -643,5 +929,13 @@ if __name__ == "__main__":
 
 
     DEVICES = configure_devices(CFGDATA)
+    if NOGUI:
+        devs = [DEVICES[d] for d in CFGDATA.get("CONFIG","devices").split()
+                if isinstance(DEVICES.get(d), SerialIo)]
+        if not devs:
+            print "no serial device configured"
+            sys.exit(1)
+        headless_run(devs, **HLARGS)
+        sys.exit(0)
     sterm_init(CFGDATA)
     root.mainloop()
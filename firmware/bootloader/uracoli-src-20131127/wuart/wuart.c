@@ -46,6 +46,10 @@
 #include "wuart.h"
 /* === Macros ======================================== */
 #define SW_VERSION (0x03)
+#define RX_RING_MASK (WUART_RX_RING_SIZE - 1)
+#if (WUART_RX_RING_SIZE & RX_RING_MASK)
+# error "WUART_RX_RING_SIZE needs to be a power of 2"
+#endif
 /* === Types ========================================= */
 
 
@@ -57,12 +61,48 @@ const node_config_t PROGMEM nc_flash = { .short_addr = 0xFECA,
                                  };
 node_config_t NodeConfig;
 
-volatile uint8_t RxbufIdx = 0;
-static wuart_buffer_t RxBuf[2];
-
-static uint16_t PeerAddress;
-static wuart_buffer_t TxBuf;
+/** baud rates, selectable by WUART_MODE_BAUD_MASK */
+static const uint32_t PROGMEM baudrates[] = {
+    9600, 19200, 38400, 57600, 115200, 230400, 250000, 500000, 1000000
+};
+#define BAUDRATE_COUNT (sizeof(baudrates) / sizeof(baudrates[0]))
+/** currently used HIF baud rate */
+static uint32_t Baudrate;
+
+/** UART input, that is not yet taken into a TX buffer */
+static uint8_t RxRing[WUART_RX_RING_SIZE];
+static uint16_t RxRingHead, RxRingTail;
+
+/** frame buffers, the radio receives into RxFrame, the others are RX
+ *  buffers of the peers */
+static wuart_buffer_t RxBuf[WUART_NSLOTS + 1];
+static wuart_buffer_t * volatile RxFrame;
+
+/** the p2p peer or the remotes of the star central */
+static wuart_peer_t Peers[WUART_NSLOTS];
+/** number of used entries in Peers */
+static uint8_t NPeers;
+/** the node is a star central */
+static bool Star;
+/** the UART fills the buffer of Peers[TxPeer] */
+static uint8_t TxPeer;
+/** Peers[TxPeer] follows, once its partial frame is handed over */
+static uint8_t TxPeerNext;
+/** Peers[TxSlot] is on air, or was the last one */
+static uint8_t TxSlot;
+/** a buffer of Peers[TxSlot] is on air */
+static volatile bool TxSending;
 volatile bool TxPending;
+/** ACK requested data frames with TX_ARET retries */
+static bool Reliable;
+/** star central: a DLE was read from the HIF */
+static bool HifInDle;
+/** star central: the remote of the last data written to the HIF */
+static uint8_t HifOutPeer;
+/** ACKs are held back until the received data is drained */
+static volatile bool RxAckOff;
+/** idle time in timer ticks, after which a partial frame is sent */
+static int8_t AggrTicks;
 
 volatile wuart_state_t WuartState;
 volatile int16_t EscapeTmoCounter;
@@ -88,18 +128,28 @@ static const p2p_ping_cnf_t PROGMEM pingrep = {
 static void wuart_init(void)
 {
 char cfg_location = '?';
+uint8_t i;
 
     /* setup peripherals */
     LED_INIT();
     LED_SET_VALUE(0);
     KEY_INIT();
-    hif_init(HIF_DEFAULT_BAUDRATE);
     TIMER_INIT();
 
     /* get configuration data */
 
+#if defined(NODE_CONFIG_HANDOFF)
+    /* record the bootloader read already */
+    if (get_node_config_handoff(&NodeConfig) == 0)
+    {
+        cfg_location = 'H';
+    }
+    /* 1st trial: read from internal EEPROM */
+    else if (get_node_config_eeprom(&NodeConfig, 0) == 0)
+#else
     /* 1st trial: read from internal EEPROM */
     if (get_node_config_eeprom(&NodeConfig, 0) == 0)
+#endif
     {
         /* using EEPROM config */;
         cfg_location = 'E';
@@ -118,6 +168,17 @@ char cfg_location = '?';
         cfg_location = 'D';
     }
 
+    Baudrate = wuart_baudrate(&NodeConfig);
+#if !defined(NO_KEYS)
+    if (KEY_GET() != 0)
+    {
+        /* rescue from a baud rate, that the host can not use */
+        Baudrate = HIF_DEFAULT_BAUDRATE;
+    }
+#endif
+    hif_init(Baudrate);
+    RxRingHead = RxRingTail = 0;
+
     if (((1UL<<NodeConfig.channel) & TRX_SUPPORTED_CHANNELS) == 0)
     {
         /* fall back to DEFAULT_CHANNEL,*/
@@ -127,18 +188,23 @@ char cfg_location = '?';
 
     }
 
-    RxbufIdx = 0;
     memset(RxBuf, 0, sizeof(RxBuf));
-    memset(&TxBuf, 0, sizeof(TxBuf));
+    memset(Peers, 0, sizeof(Peers));
+    RxFrame = &RxBuf[0];
+    for (i = 0; i < WUART_NSLOTS; i++)
+    {
+        Peers[i].rx = &RxBuf[i + 1];
+    }
 
     /* radio setup */
-    radio_init(RxBuf[RxbufIdx].data.buf, UART_FRAME_SIZE);
+    radio_init(RxFrame->data.buf, UART_FRAME_SIZE);
     configure_radio();
+    pm_set_active(PM_HIF | PM_TIMER | PM_RADIO);
     sei();
 
-    PRINTF("Wuart %d.%d chan=%d radio %02x.%02x cfg %c"EOL,
+    PRINTF("Wuart %d.%d chan=%d baud=%lu radio %02x.%02x cfg %c"EOL,
             (SW_VERSION >> 4), (SW_VERSION &0x0f),
-            NodeConfig.channel,
+            NodeConfig.channel, Baudrate,
             trx_reg_read(RG_PART_NUM),
             trx_reg_read(RG_VERSION_NUM),
             cfg_location);
@@ -156,28 +222,276 @@ char cfg_location = '?';
     }
 }
 
-static void configure_radio(void)
+/**
+ * Return the aggregation time of a node config in character times.
+ */
+static uint8_t aggr_chars(node_config_t *nc)
+{
+uint8_t n;
+
+    n = NC_AGGR_CHARS(nc);
+    return (n == 0 || n == 0xff) ? WUART_AGGR_CHARS : n;
+}
+
+/**
+ * Return true if a node config selects the reliable mode.
+ */
+static bool wuart_reliable(node_config_t *nc)
+{
+    return (NC_MODE(nc) != 0xff) && (NC_MODE(nc) & WUART_MODE_RELIABLE);
+}
+
+/**
+ * Return true if a node config selects the low power receive mode.
+ */
+static bool wuart_rpc(node_config_t *nc)
+{
+    return (NC_MODE(nc) != 0xff) && (NC_MODE(nc) & WUART_MODE_RPC);
+}
+
+/**
+ * Return true if a node config selects the star mode.
+ */
+static bool wuart_star(node_config_t *nc)
+{
+    return (NC_MODE(nc) != 0xff) && (NC_MODE(nc) & WUART_MODE_STAR);
+}
+
+/**
+ * Return true if a node config makes the node a star central.
+ */
+static bool wuart_central(node_config_t *nc)
+{
+    return (WUART_STAR_PEERS > 0) && wuart_star(nc) &&
+           ((nc->short_addr & WUART_STAR_MASK) == 0) &&
+           (nc->short_addr != 0xffff);
+}
+
+/**
+ * Return the peer address of a p2p wuart or a star remote,
+ * the address of the first remote for the star central.
+ */
+static uint16_t wuart_peer_address(node_config_t *nc)
+{
+    if (wuart_central(nc))
+    {
+        return nc->short_addr + 1;
+    }
+    if (wuart_star(nc) && (nc->short_addr != 0xffff) &&
+        (nc->short_addr & WUART_STAR_MASK))
+    {
+        return nc->short_addr & ~WUART_STAR_MASK;
+    }
+    return CALC_PEER_ADDRESS(nc->short_addr);
+}
+
+/**
+ * Return the slot in Peers of a source address, NPeers if it is none.
+ */
+static inline uint8_t wuart_slot(uint16_t src)
 {
+uint8_t slot;
 
+    if (Star == false)
+    {
+        return 0;
+    }
+    if ((src & ~WUART_STAR_MASK) != NodeConfig.short_addr)
+    {
+        return NPeers;
+    }
+    /* the central itself wraps to 0xff */
+    slot = (src & WUART_STAR_MASK) - 1;
+    return (slot < NPeers) ? slot : NPeers;
+}
+
+/**
+ * Take a character of the star central from the HIF.
+ *
+ * @return true if it is data, false if it is part of a remote select
+ */
+static bool star_hif_input(uint8_t c)
+{
+    if (HifInDle)
+    {
+        HifInDle = false;
+        if (c == WUART_STAR_DLE)
+        {
+            return true;
+        }
+        c -= '1';
+        if (c < NPeers)
+        {
+            TxPeerNext = c;
+        }
+        return false;
+    }
+    if (c == WUART_STAR_DLE)
+    {
+        HifInDle = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write the received data of a peer to the HIF.
+ */
+static void rx_drain(uint8_t slot)
+{
+wuart_buffer_t *prx = Peers[slot].rx;
+uint8_t c;
+
+    if (prx->end == 0)
+    {
+        return;
+    }
+    if (Star && (HifOutPeer != slot))
+    {
+        hif_putc(WUART_STAR_DLE);
+        hif_putc('1' + slot);
+        HifOutPeer = slot;
+    }
+    while(prx->start <= prx->end)
+    {
+        c = prx->data.buf[prx->start++];
+        if (Star && (c == WUART_STAR_DLE))
+        {
+            hif_putc(c);
+        }
+        hif_putc(c);
+        rx_ring_fill();
+    }
     cli();
-    /* initialization after Update */
-    PeerAddress = CALC_PEER_ADDRESS(NodeConfig.short_addr);
+    prx->end = 0;
+    sei();
+}
 
-    TxBuf.start = sizeof(p2p_wuart_data_t);
-    TxBuf.end = UART_FRAME_SIZE - CRC_SIZE;
+/**
+ * Return the HIF baud rate of a node config.
+ */
+static uint32_t wuart_baudrate(node_config_t *nc)
+{
+uint8_t idx;
+
+    idx = NC_MODE(nc) & WUART_MODE_BAUD_MASK;
+    if ((NC_MODE(nc) == 0xff) || (idx >= BAUDRATE_COUNT))
+    {
+        return HIF_DEFAULT_BAUDRATE;
+    }
+    return pgm_read_dword(&baudrates[idx]);
+}
 
-    FILL_P2P_HEADER_NOACK((&TxBuf.data.hdr.hdr),
-                          NodeConfig.pan_id,
-                          PeerAddress,
-                          NodeConfig.short_addr,
-                          P2P_WUART_DATA);
-    TxBuf.data.hdr.mode = 0x55;
+/**
+ * Move pending UART input into the RX ring.
+ *
+ * When the ring is full, the bytes stay in the HIF buffer, whose
+ * RTS line holds the sender off on boards with flow control.
+ */
+static void rx_ring_fill(void)
+{
+int c;
 
-    radio_set_param(RP_IDLESTATE(STATE_RX));
+    while ((uint16_t)(RxRingHead - RxRingTail) < WUART_RX_RING_SIZE)
+    {
+        c = hif_getc();
+        if (EOF == c)
+        {
+            break;
+        }
+        RxRing[RxRingHead++ & RX_RING_MASK] = (uint8_t)c;
+    }
+}
+
+/**
+ * Take a character from the RX ring, EOF if it is empty.
+ */
+static int rx_ring_getc(void)
+{
+    if (RxRingHead == RxRingTail)
+    {
+        return EOF;
+    }
+    return RxRing[RxRingTail++ & RX_RING_MASK];
+}
+
+/**
+ * Empty a TX buffer, keeping its frame header.
+ */
+static void tx_buffer_reset(wuart_buffer_t *ptx)
+{
+    ptx->start = sizeof(p2p_wuart_data_t);
+    ptx->end = UART_FRAME_SIZE - CRC_SIZE;
+}
+
+static void configure_radio(void)
+{
+uint32_t ticks;
+uint16_t peer;
+uint8_t i, k;
+wuart_peer_t *pp;
+
+    cli();
+    /* initialization after Update */
+    Star = wuart_central(&NodeConfig);
+    NPeers = Star ? WUART_STAR_PEERS : 1;
+    peer = wuart_peer_address(&NodeConfig);
+    /* broadcast frames are never acknowledged */
+    Reliable = wuart_reliable(&NodeConfig) && (peer != 0xffff);
+
+    for (k = 0; k < NPeers; k++)
+    {
+        pp = &Peers[k];
+        pp->addr = peer + k;
+        for (i = 0; i < 2; i++)
+        {
+            tx_buffer_reset(&pp->tx[i]);
+            if (Reliable)
+            {
+                FILL_P2P_HEADER_ACK((&pp->tx[i].data.hdr.hdr),
+                                    NodeConfig.pan_id,
+                                    pp->addr,
+                                    NodeConfig.short_addr,
+                                    P2P_WUART_DATA);
+            }
+            else
+            {
+                FILL_P2P_HEADER_NOACK((&pp->tx[i].data.hdr.hdr),
+                                      NodeConfig.pan_id,
+                                      pp->addr,
+                                      NodeConfig.short_addr,
+                                      P2P_WUART_DATA);
+            }
+            pp->tx[i].data.hdr.mode = 0x55;
+        }
+        pp->fill = 0;
+        pp->ready = false;
+        pp->rx->end = 0;
+        pp->rx_seq = 0x100;
+    }
+    TxPeer = TxPeerNext = 0;
+    TxSlot = 0;
+    TxSending = false;
+    RxAckOff = false;
+    HifInDle = false;
+    HifOutPeer = 0xff;
+
+    /* 10 bit per character, rounded up to full ticks */
+    ticks = (aggr_chars(&NodeConfig) * 10UL * TIMER_TICKS_PER_SEC +
+             Baudrate - 1) / Baudrate;
+    AggrTicks = (ticks > 127) ? 127 : ((ticks == 0) ? 1 : ticks);
+
+    radio_set_param(RP_IDLESTATE(Reliable ? STATE_RXAUTO : STATE_RX));
     radio_set_param(RP_CHANNEL(NodeConfig.channel));
     radio_set_param(RP_SHORTADDR(NodeConfig.short_addr));
     radio_set_param(RP_PANID(NodeConfig.pan_id));
-    radio_set_state(STATE_RX);
+#if defined(RG_TRX_RPC)
+    radio_set_param(RP_RPC(wuart_rpc(&NodeConfig) ? WUART_RPC_MODES : RADIO_RPC_OFF));
+#endif
+    radio_set_state(Reliable ? STATE_RXAUTO : STATE_RX);
+#ifdef SR_AACK_DIS_ACK
+    trx_bit_write(SR_AACK_DIS_ACK, 0);
+#endif
     sei();
 }
 
@@ -192,16 +506,34 @@ int inchar;
 node_config_t nc;
 
     memcpy(&nc, &NodeConfig, sizeof(node_config_t) );
-    peer = (nc.short_addr == 0xffff) ? 0xffff : nc.short_addr ^ 1;
     do
     {
         if (refresh)
         {
-            peer = CALC_PEER_ADDRESS(nc.short_addr);
+            peer = wuart_peer_address(&nc);
             PRINT(EOL"MENU:"EOL);
             PRINTF("[a] node address: 0x%04x"EOL, nc.short_addr);
-            PRINTF("    peer address: 0x%04x"EOL, peer);
+            if (wuart_central(&nc))
+            {
+                PRINTF("    remotes:      0x%04x ... 0x%04x"EOL,
+                       peer, peer + WUART_STAR_PEERS - 1);
+            }
+            else
+            {
+                PRINTF("    peer address: 0x%04x"EOL, peer);
+            }
+            PRINTF("[s] star:         %s"EOL,
+                   wuart_central(&nc) ? "central" :
+                   (wuart_star(&nc) ? "remote" : "off"));
             PRINTF("[c] channel:      %d"EOL, nc.channel);
+            PRINTF("[t] aggregation:  %d chars"EOL, aggr_chars(&nc));
+            PRINTF("[m] reliable:     %s"EOL,
+                   wuart_reliable(&nc) ? "on" : "off");
+            PRINTF("[b] baudrate:     %lu"EOL, wuart_baudrate(&nc));
+#if defined(RG_TRX_RPC)
+            PRINTF("[p] low power rx: %s"EOL,
+                   wuart_rpc(&nc) ? "on" : "off");
+#endif
             PRINT("[r] reset changes"EOL
                   "[e] save and exit"EOL
                   "[q] discard changes and exit"EOL
@@ -231,6 +563,59 @@ node_config_t nc;
                     PRINT("unsupported channel");
                 }
                 break;
+            case 't':
+                PRINT("enter aggregation time in characters: ");
+                val = get_number(10);
+                if (val > 0 && val < 0xff)
+                {
+                    NC_AGGR_CHARS(&nc) = val;
+                    dirty = true;
+                }
+                break;
+            case 'm':
+                if (NC_MODE(&nc) == 0xff)
+                {
+                    NC_MODE(&nc) = WUART_MODE_BAUD_MASK;
+                }
+                NC_MODE(&nc) ^= WUART_MODE_RELIABLE;
+                dirty = true;
+                break;
+            case 's':
+                if (NC_MODE(&nc) == 0xff)
+                {
+                    NC_MODE(&nc) = WUART_MODE_BAUD_MASK;
+                }
+                NC_MODE(&nc) ^= WUART_MODE_STAR;
+                dirty = true;
+                break;
+#if defined(RG_TRX_RPC)
+            case 'p':
+                if (NC_MODE(&nc) == 0xff)
+                {
+                    NC_MODE(&nc) = WUART_MODE_BAUD_MASK;
+                }
+                NC_MODE(&nc) ^= WUART_MODE_RPC;
+                dirty = true;
+                break;
+#endif
+            case 'b':
+                for (val = 0; val < BAUDRATE_COUNT; val++)
+                {
+                    PRINTF("  %d: %lu"EOL, val, pgm_read_dword(&baudrates[val]));
+                }
+                PRINT("enter baudrate index: ");
+                val = get_number(10);
+                if (val < BAUDRATE_COUNT)
+                {
+                    if (NC_MODE(&nc) == 0xff)
+                    {
+                        NC_MODE(&nc) = 0;
+                    }
+                    NC_MODE(&nc) &= ~WUART_MODE_BAUD_MASK;
+                    NC_MODE(&nc) |= val;
+                    dirty = true;
+                }
+                break;
             case 'r':
                 memcpy(&nc, &NodeConfig, sizeof(node_config_t) );
                 break;
@@ -275,20 +660,32 @@ static void inline send_ping_reply(void)
 int main(void)
 {
 int inchar;
-uint8_t pluscnt = 0;
-bool do_send;
-wuart_buffer_t *prx;
+uint8_t pluscnt = 0, i;
+bool do_send, tx_full;
+wuart_buffer_t *ptx;
+wuart_peer_t *pp;
 
     wuart_init();
     WuartState = DATA_MODE;
     do
     {
-        inchar = hif_getc();
+        /* leave further input in the UART, while both TX buffers are full
+         * or the partial frame of the last remote waits for a TX buffer */
+        rx_ring_fill();
+        pp = &Peers[TxPeer];
+        ptx = &pp->tx[pp->fill];
+        tx_full = ((ptx->start + pluscnt) >= ptx->end) ||
+                  (TxPeerNext != TxPeer);
+        inchar = tx_full ? EOF : rx_ring_getc();
 
         /* state machine to detect Hayes '302 break condition */
-        switch (WuartState)
+        switch (tx_full ? DATA_MODE : WuartState)
         {
             case DATA_MODE:
+                if (tx_full)
+                {
+                    break;
+                }
                 if (EOF == inchar)
                 {
                     EscapeTmoCounter = 255;
@@ -335,6 +732,15 @@ wuart_buffer_t *prx;
             case DO_CONFIGURE:
                 radio_set_state(STATE_OFF);
                 do_configure_dialog();
+                if (wuart_baudrate(&NodeConfig) != Baudrate)
+                {
+                    Baudrate = wuart_baudrate(&NodeConfig);
+                    PRINTF("switch to %lu baud"EOL, Baudrate);
+                    /* let the UART send the message at the old rate */
+                    DELAY_MS(100);
+                    hif_init(Baudrate);
+                }
+                RxRingHead = RxRingTail = 0;
                 configure_radio();
                 WuartState = DATA_MODE;
                 break;
@@ -343,57 +749,92 @@ wuart_buffer_t *prx;
         if (WuartState != DO_CONFIGURE)
         {
             /* handle data "coming from air" */
-            prx = &RxBuf[RxbufIdx^1];
-            while(prx->start <= prx->end)
+            for (i = 0; i < NPeers; i++)
             {
-                hif_putc(prx->data.buf[prx->start++]);
+                rx_drain(i);
             }
+#ifdef SR_AACK_DIS_ACK
             cli();
-            prx->end = 0;
+            for (i = 0; (i < NPeers) && (Peers[i].rx->end == 0); i++)
+            {
+                /* count the empty RX buffers */
+            }
+            if (RxAckOff && (i == NPeers))
+            {
+                /* the drain buffers are free again, accept further frames */
+                trx_bit_write(SR_AACK_DIS_ACK, 0);
+                RxAckOff = false;
+            }
             sei();
+#endif
 
             /* handle data "going to air" */
             do_send = false;
-            if ((TxBuf.start + pluscnt) >= TxBuf.end)
+            if (ptx->start == sizeof(p2p_wuart_data_t))
             {
-                do_send = true;
+                /* nothing left for the last remote, switch to the next */
+                TxPeer = TxPeerNext;
             }
-            else if ((LastTransmitCounter == 0) &&
-                     (TxBuf.start > sizeof(p2p_wuart_data_t)))
+            else if (tx_full || (LastTransmitCounter == 0))
             {
                 do_send = true;
             }
 
-            if (do_send == true)
+            if ((do_send == true) && (pp->ready == false))
+            {
+                /* hand the buffer over to the radio, fill the other one */
+                pp->tx[pp->fill].data.hdr.hdr.seq = pp->seq++;
+                pp->ready = true;
+                pp->fill ^= 1;
+                tx_buffer_reset(&pp->tx[pp->fill]);
+                TxPeer = TxPeerNext;
+            }
+
+            if ((TxSending == false) && (TxPending == false))
             {
-                /* wait here, while TX is busy */
-                while(TxPending == true)
-                    ;
-                radio_set_state(STATE_TXAUTO);
-                TxPending = true;
-                TxBuf.data.hdr.hdr.seq ++;
-                radio_send_frame(TxBuf.start + CRC_SIZE, TxBuf.data.buf, 0);
-                LastTransmitCounter = 100;
-                TxBuf.start = sizeof(p2p_wuart_data_t);
-                TxBuf.end = UART_FRAME_SIZE - CRC_SIZE;
-                LED_SET(1);
+                /* round robin over the peers with a complete frame,
+                 * a retry reuses the buffer and its sequence number */
+                for (i = 0; i < NPeers; i++)
+                {
+                    TxSlot = (TxSlot + 1 < NPeers) ? TxSlot + 1 : 0;
+                    pp = &Peers[TxSlot];
+                    if (pp->ready)
+                    {
+                        ptx = &pp->tx[pp->fill ^ 1];
+                        radio_set_state(STATE_TXAUTO);
+                        TxPending = true;
+                        TxSending = true;
+                        radio_send_frame(ptx->start + CRC_SIZE, ptx->data.buf, 0);
+                        LED_SET(1);
+                        break;
+                    }
+                }
             }
         }
 
         if (WuartState == DATA_MODE)
         {
             /* handle data coming from hif/uart */
+            pp = &Peers[TxPeer];
+            ptx = &pp->tx[pp->fill];
             while (pluscnt)
             {
                 //hif_putc('+');
                 --pluscnt;
-                TxBuf.data.buf[TxBuf.start++] = '+';
+                ptx->data.buf[ptx->start++] = '+';
+            }
+            if ((EOF != inchar) && Star &&
+                (star_hif_input((uint8_t)inchar) == false))
+            {
+                /* remote select, taken by TxPeer once the frame is out */
             }
-            if (EOF != inchar)
+            else if (EOF != inchar)
             {
                 /* fill in new bytes */
                 //hif_putc(inchar);
-                TxBuf.data.buf[TxBuf.start++] = (uint8_t)inchar;
+                ptx->data.buf[ptx->start++] = (uint8_t)inchar;
+                /* restart the idle timeout */
+                LastTransmitCounter = AggrTicks;
             }
         }
 
@@ -402,6 +843,12 @@ wuart_buffer_t *prx;
         {
             send_ping_reply();
         }
+
+        if (RxRingHead == RxRingTail)
+        {
+            /* UART input, frames and the aggregation timer wake it */
+            pm_idle();
+        }
     }
     while(1);
 
@@ -420,9 +867,14 @@ void usr_radio_error(radio_error_t err)
 void usr_radio_tx_done(radio_tx_done_t status)
 {
     LED_CLR(1);
-    if (status == TX_OK)
+    if (TxSending)
     {
-        //LED_CLR(1);
+        TxSending = false;
+        if ((status == TX_OK) || (Reliable == false))
+        {
+            /* release the buffer, otherwise it is sent again */
+            Peers[TxSlot].ready = false;
+        }
     }
     TxPending = false;
 }
@@ -467,20 +919,42 @@ uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi,
 {
 uint8_t __sreg = SREG; cli();
 p2p_hdr_t *pfrm;
+wuart_peer_t *pp;
+wuart_buffer_t *prx;
+uint8_t slot;
 
     if ((crc == 0) && (len > sizeof(p2p_hdr_t)))
     {
         pfrm = (p2p_hdr_t*) frm;
-        if (pfrm->cmd == P2P_WUART_DATA)
+        slot = wuart_slot(pfrm->src);
+        pp = &Peers[slot];
+        if ((pfrm->cmd == P2P_WUART_DATA) && (slot < NPeers))
         {
-            if( RxBuf[(RxbufIdx^1)].end == 0)
+            if ((pfrm->fcf & FCTL_ACK) && (pfrm->seq == pp->rx_seq))
+            {
+                /* retry of an already accepted frame, whose ACK was lost */
+            }
+            else if (pp->rx->end == 0)
             {
+                /* with the ACKs held back for another remote, the
+                 * retry of this frame is dropped as a duplicate */
                 LED_TOGGLE(0);
                 /* yes, we can do a swap */
-                RxBuf[RxbufIdx].start = sizeof(p2p_wuart_data_t);
-                RxBuf[RxbufIdx].end = len - CRC_SIZE - 1;
-                RxbufIdx ^= 1;
-                frm = RxBuf[RxbufIdx].data.buf;
+                prx = RxFrame;
+                prx->start = sizeof(p2p_wuart_data_t);
+                prx->end = len - CRC_SIZE - 1;
+                RxFrame = pp->rx;
+                pp->rx = prx;
+                frm = RxFrame->data.buf;
+                pp->rx_seq = (pfrm->fcf & FCTL_ACK) ? pfrm->seq : 0x100;
+#ifdef SR_AACK_DIS_ACK
+                if (Reliable)
+                {
+                    /* no ACKs until the main loop has drained the data */
+                    trx_bit_write(SR_AACK_DIS_ACK, 1);
+                    RxAckOff = true;
+                }
+#endif
             }
         }
         else if (pfrm->cmd == P2P_JUMP_BOOTL)
@@ -502,6 +976,7 @@ p2p_hdr_t *pfrm;
  */
 ISR(TIMER_IRQ_vect)
 {
+    PM_EVENT();
     if (EscapeTmoCounter > 0)
     {
         EscapeTmoCounter--;
@@ -49,6 +49,114 @@
 # define UART_FRAME_SIZE (MAX_FRAME_SIZE)
 #endif
 
+#ifndef WUART_AGGR_CHARS
+/**
+ * Default idle time in character times at the HIF baud rate, after which
+ * a partially filled frame is sent. Bulk data is sent in full frames,
+ * since the line does not get idle.
+ */
+# define WUART_AGGR_CHARS (4)
+#endif
+
+/**
+ * The aggregation time in character times is kept in the node config,
+ * 0 or 0xff select @ref WUART_AGGR_CHARS.
+ */
+#define NC_AGGR_CHARS(nc) ((nc)->_reserved_[1])
+
+/**
+ * Mode flags in the node config, 0xff (erased EEPROM) selects the defaults.
+ */
+#define NC_MODE(nc) ((nc)->_reserved_[0])
+
+/**
+ * Reliable mode: data frames are sent with ACK request and retried by
+ * the transceiver (TX_ARET), the receiver drops duplicates by sequence
+ * number and holds back the ACK while its drain buffer is full.
+ */
+#define WUART_MODE_RELIABLE (0x80)
+
+/**
+ * Low power receive mode: the reduced power consumption modes
+ * @ref WUART_RPC_MODES of the transceiver are used while listening,
+ * on transceivers that have them (RG_TRX_RPC).
+ */
+#define WUART_MODE_RPC (0x40)
+
+#ifndef WUART_RPC_MODES
+/** radio_set_param(RP_RPC()) value of @ref WUART_MODE_RPC */
+# define WUART_RPC_MODES (RADIO_RPC_ALL)
+#endif
+
+/**
+ * Star mode: one central node serves up to @ref WUART_STAR_PEERS remote
+ * nodes. The node whose address has the bits @ref WUART_STAR_MASK clear
+ * is the central. The remotes have the addresses central + 1 ...
+ * central + WUART_STAR_PEERS. A remote sends to the central as a
+ * p2p wuart sends to its peer. The central keeps TX and RX buffers per
+ * remote and tags the data on the HIF with @ref WUART_STAR_DLE.
+ */
+#define WUART_MODE_STAR (0x20)
+
+/** address bits of the remote in star mode */
+#define WUART_STAR_MASK (0x07)
+
+#ifndef WUART_STAR_PEERS
+/**
+ * Number of remotes a star central serves, each takes three frame
+ * buffers. With 0 a node can only be a remote.
+ */
+# if RAMEND > 0x2000
+#  define WUART_STAR_PEERS (WUART_STAR_MASK)
+# elif RAMEND > 0x1000
+#  define WUART_STAR_PEERS (3)
+# else
+#  define WUART_STAR_PEERS (0)
+# endif
+#endif
+#if WUART_STAR_PEERS > WUART_STAR_MASK
+# error "WUART_STAR_PEERS exceeds WUART_STAR_MASK"
+#endif
+
+/**
+ * HIF framing of the star central: DLE '1' ... DLE '7' selects the remote
+ * of the following data, in both directions. DLE DLE is a data byte
+ * DLE. The central sends the select before data of another remote than
+ * the last one, the host sends it before data for another remote.
+ */
+#define WUART_STAR_DLE (0x10)
+
+/** number of peer slots, a p2p wuart uses the first one */
+#if WUART_STAR_PEERS > 0
+# define WUART_NSLOTS (WUART_STAR_PEERS)
+#else
+# define WUART_NSLOTS (1)
+#endif
+
+/**
+ * The low nibble of the mode flags is an index into the baud rate table,
+ * 0x0f selects HIF_DEFAULT_BAUDRATE.
+ */
+#define WUART_MODE_BAUD_MASK (0x0f)
+
+#ifndef WUART_RX_RING_SIZE
+/**
+ * Size of the ring (a power of 2), that collects UART input while both
+ * TX buffers wait for the radio. At 230400 baud 23 bytes arrive per ms,
+ * a TX_ARET transaction with retries takes up to about 20 ms.
+ */
+# if RAMEND > 4096
+#  define WUART_RX_RING_SIZE (512)
+# elif RAMEND > 2048
+#  define WUART_RX_RING_SIZE (256)
+# else
+#  define WUART_RX_RING_SIZE (64)
+# endif
+#endif
+
+/** timer ticks per second */
+#define TIMER_TICKS_PER_SEC ((uint32_t)(1.0 / TIMER_TICK))
+
 #ifndef DEFAULT_RADIO_CHANNEL
 /** radio channel */
 # if defined(TRX_SUPPORTS_BAND_800)
@@ -79,6 +187,22 @@ typedef struct
     } data;
 } wuart_buffer_t;
 
+/** A peer, the p2p peer or a remote of the star central */
+typedef struct
+{
+    /** The UART fills tx[fill], while the other one waits for the radio. */
+    wuart_buffer_t tx[2];
+    uint8_t fill;
+    /** tx[fill^1] is complete and waits to be sent or acknowledged */
+    volatile bool ready;
+    uint8_t seq;
+    /** received data, that waits for the UART, end == 0 if it is empty */
+    wuart_buffer_t * volatile rx;
+    /** sequence number of the last accepted frame, 0x100 - none */
+    uint16_t rx_seq;
+    uint16_t addr;
+} wuart_peer_t;
+
 
 /** application states */
 typedef enum
@@ -97,6 +221,15 @@ extern "C" {
 
 static void wuart_init(void);
 static void configure_radio(void);
+static void tx_buffer_reset(wuart_buffer_t *ptx);
+static uint8_t aggr_chars(node_config_t *nc);
+static bool wuart_reliable(node_config_t *nc);
+static bool wuart_star(node_config_t *nc);
+static bool wuart_central(node_config_t *nc);
+static uint16_t wuart_peer_address(node_config_t *nc);
+static uint32_t wuart_baudrate(node_config_t *nc);
+static void rx_ring_fill(void);
+static int rx_ring_getc(void);
 
 static  uint16_t get_number(int8_t base);
 
@@ -0,0 +1,584 @@
+/* Copyright (c) 2008 - 2013 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+
+/* $Id$ */
+/*
+ * Radio benchmark with a sender and a reflector.
+ *
+ * Both nodes run the same firmware and start as reflector. Typing 's'
+ * on the HIF of one node makes it the sender, it sweeps all data rates
+ * of trx_get_number_datarates() and the TX power table. Each run sends
+ * BENCH_FRAMES data frames in TX_ARET mode and waits for their echo,
+ * the results are printed as one line of key=value pairs per run:
+ *
+ *   bench rate=OQPSK250 pwr=3 len=100 sent=200 rcvd=200 per=0 fps=..
+ *
+ * The values are: per - round trip frame error rate in 1/1000,
+ * fps - echoed frames/s, goodput - echoed payload bytes/s,
+ * cca/noack - CSMA and ACK failures of the sender, rtt_* - round trip
+ * time in us, hist - number of echos with rtt < 1, 2, 4 .. 64 ms, >= 64 ms.
+ *
+ * With antenna diversity support (SR_ANT_DIV_EN), 'a' compares the packet
+ * error rate of antenna 0, antenna 1 and diversity at the base rate for
+ * each power. ant= is the setting of both nodes, ant0/ant1 the number of
+ * echos received at each antenna:
+ *
+ *   bench rate=OQPSK250 pwr=-17 len=100 ant=div sent=200 rcvd=196 per=20 ..
+ *
+ * With the reduced power receiver modes (RG_TRX_RPC), 'p' compares the
+ * packet error rate with rpc=off and rpc=on (RADIO_RPC_ALL) at the base
+ * rate for each power, the setting is used by both nodes. The current
+ * can not be measured by the firmware, 'i' on the HIF of the reflector
+ * toggles the RPC setting of its idle listening, so that it can be read
+ * with an ammeter in both modes.
+ *
+ * Commands: 's' sweep, 'r' single run at the current settings,
+ *           'a' antenna comparison, 'p' RPC comparison, 'i' idle RPC,
+ *           'l' enter payload length, 'n' enter number of frames.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include "board.h"
+#include "hif.h"
+#include "radio.h"
+#include "timer.h"
+#include "xmpl.h"
+
+/* === Macros ========================================================== */
+#define CRC_SIZE             (2)
+#define BENCH_PANID          (0xbe00)
+#define BENCH_REFLECTOR_ADDR (0x0001)
+#define BENCH_SENDER_ADDR    (0x0002)
+#define BENCH_FCF            (0x8861) /* data frame, ACK request */
+#define BENCH_CMD_CFG        ('C')
+#define BENCH_CMD_DATA       ('D')
+#define BENCH_FRAMES         (200)
+#define BENCH_HIST_BINS      (8)
+#define BENCH_CFG_RETRIES    (5)
+/** timeout for an echo */
+#define BENCH_TMO_US         (50000UL)
+/** a reflector returns to the base settings after this idle time */
+#define BENCH_IDLE_US        (300000UL)
+
+#define US_TO_TICKS(us) ((uint32_t)((us) * 1.0e-6 / HWTIMER_TICK))
+#define TICKS_TO_US(t)  ((uint32_t)((t) * (HWTIMER_TICK * 1.0e6)))
+
+/* === Types =========================================================== */
+typedef struct
+{
+    uint16_t fcf;
+    uint8_t  seq;
+    uint16_t pan;
+    uint16_t dst;
+    uint16_t src;
+    uint8_t  cmd;
+    uint16_t bseq;
+    /* settings of the run, used by BENCH_CMD_CFG */
+    uint8_t  rate;
+    int8_t   pwr;
+    uint8_t  ant;
+    uint8_t  rpc;
+    uint8_t  data[MAX_FRAME_SIZE - 16 - CRC_SIZE];
+    uint8_t  crc[CRC_SIZE];
+} bench_frame_t;
+
+#define BENCH_HDR_SIZE (offsetof(bench_frame_t, data))
+
+typedef struct
+{
+    uint16_t sent;
+    uint16_t rcvd;
+    uint16_t cca_fail;
+    uint16_t no_ack;
+    uint32_t rtt_min;
+    uint32_t rtt_max;
+    uint32_t rtt_sum;
+    uint32_t elapsed;
+    uint16_t hist[BENCH_HIST_BINS];
+    uint16_t ant[2];
+} bench_result_t;
+
+/* === Globals ========================================================= */
+static uint8_t RxFrame[MAX_FRAME_SIZE];
+static bench_frame_t TxFrame;
+static bench_frame_t RxCopy;
+static volatile uint8_t RxLen;
+static volatile uint32_t RxTicks;
+static volatile uint8_t RxAnt;
+static volatile bool TxDone;
+static volatile radio_tx_done_t TxStatus;
+
+/** TX power values in dBm, the driver ignores values it does not support */
+static const int8_t PROGMEM pwr_table[] = {3, -1, -5, -9, -13, -17};
+
+static uint8_t BaseRate;
+static uint8_t PayloadLen = 100;
+static uint16_t NumFrames = BENCH_FRAMES;
+/** antenna setting of the runs, RADIO_ANT_OFF = no switch control as after reset */
+static uint8_t AntMode = RADIO_ANT_OFF;
+/** RPC setting of the runs and of the idle reflector, RADIO_RPC_OFF as after reset */
+static uint8_t RpcMode = RADIO_RPC_OFF;
+static uint8_t BaseRpc = RADIO_RPC_OFF;
+
+/* === Implementation ================================================== */
+
+/**
+ * Return a free running time stamp in hardware timer ticks.
+ *
+ * Taken in an ISR, it may lag by one timer period, if the
+ * timer overflow is pending.
+ */
+static uint32_t bench_ticks(void)
+{
+time_stamp_t ts;
+
+    timer_get_tstamp(&ts);
+    return ts.time_sec * HWTIMER_TICK_NB + ts.time_usec;
+}
+
+static void bench_set(uint8_t rate, int8_t pwr, uint8_t ant, uint8_t rpc)
+{
+    radio_set_state(STATE_OFF);
+    if (rate != RATE_NONE)
+    {
+        radio_set_param(RP_DATARATE(rate));
+    }
+    radio_set_param(RP_TXPWR(pwr));
+#if defined(SR_ANT_DIV_EN)
+    radio_set_param(RP_ANT_DIV(ant));
+#endif
+#if defined(RG_TRX_RPC)
+    radio_set_param(RP_RPC(rpc));
+#endif
+    radio_set_state(STATE_RXAUTO);
+}
+
+static void bench_init(uint16_t addr)
+{
+    radio_set_state(STATE_OFF);
+    radio_set_param(RP_CHANNEL(CHANNEL));
+    radio_set_param(RP_IDLESTATE(STATE_RXAUTO));
+    radio_set_param(RP_SHORTADDR(addr));
+    radio_set_param(RP_PANID(BENCH_PANID));
+    bench_set(BaseRate, (int8_t)pgm_read_byte(&pwr_table[0]), RADIO_ANT_OFF, BaseRpc);
+
+    TxFrame.fcf = BENCH_FCF;
+    TxFrame.pan = BENCH_PANID;
+    TxFrame.src = addr;
+    TxFrame.dst = (addr == BENCH_SENDER_ADDR) ?
+                  BENCH_REFLECTOR_ADDR : BENCH_SENDER_ADDR;
+}
+
+/**
+ * Send TxFrame with len payload bytes and wait for the TX_ARET result.
+ */
+static radio_tx_done_t bench_send(uint8_t len)
+{
+    TxDone = false;
+    TxFrame.seq++;
+    radio_set_state(STATE_TXAUTO);
+    radio_send_frame(BENCH_HDR_SIZE + len + CRC_SIZE, (uint8_t*)&TxFrame, 0);
+    while (TxDone == false)
+    {
+        /* wait */
+    }
+    return TxStatus;
+}
+
+/**
+ * Wait for a received frame with command cmd and sequence number bseq.
+ * @return true, if it arrived within tmo ticks after t0.
+ */
+static bool bench_wait_rx(uint8_t cmd, uint16_t bseq, uint32_t t0, uint32_t tmo)
+{
+    do
+    {
+        if (RxLen != 0)
+        {
+            if ((RxCopy.cmd == cmd) && (RxCopy.bseq == bseq))
+            {
+                return true;
+            }
+            /* a late echo of an earlier frame */
+            RxLen = 0;
+        }
+    }
+    while ((bench_ticks() - t0) < tmo);
+    return false;
+}
+
+static void bench_print(uint8_t rate, int8_t pwr, bench_result_t *res)
+{
+char rstr[16];
+uint8_t i;
+uint32_t fps, goodput;
+
+    rstr[0] = 0;
+    trx_decode_datarate(rate, rstr, sizeof(rstr));
+    rstr[sizeof(rstr) - 1] = 0;
+    fps = goodput = 0;
+    if (res->elapsed > 0)
+    {
+        fps = (uint32_t)(res->rcvd * 1.0e6 / res->elapsed);
+        goodput = (uint32_t)((float)res->rcvd * PayloadLen * 1.0e6 / res->elapsed);
+    }
+    PRINTF("bench rate=%s pwr=%d len=%d", rstr, pwr, PayloadLen);
+#if defined(SR_ANT_DIV_EN)
+    if (AntMode != RADIO_ANT_OFF)
+    {
+        PRINTF(" ant=%s", (AntMode == RADIO_ANT_DIVERSITY) ? "div" :
+                          (AntMode == RADIO_ANT_0) ? "0" : "1");
+    }
+#endif
+#if defined(RG_TRX_RPC)
+    PRINTF(" rpc=%s", (RpcMode != RADIO_RPC_OFF) ? "on" : "off");
+#endif
+    PRINTF(" sent=%u rcvd=%u per=%u fps=%lu goodput=%lu cca=%u noack=%u",
+           res->sent, res->rcvd,
+           res->sent ? (uint16_t)((res->sent - res->rcvd) * 1000UL / res->sent) : 0,
+           fps, goodput, res->cca_fail, res->no_ack);
+    PRINTF(" rtt_min=%lu rtt_avg=%lu rtt_max=%lu hist=",
+           res->rcvd ? res->rtt_min : 0,
+           res->rcvd ? res->rtt_sum / res->rcvd : 0,
+           res->rtt_max);
+    for (i = 0; i < BENCH_HIST_BINS - 1; i++)
+    {
+        PRINTF("%u,", res->hist[i]);
+    }
+    PRINTF("%u", res->hist[i]);
+#if defined(SR_ANT_DIV_EN)
+    if (AntMode != RADIO_ANT_OFF)
+    {
+        PRINTF(" ant0=%u ant1=%u", res->ant[0], res->ant[1]);
+    }
+#endif
+    PRINT("\n\r");
+}
+
+/**
+ * Sender: configure the reflector, run the frames and print the result.
+ */
+static void bench_run(uint8_t rate, int8_t pwr)
+{
+bench_result_t res;
+uint32_t t0, tstart, rtt;
+uint16_t i;
+uint8_t bin, retry;
+bool ok = false;
+
+    memset(&res, 0, sizeof(res));
+    res.rtt_min = 0xffffffffUL;
+
+    /* the settings are exchanged at the base rate and full power */
+    TxFrame.cmd = BENCH_CMD_CFG;
+    TxFrame.rate = rate;
+    TxFrame.pwr = pwr;
+    TxFrame.ant = AntMode;
+    TxFrame.rpc = RpcMode;
+    for (retry = 0; (retry < BENCH_CFG_RETRIES) && !ok; retry++)
+    {
+        TxFrame.bseq = retry;
+        RxLen = 0;
+        t0 = bench_ticks();
+        if (bench_send(0) == TX_OK)
+        {
+            ok = bench_wait_rx(BENCH_CMD_CFG, retry, t0, US_TO_TICKS(BENCH_TMO_US));
+        }
+    }
+    if (!ok)
+    {
+        PRINTF("bench rate=%d pwr=%d error=noreflector\n\r", rate, pwr);
+        return;
+    }
+    /* give the reflector time to switch */
+    DELAY_MS(5);
+    bench_set(rate, pwr, AntMode, RpcMode);
+
+    TxFrame.cmd = BENCH_CMD_DATA;
+    for (i = 0; i < PayloadLen; i++)
+    {
+        TxFrame.data[i] = i;
+    }
+    tstart = bench_ticks();
+    for (i = 0; i < NumFrames; i++)
+    {
+        LED_TOGGLE(0);
+        TxFrame.bseq = i;
+        RxLen = 0;
+        t0 = bench_ticks();
+        res.sent++;
+        switch (bench_send(PayloadLen))
+        {
+            case TX_OK:
+                break;
+            case TX_CCA_FAIL:
+                res.cca_fail++;
+                continue;
+            case TX_NO_ACK:
+                res.no_ack++;
+                continue;
+            default:
+                continue;
+        }
+        if (bench_wait_rx(BENCH_CMD_DATA, i, t0, US_TO_TICKS(BENCH_TMO_US)))
+        {
+            rtt = TICKS_TO_US(RxTicks - t0);
+            res.rcvd++;
+            res.rtt_sum += rtt;
+            if (rtt < res.rtt_min)
+            {
+                res.rtt_min = rtt;
+            }
+            if (rtt > res.rtt_max)
+            {
+                res.rtt_max = rtt;
+            }
+            for (bin = 0; (bin < BENCH_HIST_BINS - 1) && (rtt >= (1000UL << bin)); bin++)
+            {
+                /* find the log2 bin */
+            }
+            res.hist[bin]++;
+            res.ant[RxAnt & 1]++;
+        }
+    }
+    res.elapsed = TICKS_TO_US(bench_ticks() - tstart);
+
+    /* back to the base settings, after the reflector did it */
+    bench_set(BaseRate, (int8_t)pgm_read_byte(&pwr_table[0]), RADIO_ANT_OFF, BaseRpc);
+    DELAY_MS(BENCH_IDLE_US / 1000 + 100);
+    bench_print(rate, pwr, &res);
+}
+
+static void bench_sweep(void)
+{
+uint8_t r, p;
+
+    PRINTF("bench start len=%d frames=%u rates=%d\n\r",
+           PayloadLen, NumFrames, trx_get_number_datarates());
+    for (r = 0; r < trx_get_number_datarates(); r++)
+    {
+        for (p = 0; p < sizeof(pwr_table); p++)
+        {
+            bench_run(trx_get_datarate_hash(r),
+                      (int8_t)pgm_read_byte(&pwr_table[p]));
+        }
+    }
+    PRINT("bench done\n\r");
+}
+
+#if defined(SR_ANT_DIV_EN)
+/**
+ * Packet error rate of each antenna and of diversity, at the base rate.
+ */
+static void bench_antennas(void)
+{
+static const uint8_t PROGMEM ant_table[] =
+    {RADIO_ANT_0, RADIO_ANT_1, RADIO_ANT_DIVERSITY};
+uint8_t a, p;
+
+    PRINTF("bench start len=%d frames=%u antennas\n\r", PayloadLen, NumFrames);
+    for (p = 0; p < sizeof(pwr_table); p++)
+    {
+        for (a = 0; a < sizeof(ant_table); a++)
+        {
+            AntMode = pgm_read_byte(&ant_table[a]);
+            bench_run(BaseRate, (int8_t)pgm_read_byte(&pwr_table[p]));
+        }
+    }
+    AntMode = RADIO_ANT_OFF;
+    PRINT("bench done\n\r");
+}
+#endif
+
+#if defined(RG_TRX_RPC)
+/**
+ * Packet error rate with and without the reduced power receiver modes,
+ * at the base rate.
+ */
+static void bench_rpc(void)
+{
+uint8_t p;
+
+    PRINTF("bench start len=%d frames=%u rpc\n\r", PayloadLen, NumFrames);
+    for (p = 0; p < sizeof(pwr_table); p++)
+    {
+        RpcMode = RADIO_RPC_OFF;
+        bench_run(BaseRate, (int8_t)pgm_read_byte(&pwr_table[p]));
+        RpcMode = RADIO_RPC_ALL;
+        bench_run(BaseRate, (int8_t)pgm_read_byte(&pwr_table[p]));
+    }
+    RpcMode = BaseRpc;
+    PRINT("bench done\n\r");
+}
+#endif
+
+/**
+ * Reflector: echo each frame, apply the settings of a BENCH_CMD_CFG frame.
+ */
+static void bench_reflect(void)
+{
+static uint32_t tlast;
+static bool is_base = true;
+uint8_t len;
+
+    if (RxLen != 0)
+    {
+        cli();
+        len = RxLen;
+        memcpy(&TxFrame.cmd, &RxCopy.cmd, len - offsetof(bench_frame_t, cmd));
+        RxLen = 0;
+        sei();
+        tlast = bench_ticks();
+        bench_send(len - BENCH_HDR_SIZE - CRC_SIZE);
+        if (TxFrame.cmd == BENCH_CMD_CFG)
+        {
+            bench_set(TxFrame.rate, TxFrame.pwr, TxFrame.ant, TxFrame.rpc);
+            is_base = false;
+        }
+    }
+    else if (!is_base && ((bench_ticks() - tlast) > US_TO_TICKS(BENCH_IDLE_US)))
+    {
+        bench_set(BaseRate, (int8_t)pgm_read_byte(&pwr_table[0]), RADIO_ANT_OFF, BaseRpc);
+        is_base = true;
+    }
+}
+
+int main(void)
+{
+int inchar;
+
+    LED_INIT();
+    hif_init(HIF_DEFAULT_BAUDRATE);
+    timer_init();
+    radio_init(RxFrame, sizeof(RxFrame));
+    BaseRate = trx_get_datarate_hash(0);
+#if RADIO_TYPE == RADIO_AT86RF212
+    BaseRate = OQPSK100;
+#elif defined(TRX_OQPSK250)
+    BaseRate = OQPSK250;
+#endif
+    bench_init(BENCH_REFLECTOR_ADDR);
+    sei();
+
+    PRINTF("Radio Benchmark, reflector 0x%04x, chan %d\n\r"
+           " 's' sweep, 'r' run, 'a' antennas, 'p' rpc, 'i' idle rpc,"
+           " 'l' payload length, 'n' number of frames\n\r",
+           BENCH_REFLECTOR_ADDR, CHANNEL);
+
+    while(1)
+    {
+        inchar = hif_getc();
+        if (inchar == 's' || inchar == 'r' || inchar == 'a' || inchar == 'p')
+        {
+            bench_init(BENCH_SENDER_ADDR);
+            if (inchar == 's')
+            {
+                bench_sweep();
+            }
+            else if (inchar == 'a')
+            {
+#if defined(SR_ANT_DIV_EN)
+                bench_antennas();
+#else
+                PRINT("no antenna diversity\n\r");
+#endif
+            }
+            else if (inchar == 'p')
+            {
+#if defined(RG_TRX_RPC)
+                bench_rpc();
+#else
+                PRINT("no rpc\n\r");
+#endif
+            }
+            else
+            {
+                bench_run(BaseRate, (int8_t)pgm_read_byte(&pwr_table[0]));
+            }
+            bench_init(BENCH_REFLECTOR_ADDR);
+        }
+        else if (inchar == 'l')
+        {
+            PRINT("payload length: ");
+            inchar = hif_get_dec_number();
+            if (inchar >= 0 && inchar <= (int)sizeof(TxFrame.data))
+            {
+                PayloadLen = inchar;
+            }
+            PRINTF("\n\rlen=%d\n\r", PayloadLen);
+        }
+        else if (inchar == 'i')
+        {
+#if defined(RG_TRX_RPC)
+            BaseRpc = (BaseRpc == RADIO_RPC_OFF) ? RADIO_RPC_ALL : RADIO_RPC_OFF;
+            RpcMode = BaseRpc;
+            bench_set(BaseRate, (int8_t)pgm_read_byte(&pwr_table[0]), RADIO_ANT_OFF, BaseRpc);
+            PRINTF("idle rpc=%s\n\r", (BaseRpc != RADIO_RPC_OFF) ? "on" : "off");
+#else
+            PRINT("no rpc\n\r");
+#endif
+        }
+        else if (inchar == 'n')
+        {
+            PRINT("number of frames: ");
+            inchar = hif_get_dec_number();
+            if (inchar > 0)
+            {
+                NumFrames = inchar;
+            }
+            PRINTF("\n\rframes=%u\n\r", NumFrames);
+        }
+        bench_reflect();
+    }
+}
+
+uint8_t * usr_radio_receive_frame(uint8_t len, uint8_t *frm, uint8_t lqi,
+                                  int8_t ed, uint8_t crc)
+{
+bench_frame_t *pfrm = (bench_frame_t *) frm;
+
+    if ((crc == 0) && (RxLen == 0) &&
+        (len >= BENCH_HDR_SIZE + CRC_SIZE) && (len <= sizeof(bench_frame_t)) &&
+        ((pfrm->cmd == BENCH_CMD_CFG) || (pfrm->cmd == BENCH_CMD_DATA)))
+    {
+        RxTicks = bench_ticks();
+        RxAnt = radio_get_antenna();
+        memcpy(&RxCopy, frm, len);
+        RxLen = len;
+        LED_TOGGLE(1);
+    }
+    return frm;
+}
+
+void usr_radio_tx_done(radio_tx_done_t status)
+{
+    TxStatus = status;
+    TxDone = true;
+}
+/* XEOF */
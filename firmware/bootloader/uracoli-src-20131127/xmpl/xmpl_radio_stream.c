@@ -61,6 +61,8 @@ uint8_t cnt = 0;
     /* todo add buffer assignment as parameters to buffer_stream_init! */
     Rstream.pbufin  = (buffer_t *)ibuf;
     Rstream.pbufout = (buffer_t *)obuf;
+    /* send a frame per line or when the frame is full */
+    buffer_stream_set_watermark(&Rstream, XMPL_FRAME_SIZE, '\r');
     stdout = stdin = &Rstream.bstream;
 
     /* setup hardware */
@@ -89,11 +91,10 @@ uint8_t cnt = 0;
 void outcb(buffer_t *pbuf)
 {
 static uint8_t frame_header[] = {0x01, 0x80, 0, 0x11,0x22,0x33,0x44};
-char lastchar;
     //LED_TOGGLE(0);
 
-    lastchar = BUFFER_LAST_CHAR(pbuf);
-    if ((BUFFER_FREE_AT_END(pbuf) < 1) || (lastchar == '\r'))
+    /* in block mode, outcb is called once per frame */
+    if (BUFFER_SIZE(pbuf) > 0)
     {
         /* prepare send */
         buffer_prepend_block(pbuf, frame_header, sizeof(frame_header));
@@ -0,0 +1,99 @@
+/* Copyright (c) 2014 Axel Wachtler
+   All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above copyright
+     notice, this list of conditions and the following disclaimer in the
+     documentation and/or other materials provided with the distribution.
+   * Neither the name of the authors nor the names of its contributors
+     may be used to endorse or promote products derived from this software
+     without specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+
+/* $Id$ */
+/* Benchmark for the radio wake-up time (SLEEP/DEEPSLEEP to RX_ON) */
+
+#include "board.h"
+#include "transceiver.h"
+#include "radio.h"
+#include "ioutil.h"
+#include "xmpl.h"
+
+/* === macros ============================================================== */
+#define NB_RUNS (32)
+/** Timer1 free running with prescaler 8 */
+#define TSTAMP_INIT() do{ TCCR1A = 0; TCCR1B = _BV(CS11); }while(0)
+#define TSTAMP_TO_US(t) ((uint32_t)(t) * 8 / (F_CPU / 1000000UL))
+
+/* === globals ============================================================= */
+static uint8_t rxfrm[MAX_FRAME_SIZE];
+
+/* === functions =========================================================== */
+static void measure(radio_state_t sleepstate, const char *name)
+{
+uint16_t t, tmin = 0xffff, tmax = 0;
+uint32_t tsum = 0;
+uint8_t i;
+
+    for (i = 0; i < NB_RUNS; i++)
+    {
+        radio_set_state(sleepstate);
+        WAIT_MS(2);
+        t = TCNT1;
+        radio_set_state(STATE_RX);
+        t = TCNT1 - t;
+        tsum += t;
+        if (t < tmin) tmin = t;
+        if (t > tmax) tmax = t;
+        radio_set_state(STATE_OFF);
+    }
+    PRINTF("%-10s -> RX_ON: min %lu us, avg %lu us, max %lu us\n\r",
+           name, TSTAMP_TO_US(tmin), TSTAMP_TO_US(tsum / NB_RUNS),
+           TSTAMP_TO_US(tmax));
+    /* check that parameters survived */
+    PRINTF("  channel %d, pan 0x%02x%02x\n\r", trx_bit_read(SR_CHANNEL),
+           trx_reg_read(RG_PAN_ID_1), trx_reg_read(RG_PAN_ID_0));
+}
+
+int main(void)
+{
+    LED_INIT();
+    hif_init(HIF_DEFAULT_BAUDRATE);
+    TSTAMP_INIT();
+    radio_init(rxfrm, sizeof(rxfrm));
+    radio_set_state(STATE_OFF);
+    radio_set_param(RP_CHANNEL(CHANNEL));
+    radio_set_param(RP_PANID(PANID));
+    radio_set_param(RP_SHORTADDR(SHORT_ADDR));
+    sei();
+
+    PRINTF("Radio wake-up benchmark, %d runs\n\r", NB_RUNS);
+    while(1)
+    {
+        LED_TOGGLE(0);
+        measure(STATE_SLEEP, "SLEEP");
+#if defined(STATE_DEEPSLEEP) && defined(CMD_PREP_DEEP_SLEEP)
+        measure(STATE_DEEPSLEEP, "DEEPSLEEP");
+#endif
+        WAIT_MS(1000);
+    }
+}
+
+/* EOF */
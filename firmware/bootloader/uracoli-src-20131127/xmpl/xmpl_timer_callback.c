@@ -52,6 +52,7 @@ int main(void)
 
     while(1)
     {
+        timer_task();
         /*todo: add sleep macros here */
     }
 }
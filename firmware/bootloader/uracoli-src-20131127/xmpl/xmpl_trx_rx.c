@@ -85,7 +85,12 @@ trx_regval_t rval;
     rxcnt = 0;
 
     LED_SET_VALUE(0);
-    while(1);
+    pm_set_active(PM_RADIO);
+    while(1)
+    {
+        /* the frames are handled in the ISR */
+        pm_idle();
+    }
 }
 
 #if defined(TRX_IF_RFA1)